@@ -0,0 +1,173 @@
+-- biscuit--2.4.1--2.5.0.sql
+-- Migration script: Biscuit 2.4.1 → 2.5.0
+--
+-- Changes in this release:
+--   Operators 5–8 (~, ~*, = and ^@) join biscuit_text_ops, so regular
+--            expressions, SIMILAR TO, equality, IN lists and prefix matches
+--            can use existing indexes.  biscuit_operators describes them.
+--   New biscuit_stat_get_indexes(), biscuit_stat_reset() and the
+--            biscuit_stat_indexes view (scan instrumentation).
+--   New biscuit_preload_status() and biscuit_prewarm_ready() (preload
+--            worker pool and startup prewarm).
+--
+-- The on-disk format changes too (metapage version 3).  Existing indexes
+-- need no REINDEX: each gets a current metapage the first time it is
+-- loaded or changed, and its snapshot is written at the next VACUUM.
+
+-- Complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION biscuit UPDATE TO '2.5.0'" to load this file. \quit
+
+-- ==================== OPERATORS 5–8 ====================
+--
+-- CREATE OPERATOR CLASS cannot be re-run on an existing class, so the new
+-- operators are added to its family.  The planner matches index clauses by
+-- family membership, which is all the index needs.
+
+ALTER OPERATOR FAMILY biscuit_text_ops USING biscuit ADD
+    OPERATOR 5 ~ (text, text),       -- regular expression, SIMILAR TO
+    OPERATOR 6 ~* (text, text),      -- regular expression (case-insensitive)
+    OPERATOR 7 = (text, text),       -- equality, IN lists
+    OPERATOR 8 ^@ (text, text);      -- prefix (starts_with)
+
+COMMENT ON OPERATOR CLASS biscuit_text_ops USING biscuit IS
+'Operator class for text types - supports LIKE, NOT LIKE, ILIKE, NOT ILIKE, ~, ~*, SIMILAR TO, = and ^@.
+VARCHAR types will implicitly cast to text to use this class.';
+
+-- Same columns as before: CREATE OR REPLACE keeps the grant
+CREATE OR REPLACE VIEW biscuit_operators AS
+SELECT
+    opf.opfname                    AS opfamily,
+    amop.amopstrategy              AS strategy,
+    op.oprname                     AS operator,
+    format_type(op.oprleft,  NULL) AS left_type,
+    format_type(op.oprright, NULL) AS right_type,
+    CASE amop.amopstrategy
+        WHEN 1 THEN 'LIKE'
+        WHEN 2 THEN 'NOT LIKE'
+        WHEN 3 THEN 'ILIKE'
+        WHEN 4 THEN 'NOT ILIKE'
+        WHEN 5 THEN 'REGEX'
+        WHEN 6 THEN 'IREGEX'
+        WHEN 7 THEN 'EQUAL'
+        WHEN 8 THEN 'PREFIX'
+        ELSE        'UNKNOWN'
+    END                            AS description
+FROM pg_amop     amop
+JOIN pg_operator op  ON amop.amopopr    = op.oid
+JOIN pg_opfamily opf ON amop.amopfamily = opf.oid
+JOIN pg_am       am  ON opf.opfmethod   = am.oid
+WHERE am.amname = 'biscuit'
+ORDER BY opf.opfname, amop.amopstrategy;
+
+-- ==================== SCAN STATISTICS ====================
+
+-- Cumulative scan counters per index (needs biscuit in shared_preload_libraries)
+CREATE FUNCTION biscuit_stat_get_indexes()
+RETURNS TABLE (
+    indexrelid oid,
+    scans bigint,
+    rescans bigint,
+    fallback_rescans bigint,
+    bitmap_ops bigint,
+    max_cardinality bigint,
+    verify_checked bigint,
+    verify_matched bigint,
+    tids bigint,
+    sorted_rescans bigint,
+    plan_time double precision,
+    eval_time double precision,
+    verify_time double precision,
+    collect_time double precision
+)
+AS 'MODULE_PATHNAME', 'biscuit_stat_get_indexes'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION biscuit_stat_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'biscuit_stat_reset'
+LANGUAGE C STRICT VOLATILE;
+
+COMMENT ON FUNCTION biscuit_stat_reset() IS
+'Forgets the scan counters of every Biscuit index of the current database.';
+
+CREATE VIEW biscuit_stat_indexes AS
+SELECT
+    s.indexrelid,
+    i.indrelid AS relid,
+    n.nspname AS schemaname,
+    t.relname AS relname,
+    c.relname AS indexrelname,
+    s.scans,
+    s.rescans,
+    s.fallback_rescans,
+    s.bitmap_ops,
+    s.max_cardinality,
+    s.verify_checked,
+    s.verify_matched,
+    s.tids,
+    s.sorted_rescans,
+    s.plan_time,
+    s.eval_time,
+    s.verify_time,
+    s.collect_time
+FROM biscuit_stat_get_indexes() s
+JOIN pg_class c ON c.oid = s.indexrelid
+JOIN pg_namespace n ON n.oid = c.relnamespace
+JOIN pg_index i ON i.indexrelid = c.oid
+JOIN pg_class t ON t.oid = i.indrelid;
+
+COMMENT ON VIEW biscuit_stat_indexes IS
+'Cumulative scan counters of each Biscuit index of the current database since
+the server started or biscuit_stat_reset(): rescans, how many took the
+fallback record walk, bitmap operations, the largest intermediate bitmap,
+records verified against the original strings and how many matched, TIDs
+returned, rescans whose TIDs were sorted, and the time in ms spent planning,
+evaluating bitmaps, verifying and collecting TIDs (with
+biscuit.track_scan_timing). Needs biscuit in shared_preload_libraries.';
+
+-- ==================== PRELOAD / PREWARM ====================
+
+-- Per-index state of the background preload workers (all databases)
+CREATE FUNCTION biscuit_preload_status()
+RETURNS TABLE (
+    datid oid,
+    indexrelid oid,
+    state text,
+    priority bigint,
+    prewarm boolean
+)
+AS 'MODULE_PATHNAME', 'biscuit_preload_status'
+LANGUAGE C STRICT VOLATILE;
+
+COMMENT ON FUNCTION biscuit_preload_status() IS
+'Indexes the background preload workers were asked to build, in every database:
+queued, building, ready or failed; their queue priority; and whether the startup
+prewarm (biscuit.prewarm) queued them. Needs biscuit in shared_preload_libraries.
+Usage: SELECT *, indexrelid::regclass FROM biscuit_preload_status()
+       WHERE datid = (SELECT oid FROM pg_database WHERE datname = current_database());';
+
+-- Readiness probe for load balancers
+CREATE FUNCTION biscuit_prewarm_ready()
+RETURNS boolean
+AS 'MODULE_PATHNAME', 'biscuit_prewarm_ready'
+LANGUAGE C STRICT VOLATILE;
+
+COMMENT ON FUNCTION biscuit_prewarm_ready() IS
+'True once every index the startup prewarm queued (biscuit.prewarm_indexes and the
+indexes most used before the restart) is built or has failed. Always true on a
+standby and without shared_preload_libraries.
+Usage: SELECT biscuit_prewarm_ready();';
+
+-- ==================== GRANT PERMISSIONS ====================
+
+GRANT SELECT ON biscuit_stat_indexes TO PUBLIC;
+GRANT EXECUTE ON FUNCTION biscuit_prewarm_ready() TO PUBLIC;
+
+-- Like pg_stat_reset(), resetting the counters is for superusers unless granted
+REVOKE EXECUTE ON FUNCTION biscuit_stat_reset() FROM PUBLIC;
+
+-- ==================== VERSION TABLE ====================
+
+INSERT INTO biscuit_version_table (version, description)
+VALUES ('2.5.0', 'Persisted and shared indexes, change log, regex/equality/prefix operators, scan statistics and startup prewarm')
+ON CONFLICT (version) DO NOTHING;
@@ -1,4 +1,4 @@
--- biscuit--2.4.0.sql
+-- biscuit--2.5.0.sql
 -- SQL installation script for Biscuit Index Access Method
 -- PostgreSQL 15+ compatible with full CRUD support and multi-column indexes
 --
@@ -112,7 +112,13 @@ Usage: SELECT biscuit_index_stats(''index_name''::regclass::oid);';
 -- ==================== OPERATOR CLASSES ====================
 
 -- Default operator class for TEXT type.
--- Supports: LIKE (~~), NOT LIKE (!~~), ILIKE (~~*), NOT ILIKE (!~~*)
+-- Supports: LIKE (~~), NOT LIKE (!~~), ILIKE (~~*), NOT ILIKE (!~~*),
+-- regular expressions (~, ~*), which also serve SIMILAR TO, equality (=)
+-- and prefix matches (^@, starts_with). Regular expressions are answered
+-- through a LIKE pattern of the literals every match contains, and the
+-- executor rechecks the candidate rows; = and ^@ are LIKE patterns of
+-- their escaped value. Every operator also takes an ANY (array) argument,
+-- e.g. col = ANY(ARRAY['a','b']) or col LIKE ANY(...), in one index scan.
 --
 -- FIX #2 (was FUNCTION 1 biscuit_like_support(internal) with RETURNS bool):
 -- Now that biscuit_like_support is correctly declared RETURNS internal above,
@@ -123,10 +129,14 @@ DEFAULT FOR TYPE text USING biscuit AS
     OPERATOR 2 !~~ (text, text),     -- NOT LIKE
     OPERATOR 3 ~~* (text, text),     -- ILIKE (case-insensitive)
     OPERATOR 4 !~~* (text, text),    -- NOT ILIKE (case-insensitive)
+    OPERATOR 5 ~ (text, text),       -- regular expression, SIMILAR TO
+    OPERATOR 6 ~* (text, text),      -- regular expression (case-insensitive)
+    OPERATOR 7 = (text, text),       -- equality, IN lists
+    OPERATOR 8 ^@ (text, text),      -- prefix (starts_with)
     FUNCTION 1 biscuit_like_support(internal);
 
 COMMENT ON OPERATOR CLASS biscuit_text_ops USING biscuit IS
-'Operator class for text types - supports LIKE, NOT LIKE, ILIKE, NOT ILIKE.
+'Operator class for text types - supports LIKE, NOT LIKE, ILIKE, NOT ILIKE, ~, ~*, SIMILAR TO, = and ^@.
 VARCHAR types will implicitly cast to text to use this class.';
 
 -- FIX #9: An earlier revision attempted a native biscuit_bpchar_ops
@@ -249,6 +259,10 @@ SELECT
         WHEN 2 THEN 'NOT LIKE'
         WHEN 3 THEN 'ILIKE'
         WHEN 4 THEN 'NOT ILIKE'
+        WHEN 5 THEN 'REGEX'
+        WHEN 6 THEN 'IREGEX'
+        WHEN 7 THEN 'EQUAL'
+        WHEN 8 THEN 'PREFIX'
         ELSE 'UNKNOWN'
     END AS description
 FROM pg_amop amop
@@ -390,6 +404,105 @@ COMMENT ON FUNCTION biscuit_check_config() IS
 'Performs configuration health check and provides recommendations.
 Usage: SELECT * FROM biscuit_check_config();';
 
+-- ==================== SCAN STATISTICS ====================
+
+-- Cumulative scan counters per index (needs biscuit in shared_preload_libraries)
+CREATE FUNCTION biscuit_stat_get_indexes()
+RETURNS TABLE (
+    indexrelid oid,
+    scans bigint,
+    rescans bigint,
+    fallback_rescans bigint,
+    bitmap_ops bigint,
+    max_cardinality bigint,
+    verify_checked bigint,
+    verify_matched bigint,
+    tids bigint,
+    sorted_rescans bigint,
+    plan_time double precision,
+    eval_time double precision,
+    verify_time double precision,
+    collect_time double precision
+)
+AS 'MODULE_PATHNAME', 'biscuit_stat_get_indexes'
+LANGUAGE C STRICT VOLATILE;
+
+CREATE FUNCTION biscuit_stat_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'biscuit_stat_reset'
+LANGUAGE C STRICT VOLATILE;
+
+COMMENT ON FUNCTION biscuit_stat_reset() IS
+'Forgets the scan counters of every Biscuit index of the current database.';
+
+CREATE VIEW biscuit_stat_indexes AS
+SELECT
+    s.indexrelid,
+    i.indrelid AS relid,
+    n.nspname AS schemaname,
+    t.relname AS relname,
+    c.relname AS indexrelname,
+    s.scans,
+    s.rescans,
+    s.fallback_rescans,
+    s.bitmap_ops,
+    s.max_cardinality,
+    s.verify_checked,
+    s.verify_matched,
+    s.tids,
+    s.sorted_rescans,
+    s.plan_time,
+    s.eval_time,
+    s.verify_time,
+    s.collect_time
+FROM biscuit_stat_get_indexes() s
+JOIN pg_class c ON c.oid = s.indexrelid
+JOIN pg_namespace n ON n.oid = c.relnamespace
+JOIN pg_index i ON i.indexrelid = c.oid
+JOIN pg_class t ON t.oid = i.indrelid;
+
+COMMENT ON VIEW biscuit_stat_indexes IS
+'Cumulative scan counters of each Biscuit index of the current database since
+the server started or biscuit_stat_reset(): rescans, how many took the
+fallback record walk, bitmap operations, the largest intermediate bitmap,
+records verified against the original strings and how many matched, TIDs
+returned, rescans whose TIDs were sorted, and the time in ms spent planning,
+evaluating bitmaps, verifying and collecting TIDs (with
+biscuit.track_scan_timing). Needs biscuit in shared_preload_libraries.';
+
+-- ==================== PRELOAD / PREWARM ====================
+
+-- Per-index state of the background preload workers (all databases)
+CREATE FUNCTION biscuit_preload_status()
+RETURNS TABLE (
+    datid oid,
+    indexrelid oid,
+    state text,
+    priority bigint,
+    prewarm boolean
+)
+AS 'MODULE_PATHNAME', 'biscuit_preload_status'
+LANGUAGE C STRICT VOLATILE;
+
+COMMENT ON FUNCTION biscuit_preload_status() IS
+'Indexes the background preload workers were asked to build, in every database:
+queued, building, ready or failed; their queue priority; and whether the startup
+prewarm (biscuit.prewarm) queued them. Needs biscuit in shared_preload_libraries.
+Usage: SELECT *, indexrelid::regclass FROM biscuit_preload_status()
+       WHERE datid = (SELECT oid FROM pg_database WHERE datname = current_database());';
+
+-- Readiness probe for load balancers
+CREATE FUNCTION biscuit_prewarm_ready()
+RETURNS boolean
+AS 'MODULE_PATHNAME', 'biscuit_prewarm_ready'
+LANGUAGE C STRICT VOLATILE;
+
+COMMENT ON FUNCTION biscuit_prewarm_ready() IS
+'True once every index the startup prewarm queued (biscuit.prewarm_indexes and the
+indexes most used before the restart) is built or has failed. Always true on a
+standby and without shared_preload_libraries.
+Usage: SELECT biscuit_prewarm_ready();';
+
 -- ==================== VERSION INFO ====================
 
 CREATE TABLE IF NOT EXISTS biscuit_version_table (
@@ -407,7 +520,9 @@ INSERT INTO biscuit_version_table (version, description) VALUES
 
 ('2.3.0', 'Parallel index scans, faster ILIKE execution, and major cache correctness improvements'),
 
-('2.4.0', 'Added expression index support and improved parallel scan and datatype compatibility');
+('2.4.0', 'Added expression index support and improved parallel scan and datatype compatibility'),
+
+('2.5.0', 'Persisted and shared indexes, change log, regex/equality/prefix operators, scan statistics and startup prewarm');
 
 
 COMMENT ON TABLE biscuit_version_table IS
@@ -426,6 +541,11 @@ GRANT SELECT ON biscuit_indexes TO PUBLIC;
 GRANT SELECT ON biscuit_indexes_detailed TO PUBLIC;
 GRANT SELECT ON biscuit_operators TO PUBLIC;
 GRANT SELECT ON biscuit_status TO PUBLIC;
+GRANT SELECT ON biscuit_stat_indexes TO PUBLIC;
+GRANT EXECUTE ON FUNCTION biscuit_prewarm_ready() TO PUBLIC;
+
+-- Like pg_stat_reset(), resetting the counters is for superusers unless granted
+REVOKE EXECUTE ON FUNCTION biscuit_stat_reset() FROM PUBLIC;
 
 -- ==================== USAGE EXAMPLES (DOCUMENTATION) ====================
 
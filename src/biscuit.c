@@ -14,19 +14,45 @@
  * All heavy lifting is in the sub-modules:
  *   biscuit_bitmap.c   – RoaringBitmap abstraction
  *   biscuit_utf8.c     – UTF-8 helpers & type conversion
- *   biscuit_cache.c    – session index cache
+ *   biscuit_cache.c    – session index cache and its memory budget
  *   biscuit_tid.c      – TID sorting & collection
  *   biscuit_pattern.c  – LIKE/ILIKE pattern matching
+ *   biscuit_like.c     – compiled LIKE matcher for direct string checks
+ *   biscuit_regex.c    – regex / SIMILAR TO keys through a LIKE prefilter
+ *   biscuit_keys.c     – =, ^@, regex and array keys rewritten as LIKE keys
  *   biscuit_index.c    – build, load, CRUD, AM maintenance callbacks
+ *   biscuit_bulk.c     – batched bitmap loading for builds and preload
+ *   biscuit_parallel_build.c – parallel CREATE INDEX (partial builds + merge)
+ *   biscuit_arena.c    – packed string arenas behind the value caches
+ *   biscuit_storage.c  – persisted on-disk snapshot of the full index
+ *   biscuit_changelog.c – change log replayed by other backends
+ *   biscuit_shared.c   – shared-memory (DSA) index images
+ *   biscuit_stats.c    – planner statistics for costestimate
+ *   biscuit_trigram.c  – optional trigram postings for substring patterns
+ *   biscuit_result_cache.c – cross-query cache of pattern results
+ *   biscuit_pending.c  – pending list of inserts, merged in bulk
  *   biscuit_scan.c     – beginscan / rescan / gettuple / getbitmap / endscan
+ *   biscuit_instrument.c – per-scan instrumentation, EXPLAIN and biscuit_stat_indexes
+ *   biscuit_prewarm.c  – startup prewarm launcher and index usage file
  */
 
 #include "biscuit_common.h"
 #include "biscuit_bitmap.h"
+#include "biscuit_cache.h"
+#include "biscuit_changelog.h"
 #include "biscuit_index.h"
+#include "biscuit_instrument.h"
 #include "biscuit_scan.h"
+#include "biscuit_pending.h"
 #include "biscuit_preload.h"
+#include "biscuit_prewarm.h"
+#include "biscuit_result_cache.h"
+#include "biscuit_shared.h"
+#include "biscuit_storage.h"
 #include "biscuit_tid.h"
+#include "biscuit_trigram.h"
+
+#include "utils/guc.h"
 
 /* ================================================================
  * MODULE MAGIC
@@ -40,9 +66,12 @@
 
 /* ================================================================
  * _PG_init – called once when the library is loaded.
- * Registers shared-memory hooks and the background preload worker.
- * Without this, biscuit_preload_shmem is always NULL and the
- * background worker is never started.
+ * Registers the shared-memory hooks and GUCs for the background
+ * preloader, the index cache budget, the shared index images, the
+ * trigram postings, the result cache, the pending list and the scan
+ * statistics, the index options, and the startup prewarm launcher.
+ * Without this, biscuit_preload_shmem is always NULL and no preload
+ * worker is ever started.
  * ================================================================ */
 
 void _PG_init(void);
@@ -51,6 +80,15 @@ void
 _PG_init(void)
 {
     biscuit_preload_init();
+    biscuit_cache_init();
+    biscuit_shared_init();
+    biscuit_result_cache_init();
+    biscuit_pending_init();
+    biscuit_instrument_init();
+    biscuit_options_init();
+    biscuit_prewarm_init();
+
+    MarkGUCPrefixReserved("biscuit");
 }
 
 /* ================================================================
@@ -127,7 +165,8 @@ biscuit_build_info(PG_FUNCTION_ARGS)
             values[2] = pstrdup("High-performance bitmap operations enabled");
 #else
             values[1] = pstrdup("false");
-            values[2] = pstrdup("Using fallback bitmap implementation (reduced performance)");
+            values[2] = psprintf("Using fallback bitmap implementation (%s kernels)",
+                                 biscuit_bitset_kernels());
 #endif
         }
         else
@@ -166,6 +205,7 @@ biscuit_build_info_json(PG_FUNCTION_ARGS)
                      ROARING_VERSION_MAJOR, ROARING_VERSION_MINOR, ROARING_VERSION_REVISION);
 #else
     appendStringInfo(&buf, "\"roaring_enabled\": false,");
+    appendStringInfo(&buf, "\"bitset_kernels\": \"%s\",", biscuit_bitset_kernels());
 #endif
 
     appendStringInfo(&buf, "\"postgres_version\": \"%s\"", PG_VERSION);
@@ -207,7 +247,7 @@ biscuit_handler(PG_FUNCTION_ARGS)
 
     (void) fcinfo;
 
-    amroutine->amstrategies          = 4;
+    amroutine->amstrategies          = 8;
     amroutine->amsupport             = 2;
     amroutine->amoptsprocnum         = 0;
     amroutine->amcanorder            = false;
@@ -216,7 +256,7 @@ biscuit_handler(PG_FUNCTION_ARGS)
     amroutine->amcanunique           = false;
     amroutine->amcanmulticol         = true;
     amroutine->amoptionalkey         = true;
-    amroutine->amsearcharray         = false;
+    amroutine->amsearcharray         = true;
     amroutine->amsearchnulls         = false;
     amroutine->amstorage             = false;
     amroutine->amclusterable         = false;
@@ -225,6 +265,9 @@ biscuit_handler(PG_FUNCTION_ARGS)
     amroutine->amusemaintenanceworkmem = false;
     amroutine->amsummarizing         = false;
     amroutine->amparallelvacuumoptions = 0;
+    #if PG_VERSION_NUM >= 170000
+    amroutine->amcanbuildparallel    = true;
+    #endif
     amroutine->amkeytype             = InvalidOid;
 
     amroutine->ambuild               = biscuit_build;
@@ -285,29 +328,31 @@ biscuit_index_stats(PG_FUNCTION_ARGS)
     Relation      index;
     BiscuitIndex *idx;
     StringInfoData buf;
+    BiscuitMetaPageData meta;
+    BiscuitStatsData planner_stats;
     int            active_records = 0;
+    int            cache_entries;
+    Size           cache_bytes;
+    Size           copy_bytes;
+    uint64         evictions;
+    uint64         reloads;
     int            i;
 
     index = index_open(indexoid, AccessShareLock);
 
-    idx = (BiscuitIndex *) index->rd_amcache;
-    if (!idx) { idx = biscuit_load_index(index); index->rd_amcache = idx; }
+    /* Never rd_amcache: it is pfree()d on relcache invalidation */
+    idx = biscuit_changelog_lookup(index);
+    if (!idx) idx = biscuit_load_index(index);
 
     for (i = 0; i < idx->num_records; i++)
     {
-        bool has_data = (idx->num_columns == 1 && idx->data_cache[i] != NULL) ||
-                        (idx->num_columns > 1 && idx->column_data_cache[0][i] != NULL);
+        bool has_data = biscuit_record_has_value(idx, (uint32_t) i);
 
         bool is_tombstoned = false;
         if (!has_data) continue;
         
         
-#ifdef HAVE_ROARING
-        is_tombstoned = roaring_bitmap_contains(idx->tombstones, (uint32_t) i);
-#else
-        { uint32_t bl = i >> 6, bt = i & 63;
-          is_tombstoned = ((int) bl < idx->tombstones->num_blocks && (idx->tombstones->blocks[bl] & (1ULL << bt))); }
-#endif
+        is_tombstoned = biscuit_roaring_contains(idx->tombstones, (uint32_t) i);
         if (!is_tombstoned) active_records++;
     }
 
@@ -319,12 +364,79 @@ biscuit_index_stats(PG_FUNCTION_ARGS)
     appendStringInfo(&buf, "Total slots: %d\n",   idx->num_records);
     appendStringInfo(&buf, "Free slots: %d\n",    idx->free_count);
     appendStringInfo(&buf, "Tombstones: %d\n",    idx->tombstone_count);
+    appendStringInfo(&buf, "Heap ordered: %s\n",  idx->heap_ordered ? "yes" : "no");
     appendStringInfo(&buf, "Max length: %d\n",    idx->max_len);
+    if (idx->num_columns == 1)
+    {
+        if (idx->trigrams_legacy)
+            appendStringInfo(&buf, "Trigrams: %d\n", biscuit_trigram_count(idx->trigrams_legacy));
+        else
+            appendStringInfo(&buf, "Trigrams: off\n");
+    }
+    else
+    {
+        int col;
+
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            if (idx->column_indices[col].trigrams)
+                appendStringInfo(&buf, "Trigrams (column %d): %d\n", col + 1,
+                                 biscuit_trigram_count(idx->column_indices[col].trigrams));
+            else
+                appendStringInfo(&buf, "Trigrams (column %d): off\n", col + 1);
+        }
+    }
+    biscuit_result_cache_usage(idx, &cache_entries, &cache_bytes);
+    appendStringInfo(&buf, "------------------------\n");
+    appendStringInfo(&buf, "Result Cache (this session):\n");
+    appendStringInfo(&buf, "  Entries: %d (%zu bytes)\n", cache_entries, cache_bytes);
+    appendStringInfo(&buf, "  Hits: " INT64_FORMAT "\n",   idx->result_cache_hits);
+    appendStringInfo(&buf, "  Misses: " INT64_FORMAT "\n", idx->result_cache_misses);
+    appendStringInfo(&buf, "------------------------\n");
+    biscuit_cache_usage(RelationGetRelid(index), &copy_bytes, &evictions, &reloads);
+    appendStringInfo(&buf, "Index Cache (this session):\n");
+    appendStringInfo(&buf, "  This index: %zu bytes\n", copy_bytes);
+    if (biscuit_cache_memory_limit > 0)
+        appendStringInfo(&buf, "  All indexes: %zu of %d kB\n",
+                         biscuit_cache_total_bytes(), biscuit_cache_memory_limit);
+    else
+        appendStringInfo(&buf, "  All indexes: %zu bytes (no limit)\n",
+                         biscuit_cache_total_bytes());
+    appendStringInfo(&buf, "  Evictions: " UINT64_FORMAT "\n", evictions);
+    appendStringInfo(&buf, "  Reloads: " UINT64_FORMAT "\n", reloads);
+    appendStringInfo(&buf, "------------------------\n");
+    appendStringInfo(&buf, "On-disk Snapshot:\n");
+    if (biscuit_storage_describe(index, &meta))
+    {
+        appendStringInfo(&buf, "  State: %s\n",
+                         meta.snapshot_state == BISCUIT_SNAPSHOT_VALID    ? "valid" :
+                         meta.snapshot_state == BISCUIT_SNAPSHOT_BUILDING ? "stale (owned)" :
+                                                                            "stale");
+        appendStringInfo(&buf, "  Epoch: %u\n",  meta.snapshot_epoch);
+        appendStringInfo(&buf, "  Blocks: %u\n", meta.snapshot_nblocks);
+        appendStringInfo(&buf, "  Bytes: " UINT64_FORMAT "\n", meta.snapshot_bytes);
+        appendStringInfo(&buf, "  Change log: version " UINT64_FORMAT " (truncated at " UINT64_FORMAT
+                         "), this copy at " UINT64_FORMAT ", " INT64_FORMAT " entries replayed\n",
+                         meta.log_version, meta.log_base, idx->log_version, idx->log_replayed);
+    }
+    else
+        appendStringInfo(&buf, "  State: none (rebuilt from heap)\n");
+    if (biscuit_storage_read_stats(index, &planner_stats))
+        appendStringInfo(&buf, "  Planner stats: %u column(s), %u live records, correlation %.3f\n",
+                         planner_stats.ncolumns, planner_stats.live_records,
+                         planner_stats.correlation);
+    else
+        appendStringInfo(&buf, "  Planner stats: none (fixed 1%% estimate)\n");
+    appendStringInfo(&buf, "  Residency: %s\n",
+                     BiscuitIndexIsShared(idx) ? "shared image (DSA)" : "private copy");
     appendStringInfo(&buf, "------------------------\n");
     appendStringInfo(&buf, "CRUD Statistics:\n");
     appendStringInfo(&buf, "  Inserts: %lld\n",  (long long) idx->insert_count);
     appendStringInfo(&buf, "  Updates: %lld\n",  (long long) idx->update_count);
     appendStringInfo(&buf, "  Deletes: %lld\n",  (long long) idx->delete_count);
+    appendStringInfo(&buf, "  Pending: " UINT64_FORMAT " records (%zu bytes)\n",
+                     biscuit_pending_count(idx), idx->pending_bytes);
+    appendStringInfo(&buf, "  Pending merges: " INT64_FORMAT "\n", idx->pending_merges);
     appendStringInfo(&buf, "------------------------\n");
     appendStringInfo(&buf, "Active Optimizations:\n");
     appendStringInfo(&buf, "  \u2713 1. Skip wildcard intersections\n");
@@ -356,96 +468,129 @@ biscuit_index_memory_size(PG_FUNCTION_ARGS)
     Relation      index;
     BiscuitIndex *idx;
     size_t        total_bytes = 0;
-    size_t        string_bytes = 0;
-    size_t        bitmap_bytes = 0;
-    size_t        metadata_bytes = 0;
-    int           i, ch, col;
 
     index = index_open(indexoid, AccessShareLock);
     if (!index)
         elog(ERROR, "Could not open index with OID %u", indexoid);
 
-    idx = (BiscuitIndex *) index->rd_amcache;
-    if (!idx) { idx = biscuit_load_index(index); index->rd_amcache = idx; }
+    /* Never rd_amcache: it is pfree()d on relcache invalidation */
+    idx = biscuit_changelog_lookup(index);
+    if (!idx) idx = biscuit_load_index(index);
     if (!idx) { index_close(index, AccessShareLock); PG_RETURN_INT64(0); }
 
-    metadata_bytes += sizeof(BiscuitIndex);
-    if (idx->tids) metadata_bytes += idx->capacity * sizeof(ItemPointerData);
+    total_bytes = biscuit_index_memory_usage(idx);
 
-    if (idx->num_columns == 1)
+    index_close(index, AccessShareLock);
+    PG_RETURN_INT64((int64) total_bytes);
+}
+
+/* ================================================================
+ * SCAN STATISTICS (biscuit_stat_indexes)
+ * ================================================================ */
+
+#define BISCUIT_STAT_COLS 14
+
+PG_FUNCTION_INFO_V1(biscuit_stat_get_indexes);
+Datum
+biscuit_stat_get_indexes(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo       *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    BiscuitStatCounters *counters;
+    Oid                 *indexoids;
+    int                  count;
+    int                  i;
+
+    InitMaterializedSRF(fcinfo, 0);
+
+    counters = biscuit_instrument_collect(&indexoids, &count);
+    for (i = 0; i < count; i++)
     {
-        if (idx->data_cache)
-        {
-            metadata_bytes += idx->capacity * sizeof(char *);
-            for (i = 0; i < idx->num_records && i < idx->capacity; i++)
-                if (idx->data_cache[i]) string_bytes += strlen(idx->data_cache[i]) + 1;
-        }
-        if (idx->data_cache_lower)
-        {
-            metadata_bytes += idx->capacity * sizeof(char *);
-            for (i = 0; i < idx->num_records && i < idx->capacity; i++)
-                if (idx->data_cache_lower[i]) string_bytes += strlen(idx->data_cache_lower[i]) + 1;
-        }
+        BiscuitStatCounters *c = &counters[i];
+        Datum                values[BISCUIT_STAT_COLS];
+        bool                 nulls[BISCUIT_STAT_COLS];
+
+        memset(nulls, 0, sizeof(nulls));
+        values[0]  = ObjectIdGetDatum(indexoids[i]);
+        values[1]  = Int64GetDatum(c->scans);
+        values[2]  = Int64GetDatum(c->rescans);
+        values[3]  = Int64GetDatum(c->fallback_rescans);
+        values[4]  = Int64GetDatum(c->bitmap_ops);
+        values[5]  = Int64GetDatum(c->max_cardinality);
+        values[6]  = Int64GetDatum(c->verify_checked);
+        values[7]  = Int64GetDatum(c->verify_matched);
+        values[8]  = Int64GetDatum(c->tids);
+        values[9]  = Int64GetDatum(c->sorted_rescans);
+        values[10] = Float8GetDatum(c->plan_ms);
+        values[11] = Float8GetDatum(c->eval_ms);
+        values[12] = Float8GetDatum(c->verify_ms);
+        values[13] = Float8GetDatum(c->collect_ms);
+
+        tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+    }
 
-        for (ch = 0; ch < CHAR_RANGE; ch++)
-        {
-            bitmap_bytes += biscuit_charindex_memory_usage(&idx->pos_idx_legacy[ch]);
-            bitmap_bytes += biscuit_charindex_memory_usage(&idx->neg_idx_legacy[ch]);
-            bitmap_bytes += biscuit_roaring_memory_usage(idx->char_cache_legacy[ch]);
-            bitmap_bytes += biscuit_charindex_memory_usage(&idx->pos_idx_lower[ch]);
-            bitmap_bytes += biscuit_charindex_memory_usage(&idx->neg_idx_lower[ch]);
-            bitmap_bytes += biscuit_roaring_memory_usage(idx->char_cache_lower[ch]);
-        }
+    return (Datum) 0;
+}
 
-        if (idx->length_bitmaps_legacy && idx->max_length_legacy > 0)
-        {
-            metadata_bytes += idx->max_length_legacy * sizeof(RoaringBitmap *);
-            for (i = 0; i < idx->max_length_legacy; i++)
-                if (idx->length_bitmaps_legacy[i])
-                    bitmap_bytes += biscuit_roaring_memory_usage(idx->length_bitmaps_legacy[i]);
-        }
-        if (idx->length_ge_bitmaps_legacy && idx->max_length_legacy > 0)
-        {
-            metadata_bytes += idx->max_length_legacy * sizeof(RoaringBitmap *);
-            for (i = 0; i < idx->max_length_legacy; i++)
-                if (idx->length_ge_bitmaps_legacy[i])
-                    bitmap_bytes += biscuit_roaring_memory_usage(idx->length_ge_bitmaps_legacy[i]);
-        }
+PG_FUNCTION_INFO_V1(biscuit_stat_reset);
+Datum
+biscuit_stat_reset(PG_FUNCTION_ARGS)
+{
+    biscuit_instrument_reset();
+    PG_RETURN_VOID();
+}
+
+/* ================================================================
+ * PRELOAD / PREWARM STATUS
+ * ================================================================ */
+
+#define BISCUIT_PRELOAD_STATUS_COLS 5
+
+static const char *
+biscuit_preload_state_name(uint32 state)
+{
+    switch (state)
+    {
+        case BISCUIT_PRELOAD_SKELETON: return "queued";
+        case BISCUIT_PRELOAD_RUNNING:  return "building";
+        case BISCUIT_PRELOAD_DONE:     return "ready";
+        case BISCUIT_PRELOAD_FAILED:   return "failed";
+        default:                       return "none";
     }
-    else if (idx->num_columns > 1)
+}
+
+PG_FUNCTION_INFO_V1(biscuit_preload_status);
+Datum
+biscuit_preload_status(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo      *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    BiscuitPreloadInfo *info;
+    int                 count;
+    int                 i;
+
+    InitMaterializedSRF(fcinfo, 0);
+
+    info = biscuit_preload_collect(&count);
+    for (i = 0; i < count; i++)
     {
-        metadata_bytes += idx->num_columns * sizeof(Oid);
-        metadata_bytes += idx->num_columns * sizeof(FmgrInfo);
-        metadata_bytes += idx->num_columns * sizeof(char **);
+        Datum values[BISCUIT_PRELOAD_STATUS_COLS];
+        bool  nulls[BISCUIT_PRELOAD_STATUS_COLS];
 
-        if (idx->column_data_cache)
-        {
-            for (col = 0; col < idx->num_columns; col++)
-            {
-                if (idx->column_data_cache[col])
-                {
-                    metadata_bytes += idx->capacity * sizeof(char *);
-                    for (i = 0; i < idx->num_records && i < idx->capacity; i++)
-                        if (idx->column_data_cache[col][i])
-                            string_bytes += strlen(idx->column_data_cache[col][i]) + 1;
-                }
-            }
-        }
+        memset(nulls, 0, sizeof(nulls));
+        values[0] = ObjectIdGetDatum(info[i].dboid);
+        values[1] = ObjectIdGetDatum(info[i].indexoid);
+        values[2] = CStringGetTextDatum(biscuit_preload_state_name(info[i].state));
+        values[3] = Int64GetDatum(info[i].priority);
+        values[4] = BoolGetDatum(info[i].prewarm);
 
-        if (idx->column_indices)
-        {
-            metadata_bytes += idx->num_columns * sizeof(ColumnIndex);
-            for (col = 0; col < idx->num_columns; col++)
-                bitmap_bytes += biscuit_columnindex_memory_usage(&idx->column_indices[col]);
-        }
+        tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
     }
 
-    if (idx->tombstones) bitmap_bytes += biscuit_roaring_memory_usage(idx->tombstones);
-    if (idx->free_list && idx->free_capacity > 0)
-        metadata_bytes += idx->free_capacity * sizeof(uint32_t);
-
-    total_bytes = metadata_bytes + string_bytes + bitmap_bytes;
+    return (Datum) 0;
+}
 
-    index_close(index, AccessShareLock);
-    PG_RETURN_INT64((int64) total_bytes);
+PG_FUNCTION_INFO_V1(biscuit_prewarm_ready);
+Datum
+biscuit_prewarm_ready(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_BOOL(biscuit_preload_prewarm_ready());
 }
@@ -0,0 +1,203 @@
+/*
+ * biscuit_arena.c
+ * Append-only string arenas for the record value caches.
+ *
+ * data_cache, data_cache_lower and column_data_cache used to hold one
+ * palloc'd copy per value.  For the short values typical of indexed
+ * columns the allocator header and power-of-two rounding cost more than
+ * the string, every verification pass paid a strlen() per candidate, and
+ * consecutive records were scattered across the heap.  Values now live
+ * in per-column arenas:
+ *
+ *   layout        each value is packed as (uint32 byte length, bytes,
+ *                 NUL), the snapshot stream's string encoding, into large
+ *                 chunks of the owning index's memory context.  The cache
+ *                 arrays keep pointing at the bytes, so readers are
+ *                 unchanged apart from biscuit_cache_strlen(), and
+ *                 zero-copy views can point into the image exactly the
+ *                 same way.
+ *   lower copies  a value that is already lowercase is its own lowercased
+ *                 copy (data_cache_lower[rec] == data_cache[rec]); only
+ *                 values that change under biscuit_str_tolower() store a
+ *                 second copy.  The snapshot stream records the sharing.
+ *   release       a replaced or deleted value stays in its chunk and is
+ *                 only counted as released.
+ *   compaction    ambulkdelete calls biscuit_arena_compact(), which copies
+ *                 the live values into a fresh arena once released bytes
+ *                 reach half of the stored ones.
+ *
+ * Chunks start at BISCUIT_ARENA_MIN_CHUNK and double up to
+ * BISCUIT_ARENA_MAX_CHUNK; a value larger than that gets a chunk of its
+ * own.  Values never move except in compaction, so cache pointers stay
+ * valid across inserts.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_arena.h"
+#include "biscuit_utf8.h"
+
+#define BISCUIT_ARENA_MIN_CHUNK     (16 * 1024)
+#define BISCUIT_ARENA_MAX_CHUNK     (8 * 1024 * 1024)
+
+/* Released bytes an arena must reach before compaction is considered */
+#define BISCUIT_ARENA_COMPACT_MIN   (1024 * 1024)
+
+struct BiscuitArenaChunk
+{
+    BiscuitArenaChunk *next;        /* older chunk */
+    Size               size;        /* bytes in data */
+    Size               used;
+    char               data[FLEXIBLE_ARRAY_MEMBER];
+};
+
+/* ================================================================
+ * SECTION 1 – Chunks
+ * ================================================================ */
+
+static BiscuitArenaChunk *
+biscuit_arena_add_chunk(BiscuitStringArena *arena, Size size)
+{
+    BiscuitArenaChunk *chunk;
+
+    if (!arena->context)
+        arena->context = CurrentMemoryContext;
+
+    chunk = (BiscuitArenaChunk *)
+        MemoryContextAllocHuge(arena->context, offsetof(BiscuitArenaChunk, data) + size);
+    chunk->next = arena->chunks;
+    chunk->size = size;
+    chunk->used = 0;
+
+    arena->chunks     = chunk;
+    arena->allocated += size;
+    return chunk;
+}
+
+/* Space for one entry of need bytes */
+static char *
+biscuit_arena_reserve(BiscuitStringArena *arena, Size need)
+{
+    BiscuitArenaChunk *chunk = arena->chunks;
+    char              *p;
+
+    if (!chunk || chunk->size - chunk->used < need)
+    {
+        Size size = chunk ? Min(chunk->size * 2, BISCUIT_ARENA_MAX_CHUNK)
+                          : BISCUIT_ARENA_MIN_CHUNK;
+
+        chunk = biscuit_arena_add_chunk(arena, Max(size, need));
+    }
+
+    p = chunk->data + chunk->used;
+    chunk->used += need;
+    arena->used += need;
+    return p;
+}
+
+/* ================================================================
+ * SECTION 2 – Public API
+ * ================================================================ */
+
+char *
+biscuit_arena_store(BiscuitStringArena *arena, const char *s, int byte_len)
+{
+    uint32  len = (uint32) byte_len;
+    char   *p   = biscuit_arena_reserve(arena, BiscuitArenaEntrySize(byte_len));
+
+    memcpy(p, &len, sizeof(uint32));
+    p += sizeof(uint32);
+    memcpy(p, s, byte_len);
+    p[byte_len] = '\0';
+    return p;
+}
+
+char *
+biscuit_arena_store_lower(BiscuitStringArena *arena, const char *s)
+{
+    int   lower_len;
+    char *lower = biscuit_str_fold(s, biscuit_cache_strlen(s), &lower_len);
+    char *result;
+
+    if (!lower)
+        return (char *) s;
+
+    result = biscuit_arena_store(arena, lower, lower_len);
+    pfree(lower);
+    return result;
+}
+
+void
+biscuit_arena_release(BiscuitStringArena *arena, const char *s, const char *s_lower)
+{
+    if (s)
+        arena->released += BiscuitArenaEntrySize(biscuit_cache_strlen(s));
+    if (s_lower && s_lower != s)
+        arena->released += BiscuitArenaEntrySize(biscuit_cache_strlen(s_lower));
+}
+
+void
+biscuit_arena_compact(BiscuitStringArena *arena, char **strs, char **lower, int n)
+{
+    BiscuitStringArena fresh;
+    Size               live;
+    int                i;
+
+    if (arena->released < BISCUIT_ARENA_COMPACT_MIN ||
+        arena->released * 2 < arena->used)
+        return;
+
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.context = arena->context;
+
+    /* One chunk for everything that survives, when the counts are exact */
+    live = arena->used > arena->released ? arena->used - arena->released : 0;
+    if (live > 0)
+        biscuit_arena_add_chunk(&fresh, Max(live, BISCUIT_ARENA_MIN_CHUNK));
+
+    for (i = 0; i < n; i++)
+    {
+        char *s = strs[i];
+        char *copy = NULL;
+
+        if (s)
+            copy = biscuit_arena_store(&fresh, s, biscuit_cache_strlen(s));
+
+        if (lower && lower[i])
+        {
+            if (lower[i] == s)
+                lower[i] = copy;
+            else
+                lower[i] = biscuit_arena_store(&fresh, lower[i],
+                                               biscuit_cache_strlen(lower[i]));
+        }
+        strs[i] = copy;
+    }
+
+    biscuit_arena_free(arena);
+    *arena = fresh;
+}
+
+void
+biscuit_arena_free(BiscuitStringArena *arena)
+{
+    BiscuitArenaChunk *chunk = arena->chunks;
+
+    while (chunk)
+    {
+        BiscuitArenaChunk *next = chunk->next;
+
+        pfree(chunk);
+        chunk = next;
+    }
+
+    arena->chunks    = NULL;
+    arena->allocated = 0;
+    arena->used      = 0;
+    arena->released  = 0;
+}
+
+Size
+biscuit_arena_memory(const BiscuitStringArena *arena)
+{
+    return arena->allocated;
+}
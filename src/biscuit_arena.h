@@ -0,0 +1,66 @@
+/*
+ * biscuit_arena.h
+ * Append-only string arenas behind data_cache / column_data_cache.
+ *
+ * Every cached value is stored packed as
+ *
+ *     uint32 byte length | bytes | NUL
+ *
+ * which is exactly how the snapshot stream encodes a string, so a cache
+ * pointer is valid whether it points into an arena chunk or into a
+ * zero-copy snapshot / shared image, and biscuit_cache_strlen() reads the
+ * length in front of it instead of scanning for the NUL.
+ */
+
+#ifndef BISCUIT_ARENA_H
+#define BISCUIT_ARENA_H
+
+#include "biscuit_common.h"
+
+/* Bytes an entry of byte_len bytes occupies in an arena */
+#define BiscuitArenaEntrySize(byte_len) (sizeof(uint32) + (Size) (byte_len) + 1)
+
+/* Byte length of a cached string (arena- or image-resident only) */
+static inline int
+biscuit_cache_strlen(const char *s)
+{
+    uint32 len;
+
+    memcpy(&len, s - sizeof(uint32), sizeof(uint32));
+    return (int) len;
+}
+
+/*
+ * Copy byte_len bytes of s into the arena and return the packed copy.
+ * Chunks come from the memory context current at the arena's first
+ * store, which is the one the owning index lives in.
+ */
+extern char *biscuit_arena_store(BiscuitStringArena *arena, const char *s, int byte_len);
+
+/*
+ * Lowercased copy of the cached string s.  Returns s itself when
+ * lowercasing does not change it, so the case-insensitive cache costs
+ * nothing for already-lowercase values.
+ */
+extern char *biscuit_arena_store_lower(BiscuitStringArena *arena, const char *s);
+
+/* Account for a value (and its lowercased copy) no longer referenced */
+extern void  biscuit_arena_release(BiscuitStringArena *arena,
+                                   const char *s, const char *s_lower);
+
+/*
+ * Copy every live value of strs[0..n) (and lower[0..n), which may be
+ * NULL) into fresh chunks, repoint the arrays and free the old chunks.
+ * Does nothing unless released values make up a large enough share of
+ * the arena to be worth it.
+ */
+extern void  biscuit_arena_compact(BiscuitStringArena *arena,
+                                   char **strs, char **lower, int n);
+
+/* Release every chunk */
+extern void  biscuit_arena_free(BiscuitStringArena *arena);
+
+/* Bytes allocated for chunks */
+extern Size  biscuit_arena_memory(const BiscuitStringArena *arena);
+
+#endif /* BISCUIT_ARENA_H */
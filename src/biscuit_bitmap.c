@@ -3,12 +3,17 @@
  * Roaring bitmap abstraction layer.
  *
  * When compiled with HAVE_ROARING, every operation delegates to the
- * CRoaring library.  Otherwise a simple uint64_t block-array fallback
- * is used so the extension can be built without the external library.
+ * CRoaring library.  Otherwise a fallback with sparse (sorted array) and
+ * dense (bitset) forms and vectorized word kernels is used, so the
+ * extension can be built without the external library.
  */
 
 #include "biscuit_common.h"
 #include "biscuit_bitmap.h"
+#include "biscuit_trigram.h"
+
+/* In-place AND / OR / ANDNOT operations of this backend (biscuit_instrument.c) */
+uint64 biscuit_bitmap_ops = 0;
 
 /* ==================== ROARING WRAPPERS ==================== */
 
@@ -32,6 +37,28 @@ biscuit_roaring_remove(RoaringBitmap *rb, uint32_t value)
     roaring_bitmap_remove(rb, value);
 }
 
+bool
+biscuit_roaring_contains(const RoaringBitmap *rb, uint32_t value)
+{
+    return roaring_bitmap_contains(rb, value);
+}
+
+/* Add n values, fastest when they are ascending (bulk loads) */
+void
+biscuit_roaring_add_many(RoaringBitmap *rb, const uint32_t *values, size_t n)
+{
+    if (n > 0)
+        roaring_bitmap_add_many(rb, n, values);
+}
+
+/* Convert dense ranges to run containers and release spare capacity */
+void
+biscuit_roaring_optimize(RoaringBitmap *rb)
+{
+    roaring_bitmap_run_optimize(rb);
+    roaring_bitmap_shrink_to_fit(rb);
+}
+
 uint64_t
 biscuit_roaring_count(const RoaringBitmap *rb)
 {
@@ -60,21 +87,45 @@ biscuit_roaring_copy(const RoaringBitmap *rb)
 void
 biscuit_roaring_and_inplace(RoaringBitmap *a, const RoaringBitmap *b)
 {
+    biscuit_bitmap_ops++;
     roaring_bitmap_and_inplace(a, b);
 }
 
 void
 biscuit_roaring_or_inplace(RoaringBitmap *a, const RoaringBitmap *b)
 {
+    biscuit_bitmap_ops++;
     roaring_bitmap_or_inplace(a, b);
 }
 
 void
 biscuit_roaring_andnot_inplace(RoaringBitmap *a, const RoaringBitmap *b)
 {
+    biscuit_bitmap_ops++;
     roaring_bitmap_andnot_inplace(a, b);
 }
 
+/*
+ * a |= (b shifted up by offset).  Used to append a bitmap built over its
+ * own record range (parallel build) to one that already holds offset
+ * records.
+ */
+void
+biscuit_roaring_or_shifted(RoaringBitmap *a, const RoaringBitmap *b, uint32_t offset)
+{
+    roaring_bitmap_t *shifted;
+
+    if (offset == 0)
+    {
+        roaring_bitmap_or_inplace(a, b);
+        return;
+    }
+
+    shifted = roaring_bitmap_add_offset(b, (int64_t) offset);
+    roaring_bitmap_or_inplace(a, shifted);
+    roaring_bitmap_free(shifted);
+}
+
 uint32_t *
 biscuit_roaring_to_array(const RoaringBitmap *rb, uint64_t *count)
 {
@@ -82,66 +133,648 @@ biscuit_roaring_to_array(const RoaringBitmap *rb, uint64_t *count)
     *count = roaring_bitmap_get_cardinality(rb);
     if (*count == 0)
         return NULL;
-    array = (uint32_t *) palloc(*count * sizeof(uint32_t));
+    array = (uint32_t *) biscuit_palloc_huge(*count * sizeof(uint32_t));
     roaring_bitmap_to_uint32_array(rb, array);
     return array;
 }
 
-#else  /* !HAVE_ROARING – fallback bitset */
+uint32_t *
+biscuit_roaring_to_array_ranked(const RoaringBitmap *rb, uint64_t start, uint64_t n,
+                                uint64_t *count)
+{
+    uint64_t                   total = roaring_bitmap_get_cardinality(rb);
+    roaring_uint32_iterator_t *iter;
+    uint32_t                  *array;
+    uint32_t                   first;
 
+    *count = 0;
+    if (n == 0 || start >= total || !roaring_bitmap_select(rb, (uint32_t) start, &first))
+        return NULL;
+    n = Min(n, total - start);
+
+    array = (uint32_t *) biscuit_palloc_huge(n * sizeof(uint32_t));
+    iter  = roaring_iterator_create(rb);
+    roaring_uint32_iterator_move_equalorlarger(iter, first);
+    *count = roaring_uint32_iterator_read(iter, array, (uint32_t) n);
+    roaring_uint32_iterator_free(iter);
+    return array;
+}
+
+size_t
+biscuit_roaring_serialized_size(const RoaringBitmap *rb)
+{
+    return roaring_bitmap_portable_size_in_bytes(rb);
+}
+
+size_t
+biscuit_roaring_serialized_bound(uint64 universe)
+{
+    /*
+     * Per 2^16 chunk: key, cardinality and offset, and at most a bitset
+     * container (arrays and runs are only kept while smaller); plus the
+     * cookie, the container count and the run-container flags.
+     */
+    uint64 chunks = (universe + 0xFFFF) >> 16;
+
+    return 8 + (chunks + 7) / 8 + chunks * (4 + 4 + 8192);
+}
+
+size_t
+biscuit_roaring_serialize(const RoaringBitmap *rb, char *buf)
+{
+    return roaring_bitmap_portable_serialize(rb, buf);
+}
+
+/*
+ * Returns NULL when buf does not hold a well-formed bitmap of exactly
+ * len bytes; the caller treats that as corruption.
+ */
 RoaringBitmap *
-biscuit_roaring_create(void)
+biscuit_roaring_deserialize(const char *buf, size_t len)
 {
-    RoaringBitmap *rb = (RoaringBitmap *) palloc0(sizeof(RoaringBitmap));
-    rb->capacity = 16;
-    rb->blocks   = (uint64_t *) palloc0(rb->capacity * sizeof(uint64_t));
+    RoaringBitmap *rb = roaring_bitmap_portable_deserialize_safe(buf, len);
+
+    if (rb && roaring_bitmap_portable_size_in_bytes(rb) != len)
+    {
+        roaring_bitmap_free(rb);
+        return NULL;
+    }
     return rb;
 }
 
+/*
+ * Read-only view over a serialized bitmap: the containers stay in buf,
+ * which must outlive the view.  Validated first, since the frozen
+ * deserializer trusts its input.
+ */
+RoaringBitmap *
+biscuit_roaring_view(const char *buf, size_t len)
+{
+    if (roaring_bitmap_portable_deserialize_size(buf, len) != len)
+        return NULL;
+    return roaring_bitmap_portable_deserialize_frozen(buf);
+}
+
 void
-biscuit_roaring_add(RoaringBitmap *rb, uint32_t value)
+biscuit_roaring_view_free(RoaringBitmap *rb)
 {
-    int block = value >> 6;
-    int bit   = value & 63;
+    /* Frees only the view header; buf is untouched */
+    roaring_bitmap_free(rb);
+}
+
+#else  /* !HAVE_ROARING – fallback bitset */
+
+/*
+ * Fallback bitmap, in one of two forms:
+ *
+ *   sparse  blocks == NULL; the values as a sorted uint32 array.  Most
+ *           positional bitmaps hold a handful of records, and a bitset
+ *           over them would cost (and every operation would walk)
+ *           num_records / 64 words.
+ *   dense   a plain bitset of 64-bit words, combined word by word with
+ *           the vector kernels below.
+ *
+ * A bitmap starts sparse and turns dense once its array would outgrow
+ * BISCUIT_BITSET_SPARSE_MAX values or the words it spans.  Dense bitmaps
+ * turn back in biscuit_roaring_optimize() (the end of every bulk load) and
+ * when an intersection with a sparse one leaves few values.  Serialized
+ * bitmaps and views are always dense.
+ */
+#define BISCUIT_BITSET_SPARSE_MAX   4096
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BISCUIT_BITSET_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BISCUIT_BITSET_NEON
+#include <arm_neon.h>
+#endif
+
+/* ================================================================
+ * Word kernels
+ * ================================================================
+ *
+ * Dense AND / OR / ANDNOT and popcount over n words, in portable C and,
+ * where the compiler can target them, AVX2, AVX-512 and NEON.  The x86
+ * variants are compiled with target attributes, so the extension itself
+ * needs no -m flags, and chosen once per backend from the CPU's features.
+ * NEON is part of the aarch64 baseline.
+ */
+typedef struct BiscuitBitsetKernels
+{
+    const char *name;
+    void      (*and_words)(uint64_t *a, const uint64_t *b, int n);
+    void      (*or_words)(uint64_t *a, const uint64_t *b, int n);
+    void      (*andnot_words)(uint64_t *a, const uint64_t *b, int n);
+    uint64_t  (*popcount_words)(const uint64_t *w, int n);
+} BiscuitBitsetKernels;
+
+static void
+biscuit_and_words_c(uint64_t *a, const uint64_t *b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        a[i] &= b[i];
+}
 
-    if (block >= rb->capacity)
+static void
+biscuit_or_words_c(uint64_t *a, const uint64_t *b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        a[i] |= b[i];
+}
+
+static void
+biscuit_andnot_words_c(uint64_t *a, const uint64_t *b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        a[i] &= ~b[i];
+}
+
+static uint64_t
+biscuit_popcount_words_c(const uint64_t *w, int n)
+{
+    uint64_t count = 0;
+    int      i;
+
+    for (i = 0; i < n; i++)
+        count += __builtin_popcountll(w[i]);
+    return count;
+}
+
+static const BiscuitBitsetKernels biscuit_kernels_c = {
+    "portable",
+    biscuit_and_words_c, biscuit_or_words_c, biscuit_andnot_words_c,
+    biscuit_popcount_words_c
+};
+
+#ifdef BISCUIT_BITSET_X86
+
+/* Generates an AVX2 kernel: 4 words per step, the tail in scalar code */
+#define BISCUIT_AVX2_KERNEL(name, vop, sop) \
+__attribute__((target("avx2"))) static void \
+name(uint64_t *a, const uint64_t *b, int n) \
+{ \
+    int i = 0; \
+    for (; i + 4 <= n; i += 4) \
+    { \
+        __m256i va = _mm256_loadu_si256((const __m256i *) (a + i)); \
+        __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i)); \
+        _mm256_storeu_si256((__m256i *) (a + i), vop); \
+    } \
+    for (; i < n; i++) \
+        a[i] = sop; \
+}
+
+BISCUIT_AVX2_KERNEL(biscuit_and_words_avx2,    _mm256_and_si256(va, vb),    a[i] & b[i])
+BISCUIT_AVX2_KERNEL(biscuit_or_words_avx2,     _mm256_or_si256(va, vb),     a[i] | b[i])
+BISCUIT_AVX2_KERNEL(biscuit_andnot_words_avx2, _mm256_andnot_si256(vb, va), a[i] & ~b[i])
+
+/* AVX2 has no vector popcount; the hardware instruction per word is as fast */
+__attribute__((target("popcnt"))) static uint64_t
+biscuit_popcount_words_popcnt(const uint64_t *w, int n)
+{
+    uint64_t count = 0;
+    int      i;
+
+    for (i = 0; i < n; i++)
+        count += (uint64_t) _mm_popcnt_u64(w[i]);
+    return count;
+}
+
+#define BISCUIT_AVX512_KERNEL(name, vop, sop) \
+__attribute__((target("avx512f"))) static void \
+name(uint64_t *a, const uint64_t *b, int n) \
+{ \
+    int i = 0; \
+    for (; i + 8 <= n; i += 8) \
+    { \
+        __m512i va = _mm512_loadu_si512((const void *) (a + i)); \
+        __m512i vb = _mm512_loadu_si512((const void *) (b + i)); \
+        _mm512_storeu_si512((void *) (a + i), vop); \
+    } \
+    for (; i < n; i++) \
+        a[i] = sop; \
+}
+
+BISCUIT_AVX512_KERNEL(biscuit_and_words_avx512,    _mm512_and_si512(va, vb),    a[i] & b[i])
+BISCUIT_AVX512_KERNEL(biscuit_or_words_avx512,     _mm512_or_si512(va, vb),     a[i] | b[i])
+BISCUIT_AVX512_KERNEL(biscuit_andnot_words_avx512, _mm512_andnot_si512(vb, va), a[i] & ~b[i])
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt"))) static uint64_t
+biscuit_popcount_words_avx512(const uint64_t *w, int n)
+{
+    __m512i  acc   = _mm512_setzero_si512();
+    uint64_t count = 0;
+    int      i     = 0;
+
+    for (; i + 8 <= n; i += 8)
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512((const void *) (w + i))));
+    count = (uint64_t) _mm512_reduce_add_epi64(acc);
+    for (; i < n; i++)
+        count += (uint64_t) _mm_popcnt_u64(w[i]);
+    return count;
+}
+
+static const BiscuitBitsetKernels biscuit_kernels_avx2 = {
+    "avx2",
+    biscuit_and_words_avx2, biscuit_or_words_avx2, biscuit_andnot_words_avx2,
+    biscuit_popcount_words_popcnt
+};
+
+static const BiscuitBitsetKernels biscuit_kernels_avx512 = {
+    "avx512",
+    biscuit_and_words_avx512, biscuit_or_words_avx512, biscuit_andnot_words_avx512,
+    biscuit_popcount_words_avx512
+};
+
+#endif  /* BISCUIT_BITSET_X86 */
+
+#ifdef BISCUIT_BITSET_NEON
+
+#define BISCUIT_NEON_KERNEL(name, vop, sop) \
+static void \
+name(uint64_t *a, const uint64_t *b, int n) \
+{ \
+    int i = 0; \
+    for (; i + 2 <= n; i += 2) \
+    { \
+        uint64x2_t va = vld1q_u64(a + i); \
+        uint64x2_t vb = vld1q_u64(b + i); \
+        vst1q_u64(a + i, vop); \
+    } \
+    for (; i < n; i++) \
+        a[i] = sop; \
+}
+
+BISCUIT_NEON_KERNEL(biscuit_and_words_neon,    vandq_u64(va, vb), a[i] & b[i])
+BISCUIT_NEON_KERNEL(biscuit_or_words_neon,     vorrq_u64(va, vb), a[i] | b[i])
+BISCUIT_NEON_KERNEL(biscuit_andnot_words_neon, vbicq_u64(va, vb), a[i] & ~b[i])
+
+static uint64_t
+biscuit_popcount_words_neon(const uint64_t *w, int n)
+{
+    uint64_t count = 0;
+    int      i     = 0;
+
+    /* Byte counts of two words are at most 128 and fit a uint8 lane sum */
+    for (; i + 2 <= n; i += 2)
+        count += vaddvq_u8(vcntq_u8(vreinterpretq_u8_u64(vld1q_u64(w + i))));
+    for (; i < n; i++)
+        count += __builtin_popcountll(w[i]);
+    return count;
+}
+
+static const BiscuitBitsetKernels biscuit_kernels_neon = {
+    "neon",
+    biscuit_and_words_neon, biscuit_or_words_neon, biscuit_andnot_words_neon,
+    biscuit_popcount_words_neon
+};
+
+#endif  /* BISCUIT_BITSET_NEON */
+
+static const BiscuitBitsetKernels *biscuit_kernels = NULL;
+
+static const BiscuitBitsetKernels *
+biscuit_bitset_select_kernels(void)
+{
+#if defined(BISCUIT_BITSET_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+        return &biscuit_kernels_avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return &biscuit_kernels_avx2;
+#elif defined(BISCUIT_BITSET_NEON)
+    return &biscuit_kernels_neon;
+#endif
+    return &biscuit_kernels_c;
+}
+
+static inline const BiscuitBitsetKernels *
+biscuit_bitset_kernels_get(void)
+{
+    if (!biscuit_kernels)
+        biscuit_kernels = biscuit_bitset_select_kernels();
+    return biscuit_kernels;
+}
+
+const char *
+biscuit_bitset_kernels(void)
+{
+    return biscuit_bitset_kernels_get()->name;
+}
+
+/* ================================================================
+ * Sparse / dense conversion
+ * ================================================================ */
+
+/* Whether n values up to max_value are best kept as an array */
+static inline bool
+biscuit_bitset_fits_sparse(Size n, uint32_t max_value)
+{
+    return n <= BISCUIT_BITSET_SPARSE_MAX &&
+           n * sizeof(uint32_t) <= ((Size) (max_value >> 6) + 1) * sizeof(uint64_t);
+}
+
+/* Index of the first value >= v in a sorted array */
+static int
+biscuit_bitset_search(const uint32_t *values, int n, uint32_t v)
+{
+    int lo = 0, hi = n;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (values[mid] < v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void
+biscuit_bitset_reserve_values(RoaringBitmap *rb, int n)
+{
+    if (n <= rb->values_capacity)
+        return;
+
+    n = Max(n, Max(rb->values_capacity * 2, 4));
+    if (rb->values)
+        rb->values = (uint32_t *) repalloc(rb->values, n * sizeof(uint32_t));
+    else
+        rb->values = (uint32_t *) palloc(n * sizeof(uint32_t));
+    rb->values_capacity = n;
+}
+
+/* Grow a dense bitmap to at least `blocks` words in use */
+static void
+biscuit_bitset_grow(RoaringBitmap *rb, int blocks)
+{
+    if (blocks > rb->capacity)
     {
-        int      new_cap    = (block + 1) * 2;
+        int       new_cap    = blocks * 2;
         uint64_t *new_blocks = (uint64_t *) palloc0(new_cap * sizeof(uint64_t));
+
         if (rb->num_blocks > 0)
             memcpy(new_blocks, rb->blocks, rb->num_blocks * sizeof(uint64_t));
         pfree(rb->blocks);
         rb->blocks   = new_blocks;
         rb->capacity = new_cap;
     }
-    if (block >= rb->num_blocks)
-        rb->num_blocks = block + 1;
-    rb->blocks[block] |= (1ULL << bit);
+    if (blocks > rb->num_blocks)
+        rb->num_blocks = blocks;
+}
+
+/* Make rb dense with at least `blocks` words */
+static void
+biscuit_bitset_densify(RoaringBitmap *rb, int blocks)
+{
+    int i;
+
+    if (rb->blocks)
+    {
+        biscuit_bitset_grow(rb, blocks);
+        return;
+    }
+
+    if (rb->num_values > 0)
+        blocks = Max(blocks, (int) (rb->values[rb->num_values - 1] >> 6) + 1);
+
+    rb->capacity   = Max(blocks, 16);
+    rb->num_blocks = blocks;
+    rb->blocks     = (uint64_t *) palloc0(rb->capacity * sizeof(uint64_t));
+    for (i = 0; i < rb->num_values; i++)
+        rb->blocks[rb->values[i] >> 6] |= (1ULL << (rb->values[i] & 63));
+
+    if (rb->values)
+        pfree(rb->values);
+    rb->values          = NULL;
+    rb->num_values      = 0;
+    rb->values_capacity = 0;
+}
+
+/* Words in use once trailing zero words are dropped */
+static int
+biscuit_bitset_used_blocks(const RoaringBitmap *rb)
+{
+    int n = rb->num_blocks;
+
+    while (n > 0 && rb->blocks[n - 1] == 0)
+        n--;
+    return n;
+}
+
+/* Extract the set bits of n words into out; returns how many */
+static uint64_t
+biscuit_bitset_extract(const uint64_t *words, int n, uint32_t *out)
+{
+    uint64_t k = 0;
+    int      i;
+
+    for (i = 0; i < n; i++)
+    {
+        uint64_t word = words[i];
+
+        while (word)
+        {
+            out[k++] = (uint32_t) (i * 64 + __builtin_ctzll(word));
+            word    &= word - 1;
+        }
+    }
+    return k;
+}
+
+/* Make a dense bitmap sparse, if that suits its values */
+static void
+biscuit_bitset_sparsify(RoaringBitmap *rb)
+{
+    int      used;
+    uint64_t count;
+
+    if (!rb->blocks)
+        return;
+
+    used  = biscuit_bitset_used_blocks(rb);
+    count = biscuit_bitset_kernels_get()->popcount_words(rb->blocks, used);
+    if (!biscuit_bitset_fits_sparse(count, used > 0 ? (uint32_t) (used * 64 - 1) : 0))
+        return;
+
+    rb->values          = count > 0 ? (uint32_t *) palloc(count * sizeof(uint32_t)) : NULL;
+    rb->num_values      = (int) biscuit_bitset_extract(rb->blocks, used, rb->values);
+    rb->values_capacity = (int) count;
+
+    pfree(rb->blocks);
+    rb->blocks     = NULL;
+    rb->num_blocks = 0;
+    rb->capacity   = 0;
+}
+
+/* Replace rb's contents with the sorted array `values` (taking ownership) */
+static void
+biscuit_bitset_set_values(RoaringBitmap *rb, uint32_t *values, int n, int capacity)
+{
+    if (rb->blocks)
+        pfree(rb->blocks);
+    if (rb->values)
+        pfree(rb->values);
+    rb->blocks          = NULL;
+    rb->num_blocks      = 0;
+    rb->capacity        = 0;
+    rb->values          = values;
+    rb->num_values      = n;
+    rb->values_capacity = capacity;
+}
+
+/* ================================================================
+ * Operations
+ * ================================================================ */
+
+RoaringBitmap *
+biscuit_roaring_create(void)
+{
+    return (RoaringBitmap *) palloc0(sizeof(RoaringBitmap));
+}
+
+bool
+biscuit_roaring_contains(const RoaringBitmap *rb, uint32_t value)
+{
+    int block;
+
+    if (!rb->blocks)
+    {
+        int i = biscuit_bitset_search(rb->values, rb->num_values, value);
+
+        return i < rb->num_values && rb->values[i] == value;
+    }
+
+    block = (int) (value >> 6);
+    return block < rb->num_blocks && (rb->blocks[block] & (1ULL << (value & 63))) != 0;
+}
+
+void
+biscuit_roaring_add(RoaringBitmap *rb, uint32_t value)
+{
+    if (!rb->blocks)
+    {
+        int n = rb->num_values;
+        int i;
+
+        /* Ascending adds (every bulk load) append */
+        i = (n == 0 || rb->values[n - 1] < value) ? n
+            : biscuit_bitset_search(rb->values, n, value);
+        if (i < n && rb->values[i] == value)
+            return;
+
+        if (biscuit_bitset_fits_sparse(n + 1, Max(value, n > 0 ? rb->values[n - 1] : 0)))
+        {
+            biscuit_bitset_reserve_values(rb, n + 1);
+            if (i < n)
+                memmove(rb->values + i + 1, rb->values + i, (n - i) * sizeof(uint32_t));
+            rb->values[i]  = value;
+            rb->num_values = n + 1;
+            return;
+        }
+        biscuit_bitset_densify(rb, (int) (value >> 6) + 1);
+    }
+
+    biscuit_bitset_grow(rb, (int) (value >> 6) + 1);
+    rb->blocks[value >> 6] |= (1ULL << (value & 63));
 }
 
 void
 biscuit_roaring_remove(RoaringBitmap *rb, uint32_t value)
 {
-    int block = value >> 6;
-    int bit   = value & 63;
+    int block;
+
+    if (!rb->blocks)
+    {
+        int i = biscuit_bitset_search(rb->values, rb->num_values, value);
+
+        if (i < rb->num_values && rb->values[i] == value)
+        {
+            memmove(rb->values + i, rb->values + i + 1,
+                    (rb->num_values - i - 1) * sizeof(uint32_t));
+            rb->num_values--;
+        }
+        return;
+    }
+
+    block = (int) (value >> 6);
     if (block < rb->num_blocks)
-        rb->blocks[block] &= ~(1ULL << bit);
+        rb->blocks[block] &= ~(1ULL << (value & 63));
+}
+
+void
+biscuit_roaring_add_many(RoaringBitmap *rb, const uint32_t *values, size_t n)
+{
+    uint32_t max_value = 0;
+    size_t   i;
+
+    if (n == 0)
+        return;
+
+    for (i = 0; i < n; i++)
+        max_value = Max(max_value, values[i]);
+
+    if (!rb->blocks)
+    {
+        if (rb->num_values > 0)
+            max_value = Max(max_value, rb->values[rb->num_values - 1]);
+        if (biscuit_bitset_fits_sparse(rb->num_values + n, max_value))
+        {
+            for (i = 0; i < n; i++)
+                biscuit_roaring_add(rb, values[i]);
+            return;
+        }
+    }
+
+    /* Grow once to the largest value, then set words directly */
+    biscuit_bitset_densify(rb, (int) (max_value >> 6) + 1);
+    for (i = 0; i < n; i++)
+        rb->blocks[values[i] >> 6] |= (1ULL << (values[i] & 63));
+}
+
+void
+biscuit_roaring_optimize(RoaringBitmap *rb)
+{
+    if (rb->blocks)
+        biscuit_bitset_sparsify(rb);
+    else if (rb->values_capacity > rb->num_values)
+    {
+        /* Release spare capacity, as CRoaring's shrink_to_fit does */
+        if (rb->num_values == 0)
+        {
+            pfree(rb->values);
+            rb->values = NULL;
+        }
+        else
+            rb->values = (uint32_t *) repalloc(rb->values, rb->num_values * sizeof(uint32_t));
+        rb->values_capacity = rb->num_values;
+    }
 }
 
 uint64_t
 biscuit_roaring_count(const RoaringBitmap *rb)
 {
-    uint64_t count = 0;
-    int i;
-    for (i = 0; i < rb->num_blocks; i++)
-        count += __builtin_popcountll(rb->blocks[i]);
-    return count;
+    if (!rb->blocks)
+        return (uint64_t) rb->num_values;
+    return biscuit_bitset_kernels_get()->popcount_words(rb->blocks, rb->num_blocks);
 }
 
 bool
 biscuit_roaring_is_empty(const RoaringBitmap *rb)
 {
     int i;
+
+    if (!rb->blocks)
+        return rb->num_values == 0;
     for (i = 0; i < rb->num_blocks; i++)
         if (rb->blocks[i])
             return false;
@@ -155,86 +788,425 @@ biscuit_roaring_free(RoaringBitmap *rb)
         return;
     if (rb->blocks)
         pfree(rb->blocks);
+    if (rb->values)
+        pfree(rb->values);
     pfree(rb);
 }
 
 RoaringBitmap *
 biscuit_roaring_copy(const RoaringBitmap *rb)
 {
-    RoaringBitmap *copy = (RoaringBitmap *) palloc(sizeof(RoaringBitmap));
+    RoaringBitmap *copy = (RoaringBitmap *) palloc0(sizeof(RoaringBitmap));
+
+    if (!rb->blocks)
+    {
+        if (rb->num_values > 0)
+        {
+            copy->values = (uint32_t *) palloc(rb->num_values * sizeof(uint32_t));
+            memcpy(copy->values, rb->values, rb->num_values * sizeof(uint32_t));
+        }
+        copy->num_values      = rb->num_values;
+        copy->values_capacity = rb->num_values;
+        return copy;
+    }
+
+    /* A view has capacity == num_blocks; copies get room to grow */
     copy->num_blocks = rb->num_blocks;
-    copy->capacity   = rb->capacity;
-    copy->blocks     = (uint64_t *) palloc(rb->capacity * sizeof(uint64_t));
-    memcpy(copy->blocks, rb->blocks, rb->capacity * sizeof(uint64_t));
+    copy->capacity   = Max(rb->capacity, 16);
+    copy->blocks     = (uint64_t *) palloc0(copy->capacity * sizeof(uint64_t));
+    memcpy(copy->blocks, rb->blocks, rb->num_blocks * sizeof(uint64_t));
     return copy;
 }
 
+/* Keep the values of sparse a for which b's membership equals `keep` */
+static void
+biscuit_bitset_filter(RoaringBitmap *a, const RoaringBitmap *b, bool keep)
+{
+    int i, j = 0, n = 0;
+
+    for (i = 0; i < a->num_values; i++)
+    {
+        uint32_t v = a->values[i];
+        bool     in_b;
+
+        if (!b->blocks)
+        {
+            /* Both sorted: advance through b instead of searching it */
+            while (j < b->num_values && b->values[j] < v)
+                j++;
+            in_b = j < b->num_values && b->values[j] == v;
+        }
+        else
+            in_b = (int) (v >> 6) < b->num_blocks &&
+                   (b->blocks[v >> 6] & (1ULL << (v & 63))) != 0;
+
+        if (in_b == keep)
+            a->values[n++] = v;
+    }
+    a->num_values = n;
+}
+
 void
 biscuit_roaring_and_inplace(RoaringBitmap *a, const RoaringBitmap *b)
 {
-    int i;
-    int min_blocks = (a->num_blocks < b->num_blocks) ? a->num_blocks : b->num_blocks;
-    for (i = 0; i < min_blocks; i++)
-        a->blocks[i] &= b->blocks[i];
-    for (i = min_blocks; i < a->num_blocks; i++)
-        a->blocks[i] = 0;
+    int min_blocks;
+
+    biscuit_bitmap_ops++;
+
+    if (!a->blocks)
+    {
+        biscuit_bitset_filter(a, b, true);
+        return;
+    }
+
+    if (!b->blocks)
+    {
+        /* The result is a subset of sparse b, so it is sparse too */
+        uint32_t *values = b->num_values > 0
+            ? (uint32_t *) palloc(b->num_values * sizeof(uint32_t)) : NULL;
+        int       n = 0;
+        int       i;
+
+        for (i = 0; i < b->num_values; i++)
+        {
+            uint32_t v = b->values[i];
+
+            if ((int) (v >> 6) < a->num_blocks && (a->blocks[v >> 6] & (1ULL << (v & 63))))
+                values[n++] = v;
+        }
+        biscuit_bitset_set_values(a, values, n, b->num_values);
+        return;
+    }
+
+    min_blocks = Min(a->num_blocks, b->num_blocks);
+    biscuit_bitset_kernels_get()->and_words(a->blocks, b->blocks, min_blocks);
+    if (a->num_blocks > min_blocks)
+        memset(a->blocks + min_blocks, 0, (a->num_blocks - min_blocks) * sizeof(uint64_t));
+}
+
+/* Union of two sparse bitmaps into a */
+static void
+biscuit_bitset_merge(RoaringBitmap *a, const uint32_t *bv, int bn)
+{
+    uint32_t *merged;
+    int       i = 0, j = 0, n = 0;
+    uint32_t  max_value;
+
+    if (bn == 0)
+        return;
+
+    max_value = a->num_values > 0 ? Max(a->values[a->num_values - 1], bv[bn - 1]) : bv[bn - 1];
+    if (!biscuit_bitset_fits_sparse((Size) a->num_values + bn, max_value))
+    {
+        biscuit_bitset_densify(a, (int) (max_value >> 6) + 1);
+        for (j = 0; j < bn; j++)
+            a->blocks[bv[j] >> 6] |= (1ULL << (bv[j] & 63));
+        return;
+    }
+
+    merged = (uint32_t *) palloc((a->num_values + bn) * sizeof(uint32_t));
+    while (i < a->num_values || j < bn)
+    {
+        if (j == bn || (i < a->num_values && a->values[i] < bv[j]))
+            merged[n++] = a->values[i++];
+        else
+        {
+            if (i < a->num_values && a->values[i] == bv[j])
+                i++;
+            merged[n++] = bv[j++];
+        }
+    }
+    biscuit_bitset_set_values(a, merged, n, a->num_values + bn);
 }
 
 void
 biscuit_roaring_or_inplace(RoaringBitmap *a, const RoaringBitmap *b)
 {
     int i;
-    if (b->num_blocks > a->capacity)
+
+    biscuit_bitmap_ops++;
+
+    if (a == b)
+        return;
+
+    if (!b->blocks)
     {
-        int      new_cap     = b->num_blocks * 2;
-        uint64_t *new_blocks = (uint64_t *) palloc0(new_cap * sizeof(uint64_t));
-        if (a->num_blocks > 0)
-            memcpy(new_blocks, a->blocks, a->num_blocks * sizeof(uint64_t));
-        pfree(a->blocks);
-        a->blocks   = new_blocks;
-        a->capacity = new_cap;
+        if (!a->blocks)
+            biscuit_bitset_merge(a, b->values, b->num_values);
+        else
+        {
+            if (b->num_values > 0)
+                biscuit_bitset_grow(a, (int) (b->values[b->num_values - 1] >> 6) + 1);
+            for (i = 0; i < b->num_values; i++)
+                a->blocks[b->values[i] >> 6] |= (1ULL << (b->values[i] & 63));
+        }
+        return;
     }
-    if (b->num_blocks > a->num_blocks)
-        a->num_blocks = b->num_blocks;
-    for (i = 0; i < b->num_blocks; i++)
-        a->blocks[i] |= b->blocks[i];
+
+    biscuit_bitset_densify(a, b->num_blocks);
+    biscuit_bitset_kernels_get()->or_words(a->blocks, b->blocks, b->num_blocks);
 }
 
 void
 biscuit_roaring_andnot_inplace(RoaringBitmap *a, const RoaringBitmap *b)
 {
     int i;
-    int min_blocks = (a->num_blocks < b->num_blocks) ? a->num_blocks : b->num_blocks;
-    for (i = 0; i < min_blocks; i++)
-        a->blocks[i] &= ~b->blocks[i];
+
+    biscuit_bitmap_ops++;
+
+    if (!a->blocks)
+    {
+        biscuit_bitset_filter(a, b, false);
+        return;
+    }
+
+    if (!b->blocks)
+    {
+        for (i = 0; i < b->num_values; i++)
+            biscuit_roaring_remove(a, b->values[i]);
+        return;
+    }
+
+    biscuit_bitset_kernels_get()->andnot_words(a->blocks, b->blocks,
+                                               Min(a->num_blocks, b->num_blocks));
 }
 
+void
+biscuit_roaring_or_shifted(RoaringBitmap *a, const RoaringBitmap *b, uint32_t offset)
+{
+    int base  = (int) (offset >> 6);
+    int shift = (int) (offset & 63);
+    int need;
+    int i;
+
+    if (!b->blocks)
+    {
+        uint32_t *shifted;
+
+        if (b->num_values == 0)
+            return;
+
+        shifted = (uint32_t *) palloc(b->num_values * sizeof(uint32_t));
+        for (i = 0; i < b->num_values; i++)
+            shifted[i] = b->values[i] + offset;
+
+        if (!a->blocks)
+            biscuit_bitset_merge(a, shifted, b->num_values);
+        else
+        {
+            biscuit_bitset_grow(a, (int) (shifted[b->num_values - 1] >> 6) + 1);
+            for (i = 0; i < b->num_values; i++)
+                a->blocks[shifted[i] >> 6] |= (1ULL << (shifted[i] & 63));
+        }
+        pfree(shifted);
+        return;
+    }
+
+    if (b->num_blocks == 0)
+        return;
+
+    need = b->num_blocks + base + (shift ? 1 : 0);
+    biscuit_bitset_densify(a, need);
+
+    for (i = 0; i < b->num_blocks; i++)
+    {
+        uint64_t word = b->blocks[i];
+
+        if (word == 0)
+            continue;
+        a->blocks[i + base] |= word << shift;
+        if (shift)
+            a->blocks[i + base + 1] |= word >> (64 - shift);
+    }
+}
+
+/*
+ * The popcount sizes the array exactly; set bits are then peeled off
+ * each word lowest first (ctz, a single tzcnt on BMI hardware).
+ */
 uint32_t *
 biscuit_roaring_to_array(const RoaringBitmap *rb, uint64_t *count)
 {
     uint64_t  total = biscuit_roaring_count(rb);
     uint32_t *array;
-    uint64_t  idx   = 0;
-    int       i;
 
     *count = total;
     if (total == 0)
         return NULL;
 
-    array = (uint32_t *) palloc(total * sizeof(uint32_t));
-    for (i = 0; i < rb->num_blocks; i++)
+    array = (uint32_t *) biscuit_palloc_huge(total * sizeof(uint32_t));
+    if (!rb->blocks)
+        memcpy(array, rb->values, total * sizeof(uint32_t));
+    else
+        biscuit_bitset_extract(rb->blocks, rb->num_blocks, array);
+    return array;
+}
+
+uint32_t *
+biscuit_roaring_to_array_ranked(const RoaringBitmap *rb, uint64_t start, uint64_t n,
+                                uint64_t *count)
+{
+    uint64_t  total = biscuit_roaring_count(rb);
+    uint64_t  seen  = 0;
+    uint64_t  got   = 0;
+    uint32_t *array;
+    int       b     = 0;
+
+    *count = 0;
+    if (n == 0 || start >= total)
+        return NULL;
+    n = Min(n, total - start);
+
+    array = (uint32_t *) biscuit_palloc_huge(n * sizeof(uint32_t));
+    if (!rb->blocks)
     {
-        uint64_t word = rb->blocks[i];
-        while (word)
+        memcpy(array, rb->values + start, n * sizeof(uint32_t));
+        *count = n;
+        return array;
+    }
+
+    /* Whole words before the one holding rank start go by popcount */
+    while (seen + (uint64_t) __builtin_popcountll(rb->blocks[b]) <= start)
+        seen += __builtin_popcountll(rb->blocks[b++]);
+
+    for (; b < rb->num_blocks && got < n; b++)
+    {
+        uint64_t word = rb->blocks[b];
+
+        while (word && got < n)
         {
-            int bit     = __builtin_ctzll(word);
-            array[idx++] = (uint32_t)(i * 64 + bit);
-            word        &= word - 1;
+            int bit = __builtin_ctzll(word);
+
+            word &= word - 1;
+            if (seen++ >= start)
+                array[got++] = ((uint32_t) b << 6) | (uint32_t) bit;
         }
     }
+
+    *count = got;
     return array;
 }
 
+/*
+ * Fallback encoding: uint64 word count, then that many uint64 words, so
+ * the words stay 8-byte aligned when the encoding is.  Trailing zero
+ * words are trimmed so the encoding does not depend on how far the
+ * bitset happened to grow, or on which form it was in.
+ */
+static int
+biscuit_bitset_encoded_words(const RoaringBitmap *rb)
+{
+    if (!rb->blocks)
+        return rb->num_values > 0 ? (int) (rb->values[rb->num_values - 1] >> 6) + 1 : 0;
+    return biscuit_bitset_used_blocks(rb);
+}
+
+size_t
+biscuit_roaring_serialized_size(const RoaringBitmap *rb)
+{
+    return sizeof(uint64) + biscuit_bitset_encoded_words(rb) * sizeof(uint64_t);
+}
+
+size_t
+biscuit_roaring_serialized_bound(uint64 universe)
+{
+    return sizeof(uint64) + ((universe + 63) >> 6) * sizeof(uint64_t);
+}
+
+size_t
+biscuit_roaring_serialize(const RoaringBitmap *rb, char *buf)
+{
+    uint64 n = (uint64) biscuit_bitset_encoded_words(rb);
+
+    memcpy(buf, &n, sizeof(uint64));
+    if (n > 0 && rb->blocks)
+        memcpy(buf + sizeof(uint64), rb->blocks, n * sizeof(uint64_t));
+    else if (n > 0)
+    {
+        /* buf need not be aligned: assemble each word, then copy it out */
+        uint64_t word  = 0;
+        uint32_t block = rb->values[0] >> 6;
+        int      i;
+
+        memset(buf + sizeof(uint64), 0, n * sizeof(uint64_t));
+        for (i = 0; i <= rb->num_values; i++)
+        {
+            if (i == rb->num_values || (rb->values[i] >> 6) != block)
+            {
+                memcpy(buf + sizeof(uint64) + block * sizeof(uint64_t), &word, sizeof(uint64_t));
+                if (i == rb->num_values)
+                    break;
+                word  = 0;
+                block = rb->values[i] >> 6;
+            }
+            word |= 1ULL << (rb->values[i] & 63);
+        }
+    }
+    return sizeof(uint64) + n * sizeof(uint64_t);
+}
+
+/* Word count of a well-formed encoding of exactly len bytes, or -1 */
+static int
+biscuit_bitset_encoded_blocks(const char *buf, size_t len)
+{
+    uint64 n;
+
+    if (len < sizeof(uint64))
+        return -1;
+    memcpy(&n, buf, sizeof(uint64));
+    if (n > (uint64) INT_MAX || len != sizeof(uint64) + n * sizeof(uint64_t))
+        return -1;
+    return (int) n;
+}
+
+RoaringBitmap *
+biscuit_roaring_deserialize(const char *buf, size_t len)
+{
+    RoaringBitmap *rb;
+    int            n = biscuit_bitset_encoded_blocks(buf, len);
+
+    if (n < 0)
+        return NULL;
+
+    rb             = (RoaringBitmap *) palloc0(sizeof(RoaringBitmap));
+    rb->capacity   = Max(n, 16);
+    rb->num_blocks = n;
+    rb->blocks     = (uint64_t *) palloc0(rb->capacity * sizeof(uint64_t));
+    if (n > 0)
+        memcpy(rb->blocks, buf + sizeof(uint64), n * sizeof(uint64_t));
+
+    /* Small bitmaps load in the form a build leaves them in */
+    biscuit_bitset_sparsify(rb);
+    return rb;
+}
+
+/*
+ * Read-only view: blocks point straight into buf, which must be 8-byte
+ * aligned and outlive the view.  Views are always dense and must never
+ * be grown or freed with biscuit_roaring_free().
+ */
+RoaringBitmap *
+biscuit_roaring_view(const char *buf, size_t len)
+{
+    RoaringBitmap *rb;
+    int            n = biscuit_bitset_encoded_blocks(buf, len);
+
+    if (n < 0 || ((uintptr_t) buf % sizeof(uint64_t)) != 0)
+        return NULL;
+
+    rb             = (RoaringBitmap *) palloc0(sizeof(RoaringBitmap));
+    rb->capacity   = n;
+    rb->num_blocks = n;
+    rb->blocks     = (uint64_t *) (buf + sizeof(uint64));
+    return rb;
+}
+
+void
+biscuit_roaring_view_free(RoaringBitmap *rb)
+{
+    pfree(rb);
+}
+
 #endif  /* HAVE_ROARING */
 
 /* ==================== MEMORY USAGE HELPERS ==================== */
@@ -247,7 +1219,8 @@ biscuit_roaring_memory_usage(const RoaringBitmap *rb)
 #ifdef HAVE_ROARING
     return roaring_bitmap_size_in_bytes(rb);
 #else
-    return sizeof(RoaringBitmap) + (rb->capacity * sizeof(uint64_t));
+    return sizeof(RoaringBitmap) + (rb->capacity * sizeof(uint64_t)) +
+           (rb->values_capacity * sizeof(uint32_t));
 #endif
 }
 
@@ -321,5 +1294,7 @@ biscuit_columnindex_memory_usage(const ColumnIndex *col_idx)
         total += (col_idx->max_length_lower + 1) * sizeof(RoaringBitmap *);
     }
 
+    total += biscuit_trigram_memory_usage(col_idx->trigrams);
+
     return total;
 }
\ No newline at end of file
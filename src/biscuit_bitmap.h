@@ -1,7 +1,8 @@
 /*
  * biscuit_bitmap.h
  * Roaring bitmap abstraction layer declarations.
- * Wraps CRoaring when available, falls back to a simple bitset.
+ * Wraps CRoaring when available, falls back to a sparse array / bitset
+ * hybrid with vectorized word kernels.
  */
 
 #ifndef BISCUIT_BITMAP_H
@@ -11,9 +12,15 @@
 
 /* ==================== BITMAP WRAPPERS ==================== */
 
+/* In-place AND / OR / ANDNOT operations so far, for the scan instrumentation */
+extern uint64         biscuit_bitmap_ops;
+
 extern RoaringBitmap *biscuit_roaring_create(void);
 extern void           biscuit_roaring_add(RoaringBitmap *rb, uint32_t value);
 extern void           biscuit_roaring_remove(RoaringBitmap *rb, uint32_t value);
+extern bool           biscuit_roaring_contains(const RoaringBitmap *rb, uint32_t value);
+extern void           biscuit_roaring_add_many(RoaringBitmap *rb, const uint32_t *values,
+                                               size_t n);
 extern uint64_t       biscuit_roaring_count(const RoaringBitmap *rb);
 extern bool           biscuit_roaring_is_empty(const RoaringBitmap *rb);
 extern void           biscuit_roaring_free(RoaringBitmap *rb);
@@ -21,7 +28,41 @@ extern RoaringBitmap *biscuit_roaring_copy(const RoaringBitmap *rb);
 extern void           biscuit_roaring_and_inplace(RoaringBitmap *a, const RoaringBitmap *b);
 extern void           biscuit_roaring_or_inplace(RoaringBitmap *a, const RoaringBitmap *b);
 extern void           biscuit_roaring_andnot_inplace(RoaringBitmap *a, const RoaringBitmap *b);
+extern void           biscuit_roaring_or_shifted(RoaringBitmap *a, const RoaringBitmap *b,
+                                                 uint32_t offset);
 extern uint32_t      *biscuit_roaring_to_array(const RoaringBitmap *rb, uint64_t *count);
+/* The values of rank [start, start + n), ascending; NULL when there are none */
+extern uint32_t      *biscuit_roaring_to_array_ranked(const RoaringBitmap *rb, uint64_t start,
+                                                      uint64_t n, uint64_t *count);
+extern void           biscuit_roaring_optimize(RoaringBitmap *rb);
+
+#ifndef HAVE_ROARING
+/* Name of the word kernels this CPU runs ("avx512", "avx2", "neon", "portable") */
+extern const char    *biscuit_bitset_kernels(void);
+#endif
+
+/* ==================== SERIALIZATION ==================== */
+
+/*
+ * On-disk encoding used by biscuit_storage.c.  With HAVE_ROARING this is
+ * the CRoaring portable format; the fallback bitset writes its word count
+ * followed by the raw words.  The two encodings are not interchangeable,
+ * which is why the metapage records which one a snapshot was written with.
+ */
+extern size_t         biscuit_roaring_serialized_size(const RoaringBitmap *rb);
+extern size_t         biscuit_roaring_serialize(const RoaringBitmap *rb, char *buf);
+extern RoaringBitmap *biscuit_roaring_deserialize(const char *buf, size_t len);
+
+/* Largest encoding of any bitmap whose values are all below universe */
+extern size_t         biscuit_roaring_serialized_bound(uint64 universe);
+
+/*
+ * Zero-copy, read-only bitmap over an encoding that stays mapped (used for
+ * the shared-memory image, see biscuit_shared.c).  Release with
+ * biscuit_roaring_view_free(), never biscuit_roaring_free().
+ */
+extern RoaringBitmap *biscuit_roaring_view(const char *buf, size_t len);
+extern void           biscuit_roaring_view_free(RoaringBitmap *rb);
 
 /* ==================== MEMORY USAGE HELPERS ==================== */
 
@@ -0,0 +1,662 @@
+/*
+ * biscuit_bulk.c
+ * Bulk-loading pipeline for builds, skeleton completion and preload.
+ *
+ * Indexing a record one bitmap operation at a time is dominated by
+ * overheads that have nothing to do with the record itself: a binary
+ * search of the CharIndex for every byte, a separate
+ * biscuit_roaring_add() into the position, negative-position and
+ * character-cache bitmaps, and (in the old helpers) a recount of the
+ * remaining characters for every byte, quadratic in the string length.
+ * Long values made builds CPU-bound.
+ *
+ * The loader decodes each string once.  The negative offset of a
+ * character is char_count - char_pos, so no recount is needed.  Record
+ * ids are appended to per-bitmap batches ("slots") instead of to the
+ * bitmaps:
+ *
+ *   slot lookup   direct arrays indexed by byte and position (and by
+ *                 character count for length slots), so the CharIndex is
+ *                 searched only once per distinct (byte, position), when
+ *                 its slot and bitmap are created.
+ *   batching      ids arrive in ascending record order, and a slot skips
+ *                 the id it appended last (a byte repeated in one value).
+ *                 Once BISCUIT_BULK_PENDING ids are buffered, every batch
+ *                 goes to its bitmap with biscuit_roaring_add_many() and
+ *                 the batch memory is released in one context reset.
+ *   finish        length_ge bitmaps are suffix unions of the exact-length
+ *                 bitmaps, built top down with one OR per length instead
+ *                 of one add per (record, length).  Every bitmap is then
+ *                 run-optimized and shrunk.
+ *
+ * A loader started with biscuit_bulk_begin_append() adds records to an
+ * index that already holds others, as the pending-list merge does: the
+ * new length bitmaps are OR-ed into the existing arrays and only the
+ * bitmaps the batch touched are run-optimized.
+ *
+ * Trigram postings (biscuit_trigram_add) are still added per record.
+ * Position, negative-position and character-cache bitmaps are only built
+ * where the index options (BiscuitOptions) ask for them.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_bulk.h"
+#include "biscuit_trigram.h"
+#include "biscuit_utf8.h"
+
+/* Record ids buffered across all slots before a flush (4 MB) */
+#define BISCUIT_BULK_PENDING    (1 << 20)
+
+/* One target bitmap and its pending batch */
+typedef struct BiscuitBulkSlot
+{
+    RoaringBitmap *bitmap;
+    uint32        *values;      /* in pending_context */
+    int            count;
+    int            capacity;
+    uint32         last;        /* last id appended + 1, 0 if none */
+} BiscuitBulkSlot;
+
+/* Slots indexed by a small non-negative key (position or length) */
+typedef struct BiscuitBulkSlotArray
+{
+    BiscuitBulkSlot **slots;
+    int               capacity;
+} BiscuitBulkSlotArray;
+
+/* The structures of one case side of one column */
+typedef struct BiscuitBulkSide
+{
+    CharIndex             *pos_idx;         /* [CHAR_RANGE] */
+    CharIndex             *neg_idx;         /* [CHAR_RANGE] */
+    RoaringBitmap        **char_cache;      /* [CHAR_RANGE] */
+    RoaringBitmap       ***length_bitmaps;
+    RoaringBitmap       ***length_ge_bitmaps;
+    int                   *max_length;
+
+    BiscuitBulkSlotArray   pos[CHAR_RANGE];     /* by char_pos */
+    BiscuitBulkSlotArray   neg[CHAR_RANGE];     /* by remaining chars - 1 */
+    BiscuitBulkSlot       *cache[CHAR_RANGE];
+    BiscuitBulkSlotArray   lengths;             /* by char count */
+    int                    max_chars;
+
+    /* Which structures the index options select (BiscuitOptions) */
+    bool                   positions;           /* pos, neg and char cache */
+    bool                   suffix;              /* neg */
+    int                    position_limit;      /* max_indexed_chars */
+} BiscuitBulkSide;
+
+struct BiscuitBulkLoader
+{
+    BiscuitIndex     *idx;
+    MemoryContext     index_context;    /* where the bitmaps live */
+    MemoryContext     loader_context;   /* slots, slot arrays, dirty list */
+    MemoryContext     pending_context;  /* batches, reset on every flush */
+    int               nsides;           /* 2 per column: exact, lower */
+    BiscuitBulkSide  *sides;
+
+    BiscuitBulkSlot **dirty;            /* slots with a pending batch */
+    int               ndirty;
+    int               dirty_capacity;
+    int64             pending;
+    bool              append;           /* the index already holds records */
+};
+
+/* ================================================================
+ * SECTION 1 – Slots and batches
+ * ================================================================ */
+
+/* Get-or-create the bitmap of pos in ci (ci sorted by pos) */
+static RoaringBitmap *
+biscuit_bulk_charindex_bitmap(CharIndex *ci, int pos)
+{
+    int left = 0, right = ci->count - 1;
+    int insert_pos = ci->count;
+    int i;
+
+    while (left <= right)
+    {
+        int mid = (left + right) >> 1;
+
+        if (ci->entries[mid].pos == pos)
+            return ci->entries[mid].bitmap;
+        else if (ci->entries[mid].pos < pos)
+            left = mid + 1;
+        else
+        {
+            insert_pos = mid;
+            right      = mid - 1;
+        }
+    }
+
+    if (ci->count >= ci->capacity)
+    {
+        int       new_cap     = ci->capacity > 0 ? ci->capacity * 2 : 8;
+        PosEntry *new_entries = (PosEntry *) palloc(new_cap * sizeof(PosEntry));
+
+        if (ci->count > 0)
+            memcpy(new_entries, ci->entries, ci->count * sizeof(PosEntry));
+        if (ci->entries)
+            pfree(ci->entries);
+        ci->entries  = new_entries;
+        ci->capacity = new_cap;
+    }
+
+    for (i = ci->count; i > insert_pos; i--)
+        ci->entries[i] = ci->entries[i - 1];
+
+    ci->entries[insert_pos].pos    = pos;
+    ci->entries[insert_pos].bitmap = biscuit_roaring_create();
+    ci->count++;
+
+    return ci->entries[insert_pos].bitmap;
+}
+
+static BiscuitBulkSlot *
+biscuit_bulk_new_slot(BiscuitBulkLoader *bl, RoaringBitmap *bitmap)
+{
+    BiscuitBulkSlot *slot;
+
+    slot = (BiscuitBulkSlot *) MemoryContextAllocZero(bl->loader_context,
+                                                      sizeof(BiscuitBulkSlot));
+    slot->bitmap = bitmap;
+    return slot;
+}
+
+/* Slot key of array, growing array as needed; NULL if not created yet */
+static BiscuitBulkSlot **
+biscuit_bulk_slot_ref(BiscuitBulkLoader *bl, BiscuitBulkSlotArray *array, int key)
+{
+    if (key >= array->capacity)
+    {
+        int new_cap = Max(array->capacity * 2, 16);
+
+        while (key >= new_cap)
+            new_cap *= 2;
+
+        if (array->slots)
+            array->slots = (BiscuitBulkSlot **)
+                repalloc(array->slots, new_cap * sizeof(BiscuitBulkSlot *));
+        else
+            array->slots = (BiscuitBulkSlot **)
+                MemoryContextAlloc(bl->loader_context, new_cap * sizeof(BiscuitBulkSlot *));
+        memset(array->slots + array->capacity, 0,
+               (new_cap - array->capacity) * sizeof(BiscuitBulkSlot *));
+        array->capacity = new_cap;
+    }
+    return &array->slots[key];
+}
+
+static BiscuitBulkSlot *
+biscuit_bulk_charindex_slot(BiscuitBulkLoader *bl, BiscuitBulkSlotArray *array,
+                            CharIndex *ci, int key, int pos)
+{
+    BiscuitBulkSlot **ref = biscuit_bulk_slot_ref(bl, array, key);
+
+    if (!*ref)
+    {
+        MemoryContext oldcontext = MemoryContextSwitchTo(bl->index_context);
+
+        *ref = biscuit_bulk_new_slot(bl, biscuit_bulk_charindex_bitmap(ci, pos));
+        MemoryContextSwitchTo(oldcontext);
+    }
+    return *ref;
+}
+
+static void
+biscuit_bulk_flush(BiscuitBulkLoader *bl)
+{
+    int i;
+
+    for (i = 0; i < bl->ndirty; i++)
+    {
+        BiscuitBulkSlot *slot = bl->dirty[i];
+
+        biscuit_roaring_add_many(slot->bitmap, slot->values, slot->count);
+        slot->values   = NULL;
+        slot->count    = 0;
+        slot->capacity = 0;
+    }
+
+    bl->ndirty  = 0;
+    bl->pending = 0;
+    MemoryContextReset(bl->pending_context);
+}
+
+static void
+biscuit_bulk_push(BiscuitBulkLoader *bl, BiscuitBulkSlot *slot, uint32 rec)
+{
+    if (slot->last == rec + 1)
+        return;
+    slot->last = rec + 1;
+
+    if (slot->count >= slot->capacity)
+    {
+        int new_cap = slot->capacity > 0 ? slot->capacity * 2 : 8;
+
+        if (slot->values)
+            slot->values = (uint32 *) repalloc(slot->values, new_cap * sizeof(uint32));
+        else
+        {
+            slot->values = (uint32 *) MemoryContextAlloc(bl->pending_context,
+                                                         new_cap * sizeof(uint32));
+
+            if (bl->ndirty >= bl->dirty_capacity)
+            {
+                bl->dirty_capacity *= 2;
+                bl->dirty = (BiscuitBulkSlot **)
+                    repalloc(bl->dirty, bl->dirty_capacity * sizeof(BiscuitBulkSlot *));
+            }
+            bl->dirty[bl->ndirty++] = slot;
+        }
+        slot->capacity = new_cap;
+    }
+
+    slot->values[slot->count++] = rec;
+    bl->pending++;
+}
+
+/* ================================================================
+ * SECTION 2 – Records
+ * ================================================================ */
+
+/* Byte uch at character char_pos of a value of char_count characters */
+static inline void
+biscuit_bulk_add_byte(BiscuitBulkLoader *bl, BiscuitBulkSide *side,
+                      unsigned char uch, int char_pos, int char_count, uint32 rec)
+{
+    int limit     = side->position_limit;
+    int remaining = char_count - char_pos;
+
+    if (limit == 0 || char_pos < limit)
+        biscuit_bulk_push(bl, biscuit_bulk_charindex_slot(bl, &side->pos[uch],
+                                                          &side->pos_idx[uch],
+                                                          char_pos, char_pos),
+                          rec);
+    if (side->suffix && (limit == 0 || remaining <= limit))
+        biscuit_bulk_push(bl, biscuit_bulk_charindex_slot(bl, &side->neg[uch],
+                                                          &side->neg_idx[uch],
+                                                          remaining - 1, -remaining),
+                          rec);
+
+    if (!side->cache[uch])
+    {
+        MemoryContext oldcontext = MemoryContextSwitchTo(bl->index_context);
+
+        if (!side->char_cache[uch])
+            side->char_cache[uch] = biscuit_roaring_create();
+        side->cache[uch] = biscuit_bulk_new_slot(bl, side->char_cache[uch]);
+        MemoryContextSwitchTo(oldcontext);
+    }
+    biscuit_bulk_push(bl, side->cache[uch], rec);
+}
+
+static void
+biscuit_bulk_add_length(BiscuitBulkLoader *bl, BiscuitBulkSide *side,
+                        int char_count, uint32 rec)
+{
+    BiscuitBulkSlot **ref = biscuit_bulk_slot_ref(bl, &side->lengths, char_count);
+
+    if (!*ref)
+    {
+        MemoryContext oldcontext = MemoryContextSwitchTo(bl->index_context);
+
+        *ref = biscuit_bulk_new_slot(bl, biscuit_roaring_create());
+        MemoryContextSwitchTo(oldcontext);
+    }
+    biscuit_bulk_push(bl, *ref, rec);
+
+    if (char_count > side->max_chars)
+        side->max_chars = char_count;
+}
+
+/*
+ * Index str on side and, when lower_side is given, its lowercase copy
+ * lower on lower_side in the same pass.  The caller guarantees that lower
+ * then has the same characters at the same byte offsets (str is ASCII,
+ * or folding left it unchanged).
+ */
+static void
+biscuit_bulk_add_side(BiscuitBulkLoader *bl, BiscuitBulkSide *side,
+                      const char *str, int byte_len,
+                      BiscuitBulkSide *lower_side, const char *lower,
+                      uint32 rec)
+{
+    int  char_count = biscuit_utf8_char_count(str, byte_len);
+    int  byte_pos   = 0;
+    int  char_pos   = 0;
+    bool upper_pos  = side->positions;
+    bool lower_pos  = lower_side && lower_side->positions;
+
+    while ((upper_pos || lower_pos) && byte_pos < byte_len)
+    {
+        int char_len = biscuit_utf8_char_length((unsigned char) str[byte_pos]);
+        int b;
+
+        if (byte_pos + char_len > byte_len)
+            char_len = byte_len - byte_pos;
+
+        for (b = 0; b < char_len; b++)
+        {
+            if (upper_pos)
+                biscuit_bulk_add_byte(bl, side, (unsigned char) str[byte_pos + b],
+                                      char_pos, char_count, rec);
+            if (lower_pos)
+                biscuit_bulk_add_byte(bl, lower_side, (unsigned char) lower[byte_pos + b],
+                                      char_pos, char_count, rec);
+        }
+
+        byte_pos += char_len;
+        char_pos++;
+    }
+
+    biscuit_bulk_add_length(bl, side, char_count, rec);
+    if (lower_side)
+        biscuit_bulk_add_length(bl, lower_side, char_count, rec);
+}
+
+/*
+ * The case-insensitive side is indexed in the same decoding pass as the
+ * case-sensitive one whenever the lowercase copy keeps the character
+ * layout: an unchanged value, or ASCII folded to ASCII of the same length.
+ */
+void
+biscuit_bulk_add(BiscuitBulkLoader *bl, int col,
+                 const char *str, int byte_len,
+                 const char *str_lower, int lower_len,
+                 uint32 rec)
+{
+    BiscuitBulkSide *sides = &bl->sides[col * 2];
+    CharIndex       *tri;
+
+    if (!str_lower || !bl->idx->options.ilike)
+        biscuit_bulk_add_side(bl, &sides[0], str, byte_len, NULL, NULL, rec);
+    else if (lower_len == byte_len &&
+             (str_lower == str || biscuit_str_is_ascii(str, byte_len)))
+        biscuit_bulk_add_side(bl, &sides[0], str, byte_len, &sides[1], str_lower, rec);
+    else
+    {
+        biscuit_bulk_add_side(bl, &sides[0], str, byte_len, NULL, NULL, rec);
+        biscuit_bulk_add_side(bl, &sides[1], str_lower, lower_len, NULL, NULL, rec);
+    }
+
+    tri = bl->idx->num_columns == 1 ? bl->idx->trigrams_legacy
+                                    : bl->idx->column_indices[col].trigrams;
+    biscuit_trigram_add(tri, str, byte_len, str_lower, lower_len, rec);
+
+    if (bl->pending >= BISCUIT_BULK_PENDING)
+        biscuit_bulk_flush(bl);
+}
+
+/* ================================================================
+ * SECTION 3 – Setup and finish
+ * ================================================================ */
+
+/*
+ * Length bitmaps are built on every side: the case-sensitive length_ge[0]
+ * is the set of indexed records even when no position bitmaps are.
+ */
+static void
+biscuit_bulk_init_side(BiscuitBulkSide *side, const BiscuitOptions *options,
+                       bool lower,
+                       CharIndex *pos_idx, CharIndex *neg_idx,
+                       RoaringBitmap **char_cache,
+                       RoaringBitmap ***length_bitmaps,
+                       RoaringBitmap ***length_ge_bitmaps,
+                       int *max_length)
+{
+    side->positions         = lower ? options->ilike : options->like;
+    side->suffix            = options->suffix_index;
+    side->position_limit    = options->max_indexed_chars;
+    side->pos_idx           = pos_idx;
+    side->neg_idx           = neg_idx;
+    side->char_cache        = char_cache;
+    side->length_bitmaps    = length_bitmaps;
+    side->length_ge_bitmaps = length_ge_bitmaps;
+    side->max_length        = max_length;
+}
+
+static BiscuitBulkLoader *
+biscuit_bulk_start(BiscuitIndex *idx, bool append)
+{
+    BiscuitBulkLoader *bl;
+    MemoryContext      loader_context;
+    int                col;
+
+    loader_context = AllocSetContextCreate(CurrentMemoryContext,
+                                           "Biscuit bulk load",
+                                           ALLOCSET_DEFAULT_SIZES);
+
+    bl = (BiscuitBulkLoader *) MemoryContextAllocZero(loader_context, sizeof(BiscuitBulkLoader));
+    bl->idx             = idx;
+    bl->index_context   = CurrentMemoryContext;
+    bl->loader_context  = loader_context;
+    bl->pending_context = AllocSetContextCreate(loader_context,
+                                                "Biscuit bulk load batches",
+                                                ALLOCSET_DEFAULT_SIZES);
+    bl->append          = append;
+    bl->nsides          = 2 * idx->num_columns;
+    bl->sides           = (BiscuitBulkSide *)
+        MemoryContextAllocZero(loader_context, bl->nsides * sizeof(BiscuitBulkSide));
+    bl->dirty_capacity  = 1024;
+    bl->dirty           = (BiscuitBulkSlot **)
+        MemoryContextAlloc(loader_context, bl->dirty_capacity * sizeof(BiscuitBulkSlot *));
+
+    if (idx->num_columns == 1)
+    {
+        biscuit_bulk_init_side(&bl->sides[0], &idx->options, false,
+                               idx->pos_idx_legacy, idx->neg_idx_legacy,
+                               idx->char_cache_legacy,
+                               &idx->length_bitmaps_legacy, &idx->length_ge_bitmaps_legacy,
+                               &idx->max_length_legacy);
+        biscuit_bulk_init_side(&bl->sides[1], &idx->options, true,
+                               idx->pos_idx_lower, idx->neg_idx_lower,
+                               idx->char_cache_lower,
+                               &idx->length_bitmaps_lower, &idx->length_ge_bitmaps_lower,
+                               &idx->max_length_lower);
+    }
+    else
+    {
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            ColumnIndex *cidx = &idx->column_indices[col];
+
+            biscuit_bulk_init_side(&bl->sides[2 * col], &idx->options, false,
+                                   cidx->pos_idx, cidx->neg_idx,
+                                   cidx->char_cache,
+                                   &cidx->length_bitmaps, &cidx->length_ge_bitmaps,
+                                   &cidx->max_length);
+            biscuit_bulk_init_side(&bl->sides[2 * col + 1], &idx->options, true,
+                                   cidx->pos_idx_lower,
+                                   cidx->neg_idx_lower, cidx->char_cache_lower,
+                                   &cidx->length_bitmaps_lower, &cidx->length_ge_bitmaps_lower,
+                                   &cidx->max_length_lower);
+        }
+    }
+
+    return bl;
+}
+
+BiscuitBulkLoader *
+biscuit_bulk_begin(BiscuitIndex *idx)
+{
+    return biscuit_bulk_start(idx, false);
+}
+
+BiscuitBulkLoader *
+biscuit_bulk_begin_append(BiscuitIndex *idx)
+{
+    return biscuit_bulk_start(idx, true);
+}
+
+static void
+biscuit_bulk_optimize_charindex(CharIndex *ci)
+{
+    int i;
+
+    for (i = 0; i < ci->count; i++)
+        biscuit_roaring_optimize(ci->entries[i].bitmap);
+}
+
+/*
+ * Length arrays of one side: len[n] holds the records of exactly n
+ * characters; ge[n] the records of at least n, i.e. the union of len[n..].
+ */
+static void
+biscuit_bulk_finish_side(BiscuitBulkSide *side)
+{
+    int             max_length = side->max_chars + 1;
+    RoaringBitmap **len;
+    RoaringBitmap **ge;
+    int             ch;
+    int             i;
+
+    len = (RoaringBitmap **) palloc0(max_length * sizeof(RoaringBitmap *));
+    ge  = (RoaringBitmap **) palloc0(max_length * sizeof(RoaringBitmap *));
+
+    for (i = 0; i < max_length && i < side->lengths.capacity; i++)
+        if (side->lengths.slots[i])
+            len[i] = side->lengths.slots[i]->bitmap;
+
+    for (i = max_length - 1; i >= 0; i--)
+    {
+        if (i == max_length - 1)
+            ge[i] = len[i] ? biscuit_roaring_copy(len[i]) : biscuit_roaring_create();
+        else
+        {
+            ge[i] = biscuit_roaring_copy(ge[i + 1]);
+            if (len[i])
+                biscuit_roaring_or_inplace(ge[i], len[i]);
+        }
+    }
+
+    for (i = 0; i < max_length; i++)
+    {
+        if (len[i])
+            biscuit_roaring_optimize(len[i]);
+        biscuit_roaring_optimize(ge[i]);
+    }
+
+    for (ch = 0; ch < CHAR_RANGE; ch++)
+    {
+        biscuit_bulk_optimize_charindex(&side->pos_idx[ch]);
+        biscuit_bulk_optimize_charindex(&side->neg_idx[ch]);
+        if (side->char_cache[ch])
+            biscuit_roaring_optimize(side->char_cache[ch]);
+    }
+
+    *side->length_bitmaps    = len;
+    *side->length_ge_bitmaps = ge;
+    *side->max_length        = max_length;
+}
+
+static void
+biscuit_bulk_optimize_slots(BiscuitBulkSlotArray *array)
+{
+    int i;
+
+    for (i = 0; i < array->capacity; i++)
+        if (array->slots[i])
+            biscuit_roaring_optimize(array->slots[i]->bitmap);
+}
+
+/*
+ * Append-mode counterpart of biscuit_bulk_finish_side(): the records of
+ * at least n characters among the new ones are OR-ed into ge[n], which
+ * stays the union of len[n..] over all records.
+ */
+static void
+biscuit_bulk_append_side(BiscuitBulkSide *side)
+{
+    int             old_max = *side->max_length;
+    int             new_max = Max(old_max, side->max_chars + 1);
+    RoaringBitmap **len     = *side->length_bitmaps;
+    RoaringBitmap **ge      = *side->length_ge_bitmaps;
+    RoaringBitmap  *suffix  = NULL;
+    int             ch;
+    int             i;
+
+    if (new_max > old_max)
+    {
+        len = len ? (RoaringBitmap **) repalloc(len, new_max * sizeof(RoaringBitmap *))
+                  : (RoaringBitmap **) palloc(new_max * sizeof(RoaringBitmap *));
+        ge  = ge ? (RoaringBitmap **) repalloc(ge, new_max * sizeof(RoaringBitmap *))
+                 : (RoaringBitmap **) palloc(new_max * sizeof(RoaringBitmap *));
+        for (i = old_max; i < new_max; i++)
+        {
+            len[i] = NULL;
+            ge[i]  = biscuit_roaring_create();
+        }
+    }
+
+    for (i = Min(side->max_chars, side->lengths.capacity - 1); i >= 0; i--)
+    {
+        BiscuitBulkSlot *slot = side->lengths.slots[i];
+
+        if (slot)
+        {
+            if (suffix)
+                biscuit_roaring_or_inplace(suffix, slot->bitmap);
+            else
+                suffix = biscuit_roaring_copy(slot->bitmap);
+
+            if (len[i])
+            {
+                biscuit_roaring_or_inplace(len[i], slot->bitmap);
+                biscuit_roaring_free(slot->bitmap);
+            }
+            else
+                len[i] = slot->bitmap;
+            biscuit_roaring_optimize(len[i]);
+        }
+
+        if (suffix)
+        {
+            if (ge[i])
+                biscuit_roaring_or_inplace(ge[i], suffix);
+            else
+                ge[i] = biscuit_roaring_copy(suffix);
+            biscuit_roaring_optimize(ge[i]);
+        }
+    }
+    biscuit_roaring_free(suffix);
+
+    for (ch = 0; ch < CHAR_RANGE; ch++)
+    {
+        biscuit_bulk_optimize_slots(&side->pos[ch]);
+        biscuit_bulk_optimize_slots(&side->neg[ch]);
+        if (side->cache[ch])
+            biscuit_roaring_optimize(side->cache[ch]->bitmap);
+    }
+
+    *side->length_bitmaps    = len;
+    *side->length_ge_bitmaps = ge;
+    *side->max_length        = new_max;
+}
+
+void
+biscuit_bulk_finish(BiscuitBulkLoader *bl)
+{
+    MemoryContext oldcontext;
+    int           i;
+
+    biscuit_bulk_flush(bl);
+
+    oldcontext = MemoryContextSwitchTo(bl->index_context);
+    for (i = 0; i < bl->nsides; i++)
+    {
+        if (bl->append)
+            biscuit_bulk_append_side(&bl->sides[i]);
+        else
+            biscuit_bulk_finish_side(&bl->sides[i]);
+    }
+    MemoryContextSwitchTo(oldcontext);
+
+    /* max_len is the case-sensitive character bound of a single column */
+    if (bl->idx->num_columns == 1)
+        bl->idx->max_len = bl->append ? Max(bl->idx->max_len, bl->sides[0].max_chars)
+                                      : bl->sides[0].max_chars;
+
+    MemoryContextDelete(bl->loader_context);
+}
@@ -0,0 +1,51 @@
+/*
+ * biscuit_bulk.h
+ * Bulk-loading pipeline shared by every path that indexes many records
+ * at once: ambuild, skeleton completion and the preload worker.
+ *
+ * Records are added in ascending record order; every (byte, position),
+ * character-cache and length bitmap they touch receives its record ids in
+ * batches, and biscuit_bulk_finish() builds the length arrays and
+ * run-optimizes the result.  aminsert keeps using the per-record helpers
+ * in biscuit_index.c, or defers its records to the pending list, which
+ * is merged through this pipeline.
+ */
+
+#ifndef BISCUIT_BULK_H
+#define BISCUIT_BULK_H
+
+#include "biscuit_common.h"
+
+typedef struct BiscuitBulkLoader BiscuitBulkLoader;
+
+/*
+ * Start loading into idx, whose CharIndex arrays are initialised and
+ * empty and whose options are set.  Bitmaps are allocated in
+ * CurrentMemoryContext.
+ */
+extern BiscuitBulkLoader *biscuit_bulk_begin(BiscuitIndex *idx);
+
+/*
+ * Start loading into idx, which already holds records: the records added
+ * must not be in any of its bitmaps yet (the pending-list merge).
+ */
+extern BiscuitBulkLoader *biscuit_bulk_begin_append(BiscuitIndex *idx);
+
+/*
+ * Index value str of column col (0 for a single-column index) and its
+ * lowercased copy str_lower (NULL to skip the case-insensitive side) as
+ * record rec.  Neither string is retained.
+ */
+extern void               biscuit_bulk_add(BiscuitBulkLoader *bl, int col,
+                                           const char *str, int byte_len,
+                                           const char *str_lower, int lower_len,
+                                           uint32 rec);
+
+/*
+ * Flush every pending batch, replace the length bitmaps and their bounds
+ * (max_len, max_length*, as a serial build sets them), or merge into them
+ * for an appending loader, and release the loader.
+ */
+extern void               biscuit_bulk_finish(BiscuitBulkLoader *bl);
+
+#endif /* BISCUIT_BULK_H */
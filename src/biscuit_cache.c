@@ -2,114 +2,588 @@
  * biscuit_cache.c
  * Session-scoped cache for BiscuitIndex objects.
  *
- * Each index is kept in CacheMemoryContext so it survives across
- * transactions.  A relcache callback and a proc-exit hook ensure
- * stale entries are evicted when relations are dropped or the
- * backend exits.
+ * Each index copy lives in its own memory context under
+ * CacheMemoryContext so it survives across transactions.  Copies are
+ * validated against the relation and the change log before use
+ * (biscuit_changelog.c).  A relcache invalidation only makes the next
+ * lookup check that the index still exists, and drops the copy of one
+ * that was dropped; a proc-exit hook clears the cache when the backend
+ * exits.
+ *
+ * Memory budget
+ * -------------
+ * Copies are kept in a hash table keyed by index OID and on one LRU list.
+ * With biscuit.cache_memory_limit set, the summed size of the copies is
+ * kept under it by evicting the least recently used copies whole; the
+ * next use of an evicted index loads it again, from its snapshot when
+ * there is one.  Sizes come from biscuit_index_memory_usage() (for a
+ * shared view, the backend-local part of it) and are measured again as a
+ * copy grows by an eighth.  The copy being cached is never evicted, so a
+ * single index larger than the limit still works.
+ *
+ * A copy that leaves the cache (evicted, replaced or removed) may still
+ * be in use by a scan of the current transaction, so its memory is freed
+ * at transaction end.  An evicted copy needed again before then is taken
+ * back instead of being loaded twice.
  */
 
 #include "biscuit_common.h"
+#include "biscuit_arena.h"
+#include "biscuit_bitmap.h"
 #include "biscuit_cache.h"
+#include "biscuit_shared.h"
+#include "biscuit_storage.h"
+#include "biscuit_trigram.h"
+
+#include "access/xact.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/syscache.h"
+
+int biscuit_cache_memory_limit = 0;        /* kB, 0 = no limit */
 
 /* ==================== CACHE STATE ==================== */
 
 typedef struct BiscuitIndexCacheEntry {
-    Oid                        indexoid;
-    BiscuitIndex              *index;
-    struct BiscuitIndexCacheEntry *next;
+    Oid           indexoid;         /* hash key */
+    BiscuitIndex *index;            /* NULL while removed or evicted */
+    BiscuitIndex *evicted;          /* evicted copy, until transaction end */
+    Size          bytes;            /* measured size of index */
+    int           measured_records; /* num_records at that time, -1: unmeasured */
+    bool          was_evicted;      /* the next copy cached is a reload */
+    bool          invalidated;      /* relcache invalidation: check it still exists */
+    uint64        evictions;
+    uint64        reloads;
+    dlist_node    lru;              /* on biscuit_cache_lru while index is set */
 } BiscuitIndexCacheEntry;
 
-static BiscuitIndexCacheEntry *biscuit_cache_head       = NULL;
-static bool                    biscuit_callback_registered = false;
+static HTAB      *biscuit_cache_htab          = NULL;
+static dlist_head biscuit_cache_lru           = DLIST_STATIC_INIT(biscuit_cache_lru);
+static Size       biscuit_cache_bytes         = 0;
+static List      *biscuit_cache_retired       = NIL;   /* freed at transaction end */
+static bool       biscuit_cache_invalidated    = false;  /* some entry is */
+static bool       biscuit_callback_registered = false;
+static bool       biscuit_xact_callback_registered = false;
+
+void
+biscuit_cache_init(void)
+{
+    DefineCustomIntVariable("biscuit.cache_memory_limit",
+                            "Memory for cached Biscuit indexes, per backend.",
+                            "The least recently used indexes are evicted to stay under it "
+                            "and loaded again on their next use.  0 disables the limit.",
+                            &biscuit_cache_memory_limit,
+                            0, 0, MAX_KILOBYTES,
+                            PGC_USERSET,
+                            GUC_UNIT_KB,
+                            NULL, NULL, NULL);
+}
+
+MemoryContext
+biscuit_cache_new_context(void)
+{
+    return AllocSetContextCreate(CacheMemoryContext,
+                                 "Biscuit index",
+                                 ALLOCSET_DEFAULT_SIZES);
+}
+
+/* ==================== ACCOUNTING ==================== */
+
+/*
+ * Bytes behind one column's value cache: its arena, or for a view whose
+ * values point into the shared image, the packed size of every value.
+ */
+static size_t
+biscuit_cache_string_bytes(const BiscuitStringArena *arena, char **strs, char **lower, int n)
+{
+    size_t bytes = 0;
+    int    i;
+
+    if (biscuit_arena_memory(arena) > 0)
+        return biscuit_arena_memory(arena);
+
+    for (i = 0; i < n; i++)
+    {
+        if (strs && strs[i])
+            bytes += BiscuitArenaEntrySize(biscuit_cache_strlen(strs[i]));
+        if (lower && lower[i] && (!strs || lower[i] != strs[i]))
+            bytes += BiscuitArenaEntrySize(biscuit_cache_strlen(lower[i]));
+    }
+    return bytes;
+}
+
+Size
+biscuit_index_memory_usage(const BiscuitIndex *idx)
+{
+    size_t string_bytes = 0;
+    size_t bitmap_bytes = 0;
+    size_t metadata_bytes = 0;
+    int    i, ch, col;
+
+    metadata_bytes += sizeof(BiscuitIndex);
+    if (idx->tids) metadata_bytes += idx->capacity * sizeof(ItemPointerData);
+
+    if (idx->num_columns == 1)
+    {
+        if (idx->data_cache)
+            metadata_bytes += idx->capacity * sizeof(char *);
+        if (idx->data_cache_lower)
+            metadata_bytes += idx->capacity * sizeof(char *);
+        string_bytes += biscuit_cache_string_bytes(&idx->strings_legacy,
+                                                   idx->data_cache, idx->data_cache_lower,
+                                                   Min(idx->num_records, idx->capacity));
+
+        for (ch = 0; ch < CHAR_RANGE; ch++)
+        {
+            bitmap_bytes += biscuit_charindex_memory_usage(&idx->pos_idx_legacy[ch]);
+            bitmap_bytes += biscuit_charindex_memory_usage(&idx->neg_idx_legacy[ch]);
+            bitmap_bytes += biscuit_roaring_memory_usage(idx->char_cache_legacy[ch]);
+            bitmap_bytes += biscuit_charindex_memory_usage(&idx->pos_idx_lower[ch]);
+            bitmap_bytes += biscuit_charindex_memory_usage(&idx->neg_idx_lower[ch]);
+            bitmap_bytes += biscuit_roaring_memory_usage(idx->char_cache_lower[ch]);
+        }
+        bitmap_bytes += biscuit_trigram_memory_usage(idx->trigrams_legacy);
+
+        if (idx->length_bitmaps_legacy && idx->max_length_legacy > 0)
+        {
+            metadata_bytes += idx->max_length_legacy * sizeof(RoaringBitmap *);
+            for (i = 0; i < idx->max_length_legacy; i++)
+                if (idx->length_bitmaps_legacy[i])
+                    bitmap_bytes += biscuit_roaring_memory_usage(idx->length_bitmaps_legacy[i]);
+        }
+        if (idx->length_ge_bitmaps_legacy && idx->max_length_legacy > 0)
+        {
+            metadata_bytes += idx->max_length_legacy * sizeof(RoaringBitmap *);
+            for (i = 0; i < idx->max_length_legacy; i++)
+                if (idx->length_ge_bitmaps_legacy[i])
+                    bitmap_bytes += biscuit_roaring_memory_usage(idx->length_ge_bitmaps_legacy[i]);
+        }
+    }
+    else if (idx->num_columns > 1)
+    {
+        metadata_bytes += idx->num_columns * sizeof(Oid);
+        metadata_bytes += idx->num_columns * sizeof(FmgrInfo);
+        metadata_bytes += idx->num_columns * sizeof(char **);
+
+        if (idx->column_data_cache)
+        {
+            for (col = 0; col < idx->num_columns; col++)
+            {
+                if (idx->column_data_cache[col])
+                {
+                    metadata_bytes += idx->capacity * sizeof(char *);
+                    string_bytes += biscuit_cache_string_bytes(
+                        &idx->column_indices[col].strings,
+                        idx->column_data_cache[col],
+                        idx->column_data_cache_lower ? idx->column_data_cache_lower[col] : NULL,
+                        Min(idx->num_records, idx->capacity));
+                }
+            }
+        }
+
+        if (idx->column_indices)
+        {
+            metadata_bytes += idx->num_columns * sizeof(ColumnIndex);
+            for (col = 0; col < idx->num_columns; col++)
+                bitmap_bytes += biscuit_columnindex_memory_usage(&idx->column_indices[col]);
+        }
+    }
+
+    if (idx->tombstones) bitmap_bytes += biscuit_roaring_memory_usage(idx->tombstones);
+    if (idx->pending) bitmap_bytes += biscuit_roaring_memory_usage(idx->pending);
+    if (idx->free_list && idx->free_capacity > 0)
+        metadata_bytes += idx->free_capacity * sizeof(uint32_t);
+
+    return metadata_bytes + string_bytes + bitmap_bytes;
+}
+
+/* What a copy costs this backend: a view's bitmaps are in shared memory */
+static Size
+biscuit_cache_copy_bytes(const BiscuitIndex *idx)
+{
+    if (BiscuitIndexIsShared(idx))
+        return idx->memory_context ? MemoryContextMemAllocated(idx->memory_context, true) : 0;
+    return biscuit_index_memory_usage(idx);
+}
+
+static void
+biscuit_cache_measure(BiscuitIndexCacheEntry *entry)
+{
+    biscuit_cache_bytes     -= entry->bytes;
+    entry->bytes             = biscuit_cache_copy_bytes(entry->index);
+    entry->measured_records  = entry->index->num_records;
+    biscuit_cache_bytes     += entry->bytes;
+}
+
+/* Unmeasured, or grown by an eighth since it was measured */
+static bool
+biscuit_cache_needs_measure(const BiscuitIndexCacheEntry *entry)
+{
+    return entry->measured_records < 0 ||
+           entry->index->num_records > entry->measured_records + entry->measured_records / 8;
+}
+
+/* ==================== RELEASE ==================== */
+
+static void
+biscuit_cache_free_retired(void)
+{
+    while (biscuit_cache_retired != NIL)
+    {
+        BiscuitIndex *idx = (BiscuitIndex *) linitial(biscuit_cache_retired);
+
+        biscuit_cache_retired = list_delete_first(biscuit_cache_retired);
+        biscuit_storage_free_view(idx);
+    }
+
+    /* Evicted copies are gone now: the next use loads the index again */
+    if (biscuit_cache_htab)
+    {
+        HASH_SEQ_STATUS         status;
+        BiscuitIndexCacheEntry *entry;
+
+        hash_seq_init(&status, biscuit_cache_htab);
+        while ((entry = (BiscuitIndexCacheEntry *) hash_seq_search(&status)) != NULL)
+            entry->evicted = NULL;
+    }
+}
+
+static void
+biscuit_cache_xact_callback(XactEvent event, void *arg)
+{
+    (void) arg;
+
+    switch (event)
+    {
+        case XACT_EVENT_COMMIT:
+        case XACT_EVENT_ABORT:
+        case XACT_EVENT_PARALLEL_COMMIT:
+        case XACT_EVENT_PARALLEL_ABORT:
+            biscuit_cache_free_retired();
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Hand a copy that left the cache back for freeing.  A shared view goes
+ * to biscuit_shared.c, which unmaps it at transaction end; a private copy
+ * is freed at transaction end here.  Copies without their own memory
+ * context are left to CacheMemoryContext, as before.
+ */
+void
+biscuit_cache_release(BiscuitIndex *idx)
+{
+    MemoryContext oldcontext;
+
+    if (!idx)
+        return;
+    if (BiscuitIndexIsShared(idx))
+    {
+        biscuit_shared_release(idx);
+        return;
+    }
+    if (!idx->memory_context || list_member_ptr(biscuit_cache_retired, idx))
+        return;
+
+    if (!biscuit_xact_callback_registered)
+    {
+        RegisterXactCallback(biscuit_cache_xact_callback, NULL);
+        biscuit_xact_callback_registered = true;
+    }
+
+    oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+    biscuit_cache_retired = lappend(biscuit_cache_retired, idx);
+    MemoryContextSwitchTo(oldcontext);
+}
+
+/* ==================== EVICTION ==================== */
+
+static void
+biscuit_cache_evict(BiscuitIndexCacheEntry *entry)
+{
+    BiscuitIndex *idx = entry->index;
+
+    dlist_delete(&entry->lru);
+    biscuit_cache_bytes -= entry->bytes;
+
+    elog(DEBUG1, "Biscuit: evicted index %u from the cache (%zu bytes, limit %d kB)",
+         entry->indexoid, entry->bytes, biscuit_cache_memory_limit);
+
+    entry->index            = NULL;
+    entry->bytes            = 0;
+    entry->measured_records = -1;
+    entry->was_evicted      = true;
+    entry->evictions++;
+
+    /* A private copy can be taken back until it is freed */
+    if (!BiscuitIndexIsShared(idx) && idx->memory_context)
+        entry->evicted = idx;
+    biscuit_cache_release(idx);
+}
+
+/* Evict least recently used copies, never keep, until the cache fits */
+static void
+biscuit_cache_enforce_limit(BiscuitIndexCacheEntry *keep)
+{
+    Size       limit = (Size) biscuit_cache_memory_limit * 1024;
+    dlist_iter iter;
+
+    if (limit == 0)
+        return;
+
+    /* Copies cached while the limit was off were not measured */
+    dlist_foreach(iter, &biscuit_cache_lru)
+    {
+        BiscuitIndexCacheEntry *entry = dlist_container(BiscuitIndexCacheEntry, lru, iter.cur);
+
+        if (entry->measured_records < 0)
+            biscuit_cache_measure(entry);
+    }
+
+    while (biscuit_cache_bytes > limit && !dlist_is_empty(&biscuit_cache_lru))
+    {
+        BiscuitIndexCacheEntry *victim = dlist_tail_element(BiscuitIndexCacheEntry, lru,
+                                                            &biscuit_cache_lru);
+
+        if (victim == keep)
+            break;
+        biscuit_cache_evict(victim);
+    }
+}
 
 /* ==================== LOOKUP ==================== */
 
+static BiscuitIndexCacheEntry *
+biscuit_cache_find(Oid indexoid)
+{
+    if (!biscuit_cache_htab)
+        return NULL;
+    return (BiscuitIndexCacheEntry *) hash_search(biscuit_cache_htab, &indexoid,
+                                                  HASH_FIND, NULL);
+}
+
+/*
+ * Drop the copies of indexes that no longer exist.  Relcache callbacks
+ * must not read the catalogs, so they only flag the entry; this runs on
+ * the next lookup or insert, inside a transaction.
+ */
+static void
+biscuit_cache_sweep_dropped(void)
+{
+    HASH_SEQ_STATUS         status;
+    BiscuitIndexCacheEntry *entry;
+
+    if (!biscuit_cache_invalidated || !biscuit_cache_htab || !IsTransactionState())
+        return;
+    biscuit_cache_invalidated = false;
+
+    hash_seq_init(&status, biscuit_cache_htab);
+    while ((entry = (BiscuitIndexCacheEntry *) hash_seq_search(&status)) != NULL)
+    {
+        if (!entry->invalidated)
+            continue;
+        entry->invalidated = false;
+
+        if (SearchSysCacheExists1(RELOID, ObjectIdGetDatum(entry->indexoid)))
+            continue;
+
+        /* An evicted copy is on the retired list already */
+        elog(DEBUG1, "Biscuit: index %u was dropped, removing its copy", entry->indexoid);
+        biscuit_cache_remove(entry->indexoid);
+        (void) hash_search(biscuit_cache_htab, &entry->indexoid, HASH_REMOVE, NULL);
+    }
+}
+
 BiscuitIndex *
 biscuit_cache_lookup(Oid indexoid)
 {
     BiscuitIndexCacheEntry *entry;
 
-    for (entry = biscuit_cache_head; entry != NULL; entry = entry->next)
+    biscuit_cache_sweep_dropped();
+
+    entry = biscuit_cache_find(indexoid);
+    if (!entry)
+        return NULL;
+
+    /* Evicted in this transaction and still intact: take it back */
+    if (!entry->index && entry->evicted)
     {
-        if (entry->indexoid == indexoid)
-            return entry->index;
+        biscuit_cache_retired = list_delete_ptr(biscuit_cache_retired, entry->evicted);
+        entry->index       = entry->evicted;
+        entry->evicted     = NULL;
+        entry->was_evicted = false;
+        dlist_push_head(&biscuit_cache_lru, &entry->lru);
+        if (biscuit_cache_memory_limit > 0)
+            biscuit_cache_measure(entry);
+        return entry->index;
     }
-    return NULL;
+
+    if (!entry->index)
+        return NULL;
+
+    dlist_move_head(&biscuit_cache_lru, &entry->lru);
+    return entry->index;
 }
 
 /* ==================== INSERT ==================== */
 
 /*
- * Insert (or replace) an index in the cache.
- * Always allocates the list node in CacheMemoryContext.
+ * Insert (or replace) an index in the cache, making it the most recently
+ * used one, and evict others if the cache is over its limit.
  */
 void
 biscuit_cache_insert(Oid indexoid, BiscuitIndex *idx)
 {
     BiscuitIndexCacheEntry *entry;
-    MemoryContext            oldcontext;
+    bool                    found;
+
+    biscuit_cache_sweep_dropped();
+
+    if (!biscuit_cache_htab)
+    {
+        HASHCTL ctl;
+
+        memset(&ctl, 0, sizeof(ctl));
+        ctl.keysize   = sizeof(Oid);
+        ctl.entrysize = sizeof(BiscuitIndexCacheEntry);
+        ctl.hcxt      = CacheMemoryContext;
+        biscuit_cache_htab = hash_create("Biscuit index cache", 64, &ctl,
+                                         HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+    }
+
+    entry = (BiscuitIndexCacheEntry *) hash_search(biscuit_cache_htab, &indexoid,
+                                                   HASH_ENTER, &found);
+    if (!found)
+    {
+        entry->index            = NULL;
+        entry->evicted          = NULL;
+        entry->bytes            = 0;
+        entry->measured_records = -1;
+        entry->was_evicted      = false;
+        entry->invalidated      = false;
+        entry->evictions        = 0;
+        entry->reloads          = 0;
+    }
 
     /*
-     * Fast path: an entry for this indexoid already exists.  Callers
-     * (e.g. biscuit_insert) call this once per tuple to make sure the
-     * global cache reflects the latest mutated BiscuitIndex, even though
-     * the pointer itself usually hasn't changed within a statement.
-     * Updating the existing node in place avoids a palloc + remove/insert
-     * cycle (and the associated DEBUG1 log spam) for every single row.
+     * Fast path: the entry already holds idx.  Callers (e.g. biscuit_insert)
+     * call this once per tuple to make sure the global cache reflects the
+     * latest mutated BiscuitIndex, even though the pointer itself usually
+     * hasn't changed within a statement.  Only a copy that has grown
+     * noticeably is measured again.
      */
-    for (entry = biscuit_cache_head; entry != NULL; entry = entry->next)
+    if (entry->index == idx)
     {
-        if (entry->indexoid == indexoid)
+        dlist_move_head(&biscuit_cache_lru, &entry->lru);
+        if (biscuit_cache_memory_limit > 0 && biscuit_cache_needs_measure(entry))
         {
-            entry->index = idx;
-            return;
+            biscuit_cache_measure(entry);
+            biscuit_cache_enforce_limit(entry);
         }
+        return;
     }
 
-    /* No existing entry: allocate a new node in CacheMemoryContext */
-    oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
+    if (entry->index)
+    {
+        dlist_delete(&entry->lru);
+        biscuit_cache_bytes -= entry->bytes;
+        biscuit_cache_release(entry->index);
+    }
+    else if (entry->was_evicted)
+    {
+        entry->reloads++;
+        entry->was_evicted = false;
+    }
 
-    entry            = (BiscuitIndexCacheEntry *) palloc(sizeof(BiscuitIndexCacheEntry));
-    entry->indexoid  = indexoid;
-    entry->index     = idx;
-    entry->next      = biscuit_cache_head;
-    biscuit_cache_head = entry;
+    /* A copy handed back earlier is in use again */
+    if (entry->evicted == idx)
+        entry->evicted = NULL;
+    biscuit_cache_retired = list_delete_ptr(biscuit_cache_retired, idx);
 
-    MemoryContextSwitchTo(oldcontext);
+    entry->index            = idx;
+    entry->bytes            = 0;
+    entry->measured_records = -1;
+    dlist_push_head(&biscuit_cache_lru, &entry->lru);
 
     elog(DEBUG1, "Biscuit: Cached index %u", indexoid);
+
+    if (biscuit_cache_memory_limit > 0)
+    {
+        biscuit_cache_measure(entry);
+        biscuit_cache_enforce_limit(entry);
+    }
 }
 
 /* ==================== REMOVE ==================== */
 
 /*
- * Unlink a cache entry.  Memory is owned by CacheMemoryContext and
- * will be reclaimed by PostgreSQL — do not pfree here.
+ * Drop the cached copy of an index.  Its memory is freed at transaction
+ * end (see biscuit_cache_release()); the entry keeps its counters.
  */
 void
 biscuit_cache_remove(Oid indexoid)
 {
-    BiscuitIndexCacheEntry **entry_ptr = &biscuit_cache_head;
-    BiscuitIndexCacheEntry  *entry;
+    BiscuitIndexCacheEntry *entry = biscuit_cache_find(indexoid);
+
+    if (!entry || !entry->index)
+        return;
+
+    dlist_delete(&entry->lru);
+    biscuit_cache_bytes -= entry->bytes;
+    biscuit_cache_release(entry->index);
+
+    entry->index            = NULL;
+    entry->bytes            = 0;
+    entry->measured_records = -1;
+    entry->was_evicted      = false;
+
+    elog(DEBUG1, "Biscuit: Removed cache entry for index %u", indexoid);
+}
+
+/* ==================== STATISTICS ==================== */
+
+void
+biscuit_cache_usage(Oid indexoid, Size *bytes, uint64 *evictions, uint64 *reloads)
+{
+    BiscuitIndexCacheEntry *entry = biscuit_cache_find(indexoid);
 
-    while (*entry_ptr != NULL)
+    *bytes     = 0;
+    *evictions = 0;
+    *reloads   = 0;
+
+    if (!entry)
+        return;
+
+    if (entry->index && entry->measured_records < 0)
+        biscuit_cache_measure(entry);
+
+    *bytes     = entry->index ? entry->bytes : 0;
+    *evictions = entry->evictions;
+    *reloads   = entry->reloads;
+}
+
+Size
+biscuit_cache_total_bytes(void)
+{
+    dlist_iter iter;
+
+    dlist_foreach(iter, &biscuit_cache_lru)
     {
-        entry = *entry_ptr;
-        if (entry->indexoid == indexoid)
-        {
-            *entry_ptr = entry->next;
-            elog(DEBUG1, "Biscuit: Removed cache entry for index %u", indexoid);
-            return;
-        }
-        entry_ptr = &entry->next;
+        BiscuitIndexCacheEntry *entry = dlist_container(BiscuitIndexCacheEntry, lru, iter.cur);
+
+        if (entry->measured_records < 0)
+            biscuit_cache_measure(entry);
     }
+    return biscuit_cache_bytes;
 }
 
 /* ==================== CLEANUP ==================== */
 
 /*
  * Mark a BiscuitIndex as invalid.
- * We intentionally do not free its memory: CacheMemoryContext owns it.
+ * We intentionally do not free its memory: see biscuit_cache_release().
  */
 void
 biscuit_cleanup_index(BiscuitIndex *idx)
@@ -118,19 +592,47 @@ biscuit_cleanup_index(BiscuitIndex *idx)
         return;
     /*
      * Null out the pointer chain so callers can detect a cleaned-up
-     * index, but leave deallocation to CacheMemoryContext reset.
+     * index, but leave deallocation to biscuit_cache_release().
      */
     (void) idx;
 }
 
 /* ==================== CALLBACKS ==================== */
 
+/*
+ * Relcache invalidations no longer drop the cached copy: VACUUM alone
+ * sends one for every index it processes, and each backend then rebuilt
+ * its copy on the next scan.  biscuit_changelog_sync() checks a copy
+ * against the relation (its relfilenumber and options) and the change
+ * log before every use, which covers REINDEX, TRUNCATE and ALTER INDEX.
+ * The entry is only flagged, and biscuit_cache_sweep_dropped() removes
+ * the copy if the index was dropped.  InvalidOid flags every entry.
+ */
 static void
 biscuit_relcache_callback(Datum arg, Oid relid)
 {
+    HASH_SEQ_STATUS         status;
+    BiscuitIndexCacheEntry *entry;
+
     (void) arg;
-    biscuit_cache_remove(relid);
-    elog(DEBUG1, "Biscuit: Invalidated cache for relation %u", relid);
+    if (!biscuit_cache_htab)
+        return;
+
+    if (OidIsValid(relid))
+    {
+        entry = biscuit_cache_find(relid);
+        if (entry)
+        {
+            entry->invalidated        = true;
+            biscuit_cache_invalidated = true;
+        }
+        return;
+    }
+
+    hash_seq_init(&status, biscuit_cache_htab);
+    while ((entry = (BiscuitIndexCacheEntry *) hash_seq_search(&status)) != NULL)
+        entry->invalidated = true;
+    biscuit_cache_invalidated = true;
 }
 
 static void
@@ -139,7 +641,11 @@ biscuit_module_unload_callback(int code, unsigned long datum)
     (void) code;
     (void) datum;
     elog(DEBUG1, "Biscuit: Module unload - clearing all cache entries");
-    biscuit_cache_head          = NULL;
+    biscuit_cache_htab          = NULL;
+    dlist_init(&biscuit_cache_lru);
+    biscuit_cache_bytes         = 0;
+    biscuit_cache_retired       = NIL;
+    biscuit_cache_invalidated   = false;
     biscuit_callback_registered = false;
 }
 
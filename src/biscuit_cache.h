@@ -2,7 +2,7 @@
  * biscuit_cache.h
  * In-process index cache: lookup, insert, remove, and invalidation
  * callbacks that keep in-memory BiscuitIndex structures alive across
- * multiple queries within a session.
+ * multiple queries within a session, under an optional memory budget.
  */
 
 #ifndef BISCUIT_CACHE_H
@@ -10,15 +10,48 @@
 
 #include "biscuit_common.h"
 
+/* biscuit.cache_memory_limit, in kB (0 disables eviction) */
+extern int  biscuit_cache_memory_limit;
+
+/* Register the GUC (called from _PG_init) */
+extern void biscuit_cache_init(void);
+
+/*
+ * A new memory context under CacheMemoryContext for a copy that will be
+ * cached; store it in idx->memory_context once idx exists.
+ */
+extern MemoryContext biscuit_cache_new_context(void);
+
 /* Look up a cached index by relation OID. Returns NULL on miss. */
 extern BiscuitIndex *biscuit_cache_lookup(Oid indexoid);
 
-/* Insert (or replace) a BiscuitIndex in the session cache. */
+/*
+ * Insert (or replace) a BiscuitIndex in the session cache, evicting the
+ * least recently used others while the cache is over its limit.
+ */
 extern void biscuit_cache_insert(Oid indexoid, BiscuitIndex *idx);
 
 /* Remove a cache entry (e.g. after DROP INDEX). */
 extern void biscuit_cache_remove(Oid indexoid);
 
+/*
+ * Free a copy that is no longer cached at transaction end (a shared view
+ * is released to biscuit_shared.c).
+ */
+extern void biscuit_cache_release(BiscuitIndex *idx);
+
+/* Bytes held by idx, from the sizes of its arrays, strings and bitmaps */
+extern Size biscuit_index_memory_usage(const BiscuitIndex *idx);
+
+/*
+ * Cache statistics for biscuit_index_stats(): the bytes the cached copy
+ * of indexoid holds and how often it was evicted and loaded again, and
+ * the bytes of every cached copy.
+ */
+extern void biscuit_cache_usage(Oid indexoid, Size *bytes,
+                                uint64 *evictions, uint64 *reloads);
+extern Size biscuit_cache_total_bytes(void);
+
 /* Register rel-cache and proc-exit callbacks (idempotent). */
 extern void biscuit_register_callback(void);
 
@@ -0,0 +1,906 @@
+/*
+ * biscuit_changelog.c
+ * Change log of aminsert / ambulkdelete, for cross-backend freshness.
+ *
+ * Every backend keeps its own copy of the index (or a view of the shared
+ * image) and used to see only the inserts made through it.  Changes made
+ * elsewhere arrived when a relcache invalidation dropped the copy and the
+ * next scan rebuilt it from the heap.  aminsert and ambulkdelete now also
+ * append a compact entry to the index relation:
+ *
+ *   insert   the heap TID and the text of every column (NULL marked)
+ *   delete   the TIDs a bulkdelete removed, split to fit a page
+ *
+ * Each append bumps log_version on the metapage in the same WAL record
+ * as the entry.  A copy records the version it reflects.  Before it is
+ * used (biscuit_changelog_lookup()) the metapage is read, and a copy
+ * that is behind replays the entries after its version through the same
+ * insert and delete code the AM callbacks use.  Replaying an entry twice
+ * changes nothing (an insert of a TID the copy already holds replaces
+ * it), so a copy built from the heap may start at the version read
+ * before its scan and replay what the scan saw anyway.
+ *
+ * Log pages follow the snapshot data pages and are chained from
+ * log_head; new ones come from log_next_free.  Together they hold one
+ * byte stream of entries: an entry larger than the room left in the tail
+ * continues on new pages, which are written ahead of the record that
+ * links them and bumps log_version.  Each page records how many of its
+ * leading bytes finish an entry begun earlier, so replay can resume at
+ * any page.  Writing a snapshot (biscuit_storage_persist()) truncates
+ * the log: log_base moves to the current version, and copies older than
+ * that are dropped and loaded again, from the new snapshot.  Nothing
+ * else truncates it.
+ *
+ * An index built by an earlier release has an older metapage, which the
+ * first append replaces with a current one at log version 0: copies
+ * attached to it while it was old are at version 0 too and replay from
+ * there.
+ *
+ * Appenders hold the metapage page lock in share mode and the metapage
+ * buffer exclusively.  Replay holds the page lock in share mode and
+ * copies each log page out under a share buffer lock before applying
+ * it.  The writer of a snapshot takes the page lock exclusively, so an
+ * append waits for it to finish.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_cache.h"
+#include "biscuit_changelog.h"
+#include "biscuit_index.h"
+#include "biscuit_pending.h"
+#include "biscuit_preload.h"   /* BISCUIT_PRELOAD_DONE */
+#include "biscuit_shared.h"
+#include "biscuit_storage.h"
+#include "biscuit_utf8.h"
+
+#include "access/xlog.h"
+#include "common/hashfn.h"
+#include "miscadmin.h"
+#include "utils/hsearch.h"
+
+/* ================================================================
+ * SECTION 1 – Page and entry format
+ * ================================================================ */
+
+#define BISCUIT_LOG_PAGE_ID         0xB15D
+#define BISCUIT_LOG_INSERT          1
+#define BISCUIT_LOG_DELETE          2
+#define BISCUIT_LOG_NULL            0xFFFFFFFF
+
+/* Opaque area of a log page */
+typedef struct BiscuitLogPageOpaqueData
+{
+    BlockNumber next;           /* next log page, or InvalidBlockNumber */
+    uint32      nbytes;         /* entry bytes stored on this page */
+    uint32      continued;      /* leading bytes finishing an earlier entry */
+    uint16      flags;          /* reserved, always 0 */
+    uint16      page_id;        /* BISCUIT_LOG_PAGE_ID */
+} BiscuitLogPageOpaqueData;
+
+/*
+ * Entries are MAXALIGNed and may span pages.  An insert is the TID, then
+ * per column a uint32 length (BISCUIT_LOG_NULL for NULL) and the bytes;
+ * nitems is the number of columns.  A delete is an array of TIDs.
+ */
+typedef struct BiscuitLogEntryHeader
+{
+    uint64      version;
+    uint32      length;         /* payload bytes after the header */
+    uint16      kind;           /* BISCUIT_LOG_INSERT / BISCUIT_LOG_DELETE */
+    uint16      nitems;
+} BiscuitLogEntryHeader;
+
+#define BiscuitLogPageGetOpaque(page) \
+    ((BiscuitLogPageOpaqueData *) PageGetSpecialPointer(page))
+#define BiscuitLogPageGetData(page) \
+    ((char *) (page) + MAXALIGN(SizeOfPageHeaderData))
+#define BISCUIT_LOG_PAYLOAD \
+    (BLCKSZ - MAXALIGN(SizeOfPageHeaderData) - MAXALIGN(sizeof(BiscuitLogPageOpaqueData)))
+#define BiscuitLogEntrySize(len) \
+    MAXALIGN(sizeof(BiscuitLogEntryHeader) + (len))
+/* TIDs per delete entry, so one fits a page */
+#define BISCUIT_LOG_MAX_DELETE \
+    ((BISCUIT_LOG_PAYLOAD - sizeof(BiscuitLogEntryHeader)) / sizeof(ItemPointerData))
+
+/* An entry read back for replay */
+typedef struct BiscuitLogOp
+{
+    uint16      kind;
+    uint16      nitems;
+    uint32      length;
+    char       *payload;
+} BiscuitLogOp;
+
+static void
+biscuit_changelog_corrupt(Relation index, const char *detail)
+{
+    ereport(ERROR,
+            (errcode(ERRCODE_INDEX_CORRUPTED),
+             errmsg("biscuit index \"%s\" has a corrupted change log",
+                    RelationGetRelationName(index)),
+             errdetail_internal("%s", detail),
+             errhint("REINDEX the index to rebuild it.")));
+}
+
+static bool
+biscuit_changelog_is_log_page(Page page)
+{
+    return !PageIsNew(page) &&
+           PageGetSpecialSize(page) == MAXALIGN(sizeof(BiscuitLogPageOpaqueData)) &&
+           BiscuitLogPageGetOpaque(page)->page_id == BISCUIT_LOG_PAGE_ID &&
+           BiscuitLogPageGetOpaque(page)->nbytes <= BISCUIT_LOG_PAYLOAD &&
+           BiscuitLogPageGetOpaque(page)->continued <= BiscuitLogPageGetOpaque(page)->nbytes;
+}
+
+/* ================================================================
+ * SECTION 2 – Positions
+ * ================================================================ */
+
+uint64
+biscuit_changelog_current(Relation index, uint64 *base)
+{
+    BiscuitMetaPageData meta;
+
+    /* A copy is only attached to a current metapage, outside recovery */
+    if (!biscuit_storage_describe(index, &meta))
+        biscuit_storage_upgrade(index);
+    if (!biscuit_storage_describe(index, &meta))
+    {
+        *base = 0;
+        return 0;
+    }
+    *base = meta.log_base;
+    return meta.log_version;
+}
+
+void
+biscuit_changelog_attach(Relation index, BiscuitIndex *idx, uint64 version, uint64 base)
+{
+    idx->log_version   = version;
+    idx->log_base      = base;
+    idx->log_relnumber = index->rd_locator.relNumber;
+    idx->log_blkno     = InvalidBlockNumber;
+    biscuit_changelog_diverge(idx);
+}
+
+void
+biscuit_changelog_attach_snapshot(Relation index, BiscuitIndex *idx, uint64 version, uint64 base)
+{
+    uint64 epoch;
+
+    biscuit_changelog_attach(index, idx, version, base);
+
+    epoch = hash_combine64((uint64) index->rd_locator.relNumber, version);
+    idx->record_epoch = epoch ? epoch : 1;
+}
+
+void
+biscuit_changelog_diverge(BiscuitIndex *idx)
+{
+    static uint64 counter = 0;
+    uint64        epoch;
+
+    /* Unique to this backend's lifetime, so no other copy can match it */
+    epoch = hash_combine64(((uint64) MyProcPid << 32) ^ ++counter, (uint64) MyStartTimestamp);
+    idx->record_epoch = epoch ? epoch : 1;
+}
+
+/* ================================================================
+ * SECTION 3 – Appending
+ * ================================================================ */
+
+/* Pin blkno for a new log page, extending the relation when it is the end */
+static Buffer
+biscuit_changelog_new_buffer(Relation index, BlockNumber blkno)
+{
+    Buffer buf;
+
+    if (blkno < RelationGetNumberOfBlocks(index))
+        return ReadBuffer(index, blkno);
+
+    LockRelationForExtension(index, ExclusiveLock);
+    buf = ReadBufferExtended(index, MAIN_FORKNUM, P_NEW, RBM_NORMAL, NULL);
+    UnlockRelationForExtension(index, ExclusiveLock);
+
+    if (BufferGetBlockNumber(buf) != blkno)
+        elog(ERROR, "Biscuit: unexpected block %u while extending the change log of \"%s\" (expected %u)",
+             BufferGetBlockNumber(buf), RelationGetRelationName(index), blkno);
+    return buf;
+}
+
+/* Format a new log page; its next, if any, is set by the caller */
+static void
+biscuit_changelog_init_page(Page page, Buffer buf)
+{
+    BiscuitLogPageOpaqueData *opaque;
+
+    PageInit(page, BufferGetPageSize(buf), sizeof(BiscuitLogPageOpaqueData));
+    opaque            = BiscuitLogPageGetOpaque(page);
+    opaque->next      = InvalidBlockNumber;
+    opaque->nbytes    = 0;
+    opaque->continued = 0;
+    opaque->flags     = 0;
+    opaque->page_id   = BISCUIT_LOG_PAGE_ID;
+}
+
+/*
+ * Add n bytes of an entry to page.  With continued they finish an entry
+ * begun on an earlier page, and page is still empty.
+ */
+static void
+biscuit_changelog_put(Page page, const char *src, Size n, bool continued)
+{
+    BiscuitLogPageOpaqueData *opaque = BiscuitLogPageGetOpaque(page);
+
+    memcpy(BiscuitLogPageGetData(page) + opaque->nbytes, src, n);
+    if (continued)
+        opaque->continued = (uint32) n;
+    opaque->nbytes += (uint32) n;
+    ((PageHeader) page)->pd_lower = MAXALIGN(SizeOfPageHeaderData) + opaque->nbytes;
+}
+
+static void
+biscuit_changelog_append(Relation index, BiscuitIndex *idx, uint16 kind, uint16 nitems,
+                         const char *payload, uint32 len)
+{
+    BiscuitMetaPageData       meta;
+    BiscuitLogEntryHeader     hdr;
+    GenericXLogState         *state;
+    Buffer                    metabuf;
+    Buffer                    tailbuf  = InvalidBuffer;
+    Buffer                    firstbuf = InvalidBuffer;
+    BlockNumber               firstblk;
+    BlockNumber               npages;
+    BlockNumber               i;
+    Page                      metapage;
+    Page                      page;
+    Size                      need = BiscuitLogEntrySize(len);
+    Size                      head = 0;     /* bytes that go to the current tail */
+    Size                      first_len = 0;
+    Size                      off;
+    bool                      upgrade;
+    char                     *entry;
+
+    if (RecoveryInProgress() || RelationGetNumberOfBlocks(index) == 0)
+        return;
+
+    /* Waits for a snapshot being written, which overwrites the log pages */
+    LockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+
+    metabuf = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
+    LockBuffer(metabuf, BUFFER_LOCK_EXCLUSIVE);
+
+    /* An index built by an earlier release starts its log here */
+    upgrade = biscuit_storage_meta_upgrade(index, BufferGetPage(metabuf), &meta);
+
+    /* The entry as stored: header, payload, zero padding */
+    hdr.version = meta.log_version + 1;
+    hdr.length  = len;
+    hdr.kind    = kind;
+    hdr.nitems  = nitems;
+
+    entry = (char *) biscuit_palloc0_huge(need);
+    memcpy(entry, &hdr, sizeof(hdr));
+    memcpy(entry + sizeof(hdr), payload, len);
+
+    if (meta.log_tail != InvalidBlockNumber)
+    {
+        Size avail;
+
+        tailbuf = ReadBuffer(index, meta.log_tail);
+        LockBuffer(tailbuf, BUFFER_LOCK_EXCLUSIVE);
+        if (!biscuit_changelog_is_log_page(BufferGetPage(tailbuf)))
+            biscuit_changelog_corrupt(index, "the log tail is not a log page");
+        avail = BISCUIT_LOG_PAYLOAD - BiscuitLogPageGetOpaque(BufferGetPage(tailbuf))->nbytes;
+
+        /* An entry that fits a page stays on one; a larger one starts here */
+        if (need <= avail)
+            head = need;
+        else if (need > BISCUIT_LOG_PAYLOAD && avail >= sizeof(BiscuitLogEntryHeader))
+            head = avail;
+    }
+
+    npages   = (BlockNumber) ((need - head + BISCUIT_LOG_PAYLOAD - 1) / BISCUIT_LOG_PAYLOAD);
+    firstblk = meta.log_next_free;
+
+    /*
+     * New pages.  The first is written with the metapage below; the ones
+     * after it are written ahead, each in a record of its own.  Nothing
+     * refers to them until that record links the first, so a crash in
+     * between leaves them unused past log_next_free.
+     */
+    off = head;
+    for (i = 0; i < npages; i++)
+    {
+        Buffer buf = biscuit_changelog_new_buffer(index, firstblk + i);
+        Size   n   = Min(need - off, (Size) BISCUIT_LOG_PAYLOAD);
+
+        LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+        if (i == 0)
+        {
+            firstbuf  = buf;
+            first_len = n;
+        }
+        else
+        {
+            state = GenericXLogStart(index);
+            page  = GenericXLogRegisterBuffer(state, buf, GENERIC_XLOG_FULL_IMAGE);
+            biscuit_changelog_init_page(page, buf);
+            biscuit_changelog_put(page, entry + off, n, true);
+            if (i + 1 < npages)
+                BiscuitLogPageGetOpaque(page)->next = firstblk + i + 1;
+            GenericXLogFinish(state);
+            UnlockReleaseBuffer(buf);
+        }
+        off += n;
+    }
+
+    meta.log_version++;
+
+    state    = GenericXLogStart(index);
+    metapage = GenericXLogRegisterBuffer(state, metabuf, upgrade ? GENERIC_XLOG_FULL_IMAGE : 0);
+    if (upgrade)
+        PageInit(metapage, BufferGetPageSize(metabuf), sizeof(BiscuitMetaPageData));
+
+    if (BufferIsValid(tailbuf))
+    {
+        page = GenericXLogRegisterBuffer(state, tailbuf, 0);
+        if (head > 0)
+            biscuit_changelog_put(page, entry, head, false);
+        if (npages > 0)
+            BiscuitLogPageGetOpaque(page)->next = firstblk;
+    }
+    else
+        meta.log_head = firstblk;
+
+    if (npages > 0)
+    {
+        page = GenericXLogRegisterBuffer(state, firstbuf, GENERIC_XLOG_FULL_IMAGE);
+        biscuit_changelog_init_page(page, firstbuf);
+        biscuit_changelog_put(page, entry + head, first_len, head > 0);
+        if (npages > 1)
+            BiscuitLogPageGetOpaque(page)->next = firstblk + 1;
+
+        meta.log_tail      = firstblk + npages - 1;
+        meta.log_next_free = firstblk + npages;
+    }
+
+    memcpy(PageGetSpecialPointer(metapage), &meta, sizeof(BiscuitMetaPageData));
+    GenericXLogFinish(state);
+
+    if (BufferIsValid(firstbuf))
+        UnlockReleaseBuffer(firstbuf);
+    if (BufferIsValid(tailbuf))
+        UnlockReleaseBuffer(tailbuf);
+    UnlockReleaseBuffer(metabuf);
+    UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+    pfree(entry);
+
+    /* idx already holds the change: it follows unless another came first */
+    if (idx->log_relnumber == index->rd_locator.relNumber &&
+        idx->log_version + 1 == meta.log_version)
+    {
+        idx->log_version = meta.log_version;
+        idx->log_base    = meta.log_base;
+    }
+
+    if (upgrade)
+        elog(DEBUG1, "Biscuit: started the change log of index %u (metapage upgraded)",
+             RelationGetRelid(index));
+}
+
+void
+biscuit_changelog_insert(Relation index, BiscuitIndex *idx,
+                         Datum *values, bool *isnull, ItemPointer tid)
+{
+    StringInfoData buf;
+    int            col;
+
+    /* Other copies learn of the change only when they replay it */
+    biscuit_changelog_diverge(idx);
+
+    initStringInfo(&buf);
+    appendBinaryStringInfo(&buf, (const char *) tid, sizeof(ItemPointerData));
+
+    for (col = 0; col < idx->num_columns; col++)
+    {
+        uint32 len = BISCUIT_LOG_NULL;
+
+        if (isnull[col])
+            appendBinaryStringInfo(&buf, (const char *) &len, sizeof(uint32));
+        else if (idx->num_columns == 1)
+        {
+            text *txt = DatumGetTextPP(values[0]);
+
+            len = VARSIZE_ANY_EXHDR(txt);
+            appendBinaryStringInfo(&buf, (const char *) &len, sizeof(uint32));
+            appendBinaryStringInfo(&buf, VARDATA_ANY(txt), len);
+        }
+        else
+        {
+            int   out_len;
+            char *value = biscuit_datum_to_text(values[col], idx->column_types[col],
+                                                &idx->output_funcs[col], &out_len);
+
+            len = (uint32) out_len;
+            appendBinaryStringInfo(&buf, (const char *) &len, sizeof(uint32));
+            appendBinaryStringInfo(&buf, value, out_len);
+            pfree(value);
+        }
+    }
+
+    biscuit_changelog_append(index, idx, BISCUIT_LOG_INSERT, (uint16) idx->num_columns,
+                             buf.data, (uint32) buf.len);
+    pfree(buf.data);
+}
+
+void
+biscuit_changelog_delete(Relation index, BiscuitIndex *idx,
+                         const ItemPointerData *tids, int64 ntids)
+{
+    int64 off;
+
+    biscuit_changelog_diverge(idx);
+
+    for (off = 0; off < ntids; off += BISCUIT_LOG_MAX_DELETE)
+    {
+        int64 n = Min(ntids - off, (int64) BISCUIT_LOG_MAX_DELETE);
+
+        biscuit_changelog_append(index, idx, BISCUIT_LOG_DELETE, 0,
+                                 (const char *) (tids + off),
+                                 (uint32) (n * sizeof(ItemPointerData)));
+    }
+}
+
+/* ================================================================
+ * SECTION 4 – Replay
+ * ================================================================ */
+
+typedef struct BiscuitLogTidEntry
+{
+    ItemPointerData tid;        /* hash key */
+    bool            present;    /* a live record of the copy holds it */
+} BiscuitLogTidEntry;
+
+typedef struct BiscuitLogDeleteState
+{
+    ItemPointerData *tids;      /* sorted */
+    int64            ntids;
+} BiscuitLogDeleteState;
+
+static int
+biscuit_changelog_tid_cmp(const void *a, const void *b)
+{
+    return ItemPointerCompare((ItemPointer) a, (ItemPointer) b);
+}
+
+static bool
+biscuit_changelog_tid_deleted(ItemPointer tid, void *arg)
+{
+    BiscuitLogDeleteState *ds = (BiscuitLogDeleteState *) arg;
+
+    return bsearch(tid, ds->tids, ds->ntids, sizeof(ItemPointerData),
+                   biscuit_changelog_tid_cmp) != NULL;
+}
+
+/*
+ * A run of inserts.  Which of their TIDs the copy already holds is found
+ * with one pass over its records, so only those pay for the update path.
+ */
+static void
+biscuit_changelog_apply_inserts(Relation index, BiscuitIndex *idx,
+                                const BiscuitLogOp *ops, int nops)
+{
+    HASHCTL             ctl;
+    HTAB               *tids;
+    BiscuitLogTidEntry *entry;
+    MemoryContext       entry_context;
+    MemoryContext       oldcontext;
+    Datum               values[INDEX_MAX_KEYS];
+    bool                isnull[INDEX_MAX_KEYS];
+    bool                found;
+    int                 i;
+    int                 rec;
+    int                 col;
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize   = sizeof(ItemPointerData);
+    ctl.entrysize = sizeof(BiscuitLogTidEntry);
+    ctl.hcxt      = CurrentMemoryContext;
+    tids = hash_create("Biscuit change log TIDs", nops, &ctl,
+                       HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+    for (i = 0; i < nops; i++)
+    {
+        if (ops[i].length < sizeof(ItemPointerData) || ops[i].nitems != idx->num_columns)
+            biscuit_changelog_corrupt(index, "insert entry does not match the index");
+        entry = (BiscuitLogTidEntry *) hash_search(tids, ops[i].payload, HASH_ENTER, &found);
+        if (!found)
+            entry->present = false;
+    }
+
+    for (rec = 0; rec < idx->num_records; rec++)
+    {
+        if (!biscuit_record_has_value(idx, (uint32_t) rec) ||
+            biscuit_roaring_contains(idx->tombstones, (uint32_t) rec))
+            continue;
+        entry = (BiscuitLogTidEntry *) hash_search(tids, &idx->tids[rec], HASH_FIND, NULL);
+        if (entry)
+            entry->present = true;
+    }
+
+    entry_context = AllocSetContextCreate(CurrentMemoryContext,
+                                          "Biscuit change log entry",
+                                          ALLOCSET_SMALL_SIZES);
+
+    for (i = 0; i < nops; i++)
+    {
+        const char     *p   = ops[i].payload;
+        const char     *end = p + ops[i].length;
+        ItemPointerData tid;
+
+        memcpy(&tid, p, sizeof(ItemPointerData));
+        p += sizeof(ItemPointerData);
+
+        oldcontext = MemoryContextSwitchTo(entry_context);
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            uint32 len;
+
+            if (end - p < (ptrdiff_t) sizeof(uint32))
+                biscuit_changelog_corrupt(index, "insert entry is truncated");
+            memcpy(&len, p, sizeof(uint32));
+            p += sizeof(uint32);
+
+            isnull[col] = (len == BISCUIT_LOG_NULL);
+            values[col] = (Datum) 0;
+            if (!isnull[col])
+            {
+                if ((uint32) (end - p) < len)
+                    biscuit_changelog_corrupt(index, "insert entry is truncated");
+                values[col] = PointerGetDatum(cstring_to_text_with_len(p, (int) len));
+                p += len;
+            }
+        }
+
+        entry = (BiscuitLogTidEntry *) hash_search(tids, &tid, HASH_FIND, NULL);
+        biscuit_insert_record(index, idx, values, isnull, &tid, entry->present);
+        entry->present = true;
+
+        MemoryContextSwitchTo(oldcontext);
+        MemoryContextReset(entry_context);
+    }
+
+    MemoryContextDelete(entry_context);
+    hash_destroy(tids);
+}
+
+/* A run of deletes: one pass over the records for all of their TIDs */
+static void
+biscuit_changelog_apply_deletes(Relation index, BiscuitIndex *idx,
+                                const BiscuitLogOp *ops, int nops)
+{
+    BiscuitLogDeleteState ds;
+    int64                 total = 0;
+    int                   i;
+
+    for (i = 0; i < nops; i++)
+    {
+        if (ops[i].length % sizeof(ItemPointerData) != 0)
+            biscuit_changelog_corrupt(index, "delete entry is truncated");
+        total += ops[i].length / sizeof(ItemPointerData);
+    }
+
+    ds.tids  = (ItemPointerData *) palloc(Max(total, 1) * sizeof(ItemPointerData));
+    ds.ntids = 0;
+    for (i = 0; i < nops; i++)
+    {
+        memcpy(ds.tids + ds.ntids, ops[i].payload, ops[i].length);
+        ds.ntids += ops[i].length / sizeof(ItemPointerData);
+    }
+    qsort(ds.tids, ds.ntids, sizeof(ItemPointerData), biscuit_changelog_tid_cmp);
+
+    /* The deleting backend demoted the snapshot already */
+    biscuit_delete_records(index, idx, biscuit_changelog_tid_deleted, &ds, false, NULL);
+
+    pfree(ds.tids);
+}
+
+/*
+ * Sequential reader over the chained log pages, each copied out under a
+ * share buffer lock.
+ */
+typedef struct BiscuitLogReader
+{
+    Relation    index;
+    BlockNumber blkno;          /* page in copy */
+    char       *copy;           /* BLCKSZ */
+    uint32      off;            /* next byte of the page to read */
+} BiscuitLogReader;
+
+/* Read blkno into the reader; false if it is not a log page */
+static bool
+biscuit_log_reader_load(BiscuitLogReader *r, BlockNumber blkno)
+{
+    Buffer buf;
+
+    if (blkno == InvalidBlockNumber || blkno >= RelationGetNumberOfBlocks(r->index))
+        return false;
+
+    buf = ReadBuffer(r->index, blkno);
+    LockBuffer(buf, BUFFER_LOCK_SHARE);
+    memcpy(r->copy, BufferGetPage(buf), BLCKSZ);
+    UnlockReleaseBuffer(buf);
+
+    if (!biscuit_changelog_is_log_page((Page) r->copy))
+        return false;
+    r->blkno = blkno;
+    r->off   = 0;
+    return true;
+}
+
+/* Copy n bytes of the stream to dst (or skip them); false if the log ends first */
+static bool
+biscuit_log_reader_read(BiscuitLogReader *r, char *dst, Size n)
+{
+    while (n > 0)
+    {
+        BiscuitLogPageOpaqueData *opaque = BiscuitLogPageGetOpaque(r->copy);
+        Size                      chunk;
+
+        if (r->off == opaque->nbytes)
+        {
+            if (!biscuit_log_reader_load(r, opaque->next))
+                return false;
+            CHECK_FOR_INTERRUPTS();
+            continue;
+        }
+
+        chunk = Min(n, (Size) (opaque->nbytes - r->off));
+        if (dst)
+        {
+            memcpy(dst, BiscuitLogPageGetData(r->copy) + r->off, chunk);
+            dst += chunk;
+        }
+        r->off += (uint32) chunk;
+        n      -= chunk;
+    }
+    return true;
+}
+
+bool
+biscuit_changelog_replay(Relation index, BiscuitIndex *idx, const BiscuitMetaPageData *meta)
+{
+    MemoryContext    replay_context;
+    MemoryContext    oldcontext;
+    BiscuitLogReader r;
+    BiscuitLogOp    *ops;
+    int              nops = 0;
+    int              ops_capacity = 64;
+    uint64           expected = idx->log_version + 1;
+    BlockNumber      blkno;
+    bool             ok;
+    int              i, j;
+
+    if (idx->log_version == meta->log_version)
+        return true;
+    if (idx->log_relnumber != index->rd_locator.relNumber ||
+        idx->log_version < meta->log_base ||
+        idx->log_version > meta->log_version)
+        return false;
+
+    /* Resume where the last replay ended, unless the log was truncated since */
+    blkno = (idx->log_blkno != InvalidBlockNumber && idx->log_base == meta->log_base)
+            ? idx->log_blkno : meta->log_head;
+
+    replay_context = AllocSetContextCreate(CurrentMemoryContext,
+                                           "Biscuit change log replay",
+                                           ALLOCSET_DEFAULT_SIZES);
+    oldcontext = MemoryContextSwitchTo(replay_context);
+
+    ops = (BiscuitLogOp *) palloc(ops_capacity * sizeof(BiscuitLogOp));
+
+    memset(&r, 0, sizeof(r));
+    r.index = index;
+    r.copy  = (char *) palloc(BLCKSZ);
+
+    /* The first bytes of a page may finish an entry replayed before */
+    ok = biscuit_log_reader_load(&r, blkno);
+    if (ok)
+        r.off = BiscuitLogPageGetOpaque(r.copy)->continued;
+
+    /* Collect the entries first: nothing is applied under a buffer lock */
+    while (ok && expected <= meta->log_version)
+    {
+        BiscuitLogEntryHeader hdr;
+        Size                  padding;
+
+        if (!biscuit_log_reader_read(&r, (char *) &hdr, sizeof(hdr)))
+        {
+            ok = false;
+            break;
+        }
+        if (hdr.length > MaxAllocHugeSize)
+            biscuit_changelog_corrupt(index, "entry length is out of range");
+        padding = BiscuitLogEntrySize(hdr.length) - sizeof(hdr) - hdr.length;
+
+        if (hdr.version < expected)
+        {
+            if (!biscuit_log_reader_read(&r, NULL, hdr.length + padding))
+                biscuit_changelog_corrupt(index, "entry runs past the end of the log");
+            continue;
+        }
+        if (hdr.version != expected)
+        {
+            ok = false;
+            break;
+        }
+
+        if (nops == ops_capacity)
+        {
+            ops_capacity *= 2;
+            ops = (BiscuitLogOp *) repalloc(ops, ops_capacity * sizeof(BiscuitLogOp));
+        }
+        ops[nops].kind    = hdr.kind;
+        ops[nops].nitems  = hdr.nitems;
+        ops[nops].length  = hdr.length;
+        ops[nops].payload = (char *) biscuit_palloc_huge(Max(hdr.length, 1));
+        if (!biscuit_log_reader_read(&r, ops[nops].payload, hdr.length) ||
+            !biscuit_log_reader_read(&r, NULL, padding))
+            biscuit_changelog_corrupt(index, "entry runs past the end of the log");
+        nops++;
+        expected++;
+    }
+
+    /* Apply runs of the same kind together, in log order */
+    for (i = 0; ok && i < nops; i = j)
+    {
+        for (j = i; j < nops && ops[j].kind == ops[i].kind; j++)
+            ;
+        if (ops[i].kind == BISCUIT_LOG_INSERT)
+            biscuit_changelog_apply_inserts(index, idx, ops + i, j - i);
+        else if (ops[i].kind == BISCUIT_LOG_DELETE)
+            biscuit_changelog_apply_deletes(index, idx, ops + i, j - i);
+        else
+            biscuit_changelog_corrupt(index, "unknown entry kind");
+    }
+
+    if (ok)
+    {
+        uint64 epoch;
+
+        /*
+         * Copies that agreed before and applied the same entries agree
+         * after; the view's delta numbers records differently from a
+         * private copy, so that is part of the mix too.
+         */
+        epoch = hash_combine64(idx->record_epoch, idx->log_version);
+        epoch = hash_combine64(epoch, meta->log_version);
+        epoch = hash_combine64(epoch, BiscuitIndexIsShared(idx) ? 1 : 0);
+        idx->record_epoch  = epoch ? epoch : 1;
+
+        idx->log_version   = meta->log_version;
+        idx->log_base      = meta->log_base;
+        idx->log_blkno     = r.blkno;
+        idx->log_replayed += nops;
+
+        /* Changed by other backends too: it cannot own an epoch any more */
+        idx->storage_epoch = 0;
+    }
+
+    MemoryContextSwitchTo(oldcontext);
+    MemoryContextDelete(replay_context);
+
+    elog(DEBUG1, "Biscuit: %s %d change log entries into index %u (version " UINT64_FORMAT ")",
+         ok ? "replayed" : "could not replay", nops, RelationGetRelid(index),
+         meta->log_version);
+
+    return ok;
+}
+
+/* ================================================================
+ * SECTION 5 – Synchronisation
+ * ================================================================ */
+
+/* Whether idx was built from the relation as it is now */
+static bool
+biscuit_changelog_matches(Relation index, const BiscuitIndex *idx)
+{
+    BiscuitOptions options;
+
+    if (idx->log_relnumber != index->rd_locator.relNumber ||
+        idx->num_columns != index->rd_index->indnatts)
+        return false;
+
+    biscuit_index_options(index, &options);
+    return options.like == idx->options.like &&
+           options.ilike == idx->options.ilike &&
+           options.suffix_index == idx->options.suffix_index &&
+           options.store_strings == idx->options.store_strings &&
+           options.trigrams == idx->options.trigrams &&
+           options.max_indexed_chars == idx->options.max_indexed_chars;
+}
+
+/* Drop idx from the cache; it is freed at transaction end */
+static BiscuitIndex *
+biscuit_changelog_discard(Relation index, BiscuitIndex *idx, const char *reason)
+{
+    Oid indexoid = RelationGetRelid(index);
+
+    elog(DEBUG1, "Biscuit: dropping the copy of index %u (%s)", indexoid, reason);
+
+    if (biscuit_cache_lookup(indexoid) == idx)
+        biscuit_cache_remove(indexoid);
+    else
+        biscuit_cache_release(idx);
+    return NULL;
+}
+
+BiscuitIndex *
+biscuit_changelog_sync(Relation index, BiscuitIndex *idx)
+{
+    BiscuitMetaPageData meta;
+    bool                ok;
+
+    if (!idx)
+        return NULL;
+    if (!biscuit_changelog_matches(index, idx))
+        return biscuit_changelog_discard(index, idx, "the index was rebuilt or altered");
+
+    /* A skeleton catches up once its bitmaps are built */
+    if (idx->preload_state < BISCUIT_PRELOAD_DONE)
+        return idx;
+
+    /*
+     * No current metapage.  A standby cannot write one, and its copy misses
+     * nothing until the primary does (replay then starts at version 0).
+     * On a primary the copy may have missed changes: load the index again,
+     * which upgrades the metapage.
+     */
+    if (!biscuit_storage_describe(index, &meta))
+    {
+        if (RecoveryInProgress())
+            return idx;
+        return biscuit_changelog_discard(index, idx, "the index has no current metapage");
+    }
+
+    /* Steady state: one share lock on the metapage */
+    if (meta.log_version == idx->log_version)
+        return idx;
+    if (idx->log_version < meta.log_base || idx->log_version > meta.log_version)
+        return biscuit_changelog_discard(index, idx, "the change log was truncated");
+
+    /*
+     * A shared view takes the changes as a delta on its pending list and
+     * tombstones; one that cannot switches to a private copy, which has
+     * already replayed the log.
+     */
+    if (BiscuitIndexIsShared(idx) && biscuit_pending_accepts(index, idx))
+        biscuit_shared_open_delta(idx);
+    else if (BiscuitIndexIsShared(idx))
+    {
+        BiscuitIndex *copy = biscuit_shared_make_private(index, idx);
+
+        if (!copy)
+            return biscuit_changelog_discard(index, idx, "the change log no longer covers it");
+        return copy;
+    }
+
+    /* Waits for a snapshot being written, which truncates the log anyway */
+    LockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+    ok = biscuit_storage_describe(index, &meta) && biscuit_changelog_replay(index, idx, &meta);
+    UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+
+    if (!ok)
+        return biscuit_changelog_discard(index, idx, "the change log no longer covers it");
+    return idx;
+}
+
+BiscuitIndex *
+biscuit_changelog_lookup(Relation index)
+{
+    BiscuitIndex *idx = biscuit_cache_lookup(RelationGetRelid(index));
+
+    return idx ? biscuit_changelog_sync(index, idx) : NULL;
+}
@@ -0,0 +1,72 @@
+/*
+ * biscuit_changelog.h
+ * Change log of aminsert / ambulkdelete in the index relation, replayed
+ * by other backends to bring their copy of the index up to date without
+ * rebuilding it.
+ *
+ * Every entry carries the next metapage log_version; a copy at version
+ * N replays the entries after N.  See biscuit_changelog.c.
+ */
+
+#ifndef BISCUIT_CHANGELOG_H
+#define BISCUIT_CHANGELOG_H
+
+#include "biscuit_common.h"
+
+/*
+ * The metapage log_version (and in *base the truncation point), after
+ * upgrading an older metapage; 0 when there is still no current one (a
+ * standby).  Read before a heap scan and handed to
+ * biscuit_changelog_attach() once the copy exists.
+ */
+extern uint64        biscuit_changelog_current(Relation index, uint64 *base);
+
+/* Record that idx reflects every entry up to version, under base */
+extern void          biscuit_changelog_attach(Relation index, BiscuitIndex *idx,
+                                              uint64 version, uint64 base);
+
+/*
+ * As above, for a copy decoded from the snapshot taken at version: it
+ * numbers its records like every other copy of that snapshot.
+ */
+extern void          biscuit_changelog_attach_snapshot(Relation index, BiscuitIndex *idx,
+                                                       uint64 version, uint64 base);
+
+/* Give idx a record numbering of its own, after a change made only to it */
+extern void          biscuit_changelog_diverge(BiscuitIndex *idx);
+
+/*
+ * Log an insert / the TIDs removed by a bulkdelete.  Called after the
+ * change was made to idx, whose version follows the log when nothing
+ * else was appended meanwhile.
+ */
+extern void          biscuit_changelog_insert(Relation index, BiscuitIndex *idx,
+                                              Datum *values, bool *isnull,
+                                              ItemPointer tid);
+extern void          biscuit_changelog_delete(Relation index, BiscuitIndex *idx,
+                                              const ItemPointerData *tids,
+                                              int64 ntids);
+
+/*
+ * Bring idx up to date: replay the entries it has not seen.  Returns idx
+ * (a shared view takes them as a delta, or is made private when its
+ * index cannot take pending inserts), or NULL
+ * after removing it from the cache when it cannot catch up (the log was
+ * truncated past it, or the index was rebuilt), so the caller loads the
+ * index again.  Skeletons are returned as they are.
+ */
+extern BiscuitIndex *biscuit_changelog_sync(Relation index, BiscuitIndex *idx);
+
+/* biscuit_cache_lookup() followed by biscuit_changelog_sync() */
+extern BiscuitIndex *biscuit_changelog_lookup(Relation index);
+
+/*
+ * Replay the entries after idx->log_version up to meta->log_version into
+ * idx, a private copy or a shared view opened for a delta
+ * (biscuit_shared_open_delta()).  The caller holds the metapage share page lock.
+ * Returns false when the log no longer covers idx.
+ */
+extern bool          biscuit_changelog_replay(Relation index, BiscuitIndex *idx,
+                                              const BiscuitMetaPageData *meta);
+
+#endif /* BISCUIT_CHANGELOG_H */
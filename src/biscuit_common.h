@@ -52,6 +52,9 @@
 #include "utils/snapmgr.h"
 #include "access/xact.h"
 #include "postmaster/interrupt.h"
+#include "utils/dsa.h"
+#include "lib/ilist.h"
+#include "portability/instr_time.h"
 
 /* ==================== ROARING BITMAP TYPES ==================== */
 
@@ -59,10 +62,18 @@
 #include "roaring/roaring.h"
 typedef roaring_bitmap_t RoaringBitmap;
 #else
+/*
+ * Fallback bitmap: a sorted array of values while sparse, a bitset once
+ * dense (see biscuit_bitmap.c).  Test membership with
+ * biscuit_roaring_contains() rather than the fields.
+ */
 typedef struct {
-    uint64_t *blocks;
+    uint64_t *blocks;           /* dense words; NULL while sparse */
     int num_blocks;
     int capacity;
+    uint32_t *values;           /* sorted values while sparse */
+    int num_values;
+    int values_capacity;
 } RoaringBitmap;
 #endif
 
@@ -80,16 +91,30 @@ typedef struct {
 #define BISCUIT_NOT_LIKE_STRATEGY       2
 #define BISCUIT_ILIKE_STRATEGY          3
 #define BISCUIT_NOT_ILIKE_STRATEGY      4
+#define BISCUIT_REGEX_STRATEGY          5   /* ~, through a LIKE prefilter */
+#define BISCUIT_IREGEX_STRATEGY         6   /* ~*, through an ILIKE prefilter */
+#define BISCUIT_EQUAL_STRATEGY          7   /* =, as LIKE of the escaped value */
+#define BISCUIT_PREFIX_STRATEGY         8   /* ^@, as LIKE of the escaped prefix */
 
 /* ==================== CONSTANTS ==================== */
 
 #define BISCUIT_MAGIC                   0x42495343  /* "BISC" */
-#define BISCUIT_VERSION                 1
+#define BISCUIT_VERSION                 3   /* 2: persisted snapshot, 3: change log */
 #define BISCUIT_METAPAGE_BLKNO          0
 #define CHAR_RANGE                      256
 #define TOMBSTONE_CLEANUP_THRESHOLD     1000
 #define RADIX_SORT_THRESHOLD            5000
-#define BISCUIT_LIBRARY_VERSION         "2.4.1"
+#define BISCUIT_LIBRARY_VERSION         "2.5.0"
+
+/*
+ * Record numbers are uint32 bitmap members and the record counters are
+ * int, so one copy holds at most this many records.  The arrays sized by
+ * the record count are huge allocations to get there: the value caches
+ * alone would otherwise stop at 128M records (1 GB of pointers).
+ */
+#define BISCUIT_MAX_RECORDS             PG_INT32_MAX
+#define biscuit_palloc_huge(size)       palloc_extended((size), MCXT_ALLOC_HUGE)
+#define biscuit_palloc0_huge(size)      palloc_extended((size), MCXT_ALLOC_HUGE | MCXT_ALLOC_ZERO)
 
 /* ==================== MEMORY MANAGEMENT MACROS ==================== */
 
@@ -126,12 +151,133 @@ typedef struct {
 typedef struct BiscuitMetaPageData {
     uint32 magic;
     uint32 version;
-    BlockNumber root;
+    BlockNumber root;               /* first snapshot data block */
     uint32 num_records;
+
+    /*
+     * Version 2: persisted snapshot of the in-memory index (see
+     * biscuit_storage.c).  Version-1 metapages end at num_records and
+     * are treated as "no snapshot".
+     */
+    uint32 num_columns;
+    uint32 snapshot_state;          /* BISCUIT_SNAPSHOT_* */
+    uint32 snapshot_epoch;          /* bumped by every claim */
+    uint32 snapshot_flags;          /* BISCUIT_SNAPSHOT_F_* */
+    BlockNumber snapshot_nblocks;   /* data blocks root..root+n-1 */
+    uint32 reserved;
+    uint64 snapshot_bytes;          /* payload bytes across those blocks */
+
+    /*
+     * Version 3: change log of aminsert / ambulkdelete (see
+     * biscuit_changelog.c).  Version-2 metapages are treated as "no
+     * snapshot" and re-initialised by the next claim.
+     */
+    uint64 snapshot_version;        /* log version the data pages reflect */
+    uint64 log_version;             /* newest entry, bumped by every append */
+    uint64 log_base;                /* entries up to here are gone */
+    BlockNumber log_head;           /* first log page, or InvalidBlockNumber */
+    BlockNumber log_tail;           /* page appends go to */
+    BlockNumber log_next_free;      /* next block for a new log page */
+    uint32 log_reserved;
 } BiscuitMetaPageData;
 
+/* Size of the version-1 metapage, used to recognise pre-snapshot indexes */
+#define BISCUIT_METAPAGE_V1_SIZE    offsetof(BiscuitMetaPageData, num_columns)
+
+/* snapshot_state values */
+#define BISCUIT_SNAPSHOT_INVALID    0   /* no usable snapshot, no owner     */
+#define BISCUIT_SNAPSHOT_VALID      1   /* data pages match the heap        */
+#define BISCUIT_SNAPSHOT_BUILDING   2   /* stale, but the backend holding
+                                         * snapshot_epoch has a complete copy */
+
+/* snapshot_flags bits */
+#define BISCUIT_SNAPSHOT_F_ROARING  0x0001  /* bitmaps in CRoaring format */
+#define BISCUIT_SNAPSHOT_F_TRIGRAMS 0x0002  /* stream has trigram sections;
+                                         * older snapshots are rebuilt */
+#define BISCUIT_SNAPSHOT_F_SHARED_LOWER 0x0004  /* lowercased copies may refer
+                                         * to their value */
+#define BISCUIT_SNAPSHOT_F_OPTIONS  0x0008  /* stream records the build options */
+
 typedef BiscuitMetaPageData *BiscuitMetaPage;
 
+/*
+ * Planner statistics (biscuit_stats.c), stored in the content area of the
+ * metapage whenever a snapshot is persisted.  Every value is the fraction
+ * of live records with the property, scaled to BISCUIT_STATS_SCALE and
+ * rounded up so that a non-empty bitmap never reads as zero.  Only the
+ * first ncolumns columns that fit on the page are covered.
+ */
+#define BISCUIT_STATS_MAGIC         0x42535454  /* "BSTT" */
+#define BISCUIT_STATS_MAX_COLUMNS   3
+#define BISCUIT_STATS_LENGTHS       64
+#define BISCUIT_STATS_SCALE         65535
+
+typedef struct BiscuitColumnStats {
+    uint16 has_char[CHAR_RANGE];            /* byte anywhere (case-sensitive) */
+    uint16 has_char_lower[CHAR_RANGE];      /* byte anywhere (case-folded)    */
+    uint16 first_char[CHAR_RANGE];          /* case-folded first character    */
+    uint16 last_char[CHAR_RANGE];           /* case-folded last character     */
+    uint16 length_ge[BISCUIT_STATS_LENGTHS];    /* at least n characters      */
+} BiscuitColumnStats;
+
+typedef struct BiscuitStatsData {
+    uint32 magic;
+    uint32 ncolumns;
+    uint32 live_records;
+    float4 correlation;                     /* record order vs. heap order */
+    BiscuitColumnStats columns[BISCUIT_STATS_MAX_COLUMNS];
+} BiscuitStatsData;
+
+#define BiscuitStatsSize(ncols) \
+    (offsetof(BiscuitStatsData, columns) + (ncols) * sizeof(BiscuitColumnStats))
+
+/*
+ * Trigram postings (biscuit_trigram.c): an array of this many CharIndex
+ * buckets addressed by the first two bytes of a trigram, each sorted by
+ * the third.  NULL when the index was built without them.
+ */
+#define BISCUIT_TRIGRAM_BUCKETS     65536
+
+/*
+ * Append-only string arena (biscuit_arena.c) holding the cached record
+ * values of one column.  All zeroes is an empty arena.
+ */
+typedef struct BiscuitArenaChunk BiscuitArenaChunk;
+
+typedef struct BiscuitStringArena {
+    MemoryContext      context;     /* set by the first store */
+    BiscuitArenaChunk *chunks;      /* newest first */
+    Size allocated;                 /* chunk bytes */
+    Size used;                      /* bytes of stored values */
+    Size released;                  /* bytes of values no longer referenced */
+} BiscuitStringArena;
+
+/*
+ * Index options, WITH (...) on CREATE INDEX (biscuit_options()).  An
+ * index copy keeps the options it was built with in BiscuitIndex.options;
+ * ALTER INDEX ... SET takes effect at the next REINDEX.  Patterns the
+ * built structures cannot answer exactly are verified against the cached
+ * strings or handed to the executor for recheck (biscuit_pattern_support).
+ */
+typedef struct BiscuitOptions {
+    int32 vl_len_;              /* varlena header (do not touch directly!) */
+    bool  like;                 /* case-sensitive position bitmaps */
+    bool  ilike;                /* the lowercase mirror */
+    bool  suffix_index;         /* negative-position bitmaps */
+    bool  store_strings;        /* record value caches */
+    bool  trigrams;             /* trigram postings (biscuit_trigram.c) */
+    int   max_indexed_chars;    /* positions indexed from either end, 0 = all */
+    int   pending_list_limit;   /* kB, -1 = biscuit.pending_list_limit; read
+                                 * from the relation, not the built copy */
+} BiscuitOptions;
+
+/* Whether options index a character at char_pos / remaining from the end */
+#define BiscuitOptionsIndexPos(o, char_pos) \
+    ((o)->max_indexed_chars == 0 || (char_pos) < (o)->max_indexed_chars)
+#define BiscuitOptionsIndexNeg(o, remaining) \
+    ((o)->suffix_index && \
+     ((o)->max_indexed_chars == 0 || (remaining) <= (o)->max_indexed_chars))
+
 /* Per-column bitmap index (case-sensitive + case-insensitive) */
 typedef struct {
     /* Case-sensitive */
@@ -149,11 +295,18 @@ typedef struct {
     RoaringBitmap **length_bitmaps_lower;
     RoaringBitmap **length_ge_bitmaps_lower;
     int max_length_lower;
+
+    /* Optional trigram postings over both cases */
+    CharIndex *trigrams;
+
+    /* Storage for column_data_cache[col] and column_data_cache_lower[col] */
+    BiscuitStringArena strings;
 } ColumnIndex;
 
 /* Main in-memory index structure */
 typedef struct BiscuitIndex {
     int num_columns;
+    BiscuitOptions options;         /* as built */
     Oid *column_types;
     FmgrInfo *output_funcs;
     char ***column_data_cache;      /* [column][record] */
@@ -173,7 +326,10 @@ typedef struct BiscuitIndex {
      *   • Allocated as char**  per column, palloc0'd to idx->capacity slots.
      *   • Grown with repalloc whenever column_data_cache is grown.
      *   • NULL entries mirror NULL entries in column_data_cache.
-     *   • Freed / NULLed in the vacuum bulkdelete path alongside
+     *   • Strings live in column_indices[col].strings (biscuit_arena.c);
+     *     an entry equals column_data_cache[col][rec] when lowercasing
+     *     leaves the value unchanged.  Never pfree() an entry: release it
+     *     and NULL it in the vacuum bulkdelete path alongside
      *     column_data_cache entries.
      * Only allocated when num_columns > 1; NULL otherwise.
      */
@@ -196,14 +352,28 @@ typedef struct BiscuitIndex {
     RoaringBitmap **length_ge_bitmaps_lower;
     int max_length_lower;
 
+    /* Optional single-column trigram postings over both cases */
+    CharIndex *trigrams_legacy;
+
     char **data_cache_lower;
 
     /* Record data */
     ItemPointerData *tids;
     char **data_cache;
+
+    /* Storage for data_cache and data_cache_lower (biscuit_arena.c) */
+    BiscuitStringArena strings_legacy;
     int num_records;
     int capacity;
 
+    /*
+     * tids[0 .. num_records) ascend in heap order, deleted slots included
+     * (they keep their last TID), so a result bitmap iterates in heap
+     * order and scans skip the TID sort.  Kept by aminsert where it can,
+     * and restored by compaction in VACUUM (biscuit_compact()).
+     */
+    bool heap_ordered;
+
     /* CRUD state */
     RoaringBitmap *tombstones;
     uint32_t *free_list;
@@ -232,18 +402,124 @@ typedef struct BiscuitIndex {
      * no cross-process pointer sharing.
      */
     uint32 preload_state;
+
+    /*
+     * Metapage snapshot_epoch this copy corresponds to (0 = none).  A copy
+     * whose epoch matches a BUILDING metapage is the authoritative one and
+     * may be written back to disk by biscuit_storage_persist().
+     */
+    uint32 storage_epoch;
+
+    /*
+     * Change log position (biscuit_changelog.c): the newest entry this
+     * copy reflects and the truncation point and relfilenumber it was
+     * read under.  log_blkno is the page the last replay ended on, where
+     * the next one resumes.
+     */
+    uint64        log_version;
+    uint64        log_base;
+    RelFileNumber log_relnumber;
+    BlockNumber   log_blkno;
+    int64         log_replayed;     /* entries applied from other backends */
+
+    /*
+     * Identifies how this copy numbers its records (never 0).  Copies
+     * loaded from the same snapshot and replayed over the same entries
+     * agree on it; a build or a local change gives the copy a value of
+     * its own.  Unlike storage_epoch it says nothing about ownership: it
+     * only lets parallel scan participants exchange record numbers.
+     */
+    uint64        record_epoch;
+
+    /*
+     * Pattern result cache (biscuit_result_cache.c).  The tag identifies
+     * this copy to the backend-local cache; it is assigned on first use,
+     * so a copy rebuilt or reloaded under the same relation never sees
+     * results cached for its predecessor.
+     */
+    uint64 result_cache_tag;
+    int64  result_cache_hits;
+    int64  result_cache_misses;
+
+    /*
+     * Pending list (biscuit_pending.c): records inserted since the last
+     * merge.  Their values are in the string caches, but they are in no
+     * bitmap yet; pending_bytes is what they count against the limit.
+     */
+    RoaringBitmap *pending;
+    Size           pending_bytes;
+    int64          pending_merges;
+
+    /*
+     * Shared residency (biscuit_shared.c).  For a view of the DSA image,
+     * shared_image points at that image; it is zero for an ordinary
+     * private copy.  shared_delta is set once the view takes changes on
+     * top of the image (its TIDs and tombstones are then its own).
+     * memory_context holds every allocation of the copy, this struct
+     * included, so biscuit_cache.c can free it whole (NULL for an
+     * uncached build in the caller's context).
+     */
+    dsa_pointer   shared_image;
+    bool          shared_delta;
+    MemoryContext memory_context;
 } BiscuitIndex;
 
+/* Context for allocations that become part of the copy idx */
+#define BiscuitIndexMemoryContext(idx) \
+    ((idx)->memory_context ? (idx)->memory_context : CacheMemoryContext)
+
+/*
+ * Scan instrumentation (biscuit_instrument.c), summed over the rescans of
+ * one scan: shown by EXPLAIN ANALYZE, then added to the index's shared
+ * counters at endscan.
+ */
+typedef struct BiscuitScanInstrument
+{
+    int64       rescans;
+    int64       fallback_rescans;   /* evaluated without bitmaps */
+    int64       bitmap_ops;         /* bitmap AND / OR / ANDNOT */
+    int64       max_cardinality;    /* largest key result or intersection */
+    int64       verify_checked;     /* candidates matched against strings */
+    int64       verify_matched;
+    int64       tids;               /* TIDs returned */
+    int64       sorted_rescans;     /* results sorted by TID */
+    instr_time  plan_time;          /* key rewrite and query planning */
+    instr_time  eval_time;          /* bitmap evaluation or fallback walk */
+    instr_time  verify_time;
+    instr_time  collect_time;       /* TID collection and sorting */
+} BiscuitScanInstrument;
+
 /* Scan opaque state */
 typedef struct {
     BiscuitIndex *index;
-    ItemPointerData *results;
+    ItemPointerData *results;   /* all TIDs, or the current batch when streaming */
     int num_results;
     int current;
 
+    /*
+     * Streaming mode (biscuit_tid.c): results is refilled from stream,
+     * each batch sorted by heap block when sort_batches is set
+     */
+    struct BiscuitTidStream *stream;
+    int batch_size;
+    bool sort_batches;
+
+    /* Index-only scans: the record of each results[] entry */
+    uint32_t *records;
+
+    /*
+     * Parallel scans (biscuit_tid.c): whether this participant evaluates
+     * the query and still has to publish it.
+     */
+    bool parallel_publish;
+
     bool is_aggregate_only;
     bool needs_sorted_access;
-    int limit_remaining;
+
+    /* Results are a superset the executor must recheck (index options) */
+    bool recheck;
+
+    BiscuitScanInstrument instr;
 } BiscuitScanOpaque;
 
 /* Parsed LIKE pattern */
@@ -277,6 +553,7 @@ typedef struct {
     int anchor_strength;
 
     double selectivity_score;
+    uint64 estimated_count;     /* bitmap-cardinality bound on matches */
     int priority;
 } QueryPredicate;
 
@@ -296,12 +573,18 @@ typedef struct {
     int output_count;
 } TIDCollectionWorker;
 
-/* Pattern result cache entry */
+/* Pattern result cache entry (biscuit_result_cache.c) */
 typedef struct PatternCacheEntry {
-    char *pattern;
-    ItemPointerData *tids;
-    int num_tids;
-    struct PatternCacheEntry *next;
+    dlist_node node;            /* LRU list, most recently used first */
+    uint64 index_tag;           /* BiscuitIndex.result_cache_tag */
+    int column;
+    bool ilike;
+    uint32 hash;                /* of pattern */
+    char *pattern;              /* as given by the scan key */
+    struct BiscuitLikePlan *match_plan; /* pattern compiled, lowercased for ILIKE */
+    RoaringBitmap *result;      /* matching records, tombstones included */
+    bool lossy;                 /* result is a superset (needs recheck) */
+    Size bytes;                 /* charged against biscuit.result_cache_size */
 } PatternCacheEntry;
 
 /* ==================== CROSS-VERSION COMPATIBILITY ==================== */
@@ -6,92 +6,51 @@
  */
 
 #include "biscuit_common.h"
+#include "biscuit_arena.h"
 #include "biscuit_bitmap.h"
+#include "biscuit_bulk.h"
+#include "biscuit_preload.h"   /* BISCUIT_PRELOAD_DONE */
 #include "biscuit_utf8.h"
 #include "biscuit_cache.h"
+#include "biscuit_changelog.h"
 #include "biscuit_index.h"
+#include "biscuit_parallel_build.h"
+#include "biscuit_pending.h"
+#include "biscuit_shared.h"
+#include "biscuit_stats.h"
+#include "biscuit_storage.h"
+#include "biscuit_keys.h"
+#include "biscuit_tid.h"
+
+#include "optimizer/cost.h"
+#include "utils/guc.h"           /* MAX_KILOBYTES */
+#include "utils/selfuncs.h"
 
 /* ================================================================
  * SECTION 1 – Disk metadata I/O
  * ================================================================ */
 
-void
-biscuit_write_metadata_to_disk(Relation index, BiscuitIndex *idx)
-{
-    Buffer             buf;
-    Page               page;
-    GenericXLogState  *state;
-    BiscuitMetaPageData *meta;
-
-    //buf   = ReadBufferExtended(index, MAIN_FORKNUM, P_NEW, RBM_NORMAL, NULL);
-    
-    {
-        BlockNumber nblocks = RelationGetNumberOfBlocks(index);
-        if (nblocks == 0)
-            buf = ReadBufferExtended(index, MAIN_FORKNUM, P_NEW, RBM_NORMAL, NULL);
-        else
-            buf = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
-    }
-    
-    LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
-
-    state = GenericXLogStart(index);
-    page  = GenericXLogRegisterBuffer(state, buf, GENERIC_XLOG_FULL_IMAGE);
-
-    PageInit(page, BufferGetPageSize(buf), sizeof(BiscuitMetaPageData));
-
-    meta          = (BiscuitMetaPageData *) PageGetSpecialPointer(page);
-    meta->magic   = BISCUIT_MAGIC;
-    meta->version = BISCUIT_VERSION;
-    meta->num_records = idx->num_records;
-    meta->root    = 0;
-
-    GenericXLogFinish(state);
-    UnlockReleaseBuffer(buf);
-}
-
+/*
+ * Report what the metapage records about the persisted snapshot.  Block 0
+ * and the snapshot data pages are owned by biscuit_storage.c; this is a
+ * thin convenience wrapper for callers that only want the counts.
+ */
 bool
 biscuit_read_metadata_from_disk(Relation index,
                                 int *num_records,
                                 int *num_columns,
                                 int *max_len)
 {
-    Buffer             buf;
-    Page               page;
-    BiscuitMetaPageData *meta;
-    BlockNumber        nblocks = RelationGetNumberOfBlocks(index);
-
-    if (nblocks == 0)
-    {
-        *num_records = *num_columns = *max_len = 0;
-        return false;
-    }
-
-    buf  = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
-    LockBuffer(buf, BUFFER_LOCK_SHARE);
-    page = BufferGetPage(buf);
-
-    if (PageIsNew(page) || PageIsEmpty(page))
-    {
-        UnlockReleaseBuffer(buf);
-        *num_records = *num_columns = *max_len = 0;
-        return false;
-    }
+    BiscuitMetaPageData meta;
 
-    meta = (BiscuitMetaPageData *) PageGetSpecialPointer(page);
+    *num_records = *num_columns = *max_len = 0;
 
-    if (meta->magic != BISCUIT_MAGIC)
-    {
-        UnlockReleaseBuffer(buf);
-        *num_records = *num_columns = *max_len = 0;
+    if (!biscuit_storage_describe(index, &meta))
         return false;
-    }
 
-    *num_records = meta->num_records;
-    *num_columns = 0;
-    *max_len     = 0;
+    *num_records = meta.num_records;
+    *num_columns = meta.num_columns;
 
-    UnlockReleaseBuffer(buf);
     return true;
 }
 
@@ -117,8 +76,8 @@ biscuit_push_free_slot(BiscuitIndex *idx, uint32_t slot)
 {
     if (idx->free_count >= idx->free_capacity)
     {
-        int       new_cap  = idx->free_capacity * 2;
-        uint32_t *new_list = (uint32_t *) palloc(new_cap * sizeof(uint32_t));
+        int       new_cap  = (int) Min((int64) idx->free_capacity * 2, BISCUIT_MAX_RECORDS);
+        uint32_t *new_list = (uint32_t *) biscuit_palloc_huge(new_cap * sizeof(uint32_t));
         memcpy(new_list, idx->free_list, idx->free_count * sizeof(uint32_t));
         pfree(idx->free_list);
         idx->free_list     = new_list;
@@ -136,108 +95,304 @@ biscuit_pop_free_slot(BiscuitIndex *idx, uint32_t *slot)
     return true;
 }
 
+/* Grow one value cache, leaving the new slots NULL */
+static char **
+biscuit_grow_cache(char **cache, int old_capacity, int capacity)
+{
+    cache = (char **) repalloc_huge(cache, (Size) capacity * sizeof(char *));
+    memset(cache + old_capacity, 0, (Size) (capacity - old_capacity) * sizeof(char *));
+    return cache;
+}
+
 /*
- * Remove a record from every character and length bitmap.
- * Handles both single-column (legacy) and multi-column layouts.
+ * Room for n more records in the TID array and the value caches, whose
+ * capacity doubles up to BISCUIT_MAX_RECORDS.  New cache slots are NULL:
+ * bulkdelete and the fallback scans rely on it.
  */
 void
-biscuit_remove_from_all_indices(BiscuitIndex *idx, uint32_t rec_idx)
+biscuit_reserve_records(BiscuitIndex *idx, int64 n)
 {
-    int ch, j, col;
+    int64 needed = (int64) idx->num_records + n;
+    int   old_capacity = idx->capacity;
+    int64 capacity = Max(old_capacity, 1024);
+    int   col;
 
-    if (!idx)
+    if (needed <= idx->capacity)
+        return;
+    if (needed > BISCUIT_MAX_RECORDS)
+        ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("biscuit index cannot hold more than %d records",
+                        BISCUIT_MAX_RECORDS),
+                 errhint("Partition the table and index each partition.")));
+
+    while (capacity < needed)
+        capacity *= 2;
+    idx->capacity = (int) Min(capacity, BISCUIT_MAX_RECORDS);
+
+    idx->tids = (ItemPointerData *) repalloc_huge(idx->tids,
+                                                  (Size) idx->capacity * sizeof(ItemPointerData));
+    if (idx->num_columns == 1)
+    {
+        if (idx->data_cache)
+            idx->data_cache = biscuit_grow_cache(idx->data_cache, old_capacity, idx->capacity);
+        if (idx->data_cache_lower)
+            idx->data_cache_lower = biscuit_grow_cache(idx->data_cache_lower, old_capacity,
+                                                       idx->capacity);
+    }
+    else
+    {
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            idx->column_data_cache[col] = biscuit_grow_cache(idx->column_data_cache[col],
+                                                             old_capacity, idx->capacity);
+            if (idx->column_data_cache_lower)
+                idx->column_data_cache_lower[col] =
+                    biscuit_grow_cache(idx->column_data_cache_lower[col], old_capacity,
+                                       idx->capacity);
+        }
+    }
+}
+
+/* Whether tid can go into slot without breaking idx->heap_ordered */
+static bool
+biscuit_slot_keeps_heap_order(const BiscuitIndex *idx, uint32_t slot, ItemPointer tid)
+{
+    if (slot > 0 && ItemPointerCompare((ItemPointer) &idx->tids[slot - 1], tid) > 0)
+        return false;
+    if (slot + 1 < (uint32_t) idx->num_records &&
+        ItemPointerCompare(tid, (ItemPointer) &idx->tids[slot + 1]) > 0)
+        return false;
+    return true;
+}
+
+/*
+ * Pick a free slot for a new record with TID tid, or return false to have
+ * it appended.  While the records are in heap order, the most recent free
+ * slot is taken only when tid fits between its neighbours; otherwise the
+ * record is appended if that keeps the order (the slot waits for
+ * compaction), and only when neither does is the order given up.
+ */
+static bool
+biscuit_take_free_slot(BiscuitIndex *idx, ItemPointer tid, uint32_t *slot)
+{
+    if (idx->free_count == 0)
+        return false;
+
+    if (idx->heap_ordered &&
+        !biscuit_slot_keeps_heap_order(idx, idx->free_list[idx->free_count - 1], tid))
+    {
+        if (biscuit_slot_keeps_heap_order(idx, (uint32_t) idx->num_records, tid))
+            return false;
+        idx->heap_ordered = false;
+    }
+
+    return biscuit_pop_free_slot(idx, slot);
+}
+
+/*
+ * Bitmap visitors.  Every record bitmap of an index is reached through
+ * biscuit_visit_bitmaps(), so removing one record, removing a whole dead
+ * set and renumbering records all cover the same bitmaps.  A visitor may
+ * replace *bitmap.
+ */
+typedef void (*BiscuitBitmapVisitor) (RoaringBitmap **bitmap, void *arg);
+
+static void
+biscuit_visit_char_index(CharIndex *ci, BiscuitBitmapVisitor visit, void *arg)
+{
+    int j;
+
+    for (j = 0; j < ci->count; j++)
+        if (ci->entries[j].bitmap)
+            visit(&ci->entries[j].bitmap, arg);
+}
+
+/* One case side: positions, negative positions, char caches, lengths */
+static void
+biscuit_visit_side(CharIndex *pos_idx, CharIndex *neg_idx, RoaringBitmap **char_cache,
+                   RoaringBitmap **length, RoaringBitmap **length_ge, int max_length,
+                   BiscuitBitmapVisitor visit, void *arg)
+{
+    int ch, j;
+
+    for (ch = 0; ch < CHAR_RANGE; ch++)
+    {
+        biscuit_visit_char_index(&pos_idx[ch], visit, arg);
+        biscuit_visit_char_index(&neg_idx[ch], visit, arg);
+        if (char_cache[ch])
+            visit(&char_cache[ch], arg);
+    }
+
+    /*
+     * FIX 4: j < max_length (not <=): valid indices are 0..max_length-1,
+     * reading one past the end GPF'd on the first VACUUM.
+     */
+    for (j = 0; j < max_length; j++)
+    {
+        if (length && length[j])
+            visit(&length[j], arg);
+        if (length_ge && length_ge[j])
+            visit(&length_ge[j], arg);
+    }
+}
+
+static void
+biscuit_visit_trigrams(CharIndex *trigrams, BiscuitBitmapVisitor visit, void *arg)
+{
+    int b;
+
+    if (!trigrams)
         return;
+    for (b = 0; b < BISCUIT_TRIGRAM_BUCKETS; b++)
+        biscuit_visit_char_index(&trigrams[b], visit, arg);
+}
+
+/*
+ * Call visit on every record bitmap of idx, on both case sides and for
+ * every column.  Trigram postings are only visited when trigrams is set:
+ * they are a superset filter, and stale bits of removed records do no
+ * harm there, but renumbering must move them too.
+ */
+static void
+biscuit_visit_bitmaps(BiscuitIndex *idx, bool trigrams, BiscuitBitmapVisitor visit, void *arg)
+{
+    int col;
 
-    /* -------- Multi-column -------- */
     if (idx->num_columns > 1 && idx->column_indices)
     {
         for (col = 0; col < idx->num_columns; col++)
         {
             ColumnIndex *cidx = &idx->column_indices[col];
 
-            for (ch = 0; ch < CHAR_RANGE; ch++)
-            {
-                /* case-sensitive */
-                for (j = 0; j < cidx->pos_idx[ch].count; j++)
-                    biscuit_roaring_remove(cidx->pos_idx[ch].entries[j].bitmap, rec_idx);
-                for (j = 0; j < cidx->neg_idx[ch].count; j++)
-                    biscuit_roaring_remove(cidx->neg_idx[ch].entries[j].bitmap, rec_idx);
-                if (cidx->char_cache[ch])
-                    biscuit_roaring_remove(cidx->char_cache[ch], rec_idx);
-
-                /* case-insensitive */
-                for (j = 0; j < cidx->pos_idx_lower[ch].count; j++)
-                    biscuit_roaring_remove(cidx->pos_idx_lower[ch].entries[j].bitmap, rec_idx);
-                for (j = 0; j < cidx->neg_idx_lower[ch].count; j++)
-                    biscuit_roaring_remove(cidx->neg_idx_lower[ch].entries[j].bitmap, rec_idx);
-                if (cidx->char_cache_lower[ch])
-                    biscuit_roaring_remove(cidx->char_cache_lower[ch], rec_idx);
-            }
-
-            if (cidx->length_bitmaps)
-                for (j = 0; j < cidx->max_length; j++)
-                    if (cidx->length_bitmaps[j])
-                        biscuit_roaring_remove(cidx->length_bitmaps[j], rec_idx);
-
-            if (cidx->length_ge_bitmaps)
-                for (j = 0; j < cidx->max_length; j++)
-                    if (cidx->length_ge_bitmaps[j])
-                        biscuit_roaring_remove(cidx->length_ge_bitmaps[j], rec_idx);
-
-            if (cidx->length_bitmaps_lower)
-                for (j = 0; j < cidx->max_length_lower; j++)
-                    if (cidx->length_bitmaps_lower[j])
-                        biscuit_roaring_remove(cidx->length_bitmaps_lower[j], rec_idx);
-
-            if (cidx->length_ge_bitmaps_lower)
-                for (j = 0; j < cidx->max_length_lower; j++)
-                    if (cidx->length_ge_bitmaps_lower[j])
-                        biscuit_roaring_remove(cidx->length_ge_bitmaps_lower[j], rec_idx);
+            biscuit_visit_side(cidx->pos_idx, cidx->neg_idx, cidx->char_cache,
+                               cidx->length_bitmaps, cidx->length_ge_bitmaps,
+                               cidx->max_length, visit, arg);
+            biscuit_visit_side(cidx->pos_idx_lower, cidx->neg_idx_lower, cidx->char_cache_lower,
+                               cidx->length_bitmaps_lower, cidx->length_ge_bitmaps_lower,
+                               cidx->max_length_lower, visit, arg);
+            if (trigrams)
+                biscuit_visit_trigrams(cidx->trigrams, visit, arg);
         }
         return;
     }
 
-    /* -------- Single-column (legacy) -------- */
-    for (ch = 0; ch < CHAR_RANGE; ch++)
+    biscuit_visit_side(idx->pos_idx_legacy, idx->neg_idx_legacy, idx->char_cache_legacy,
+                       idx->length_bitmaps_legacy, idx->length_ge_bitmaps_legacy,
+                       idx->max_length_legacy, visit, arg);
+    biscuit_visit_side(idx->pos_idx_lower, idx->neg_idx_lower, idx->char_cache_lower,
+                       idx->length_bitmaps_lower, idx->length_ge_bitmaps_lower,
+                       idx->max_length_lower, visit, arg);
+    if (trigrams)
+        biscuit_visit_trigrams(idx->trigrams_legacy, visit, arg);
+}
+
+static void
+biscuit_remove_visit(RoaringBitmap **bitmap, void *arg)
+{
+    biscuit_roaring_remove(*bitmap, *(const uint32_t *) arg);
+}
+
+static void
+biscuit_andnot_visit(RoaringBitmap **bitmap, void *arg)
+{
+    biscuit_roaring_andnot_inplace(*bitmap, (const RoaringBitmap *) arg);
+}
+
+/*
+ * Remove a record from every character and length bitmap.
+ * Handles both single-column (legacy) and multi-column layouts.
+ */
+void
+biscuit_remove_from_all_indices(BiscuitIndex *idx, uint32_t rec_idx)
+{
+    if (!idx)
+        return;
+    biscuit_visit_bitmaps(idx, false, biscuit_remove_visit, &rec_idx);
+}
+
+/*
+ * Remove every record of records from every character and length bitmap:
+ * one ANDNOT per bitmap, however many records go.
+ */
+static void
+biscuit_remove_set_from_all_indices(BiscuitIndex *idx, const RoaringBitmap *records)
+{
+    if (biscuit_roaring_is_empty(records))
+        return;
+    biscuit_visit_bitmaps(idx, false, biscuit_andnot_visit, (void *) records);
+}
+
+/*
+ * Whether record rec holds a value, i.e. is neither a NULL nor a removed
+ * record.  A warm index built without strings answers from the
+ * case-sensitive length_ge[0] bitmap, which every index builds.
+ */
+bool
+biscuit_record_has_value(const BiscuitIndex *idx, uint32_t rec)
+{
+    const RoaringBitmap *present;
+
+    if (idx->options.store_strings || idx->preload_state < BISCUIT_PRELOAD_DONE)
     {
-        /* case-sensitive */
-        for (j = 0; j < idx->pos_idx_legacy[ch].count; j++)
-            biscuit_roaring_remove(idx->pos_idx_legacy[ch].entries[j].bitmap, rec_idx);
-        for (j = 0; j < idx->neg_idx_legacy[ch].count; j++)
-            biscuit_roaring_remove(idx->neg_idx_legacy[ch].entries[j].bitmap, rec_idx);
-        if (idx->char_cache_legacy[ch])
-            biscuit_roaring_remove(idx->char_cache_legacy[ch], rec_idx);
-
-        /* case-insensitive */
-        for (j = 0; j < idx->pos_idx_lower[ch].count; j++)
-            biscuit_roaring_remove(idx->pos_idx_lower[ch].entries[j].bitmap, rec_idx);
-        for (j = 0; j < idx->neg_idx_lower[ch].count; j++)
-            biscuit_roaring_remove(idx->neg_idx_lower[ch].entries[j].bitmap, rec_idx);
-        if (idx->char_cache_lower[ch])
-            biscuit_roaring_remove(idx->char_cache_lower[ch], rec_idx);
+        if (idx->num_columns == 1)
+            return idx->data_cache && idx->data_cache[rec] != NULL;
+        return idx->column_data_cache && idx->column_data_cache[0] &&
+               idx->column_data_cache[0][rec] != NULL;
     }
 
-    if (idx->max_length_legacy > 0)
+    if (idx->num_columns == 1)
+        present = idx->length_ge_bitmaps_legacy ? idx->length_ge_bitmaps_legacy[0] : NULL;
+    else
+        present = idx->column_indices[0].length_ge_bitmaps
+                  ? idx->column_indices[0].length_ge_bitmaps[0] : NULL;
+    if (!present)
+        return false;
+
+    return biscuit_roaring_contains(present, rec);
+}
+
+/*
+ * The value of column col of record rec as LIKE (ilike = false) or ILIKE
+ * matches it, with its byte length in *len; NULL when the record has no
+ * value or the index keeps no strings.  Without a cached lowercased copy
+ * the ILIKE form is computed into *to_free, which the caller pfrees.
+ */
+const char *
+biscuit_record_string(const BiscuitIndex *idx, int col, bool ilike, uint32_t rec,
+                      int *len, char **to_free)
+{
+    const char *str;
+    const char *lower;
+
+    *to_free = NULL;
+    if (idx->num_columns == 1)
     {
-        for (j = 0; j < idx->max_length_legacy; j++)
-        {
-            if (idx->length_bitmaps_legacy && idx->length_bitmaps_legacy[j])
-                biscuit_roaring_remove(idx->length_bitmaps_legacy[j], rec_idx);
-            if (idx->length_ge_bitmaps_legacy && idx->length_ge_bitmaps_legacy[j])
-                biscuit_roaring_remove(idx->length_ge_bitmaps_legacy[j], rec_idx);
-        }
+        str   = idx->data_cache ? idx->data_cache[rec] : NULL;
+        lower = idx->data_cache_lower ? idx->data_cache_lower[rec] : NULL;
+    }
+    else
+    {
+        str   = idx->column_data_cache ? idx->column_data_cache[col][rec] : NULL;
+        lower = idx->column_data_cache_lower ? idx->column_data_cache_lower[col][rec] : NULL;
     }
 
-    if (idx->max_length_lower > 0)
+    if (!str)
+        return NULL;
+    if (!ilike)
     {
-        for (j = 0; j < idx->max_length_lower; j++)
-        {
-            if (idx->length_bitmaps_lower && idx->length_bitmaps_lower[j])
-                biscuit_roaring_remove(idx->length_bitmaps_lower[j], rec_idx);
-            if (idx->length_ge_bitmaps_lower && idx->length_ge_bitmaps_lower[j])
-                biscuit_roaring_remove(idx->length_ge_bitmaps_lower[j], rec_idx);
-        }
+        *len = biscuit_cache_strlen(str);
+        return str;
     }
+    if (lower)
+    {
+        *len = biscuit_cache_strlen(lower);
+        return lower;
+    }
+
+    *to_free = biscuit_str_tolower(str, biscuit_cache_strlen(str));
+    *len     = strlen(*to_free);
+    return *to_free;
 }
 
 /* ================================================================
@@ -253,28 +408,39 @@ biscuit_remove_from_all_indices(BiscuitIndex *idx, uint32_t rec_idx)
  */
 
 #include "biscuit_pattern.h"   /* for set_pos/neg_bitmap helpers etc */
-#include "biscuit_preload.h"   /* for BISCUIT_PRELOAD_DONE = 3 */
+#include "biscuit_result_cache.h"
+#include "biscuit_trigram.h"
 
 /*
  * Helper: add a single text record to the single-column (legacy) index.
- * Called once per non-NULL heap tuple during build and load.
+ * Used by aminsert; builds and loads go through the bulk loader
+ * (biscuit_bulk.c).
  *
- * str / byte_len  : original (UTF-8) string
+ * str / byte_len  : original (UTF-8) string, already stored as
+ *                   idx->data_cache[rec_idx]
+ * arena           : where the lowercased copy goes (the index's own, or a
+ *                   scratch arena when the index keeps no strings)
  * rec_idx         : slot in the index arrays to write into
+ *
+ * Only the bitmap families selected by idx->options are maintained.
  */
 static void
-biscuit_index_single_record(BiscuitIndex *idx,
-                             const char   *str,
-                             int           byte_len,
-                             int           rec_idx)
+biscuit_index_single_record(BiscuitIndex       *idx,
+                             BiscuitStringArena *arena,
+                             const char         *str,
+                             int                 byte_len,
+                             int                 rec_idx)
 {
+    const BiscuitOptions *options = &idx->options;
     int byte_pos  = 0;
     int char_pos  = 0;
     int char_count = biscuit_utf8_char_count(str, byte_len);
+    char *str_lower = NULL;
+    int   lower_byte_len = 0;
 
     /* ---- Case-sensitive character indexing ---- */
     byte_pos = char_pos = 0;
-    while (byte_pos < byte_len)
+    while (options->like && byte_pos < byte_len)
     {
         unsigned char first_byte = (unsigned char) str[byte_pos];
         int           char_len   = biscuit_utf8_char_length(first_byte);
@@ -291,22 +457,28 @@ biscuit_index_single_record(BiscuitIndex *idx,
             int neg_offset;
 
             /* positive position */
-            bm = biscuit_get_pos_bitmap(idx, uch, char_pos);
-            if (!bm) {
-                bm = biscuit_roaring_create();
-                biscuit_set_pos_bitmap(idx, uch, char_pos, bm);
+            if (BiscuitOptionsIndexPos(options, char_pos))
+            {
+                bm = biscuit_get_pos_bitmap(idx, uch, char_pos);
+                if (!bm) {
+                    bm = biscuit_roaring_create();
+                    biscuit_set_pos_bitmap(idx, uch, char_pos, bm);
+                }
+                biscuit_roaring_add(bm, rec_idx);
             }
-            biscuit_roaring_add(bm, rec_idx);
 
             /* negative position */
-            remaining_chars = biscuit_utf8_char_count(str + byte_pos, byte_len - byte_pos);
+            remaining_chars = char_count - char_pos;
             neg_offset = -remaining_chars;
-            bm = biscuit_get_neg_bitmap(idx, uch, neg_offset);
-            if (!bm) {
-                bm = biscuit_roaring_create();
-                biscuit_set_neg_bitmap(idx, uch, neg_offset, bm);
+            if (BiscuitOptionsIndexNeg(options, remaining_chars))
+            {
+                bm = biscuit_get_neg_bitmap(idx, uch, neg_offset);
+                if (!bm) {
+                    bm = biscuit_roaring_create();
+                    biscuit_set_neg_bitmap(idx, uch, neg_offset, bm);
+                }
+                biscuit_roaring_add(bm, rec_idx);
             }
-            biscuit_roaring_add(bm, rec_idx);
 
             /* character cache */
             if (!idx->char_cache_legacy[uch])
@@ -319,15 +491,15 @@ biscuit_index_single_record(BiscuitIndex *idx,
     }
 
     /* ---- Case-insensitive character indexing ---- */
+    if (options->ilike)
     {
-        char *str_lower      = biscuit_str_tolower(str, byte_len);
-        int   lower_byte_len = strlen(str_lower);
-        int   lower_char_count = biscuit_utf8_char_count(str_lower, lower_byte_len);
+        int   lower_char_count;
 
-        idx->data_cache_lower[rec_idx] = str_lower;
+        str_lower        = biscuit_arena_store_lower(arena, idx->data_cache[rec_idx]);
+        lower_byte_len   = biscuit_cache_strlen(str_lower);
+        lower_char_count = biscuit_utf8_char_count(str_lower, lower_byte_len);
 
-        if (lower_char_count > idx->max_length_lower)
-            idx->max_length_lower = lower_char_count;
+        idx->data_cache_lower[rec_idx] = str_lower;
 
         byte_pos = char_pos = 0;
         while (byte_pos < lower_byte_len)
@@ -346,21 +518,27 @@ biscuit_index_single_record(BiscuitIndex *idx,
                 int remaining_chars;
                 int neg_offset;
 
-                bm = biscuit_get_pos_bitmap_lower(idx, uch, char_pos);
-                if (!bm) {
-                    bm = biscuit_roaring_create();
-                    biscuit_set_pos_bitmap_lower(idx, uch, char_pos, bm);
+                if (BiscuitOptionsIndexPos(options, char_pos))
+                {
+                    bm = biscuit_get_pos_bitmap_lower(idx, uch, char_pos);
+                    if (!bm) {
+                        bm = biscuit_roaring_create();
+                        biscuit_set_pos_bitmap_lower(idx, uch, char_pos, bm);
+                    }
+                    biscuit_roaring_add(bm, rec_idx);
                 }
-                biscuit_roaring_add(bm, rec_idx);
 
-                remaining_chars = biscuit_utf8_char_count(str_lower + byte_pos, lower_byte_len - byte_pos);
+                remaining_chars = lower_char_count - char_pos;
                 neg_offset = -remaining_chars;
-                bm = biscuit_get_neg_bitmap_lower(idx, uch, neg_offset);
-                if (!bm) {
-                    bm = biscuit_roaring_create();
-                    biscuit_set_neg_bitmap_lower(idx, uch, neg_offset, bm);
+                if (BiscuitOptionsIndexNeg(options, remaining_chars))
+                {
+                    bm = biscuit_get_neg_bitmap_lower(idx, uch, neg_offset);
+                    if (!bm) {
+                        bm = biscuit_roaring_create();
+                        biscuit_set_neg_bitmap_lower(idx, uch, neg_offset, bm);
+                    }
+                    biscuit_roaring_add(bm, rec_idx);
                 }
-                biscuit_roaring_add(bm, rec_idx);
 
                 if (!idx->char_cache_lower[uch])
                     idx->char_cache_lower[uch] = biscuit_roaring_create();
@@ -372,6 +550,9 @@ biscuit_index_single_record(BiscuitIndex *idx,
         }
     }
 
+    biscuit_trigram_add(idx->trigrams_legacy, str, byte_len,
+                        str_lower, lower_byte_len, rec_idx);
+
     /* Track max case-sensitive character length */
     if (char_count > idx->max_len)
         idx->max_len = char_count;
@@ -395,6 +576,9 @@ biscuit_index_single_record(BiscuitIndex *idx,
  *   str      – original UTF-8 string (NOT NUL-terminated beyond byte_len)
  *   byte_len – byte length of str
  *   rec_idx  – record slot being indexed
+ *
+ * As for a single column, only the families idx->options selects are
+ * maintained.
  */
 static void
 biscuit_index_column_record(BiscuitIndex *idx,
@@ -403,6 +587,7 @@ biscuit_index_column_record(BiscuitIndex *idx,
                              int           byte_len,
                              int           rec_idx)
 {
+    const BiscuitOptions *options = &idx->options;
     ColumnIndex   *cidx       = &idx->column_indices[col];
     int            byte_pos   = 0;
     int            char_pos   = 0;
@@ -412,7 +597,7 @@ biscuit_index_column_record(BiscuitIndex *idx,
      * Case-sensitive pass
      * ---------------------------------------------------------------- */
     byte_pos = char_pos = 0;
-    while (byte_pos < byte_len)
+    while (options->like && byte_pos < byte_len)
     {
         unsigned char first_byte = (unsigned char) str[byte_pos];
         int           char_len   = biscuit_utf8_char_length(first_byte);
@@ -429,24 +614,30 @@ biscuit_index_column_record(BiscuitIndex *idx,
             int            neg_offset;
 
             /* positive-position bitmap */
-            bm = biscuit_get_col_pos_bitmap(cidx, uch, char_pos);
-            if (!bm)
+            if (BiscuitOptionsIndexPos(options, char_pos))
             {
-                bm = biscuit_roaring_create();
-                biscuit_set_col_pos_bitmap(cidx, uch, char_pos, bm);
+                bm = biscuit_get_col_pos_bitmap(cidx, uch, char_pos);
+                if (!bm)
+                {
+                    bm = biscuit_roaring_create();
+                    biscuit_set_col_pos_bitmap(cidx, uch, char_pos, bm);
+                }
+                biscuit_roaring_add(bm, rec_idx);
             }
-            biscuit_roaring_add(bm, rec_idx);
 
             /* negative-position bitmap */
-            remaining_chars = biscuit_utf8_char_count(str + byte_pos, byte_len - byte_pos);
+            remaining_chars = char_count - char_pos;
             neg_offset      = -remaining_chars;
-            bm = biscuit_get_col_neg_bitmap(cidx, uch, neg_offset);
-            if (!bm)
+            if (BiscuitOptionsIndexNeg(options, remaining_chars))
             {
-                bm = biscuit_roaring_create();
-                biscuit_set_col_neg_bitmap(cidx, uch, neg_offset, bm);
+                bm = biscuit_get_col_neg_bitmap(cidx, uch, neg_offset);
+                if (!bm)
+                {
+                    bm = biscuit_roaring_create();
+                    biscuit_set_col_neg_bitmap(cidx, uch, neg_offset, bm);
+                }
+                biscuit_roaring_add(bm, rec_idx);
             }
-            biscuit_roaring_add(bm, rec_idx);
 
             /* character-presence cache */
             if (!cidx->char_cache[uch])
@@ -458,22 +649,22 @@ biscuit_index_column_record(BiscuitIndex *idx,
         char_pos++;
     }
 
-    /* Track max character length for this column */
-    if (char_count > cidx->max_length)
-        cidx->max_length = char_count;
-
     /* ----------------------------------------------------------------
      * Case-insensitive pass
      * ---------------------------------------------------------------- */
+    if (!options->ilike)
+        biscuit_trigram_add(cidx->trigrams, str, byte_len, NULL, 0, rec_idx);
+    else
     {
-        char *str_lower      = biscuit_str_tolower(str, byte_len);
-        int   lower_byte_len = (int) strlen(str_lower);
-        int   lower_char_count;
+        int         lower_byte_len;
+        char       *folded    = biscuit_str_fold(str, byte_len, &lower_byte_len);
+        const char *str_lower = folded ? folded : str;
+        int         lower_char_count;
 
-        lower_char_count = biscuit_utf8_char_count(str_lower, lower_byte_len);
+        if (!folded)
+            lower_byte_len = byte_len;
 
-        if (lower_char_count > cidx->max_length_lower)
-            cidx->max_length_lower = lower_char_count;
+        lower_char_count = biscuit_utf8_char_count(str_lower, lower_byte_len);
 
         byte_pos = char_pos = 0;
         while (byte_pos < lower_byte_len)
@@ -493,25 +684,30 @@ biscuit_index_column_record(BiscuitIndex *idx,
                 int            neg_offset;
 
                 /* positive-position (lower) */
-                bm = biscuit_get_col_pos_bitmap_lower(cidx, uch, char_pos);
-                if (!bm)
+                if (BiscuitOptionsIndexPos(options, char_pos))
                 {
-                    bm = biscuit_roaring_create();
-                    biscuit_set_col_pos_bitmap_lower(cidx, uch, char_pos, bm);
+                    bm = biscuit_get_col_pos_bitmap_lower(cidx, uch, char_pos);
+                    if (!bm)
+                    {
+                        bm = biscuit_roaring_create();
+                        biscuit_set_col_pos_bitmap_lower(cidx, uch, char_pos, bm);
+                    }
+                    biscuit_roaring_add(bm, rec_idx);
                 }
-                biscuit_roaring_add(bm, rec_idx);
 
                 /* negative-position (lower) */
-                remaining_chars = biscuit_utf8_char_count(str_lower + byte_pos,
-                                                           lower_byte_len - byte_pos);
+                remaining_chars = lower_char_count - char_pos;
                 neg_offset      = -remaining_chars;
-                bm = biscuit_get_col_neg_bitmap_lower(cidx, uch, neg_offset);
-                if (!bm)
+                if (BiscuitOptionsIndexNeg(options, remaining_chars))
                 {
-                    bm = biscuit_roaring_create();
-                    biscuit_set_col_neg_bitmap_lower(cidx, uch, neg_offset, bm);
+                    bm = biscuit_get_col_neg_bitmap_lower(cidx, uch, neg_offset);
+                    if (!bm)
+                    {
+                        bm = biscuit_roaring_create();
+                        biscuit_set_col_neg_bitmap_lower(cidx, uch, neg_offset, bm);
+                    }
+                    biscuit_roaring_add(bm, rec_idx);
                 }
-                biscuit_roaring_add(bm, rec_idx);
 
                 /* character-presence cache (lower) */
                 if (!cidx->char_cache_lower[uch])
@@ -523,27 +719,122 @@ biscuit_index_column_record(BiscuitIndex *idx,
             char_pos++;
         }
 
-        pfree(str_lower);
+        biscuit_trigram_add(cidx->trigrams, str, byte_len,
+                            str_lower, lower_byte_len, rec_idx);
+
+        if (folded)
+            pfree(folded);
     }
 }
 
 /*
- * Build a brand-new index from the heap.  Returns an IndexBuildResult.
- * Handles both single-column and multi-column cases.
+ * Index one value of a build as record rec of column col, caching it
+ * (and its lowercased copy for ILIKE) when the options keep strings.
+ * str is the palloc'd output of biscuit_datum_to_text() and is consumed.
  */
-IndexBuildResult *
-biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
+static void
+biscuit_build_add_value(BiscuitIndex *idx, BiscuitBulkLoader *bulk, int col,
+                        char *str, int byte_len, uint32 rec)
 {
-    IndexBuildResult *result;
-    BiscuitIndex     *idx;
+    BiscuitStringArena *arena;
+    char              **strs;
+    char              **lower;
+    char               *value;
+    char               *value_lower = NULL;
+    int                 lower_len   = 0;
+
+    if (!idx->options.store_strings)
+    {
+        if (idx->options.ilike)
+        {
+            value_lower = biscuit_str_fold(str, byte_len, &lower_len);
+            if (!value_lower)
+                lower_len = byte_len;
+        }
+        biscuit_bulk_add(bulk, col, str, byte_len,
+                         value_lower ? value_lower : (idx->options.ilike ? str : NULL),
+                         lower_len, rec);
+        if (value_lower)
+            pfree(value_lower);
+        pfree(str);
+        return;
+    }
+
+    if (idx->num_columns == 1)
+    {
+        arena = &idx->strings_legacy;
+        strs  = idx->data_cache;
+        lower = idx->data_cache_lower;
+    }
+    else
+    {
+        arena = &idx->column_indices[col].strings;
+        strs  = idx->column_data_cache[col];
+        lower = idx->column_data_cache_lower[col];
+    }
+
+    value = biscuit_arena_store(arena, str, byte_len);
+    pfree(str);
+    if (idx->options.ilike)
+    {
+        value_lower = biscuit_arena_store_lower(arena, value);
+        lower_len   = biscuit_cache_strlen(value_lower);
+    }
+
+    strs[rec]  = value;
+    lower[rec] = value_lower;
+    biscuit_bulk_add(bulk, col, value, byte_len, value_lower, lower_len, rec);
+}
+
+/* Heap scan of a build: the whole table, or this participant's share */
+static TableScanDesc
+biscuit_build_beginscan(Relation heap, ParallelTableScanDesc pscan)
+{
+    if (pscan)
+    {
+    #if PG_VERSION_NUM >= 190000
+        return table_beginscan_parallel(heap, pscan, 0);
+    #else
+        return table_beginscan_parallel(heap, pscan);
+    #endif
+    }
+
+    #if PG_VERSION_NUM >= 190000
+        return table_beginscan(heap, SnapshotAny, 0, NULL, 0);
+    #else
+        return table_beginscan(heap, SnapshotAny, 0, NULL);
+    #endif
+}
+
+/*
+ * Build a complete in-memory index from the heap and publish it in the
+ * session cache.  Handles both single-column and multi-column cases.
+ * With cache_result = false the index is built in CurrentMemoryContext
+ * and not cached (the preload worker only needs it to write the snapshot).
+ *
+ * A fresh snapshot epoch is claimed before the heap scan starts (see
+ * biscuit_storage.c), so the returned copy is the one allowed to write
+ * the on-disk snapshot unless a concurrent insert demotes it.
+ *
+ * With pscan the heap is read through a parallel table scan and only the
+ * blocks this participant is handed become records; no epoch is claimed
+ * (the parallel build leader claims it once for the merged index).
+ */
+static BiscuitIndex *
+biscuit_build_internal(Relation heap, Relation index, IndexInfo *indexInfo,
+                       bool cache_result, ParallelTableScanDesc pscan)
+{
+    BiscuitIndex     *idx = NULL;
     TupleTableSlot   *slot;
     TableScanDesc     scan;
     MemoryContext     oldcontext;
-    int               ch, natts, col, rec_idx;
+    MemoryContext     copy_context;
+    int               ch, natts, col;
     EState           *estate;
     ExprContext      *econtext;
     Datum             index_values[INDEX_MAX_KEYS];
     bool              index_isnull[INDEX_MAX_KEYS];
+    BiscuitBulkLoader *bulk;
 
     /*
      * FIX #10 — expression index columns (e.g. USING biscuit((col::text))
@@ -579,25 +870,39 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
     econtext = GetPerTupleExprContext(estate);
 
     /*
-     * All BiscuitIndex data must live in CacheMemoryContext, not in
+     * All BiscuitIndex data must live under CacheMemoryContext, not in
      * rd_indexcxt.  PostgreSQL calls MemoryContextDelete(rd_indexcxt) inside
      * RelationClearRelation on any relcache invalidation (ANALYZE, DDL, cache
      * sweeps), which would free all our data while the cache entry still holds
      * the pointer.  CacheMemoryContext is never reset by PostgreSQL and is the
-     * correct long-lived home for session-scoped index structures.
+     * correct long-lived home for session-scoped index structures; the copy
+     * gets a context of its own there so biscuit_cache.c can free it whole.
      */
-    oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
+    copy_context = cache_result ? biscuit_cache_new_context() : CurrentMemoryContext;
+    oldcontext   = MemoryContextSwitchTo(copy_context);
 
     PG_TRY();
     {
         natts = index->rd_index->indnatts;
 
         idx               = (BiscuitIndex *) palloc0(sizeof(BiscuitIndex));
+        idx->memory_context = cache_result ? copy_context : NULL;
         idx->capacity     = 1024;
         idx->num_records  = 0;
         idx->num_columns  = natts;
+        biscuit_index_options(index, &idx->options);
         idx->max_len      = 0;
         idx->tids         = (ItemPointerData *) palloc(idx->capacity * sizeof(ItemPointerData));
+        idx->storage_epoch = pscan ? 0 : biscuit_storage_claim(index);
+
+        /* Entries logged from here on may be missed by the scan: replay them */
+        if (!pscan)
+        {
+            uint64 log_base;
+            uint64 log_version = biscuit_changelog_current(index, &log_base);
+
+            biscuit_changelog_attach(index, idx, log_version, log_base);
+        }
 
         if (natts == 1)
         {
@@ -632,14 +937,14 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
                 idx->char_cache_lower[ch]        = NULL;
             }
 
+            if (idx->options.trigrams)
+                idx->trigrams_legacy = biscuit_trigram_create();
+
             biscuit_init_crud_structures(idx);
 
+            bulk = biscuit_bulk_begin(idx);
             slot = table_slot_create(heap, NULL);
-            #if PG_VERSION_NUM >= 190000
-                scan = table_beginscan(heap, SnapshotAny, 0, NULL, 0);
-            #else
-                scan = table_beginscan(heap, SnapshotAny, 0, NULL);
-            #endif
+            scan = biscuit_build_beginscan(heap, pscan);
             while (table_scan_getnextslot(scan, ForwardScanDirection, slot))
             {
                 char  *str;
@@ -654,22 +959,10 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
                     str = biscuit_datum_to_text(index_values[0], coltypid,
                                                  &single_output_func, &out_len);
 
-                    if (idx->num_records >= idx->capacity)
-                    {
-                        idx->capacity *= 2;
-                        idx->tids = (ItemPointerData *) repalloc(
-                            idx->tids, idx->capacity * sizeof(ItemPointerData));
-                        idx->data_cache = (char **) repalloc(
-                            idx->data_cache, idx->capacity * sizeof(char *));
-                        idx->data_cache_lower = (char **) repalloc(
-                            idx->data_cache_lower, idx->capacity * sizeof(char *));
-                    }
+                    biscuit_reserve_records(idx, 1);
 
                     ItemPointerCopy(&slot->tts_tid, &idx->tids[idx->num_records]);
-                    idx->data_cache[idx->num_records] = str;
-
-                    biscuit_index_single_record(idx, str, out_len, idx->num_records);
-
+                    biscuit_build_add_value(idx, bulk, 0, str, out_len, idx->num_records);
                     idx->num_records++;
                 }
             }
@@ -677,53 +970,8 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
             table_endscan(scan);
             ExecDropSingleTupleTableSlot(slot);
 
-            /* Build length bitmaps */
-            idx->max_length_legacy = idx->max_len + 1;
-            idx->max_length_lower += 1;
-
-            idx->length_bitmaps_legacy    = (RoaringBitmap **) palloc0(idx->max_length_legacy * sizeof(RoaringBitmap *));
-            idx->length_ge_bitmaps_legacy = (RoaringBitmap **) palloc0(idx->max_length_legacy * sizeof(RoaringBitmap *));
-            idx->length_bitmaps_lower     = (RoaringBitmap **) palloc0(idx->max_length_lower   * sizeof(RoaringBitmap *));
-            idx->length_ge_bitmaps_lower  = (RoaringBitmap **) palloc0(idx->max_length_lower   * sizeof(RoaringBitmap *));
-
-            for (ch = 0; ch < idx->max_length_legacy; ch++)
-                idx->length_ge_bitmaps_legacy[ch] = biscuit_roaring_create();
-            for (ch = 0; ch < idx->max_length_lower; ch++)
-                idx->length_ge_bitmaps_lower[ch] = biscuit_roaring_create();
-
-            for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
-            {
-                int bl;
-                int cl;
-                if (!idx->data_cache[rec_idx]) continue;
-
-                bl = strlen(idx->data_cache[rec_idx]);
-                cl = biscuit_utf8_char_count(idx->data_cache[rec_idx], bl);
-
-                if (cl < idx->max_length_legacy)
-                {
-                    if (!idx->length_bitmaps_legacy[cl])
-                        idx->length_bitmaps_legacy[cl] = biscuit_roaring_create();
-                    biscuit_roaring_add(idx->length_bitmaps_legacy[cl], rec_idx);
-                }
-                for (int i = 0; i <= cl && i < idx->max_length_legacy; i++)
-                    biscuit_roaring_add(idx->length_ge_bitmaps_legacy[i], rec_idx);
-
-                if (idx->data_cache_lower[rec_idx])
-                {
-                    int lbl = strlen(idx->data_cache_lower[rec_idx]);
-                    int lcl = biscuit_utf8_char_count(idx->data_cache_lower[rec_idx], lbl);
-
-                    if (lcl < idx->max_length_lower)
-                    {
-                        if (!idx->length_bitmaps_lower[lcl])
-                            idx->length_bitmaps_lower[lcl] = biscuit_roaring_create();
-                        biscuit_roaring_add(idx->length_bitmaps_lower[lcl], rec_idx);
-                    }
-                    for (int i = 0; i <= lcl && i < idx->max_length_lower; i++)
-                        biscuit_roaring_add(idx->length_ge_bitmaps_lower[i], rec_idx);
-                }
-            }
+            /* Flush the batches and build the length bitmaps */
+            biscuit_bulk_finish(bulk);
         }
         else
         {
@@ -774,16 +1022,16 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
                     cidx->neg_idx_lower[ch].count    = 0; cidx->neg_idx_lower[ch].capacity = 64;
                     cidx->char_cache_lower[ch]       = NULL;
                 }
+
+                if (idx->options.trigrams)
+                    cidx->trigrams = biscuit_trigram_create();
             }
 
             biscuit_init_crud_structures(idx);
 
+            bulk = biscuit_bulk_begin(idx);
             slot = table_slot_create(heap, NULL);
-            #if PG_VERSION_NUM >= 190000
-                scan = table_beginscan(heap, SnapshotAny, 0, NULL, 0);
-            #else
-                scan = table_beginscan(heap, SnapshotAny, 0, NULL);
-            #endif
+            scan = biscuit_build_beginscan(heap, pscan);
             while (table_scan_getnextslot(scan, ForwardScanDirection, slot))
             {
                 bool all_non_null = true;
@@ -809,18 +1057,7 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
                 }
                 if (!all_non_null) continue;
 
-                if (idx->num_records >= idx->capacity)
-                {
-                    idx->capacity *= 2;
-                    idx->tids = (ItemPointerData *) repalloc(idx->tids, idx->capacity * sizeof(ItemPointerData));
-                    for (col = 0; col < natts; col++)
-                    {
-                        idx->column_data_cache[col] = (char **) repalloc(
-                            idx->column_data_cache[col], idx->capacity * sizeof(char *));
-                        idx->column_data_cache_lower[col] = (char **) repalloc(
-                            idx->column_data_cache_lower[col], idx->capacity * sizeof(char *));
-                    }
-                }
+                biscuit_reserve_records(idx, 1);
 
                 ItemPointerCopy(&slot->tts_tid, &idx->tids[idx->num_records]);
 
@@ -837,8 +1074,6 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
                     }
 
                     str = biscuit_datum_to_text(index_values[col], idx->column_types[col], &idx->output_funcs[col], &out_len);
-                    idx->column_data_cache[col][idx->num_records]       = str;
-                    idx->column_data_cache_lower[col][idx->num_records] = biscuit_str_tolower(str, out_len);
 
                     /*
                      * Populate all character-level and case-insensitive bitmaps
@@ -846,7 +1081,7 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
                      * missing call was the root cause of multi-column indexes
                      * returning 0 rows for every query.
                      */
-                    biscuit_index_column_record(idx, col, str, out_len, idx->num_records);
+                    biscuit_build_add_value(idx, bulk, col, str, out_len, idx->num_records);
                 }
 
                 idx->num_records++;
@@ -855,90 +1090,8 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
             table_endscan(scan);
             ExecDropSingleTupleTableSlot(slot);
 
-            /* Build per-column length bitmaps */
-            for (col = 0; col < natts; col++)
-            {
-                ColumnIndex *cidx = &idx->column_indices[col];
-                int max_cl = 0;
-
-                for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
-                {
-                    int bl;
-                    int cl;
-                    if (!idx->column_data_cache[col][rec_idx]) continue;
-                    bl = strlen(idx->column_data_cache[col][rec_idx]);
-                    cl = biscuit_utf8_char_count(idx->column_data_cache[col][rec_idx], bl);
-                    if (cl > max_cl) max_cl = cl;
-                }
-
-                cidx->max_length = max_cl + 1;
-                cidx->length_bitmaps    = (RoaringBitmap **) palloc0(cidx->max_length * sizeof(RoaringBitmap *));
-                cidx->length_ge_bitmaps = (RoaringBitmap **) palloc0(cidx->max_length * sizeof(RoaringBitmap *));
-                for (int i = 0; i < cidx->max_length; i++)
-                    cidx->length_ge_bitmaps[i] = biscuit_roaring_create();
-
-                for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
-                {
-                    int bl;
-                    int cl;
-                    if (!idx->column_data_cache[col][rec_idx]) continue;
-                    bl = strlen(idx->column_data_cache[col][rec_idx]);
-                    cl = biscuit_utf8_char_count(idx->column_data_cache[col][rec_idx], bl);
-                    if (cl < cidx->max_length)
-                    {
-                        if (!cidx->length_bitmaps[cl]) cidx->length_bitmaps[cl] = biscuit_roaring_create();
-                        biscuit_roaring_add(cidx->length_bitmaps[cl], rec_idx);
-                    }
-                    for (int i = 0; i <= cl && i < cidx->max_length; i++)
-                        biscuit_roaring_add(cidx->length_ge_bitmaps[i], rec_idx);
-                }
-
-                /* Case-insensitive length bitmaps — compute max_length_lower independently.
-                 * Cannot simply copy max_length: lowercasing can change character count
-                 * (e.g. German ß → ss doubles that character). */
-                {
-                    int max_cl_lower = 0;
-
-                    for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
-                    {
-                        int bl, cl;
-                        const char *s = idx->column_data_cache[col][rec_idx];
-                        char       *sl;
-                        if (!s) continue;
-                        bl = strlen(s);
-                        sl = biscuit_str_tolower(s, bl);
-                        cl = biscuit_utf8_char_count(sl, strlen(sl));
-                        pfree(sl);
-                        if (cl > max_cl_lower) max_cl_lower = cl;
-                    }
-
-                    cidx->max_length_lower = max_cl_lower + 1;
-                    cidx->length_bitmaps_lower    = (RoaringBitmap **) palloc0(cidx->max_length_lower * sizeof(RoaringBitmap *));
-                    cidx->length_ge_bitmaps_lower = (RoaringBitmap **) palloc0(cidx->max_length_lower * sizeof(RoaringBitmap *));
-                    for (int i = 0; i < cidx->max_length_lower; i++)
-                        cidx->length_ge_bitmaps_lower[i] = biscuit_roaring_create();
-
-                    for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
-                    {
-                        int         bl, cl;
-                        const char *s = idx->column_data_cache[col][rec_idx];
-                        char       *sl;
-                        if (!s) continue;
-                        bl = strlen(s);
-                        sl = biscuit_str_tolower(s, bl);
-                        cl = biscuit_utf8_char_count(sl, strlen(sl));
-                        pfree(sl);
-                        if (cl < cidx->max_length_lower)
-                        {
-                            if (!cidx->length_bitmaps_lower[cl])
-                                cidx->length_bitmaps_lower[cl] = biscuit_roaring_create();
-                            biscuit_roaring_add(cidx->length_bitmaps_lower[cl], rec_idx);
-                        }
-                        for (int i = 0; i <= cl && i < cidx->max_length_lower; i++)
-                            biscuit_roaring_add(cidx->length_ge_bitmaps_lower[i], rec_idx);
-                    }
-                }
-            }
+            /* Flush the batches and build the per-column length bitmaps */
+            biscuit_bulk_finish(bulk);
         }
 
         /*
@@ -955,35 +1108,76 @@ biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
          */
         idx->preload_state = BISCUIT_PRELOAD_DONE;
 
-        biscuit_write_metadata_to_disk(index, idx);
-        biscuit_register_callback();
-        /*
-         * NOTE: idx lives permanently in CacheMemoryContext and is owned
-         * exclusively by biscuit_cache (keyed by relid).  Do NOT also
-         * assign it to index->rd_amcache: PostgreSQL pfree()s rd_amcache
-         * on relcache invalidation, which under load (VACUUM/ANALYZE/many
-         * transactions) happens far more often than our own cache gets
-         * evicted, and pfree()ing this shared object out from under the
-         * global cache produces a dangling pointer / use-after-free the
-         * next time biscuit_cache_lookup() hands it back out.
-         */
-        biscuit_cache_insert(RelationGetRelid(index), idx);
+        /* A synchronized scan may have started mid-heap (and wrapped) */
+        idx->heap_ordered = biscuit_tids_in_heap_order(idx->tids, idx->num_records);
+
+        if (cache_result)
+        {
+            biscuit_register_callback();
+            /*
+             * NOTE: idx lives in its own context under CacheMemoryContext and
+             * is owned exclusively by biscuit_cache (keyed by relid).  Do NOT also
+             * assign it to index->rd_amcache: PostgreSQL pfree()s rd_amcache
+             * on relcache invalidation, which under load (VACUUM/ANALYZE/many
+             * transactions) happens far more often than our own cache gets
+             * evicted, and pfree()ing this shared object out from under the
+             * global cache produces a dangling pointer / use-after-free the
+             * next time biscuit_cache_lookup() hands it back out.
+             */
+            biscuit_cache_insert(RelationGetRelid(index), idx);
+        }
 
         MemoryContextSwitchTo(oldcontext);
         FreeExecutorState(estate);
-
-        result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
-        result->heap_tuples  = idx->num_records;
-        result->index_tuples = idx->num_records;
-
-        return result;
     }
     PG_CATCH();
     {
         MemoryContextSwitchTo(oldcontext);
+        if (cache_result)
+            MemoryContextDelete(copy_context);
         PG_RE_THROW();
     }
     PG_END_TRY();
+
+    return idx;
+}
+
+/*
+ * One participant's share of a parallel build: the records of the heap
+ * blocks pscan hands out, as an uncached index in CurrentMemoryContext.
+ */
+BiscuitIndex *
+biscuit_build_partial(Relation heap, Relation index, IndexInfo *indexInfo,
+                      ParallelTableScanDesc pscan)
+{
+    return biscuit_build_internal(heap, index, indexInfo, false, pscan);
+}
+
+/*
+ * ambuild: build the index from the heap and write the full snapshot to
+ * the index pages, so later sessions can load it without a heap scan.
+ * With parallel workers planned, each scans part of the heap and the
+ * leader merges their partial indexes (biscuit_parallel_build.c).
+ */
+IndexBuildResult *
+biscuit_build(Relation heap, Relation index, IndexInfo *indexInfo)
+{
+    IndexBuildResult *result;
+    BiscuitIndex     *idx = NULL;
+
+#if PG_VERSION_NUM >= 170000
+    if (indexInfo->ii_ParallelWorkers > 0)
+        idx = biscuit_build_parallel(heap, index, indexInfo);
+#endif
+    if (!idx)
+        idx = biscuit_build_internal(heap, index, indexInfo, true, NULL);
+    biscuit_storage_persist(index, idx);
+
+    result = (IndexBuildResult *) palloc(sizeof(IndexBuildResult));
+    result->heap_tuples  = idx->num_records;
+    result->index_tuples = idx->num_records;
+
+    return result;
 }
 
 void
@@ -994,95 +1188,142 @@ biscuit_buildempty(Relation index)
 }
 
 /*
- * Load (rebuild) the index from the heap on a cache miss.
- * Delegates to biscuit_build logic by re-scanning the heap.
+ * Load the index on a cache miss.  An on-disk snapshot is read directly
+ * (and caught up from the change log); otherwise the index is rebuilt
+ * from the heap (claiming a new snapshot epoch, so VACUUM can write it
+ * back later) and replays what was logged while the heap was scanned.
+ * Should VACUUM truncate the log meanwhile, the load is repeated once.
  */
 BiscuitIndex *
 biscuit_load_index(Relation index)
 {
     IndexInfo        *indexInfo;
-    IndexBuildResult *dummy;
+    BiscuitIndex     *idx;
+    BiscuitIndex     *synced;
     Relation          heap;
+    int               attempt;
 
-    heap = table_open(index->rd_index->indrelid, AccessShareLock);
+    for (attempt = 0;; attempt++)
+    {
+        idx = biscuit_storage_load(index);
+        if (idx)
+        {
+            biscuit_register_callback();
+            biscuit_cache_insert(RelationGetRelid(index), idx);
+            return idx;
+        }
 
-    indexInfo = BuildIndexInfo(index);
+        heap = table_open(index->rd_index->indrelid, AccessShareLock);
 
-    /* Re-use build path */
-    dummy = biscuit_build(heap, index, indexInfo);
-    pfree(dummy);
+        indexInfo = BuildIndexInfo(index);
 
-    table_close(heap, AccessShareLock);
+        /* Re-use build path; idx is placed in biscuit_cache, never rd_amcache */
+        idx = biscuit_build_internal(heap, index, indexInfo, true, NULL);
+
+        table_close(heap, AccessShareLock);
 
-    /* idx was placed in biscuit_cache by biscuit_build(); rd_amcache is
-     * never used as the source of truth (see note in biscuit_build). */
-    return biscuit_cache_lookup(RelationGetRelid(index));
+        synced = biscuit_changelog_sync(index, idx);
+        if (synced)
+            return synced;
+        if (attempt > 0)
+        {
+            /* Keep this copy; its next use will find it behind and reload */
+            biscuit_cache_insert(RelationGetRelid(index), idx);
+            return idx;
+        }
+    }
 }
 
+/*
+ * Build the index from the heap only to write the on-disk snapshot, then
+ * free it again.  Used by the preload worker, whose own copy would not be
+ * reachable by any session.  Returns true if the snapshot is now VALID.
+ */
 bool
-biscuit_insert(Relation index,
-               Datum *values,
-               bool *isnull,
-               ItemPointer ht_ctid,
-               Relation heapRelation,
-               IndexUniqueCheck checkUnique,
-               bool indexUnchanged,
-               IndexInfo *indexInfo)
+biscuit_build_snapshot(Relation index)
 {
+    IndexInfo     *indexInfo;
     BiscuitIndex  *idx;
+    Relation       heap;
+    MemoryContext  build_context;
+    MemoryContext  oldcontext;
+    bool           persisted;
+
+    heap      = table_open(index->rd_index->indrelid, AccessShareLock);
+    indexInfo = BuildIndexInfo(index);
+
+    build_context = AllocSetContextCreate(CurrentMemoryContext,
+                                          "Biscuit snapshot build",
+                                          ALLOCSET_DEFAULT_SIZES);
+    oldcontext = MemoryContextSwitchTo(build_context);
+    idx = biscuit_build_internal(heap, index, indexInfo, false, NULL);
+    MemoryContextSwitchTo(oldcontext);
+
+    table_close(heap, AccessShareLock);
+
+    persisted = biscuit_storage_persist(index, idx);
+
+    /* Releases the bitmaps and build_context itself */
+    idx->memory_context = build_context;
+    biscuit_storage_free_view(idx);
+
+    return persisted;
+}
+
+void
+biscuit_insert_record(Relation index, BiscuitIndex *idx,
+                      Datum *values, bool *isnull,
+                      ItemPointer tid, bool check_existing)
+{
     MemoryContext  oldcontext;
     uint32_t       slot;
     bool           found_existing  = false;
     bool           is_reusing_slot = false;
+    bool           view = BiscuitIndexIsShared(idx);
+    bool           retired_existing = false;
     int            col;
+    BiscuitStringArena scratch;     /* values of an index without strings */
 
-    (void) heapRelation;
-    (void) checkUnique;
-    (void) indexUnchanged;
-    (void) indexInfo;
+    /* The copy owns its memory context, see biscuit_build_internal() */
+    oldcontext = MemoryContextSwitchTo(BiscuitIndexMemoryContext(idx));
 
     /*
-     * Always resolve through the global, relid-keyed biscuit_cache rather
-     * than index->rd_amcache.  rd_amcache is pfree()d by PostgreSQL on
-     * relcache invalidation (e.g. the catalog access triggered by INSERT's
-     * own executor setup) — if we shared the same pointer with rd_amcache,
-     * that pfree would free the object the global cache still references,
-     * leading to a use-after-free on a later lookup.
+     * Check for duplicate TID (UPDATE path).  Only live records count: a
+     * deleted slot keeps its old TID while it waits on the free list.
      */
-    idx = biscuit_cache_lookup(RelationGetRelid(index));
-    if (!idx)
-        idx = biscuit_load_index(index);
-
-    /*
-     * FIX 1 — SELECT → INSERT crash (segfault at 0xfffffffffffffff8).
-     *
-     * When a SELECT runs before any INSERT, beginscan calls
-     * biscuit_load_skeleton() which leaves all four length-bitmap arrays
-     * (length_bitmaps_legacy, length_ge_bitmaps_legacy, length_bitmaps_lower,
-     * length_ge_bitmaps_lower) as NULL and max_length_legacy / max_length_lower
-     * as 0.  The grow-path below then calls repalloc(NULL, ...) which reads
-     * the palloc chunk header at ptr-8 == 0xfffffffffffffff8 and crashes.
-     *
-     * Fix: if the index arrived as a skeleton (preload_state < DONE), complete
-     * the bitmap build inline now, before touching any length-bitmap pointer.
-     * biscuit_complete_preload_local() is idempotent and cheap when
-     * num_records is small; for large indexes this path is only hit once per
-     * session because the result is stored back into the cache below.
-     *
-     * This also fixes the mirrored hazard in the multi-column path where
-     * cidx->length_bitmaps / length_ge_bitmaps are NULL in a skeleton.
-     */
-     
-    oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
-    if (idx->preload_state < BISCUIT_PRELOAD_DONE)
-        biscuit_complete_preload_local(idx, RelationGetRelid(index));
-
-
-    /* Check for duplicate TID (UPDATE path) */
-    for (int i = 0; i < idx->num_records; i++)
+    for (int i = 0; check_existing && i < idx->num_records; i++)
     {
-        if (ItemPointerEquals(&idx->tids[i], ht_ctid))
+        if (ItemPointerEquals(&idx->tids[i], tid) &&
+            biscuit_record_has_value(idx, (uint32_t) i) &&
+            !biscuit_roaring_contains(idx->tombstones, (uint32_t) i))
         {
+            if (view)
+            {
+                /*
+                 * The old slot's bits are in the shared image: tombstone
+                 * it and append the new values as a pending record.
+                 */
+                biscuit_roaring_add(idx->tombstones, (uint32_t) i);
+                idx->tombstone_count++;
+                if (idx->num_columns == 1)
+                {
+                    idx->data_cache[i]       = NULL;
+                    idx->data_cache_lower[i] = NULL;
+                }
+                else
+                    for (col = 0; col < idx->num_columns; col++)
+                    {
+                        idx->column_data_cache[col][i] = NULL;
+                        if (idx->column_data_cache_lower)
+                            idx->column_data_cache_lower[col][i] = NULL;
+                    }
+                if (idx->pending)
+                    biscuit_roaring_remove(idx->pending, (uint32_t) i);
+                idx->update_count++;
+                retired_existing = true;
+                break;
+            }
+
             found_existing = true;
             slot           = i;
 
@@ -1091,24 +1332,22 @@ biscuit_insert(Relation index,
 
             if (idx->num_columns == 1)
             {
-                if (idx->data_cache[slot])       { pfree(idx->data_cache[slot]);       idx->data_cache[slot]       = NULL; }
-                if (idx->data_cache_lower[slot])  { pfree(idx->data_cache_lower[slot]); idx->data_cache_lower[slot] = NULL; }
+                biscuit_arena_release(&idx->strings_legacy,
+                                      idx->data_cache[slot], idx->data_cache_lower[slot]);
+                idx->data_cache[slot]       = NULL;
+                idx->data_cache_lower[slot] = NULL;
             }
             else
             {
                 for (col = 0; col < idx->num_columns; col++)
                 {
-                    if (idx->column_data_cache[col][slot])
-                    {
-                        pfree(idx->column_data_cache[col][slot]);
-                        idx->column_data_cache[col][slot] = NULL;
-                    }
-                    if (idx->column_data_cache_lower &&
-                        idx->column_data_cache_lower[col][slot])
-                    {
-                        pfree(idx->column_data_cache_lower[col][slot]);
+                    biscuit_arena_release(&idx->column_indices[col].strings,
+                                          idx->column_data_cache[col][slot],
+                                          idx->column_data_cache_lower ?
+                                          idx->column_data_cache_lower[col][slot] : NULL);
+                    idx->column_data_cache[col][slot] = NULL;
+                    if (idx->column_data_cache_lower)
                         idx->column_data_cache_lower[col][slot] = NULL;
-                    }
                 }
             }
 
@@ -1119,8 +1358,8 @@ biscuit_insert(Relation index,
         }
     }
 
-    /* Try to reuse a free slot */
-    if (!found_existing && biscuit_pop_free_slot(idx, &slot))
+    /* Try to reuse a free slot; a shared view only appends */
+    if (!found_existing && !view && biscuit_take_free_slot(idx, tid, &slot))
     {
         is_reusing_slot = true;
         /* Un-tombstone the recycled slot so NOT LIKE inversion
@@ -1133,82 +1372,47 @@ biscuit_insert(Relation index,
     if (!found_existing && !is_reusing_slot)
     {
         /* Append new slot */
-        if (idx->num_records >= idx->capacity)
-        {
-            int old_capacity = idx->capacity;
-            idx->capacity *= 2;
-            idx->tids = (ItemPointerData *) repalloc(idx->tids, idx->capacity * sizeof(ItemPointerData));
-            if (idx->num_columns == 1)
-            {
-                idx->data_cache       = (char **) repalloc(idx->data_cache,       idx->capacity * sizeof(char *));
-                idx->data_cache_lower = (char **) repalloc(idx->data_cache_lower, idx->capacity * sizeof(char *));
-                /*
-                 * FIX A: Zero-initialise the newly allocated tail so that
-                 * data_cache[slot] and data_cache_lower[slot] are reliably
-                 * NULL for fresh slots.  Without this, repalloc leaves the
-                 * memory uninitialised; the guard at "if (idx->data_cache_lower[slot])"
-                 * below may pass on garbage and strlen/utf8_char_count then
-                 * dereferences a wild pointer.
-                 */
-                memset(idx->data_cache       + old_capacity, 0,
-                       (idx->capacity - old_capacity) * sizeof(char *));
-                memset(idx->data_cache_lower  + old_capacity, 0,
-                       (idx->capacity - old_capacity) * sizeof(char *));
-            }
-            else
-            {
-                for (col = 0; col < idx->num_columns; col++)
-                {
-                    int old_cap = old_capacity;
-                    idx->column_data_cache[col] = (char **) repalloc(
-                        idx->column_data_cache[col], idx->capacity * sizeof(char *));
-                    /*
-                     * FIX B: Same zero-init requirement for the multi-column
-                     * cache arrays.  biscuit_bulkdelete reads column_data_cache[0][i]
-                     * to detect live records; uninitialised bytes here cause it to
-                     * treat garbage as a valid pointer and misclassify rows.
-                     */
-                    memset(idx->column_data_cache[col] + old_cap, 0,
-                           (idx->capacity - old_cap) * sizeof(char *));
-
-                    /*
-                     * FIX C: Grow and zero-init column_data_cache_lower in
-                     * lockstep.  Without this the array is shorter than
-                     * column_data_cache; fallback scans on newly-appended
-                     * slots read off the end of the allocation.
-                     */
-                    if (idx->column_data_cache_lower)
-                    {
-                        idx->column_data_cache_lower[col] = (char **) repalloc(
-                            idx->column_data_cache_lower[col], idx->capacity * sizeof(char *));
-                        memset(idx->column_data_cache_lower[col] + old_cap, 0,
-                               (idx->capacity - old_cap) * sizeof(char *));
-                    }
-                }
-            }
-        }
+        biscuit_reserve_records(idx, 1);
+        if (idx->heap_ordered && !biscuit_slot_keeps_heap_order(idx, (uint32_t) idx->num_records, tid))
+            idx->heap_ordered = false;
         slot = idx->num_records++;
     }
 
-    ItemPointerCopy(ht_ctid, &idx->tids[slot]);
+    ItemPointerCopy(tid, &idx->tids[slot]);
 
-    /* Insert record data */
-    if (idx->num_columns == 1)
+    /*
+     * An index built with store_strings = off still caches the new value
+     * while it is indexed and the result cache is patched, in a scratch
+     * arena released below.
+     */
+    memset(&scratch, 0, sizeof(scratch));
+
+    /* Insert record data; biscuit_insert() sends a shared view here only */
+    Assert(!view || biscuit_pending_accepts(index, idx));
+    if (biscuit_pending_accepts(index, idx))
+    {
+        /* Cache the values only; their bitmaps are built at the next merge */
+        biscuit_pending_insert(index, idx, values, isnull, slot);
+    }
+    else if (idx->num_columns == 1)
     {
         if (!isnull[0])
         {
             text *txt      = DatumGetTextPP(values[0]);
             char *str      = VARDATA_ANY(txt);
             int   byte_len = VARSIZE_ANY_EXHDR(txt);
+            BiscuitStringArena *arena = idx->options.store_strings ? &idx->strings_legacy
+                                                                   : &scratch;
 
-            idx->data_cache[slot] = pnstrdup(str, byte_len);
+            idx->data_cache[slot] = biscuit_arena_store(arena, str, byte_len);
 
             /*
              * biscuit_index_single_record writes idx->data_cache_lower[slot]
-             * as a side-effect.  It must run BEFORE the length-bitmap block
-             * below reads data_cache_lower[slot].
+             * as a side-effect (unless the index has no ILIKE mirror).  It
+             * must run BEFORE the length-bitmap block below reads
+             * data_cache_lower[slot].
              */
-            biscuit_index_single_record(idx, str, byte_len, slot);
+            biscuit_index_single_record(idx, arena, str, byte_len, slot);
 
             /* Grow length bitmaps if needed */
             {
@@ -1254,7 +1458,7 @@ biscuit_insert(Relation index,
                  */
                 if (idx->data_cache_lower[slot])
                 {
-                    int lbl = strlen(idx->data_cache_lower[slot]);
+                    int lbl = biscuit_cache_strlen(idx->data_cache_lower[slot]);
                     int lcl = biscuit_utf8_char_count(idx->data_cache_lower[slot], lbl);
                     if (lcl >= idx->max_length_lower)
                     {
@@ -1298,9 +1502,15 @@ biscuit_insert(Relation index,
         {
             if (!isnull[col])
             {
+                BiscuitStringArena *arena = idx->options.store_strings
+                                            ? &idx->column_indices[col].strings
+                                            : &scratch;
                 int   out_len;
-                char *str = biscuit_datum_to_text(values[col], idx->column_types[col],
-                                                  &idx->output_funcs[col], &out_len);
+                char *value = biscuit_datum_to_text(values[col], idx->column_types[col],
+                                                    &idx->output_funcs[col], &out_len);
+                char *str = biscuit_arena_store(arena, value, out_len);
+
+                pfree(value);
                 idx->column_data_cache[col][slot] = str;
 
                 /*
@@ -1309,8 +1519,8 @@ biscuit_insert(Relation index,
                  * matching the invariant established at build / skeleton load time.
                  * Mirror NULL to NULL for the null-column case handled below.
                  */
-                if (idx->column_data_cache_lower)
-                    idx->column_data_cache_lower[col][slot] = biscuit_str_tolower(str, out_len);
+                if (idx->column_data_cache_lower && idx->options.ilike)
+                    idx->column_data_cache_lower[col][slot] = biscuit_arena_store_lower(arena, str);
 
                 biscuit_index_column_record(idx, col, str, out_len, slot);
 
@@ -1375,7 +1585,7 @@ biscuit_insert(Relation index,
                         const char *lstr = idx->column_data_cache_lower[col][slot];
                         if (lstr)
                         {
-                            int lbl = strlen(lstr);
+                            int lbl = biscuit_cache_strlen(lstr);
                             int lcl = biscuit_utf8_char_count(lstr, lbl);
 
                             if (lcl >= cidx->max_length_lower)
@@ -1418,9 +1628,128 @@ biscuit_insert(Relation index,
         }
     }
 
-    if (!found_existing && !is_reusing_slot)
+    /* Patch cached pattern results for the new value of this slot */
+    biscuit_result_cache_note_insert(idx, slot);
+
+    if (!idx->options.store_strings)
+    {
+        if (idx->num_columns == 1)
+        {
+            idx->data_cache[slot]       = NULL;
+            idx->data_cache_lower[slot] = NULL;
+        }
+        else
+        {
+            for (col = 0; col < idx->num_columns; col++)
+            {
+                idx->column_data_cache[col][slot] = NULL;
+                if (idx->column_data_cache_lower)
+                    idx->column_data_cache_lower[col][slot] = NULL;
+            }
+        }
+        biscuit_arena_free(&scratch);
+    }
+
+    if (!found_existing && !is_reusing_slot && !retired_existing)
         idx->insert_count++;
 
+    MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Swap a shared view for a private copy caught up through the change
+ * log, or load the index afresh once the log no longer reaches back to
+ * the view's image.
+ */
+static BiscuitIndex *
+biscuit_private_copy(Relation index, BiscuitIndex *view)
+{
+    BiscuitIndex *idx = biscuit_shared_make_private(index, view);
+
+    while (!idx)
+    {
+        biscuit_cache_remove(RelationGetRelid(index));
+        idx = biscuit_load_index(index);
+        if (BiscuitIndexIsShared(idx))
+            idx = biscuit_shared_make_private(index, idx);
+    }
+
+    return idx;
+}
+
+bool
+biscuit_insert(Relation index,
+               Datum *values,
+               bool *isnull,
+               ItemPointer ht_ctid,
+               Relation heapRelation,
+               IndexUniqueCheck checkUnique,
+               bool indexUnchanged,
+               IndexInfo *indexInfo)
+{
+    BiscuitIndex  *idx;
+    MemoryContext  oldcontext;
+
+    (void) heapRelation;
+    (void) checkUnique;
+    (void) indexUnchanged;
+    (void) indexInfo;
+
+    /*
+     * Always resolve through the global, relid-keyed biscuit_cache rather
+     * than index->rd_amcache.  rd_amcache is pfree()d by PostgreSQL on
+     * relcache invalidation (e.g. the catalog access triggered by INSERT's
+     * own executor setup) — if we shared the same pointer with rd_amcache,
+     * that pfree would free the object the global cache still references,
+     * leading to a use-after-free on a later lookup.
+     */
+    idx = biscuit_changelog_lookup(index);
+    if (!idx)
+        idx = biscuit_load_index(index);
+
+    /*
+     * A shared image is read-only: the insert joins the view's pending
+     * list, or, when the index cannot take pending inserts, this backend
+     * switches to a private copy.
+     */
+    if (BiscuitIndexIsShared(idx) && biscuit_pending_accepts(index, idx))
+        biscuit_shared_open_delta(idx);
+    else if (BiscuitIndexIsShared(idx))
+        idx = biscuit_private_copy(index, idx);
+
+    /*
+     * FIX 1 — SELECT → INSERT crash (segfault at 0xfffffffffffffff8).
+     *
+     * When a SELECT runs before any INSERT, beginscan calls
+     * biscuit_load_skeleton() which leaves all four length-bitmap arrays
+     * (length_bitmaps_legacy, length_ge_bitmaps_legacy, length_bitmaps_lower,
+     * length_ge_bitmaps_lower) as NULL and max_length_legacy / max_length_lower
+     * as 0.  The grow-path below then calls repalloc(NULL, ...) which reads
+     * the palloc chunk header at ptr-8 == 0xfffffffffffffff8 and crashes.
+     *
+     * Fix: if the index arrived as a skeleton (preload_state < DONE), complete
+     * the bitmap build inline now, before touching any length-bitmap pointer.
+     * biscuit_complete_preload_local() is idempotent and cheap when
+     * num_records is small; for large indexes this path is only hit once per
+     * session because the result is stored back into the cache below.
+     *
+     * This also fixes the mirrored hazard in the multi-column path where
+     * cidx->length_bitmaps / length_ge_bitmaps are NULL in a skeleton.
+     */
+
+    oldcontext = MemoryContextSwitchTo(BiscuitIndexMemoryContext(idx));
+    if (idx->preload_state < BISCUIT_PRELOAD_DONE)
+        biscuit_complete_preload_local(idx, RelationGetRelid(index));
+
+    /* The on-disk snapshot will no longer include this tuple */
+    biscuit_storage_mark_dirty(index, idx);
+    MemoryContextSwitchTo(oldcontext);
+
+    biscuit_insert_record(index, idx, values, isnull, ht_ctid, true);
+
+    /* Other backends pick the tuple up from the change log */
+    biscuit_changelog_insert(index, idx, values, isnull, ht_ctid);
+
     /*
      * FIX 2 — INSERT → SELECT returns 0.
      *
@@ -1436,8 +1765,6 @@ biscuit_insert(Relation index,
      */
     biscuit_cache_insert(RelationGetRelid(index), idx);
 
-    MemoryContextSwitchTo(oldcontext);
-
     return true;
 }
 
@@ -1445,27 +1772,35 @@ biscuit_insert(Relation index,
  * SECTION 5 – BULKDELETE
  * ================================================================ */
 
-IndexBulkDeleteResult *
-biscuit_bulkdelete(IndexVacuumInfo *info,
-                   IndexBulkDeleteResult *stats,
-                   IndexBulkDeleteCallback callback,
-                   void *callback_state)
+int64
+biscuit_delete_records(Relation index, BiscuitIndex *idx,
+                       IndexBulkDeleteCallback callback, void *callback_state,
+                       bool mark_dirty, ItemPointerData **deleted)
 {
-    Relation       index = info->index;
-    BiscuitIndex  *idx;
-    int            i, j, ch, col;
+    int            i, j, col;
     MemoryContext  oldcontext;
     RoaringBitmap *records_to_delete;
     uint64_t       delete_count;
     uint32_t      *delete_indices;
+    bool           marked_dirty = false;
+    bool           view = BiscuitIndexIsShared(idx);
+    int64          ndeleted = 0;
+    int            deleted_capacity = 64;
 
-    idx = biscuit_cache_lookup(RelationGetRelid(index));
-    if (!idx) { idx = biscuit_load_index(index); }
+    /*
+     * Deleted records must not be left on the pending list.  A shared
+     * view only tombstones them (biscuit_shared_open_delta): its bitmaps
+     * and string image cannot change, and its slots are not reused.
+     */
+    if (view)
+        biscuit_shared_open_delta(idx);
+    else
+        biscuit_pending_flush(idx);
 
-    if (!stats)
-        stats = (IndexBulkDeleteResult *) palloc0(sizeof(IndexBulkDeleteResult));
+    if (deleted)
+        *deleted = (ItemPointerData *) palloc(deleted_capacity * sizeof(ItemPointerData));
 
-    oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
+    oldcontext = MemoryContextSwitchTo(BiscuitIndexMemoryContext(idx));
 
     records_to_delete = biscuit_roaring_create();
 
@@ -1474,142 +1809,125 @@ biscuit_bulkdelete(IndexVacuumInfo *info,
         bool has_data;
         bool already_tombstoned;
 
-        if (idx->num_columns == 1)
-            has_data = (idx->data_cache[i] != NULL);
-        else
-            has_data = (idx->column_data_cache && idx->column_data_cache[0] && idx->column_data_cache[0][i] != NULL);
+        has_data = biscuit_record_has_value(idx, (uint32_t) i);
 
         if (!has_data) continue;
 
-#ifdef HAVE_ROARING
-        already_tombstoned = roaring_bitmap_contains(idx->tombstones, (uint32_t) i);
-#else
-        { uint32_t bl = i >> 6, bt = i & 63; already_tombstoned = ((int) bl < idx->tombstones->num_blocks && (idx->tombstones->blocks[bl] & (1ULL << bt))); }
-#endif
+        already_tombstoned = biscuit_roaring_contains(idx->tombstones, (uint32_t) i);
         if (already_tombstoned) continue;
 
         if (callback(&idx->tids[i], callback_state))
         {
+            if (!marked_dirty)
+            {
+                if (mark_dirty)
+                    biscuit_storage_mark_dirty(index, idx);
+                biscuit_result_cache_invalidate(idx);
+                marked_dirty = true;
+            }
+
+            if (deleted)
+            {
+                /* repalloc keeps the array in the caller's context */
+                if (ndeleted == deleted_capacity)
+                {
+                    deleted_capacity *= 2;
+                    *deleted = (ItemPointerData *) repalloc(*deleted,
+                                                            deleted_capacity * sizeof(ItemPointerData));
+                }
+                ItemPointerCopy(&idx->tids[i], &(*deleted)[ndeleted]);
+            }
+
             biscuit_roaring_add(idx->tombstones, (uint32_t) i);
             biscuit_roaring_add(records_to_delete, (uint32_t) i);
             idx->tombstone_count++;
-            biscuit_push_free_slot(idx, (uint32_t) i);
-            stats->tuples_removed++;
+            if (!view)
+                biscuit_push_free_slot(idx, (uint32_t) i);
+            ndeleted++;
             idx->delete_count++;
         }
     }
 
     delete_count = biscuit_roaring_count(records_to_delete);
 
-    if (delete_count > 0)
+    if (delete_count > 0 && view)
     {
+        /*
+         * The values live in the shared image: forget the private
+         * pointers to them and leave the bitmaps to the tombstones.
+         */
         delete_indices = biscuit_roaring_to_array(records_to_delete, &delete_count);
 
-        if (delete_indices)
+        for (j = 0; j < (int) delete_count; j++)
         {
             if (idx->num_columns == 1)
             {
-                for (ch = 0; ch < CHAR_RANGE; ch++)
+                idx->data_cache[delete_indices[j]] = NULL;
+                if (idx->data_cache_lower)
+                    idx->data_cache_lower[delete_indices[j]] = NULL;
+            }
+            else
+                for (col = 0; col < idx->num_columns; col++)
                 {
-                    for (j = 0; j < idx->pos_idx_legacy[ch].count; j++)
-                        biscuit_roaring_andnot_inplace(idx->pos_idx_legacy[ch].entries[j].bitmap, records_to_delete);
-                    for (j = 0; j < idx->neg_idx_legacy[ch].count; j++)
-                        biscuit_roaring_andnot_inplace(idx->neg_idx_legacy[ch].entries[j].bitmap, records_to_delete);
-                    if (idx->char_cache_legacy[ch])
-                        biscuit_roaring_andnot_inplace(idx->char_cache_legacy[ch], records_to_delete);
-
-                    for (j = 0; j < idx->pos_idx_lower[ch].count; j++)
-                        biscuit_roaring_andnot_inplace(idx->pos_idx_lower[ch].entries[j].bitmap, records_to_delete);
-                    for (j = 0; j < idx->neg_idx_lower[ch].count; j++)
-                        biscuit_roaring_andnot_inplace(idx->neg_idx_lower[ch].entries[j].bitmap, records_to_delete);
-                    if (idx->char_cache_lower[ch])
-                        biscuit_roaring_andnot_inplace(idx->char_cache_lower[ch], records_to_delete);
+                    idx->column_data_cache[col][delete_indices[j]] = NULL;
+                    if (idx->column_data_cache_lower)
+                        idx->column_data_cache_lower[col][delete_indices[j]] = NULL;
                 }
+        }
 
-                for (j = 0; j < idx->max_length_legacy; j++)
-                {
-                    if (idx->length_bitmaps_legacy && idx->length_bitmaps_legacy[j])
-                        biscuit_roaring_andnot_inplace(idx->length_bitmaps_legacy[j], records_to_delete);
-                    if (idx->length_ge_bitmaps_legacy && idx->length_ge_bitmaps_legacy[j])
-                        biscuit_roaring_andnot_inplace(idx->length_ge_bitmaps_legacy[j], records_to_delete);
-                }
-                for (j = 0; j < idx->max_length_lower; j++)
-                {
-                    if (idx->length_bitmaps_lower && idx->length_bitmaps_lower[j])
-                        biscuit_roaring_andnot_inplace(idx->length_bitmaps_lower[j], records_to_delete);
-                    if (idx->length_ge_bitmaps_lower && idx->length_ge_bitmaps_lower[j])
-                        biscuit_roaring_andnot_inplace(idx->length_ge_bitmaps_lower[j], records_to_delete);
-                }
+        if (idx->pending)
+            biscuit_roaring_andnot_inplace(idx->pending, records_to_delete);
+
+        if (delete_indices)
+            pfree(delete_indices);
+    }
+    else if (delete_count > 0)
+    {
+        delete_indices = biscuit_roaring_to_array(records_to_delete, &delete_count);
+
+        if (delete_indices)
+        {
+            /* One ANDNOT of the dead set per bitmap */
+            biscuit_remove_set_from_all_indices(idx, records_to_delete);
 
+            if (idx->num_columns == 1)
+            {
                 for (j = 0; j < (int) delete_count; j++)
                 {
-                    if (idx->data_cache[delete_indices[j]])
-                        { pfree(idx->data_cache[delete_indices[j]]); idx->data_cache[delete_indices[j]] = NULL; }
-                    if (idx->data_cache_lower && idx->data_cache_lower[delete_indices[j]])
-                        { pfree(idx->data_cache_lower[delete_indices[j]]); idx->data_cache_lower[delete_indices[j]] = NULL; }
+                    biscuit_arena_release(&idx->strings_legacy,
+                                          idx->data_cache[delete_indices[j]],
+                                          idx->data_cache_lower ?
+                                          idx->data_cache_lower[delete_indices[j]] : NULL);
+                    idx->data_cache[delete_indices[j]] = NULL;
+                    if (idx->data_cache_lower)
+                        idx->data_cache_lower[delete_indices[j]] = NULL;
                 }
+
+                /* Drop the deleted values from the arena once enough have gone */
+                biscuit_arena_compact(&idx->strings_legacy, idx->data_cache,
+                                      idx->data_cache_lower, idx->num_records);
             }
             else
             {
-                for (col = 0; col < idx->num_columns; col++)
-                {
-                    ColumnIndex *cidx = &idx->column_indices[col];
-
-                    for (ch = 0; ch < CHAR_RANGE; ch++)
-                    {
-                        for (j = 0; j < cidx->pos_idx[ch].count; j++)
-                            biscuit_roaring_andnot_inplace(cidx->pos_idx[ch].entries[j].bitmap, records_to_delete);
-                        for (j = 0; j < cidx->neg_idx[ch].count; j++)
-                            biscuit_roaring_andnot_inplace(cidx->neg_idx[ch].entries[j].bitmap, records_to_delete);
-                        if (cidx->char_cache[ch])
-                            biscuit_roaring_andnot_inplace(cidx->char_cache[ch], records_to_delete);
-
-                        for (j = 0; j < cidx->pos_idx_lower[ch].count; j++)
-                            biscuit_roaring_andnot_inplace(cidx->pos_idx_lower[ch].entries[j].bitmap, records_to_delete);
-                        for (j = 0; j < cidx->neg_idx_lower[ch].count; j++)
-                            biscuit_roaring_andnot_inplace(cidx->neg_idx_lower[ch].entries[j].bitmap, records_to_delete);
-                        if (cidx->char_cache_lower[ch])
-                            biscuit_roaring_andnot_inplace(cidx->char_cache_lower[ch], records_to_delete);
-                    }
-
-                    /*
-                     * FIX 4: Was j <= cidx->max_length / j <= cidx->max_length_lower,
-                     * reading one slot past the end of the palloc'd arrays (valid
-                     * indices 0..max_length-1).  This caused the GPF in biscuit.so
-                     * at 15:05 on the first VACUUM after the earlier fixes, because
-                     * autovacuum hit this path before the extension was reloaded.
-                     */
-                    for (j = 0; j < cidx->max_length; j++)
-                    {
-                        if (cidx->length_bitmaps && cidx->length_bitmaps[j])
-                            biscuit_roaring_andnot_inplace(cidx->length_bitmaps[j], records_to_delete);
-                        if (cidx->length_ge_bitmaps && cidx->length_ge_bitmaps[j])
-                            biscuit_roaring_andnot_inplace(cidx->length_ge_bitmaps[j], records_to_delete);
-                    }
-                    for (j = 0; j < cidx->max_length_lower; j++)
-                    {
-                        if (cidx->length_bitmaps_lower && cidx->length_bitmaps_lower[j])
-                            biscuit_roaring_andnot_inplace(cidx->length_bitmaps_lower[j], records_to_delete);
-                        if (cidx->length_ge_bitmaps_lower && cidx->length_ge_bitmaps_lower[j])
-                            biscuit_roaring_andnot_inplace(cidx->length_ge_bitmaps_lower[j], records_to_delete);
-                    }
-                }
-
                 for (j = 0; j < (int) delete_count; j++)
                     for (col = 0; col < idx->num_columns; col++)
                     {
-                        if (idx->column_data_cache[col][delete_indices[j]])
-                        {
-                            pfree(idx->column_data_cache[col][delete_indices[j]]);
-                            idx->column_data_cache[col][delete_indices[j]] = NULL;
-                        }
-                        if (idx->column_data_cache_lower &&
-                            idx->column_data_cache_lower[col][delete_indices[j]])
-                        {
-                            pfree(idx->column_data_cache_lower[col][delete_indices[j]]);
+                        biscuit_arena_release(&idx->column_indices[col].strings,
+                                              idx->column_data_cache[col][delete_indices[j]],
+                                              idx->column_data_cache_lower ?
+                                              idx->column_data_cache_lower[col][delete_indices[j]] : NULL);
+                        idx->column_data_cache[col][delete_indices[j]] = NULL;
+                        if (idx->column_data_cache_lower)
                             idx->column_data_cache_lower[col][delete_indices[j]] = NULL;
-                        }
                     }
+
+                /* Drop the deleted values from the arenas once enough have gone */
+                for (col = 0; col < idx->num_columns; col++)
+                    biscuit_arena_compact(&idx->column_indices[col].strings,
+                                          idx->column_data_cache[col],
+                                          idx->column_data_cache_lower ?
+                                          idx->column_data_cache_lower[col] : NULL,
+                                          idx->num_records);
             }
 
             pfree(delete_indices);
@@ -1618,19 +1936,14 @@ biscuit_bulkdelete(IndexVacuumInfo *info,
 
     biscuit_roaring_free(records_to_delete);
 
-    /* BEFORE clearing tombstones, purge stale bitmap data for
-    * tombstoned slots that were never reused (still on free_list). */
-    if (idx->tombstone_count >= TOMBSTONE_CLEANUP_THRESHOLD)
+    /*
+     * Tombstoned slots still on the free list were cleared from the
+     * bitmaps when they were deleted; once enough accumulate, purge any
+     * stale bits they left with one more ANDNOT per bitmap and forget them.
+     */
+    if (!view && idx->tombstone_count >= TOMBSTONE_CLEANUP_THRESHOLD)
     {
-        uint64_t  ts_count;
-        uint32_t *ts_slots = biscuit_roaring_to_array(idx->tombstones, &ts_count);
-        if (ts_slots)
-        {
-            uint64_t k;
-            for (k = 0; k < ts_count; k++)
-                biscuit_remove_from_all_indices(idx, ts_slots[k]);
-            pfree(ts_slots);
-        }
+        biscuit_remove_set_from_all_indices(idx, idx->tombstones);
         biscuit_roaring_free(idx->tombstones);
         idx->tombstones      = biscuit_roaring_create();
         idx->tombstone_count = 0;
@@ -1638,32 +1951,351 @@ biscuit_bulkdelete(IndexVacuumInfo *info,
 
     MemoryContextSwitchTo(oldcontext);
 
-    stats->num_pages   = 1;
+    return ndeleted;
+}
+
+IndexBulkDeleteResult *
+biscuit_bulkdelete(IndexVacuumInfo *info,
+                   IndexBulkDeleteResult *stats,
+                   IndexBulkDeleteCallback callback,
+                   void *callback_state)
+{
+    Relation         index = info->index;
+    BiscuitIndex    *idx;
+    ItemPointerData *deleted;
+    int64            ndeleted;
+
+    idx = biscuit_changelog_lookup(index);
+    if (!idx) { idx = biscuit_load_index(index); }
+    if (BiscuitIndexIsShared(idx))
+        biscuit_shared_open_delta(idx);
+
+    if (!stats)
+        stats = (IndexBulkDeleteResult *) palloc0(sizeof(IndexBulkDeleteResult));
+
+    ndeleted = biscuit_delete_records(index, idx, callback, callback_state, true, &deleted);
+    stats->tuples_removed += ndeleted;
+
+    /* Other backends remove the same TIDs when they replay the log */
+    if (ndeleted > 0)
+        biscuit_changelog_delete(index, idx, deleted, ndeleted);
+    pfree(deleted);
+
+    stats->num_pages   = RelationGetNumberOfBlocks(index);
     stats->pages_deleted = 0;
     stats->pages_free  = 0;
 
     return stats;
 }
 
+/*
+ * Compaction.  Deleted slots stay on the free list until an insert reuses
+ * them, so after a large delete every bitmap, cache and TID array still
+ * spans the old record range and NOT LIKE pays for the holes.  When the
+ * free slots reach a tenth of the records, or inserts out of heap order
+ * broke idx->heap_ordered, the live records are renumbered densely in
+ * heap (TID) order, and every bitmap is rewritten through the old -> new
+ * map and run-optimized.
+ */
+#define BISCUIT_COMPACT_DROPPED  UINT32_MAX
+
+typedef struct BiscuitCompactMap
+{
+    const uint32_t *map;        /* old record -> new, or DROPPED */
+    uint32_t        old_records;
+    bool            monotonic;  /* the map keeps the record order */
+} BiscuitCompactMap;
+
+static int
+biscuit_compact_rec_cmp(const void *a, const void *b)
+{
+    uint32_t ra = *(const uint32_t *) a;
+    uint32_t rb = *(const uint32_t *) b;
+
+    return (ra > rb) - (ra < rb);
+}
+
+/* Heap order of two records, ties in record order so the sort is stable */
+static int
+biscuit_compact_tid_cmp(const void *a, const void *b, void *arg)
+{
+    const ItemPointerData *tids = (const ItemPointerData *) arg;
+    uint32_t               ra   = *(const uint32_t *) a;
+    uint32_t               rb   = *(const uint32_t *) b;
+    int                    c;
+
+    c = ItemPointerCompare((ItemPointer) &tids[ra], (ItemPointer) &tids[rb]);
+    if (c != 0)
+        return c;
+    return biscuit_compact_rec_cmp(a, b);
+}
+
+static void
+biscuit_compact_visit(RoaringBitmap **bitmap, void *arg)
+{
+    const BiscuitCompactMap *cm = (const BiscuitCompactMap *) arg;
+    RoaringBitmap           *out = biscuit_roaring_create();
+    uint32_t                *recs;
+    uint64_t                 count;
+    uint64_t                 i;
+    uint64_t                 n = 0;
+
+    recs = biscuit_roaring_to_array(*bitmap, &count);
+    for (i = 0; recs && i < count; i++)
+        if (recs[i] < cm->old_records && cm->map[recs[i]] != BISCUIT_COMPACT_DROPPED)
+            recs[n++] = cm->map[recs[i]];
+
+    /* A monotonic map keeps recs sorted; a reordering one does not */
+    if (!cm->monotonic && n > 1)
+        qsort(recs, n, sizeof(uint32_t), biscuit_compact_rec_cmp);
+    if (n > 0)
+        biscuit_roaring_add_many(out, recs, n);
+    biscuit_roaring_optimize(out);
+
+    if (recs)
+        pfree(recs);
+    biscuit_roaring_free(*bitmap);
+    *bitmap = out;
+}
+
+/* dst[map[i]] = src[i] for the kept records of an array of pointers */
+static void
+biscuit_compact_move(char **array, const uint32_t *map, int old_records, int live, char **scratch)
+{
+    int i;
+
+    memcpy(scratch, array, (Size) old_records * sizeof(char *));
+    for (i = 0; i < old_records; i++)
+        if (map[i] != BISCUIT_COMPACT_DROPPED)
+            array[map[i]] = scratch[i];
+
+    /* Slots past the end are NULL, as in a freshly grown cache */
+    for (i = live; i < old_records; i++)
+        array[i] = NULL;
+}
+
+bool
+biscuit_compact(BiscuitIndex *idx)
+{
+    MemoryContext     oldcontext;
+    BiscuitCompactMap cm;
+    ItemPointerData  *old_tids;
+    uint32_t         *map;
+    uint32_t         *order;
+    char            **scratch;
+    int               old_records = idx->num_records;
+    int               live = 0;
+    int               i, col;
+
+    if (BiscuitIndexIsShared(idx) || idx->preload_state < BISCUIT_PRELOAD_DONE ||
+        old_records == 0)
+        return false;
+    if (idx->heap_ordered &&
+        (idx->free_count == 0 || idx->free_count < old_records / 10))
+        return false;
+
+    /* Pending records must be in the bitmaps to be renumbered with them */
+    biscuit_pending_flush(idx);
+
+    oldcontext = MemoryContextSwitchTo(BiscuitIndexMemoryContext(idx));
+
+    map = (uint32_t *) biscuit_palloc0_huge((Size) old_records * sizeof(uint32_t));
+    for (i = 0; i < idx->free_count; i++)
+        if (idx->free_list[i] < (uint32_t) old_records)
+            map[idx->free_list[i]] = BISCUIT_COMPACT_DROPPED;
+
+    /* The live records, then in heap order unless they already are */
+    order = (uint32_t *) biscuit_palloc_huge((Size) old_records * sizeof(uint32_t));
+    for (i = 0; i < old_records; i++)
+        if (map[i] != BISCUIT_COMPACT_DROPPED)
+            order[live++] = (uint32_t) i;
+    if (!idx->heap_ordered)
+        qsort_arg(order, live, sizeof(uint32_t), biscuit_compact_tid_cmp, idx->tids);
+    for (i = 0; i < live; i++)
+        map[order[i]] = (uint32_t) i;
+
+    old_tids = (ItemPointerData *) biscuit_palloc_huge((Size) old_records * sizeof(ItemPointerData));
+    memcpy(old_tids, idx->tids, (Size) old_records * sizeof(ItemPointerData));
+    for (i = 0; i < live; i++)
+        idx->tids[i] = old_tids[order[i]];
+
+    scratch = (char **) biscuit_palloc_huge((Size) old_records * sizeof(char *));
+    if (idx->num_columns == 1)
+    {
+        biscuit_compact_move(idx->data_cache, map, old_records, live, scratch);
+        if (idx->data_cache_lower)
+            biscuit_compact_move(idx->data_cache_lower, map, old_records, live, scratch);
+    }
+    else
+    {
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            biscuit_compact_move(idx->column_data_cache[col], map, old_records, live, scratch);
+            if (idx->column_data_cache_lower)
+                biscuit_compact_move(idx->column_data_cache_lower[col], map, old_records, live,
+                                     scratch);
+        }
+    }
+
+    cm.map         = map;
+    cm.old_records = (uint32_t) old_records;
+    cm.monotonic   = idx->heap_ordered;
+    biscuit_visit_bitmaps(idx, true, biscuit_compact_visit, &cm);
+
+    /* Every tombstone was a free slot; both are gone now */
+    biscuit_roaring_free(idx->tombstones);
+    idx->tombstones      = biscuit_roaring_create();
+    idx->tombstone_count = 0;
+    idx->free_count      = 0;
+    idx->num_records     = live;
+    idx->heap_ordered    = true;
+
+    pfree(scratch);
+    pfree(old_tids);
+    pfree(order);
+    pfree(map);
+    MemoryContextSwitchTo(oldcontext);
+
+    /* Cached results and parallel scan peers name records by their old numbers */
+    biscuit_result_cache_invalidate(idx);
+    biscuit_changelog_diverge(idx);
+
+    elog(DEBUG1, "Biscuit: compacted %d records to %d%s", old_records, live,
+         cm.monotonic ? "" : " in heap order");
+    return true;
+}
+
 /* ================================================================
  * SECTION 6 – Remaining AM callbacks
  * ================================================================ */
 
+/*
+ * Write the on-disk snapshot back once VACUUM is done with the index.
+ * The copy in this backend is compacted when deletes left enough holes,
+ * and persisted when it owns the current epoch (it was built or loaded
+ * here and every change since went through it); otherwise the index is
+ * rebuilt from the heap first.
+ */
 IndexBulkDeleteResult *
 biscuit_vacuumcleanup(IndexVacuumInfo *info, IndexBulkDeleteResult *stats)
 {
-    (void) info;
+    Relation      index = info->index;
+    BiscuitIndex *idx;
+
+    if (info->analyze_only)
+        return stats;
+
+    if (!biscuit_storage_is_valid(index))
+    {
+        /* The snapshot takes the pending list, which a view cannot merge */
+        idx = biscuit_changelog_lookup(index);
+        if (idx && BiscuitIndexIsShared(idx))
+            idx = biscuit_private_copy(index, idx);
+        if (idx)
+            biscuit_compact(idx);
+        if (!idx || !biscuit_storage_persist(index, idx))
+        {
+            idx = biscuit_load_index(index);
+            if (BiscuitIndexIsShared(idx))
+                idx = biscuit_private_copy(index, idx);
+            biscuit_storage_persist(index, idx);
+        }
+    }
+
+    if (stats)
+        stats->num_pages = RelationGetNumberOfBlocks(index);
+
     return stats;
 }
 
 bool
 biscuit_canreturn(Relation index, int attno)
 {
-    (void) index;
+    BiscuitOptions options;
+
     (void) attno;
-    return false;
+
+    /* Index-only scans rebuild the values from the string caches */
+    biscuit_index_options(index, &options);
+    return options.store_strings;
+}
+
+/*
+ * Selectivity of one index qual from the metapage statistics, or the
+ * planner's generic estimate when the pattern is not a constant or the
+ * column is not covered.  *nops accumulates the bitmap operations the
+ * qual will cost at scan time (about one per pattern byte), *nverify the
+ * strings it will match one by one where the index's options leave the
+ * pattern unindexed.  A pattern left to the executor selects everything.
+ */
+static Selectivity
+biscuit_clause_selectivity(PlannerInfo *root, IndexOptInfo *indexinfo,
+                           int indexcol, RestrictInfo *rinfo,
+                           const BiscuitStatsData *stats,
+                           const BiscuitOptions *options,
+                           double *nops, double *nverify)
+{
+    OpExpr *op = (OpExpr *) rinfo->clause;
+    Node   *arg;
+
+    if (stats && IsA(op, OpExpr) && list_length(op->args) == 2)
+    {
+        arg = (Node *) lsecond(op->args);
+        if (IsA(arg, RelabelType))
+            arg = (Node *) ((RelabelType *) arg)->arg;
+
+        if (IsA(arg, Const) && !((Const *) arg)->constisnull)
+        {
+            char        *pattern  = TextDatumGetCString(((Const *) arg)->constvalue);
+            int          strategy = get_op_opfamily_strategy(op->opno,
+                                                             indexinfo->opfamily[indexcol]);
+            Selectivity  sel;
+            int          support;
+
+            /*
+             * =, ^@ and regex quals cost what their LIKE pattern reads, see
+             * biscuit_keys.c
+             */
+            if (strategy > BISCUIT_NOT_ILIKE_STRATEGY)
+            {
+                bool  lossy;
+                char *like = biscuit_key_like_pattern(strategy, op->inputcollid,
+                                                      pattern, &lossy);
+
+                pfree(pattern);
+                pattern  = like;
+                strategy = biscuit_key_like_strategy(strategy);
+            }
+
+            support = biscuit_pattern_support(options,
+                                              strategy == BISCUIT_ILIKE_STRATEGY ||
+                                              strategy == BISCUIT_NOT_ILIKE_STRATEGY,
+                                              pattern);
+            *nops += strlen(pattern) + 1;
+            if (support == BISCUIT_SUPPORT_VERIFY)
+                *nverify += stats->live_records;
+            sel = (support == BISCUIT_SUPPORT_RECHECK)
+                ? 1.0
+                : biscuit_stats_selectivity(stats, indexcol, pattern, strategy);
+            pfree(pattern);
+            if (sel >= 0)
+                return sel;
+        }
+    }
+
+    *nops += 1;
+    return clause_selectivity(root, (Node *) rinfo, 0, JOIN_INNER, NULL);
 }
 
+/*
+ * The index is evaluated in memory: startup covers the bitmap operations
+ * of amrescan (each proportional to the number of roaring containers,
+ * one per 64K records, plus a constant), and each returned TID costs
+ * cpu_index_tuple_cost; strings matched one by one cost cpu_operator_cost
+ * each.  Selectivity comes from the statistics persisted
+ * on the metapage (biscuit_stats.c).  Indexes without them (never
+ * persisted, or built by an older version) keep the fixed 1% estimate.
+ */
 void
 biscuit_costestimate(PlannerInfo *root, IndexPath *path,
                     double loop_count,
@@ -1671,18 +2303,38 @@ biscuit_costestimate(PlannerInfo *root, IndexPath *path,
                     Selectivity *indexSelectivity,
                     double *indexCorrelation, double *indexPages)
 {
-    Relation    index    = (path->indexinfo->indexoid != InvalidOid)
-                           ? index_open(path->indexinfo->indexoid, AccessShareLock)
-                           : NULL;
-    BlockNumber numPages = 1;
+    IndexOptInfo     *indexinfo = path->indexinfo;
+    Relation          index     = (indexinfo->indexoid != InvalidOid)
+                                  ? index_open(indexinfo->indexoid, AccessShareLock)
+                                  : NULL;
+    BlockNumber       numPages  = 1;
+    BiscuitStatsData *stats     = NULL;
+    BiscuitOptions    options;
+    Selectivity       sel       = 1.0;
+    double            nops      = 0;
+    double            nverify   = 0;
+    double            ntuples;
+    ListCell         *lc;
 
-    (void) root;
     (void) loop_count;
 
     if (index)
     {
         numPages = RelationGetNumberOfBlocks(index);
         if (numPages == 0) numPages = 1;
+        biscuit_index_options(index, &options);
+
+        if (path->indexclauses != NIL)
+        {
+            stats = (BiscuitStatsData *) palloc(sizeof(BiscuitStatsData));
+            if (!biscuit_storage_read_stats(index, stats))
+            {
+                pfree(stats);
+                stats = NULL;
+            }
+        }
+        if (path->path.parallel_aware)
+            biscuit_parallel_note_path(index);
         index_close(index, AccessShareLock);
     }
 
@@ -1701,18 +2353,44 @@ biscuit_costestimate(PlannerInfo *root, IndexPath *path,
         return;
     }
 
-    *indexStartupCost  = 0.0;
-    *indexTotalCost    = 0.01 + (numPages * random_page_cost);
-    *indexSelectivity  = 0.01;
-    *indexCorrelation  = 1.0;
+    if (!stats)
+    {
+        *indexStartupCost  = 0.0;
+        *indexTotalCost    = 0.01 + (numPages * random_page_cost);
+        *indexSelectivity  = 0.01;
+        *indexCorrelation  = 1.0;
+        if (indexPages) *indexPages = numPages;
+        return;
+    }
+
+    /* Quals are ANDed; treat them as independent, like genericcostestimate */
+    foreach(lc, path->indexclauses)
+    {
+        IndexClause *iclause = lfirst_node(IndexClause, lc);
+        ListCell    *lc2;
+
+        foreach(lc2, iclause->indexquals)
+        {
+            RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc2);
+
+            sel *= biscuit_clause_selectivity(root, indexinfo, iclause->indexcol,
+                                              rinfo, stats, &options,
+                                              &nops, &nverify);
+        }
+    }
+    CLAMP_PROBABILITY(sel);
+
+    ntuples = clamp_row_est(sel * indexinfo->rel->tuples);
+
+    *indexStartupCost  = nops * cpu_operator_cost *
+                         (1.0 + stats->live_records / 65536.0) +
+                         nverify * cpu_operator_cost;
+    *indexTotalCost    = *indexStartupCost + ntuples * cpu_index_tuple_cost;
+    *indexSelectivity  = sel;
+    *indexCorrelation  = stats->correlation;
     if (indexPages) *indexPages = numPages;
-}
-bytea *
-biscuit_options(Datum reloptions, bool validate)
-{
-    (void) reloptions;
-    (void) validate;
-    return NULL;
+
+    pfree(stats);
 }
 
 bool
@@ -1732,3 +2410,78 @@ biscuit_adjustmembers(Oid opfamilyoid, Oid opclassoid,
     (void) operators;
     (void) functions;
 }
+
+/* ================================================================
+ * SECTION 7 – Index options
+ * ================================================================
+ *
+ * CREATE INDEX ... USING biscuit (col) WITH (ilike = off, ...) selects
+ * the bitmap families a build produces (BiscuitOptions).  Each is
+ * defaulted to what an index without options has always built.
+ * pending_list_limit governs inserts, not the build: it is read from the
+ * relation on every insert, so ALTER INDEX ... SET applies at once.
+ */
+
+static relopt_kind biscuit_relopt_kind;
+
+void
+biscuit_options_init(void)
+{
+    biscuit_relopt_kind = add_reloption_kind();
+
+    add_bool_reloption(biscuit_relopt_kind, "like",
+                       "Build the case-sensitive position bitmaps used by LIKE",
+                       true, AccessExclusiveLock);
+    add_bool_reloption(biscuit_relopt_kind, "ilike",
+                       "Build the lowercase mirror used by ILIKE",
+                       true, AccessExclusiveLock);
+    add_bool_reloption(biscuit_relopt_kind, "suffix_index",
+                       "Build the negative-position bitmaps used by suffix patterns",
+                       true, AccessExclusiveLock);
+    add_bool_reloption(biscuit_relopt_kind, "store_strings",
+                       "Keep the indexed values in memory for substring matching",
+                       true, AccessExclusiveLock);
+    add_bool_reloption(biscuit_relopt_kind, "trigrams",
+                       "Build trigram posting bitmaps to accelerate substring patterns",
+                       false, AccessExclusiveLock);
+    add_int_reloption(biscuit_relopt_kind, "max_indexed_chars",
+                      "Characters indexed from either end of a value (0 for all)",
+                      0, 0, INT_MAX, AccessExclusiveLock);
+    add_int_reloption(biscuit_relopt_kind, "pending_list_limit",
+                      "Pending list size in kB before it is merged (0 to index inserts directly)",
+                      -1, 0, MAX_KILOBYTES, ShareUpdateExclusiveLock);
+}
+
+void
+biscuit_index_options(Relation index, BiscuitOptions *options)
+{
+    if (index->rd_options)
+    {
+        memcpy(options, index->rd_options, sizeof(BiscuitOptions));
+        return;
+    }
+
+    memset(options, 0, sizeof(BiscuitOptions));
+    options->like          = true;
+    options->ilike         = true;
+    options->suffix_index  = true;
+    options->store_strings = true;
+    options->pending_list_limit = -1;
+}
+
+bytea *
+biscuit_options(Datum reloptions, bool validate)
+{
+    static const relopt_parse_elt tab[] = {
+        {"like", RELOPT_TYPE_BOOL, offsetof(BiscuitOptions, like)},
+        {"ilike", RELOPT_TYPE_BOOL, offsetof(BiscuitOptions, ilike)},
+        {"suffix_index", RELOPT_TYPE_BOOL, offsetof(BiscuitOptions, suffix_index)},
+        {"store_strings", RELOPT_TYPE_BOOL, offsetof(BiscuitOptions, store_strings)},
+        {"trigrams", RELOPT_TYPE_BOOL, offsetof(BiscuitOptions, trigrams)},
+        {"max_indexed_chars", RELOPT_TYPE_INT, offsetof(BiscuitOptions, max_indexed_chars)},
+        {"pending_list_limit", RELOPT_TYPE_INT, offsetof(BiscuitOptions, pending_list_limit)},
+    };
+
+    return (bytea *) build_reloptions(reloptions, validate, biscuit_relopt_kind,
+                                      sizeof(BiscuitOptions), tab, lengthof(tab));
+}
@@ -1,6 +1,7 @@
 /*
  * biscuit_index.h
- * Index build, load, disk serialization, and CRUD helper declarations.
+ * Index build, load, metapage access, and CRUD helper declarations.
+ * The persisted snapshot itself lives in biscuit_storage.h.
  */
 
 #ifndef BISCUIT_INDEX_H
@@ -11,7 +12,6 @@
 
 /* ==================== DISK I/O ==================== */
 
-extern void biscuit_write_metadata_to_disk(Relation index, BiscuitIndex *idx);
 extern bool biscuit_read_metadata_from_disk(Relation index,
                                             int *num_records,
                                             int *num_columns,
@@ -24,6 +24,11 @@ extern IndexBuildResult *biscuit_build(Relation heap,
                                        IndexInfo *indexInfo);
 extern void              biscuit_buildempty(Relation index);
 extern BiscuitIndex     *biscuit_load_index(Relation index);
+extern bool              biscuit_build_snapshot(Relation index);
+extern BiscuitIndex     *biscuit_build_partial(Relation heap,
+                                               Relation index,
+                                               IndexInfo *indexInfo,
+                                               ParallelTableScanDesc pscan);
 
 /* ==================== CRUD HELPERS ==================== */
 
@@ -31,12 +36,57 @@ extern void biscuit_init_crud_structures(BiscuitIndex *idx);
 extern void biscuit_push_free_slot(BiscuitIndex *idx, uint32_t slot);
 extern bool biscuit_pop_free_slot(BiscuitIndex *idx, uint32_t *slot);
 
+/*
+ * Room for n more records in the TID array and value caches (new cache
+ * slots are NULL).  ERRORs past BISCUIT_MAX_RECORDS.
+ */
+extern void biscuit_reserve_records(BiscuitIndex *idx, int64 n);
+
 /*
  * Remove a single record from every character/length bitmap in the index.
- * Used by bulkdelete and update paths.
+ * Used by the update path; bulkdelete removes its whole dead set at once.
  */
 extern void biscuit_remove_from_all_indices(BiscuitIndex *idx, uint32_t rec_idx);
 
+/*
+ * Index values / isnull under heap TID tid, in a private, fully built
+ * copy.  With check_existing a live record already holding tid is
+ * replaced (the update path); without, the caller knows there is none.
+ * Shared by aminsert and the replay of its change log entries.
+ */
+extern void biscuit_insert_record(Relation index, BiscuitIndex *idx,
+                                  Datum *values, bool *isnull,
+                                  ItemPointer tid, bool check_existing);
+
+/*
+ * Remove every live record whose TID callback accepts, as ambulkdelete
+ * does; returns how many.  With mark_dirty the snapshot is demoted first
+ * (replayed deletes are already accounted for).  With deleted != NULL the
+ * removed TIDs are returned in a palloc'd array.
+ */
+extern int64 biscuit_delete_records(Relation index, BiscuitIndex *idx,
+                                    IndexBulkDeleteCallback callback,
+                                    void *callback_state, bool mark_dirty,
+                                    ItemPointerData **deleted);
+
+/*
+ * Renumber the live records of a private copy densely and in heap order
+ * when enough slots are free or the order was broken; false if nothing
+ * was done.  Called by VACUUM and after a parallel build.
+ */
+extern bool biscuit_compact(BiscuitIndex *idx);
+
+/* Whether record rec holds a value (neither NULL nor removed) */
+extern bool biscuit_record_has_value(const BiscuitIndex *idx, uint32_t rec);
+
+/*
+ * Value of column col of record rec as (I)LIKE matches it, or NULL when
+ * there is none or the index keeps no strings.  *to_free is set when the
+ * lowercased form had to be computed.
+ */
+extern const char *biscuit_record_string(const BiscuitIndex *idx, int col, bool ilike,
+                                         uint32_t rec, int *len, char **to_free);
+
 /* ==================== AM CALLBACKS ==================== */
 
 extern bool biscuit_insert(Relation index,
@@ -67,6 +117,14 @@ extern void biscuit_costestimate(PlannerInfo *root,
                                  double *indexCorrelation,
                                  double *indexPages);
 
+/* ==================== INDEX OPTIONS ==================== */
+
+/* Register the WITH (...) options; called from _PG_init() */
+extern void   biscuit_options_init(void);
+
+/* The options of index, or the defaults when none are set */
+extern void   biscuit_index_options(Relation index, BiscuitOptions *options);
+
 extern bytea *biscuit_options(Datum reloptions, bool validate);
 extern bool   biscuit_validate(Oid opclassoid);
 extern void   biscuit_adjustmembers(Oid opfamilyoid, Oid opclassoid,
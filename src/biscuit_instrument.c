@@ -0,0 +1,415 @@
+/*
+ * biscuit_instrument.c
+ * Per-scan instrumentation and the cumulative per-index counters.
+ *
+ * Every scan keeps a BiscuitScanInstrument in its opaque state (see
+ * biscuit_common.h), summed over its rescans:
+ *
+ *   plan     biscuit_keys_rewrite() and the multi-column query plan
+ *   eval     bitmap evaluation of the keys, or the fallback walk of the
+ *            string caches while the bitmaps are not built yet; the in-
+ *            place AND / OR / ANDNOT operations it ran (biscuit_bitmap_ops)
+ *            and the largest key result or intersection it held
+ *   verify   candidates matched against the strings directly, and how
+ *            many of them survived
+ *   collect  TID collection: sorting, streaming, the TIDBitmap
+ *
+ * Times are taken only with biscuit.track_scan_timing (two clock reads
+ * per phase and rescan, not per row); the counts are always kept.
+ *
+ * EXPLAIN ANALYZE shows them under each Biscuit index node (PostgreSQL
+ * 18+, through explain_per_node_hook; earlier releases have no hook for
+ * it).  Parallel workers' scans are not in the leader's node, but they
+ * are in the shared counters.
+ *
+ * At endscan the scan is added to its index's entry in a shared hash
+ * table keyed by (database, index OID), which biscuit_stat_indexes
+ * reads.  The table needs biscuit in shared_preload_libraries and holds
+ * biscuit.stat_max_indexes entries; scans of indexes beyond that are not
+ * counted.  biscuit_stat_reset() empties it for the current database.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_instrument.h"
+#include "biscuit_scan.h"
+
+#include "storage/spin.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+
+#if PG_VERSION_NUM >= 180000
+#include "commands/explain.h"
+#include "commands/explain_format.h"
+#include "commands/explain_state.h"
+#endif
+
+/* ================================================================
+ * SECTION 1 – Types and state
+ * ================================================================ */
+
+bool biscuit_track_scan_timing = true;
+int  biscuit_stat_max_indexes  = 1024;
+
+typedef struct BiscuitStatKey
+{
+    Oid         dboid;
+    Oid         indexoid;
+} BiscuitStatKey;
+
+typedef struct BiscuitStatEntry
+{
+    BiscuitStatKey      key;
+    slock_t             mutex;      /* protects counters */
+    BiscuitStatCounters counters;
+} BiscuitStatEntry;
+
+static HTAB   *biscuit_stat_htab = NULL;
+static LWLock *biscuit_stat_lock = NULL;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+#if PG_VERSION_NUM >= 180000
+static explain_per_node_hook_type prev_explain_per_node_hook = NULL;
+#endif
+
+/* ================================================================
+ * SECTION 2 – Shared memory setup
+ * ================================================================ */
+
+static Size
+biscuit_stat_shmem_size(void)
+{
+    return hash_estimate_size(biscuit_stat_max_indexes, sizeof(BiscuitStatEntry));
+}
+
+static void
+biscuit_stat_shmem_request(void)
+{
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+    RequestAddinShmemSpace(biscuit_stat_shmem_size());
+    RequestNamedLWLockTranche("biscuit_stat", 1);
+}
+
+static void
+biscuit_stat_shmem_startup(void)
+{
+    HASHCTL info;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    memset(&info, 0, sizeof(info));
+    info.keysize   = sizeof(BiscuitStatKey);
+    info.entrysize = sizeof(BiscuitStatEntry);
+    biscuit_stat_htab = ShmemInitHash("biscuit scan statistics",
+                                      biscuit_stat_max_indexes,
+                                      biscuit_stat_max_indexes,
+                                      &info, HASH_ELEM | HASH_BLOBS);
+
+    biscuit_stat_lock = &(GetNamedLWLockTranche("biscuit_stat"))->lock;
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+/* ================================================================
+ * SECTION 3 – EXPLAIN
+ * ================================================================ */
+
+#if PG_VERSION_NUM >= 180000
+
+static void
+biscuit_instrument_explain(const BiscuitScanInstrument *instr, ExplainState *es)
+{
+    bool timing = es->timing && biscuit_track_scan_timing;
+
+    if (es->format == EXPLAIN_FORMAT_TEXT)
+    {
+        ExplainIndentText(es);
+        appendStringInfo(es->str,
+                         "Biscuit: rescans=" INT64_FORMAT " fallback=" INT64_FORMAT
+                         " bitmap ops=" INT64_FORMAT " max cardinality=" INT64_FORMAT
+                         " tids=" INT64_FORMAT " sorted=" INT64_FORMAT "\n",
+                         instr->rescans, instr->fallback_rescans, instr->bitmap_ops,
+                         instr->max_cardinality, instr->tids, instr->sorted_rescans);
+        if (instr->verify_checked > 0)
+        {
+            ExplainIndentText(es);
+            appendStringInfo(es->str,
+                             "Biscuit Verify: checked=" INT64_FORMAT " matched=" INT64_FORMAT "\n",
+                             instr->verify_checked, instr->verify_matched);
+        }
+        if (timing)
+        {
+            ExplainIndentText(es);
+            appendStringInfo(es->str,
+                             "Biscuit Timing: plan=%.3f eval=%.3f verify=%.3f collect=%.3f\n",
+                             INSTR_TIME_GET_MILLISEC(instr->plan_time),
+                             INSTR_TIME_GET_MILLISEC(instr->eval_time),
+                             INSTR_TIME_GET_MILLISEC(instr->verify_time),
+                             INSTR_TIME_GET_MILLISEC(instr->collect_time));
+        }
+        return;
+    }
+
+    ExplainPropertyInteger("Biscuit Rescans", NULL, instr->rescans, es);
+    ExplainPropertyInteger("Biscuit Fallback Rescans", NULL, instr->fallback_rescans, es);
+    ExplainPropertyInteger("Biscuit Bitmap Ops", NULL, instr->bitmap_ops, es);
+    ExplainPropertyInteger("Biscuit Max Cardinality", NULL, instr->max_cardinality, es);
+    ExplainPropertyInteger("Biscuit TIDs", NULL, instr->tids, es);
+    ExplainPropertyInteger("Biscuit Sorted Rescans", NULL, instr->sorted_rescans, es);
+    ExplainPropertyInteger("Biscuit Verify Checked", NULL, instr->verify_checked, es);
+    ExplainPropertyInteger("Biscuit Verify Matched", NULL, instr->verify_matched, es);
+    if (timing)
+    {
+        ExplainPropertyFloat("Biscuit Plan Time", "ms",
+                             INSTR_TIME_GET_MILLISEC(instr->plan_time), 3, es);
+        ExplainPropertyFloat("Biscuit Eval Time", "ms",
+                             INSTR_TIME_GET_MILLISEC(instr->eval_time), 3, es);
+        ExplainPropertyFloat("Biscuit Verify Time", "ms",
+                             INSTR_TIME_GET_MILLISEC(instr->verify_time), 3, es);
+        ExplainPropertyFloat("Biscuit Collect Time", "ms",
+                             INSTR_TIME_GET_MILLISEC(instr->collect_time), 3, es);
+    }
+}
+
+/* The scan of a Biscuit index behind an index or bitmap index scan node */
+static void
+biscuit_explain_per_node(PlanState *planstate, List *ancestors,
+                         const char *relationship, const char *plan_name,
+                         ExplainState *es)
+{
+    IndexScanDesc scan;
+
+    if (prev_explain_per_node_hook)
+        prev_explain_per_node_hook(planstate, ancestors, relationship, plan_name, es);
+
+    if (!es->analyze)
+        return;
+
+    switch (nodeTag(planstate))
+    {
+        case T_IndexScanState:
+            scan = ((IndexScanState *) planstate)->iss_ScanDesc;
+            break;
+        case T_IndexOnlyScanState:
+            scan = ((IndexOnlyScanState *) planstate)->ioss_ScanDesc;
+            break;
+        case T_BitmapIndexScanState:
+            scan = ((BitmapIndexScanState *) planstate)->biss_ScanDesc;
+            break;
+        default:
+            return;
+    }
+
+    if (!scan || !scan->opaque ||
+        scan->indexRelation->rd_indam->amrescan != biscuit_rescan)
+        return;
+
+    biscuit_instrument_explain(&((BiscuitScanOpaque *) scan->opaque)->instr, es);
+}
+
+#endif /* PG_VERSION_NUM >= 180000 */
+
+/* ================================================================
+ * SECTION 4 – Initialisation
+ * ================================================================ */
+
+void
+biscuit_instrument_init(void)
+{
+    DefineCustomBoolVariable("biscuit.track_scan_timing",
+                             "Time the phases of Biscuit index scans.",
+                             "Shown by EXPLAIN ANALYZE and summed in biscuit_stat_indexes.",
+                             &biscuit_track_scan_timing,
+                             true,
+                             PGC_SUSET,
+                             0,
+                             NULL, NULL, NULL);
+
+    DefineCustomIntVariable("biscuit.stat_max_indexes",
+                            "Number of Biscuit indexes the shared scan statistics are kept for.",
+                            NULL,
+                            &biscuit_stat_max_indexes,
+                            1024, 16, 1000000,
+                            PGC_POSTMASTER,
+                            0,
+                            NULL, NULL, NULL);
+
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook      = biscuit_stat_shmem_request;
+
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook      = biscuit_stat_shmem_startup;
+
+#if PG_VERSION_NUM >= 180000
+    prev_explain_per_node_hook = explain_per_node_hook;
+    explain_per_node_hook      = biscuit_explain_per_node;
+#endif
+}
+
+/* ================================================================
+ * SECTION 5 – Counters
+ * ================================================================ */
+
+void
+biscuit_instrument_cardinality(BiscuitScanInstrument *instr, const RoaringBitmap *bm)
+{
+    int64 n;
+
+    if (!bm)
+        return;
+    n = (int64) biscuit_roaring_count(bm);
+    if (n > instr->max_cardinality)
+        instr->max_cardinality = n;
+}
+
+void
+biscuit_instrument_report(Oid indexoid, const BiscuitScanInstrument *instr)
+{
+    BiscuitStatKey    key;
+    BiscuitStatEntry *entry;
+    bool              found;
+
+    if (!biscuit_stat_htab || instr->rescans == 0)
+        return;
+
+    key.dboid    = MyDatabaseId;
+    key.indexoid = indexoid;
+
+    LWLockAcquire(biscuit_stat_lock, LW_SHARED);
+    entry = (BiscuitStatEntry *) hash_search(biscuit_stat_htab, &key, HASH_FIND, NULL);
+    if (!entry)
+    {
+        LWLockRelease(biscuit_stat_lock);
+        LWLockAcquire(biscuit_stat_lock, LW_EXCLUSIVE);
+        entry = (BiscuitStatEntry *) hash_search(biscuit_stat_htab, &key,
+                                                 HASH_ENTER_NULL, &found);
+        if (!entry)
+        {
+            /* Table full: this index is not counted */
+            LWLockRelease(biscuit_stat_lock);
+            return;
+        }
+        if (!found)
+        {
+            SpinLockInit(&entry->mutex);
+            memset(&entry->counters, 0, sizeof(entry->counters));
+        }
+    }
+
+    SpinLockAcquire(&entry->mutex);
+    entry->counters.scans++;
+    entry->counters.rescans          += instr->rescans;
+    entry->counters.fallback_rescans += instr->fallback_rescans;
+    entry->counters.bitmap_ops       += instr->bitmap_ops;
+    entry->counters.max_cardinality   = Max(entry->counters.max_cardinality,
+                                            instr->max_cardinality);
+    entry->counters.verify_checked   += instr->verify_checked;
+    entry->counters.verify_matched   += instr->verify_matched;
+    entry->counters.tids             += instr->tids;
+    entry->counters.sorted_rescans   += instr->sorted_rescans;
+    entry->counters.plan_ms          += INSTR_TIME_GET_MILLISEC(instr->plan_time);
+    entry->counters.eval_ms          += INSTR_TIME_GET_MILLISEC(instr->eval_time);
+    entry->counters.verify_ms        += INSTR_TIME_GET_MILLISEC(instr->verify_time);
+    entry->counters.collect_ms       += INSTR_TIME_GET_MILLISEC(instr->collect_time);
+    SpinLockRelease(&entry->mutex);
+
+    LWLockRelease(biscuit_stat_lock);
+}
+
+BiscuitStatCounters *
+biscuit_instrument_collect(Oid **indexoids, int *count)
+{
+    BiscuitStatCounters *counters;
+    HASH_SEQ_STATUS      status;
+    BiscuitStatEntry    *entry;
+    long                 capacity;
+    int                  n = 0;
+
+    *indexoids = NULL;
+    *count     = 0;
+    if (!biscuit_stat_htab)
+        return NULL;
+
+    LWLockAcquire(biscuit_stat_lock, LW_SHARED);
+
+    capacity   = Max(hash_get_num_entries(biscuit_stat_htab), 1);
+    counters   = (BiscuitStatCounters *) palloc(capacity * sizeof(BiscuitStatCounters));
+    *indexoids = (Oid *) palloc(capacity * sizeof(Oid));
+
+    hash_seq_init(&status, biscuit_stat_htab);
+    while ((entry = (BiscuitStatEntry *) hash_seq_search(&status)) != NULL)
+    {
+        if (entry->key.dboid != MyDatabaseId)
+            continue;
+
+        SpinLockAcquire(&entry->mutex);
+        counters[n] = entry->counters;
+        SpinLockRelease(&entry->mutex);
+        (*indexoids)[n] = entry->key.indexoid;
+        n++;
+    }
+
+    LWLockRelease(biscuit_stat_lock);
+
+    *count = n;
+    return counters;
+}
+
+BiscuitStatUsage *
+biscuit_instrument_usage(int *count)
+{
+    BiscuitStatUsage *usage;
+    HASH_SEQ_STATUS   status;
+    BiscuitStatEntry *entry;
+    int               n = 0;
+
+    *count = 0;
+    if (!biscuit_stat_htab)
+        return NULL;
+
+    LWLockAcquire(biscuit_stat_lock, LW_SHARED);
+
+    usage = (BiscuitStatUsage *)
+        palloc(Max(hash_get_num_entries(biscuit_stat_htab), 1) * sizeof(BiscuitStatUsage));
+
+    hash_seq_init(&status, biscuit_stat_htab);
+    while ((entry = (BiscuitStatEntry *) hash_seq_search(&status)) != NULL)
+    {
+        usage[n].dboid    = entry->key.dboid;
+        usage[n].indexoid = entry->key.indexoid;
+        SpinLockAcquire(&entry->mutex);
+        usage[n].scans    = entry->counters.scans;
+        SpinLockRelease(&entry->mutex);
+        n++;
+    }
+
+    LWLockRelease(biscuit_stat_lock);
+
+    *count = n;
+    return usage;
+}
+
+void
+biscuit_instrument_reset(void)
+{
+    HASH_SEQ_STATUS   status;
+    BiscuitStatEntry *entry;
+
+    if (!biscuit_stat_htab)
+        return;
+
+    LWLockAcquire(biscuit_stat_lock, LW_EXCLUSIVE);
+    hash_seq_init(&status, biscuit_stat_htab);
+    while ((entry = (BiscuitStatEntry *) hash_seq_search(&status)) != NULL)
+    {
+        if (entry->key.dboid == MyDatabaseId)
+            hash_search(biscuit_stat_htab, &entry->key, HASH_REMOVE, NULL);
+    }
+    LWLockRelease(biscuit_stat_lock);
+}
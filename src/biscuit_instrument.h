@@ -0,0 +1,89 @@
+/*
+ * biscuit_instrument.h
+ * Per-scan instrumentation: what each scan spent its time on, shown by
+ * EXPLAIN ANALYZE and accumulated per index in shared memory for the
+ * biscuit_stat_indexes view.
+ */
+
+#ifndef BISCUIT_INSTRUMENT_H
+#define BISCUIT_INSTRUMENT_H
+
+#include "biscuit_common.h"
+
+/* biscuit.track_scan_timing: time the phases of every scan */
+extern bool biscuit_track_scan_timing;
+
+/* biscuit.stat_max_indexes: indexes the shared counters are sized for */
+extern int  biscuit_stat_max_indexes;
+
+/* Register the GUCs, the shared-memory hooks and the EXPLAIN hook */
+extern void biscuit_instrument_init(void);
+
+/*
+ * Phase timing for a BiscuitScanInstrument field: start with
+ * BISCUIT_INSTR_START(start), add the time since to field with
+ * BISCUIT_INSTR_STOP.  Both do nothing without biscuit.track_scan_timing.
+ */
+#define BISCUIT_INSTR_START(start) \
+    do { \
+        if (biscuit_track_scan_timing) \
+            INSTR_TIME_SET_CURRENT(start); \
+    } while (0)
+
+#define BISCUIT_INSTR_STOP(field, start) \
+    do { \
+        if (biscuit_track_scan_timing) \
+        { \
+            instr_time _biscuit_end; \
+            INSTR_TIME_SET_CURRENT(_biscuit_end); \
+            INSTR_TIME_ACCUM_DIFF(field, _biscuit_end, start); \
+        } \
+    } while (0)
+
+/* Note an intermediate result of the scan, for max_cardinality */
+extern void biscuit_instrument_cardinality(BiscuitScanInstrument *instr,
+                                           const RoaringBitmap *bm);
+
+/* Add a finished scan of indexoid to the shared counters */
+extern void biscuit_instrument_report(Oid indexoid, const BiscuitScanInstrument *instr);
+
+/* Cumulative counters of one index, as biscuit_stat_indexes shows them */
+typedef struct BiscuitStatCounters
+{
+    int64       scans;
+    int64       rescans;
+    int64       fallback_rescans;
+    int64       bitmap_ops;
+    int64       max_cardinality;
+    int64       verify_checked;
+    int64       verify_matched;
+    int64       tids;
+    int64       sorted_rescans;
+    double      plan_ms;
+    double      eval_ms;
+    double      verify_ms;
+    double      collect_ms;
+} BiscuitStatCounters;
+
+/*
+ * The counters of every index of the current database, palloc'd; *count
+ * entries, their OIDs in *indexoids.  Nothing without biscuit in
+ * shared_preload_libraries.
+ */
+extern BiscuitStatCounters *biscuit_instrument_collect(Oid **indexoids, int *count);
+
+/* Forget the counters of every index of the current database */
+extern void biscuit_instrument_reset(void);
+
+/* How often an index was scanned, in any database (biscuit_prewarm.c) */
+typedef struct BiscuitStatUsage
+{
+    Oid         dboid;
+    Oid         indexoid;
+    int64       scans;
+} BiscuitStatUsage;
+
+/* Every index with counters, palloc'd; *count entries */
+extern BiscuitStatUsage *biscuit_instrument_usage(int *count);
+
+#endif /* BISCUIT_INSTRUMENT_H */
@@ -0,0 +1,236 @@
+/*
+ * biscuit_keys.c
+ * Scan key rewriting.
+ *
+ * The bitmap queries, the result cache and the skeleton fallback all
+ * evaluate LIKE / ILIKE patterns.  The other strategies of the opclass
+ * are rewritten into such keys once per rescan, before any of them runs:
+ *
+ *   =  (7)        the escaped value:  'abc'  ->  LIKE 'abc'
+ *   ^@ (8)        the escaped prefix: 'abc'  ->  LIKE 'abc%'
+ *   ~, ~* (5, 6)  the LIKE / ILIKE prefilter of biscuit_regex.c (lossy)
+ *
+ * These go through the same exact and prefix fast paths as LIKE does
+ * (position 0 and the length bitmaps).  Under a nondeterministic
+ * collation equal strings may differ in their bytes, so = and ^@ then
+ * take every value and leave the answer to the recheck.
+ *
+ * Array keys (amsearcharray: = ANY, LIKE ANY, ^@ ANY, ~ ANY ...) keep one
+ * key whose argument becomes the text[] of their LIKE patterns, and the
+ * scan ORs the patterns' results inside a single rescan instead of
+ * running one index scan per element.  NULL elements match nothing.  A
+ * negated array key (NOT LIKE ANY) holds for any value that differs from
+ * one of the patterns, which the bitmaps do not answer; it takes every
+ * value and is rechecked.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_keys.h"
+#include "biscuit_like.h"
+#include "biscuit_regex.h"
+
+#include "utils/array.h"
+
+int
+biscuit_key_like_strategy(int strategy)
+{
+    switch (strategy)
+    {
+        case BISCUIT_REGEX_STRATEGY:
+        case BISCUIT_EQUAL_STRATEGY:
+        case BISCUIT_PREFIX_STRATEGY:
+            return BISCUIT_LIKE_STRATEGY;
+        case BISCUIT_IREGEX_STRATEGY:
+            return BISCUIT_ILIKE_STRATEGY;
+        default:
+            return strategy;
+    }
+}
+
+char *
+biscuit_key_like_pattern(int strategy, Oid collation, const char *arg, bool *lossy)
+{
+    char *pattern;
+
+    *lossy = false;
+
+    switch (strategy)
+    {
+        case BISCUIT_REGEX_STRATEGY:
+        case BISCUIT_IREGEX_STRATEGY:
+            *lossy = true;
+            return biscuit_regex_to_like(arg);
+
+        case BISCUIT_EQUAL_STRATEGY:
+        case BISCUIT_PREFIX_STRATEGY:
+            if (OidIsValid(collation) && !get_collation_isdeterministic(collation))
+            {
+                *lossy = true;
+                return pstrdup("%");
+            }
+            pattern = biscuit_like_escape(arg, strlen(arg));
+            if (strategy == BISCUIT_PREFIX_STRATEGY)
+                strcat(pattern, "%");
+            return pattern;
+
+        default:
+            return pstrdup(arg);
+    }
+}
+
+/* Rewrite an array key into the text[] of its patterns (a scalar for one) */
+static void
+biscuit_keys_rewrite_array(ScanKey key, bool *lossy)
+{
+    ArrayType *array = DatumGetArrayTypeP(key->sk_argument);
+    bool       is_not = (key->sk_strategy == BISCUIT_NOT_LIKE_STRATEGY ||
+                         key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
+    Datum     *elems;
+    bool      *nulls;
+    Datum     *patterns;
+    int        nelems;
+    int        npatterns = 0;
+    int        i;
+
+    deconstruct_array_builtin(array, TEXTOID, &elems, &nulls, &nelems);
+
+    if (is_not)
+    {
+        key->sk_strategy = (key->sk_strategy == BISCUIT_NOT_LIKE_STRATEGY)
+                         ? BISCUIT_LIKE_STRATEGY : BISCUIT_ILIKE_STRATEGY;
+        key->sk_flags   &= ~SK_SEARCHARRAY;
+        key->sk_argument = CStringGetTextDatum("%");
+        *lossy = true;
+        return;
+    }
+
+    patterns = (Datum *) palloc(Max(nelems, 1) * sizeof(Datum));
+    for (i = 0; i < nelems; i++)
+    {
+        char *arg;
+        char *pattern;
+        bool  elem_lossy;
+
+        if (nulls[i])
+            continue;
+
+        arg     = TextDatumGetCString(elems[i]);
+        pattern = biscuit_key_like_pattern(key->sk_strategy, key->sk_collation,
+                                           arg, &elem_lossy);
+        patterns[npatterns++] = CStringGetTextDatum(pattern);
+        *lossy |= elem_lossy;
+        pfree(pattern);
+        pfree(arg);
+    }
+
+    key->sk_strategy = biscuit_key_like_strategy(key->sk_strategy);
+    if (npatterns == 1)
+    {
+        key->sk_flags   &= ~SK_SEARCHARRAY;
+        key->sk_argument = patterns[0];
+    }
+    else
+        key->sk_argument = PointerGetDatum(construct_array_builtin(patterns, npatterns,
+                                                                   TEXTOID));
+}
+
+ScanKey
+biscuit_keys_rewrite(ScanKey keys, int nkeys, bool *lossy)
+{
+    ScanKey rewritten = NULL;
+    int     i;
+
+    *lossy = false;
+
+    for (i = 0; i < nkeys; i++)
+    {
+        ScanKey key;
+
+        if ((keys[i].sk_flags & SK_ISNULL) ||
+            (keys[i].sk_strategy <= BISCUIT_NOT_ILIKE_STRATEGY &&
+             !(keys[i].sk_flags & SK_SEARCHARRAY)))
+            continue;
+
+        if (!rewritten)
+        {
+            rewritten = (ScanKey) palloc(nkeys * sizeof(ScanKeyData));
+            memcpy(rewritten, keys, nkeys * sizeof(ScanKeyData));
+        }
+        key = &rewritten[i];
+
+        if (key->sk_flags & SK_SEARCHARRAY)
+            biscuit_keys_rewrite_array(key, lossy);
+        else
+        {
+            char *arg     = TextDatumGetCString(key->sk_argument);
+            bool  key_lossy;
+            char *pattern = biscuit_key_like_pattern(key->sk_strategy, key->sk_collation,
+                                                     arg, &key_lossy);
+
+            elog(DEBUG1, "Biscuit: strategy %d key '%s' evaluated as LIKE '%s'",
+                 key->sk_strategy, arg, pattern);
+
+            key->sk_strategy = biscuit_key_like_strategy(key->sk_strategy);
+            key->sk_argument = CStringGetTextDatum(pattern);
+            *lossy |= key_lossy;
+            pfree(pattern);
+            pfree(arg);
+        }
+    }
+
+    return rewritten ? rewritten : keys;
+}
+
+void
+biscuit_keys_free(ScanKey rewritten, ScanKey keys, int nkeys)
+{
+    int i;
+
+    if (rewritten == keys)
+        return;
+
+    for (i = 0; i < nkeys; i++)
+        if (rewritten[i].sk_argument != keys[i].sk_argument)
+            pfree(DatumGetPointer(rewritten[i].sk_argument));
+    pfree(rewritten);
+}
+
+char **
+biscuit_key_patterns(ScanKey key, int *npatterns)
+{
+    char **patterns;
+
+    if (key->sk_flags & SK_SEARCHARRAY)
+    {
+        Datum *elems;
+        bool  *nulls;
+        int    nelems;
+        int    i;
+
+        deconstruct_array_builtin(DatumGetArrayTypeP(key->sk_argument), TEXTOID,
+                                  &elems, &nulls, &nelems);
+        patterns   = (char **) palloc(Max(nelems, 1) * sizeof(char *));
+        *npatterns = 0;
+        for (i = 0; i < nelems; i++)
+            if (!nulls[i])
+                patterns[(*npatterns)++] = TextDatumGetCString(elems[i]);
+        pfree(elems);
+        pfree(nulls);
+        return patterns;
+    }
+
+    patterns    = (char **) palloc(sizeof(char *));
+    patterns[0] = TextDatumGetCString(key->sk_argument);
+    *npatterns  = 1;
+    return patterns;
+}
+
+void
+biscuit_key_patterns_free(char **patterns, int npatterns)
+{
+    int i;
+
+    for (i = 0; i < npatterns; i++)
+        pfree(patterns[i]);
+    pfree(patterns);
+}
@@ -0,0 +1,40 @@
+/*
+ * biscuit_keys.h
+ * Scan keys of every strategy in biscuit_text_ops rewritten as the LIKE /
+ * ILIKE keys the bitmap and fallback paths evaluate.
+ */
+
+#ifndef BISCUIT_KEYS_H
+#define BISCUIT_KEYS_H
+
+#include "biscuit_common.h"
+
+/* The LIKE strategy (1-4) a strategy is evaluated with */
+extern int     biscuit_key_like_strategy(int strategy);
+
+/*
+ * The LIKE pattern for the argument arg of a strategy key, palloc'd.
+ * *lossy is set when the pattern matches a superset of the key.
+ */
+extern char   *biscuit_key_like_pattern(int strategy, Oid collation,
+                                        const char *arg, bool *lossy);
+
+/*
+ * keys with every key that is not a plain LIKE / ILIKE key rewritten as
+ * one; keys itself when there are none.  Array keys (= ANY, LIKE ANY,
+ * ...) become a LIKE ANY of their patterns.  *lossy is set when a pattern
+ * matches a superset and the scan must recheck its rows.
+ */
+extern ScanKey biscuit_keys_rewrite(ScanKey keys, int nkeys, bool *lossy);
+
+/* Free what biscuit_keys_rewrite() returned for keys */
+extern void    biscuit_keys_free(ScanKey rewritten, ScanKey keys, int nkeys);
+
+/*
+ * The patterns of a rewritten key, palloc'd: its argument, or the
+ * elements of an array key, whose matches are OR-ed.
+ */
+extern char  **biscuit_key_patterns(ScanKey key, int *npatterns);
+extern void    biscuit_key_patterns_free(char **patterns, int npatterns);
+
+#endif /* BISCUIT_KEYS_H */
@@ -0,0 +1,389 @@
+/*
+ * biscuit_like.c
+ * Compiled LIKE matcher.
+ *
+ * Every place that checks a string directly against a pattern (the
+ * '%substring%' candidates of the bitmap queries, the skeleton fallback
+ * scan, candidate verification in the scans and the result cache) used
+ * to run a byte-at-a-time backtracking matcher, or walk every character
+ * offset of the string trying the part there.  Here the pattern is
+ * compiled once into segments (the runs between unescaped '%'), each a
+ * list of pieces: a number of '_' wildcards followed by literal bytes.
+ *
+ * Segments have a fixed length in characters, so a pattern matches iff
+ * each segment matches at the leftmost place after the previous one,
+ * with the first pinned to the start and the last to the end unless the
+ * pattern is open there.  No backtracking across segments is needed.
+ * An unanchored segment is found by searching for its first literal,
+ * with memchr or an AVX2 first/last-byte filter, and verifying the rest
+ * of its pieces only where that literal occurs; '_' skips a whole UTF-8
+ * character.
+ *
+ * Strings are assumed to be valid UTF-8, as everywhere else in Biscuit.
+ * ILIKE callers compile the lowercased pattern and match lowercased
+ * strings.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_like.h"
+#include "biscuit_utf8.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BISCUIT_LIKE_AVX2
+#include <immintrin.h>
+#endif
+
+typedef struct BiscuitLikePiece
+{
+    int skip;                   /* '_' wildcards before the literal */
+    int lit_off;                /* literal bytes, in plan->bytes */
+    int lit_len;
+} BiscuitLikePiece;
+
+typedef struct BiscuitLikeSegment
+{
+    int first_piece;
+    int npieces;
+    int nchars;                 /* characters the segment spans */
+} BiscuitLikeSegment;
+
+struct BiscuitLikePlan
+{
+    bool                starts_percent;
+    bool                ends_percent;
+    int                 nsegments;
+    BiscuitLikeSegment *segments;
+    BiscuitLikePiece   *pieces;
+    char               *bytes;
+};
+
+/* ================================================================
+ * SECTION 1 – Literal search
+ * ================================================================ */
+
+/* Offset of the first occurrence of lit (m >= 1 bytes) in hay, or -1 */
+static int
+biscuit_like_find_c(const char *hay, int n, const char *lit, int m)
+{
+    const char *p    = hay;
+    const char *last = hay + n - m;
+
+    while (p <= last)
+    {
+        p = memchr(p, lit[0], last - p + 1);
+        if (!p)
+            return -1;
+        if (memcmp(p + 1, lit + 1, m - 1) == 0)
+            return (int) (p - hay);
+        p++;
+    }
+    return -1;
+}
+
+#ifdef BISCUIT_LIKE_AVX2
+
+/*
+ * 32 candidate positions per step: a position survives when both the
+ * literal's first and last bytes match, and only survivors are compared
+ * in full.  The tail is left to the portable search.
+ */
+__attribute__((target("avx2"))) static int
+biscuit_like_find_avx2(const char *hay, int n, const char *lit, int m)
+{
+    const __m256i first = _mm256_set1_epi8(lit[0]);
+    const __m256i last  = _mm256_set1_epi8(lit[m - 1]);
+    int           i     = 0;
+    int           r;
+
+    for (; i + m - 1 + 32 <= n; i += 32)
+    {
+        __m256i  bf   = _mm256_loadu_si256((const __m256i *) (hay + i));
+        __m256i  bl   = _mm256_loadu_si256((const __m256i *) (hay + i + m - 1));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, bf), _mm256_cmpeq_epi8(last, bl)));
+
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+
+            if (memcmp(hay + i + bit + 1, lit + 1, m - 2) == 0)
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    r = biscuit_like_find_c(hay + i, n - i, lit, m);
+    return r < 0 ? -1 : i + r;
+}
+
+#endif  /* BISCUIT_LIKE_AVX2 */
+
+typedef int (*BiscuitLikeFindFn) (const char *hay, int n, const char *lit, int m);
+
+static BiscuitLikeFindFn biscuit_like_find_impl = NULL;
+
+static int
+biscuit_like_find(const char *hay, int n, const char *lit, int m)
+{
+    if (m > n)
+        return -1;
+    if (m == 1)
+    {
+        const char *p = memchr(hay, lit[0], n);
+
+        return p ? (int) (p - hay) : -1;
+    }
+
+    if (!biscuit_like_find_impl)
+    {
+        biscuit_like_find_impl = biscuit_like_find_c;
+#ifdef BISCUIT_LIKE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            biscuit_like_find_impl = biscuit_like_find_avx2;
+#endif
+    }
+    return biscuit_like_find_impl(hay, n, lit, m);
+}
+
+/* ================================================================
+ * SECTION 2 – Compilation
+ * ================================================================ */
+
+BiscuitLikePlan *
+biscuit_like_compile(const char *pat, int pat_len)
+{
+    BiscuitLikePlan    *plan;
+    BiscuitLikeSegment *seg   = NULL;
+    BiscuitLikePiece   *piece = NULL;
+    Size                seg_size   = MAXALIGN((pat_len + 1) * sizeof(BiscuitLikeSegment));
+    Size                piece_size = MAXALIGN((pat_len + 1) * sizeof(BiscuitLikePiece));
+    char               *mem;
+    int                 nbytes = 0;
+    int                 npieces = 0;
+    int                 i = 0;
+
+    /* One allocation: the plan, then segments, pieces and literal bytes */
+    mem  = (char *) palloc(MAXALIGN(sizeof(BiscuitLikePlan)) + seg_size + piece_size + pat_len + 1);
+    plan = (BiscuitLikePlan *) mem;
+    plan->segments = (BiscuitLikeSegment *) (mem + MAXALIGN(sizeof(BiscuitLikePlan)));
+    plan->pieces   = (BiscuitLikePiece *) ((char *) plan->segments + seg_size);
+    plan->bytes    = (char *) plan->pieces + piece_size;
+    plan->nsegments      = 0;
+    plan->starts_percent = pat_len > 0 && pat[0] == '%';
+    plan->ends_percent   = false;
+
+    while (i < pat_len)
+    {
+        unsigned char c = (unsigned char) pat[i++];
+        bool          wildcard = false;
+
+        if (c == '%')
+        {
+            seg   = NULL;
+            piece = NULL;
+            plan->ends_percent = true;
+            continue;
+        }
+
+        plan->ends_percent = false;
+        if (c == '\\' && i < pat_len)
+            c = (unsigned char) pat[i++];
+        else if (c == '_')
+            wildcard = true;
+
+        if (!seg)
+        {
+            seg = &plan->segments[plan->nsegments++];
+            seg->first_piece = npieces;
+            seg->npieces     = 0;
+            seg->nchars      = 0;
+        }
+
+        /* A piece is wildcards then literal bytes; a '_' after bytes starts the next */
+        if (!piece || (wildcard && piece->lit_len > 0))
+        {
+            piece = &plan->pieces[npieces++];
+            piece->skip    = 0;
+            piece->lit_off = nbytes;
+            piece->lit_len = 0;
+            seg->npieces++;
+        }
+
+        if (wildcard)
+        {
+            piece->skip++;
+            seg->nchars++;
+        }
+        else
+        {
+            plan->bytes[nbytes++] = (char) c;
+            piece->lit_len++;
+            if (!biscuit_utf8_is_continuation(c))
+                seg->nchars++;
+        }
+    }
+
+    return plan;
+}
+
+void
+biscuit_like_free(BiscuitLikePlan *plan)
+{
+    if (plan)
+        pfree(plan);
+}
+
+/* ================================================================
+ * SECTION 3 – Matching
+ * ================================================================ */
+
+/* Skip n characters from p; -1 when hay ends first */
+static inline int
+biscuit_like_skip(const char *hay, int hay_len, int p, int n)
+{
+    while (n-- > 0)
+    {
+        if (p >= hay_len)
+            return -1;
+        p = Min(p + biscuit_utf8_char_length((unsigned char) hay[p]), hay_len);
+    }
+    return p;
+}
+
+/* Match pieces [first, first + n) at exactly p; the end offset or -1 */
+static int
+biscuit_like_match_pieces(const BiscuitLikePlan *plan, int first, int n,
+                          const char *hay, int hay_len, int p)
+{
+    int i;
+
+    for (i = first; i < first + n; i++)
+    {
+        const BiscuitLikePiece *piece = &plan->pieces[i];
+
+        if (piece->skip > 0 && (p = biscuit_like_skip(hay, hay_len, p, piece->skip)) < 0)
+            return -1;
+        if (piece->lit_len > 0)
+        {
+            if (p + piece->lit_len > hay_len ||
+                memcmp(hay + p, plan->bytes + piece->lit_off, piece->lit_len) != 0)
+                return -1;
+            p += piece->lit_len;
+        }
+    }
+    return p;
+}
+
+/* Leftmost match of seg at or after p; the end offset or -1 */
+static int
+biscuit_like_find_segment(const BiscuitLikePlan *plan, const BiscuitLikeSegment *seg,
+                          const char *hay, int hay_len, int p)
+{
+    const BiscuitLikePiece *lead = &plan->pieces[seg->first_piece];
+    const char             *lit  = plan->bytes + lead->lit_off;
+    int                     q;
+
+    /* Nothing but '_': any position will do */
+    if (lead->lit_len == 0)
+        return biscuit_like_skip(hay, hay_len, p, lead->skip);
+
+    /* The literal starts no earlier than lead->skip characters in */
+    if ((q = biscuit_like_skip(hay, hay_len, p, lead->skip)) < 0)
+        return -1;
+
+    for (;;)
+    {
+        int at = biscuit_like_find(hay + q, hay_len - q, lit, lead->lit_len);
+        int end;
+
+        if (at < 0)
+            return -1;
+        at += q;
+
+        end = biscuit_like_match_pieces(plan, seg->first_piece + 1, seg->npieces - 1,
+                                        hay, hay_len, at + lead->lit_len);
+        if (end >= 0)
+            return end;
+        q = at + 1;
+    }
+}
+
+bool
+biscuit_like_exec(const BiscuitLikePlan *plan, const char *hay, int hay_len)
+{
+    int first = 0;
+    int last  = plan->nsegments - 1;
+    int pos   = 0;
+    int i;
+
+    if (plan->nsegments == 0)
+        return plan->starts_percent || hay_len == 0;
+
+    if (!plan->starts_percent)
+    {
+        const BiscuitLikeSegment *seg = &plan->segments[0];
+
+        pos = biscuit_like_match_pieces(plan, seg->first_piece, seg->npieces, hay, hay_len, 0);
+        if (pos < 0)
+            return false;
+        if (plan->nsegments == 1 && !plan->ends_percent)
+            return pos == hay_len;
+        first = 1;
+    }
+
+    for (i = first; i < (plan->ends_percent ? last + 1 : last); i++)
+    {
+        pos = biscuit_like_find_segment(plan, &plan->segments[i], hay, hay_len, pos);
+        if (pos < 0)
+            return false;
+    }
+
+    if (!plan->ends_percent)
+    {
+        /* The last segment ends the string: back up its length in characters */
+        const BiscuitLikeSegment *seg   = &plan->segments[last];
+        int                       start = hay_len;
+        int                       n;
+
+        for (n = 0; n < seg->nchars; n++)
+        {
+            if (start <= pos)
+                return false;
+            start--;
+            while (start > pos && biscuit_utf8_is_continuation((unsigned char) hay[start]))
+                start--;
+        }
+        return biscuit_like_match_pieces(plan, seg->first_piece, seg->npieces,
+                                         hay, hay_len, start) == hay_len;
+    }
+
+    return true;
+}
+
+bool
+biscuit_like_match(const char *hay, int hay_len, const char *pat, int pat_len)
+{
+    BiscuitLikePlan *plan = biscuit_like_compile(pat, pat_len);
+    bool             matched = biscuit_like_exec(plan, hay, hay_len);
+
+    biscuit_like_free(plan);
+    return matched;
+}
+
+char *
+biscuit_like_escape(const char *str, int len)
+{
+    char *pat = (char *) palloc(2 * len + 2);
+    int   n   = 0;
+    int   i;
+
+    for (i = 0; i < len; i++)
+    {
+        if (str[i] == '%' || str[i] == '_' || str[i] == '\\')
+            pat[n++] = '\\';
+        pat[n++] = str[i];
+    }
+    pat[n] = '\0';
+    return pat;
+}
@@ -0,0 +1,38 @@
+/*
+ * biscuit_like.h
+ * LIKE patterns compiled once and matched against many strings: the
+ * verification of '%substring%' candidates, the skeleton fallback scan
+ * and every other place that checks a cached string directly.
+ */
+
+#ifndef BISCUIT_LIKE_H
+#define BISCUIT_LIKE_H
+
+#include "biscuit_common.h"
+
+typedef struct BiscuitLikePlan BiscuitLikePlan;
+
+/*
+ * Compile pattern (backslash escapes, as the rest of the extension).  For
+ * ILIKE pass the lowercased pattern and match lowercased strings.  The
+ * plan is allocated in CurrentMemoryContext and does not reference pat.
+ */
+extern BiscuitLikePlan *biscuit_like_compile(const char *pat, int pat_len);
+
+/* Whether hay (hay_len bytes, UTF-8) matches the compiled pattern */
+extern bool             biscuit_like_exec(const BiscuitLikePlan *plan,
+                                          const char *hay, int hay_len);
+
+extern void             biscuit_like_free(BiscuitLikePlan *plan);
+
+/* One-off match: compile, match and free */
+extern bool             biscuit_like_match(const char *hay, int hay_len,
+                                           const char *pat, int pat_len);
+
+/*
+ * A pattern matching exactly the len bytes of str: '%', '_' and '\' are
+ * escaped.  palloc'd, with room for a '%' to be appended.
+ */
+extern char            *biscuit_like_escape(const char *str, int len);
+
+#endif /* BISCUIT_LIKE_H */
@@ -0,0 +1,510 @@
+/*
+ * biscuit_parallel_build.c
+ * Parallel CREATE INDEX.
+ *
+ * A serial build reads the whole heap in one backend and spends most of
+ * its time in biscuit_index_single_record / biscuit_index_column_record,
+ * which is embarrassingly parallel: a record's bitmaps depend on nothing
+ * but its own value.  With amcanbuildparallel the planner hands ambuild
+ * up to max_parallel_maintenance_workers workers, and
+ *
+ *   1. the leader sets up a parallel heap scan, a SharedFileSet and a
+ *      few DSM keys (the usual btree / BRIN layout), then launches the
+ *      workers;
+ *   2. every participant, the leader included, runs the ordinary build
+ *      loop over the blocks the parallel scan hands it, producing a
+ *      complete partial index whose records are numbered from 0;
+ *   3. each worker writes its partial index to a temporary file in the
+ *      snapshot stream format (biscuit_storage_write_file) and exits;
+ *   4. the leader reads the files back one at a time and appends them to
+ *      its own partial index.  Record ranges are disjoint, so appending
+ *      is concatenation of the TID and string arrays plus an OR of every
+ *      bitmap shifted by the number of records merged so far.
+ *
+ * Each worker file is released as soon as it is merged, so the leader
+ * holds at most the merged index plus one partial at a time.  Record
+ * numbers follow the order the participants are merged in, so once every
+ * partial is in the leader renumbers them in heap order (biscuit_compact)
+ * and scans can skip sorting their TIDs.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_arena.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_cache.h"
+#include "biscuit_changelog.h"
+#include "biscuit_index.h"
+#include "biscuit_parallel_build.h"
+#include "biscuit_storage.h"
+#include "biscuit_tid.h"
+
+#if PG_VERSION_NUM >= 170000
+
+#include "executor/instrument.h"
+#include "pgstat.h"
+#include "storage/sharedfileset.h"
+
+/* ================================================================
+ * SECTION 1 – Shared state
+ * ================================================================ */
+
+#define PARALLEL_KEY_BISCUIT_SHARED     UINT64CONST(0xB15C000000000001)
+#define PARALLEL_KEY_BISCUIT_SCAN       UINT64CONST(0xB15C000000000002)
+#define PARALLEL_KEY_QUERY_TEXT         UINT64CONST(0xB15C000000000003)
+#define PARALLEL_KEY_WAL_USAGE          UINT64CONST(0xB15C000000000004)
+#define PARALLEL_KEY_BUFFER_USAGE       UINT64CONST(0xB15C000000000005)
+
+typedef struct BiscuitBuildShared
+{
+    Oid           heaprelid;
+    Oid           indexrelid;
+    bool          isconcurrent;
+    SharedFileSet fileset;      /* one partial index file per worker */
+} BiscuitBuildShared;
+
+static void
+biscuit_partial_file_name(char *name, size_t size, int worker)
+{
+    snprintf(name, size, "biscuit-partial-%d", worker);
+}
+
+/* ================================================================
+ * SECTION 2 – Merging partial indexes
+ * ================================================================ */
+
+/* dst |= src shifted by offset; dst is created when NULL */
+static RoaringBitmap *
+biscuit_merge_bitmap(RoaringBitmap *dst, const RoaringBitmap *src, uint32 offset)
+{
+    if (!src)
+        return dst;
+    if (!dst)
+        dst = biscuit_roaring_create();
+    biscuit_roaring_or_shifted(dst, src, offset);
+    return dst;
+}
+
+/* Merge two position-sorted CharIndexes into dst */
+static void
+biscuit_merge_charindex(CharIndex *dst, const CharIndex *src, uint32 offset)
+{
+    PosEntry *merged;
+    int       capacity;
+    int       i = 0, j = 0, n = 0;
+
+    if (src->count == 0)
+        return;
+
+    capacity = dst->count + src->count;
+    merged   = (PosEntry *) palloc(capacity * sizeof(PosEntry));
+
+    while (i < dst->count || j < src->count)
+    {
+        if (j == src->count ||
+            (i < dst->count && dst->entries[i].pos < src->entries[j].pos))
+            merged[n++] = dst->entries[i++];
+        else if (i == dst->count || src->entries[j].pos < dst->entries[i].pos)
+        {
+            merged[n].pos    = src->entries[j].pos;
+            merged[n].bitmap = biscuit_merge_bitmap(NULL, src->entries[j].bitmap, offset);
+            n++, j++;
+        }
+        else
+        {
+            merged[n].pos    = dst->entries[i].pos;
+            merged[n].bitmap = biscuit_merge_bitmap(dst->entries[i].bitmap,
+                                                    src->entries[j].bitmap, offset);
+            n++, i++, j++;
+        }
+    }
+
+    if (dst->entries)
+        pfree(dst->entries);
+    dst->entries  = merged;
+    dst->count    = n;
+    dst->capacity = capacity;
+}
+
+/*
+ * Length bitmaps: both arrays grow to the longer bound.  length_ge slots
+ * past dst's old bound start empty, since no earlier record is that long.
+ */
+static void
+biscuit_merge_lengths(RoaringBitmap ***length_bitmaps,
+                      RoaringBitmap ***length_ge_bitmaps,
+                      int *max_length,
+                      RoaringBitmap **src_length_bitmaps,
+                      RoaringBitmap **src_length_ge_bitmaps,
+                      int src_max_length,
+                      uint32 offset)
+{
+    int i;
+
+    if (src_max_length > *max_length)
+    {
+        if (*length_bitmaps)
+        {
+            *length_bitmaps    = (RoaringBitmap **) repalloc(*length_bitmaps,
+                                                             src_max_length * sizeof(RoaringBitmap *));
+            *length_ge_bitmaps = (RoaringBitmap **) repalloc(*length_ge_bitmaps,
+                                                             src_max_length * sizeof(RoaringBitmap *));
+        }
+        else
+        {
+            *length_bitmaps    = (RoaringBitmap **) palloc(src_max_length * sizeof(RoaringBitmap *));
+            *length_ge_bitmaps = (RoaringBitmap **) palloc(src_max_length * sizeof(RoaringBitmap *));
+        }
+
+        for (i = *max_length; i < src_max_length; i++)
+        {
+            (*length_bitmaps)[i]    = NULL;
+            (*length_ge_bitmaps)[i] = biscuit_roaring_create();
+        }
+        *max_length = src_max_length;
+    }
+
+    for (i = 0; i < src_max_length; i++)
+    {
+        (*length_bitmaps)[i]    = biscuit_merge_bitmap((*length_bitmaps)[i],
+                                                       src_length_bitmaps[i], offset);
+        (*length_ge_bitmaps)[i] = biscuit_merge_bitmap((*length_ge_bitmaps)[i],
+                                                       src_length_ge_bitmaps[i], offset);
+    }
+}
+
+static void
+biscuit_merge_side(CharIndex *pos_idx, CharIndex *neg_idx, RoaringBitmap **char_cache,
+                   const CharIndex *src_pos_idx, const CharIndex *src_neg_idx,
+                   RoaringBitmap **src_char_cache, uint32 offset)
+{
+    int ch;
+
+    for (ch = 0; ch < CHAR_RANGE; ch++)
+    {
+        biscuit_merge_charindex(&pos_idx[ch], &src_pos_idx[ch], offset);
+        biscuit_merge_charindex(&neg_idx[ch], &src_neg_idx[ch], offset);
+        char_cache[ch] = biscuit_merge_bitmap(char_cache[ch], src_char_cache[ch], offset);
+    }
+}
+
+static void
+biscuit_merge_trigrams(CharIndex *tri, const CharIndex *src, uint32 offset)
+{
+    int b;
+
+    /* Every participant reads the same trigrams index option */
+    if (!tri != !src)
+        elog(ERROR, "Biscuit: parallel build participants disagree on trigram postings");
+    if (!tri)
+        return;
+
+    for (b = 0; b < BISCUIT_TRIGRAM_BUCKETS; b++)
+        biscuit_merge_charindex(&tri[b], &src[b], offset);
+}
+
+/* Copy a value and its lowercased copy into arena, keeping a shared copy shared */
+static void
+biscuit_merge_string(BiscuitStringArena *arena, const char *s, const char *lower,
+                     char **dst, char **dst_lower)
+{
+    *dst = s ? biscuit_arena_store(arena, s, biscuit_cache_strlen(s)) : NULL;
+
+    if (!lower)
+        *dst_lower = NULL;
+    else if (lower == s)
+        *dst_lower = *dst;
+    else
+        *dst_lower = biscuit_arena_store(arena, lower, biscuit_cache_strlen(lower));
+}
+
+/*
+ * Append part's records to idx.  Allocates in CurrentMemoryContext (the
+ * context idx lives in); part is only read.
+ */
+static void
+biscuit_merge_partial(BiscuitIndex *idx, BiscuitIndex *part)
+{
+    uint32 offset = (uint32) idx->num_records;
+    int    rec;
+    int    col;
+
+    if (part->num_records == 0)
+        return;
+
+    biscuit_reserve_records(idx, part->num_records);
+    memcpy(idx->tids + idx->num_records, part->tids,
+           part->num_records * sizeof(ItemPointerData));
+
+    if (idx->num_columns == 1)
+    {
+        for (rec = 0; rec < part->num_records; rec++)
+            biscuit_merge_string(&idx->strings_legacy,
+                                 part->data_cache[rec], part->data_cache_lower[rec],
+                                 &idx->data_cache[offset + rec],
+                                 &idx->data_cache_lower[offset + rec]);
+
+        idx->max_len = Max(idx->max_len, part->max_len);
+        biscuit_merge_side(idx->pos_idx_legacy, idx->neg_idx_legacy, idx->char_cache_legacy,
+                           part->pos_idx_legacy, part->neg_idx_legacy, part->char_cache_legacy,
+                           offset);
+        biscuit_merge_side(idx->pos_idx_lower, idx->neg_idx_lower, idx->char_cache_lower,
+                           part->pos_idx_lower, part->neg_idx_lower, part->char_cache_lower,
+                           offset);
+        biscuit_merge_lengths(&idx->length_bitmaps_legacy, &idx->length_ge_bitmaps_legacy,
+                              &idx->max_length_legacy,
+                              part->length_bitmaps_legacy, part->length_ge_bitmaps_legacy,
+                              part->max_length_legacy, offset);
+        biscuit_merge_lengths(&idx->length_bitmaps_lower, &idx->length_ge_bitmaps_lower,
+                              &idx->max_length_lower,
+                              part->length_bitmaps_lower, part->length_ge_bitmaps_lower,
+                              part->max_length_lower, offset);
+        biscuit_merge_trigrams(idx->trigrams_legacy, part->trigrams_legacy, offset);
+    }
+    else
+    {
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            ColumnIndex *cidx = &idx->column_indices[col];
+            ColumnIndex *pidx = &part->column_indices[col];
+
+            for (rec = 0; rec < part->num_records; rec++)
+                biscuit_merge_string(&cidx->strings,
+                                     part->column_data_cache[col][rec],
+                                     part->column_data_cache_lower[col][rec],
+                                     &idx->column_data_cache[col][offset + rec],
+                                     &idx->column_data_cache_lower[col][offset + rec]);
+
+            biscuit_merge_side(cidx->pos_idx, cidx->neg_idx, cidx->char_cache,
+                               pidx->pos_idx, pidx->neg_idx, pidx->char_cache, offset);
+            biscuit_merge_side(cidx->pos_idx_lower, cidx->neg_idx_lower, cidx->char_cache_lower,
+                               pidx->pos_idx_lower, pidx->neg_idx_lower, pidx->char_cache_lower,
+                               offset);
+            biscuit_merge_lengths(&cidx->length_bitmaps, &cidx->length_ge_bitmaps,
+                                  &cidx->max_length,
+                                  pidx->length_bitmaps, pidx->length_ge_bitmaps,
+                                  pidx->max_length, offset);
+            biscuit_merge_lengths(&cidx->length_bitmaps_lower, &cidx->length_ge_bitmaps_lower,
+                                  &cidx->max_length_lower,
+                                  pidx->length_bitmaps_lower, pidx->length_ge_bitmaps_lower,
+                                  pidx->max_length_lower, offset);
+            biscuit_merge_trigrams(cidx->trigrams, pidx->trigrams, offset);
+        }
+    }
+
+    idx->num_records += part->num_records;
+}
+
+/* ================================================================
+ * SECTION 3 – Worker
+ * ================================================================ */
+
+void
+biscuit_parallel_build_main(dsm_segment *seg, shm_toc *toc)
+{
+    BiscuitBuildShared    *shared;
+    ParallelTableScanDesc  pscan;
+    char                  *sharedquery;
+    WalUsage              *walusage;
+    BufferUsage           *bufferusage;
+    LOCKMODE               heapLockmode;
+    LOCKMODE               indexLockmode;
+    Relation               heap;
+    Relation               index;
+    IndexInfo             *indexInfo;
+    BiscuitIndex          *part;
+    BufFile               *file;
+    char                   name[MAXPGPATH];
+
+    sharedquery = shm_toc_lookup(toc, PARALLEL_KEY_QUERY_TEXT, true);
+    debug_query_string = sharedquery;
+    pgstat_report_activity(STATE_RUNNING, debug_query_string);
+
+    shared = (BiscuitBuildShared *) shm_toc_lookup(toc, PARALLEL_KEY_BISCUIT_SHARED, false);
+    pscan  = (ParallelTableScanDesc) shm_toc_lookup(toc, PARALLEL_KEY_BISCUIT_SCAN, false);
+
+    /* Same lock modes as the leader, see index_build() */
+    if (!shared->isconcurrent)
+    {
+        heapLockmode  = ShareLock;
+        indexLockmode = AccessExclusiveLock;
+    }
+    else
+    {
+        heapLockmode  = ShareUpdateExclusiveLock;
+        indexLockmode = RowExclusiveLock;
+    }
+
+    heap  = table_open(shared->heaprelid, heapLockmode);
+    index = index_open(shared->indexrelid, indexLockmode);
+
+    indexInfo = BuildIndexInfo(index);
+    indexInfo->ii_Concurrent = shared->isconcurrent;
+
+    SharedFileSetAttach(&shared->fileset, seg);
+
+    InstrStartParallelQuery();
+
+    part = biscuit_build_partial(heap, index, indexInfo, pscan);
+
+    biscuit_partial_file_name(name, sizeof(name), ParallelWorkerNumber);
+    file = BufFileCreateFileSet(&shared->fileset.fs, name);
+    biscuit_storage_write_file(part, file);
+    BufFileClose(file);
+
+    walusage    = shm_toc_lookup(toc, PARALLEL_KEY_WAL_USAGE, false);
+    bufferusage = shm_toc_lookup(toc, PARALLEL_KEY_BUFFER_USAGE, false);
+    InstrEndParallelQuery(&bufferusage[ParallelWorkerNumber],
+                          &walusage[ParallelWorkerNumber]);
+
+    index_close(index, indexLockmode);
+    table_close(heap, heapLockmode);
+}
+
+/* ================================================================
+ * SECTION 4 – Leader
+ * ================================================================ */
+
+BiscuitIndex *
+biscuit_build_parallel(Relation heap, Relation index, IndexInfo *indexInfo)
+{
+    ParallelContext       *pcxt;
+    BiscuitBuildShared    *shared;
+    ParallelTableScanDesc  pscan;
+    Size                   estpscan;
+    WalUsage              *walusage;
+    BufferUsage           *bufferusage;
+    int                    querylen;
+    uint32                 epoch;
+    uint64                 log_version;
+    uint64                 log_base;
+    BiscuitIndex          *idx;
+    MemoryContext          oldcontext;
+    MemoryContext          copy_context;
+    int                    i;
+
+    /* Claimed before any participant starts scanning, as in a serial build */
+    epoch       = biscuit_storage_claim(index);
+    log_version = biscuit_changelog_current(index, &log_base);
+
+    EnterParallelMode();
+    pcxt = CreateParallelContext("biscuit", "biscuit_parallel_build_main",
+                                 indexInfo->ii_ParallelWorkers);
+
+    estpscan = table_parallelscan_estimate(heap, SnapshotAny);
+    shm_toc_estimate_chunk(&pcxt->estimator, sizeof(BiscuitBuildShared));
+    shm_toc_estimate_chunk(&pcxt->estimator, estpscan);
+    shm_toc_estimate_chunk(&pcxt->estimator, mul_size(sizeof(WalUsage), pcxt->nworkers));
+    shm_toc_estimate_chunk(&pcxt->estimator, mul_size(sizeof(BufferUsage), pcxt->nworkers));
+    shm_toc_estimate_keys(&pcxt->estimator, 4);
+
+    if (debug_query_string)
+    {
+        querylen = strlen(debug_query_string);
+        shm_toc_estimate_chunk(&pcxt->estimator, querylen + 1);
+        shm_toc_estimate_keys(&pcxt->estimator, 1);
+    }
+    else
+        querylen = 0;
+
+    InitializeParallelDSM(pcxt);
+
+    /* No DSM segment: let biscuit_build() fall back to a serial build */
+    if (pcxt->seg == NULL)
+    {
+        DestroyParallelContext(pcxt);
+        ExitParallelMode();
+        return NULL;
+    }
+
+    shared = (BiscuitBuildShared *) shm_toc_allocate(pcxt->toc, sizeof(BiscuitBuildShared));
+    shared->heaprelid    = RelationGetRelid(heap);
+    shared->indexrelid   = RelationGetRelid(index);
+    shared->isconcurrent = indexInfo->ii_Concurrent;
+    SharedFileSetInit(&shared->fileset, pcxt->seg);
+    shm_toc_insert(pcxt->toc, PARALLEL_KEY_BISCUIT_SHARED, shared);
+
+    pscan = (ParallelTableScanDesc) shm_toc_allocate(pcxt->toc, estpscan);
+    table_parallelscan_initialize(heap, pscan, SnapshotAny);
+    shm_toc_insert(pcxt->toc, PARALLEL_KEY_BISCUIT_SCAN, pscan);
+
+    if (debug_query_string)
+    {
+        char *sharedquery = (char *) shm_toc_allocate(pcxt->toc, querylen + 1);
+
+        memcpy(sharedquery, debug_query_string, querylen + 1);
+        shm_toc_insert(pcxt->toc, PARALLEL_KEY_QUERY_TEXT, sharedquery);
+    }
+
+    walusage = shm_toc_allocate(pcxt->toc, mul_size(sizeof(WalUsage), pcxt->nworkers));
+    shm_toc_insert(pcxt->toc, PARALLEL_KEY_WAL_USAGE, walusage);
+    bufferusage = shm_toc_allocate(pcxt->toc, mul_size(sizeof(BufferUsage), pcxt->nworkers));
+    shm_toc_insert(pcxt->toc, PARALLEL_KEY_BUFFER_USAGE, bufferusage);
+
+    LaunchParallelWorkers(pcxt);
+
+    /*
+     * The leader scans its share like any worker (with no workers launched
+     * that is the whole heap); its records come first.  The copy's context
+     * hangs off the build's until it is published, so an error anywhere
+     * before that frees it with the transaction.
+     */
+    copy_context = AllocSetContextCreate(CurrentMemoryContext,
+                                         "Biscuit index",
+                                         ALLOCSET_DEFAULT_SIZES);
+    oldcontext   = MemoryContextSwitchTo(copy_context);
+    idx = biscuit_build_partial(heap, index, indexInfo, pscan);
+    MemoryContextSwitchTo(oldcontext);
+    idx->memory_context = copy_context;
+
+    WaitForParallelWorkersToFinish(pcxt);
+
+    for (i = 0; i < pcxt->nworkers_launched; i++)
+    {
+        MemoryContext  part_context;
+        BiscuitIndex  *part;
+        BufFile       *file;
+        char           name[MAXPGPATH];
+
+        part_context = AllocSetContextCreate(CurrentMemoryContext,
+                                             "Biscuit parallel build partial",
+                                             ALLOCSET_DEFAULT_SIZES);
+        oldcontext = MemoryContextSwitchTo(part_context);
+
+        biscuit_partial_file_name(name, sizeof(name), i);
+        file = BufFileOpenFileSet(&shared->fileset.fs, name, O_RDONLY, false);
+        part = biscuit_storage_read_file(index, file);
+        BufFileClose(file);
+        BufFileDeleteFileSet(&shared->fileset.fs, name, false);
+
+        MemoryContextSwitchTo(copy_context);
+        biscuit_merge_partial(idx, part);
+        MemoryContextSwitchTo(oldcontext);
+
+        /* Releases the partial's bitmaps and part_context itself */
+        part->memory_context = part_context;
+        biscuit_storage_free_view(part);
+    }
+
+    for (i = 0; i < pcxt->nworkers_launched; i++)
+        InstrAccumParallelQuery(&bufferusage[i], &walusage[i]);
+
+    DestroyParallelContext(pcxt);
+    ExitParallelMode();
+
+    /* Each participant's blocks ascend, the concatenation need not */
+    idx->heap_ordered = biscuit_tids_in_heap_order(idx->tids, idx->num_records);
+    if (!idx->heap_ordered)
+        biscuit_compact(idx);
+
+    idx->storage_epoch = epoch;
+    biscuit_changelog_attach(index, idx, log_version, log_base);
+
+    /* Published exactly like a serial build, see biscuit_build_internal() */
+    MemoryContextSetParent(copy_context, CacheMemoryContext);
+    biscuit_register_callback();
+    biscuit_cache_insert(RelationGetRelid(index), idx);
+
+    return idx;
+}
+
+#endif  /* PG_VERSION_NUM >= 170000 */
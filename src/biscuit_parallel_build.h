@@ -0,0 +1,27 @@
+/*
+ * biscuit_parallel_build.h
+ * Parallel CREATE INDEX: workers build partial indexes over their share
+ * of the heap and the leader merges them (PostgreSQL 17+).
+ */
+
+#ifndef BISCUIT_PARALLEL_BUILD_H
+#define BISCUIT_PARALLEL_BUILD_H
+
+#include "biscuit_common.h"
+
+#if PG_VERSION_NUM >= 170000
+
+/*
+ * Build idx with indexInfo->ii_ParallelWorkers workers and publish it in
+ * the session cache, as biscuit_build_internal() does.  Returns NULL when
+ * no parallel context could be set up; the caller builds serially.
+ */
+extern BiscuitIndex *biscuit_build_parallel(Relation heap, Relation index,
+                                            IndexInfo *indexInfo);
+
+/* Worker entry point, looked up by name by the parallel infrastructure */
+extern PGDLLEXPORT void biscuit_parallel_build_main(dsm_segment *seg, shm_toc *toc);
+
+#endif
+
+#endif /* BISCUIT_PARALLEL_BUILD_H */
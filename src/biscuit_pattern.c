@@ -7,9 +7,14 @@
  */
 
 #include "biscuit_common.h"
+#include "biscuit_arena.h"
 #include "biscuit_bitmap.h"
 #include "biscuit_utf8.h"
+#include "biscuit_index.h"     /* biscuit_record_string */
 #include "biscuit_pattern.h"
+#include "biscuit_like.h"
+#include "biscuit_preload.h"   /* BISCUIT_PRELOAD_DONE */
+#include "biscuit_trigram.h"
 
 /* ================================================================
  * SECTION 1 – CharIndex bitmap accessor helpers
@@ -521,66 +526,172 @@ biscuit_part_seed_byte(const char *part, int byte_len)
 }
 
 /*
- * biscuit_part_match_substr
- * -------------------------
- * Check whether the sentinel-encoded part string matches a substring of
- * haystack starting at byte offset hay_off.
- *
- * Rules:
- *   - A bare '_' in the part matches exactly one UTF-8 character in hay.
- *   - A BISCUIT_LITERAL_ESC + byte pair matches that exact literal byte.
- *   - All other bytes match themselves exactly.
+ * biscuit_verify_substring
+ * ------------------------
+ * Add to result each candidate whose cached string (strs, lowercased for
+ * ILIKE) matches plan, the compiled pattern.  Candidates are visited in
+ * ascending order, so result is built by appends.
+ */
+static void
+biscuit_verify_substring(RoaringBitmap *result, const RoaringBitmap *candidates,
+                         char **strs, int num_records, const BiscuitLikePlan *plan)
+{
+    uint64_t  count;
+    uint32_t *recs;
+    uint64_t  j;
+
+    if (!strs)
+        return;
+
+    recs = biscuit_roaring_to_array(candidates, &count);
+    if (!recs)
+        return;
+
+    for (j = 0; j < count; j++)
+    {
+        const char *hay;
+
+        if (recs[j] >= (uint32_t) num_records || (hay = strs[recs[j]]) == NULL)
+            continue;
+        if (biscuit_like_exec(plan, hay, biscuit_cache_strlen(hay)))
+            biscuit_roaring_add(result, recs[j]);
+    }
+    pfree(recs);
+}
+
+/*
+ * Rarest-part-first filtering
+ * ---------------------------
+ * The windowed matchers walk the parts of '%foo%bar%baz%' left to right
+ * and probe every position of each, so a common first part makes them
+ * explore most of the table before a rare later part rules it out.
+ * Before they run, each part not already matched exactly is reduced to a
+ * position-free filter: the character caches of its concrete bytes and,
+ * when the index has them, its trigram postings.  Parts are intersected
+ * into the candidates in the order of their smallest character cache, a
+ * cheap estimate of their own cardinality, so the rarest part shrinks
+ * the set first and an impossible one empties it without touching the
+ * rest.  The filters are supersets; the positional match still decides.
  *
- * Returns true on a full match of the part, false otherwise.
- * hay/hay_byte_len: the full string and its byte length.
- * hay_off: byte offset within hay where matching starts.
+ * Once few candidates survive, checking them against the cached strings
+ * is cheaper than the positional match, whose cost grows with the
+ * longest string rather than with the candidates.
  */
-static bool
-biscuit_part_match_substr(const char *hay, int hay_byte_len, int hay_off,
-                           const char *part, int part_byte_len)
+#define BISCUIT_VERIFY_SURVIVORS  8192
+
+typedef struct BiscuitPartEstimate
 {
-    int pi = 0;  /* part byte position */
-    int hi = hay_off;  /* haystack byte position */
+    int      part;
+    uint64_t card;              /* smallest character cache of the part */
+} BiscuitPartEstimate;
 
-    while (pi < part_byte_len)
+static int
+biscuit_compare_part_estimates(const void *a, const void *b)
+{
+    uint64_t ca = ((const BiscuitPartEstimate *) a)->card;
+    uint64_t cb = ((const BiscuitPartEstimate *) b)->card;
+
+    return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
+
+/* The distinct concrete bytes of a parsed part; their number */
+static int
+biscuit_part_bytes(const char *part, int byte_len, unsigned char *bytes)
+{
+    bool seen[CHAR_RANGE];
+    int  n = 0;
+    int  i;
+
+    memset(seen, 0, sizeof(seen));
+    for (i = 0; i < byte_len; i++)
     {
-        unsigned char pc;
-        if (hi >= hay_byte_len)
-            return false;
+        unsigned char c = (unsigned char) part[i];
 
-        pc = (unsigned char) part[pi];
+        if (c == (unsigned char) BISCUIT_LITERAL_ESC && i + 1 < byte_len)
+            c = (unsigned char) part[++i];
+        else if (c == '_')
+            continue;
 
-        if (pc == (unsigned char) BISCUIT_LITERAL_ESC)
-        {
-            unsigned char literal;
-            /* Literal match: part[pi+1] must equal hay[hi] exactly */
-            if (pi + 1 >= part_byte_len)
-                return false;
-            literal = (unsigned char) part[pi + 1];
-            if ((unsigned char) hay[hi] != literal)
-                return false;
-            pi += 2;
-            hi += 1;
-        }
-        else if (pc == '_')
+        if (!seen[c])
         {
-            /* Single-char wildcard: consume one UTF-8 char from haystack */
-            int cl = biscuit_utf8_char_length((unsigned char) hay[hi]);
-            if (hi + cl > hay_byte_len)
-                return false;
-            pi += 1;
-            hi += cl;
+            seen[c] = true;
+            bytes[n++] = c;
         }
-        else
+    }
+    return n;
+}
+
+static void
+biscuit_filter_parts_rarest_first(RoaringBitmap **char_cache, const CharIndex *trigrams,
+                                  const ParsedPattern *parsed, int first_part,
+                                  RoaringBitmap *candidates)
+{
+    BiscuitPartEstimate *est   = (BiscuitPartEstimate *) palloc(parsed->part_count * sizeof(BiscuitPartEstimate));
+    unsigned char        bytes[CHAR_RANGE];
+    int                  nparts = 0;
+    int                  i, k, b;
+
+    for (i = first_part; i < parsed->part_count; i++)
+    {
+        int      nbytes = biscuit_part_bytes(parsed->parts[i], parsed->part_byte_lens[i], bytes);
+        uint64_t card   = PG_UINT64_MAX;
+
+        if (nbytes == 0)
+            continue;           /* only '_': no filter */
+
+        for (b = 0; b < nbytes && card > 0; b++)
+            card = char_cache[bytes[b]] ? Min(card, biscuit_roaring_count(char_cache[bytes[b]])) : 0;
+
+        est[nparts].part = i;
+        est[nparts].card = card;
+        nparts++;
+    }
+
+    if (nparts > 1)
+        qsort(est, nparts, sizeof(BiscuitPartEstimate), biscuit_compare_part_estimates);
+
+    for (k = 0; k < nparts && !biscuit_roaring_is_empty(candidates); k++)
+    {
+        int part   = est[k].part;
+        int nbytes = biscuit_part_bytes(parsed->parts[part], parsed->part_byte_lens[part], bytes);
+
+        if (est[k].card == 0)
         {
-            /* Literal byte from pattern: must match exactly */
-            if ((unsigned char) hay[hi] != pc)
-                return false;
-            pi += 1;
-            hi += 1;
+            /* A byte of the part occurs nowhere */
+            RoaringBitmap *empty = biscuit_roaring_create();
+
+            biscuit_roaring_and_inplace(candidates, empty);
+            biscuit_roaring_free(empty);
+            break;
         }
+
+        for (b = 0; b < nbytes && !biscuit_roaring_is_empty(candidates); b++)
+            biscuit_roaring_and_inplace(candidates, char_cache[bytes[b]]);
+        biscuit_trigram_filter(trigrams, parsed->parts[part], parsed->part_byte_lens[part],
+                               candidates);
     }
-    return true;  /* all part bytes consumed */
+
+    pfree(est);
+}
+
+/*
+ * Match the surviving candidates of a multi-part pattern directly when
+ * there are few enough and strs (NULL without store_strings) holds their
+ * values.  False leaves them to the windowed matcher.
+ */
+static bool
+biscuit_verify_survivors(RoaringBitmap *result, const RoaringBitmap *candidates,
+                         char **strs, int num_records, const char *pattern)
+{
+    BiscuitLikePlan *plan;
+
+    if (!strs || biscuit_roaring_count(candidates) > BISCUIT_VERIFY_SURVIVORS)
+        return false;
+
+    plan = biscuit_like_compile(pattern, strlen(pattern));
+    biscuit_verify_substring(result, candidates, strs, num_records, plan);
+    biscuit_like_free(plan);
+    return true;
 }
 
 
@@ -1734,11 +1845,7 @@ biscuit_query_pattern(BiscuitIndex *idx, const char *pattern)
             result = biscuit_roaring_create();
             for (i = 0; i < idx->num_records; i++) {
                 bool ts = false;
-                #ifdef HAVE_ROARING
-                ts = roaring_bitmap_contains(idx->tombstones, (uint32_t) i);
-                #else
-                { uint32_t bl = i >> 6, bt = i & 63; ts = ((int) bl < idx->tombstones->num_blocks && (idx->tombstones->blocks[bl] & (1ULL << bt))); }
-                #endif
+                ts = biscuit_roaring_contains(idx->tombstones, (uint32_t) i);
                 if (!ts && idx->data_cache[i]) biscuit_roaring_add(result, i);
             }
         }
@@ -1766,11 +1873,7 @@ biscuit_query_pattern(BiscuitIndex *idx, const char *pattern)
             result = biscuit_roaring_create();
             for (i = 0; i < idx->num_records; i++) {
                 bool ts = false;
-                #ifdef HAVE_ROARING
-                ts = roaring_bitmap_contains(idx->tombstones, (uint32_t) i);
-                #else
-                { uint32_t bl = i >> 6, bt = i & 63; ts = ((int) bl < idx->tombstones->num_blocks && (idx->tombstones->blocks[bl] & (1ULL << bt))); }
-                #endif
+                ts = biscuit_roaring_contains(idx->tombstones, (uint32_t) i);
                 if (!ts) biscuit_roaring_add(result, i);
             }
             biscuit_free_parsed_pattern(parsed);
@@ -1807,54 +1910,16 @@ biscuit_query_pattern(BiscuitIndex *idx, const char *pattern)
                         int part_char_len = parsed->part_lens[0];
                         RoaringBitmap *lf = biscuit_get_length_ge(idx, part_char_len);
                         if (lf) { biscuit_roaring_and_inplace(candidates, lf); biscuit_roaring_free(lf); }
+                        biscuit_trigram_filter(idx->trigrams_legacy, parsed->parts[0],
+                                               parsed->part_byte_lens[0], candidates);
 
-                        #ifdef HAVE_ROARING
-                        {
-                            roaring_uint32_iterator_t *iter = roaring_iterator_create(candidates);
-                            while (iter->has_value) {
-                                uint32_t rec = iter->current_value;
-                                if (rec < (uint32_t) idx->num_records && idx->data_cache[rec]) {
-                                    const char *hay = idx->data_cache[rec];
-                                    int hbl = strlen(hay), hcl = biscuit_utf8_char_count(hay, hbl);
-                                    bool found = false;
-                                    for (int cp = 0; cp <= hcl - part_char_len && !found; cp++) {
-                                        int bo = biscuit_utf8_char_to_byte_offset(hay, hbl, cp);
-                                        if (bo < 0) continue;
-                                        if (biscuit_part_match_substr(hay, hbl, bo,
-                                                parsed->parts[0], parsed->part_byte_lens[0]))
-                                            found = true;
-                                    }
-                                    if (found) biscuit_roaring_add(result, rec);
-                                }
-                                roaring_uint32_iterator_advance(iter);
-                            }
-                            roaring_uint32_iterator_free(iter);
-                        }
-                        #else
                         {
-                            uint64_t cnt;
-                            uint32_t *indices = biscuit_roaring_to_array(candidates, &cnt);
-                            if (indices) {
-                                for (int j = 0; j < (int) cnt; j++) {
-                                    uint32_t rec = indices[j];
-                                    if (rec < (uint32_t) idx->num_records && idx->data_cache[rec]) {
-                                        const char *hay = idx->data_cache[rec];
-                                        int hbl = strlen(hay), hcl = biscuit_utf8_char_count(hay, hbl);
-                                        bool found = false;
-                                        for (int cp = 0; cp <= hcl - part_char_len && !found; cp++) {
-                                            int bo = biscuit_utf8_char_to_byte_offset(hay, hbl, cp);
-                                            if (bo < 0) continue;
-                                            if (biscuit_part_match_substr(hay, hbl, bo,
-                                                    parsed->parts[0], parsed->part_byte_lens[0]))
-                                                found = true;
-                                        }
-                                        if (found) biscuit_roaring_add(result, rec);
-                                    }
-                                }
-                                pfree(indices);
-                            }
+                            BiscuitLikePlan *plan = biscuit_like_compile(pattern, plen);
+
+                            biscuit_verify_substring(result, candidates, idx->data_cache,
+                                                     idx->num_records, plan);
+                            biscuit_like_free(plan);
                         }
-                        #endif
                         biscuit_roaring_free(candidates);
                     }
                 }
@@ -1879,7 +1944,13 @@ biscuit_query_pattern(BiscuitIndex *idx, const char *pattern)
                     RoaringBitmap *first = biscuit_match_part_at_pos(idx, parsed->parts[0], parsed->part_byte_lens[0], 0);
                     if (first) { biscuit_roaring_and_inplace(first, candidates); biscuit_roaring_free(candidates); candidates = first; }
                 }
-                if (!biscuit_roaring_is_empty(candidates)) {
+                biscuit_filter_parts_rarest_first(idx->char_cache_legacy, idx->trigrams_legacy,
+                                                  parsed, parsed->starts_percent ? 0 : 1,
+                                                  candidates);
+                if (!biscuit_roaring_is_empty(candidates) &&
+                    !biscuit_verify_survivors(result, candidates,
+                                              idx->options.store_strings ? idx->data_cache : NULL,
+                                              idx->num_records, pattern)) {
                     biscuit_recursive_windowed_match(result, idx,
                         (const char **) parsed->parts, parsed->part_byte_lens, parsed->part_count,
                         parsed->ends_percent, 0, 0, candidates, idx->max_len);
@@ -1935,11 +2006,7 @@ biscuit_query_pattern_ilike(BiscuitIndex *idx, const char *pattern)
             result = biscuit_roaring_create();
             for (i = 0; i < idx->num_records; i++) {
                 bool ts = false;
-#ifdef HAVE_ROARING
-                ts = roaring_bitmap_contains(idx->tombstones, (uint32_t) i);
-#else
-                { uint32_t bl = i >> 6, bt = i & 63; ts = ((int) bl < idx->tombstones->num_blocks && (idx->tombstones->blocks[bl] & (1ULL << bt))); }
-#endif
+                ts = biscuit_roaring_contains(idx->tombstones, (uint32_t) i);
                 if (!ts && idx->data_cache_lower && idx->data_cache_lower[i]) biscuit_roaring_add(result, i);
             }
         }
@@ -1967,11 +2034,7 @@ biscuit_query_pattern_ilike(BiscuitIndex *idx, const char *pattern)
             result = biscuit_roaring_create();
             for (i = 0; i < idx->num_records; i++) {
                 bool ts = false;
-#ifdef HAVE_ROARING
-                ts = roaring_bitmap_contains(idx->tombstones, (uint32_t) i);
-#else
-                { uint32_t bl = i >> 6, bt = i & 63; ts = ((int) bl < idx->tombstones->num_blocks && (idx->tombstones->blocks[bl] & (1ULL << bt))); }
-#endif
+                ts = biscuit_roaring_contains(idx->tombstones, (uint32_t) i);
                 if (!ts) biscuit_roaring_add(result, i);
             }
             biscuit_free_parsed_pattern(parsed); parsed = NULL; /* FIX 5 */ pfree(pl); return result;
@@ -2003,39 +2066,15 @@ biscuit_query_pattern_ilike(BiscuitIndex *idx, const char *pattern)
                     int pcl = parsed->part_lens[0];
                     RoaringBitmap *lf = biscuit_get_length_ge_lower(idx, pcl);
                     if (lf) { biscuit_roaring_and_inplace(candidates, lf); biscuit_roaring_free(lf); }
-                    #ifdef HAVE_ROARING
-                    { roaring_uint32_iterator_t *iter = roaring_iterator_create(candidates);
-                      while (iter->has_value) { uint32_t rec = iter->current_value;
-                        if (rec < (uint32_t) idx->num_records && idx->data_cache_lower && idx->data_cache_lower[rec]) {
-                            const char *hay = idx->data_cache_lower[rec];
-                            int hbl = strlen(hay), hcl = biscuit_utf8_char_count(hay, hbl);
-                            bool found = false;
-                            for (int cp = 0; cp <= hcl - pcl && !found; cp++) {
-                                int bo = biscuit_utf8_char_to_byte_offset(hay, hbl, cp);
-                                if (bo >= 0 && biscuit_part_match_substr(hay, hbl, bo,
-                                        parsed->parts[0], parsed->part_byte_lens[0]))
-                                    found = true;
-                            }
-                            if (found) biscuit_roaring_add(result, rec);
-                        }
-                        roaring_uint32_iterator_advance(iter); }
-                      roaring_uint32_iterator_free(iter); }
-                    #else
-                    { uint64_t cnt; uint32_t *indices = biscuit_roaring_to_array(candidates, &cnt);
-                      if (indices) { for (int j = 0; j < (int) cnt; j++) { uint32_t rec = indices[j];
-                            if (rec < (uint32_t) idx->num_records && idx->data_cache_lower && idx->data_cache_lower[rec]) {
-                                const char *hay = idx->data_cache_lower[rec];
-                                int hbl = strlen(hay), hcl = biscuit_utf8_char_count(hay, hbl);
-                                bool found = false;
-                                for (int cp = 0; cp <= hcl - pcl && !found; cp++) {
-                                    int bo = biscuit_utf8_char_to_byte_offset(hay, hbl, cp);
-                                    if (bo >= 0 && biscuit_part_match_substr(hay, hbl, bo,
-                                            parsed->parts[0], parsed->part_byte_lens[0]))
-                                        found = true;
-                                }
-                                if (found) biscuit_roaring_add(result, rec); } }
-                          pfree(indices); } }
-                    #endif
+                    biscuit_trigram_filter(idx->trigrams_legacy, parsed->parts[0],
+                                           parsed->part_byte_lens[0], candidates);
+                    {
+                        BiscuitLikePlan *plan = biscuit_like_compile(pl, plen);
+
+                        biscuit_verify_substring(result, candidates, idx->data_cache_lower,
+                                                 idx->num_records, plan);
+                        biscuit_like_free(plan);
+                    }
                     biscuit_roaring_free(candidates);
                 }
             }
@@ -2054,7 +2093,13 @@ biscuit_query_pattern_ilike(BiscuitIndex *idx, const char *pattern)
             candidates = biscuit_get_length_ge_lower(idx, min_len);
             if (candidates && !biscuit_roaring_is_empty(candidates)) {
                 if (!parsed->starts_percent) { RoaringBitmap *first = biscuit_match_part_at_pos_ilike(idx, parsed->parts[0], parsed->part_byte_lens[0], 0); if (first) { biscuit_roaring_and_inplace(first, candidates); biscuit_roaring_free(candidates); candidates = first; } }
-                if (!biscuit_roaring_is_empty(candidates))
+                biscuit_filter_parts_rarest_first(idx->char_cache_lower, idx->trigrams_legacy,
+                                                  parsed, parsed->starts_percent ? 0 : 1,
+                                                  candidates);
+                if (!biscuit_roaring_is_empty(candidates) &&
+                    !biscuit_verify_survivors(result, candidates,
+                                              idx->options.store_strings ? idx->data_cache_lower : NULL,
+                                              idx->num_records, pl))
                     biscuit_recursive_windowed_match_ilike(result, idx, (const char **) parsed->parts, parsed->part_byte_lens, parsed->part_count, parsed->ends_percent, 0, 0, candidates, idx->max_length_lower);
                 biscuit_roaring_free(candidates);
             } else if (candidates) biscuit_roaring_free(candidates);
@@ -2148,63 +2193,31 @@ biscuit_query_column_pattern(BiscuitIndex *idx, int col_idx, const char *pattern
                 /*
                  * Substring LIKE: %needle%
                  * Seed candidates from char_cache[first_byte] (case-sensitive),
-                 * filter by minimum length, then verify with strstr.
+                 * filter by minimum length, then verify with the compiled pattern.
                  */
                 result = biscuit_roaring_create();
                 if (parsed->part_byte_lens[0] > 0)
                 {
-                    unsigned char  fb    = (unsigned char) parsed->parts[0][0];
-                    RoaringBitmap *cands = col->char_cache[fb]
-                                          ? biscuit_roaring_copy(col->char_cache[fb])
-                                          : biscuit_roaring_create();
+                    unsigned char  fb    = biscuit_part_seed_byte(parsed->parts[0],
+                                                                  parsed->part_byte_lens[0]);
+                    RoaringBitmap *cands = fb == 0 ? biscuit_get_col_length_ge(col, 0)   /* all '_' */
+                                         : col->char_cache[fb] ? biscuit_roaring_copy(col->char_cache[fb])
+                                         : biscuit_roaring_create();
                     int            pcl   = parsed->part_lens[0];
                     RoaringBitmap *lf    = biscuit_get_col_length_ge(col, pcl);
 
                     if (lf) { biscuit_roaring_and_inplace(cands, lf); biscuit_roaring_free(lf); }
+                    biscuit_trigram_filter(col->trigrams, parsed->parts[0],
+                                           parsed->part_byte_lens[0], cands);
 
-#ifdef HAVE_ROARING
-                    {
-                        roaring_uint32_iterator_t *iter = roaring_iterator_create(cands);
-                        while (iter->has_value)
-                        {
-                            uint32_t    rec = iter->current_value;
-                            const char *hay;
-                            if (rec < (uint32_t) idx->num_records &&
-                                idx->column_data_cache &&
-                                idx->column_data_cache[col_idx] &&
-                                (hay = idx->column_data_cache[col_idx][rec]) != NULL)
-                            {
-                                if (strstr(hay, parsed->parts[0]) != NULL)
-                                    biscuit_roaring_add(result, rec);
-                            }
-                            roaring_uint32_iterator_advance(iter);
-                        }
-                        roaring_uint32_iterator_free(iter);
-                    }
-#else
                     {
-                        uint64_t  cnt;
-                        uint32_t *indices = biscuit_roaring_to_array(cands, &cnt);
-                        if (indices)
-                        {
-                            int j;
-                            for (j = 0; j < (int) cnt; j++)
-                            {
-                                uint32_t    rec = indices[j];
-                                const char *hay;
-                                if (rec < (uint32_t) idx->num_records &&
-                                    idx->column_data_cache &&
-                                    idx->column_data_cache[col_idx] &&
-                                    (hay = idx->column_data_cache[col_idx][rec]) != NULL)
-                                {
-                                    if (strstr(hay, parsed->parts[0]) != NULL)
-                                        biscuit_roaring_add(result, rec);
-                                }
-                            }
-                            pfree(indices);
-                        }
+                        BiscuitLikePlan *plan = biscuit_like_compile(pattern, plen);
+
+                        biscuit_verify_substring(result, cands,
+                                                 idx->column_data_cache ? idx->column_data_cache[col_idx] : NULL,
+                                                 idx->num_records, plan);
+                        biscuit_like_free(plan);
                     }
-#endif
                     biscuit_roaring_free(cands);
                 }
             }
@@ -2223,7 +2236,13 @@ biscuit_query_column_pattern(BiscuitIndex *idx, int col_idx, const char *pattern
             cands = biscuit_get_col_length_ge(col, min_len);
             if (cands && !biscuit_roaring_is_empty(cands)) {
                 if (!parsed->starts_percent) { RoaringBitmap *first = biscuit_match_col_part_at_pos(col, parsed->parts[0], parsed->part_byte_lens[0], 0); if (first) { biscuit_roaring_and_inplace(first, cands); biscuit_roaring_free(cands); cands = first; } }
-                if (!biscuit_roaring_is_empty(cands))
+                biscuit_filter_parts_rarest_first(col->char_cache, col->trigrams,
+                                                  parsed, parsed->starts_percent ? 0 : 1, cands);
+                if (!biscuit_roaring_is_empty(cands) &&
+                    !biscuit_verify_survivors(result, cands,
+                                              idx->options.store_strings && idx->column_data_cache
+                                                  ? idx->column_data_cache[col_idx] : NULL,
+                                              idx->num_records, pattern))
                     biscuit_recursive_windowed_match_col(result, col, (const char **) parsed->parts, parsed->part_byte_lens, parsed->part_count, parsed->ends_percent, 0, 0, cands, col->max_length);
                 biscuit_roaring_free(cands);
             } else if (cands) biscuit_roaring_free(cands);
@@ -2303,76 +2322,32 @@ biscuit_query_column_pattern_ilike(BiscuitIndex *idx, int col_idx, const char *p
                  * pl (the pattern) has already been fully lowercased above.
                  * parsed->parts[0] is therefore also lowercase.
                  * Seed candidates from char_cache_lower[first_byte_of_lowercase_needle],
-                 * filter by minimum length, then verify with strstr against the
-                 * lowercased data cache (column_data_cache holds the original strings;
-                 * we lowercase on the fly per candidate, which is cheap because
-                 * char_cache_lower has already pruned the candidate set to only rows
-                 * that contain the first character of the needle).
+                 * filter by minimum length, then verify the lowercased pattern
+                 * against column_data_cache_lower.
                  */
                 result = biscuit_roaring_create();
                 if (parsed->part_byte_lens[0] > 0)
                 {
-                    unsigned char  fb    = (unsigned char) parsed->parts[0][0]; /* lowercase first byte */
-                    RoaringBitmap *cands = col->char_cache_lower[fb]
-                                          ? biscuit_roaring_copy(col->char_cache_lower[fb])
-                                          : biscuit_roaring_create();
+                    unsigned char  fb    = biscuit_part_seed_byte(parsed->parts[0],
+                                                                  parsed->part_byte_lens[0]);
+                    RoaringBitmap *cands = fb == 0 ? biscuit_get_col_length_ge_lower(col, 0)   /* all '_' */
+                                         : col->char_cache_lower[fb] ? biscuit_roaring_copy(col->char_cache_lower[fb])
+                                         : biscuit_roaring_create();
                     int            pcl   = parsed->part_lens[0];
                     RoaringBitmap *lf    = biscuit_get_col_length_ge_lower(col, pcl);
 
                     if (lf) { biscuit_roaring_and_inplace(cands, lf); biscuit_roaring_free(lf); }
+                    biscuit_trigram_filter(col->trigrams, parsed->parts[0],
+                                           parsed->part_byte_lens[0], cands);
 
-#ifdef HAVE_ROARING
-                    {
-                        roaring_uint32_iterator_t *iter = roaring_iterator_create(cands);
-                        while (iter->has_value)
-                        {
-                            uint32_t    rec = iter->current_value;
-                            const char *hay;
-                            /*
-                             * Use the pre-lowercased cache populated at build /
-                             * skeleton-load / insert time.  This avoids a
-                             * palloc + tolower + pfree per candidate — the hot
-                             * path inside an already bitmap-pruned set.
-                             * column_data_cache_lower mirrors column_data_cache
-                             * slot-for-slot; a NULL entry means the source value
-                             * was NULL, so the same guard applies.
-                             */
-                            if (rec < (uint32_t) idx->num_records &&
-                                idx->column_data_cache_lower &&
-                                idx->column_data_cache_lower[col_idx] &&
-                                (hay = idx->column_data_cache_lower[col_idx][rec]) != NULL)
-                            {
-                                if (strstr(hay, parsed->parts[0]) != NULL)
-                                    biscuit_roaring_add(result, rec);
-                            }
-                            roaring_uint32_iterator_advance(iter);
-                        }
-                        roaring_uint32_iterator_free(iter);
-                    }
-#else
                     {
-                        uint64_t  cnt;
-                        uint32_t *indices = biscuit_roaring_to_array(cands, &cnt);
-                        if (indices)
-                        {
-                            int j;
-                            for (j = 0; j < (int) cnt; j++)
-                            {
-                                uint32_t    rec = indices[j];
-                                const char *hay;
-                                if (rec < (uint32_t) idx->num_records &&
-                                    idx->column_data_cache_lower &&
-                                    idx->column_data_cache_lower[col_idx] &&
-                                    (hay = idx->column_data_cache_lower[col_idx][rec]) != NULL)
-                                {
-                                    if (strstr(hay, parsed->parts[0]) != NULL)
-                                        biscuit_roaring_add(result, rec);
-                                }
-                            }
-                            pfree(indices);
-                        }
+                        BiscuitLikePlan *plan = biscuit_like_compile(pl, plen);
+
+                        biscuit_verify_substring(result, cands,
+                                                 idx->column_data_cache_lower ? idx->column_data_cache_lower[col_idx] : NULL,
+                                                 idx->num_records, plan);
+                        biscuit_like_free(plan);
                     }
-#endif
                     biscuit_roaring_free(cands);
                 }
             }
@@ -2387,7 +2362,13 @@ biscuit_query_column_pattern_ilike(BiscuitIndex *idx, int col_idx, const char *p
             cands = biscuit_get_col_length_ge_lower(col, min_len);
             if (cands && !biscuit_roaring_is_empty(cands)) {
                 if (!parsed->starts_percent) { RoaringBitmap *first = biscuit_match_col_part_at_pos_ilike(col, parsed->parts[0], parsed->part_byte_lens[0], 0); if (first) { biscuit_roaring_and_inplace(first, cands); biscuit_roaring_free(cands); cands = first; } }
-                if (!biscuit_roaring_is_empty(cands))
+                biscuit_filter_parts_rarest_first(col->char_cache_lower, col->trigrams,
+                                                  parsed, parsed->starts_percent ? 0 : 1, cands);
+                if (!biscuit_roaring_is_empty(cands) &&
+                    !biscuit_verify_survivors(result, cands,
+                                              idx->options.store_strings && idx->column_data_cache_lower
+                                                  ? idx->column_data_cache_lower[col_idx] : NULL,
+                                              idx->num_records, pl))
                     biscuit_recursive_windowed_match_col_ilike(result, col, (const char **) parsed->parts, parsed->part_byte_lens, parsed->part_count, parsed->ends_percent, 0, 0, cands, col->max_length_lower);
                 biscuit_roaring_free(cands);
             } else if (cands) biscuit_roaring_free(cands);
@@ -2457,11 +2438,103 @@ analyze_pattern(QueryPredicate *pred)
     if (pred->selectivity_score > 1.0) pred->selectivity_score = 1.0;
 }
 
+static uint64
+biscuit_probe_count(const RoaringBitmap *bm)
+{
+    return bm ? biscuit_roaring_count(bm) : 0;
+}
+
+/*
+ * Upper bound on the records a predicate can match, from the cardinality
+ * of bitmaps the query itself would have to intersect: every concrete
+ * byte's char_cache, the position-0 / -1 bitmap of an anchored first /
+ * last byte, and the length_ge bitmap of the minimum length.  Each probe
+ * is a container-count walk, so this is cheap next to evaluating the
+ * predicate.  NOT LIKE gets the complement of that bound.
+ */
+static uint64
+biscuit_estimate_predicate(BiscuitIndex *idx, QueryPredicate *pred)
+{
+    ColumnIndex    *col = &idx->column_indices[pred->column_index];
+    int             strategy = pred->scan_key->sk_strategy;
+    bool            is_ilike = (strategy == BISCUIT_ILIKE_STRATEGY ||
+                                strategy == BISCUIT_NOT_ILIKE_STRATEGY);
+    bool            is_not   = (strategy == BISCUIT_NOT_LIKE_STRATEGY ||
+                                strategy == BISCUIT_NOT_ILIKE_STRATEGY);
+    RoaringBitmap **char_cache = is_ilike ? col->char_cache_lower : col->char_cache;
+    RoaringBitmap **length_ge  = is_ilike ? col->length_ge_bitmaps_lower : col->length_ge_bitmaps;
+    int             max_length = is_ilike ? col->max_length_lower : col->max_length;
+    uint64          total = (uint64) idx->num_records;
+    uint64          est   = total;
+    char           *pat;
+    ParsedPattern  *parsed;
+    int             min_len = 0;
+    int             i, j;
+
+    pat = is_ilike ? biscuit_str_tolower(pred->pattern, strlen(pred->pattern))
+                   : pstrdup(pred->pattern);
+    parsed = biscuit_parse_pattern(pat);
+
+    for (i = 0; i < parsed->part_count && est > 0; i++)
+    {
+        const char *part = parsed->parts[i];
+        int         blen = parsed->part_byte_lens[i];
+
+        min_len += parsed->part_lens[i];
+
+        for (j = 0; j < blen && est > 0; j++)
+        {
+            unsigned char c = (unsigned char) part[j];
+
+            if (c == (unsigned char) BISCUIT_LITERAL_ESC && j + 1 < blen)
+                c = (unsigned char) part[++j];
+            else if (c == '_')
+                continue;
+
+            est = Min(est, biscuit_probe_count(char_cache[c]));
+        }
+    }
+
+    if (parsed->part_count > 0 && est > 0)
+    {
+        const char *first = parsed->parts[0];
+        const char *last  = parsed->parts[parsed->part_count - 1];
+        int         lblen = parsed->part_byte_lens[parsed->part_count - 1];
+
+        if (!parsed->starts_percent && parsed->part_byte_lens[0] > 0 &&
+            first[0] != '_' && first[0] != BISCUIT_LITERAL_ESC)
+        {
+            RoaringBitmap *bm = is_ilike
+                ? biscuit_get_col_pos_bitmap_lower(col, (unsigned char) first[0], 0)
+                : biscuit_get_col_pos_bitmap(col, (unsigned char) first[0], 0);
+            est = Min(est, biscuit_probe_count(bm));
+        }
+        if (!parsed->ends_percent && lblen > 0 && last[lblen - 1] != '_' &&
+            (lblen < 2 || last[lblen - 2] != BISCUIT_LITERAL_ESC))
+        {
+            RoaringBitmap *bm = is_ilike
+                ? biscuit_get_col_neg_bitmap_lower(col, (unsigned char) last[lblen - 1], -1)
+                : biscuit_get_col_neg_bitmap(col, (unsigned char) last[lblen - 1], -1);
+            est = Min(est, biscuit_probe_count(bm));
+        }
+    }
+
+    if (est > 0 && length_ge)
+        est = Min(est, (min_len < max_length) ? biscuit_probe_count(length_ge[Max(min_len, 0)]) : 0);
+
+    biscuit_free_parsed_pattern(parsed);
+    pfree(pat);
+
+    return is_not ? total - Min(est, total) : est;
+}
+
 static int
 compare_predicates(const void *a, const void *b)
 {
     const QueryPredicate *pa = (const QueryPredicate *) a;
     const QueryPredicate *pb = (const QueryPredicate *) b;
+    if (pa->estimated_count < pb->estimated_count) return -1;
+    if (pa->estimated_count > pb->estimated_count) return  1;
     if (pa->selectivity_score < pb->selectivity_score) return -1;
     if (pa->selectivity_score > pb->selectivity_score) return  1;
     return 0;
@@ -2473,8 +2546,6 @@ biscuit_build_query_plan(BiscuitIndex *idx, ScanKey keys, int nkeys)
     QueryPlan *plan;
     int        i;
 
-    (void) idx;  /* reserved for future cardinality-aware planning */
-
     plan            = (QueryPlan *) palloc(sizeof(QueryPlan));
     plan->predicates = (QueryPredicate *) palloc(nkeys * sizeof(QueryPredicate));
     plan->count     = 0;
@@ -2491,16 +2562,39 @@ biscuit_build_query_plan(BiscuitIndex *idx, ScanKey keys, int nkeys)
         pred->column_index = key->sk_attno - 1;
         pred->scan_key     = key;
 
+        /*
+         * An array key ORs several patterns (biscuit_keys_rewrite); it is
+         * ordered as the match-anything pattern, which bounds them all.
+         */
+        if (key->sk_flags & SK_SEARCHARRAY)
+            pred->pattern = pstrdup("%");
+        else
         {
             text *pt = DatumGetTextPP(key->sk_argument);
             pred->pattern = pstrdup(text_to_cstring(pt));
         }
 
         analyze_pattern(pred);
+
+        /*
+         * Cardinality probe; without bitmaps (or for a column the index
+         * does not have, or a pattern its options leave unindexed) only
+         * the pattern-shape heuristic is left.
+         */
+        pred->estimated_count = PG_UINT64_MAX;
+        if (idx && idx->column_indices && idx->num_columns > 1 &&
+            idx->preload_state >= BISCUIT_PRELOAD_DONE &&
+            pred->column_index >= 0 && pred->column_index < idx->num_columns &&
+            biscuit_pattern_support(&idx->options,
+                                    key->sk_strategy == BISCUIT_ILIKE_STRATEGY ||
+                                    key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY,
+                                    pred->pattern) == BISCUIT_SUPPORT_BITMAP)
+            pred->estimated_count = biscuit_estimate_predicate(idx, pred);
+
         plan->count++;
     }
 
-    /* Sort by selectivity: most selective first */
+    /* Sort by estimated matches, pattern heuristic as tie-break */
     if (plan->count > 1)
         qsort(plan->predicates, plan->count, sizeof(QueryPredicate), compare_predicates);
 
@@ -2535,3 +2629,154 @@ biscuit_free_query_plan(QueryPlan *plan)
     }
     PG_END_TRY();
 }
+
+/* ================================================================
+ * SECTION 11 – Index options
+ * ================================================================
+ *
+ * An index built with some bitmap families turned off (biscuit_options)
+ * still answers every pattern.  biscuit_pattern_support() tells whether
+ * the families that were built answer it exactly; where they do not,
+ * biscuit_query_unindexed() narrows the live records with what is there
+ * (case-sensitive lengths, the character caches) and either verifies the
+ * rest against the cached strings or leaves them to the executor.
+ */
+
+/* A part of char_len characters lies within the indexed positions */
+static bool
+biscuit_options_within(const BiscuitOptions *options, int char_len)
+{
+    return options->max_indexed_chars == 0 || char_len <= options->max_indexed_chars;
+}
+
+int
+biscuit_pattern_support(const BiscuitOptions *options, bool ilike, const char *pattern)
+{
+    bool           built    = ilike ? options->ilike : options->like;
+    int            fallback = options->store_strings ? BISCUIT_SUPPORT_VERIFY
+                                                     : BISCUIT_SUPPORT_RECHECK;
+    ParsedPattern *parsed;
+    const char    *p;
+    bool           ok;
+
+    if (!built)
+        return fallback;
+    if (options->max_indexed_chars == 0 && options->suffix_index && options->store_strings)
+        return BISCUIT_SUPPORT_BITMAP;
+
+    /* '', '%', '___' and the like are answered by the length bitmaps */
+    for (p = pattern; *p == '%' || *p == '_'; p++)
+        ;
+    if (*p == '\0')
+        return BISCUIT_SUPPORT_BITMAP;
+
+    /* Lowercasing keeps the wildcards and character counts the shape depends on */
+    parsed = biscuit_parse_pattern(pattern);
+
+    if (parsed->part_count == 0)
+        ok = true;
+    else if (parsed->part_count == 1 && !parsed->starts_percent)
+        ok = biscuit_options_within(options, parsed->part_lens[0]);
+    else if (parsed->part_count == 1 && !parsed->ends_percent)
+        ok = options->suffix_index && biscuit_options_within(options, parsed->part_lens[0]);
+    else if (parsed->part_count == 1)
+        ok = options->store_strings;        /* '%abc%' verifies against the strings */
+    else if (parsed->part_count == 2 && !parsed->starts_percent && !parsed->ends_percent)
+        ok = options->suffix_index &&
+             biscuit_options_within(options, parsed->part_lens[0]) &&
+             biscuit_options_within(options, parsed->part_lens[1]);
+    else
+        ok = options->max_indexed_chars == 0 &&
+             (parsed->ends_percent || options->suffix_index);
+
+    biscuit_free_parsed_pattern(parsed);
+
+    return ok ? BISCUIT_SUPPORT_BITMAP : fallback;
+}
+
+RoaringBitmap *
+biscuit_query_unindexed(BiscuitIndex *idx, int col, bool ilike, const char *pattern,
+                        bool verify)
+{
+    bool            multi = idx->num_columns > 1;
+    ColumnIndex    *cidx  = multi ? &idx->column_indices[col] : NULL;
+    bool            built = ilike ? idx->options.ilike : idx->options.like;
+    bool            lower = ilike && idx->options.ilike;
+    RoaringBitmap **char_cache = NULL;
+    RoaringBitmap  *result;
+    char           *pat;
+    ParsedPattern  *parsed;
+    int             min_len = 0;
+    int             i, j;
+
+    pat = ilike ? biscuit_str_tolower(pattern, strlen(pattern)) : pstrdup(pattern);
+    parsed = biscuit_parse_pattern(pat);
+
+    for (i = 0; i < parsed->part_count; i++)
+        min_len += parsed->part_lens[i];
+
+    /* Case folding keeps character counts, so either side's lengths serve */
+    if (multi)
+        result = lower ? biscuit_get_col_length_ge_lower(cidx, min_len)
+                       : biscuit_get_col_length_ge(cidx, min_len);
+    else
+        result = lower ? biscuit_get_length_ge_lower(idx, min_len)
+                       : biscuit_get_length_ge(idx, min_len);
+
+    if (built)
+        char_cache = multi ? (ilike ? cidx->char_cache_lower : cidx->char_cache)
+                           : (ilike ? idx->char_cache_lower : idx->char_cache_legacy);
+
+    /* Every concrete byte of the pattern occurs somewhere in a match */
+    for (i = 0; char_cache && i < parsed->part_count && !biscuit_roaring_is_empty(result); i++)
+    {
+        const char *part = parsed->parts[i];
+        int         blen = parsed->part_byte_lens[i];
+
+        for (j = 0; j < blen; j++)
+        {
+            unsigned char c = (unsigned char) part[j];
+
+            if (c == (unsigned char) BISCUIT_LITERAL_ESC && j + 1 < blen)
+                c = (unsigned char) part[++j];
+            else if (c == '_')
+                continue;
+
+            if (!char_cache[c])
+            {
+                biscuit_roaring_free(result);
+                result = biscuit_roaring_create();
+                break;
+            }
+            biscuit_roaring_and_inplace(result, char_cache[c]);
+        }
+    }
+
+    if (verify && !biscuit_roaring_is_empty(result))
+    {
+        uint64_t  count;
+        uint32_t        *recs = biscuit_roaring_to_array(result, &count);
+        BiscuitLikePlan *plan = biscuit_like_compile(pat, strlen(pat));
+
+        for (j = 0; recs && j < (int) count; j++)
+        {
+            const char *str;
+            char       *to_free;
+            int         len;
+
+            str = biscuit_record_string(idx, col, ilike, recs[j], &len, &to_free);
+            if (!str || !biscuit_like_exec(plan, str, len))
+                biscuit_roaring_remove(result, recs[j]);
+            if (to_free)
+                pfree(to_free);
+        }
+        if (recs)
+            pfree(recs);
+        biscuit_like_free(plan);
+    }
+
+    biscuit_free_parsed_pattern(parsed);
+    pfree(pat);
+
+    return result;
+}
@@ -69,6 +69,25 @@ extern RoaringBitmap *biscuit_query_column_pattern_ilike(BiscuitIndex *idx,
                                                          int col_idx,
                                                          const char *pattern);
 
+/* ==================== INDEX OPTIONS ==================== */
+
+/* How the bitmap families an index was built with answer a pattern */
+#define BISCUIT_SUPPORT_BITMAP   0  /* exactly, by the query functions above */
+#define BISCUIT_SUPPORT_VERIFY   1  /* by checking candidates against the cached strings */
+#define BISCUIT_SUPPORT_RECHECK  2  /* only as a superset the executor rechecks */
+
+/* Support for pattern under LIKE (ilike false) or ILIKE */
+extern int            biscuit_pattern_support(const BiscuitOptions *options, bool ilike,
+                                              const char *pattern);
+
+/*
+ * Records of column col that may match pattern, from the length and
+ * character-cache bitmaps alone; with verify, exactly those that match,
+ * checked against the cached strings.  Not tombstone-filtered.
+ */
+extern RoaringBitmap *biscuit_query_unindexed(BiscuitIndex *idx, int col, bool ilike,
+                                              const char *pattern, bool verify);
+
 /* ==================== QUERY PLAN / OPTIMIZER ==================== */
 
 extern QueryPlan *biscuit_build_query_plan(BiscuitIndex *idx,
@@ -0,0 +1,284 @@
+/*
+ * biscuit_pending.c
+ * Pending list of inserted records, merged into the bitmaps in bulk.
+ *
+ * Indexing one record in aminsert updates a position, negative-position
+ * and character-cache bitmap for every byte of every value, on both case
+ * sides, plus the length bitmaps.  A COPY into an indexed table paid that
+ * per row.  As GIN's fastupdate does, aminsert now only caches the values
+ * of the new record (it still gets its slot and TID at once) and adds the
+ * slot to idx->pending:
+ *
+ *   queries    biscuit_result_cache_evaluate() ORs the pending records
+ *              matching the pattern, checked with the compiled matcher,
+ *              into the bitmap result, and NOT LIKE widens its universe
+ *              with the pending records that have a value.  Cached
+ *              results are patched on insert as before, so they stay
+ *              exact across merges.
+ *   merges     once the values of the pending records exceed
+ *              pending_list_limit (the index option, else
+ *              biscuit.pending_list_limit), and in VACUUM and before a
+ *              snapshot is written, every pending record goes through the
+ *              batched loader (biscuit_bulk_begin_append()).
+ *
+ * Queries check pending records against their strings, so an index with
+ * store_strings = off indexes every insert directly.  The list lives in
+ * the backend's copy of the index like every other change made through
+ * it.  A view of a shared image keeps its changes on the list until the
+ * next snapshot replaces the image (see biscuit_shared.c).
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_arena.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_bulk.h"
+#include "biscuit_index.h"     /* biscuit_record_string */
+#include "biscuit_like.h"
+#include "biscuit_pending.h"
+#include "biscuit_shared.h"    /* BiscuitIndexIsShared */
+#include "biscuit_utf8.h"
+
+#include "utils/guc.h"
+
+int biscuit_pending_list_limit = 4096;     /* kB */
+
+void
+biscuit_pending_init(void)
+{
+    DefineCustomIntVariable("biscuit.pending_list_limit",
+                            "Size of the pending list of inserted records before it is merged.",
+                            "Inserts cache their values and defer bitmap maintenance until "
+                            "then.  0 indexes every insert directly.  Overridden by the "
+                            "pending_list_limit index option.",
+                            &biscuit_pending_list_limit,
+                            4096, 0, MAX_KILOBYTES,
+                            PGC_USERSET,
+                            GUC_UNIT_KB,
+                            NULL, NULL, NULL);
+}
+
+/* ================================================================
+ * SECTION 1 – Insert and merge
+ * ================================================================ */
+
+/* The limit of index in bytes; the option is read from the relation */
+static Size
+biscuit_pending_limit(Relation index)
+{
+    int limit = biscuit_pending_list_limit;
+
+    if (index->rd_options &&
+        ((BiscuitOptions *) index->rd_options)->pending_list_limit >= 0)
+        limit = ((BiscuitOptions *) index->rd_options)->pending_list_limit;
+
+    return (Size) limit * 1024;
+}
+
+bool
+biscuit_pending_accepts(Relation index, const BiscuitIndex *idx)
+{
+    return idx->options.store_strings && biscuit_pending_limit(index) > 0;
+}
+
+void
+biscuit_pending_insert(Relation index, BiscuitIndex *idx,
+                       Datum *values, bool *isnull, uint32 rec)
+{
+    Size bytes = sizeof(ItemPointerData);
+    int  col;
+
+    if (idx->num_columns == 1)
+    {
+        char *str   = NULL;
+        char *lower = NULL;
+
+        if (!isnull[0])
+        {
+            text *txt      = DatumGetTextPP(values[0]);
+            int   byte_len = VARSIZE_ANY_EXHDR(txt);
+
+            str = biscuit_arena_store(&idx->strings_legacy, VARDATA_ANY(txt), byte_len);
+            if (idx->options.ilike)
+                lower = biscuit_arena_store_lower(&idx->strings_legacy, str);
+            bytes += byte_len;
+        }
+        idx->data_cache[rec]       = str;
+        idx->data_cache_lower[rec] = lower;
+    }
+    else
+    {
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            BiscuitStringArena *arena = &idx->column_indices[col].strings;
+            char               *str   = NULL;
+            char               *lower = NULL;
+
+            if (!isnull[col])
+            {
+                int   out_len;
+                char *value = biscuit_datum_to_text(values[col], idx->column_types[col],
+                                                    &idx->output_funcs[col], &out_len);
+
+                str = biscuit_arena_store(arena, value, out_len);
+                pfree(value);
+                if (idx->column_data_cache_lower && idx->options.ilike)
+                    lower = biscuit_arena_store_lower(arena, str);
+                bytes += out_len;
+            }
+            idx->column_data_cache[col][rec] = str;
+            if (idx->column_data_cache_lower)
+                idx->column_data_cache_lower[col][rec] = lower;
+        }
+    }
+
+    if (!idx->pending)
+        idx->pending = biscuit_roaring_create();
+    biscuit_roaring_add(idx->pending, rec);
+    idx->pending_bytes += bytes;
+
+    /* A shared view's bitmaps are the image's: its list is never merged */
+    if (idx->pending_bytes >= biscuit_pending_limit(index) && !BiscuitIndexIsShared(idx))
+        biscuit_pending_flush(idx);
+}
+
+void
+biscuit_pending_flush(BiscuitIndex *idx)
+{
+    MemoryContext      oldcontext;
+    BiscuitBulkLoader *bulk;
+    uint32_t          *recs;
+    uint64_t           count;
+    uint64_t           i;
+    int                col;
+
+    if (!idx->pending || biscuit_roaring_is_empty(idx->pending))
+        return;
+
+    /* The bitmaps of a private copy live in its own memory context */
+    oldcontext = MemoryContextSwitchTo(BiscuitIndexMemoryContext(idx));
+
+    recs = biscuit_roaring_to_array(idx->pending, &count);
+    bulk = biscuit_bulk_begin_append(idx);
+
+    for (i = 0; recs && i < count; i++)
+    {
+        uint32_t rec = recs[i];
+
+        if (biscuit_roaring_contains(idx->tombstones, rec))
+            continue;
+
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            const char *str;
+            const char *lower;
+
+            if (idx->num_columns == 1)
+            {
+                str   = idx->data_cache[rec];
+                lower = idx->data_cache_lower[rec];
+            }
+            else
+            {
+                str   = idx->column_data_cache[col][rec];
+                lower = idx->column_data_cache_lower ? idx->column_data_cache_lower[col][rec]
+                                                     : NULL;
+            }
+
+            if (str)
+                biscuit_bulk_add(bulk, col, str, biscuit_cache_strlen(str),
+                                 lower, lower ? biscuit_cache_strlen(lower) : 0, rec);
+        }
+    }
+
+    biscuit_bulk_finish(bulk);
+    if (recs)
+        pfree(recs);
+
+    elog(DEBUG1, "Biscuit: merged %llu pending records (%zu bytes)",
+         (unsigned long long) count, idx->pending_bytes);
+
+    biscuit_roaring_free(idx->pending);
+    idx->pending       = NULL;
+    idx->pending_bytes = 0;
+    idx->pending_merges++;
+
+    MemoryContextSwitchTo(oldcontext);
+}
+
+/* ================================================================
+ * SECTION 2 – Queries
+ * ================================================================ */
+
+void
+biscuit_pending_add_matches(const BiscuitIndex *idx, int col, bool ilike,
+                            const char *pattern, RoaringBitmap *result)
+{
+    BiscuitLikePlan *plan;
+    uint32_t        *recs;
+    uint64_t         count;
+    uint64_t         i;
+
+    if (!idx->pending || biscuit_roaring_is_empty(idx->pending))
+        return;
+
+    recs = biscuit_roaring_to_array(idx->pending, &count);
+    if (!recs)
+        return;
+
+    if (ilike)
+    {
+        char *lower = biscuit_str_tolower(pattern, strlen(pattern));
+
+        plan = biscuit_like_compile(lower, strlen(lower));
+        pfree(lower);
+    }
+    else
+        plan = biscuit_like_compile(pattern, strlen(pattern));
+
+    for (i = 0; i < count; i++)
+    {
+        const char *str;
+        char       *to_free;
+        int         len;
+
+        str = biscuit_record_string(idx, col, ilike, recs[i], &len, &to_free);
+        if (str && biscuit_like_exec(plan, str, len))
+            biscuit_roaring_add(result, recs[i]);
+        if (to_free)
+            pfree(to_free);
+    }
+
+    biscuit_like_free(plan);
+    pfree(recs);
+}
+
+void
+biscuit_pending_add_valued(const BiscuitIndex *idx, int col, RoaringBitmap *result)
+{
+    uint32_t *recs;
+    uint64_t  count;
+    uint64_t  i;
+
+    if (!idx->pending || biscuit_roaring_is_empty(idx->pending))
+        return;
+
+    recs = biscuit_roaring_to_array(idx->pending, &count);
+    if (!recs)
+        return;
+
+    for (i = 0; i < count; i++)
+    {
+        const char *str = idx->num_columns == 1 ? idx->data_cache[recs[i]]
+                                                : idx->column_data_cache[col][recs[i]];
+
+        if (str)
+            biscuit_roaring_add(result, recs[i]);
+    }
+    pfree(recs);
+}
+
+uint64
+biscuit_pending_count(const BiscuitIndex *idx)
+{
+    return idx->pending ? biscuit_roaring_count(idx->pending) : 0;
+}
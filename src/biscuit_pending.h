@@ -0,0 +1,49 @@
+/*
+ * biscuit_pending.h
+ * Pending list: records inserted by aminsert whose bitmaps are built
+ * later, in bulk, as GIN's fastupdate does for its entry tree.
+ */
+
+#ifndef BISCUIT_PENDING_H
+#define BISCUIT_PENDING_H
+
+#include "biscuit_common.h"
+
+/* biscuit.pending_list_limit, in kB (0 indexes every insert directly) */
+extern int  biscuit_pending_list_limit;
+
+/* Register the GUC (called from _PG_init) */
+extern void biscuit_pending_init(void);
+
+/*
+ * Whether aminsert on index, whose copy in this backend is idx, goes to
+ * the pending list.  Needs the string caches (store_strings) and a
+ * non-zero limit, from the pending_list_limit option or the GUC.
+ */
+extern bool biscuit_pending_accepts(Relation index, const BiscuitIndex *idx);
+
+/*
+ * Cache the values of record rec (slot and TID already assigned) and add
+ * it to the pending list, merging the list once it outgrows the limit.
+ */
+extern void biscuit_pending_insert(Relation index, BiscuitIndex *idx,
+                                   Datum *values, bool *isnull, uint32 rec);
+
+/*
+ * Merge every pending record into the bitmaps through the bulk loader.
+ * Called at the limit, by VACUUM and before a snapshot is written.
+ */
+extern void biscuit_pending_flush(BiscuitIndex *idx);
+
+/* Add to result the pending records whose column col matches pattern */
+extern void biscuit_pending_add_matches(const BiscuitIndex *idx, int col, bool ilike,
+                                        const char *pattern, RoaringBitmap *result);
+
+/* Add to result the pending records with a value in column col */
+extern void biscuit_pending_add_valued(const BiscuitIndex *idx, int col,
+                                       RoaringBitmap *result);
+
+/* Records currently pending */
+extern uint64 biscuit_pending_count(const BiscuitIndex *idx);
+
+#endif /* BISCUIT_PENDING_H */
@@ -10,50 +10,115 @@
  *       zero bitmap overhead (~1-2 ms for 1 M rows vs ~500 ms full load).
  *
  *  2. biscuit_preload_request()    – still in beginscan:
- *       Pushes the index OID into a tiny shmem ring-buffer and pings
- *       the worker latch.  Returns immediately.
+ *       Marks the index SKELETON in the shared state table, appends it
+ *       to the work queue and wakes (or starts) the worker for the
+ *       current database.  Returns immediately.
  *
- *  3. BiscuitPreloadWorker         – background process:
- *       Wakes on latch signal, dequeues an OID, opens the relation,
- *       calls biscuit_complete_preload() which rebuilds all bitmaps
- *       from the already-populated data_cache, then inserts the warm
- *       index into the session cache and sets preload_state = DONE.
+ *  3. BiscuitPreloadWorker         – background processes, a pool of up
+ *       to biscuit.preload_workers per database:
+ *       Each dequeues the index of highest priority, calls
+ *       biscuit_complete_preload() which builds the full index from the
+ *       heap and writes it to the on-disk snapshot (and the shared image
+ *       area, when enabled), then sets the index DONE.  Indexes queued
+ *       by the startup prewarm (biscuit_prewarm.c) go through the same
+ *       queue, behind those a session is waiting on.
  *
- *  4. biscuit_fallback_scan()      – used by rescan while state < DONE:
+ *  4. biscuit_preload_adopt()      – beginscan / rescan after DONE:
+ *       Swaps the skeleton for the worker's snapshot, so no backend
+ *       rebuilds bitmaps that the worker already built.
+ *
+ *  5. biscuit_fallback_scan()      – used by rescan while state < DONE:
  *       Plain strstr / strcasestr walk of data_cache — no bitmaps.
  *       Correct but slower; only used during the warm-up window.
  *
  * Concurrency / safety
  * --------------------
  *  • The skeleton and the fully-loaded index are both allocated in
- *    CacheMemoryContext of their respective backend.  No cross-process
- *    pointer sharing.
- *  • The shared-memory ring-buffer is protected by a LWLock
- *    (BISCUIT_PRELOAD_LWLOCK).
- *  • preload_state is a pg_atomic_uint32 inside the shmem control
- *    block (indexed by OID % 64), not inside BiscuitIndex.  The
- *    foreground backend polls it cheaply before each scan.
+ *    CacheMemoryContext of their respective backend.  Only the
+ *    persisted snapshot (and the shared image built from it) crosses
+ *    process boundaries.
+ *  • Per-index state lives in a shared hash table keyed by (database,
+ *    index OID), sized by biscuit.preload_max_indexes, so distinct
+ *    indexes never share a slot.  Pending entries are linked into a
+ *    queue through the entries themselves.  Table, queue and worker
+ *    slots are protected by one LWLock (BiscuitPreloadLock).
  */
 
 #include "biscuit_common.h"
+#include "biscuit_arena.h"
 #include "biscuit_bitmap.h"
+#include "biscuit_bulk.h"
 #include "biscuit_cache.h"
+#include "biscuit_changelog.h"
 #include "biscuit_index.h"
+#include "biscuit_like.h"
 #include "biscuit_pattern.h"
 #include "biscuit_utf8.h"
 #include "biscuit_preload.h"
+#include "biscuit_prewarm.h"
+#include "biscuit_shared.h"
+#include "biscuit_storage.h"
+#include "biscuit_tid.h"
+#include "biscuit_trigram.h"
+
+#include "access/xlog.h"
+#include "catalog/pg_class.h"
+#include "commands/defrem.h"
+#include "lib/ilist.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/syscache.h"
 
 
 #ifndef WAIT_EVENT_BGWORKER_MAIN
 #define WAIT_EVENT_BGWORKER_MAIN 0
 #endif
+
+/* An idle worker exits after this long; it is restarted on demand */
+#define BISCUIT_PRELOAD_IDLE_TIMEOUT_MS 60000L
+
+int biscuit_preload_max_indexes = 4096;
+int biscuit_preload_workers     = 2;
+
 /* ================================================================
  * Shared memory
  * ================================================================ */
 
+typedef struct BiscuitPreloadKey
+{
+    Oid         dboid;
+    Oid         indexoid;
+} BiscuitPreloadKey;
+
+typedef struct BiscuitPreloadEntry
+{
+    BiscuitPreloadKey key;
+    uint32            state;        /* BISCUIT_PRELOAD_* */
+    int64             priority;     /* BISCUIT_PRELOAD_PRIORITY_*, or recorded scans */
+    bool              prewarm;      /* queued by the startup prewarm */
+    dlist_node        node;         /* in queue while SKELETON */
+} BiscuitPreloadEntry;
+
+typedef struct BiscuitPreloadWorkerSlot
+{
+    Oid         dboid;              /* InvalidOid = slot free */
+    pid_t       pid;                /* 0 while the worker is starting */
+    Latch      *latch;
+    bool        busy;               /* building an index */
+} BiscuitPreloadWorkerSlot;
+
+typedef struct BiscuitPreloadShmem
+{
+    dlist_head               queue;         /* entries waiting for a worker */
+    int                      queue_size;
+    bool                     prewarm_queueing; /* startup prewarm not queued yet */
+    BiscuitPreloadWorkerSlot workers[BISCUIT_PRELOAD_MAX_WORKERS];
+} BiscuitPreloadShmem;
+
 static BiscuitPreloadShmem *biscuit_preload_shmem = NULL;
+static HTAB                *biscuit_preload_htab  = NULL;
 
-/* LWLock protecting the ring buffer (acquired from LWLockNewTrancheId) */
+/* LWLock protecting the state table, queue and worker slots */
 static LWLockPadded        *biscuit_lwlock_base    = NULL;
 
 #define BiscuitPreloadLock() (&biscuit_lwlock_base[0].lock)
@@ -66,7 +131,7 @@ Size
 biscuit_preload_shmem_size(void)
 {
     return MAXALIGN(sizeof(BiscuitPreloadShmem))
-         + MAXALIGN(sizeof(LWLockPadded));
+         + hash_estimate_size(biscuit_preload_max_indexes, sizeof(BiscuitPreloadEntry));
 }
 
 /* ================================================================
@@ -88,7 +153,8 @@ biscuit_shmem_request(void)
 static void
 biscuit_shmem_startup(void)
 {
-    bool found;
+    HASHCTL info;
+    bool    found;
 
     if (prev_shmem_startup_hook)
         prev_shmem_startup_hook();
@@ -102,18 +168,19 @@ biscuit_shmem_startup(void)
 
     if (!found)
     {
-        int i;
         memset(biscuit_preload_shmem, 0, sizeof(BiscuitPreloadShmem));
-        for (i = 0; i < 64; i++)
-        {
-            pg_atomic_init_u32(&biscuit_preload_shmem->slot_state[i],
-                               BISCUIT_PRELOAD_NONE);
-            pg_atomic_init_u32(&biscuit_preload_shmem->slot_oid[i],
-                               InvalidOid);
-        }
-        biscuit_preload_shmem->worker_latch = NULL;
+        dlist_init(&biscuit_preload_shmem->queue);
+        biscuit_preload_shmem->prewarm_queueing = biscuit_prewarm_enabled;
     }
 
+    memset(&info, 0, sizeof(info));
+    info.keysize   = sizeof(BiscuitPreloadKey);
+    info.entrysize = sizeof(BiscuitPreloadEntry);
+    biscuit_preload_htab = ShmemInitHash("biscuit preload states",
+                                         biscuit_preload_max_indexes,
+                                         biscuit_preload_max_indexes,
+                                         &info, HASH_ELEM | HASH_BLOBS);
+
     biscuit_lwlock_base =
         GetNamedLWLockTranche("biscuit_preload");
 
@@ -127,7 +194,24 @@ biscuit_shmem_startup(void)
 void
 biscuit_preload_init(void)
 {
-    BackgroundWorker worker;
+    DefineCustomIntVariable("biscuit.preload_max_indexes",
+                            "Number of Biscuit indexes whose background preload state can be tracked.",
+                            NULL,
+                            &biscuit_preload_max_indexes,
+                            4096, 64, 1000000,
+                            PGC_POSTMASTER,
+                            0,
+                            NULL, NULL, NULL);
+
+    DefineCustomIntVariable("biscuit.preload_workers",
+                            "Number of Biscuit preload workers one database can run at once.",
+                            "Each builds a different index; all databases share "
+                            "16 worker slots and max_worker_processes.",
+                            &biscuit_preload_workers,
+                            2, 1, BISCUIT_PRELOAD_MAX_WORKERS,
+                            PGC_SIGHUP,
+                            0,
+                            NULL, NULL, NULL);
 
     /* Hook shared-memory allocation */
     prev_shmem_request_hook = shmem_request_hook;
@@ -135,80 +219,353 @@ biscuit_preload_init(void)
 
     prev_shmem_startup_hook = shmem_startup_hook;
     shmem_startup_hook      = biscuit_shmem_startup;
+}
+
+/* ================================================================
+ * Worker slots (caller holds BiscuitPreloadLock)
+ * ================================================================ */
+
+/*
+ * Wake the idle workers of dboid; if it has more queued indexes than idle
+ * workers and less than biscuit.preload_workers, claim a free slot for
+ * another.  Returns the claimed slot (the caller launches it) or -1;
+ * *nworkers is the number dboid had already.
+ */
+static int
+biscuit_preload_claim_worker(Oid dboid, int *nworkers)
+{
+    BiscuitPreloadShmem *sh        = biscuit_preload_shmem;
+    int                  idle      = 0;
+    int                  free_slot = -1;
+    int                  queued    = 0;
+    dlist_iter           iter;
+    int                  i;
+
+    *nworkers = 0;
+    for (i = 0; i < BISCUIT_PRELOAD_MAX_WORKERS; i++)
+    {
+        BiscuitPreloadWorkerSlot *slot = &sh->workers[i];
+
+        if (slot->dboid == dboid)
+        {
+            (*nworkers)++;
+            if (!slot->busy)
+            {
+                /* A worker still starting has no latch; it looks anyway */
+                idle++;
+                if (slot->latch)
+                    SetLatch(slot->latch);
+            }
+        }
+        else if (!OidIsValid(slot->dboid) && free_slot < 0)
+            free_slot = i;
+    }
+
+    if (*nworkers >= biscuit_preload_workers || free_slot < 0)
+        return -1;
+
+    dlist_foreach(iter, &sh->queue)
+    {
+        BiscuitPreloadEntry *entry = dlist_container(BiscuitPreloadEntry, node, iter.cur);
+
+        if (entry->key.dboid == dboid)
+            queued++;
+    }
+    if (queued <= idle)
+        return -1;
+
+    sh->workers[free_slot].dboid = dboid;
+    sh->workers[free_slot].pid   = 0;
+    sh->workers[free_slot].latch = NULL;
+    sh->workers[free_slot].busy  = false;
+    return free_slot;
+}
+
+/*
+ * Start a worker for the given slot.  Returns false (and frees the slot)
+ * if the postmaster has no room for another background worker.
+ */
+static bool
+biscuit_preload_launch_worker(int slotno)
+{
+    BackgroundWorker worker;
 
-    /* Register the persistent background worker */
     memset(&worker, 0, sizeof(worker));
     worker.bgw_flags        = BGWORKER_SHMEM_ACCESS |
                               BGWORKER_BACKEND_DATABASE_CONNECTION;
     worker.bgw_start_time   = BgWorkerStart_RecoveryFinished;
-    worker.bgw_restart_time = 5;   /* restart after 5 s on crash */
+    worker.bgw_restart_time = BGW_NEVER_RESTART;
     snprintf(worker.bgw_library_name, BGW_MAXLEN, "biscuit");
     snprintf(worker.bgw_function_name, BGW_MAXLEN,
              "biscuit_preload_worker_main");
     snprintf(worker.bgw_name, BGW_MAXLEN, "biscuit preload worker");
     snprintf(worker.bgw_type, BGW_MAXLEN, "biscuit preload");
-    worker.bgw_main_arg     = (Datum) 0;
+    worker.bgw_main_arg     = Int32GetDatum(slotno);
     worker.bgw_notify_pid   = 0;
 
-    RegisterBackgroundWorker(&worker);
+    if (RegisterDynamicBackgroundWorker(&worker, NULL))
+        return true;
+
+    LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
+    biscuit_preload_shmem->workers[slotno].dboid = InvalidOid;
+    LWLockRelease(BiscuitPreloadLock());
+
+    elog(DEBUG1, "Biscuit preload: could not start a background worker");
+    return false;
 }
 
 /* ================================================================
  * biscuit_preload_request  – enqueue an OID for the worker
  * ================================================================ */
 
-void
+bool
 biscuit_preload_request(Oid indexoid)
 {
     BiscuitPreloadShmem *sh = biscuit_preload_shmem;
-    int oid_slot = (int)(indexoid % 64);
+    BiscuitPreloadKey    key;
+    BiscuitPreloadEntry *entry;
+    int                  launch;
+    int                  nworkers;
+    bool                 found;
 
-    if (!sh)
-        return;   /* shmem not yet initialised (e.g. bootstrap) */
+    if (!sh || RecoveryInProgress())
+        return false;   /* not preloaded, or nothing could persist the result */
+
+    memset(&key, 0, sizeof(key));
+    key.dboid    = MyDatabaseId;
+    key.indexoid = indexoid;
 
     LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
 
-    if (sh->queue_size >= 64)
+    entry = (BiscuitPreloadEntry *)
+        hash_search(biscuit_preload_htab, &key, HASH_ENTER_NULL, &found);
+    if (!entry)
     {
-        /* Queue full — skip; worker will catch it on the next cycle */
         LWLockRelease(BiscuitPreloadLock());
-        elog(DEBUG1, "Biscuit preload: queue full, skipping OID %u", indexoid);
-        return;
+        elog(DEBUG1, "Biscuit preload: state table full, skipping OID %u", indexoid);
+        return false;
+    }
+
+    /*
+     * A finished or failed entry is requeued: the caller only asks when
+     * no usable snapshot exists, so the earlier result is gone.
+     */
+    if (!found ||
+        (entry->state != BISCUIT_PRELOAD_SKELETON && entry->state != BISCUIT_PRELOAD_RUNNING))
+    {
+        entry->state   = BISCUIT_PRELOAD_SKELETON;
+        entry->prewarm = false;
+        dlist_push_tail(&sh->queue, &entry->node);
+        sh->queue_size++;
     }
 
-    /* Check for duplicate OIDs already in the queue */
+    /* A session waits on it now, whatever queued it first */
+    entry->priority = BISCUIT_PRELOAD_PRIORITY_WAITING;
+
+    /* Wake this database's workers, or claim a slot for another one */
+    launch = biscuit_preload_claim_worker(MyDatabaseId, &nworkers);
+    if (launch < 0 && nworkers == 0)
     {
-        int i;
-        for (i = 0; i < sh->queue_size; i++)
+        /* Every worker slot is busy with another database */
+        if (entry->state == BISCUIT_PRELOAD_SKELETON)
         {
-            int pos = (sh->queue_head + i) % 64;
-            if (sh->queue[pos] == indexoid)
-            {
-                LWLockRelease(BiscuitPreloadLock());
-                return;   /* already queued */
-            }
+            dlist_delete(&entry->node);
+            sh->queue_size--;
         }
+        hash_search(biscuit_preload_htab, &key, HASH_REMOVE, NULL);
+        LWLockRelease(BiscuitPreloadLock());
+        return false;
     }
 
-    sh->queue[sh->queue_tail] = indexoid;
-    sh->queue_tail            = (sh->queue_tail + 1) % 64;
-    sh->queue_size++;
+    LWLockRelease(BiscuitPreloadLock());
+
+    if (launch >= 0 && !biscuit_preload_launch_worker(launch) && nworkers == 0)
+        return false;       /* entry stays queued for the next request */
+
+    elog(DEBUG1, "Biscuit preload: queued index %u for background load", indexoid);
+    return true;
+}
+
+/* ================================================================
+ * Startup prewarm  (biscuit_prewarm.c queues, the workers build)
+ * ================================================================ */
+
+bool
+biscuit_preload_enqueue(Oid dboid, Oid indexoid, int64 priority, bool prewarm)
+{
+    BiscuitPreloadShmem *sh = biscuit_preload_shmem;
+    BiscuitPreloadKey    key;
+    BiscuitPreloadEntry *entry;
+    bool                 found;
+
+    if (!sh)
+        return false;
+
+    memset(&key, 0, sizeof(key));
+    key.dboid    = dboid;
+    key.indexoid = indexoid;
+
+    LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
+
+    entry = (BiscuitPreloadEntry *)
+        hash_search(biscuit_preload_htab, &key, HASH_ENTER_NULL, &found);
+    if (!entry)
+    {
+        LWLockRelease(BiscuitPreloadLock());
+        return false;
+    }
+
+    if (!found)
+    {
+        entry->state    = BISCUIT_PRELOAD_SKELETON;
+        entry->priority = priority;
+        entry->prewarm  = prewarm;
+        dlist_push_tail(&sh->queue, &entry->node);
+        sh->queue_size++;
+    }
+    else if (entry->state == BISCUIT_PRELOAD_SKELETON)
+    {
+        /* Already queued: keep the higher priority */
+        entry->priority = Max(entry->priority, priority);
+        entry->prewarm |= prewarm;
+    }
+    /* Else built or being built since; nothing to add */
+
+    LWLockRelease(BiscuitPreloadLock());
+    return true;
+}
+
+int
+biscuit_preload_dispatch(void)
+{
+    BiscuitPreloadShmem *sh = biscuit_preload_shmem;
+    int                  launch[BISCUIT_PRELOAD_MAX_WORKERS];
+    Oid                  seen[BISCUIT_PRELOAD_MAX_WORKERS];
+    int                  nlaunch = 0;
+    int                  nseen   = 0;
+    int                  queued;
+    dlist_iter           iter;
+    int                  i;
+
+    if (!sh || RecoveryInProgress())
+        return 0;
+
+    LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
 
     /*
-     * Key the state on (indexoid % 64), not on the ring-buffer slot.
-     * This way biscuit_preload_state() can find the state even after the
-     * worker has dequeued the OID (queue_head advanced past the slot).
+     * Claim workers database by database in queue order, so the databases
+     * queued first get the slots when there are not enough for all.
      */
-    pg_atomic_write_u32(&sh->slot_oid[oid_slot],   (uint32) indexoid);
-    pg_atomic_write_u32(&sh->slot_state[oid_slot], BISCUIT_PRELOAD_SKELETON);
+    dlist_foreach(iter, &sh->queue)
+    {
+        BiscuitPreloadEntry *entry = dlist_container(BiscuitPreloadEntry, node, iter.cur);
+        Oid                  dboid = entry->key.dboid;
+        int                  slotno;
+        int                  nworkers;
+
+        for (i = 0; i < nseen; i++)
+            if (seen[i] == dboid)
+                break;
+        if (i < nseen)
+            continue;
+        if (nseen == BISCUIT_PRELOAD_MAX_WORKERS)
+            break;              /* more databases than worker slots */
+        seen[nseen++] = dboid;
+
+        while ((slotno = biscuit_preload_claim_worker(dboid, &nworkers)) >= 0)
+            launch[nlaunch++] = slotno;
+    }
+    queued = sh->queue_size;
 
     LWLockRelease(BiscuitPreloadLock());
 
-    /* Wake the worker */
-    if (sh->worker_latch)
-        SetLatch(sh->worker_latch);
+    for (i = 0; i < nlaunch; i++)
+        (void) biscuit_preload_launch_worker(launch[i]);
 
-    elog(DEBUG1, "Biscuit preload: queued index %u for background load", indexoid);
+    return queued;
+}
+
+void
+biscuit_preload_prewarm_queued(void)
+{
+    if (!biscuit_preload_shmem)
+        return;
+
+    LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
+    biscuit_preload_shmem->prewarm_queueing = false;
+    LWLockRelease(BiscuitPreloadLock());
+}
+
+bool
+biscuit_preload_prewarm_ready(void)
+{
+    BiscuitPreloadShmem *sh    = biscuit_preload_shmem;
+    bool                 ready;
+    HASH_SEQ_STATUS      status;
+    BiscuitPreloadEntry *entry;
+
+    /* Standbys warm nothing in the background: there is nothing to wait for */
+    if (!sh || RecoveryInProgress())
+        return true;
+
+    LWLockAcquire(BiscuitPreloadLock(), LW_SHARED);
+    ready = !sh->prewarm_queueing;
+    if (ready)
+    {
+        hash_seq_init(&status, biscuit_preload_htab);
+        while ((entry = (BiscuitPreloadEntry *) hash_seq_search(&status)) != NULL)
+        {
+            if (entry->prewarm &&
+                (entry->state == BISCUIT_PRELOAD_SKELETON ||
+                 entry->state == BISCUIT_PRELOAD_RUNNING))
+            {
+                ready = false;
+                hash_seq_term(&status);
+                break;
+            }
+        }
+    }
+    LWLockRelease(BiscuitPreloadLock());
+
+    return ready;
+}
+
+BiscuitPreloadInfo *
+biscuit_preload_collect(int *count)
+{
+    BiscuitPreloadInfo  *info;
+    HASH_SEQ_STATUS      status;
+    BiscuitPreloadEntry *entry;
+    int                  n = 0;
+
+    *count = 0;
+    if (!biscuit_preload_shmem)
+        return NULL;
+
+    LWLockAcquire(BiscuitPreloadLock(), LW_SHARED);
+
+    info = (BiscuitPreloadInfo *)
+        palloc(Max(hash_get_num_entries(biscuit_preload_htab), 1) * sizeof(BiscuitPreloadInfo));
+
+    hash_seq_init(&status, biscuit_preload_htab);
+    while ((entry = (BiscuitPreloadEntry *) hash_seq_search(&status)) != NULL)
+    {
+        /* Leave out the biscuit.prewarm_indexes lookups */
+        if (!OidIsValid(entry->key.indexoid))
+            continue;
+
+        info[n].dboid    = entry->key.dboid;
+        info[n].indexoid = entry->key.indexoid;
+        info[n].state    = entry->state;
+        info[n].priority = entry->priority;
+        info[n].prewarm  = entry->prewarm;
+        n++;
+    }
+
+    LWLockRelease(BiscuitPreloadLock());
+
+    *count = n;
+    return info;
 }
 
 /* ================================================================
@@ -216,30 +573,70 @@ biscuit_preload_request(Oid indexoid)
  * ================================================================ */
 
 /*
- * Return BISCUIT_PRELOAD_* for the given OID, or BISCUIT_PRELOAD_NONE
- * if the OID is not tracked (or a different OID owns the same slot).
+ * Return BISCUIT_PRELOAD_* for the given OID in the current database,
+ * or BISCUIT_PRELOAD_NONE if it is not tracked.
  *
- * O(1): reads two atomic uint32s, no lock, no ring-buffer scan.
- * Safe to call concurrently with the worker or biscuit_preload_request.
+ * One shared-lock hash probe; only called while an index is a skeleton.
  */
 uint32
 biscuit_preload_state(Oid indexoid)
 {
     BiscuitPreloadShmem *sh = biscuit_preload_shmem;
-    int      oid_slot;
-    uint32   stored_oid;
+    BiscuitPreloadKey    key;
+    BiscuitPreloadEntry *entry;
+    uint32               state = BISCUIT_PRELOAD_NONE;
 
     if (!sh)
         return BISCUIT_PRELOAD_NONE;
 
-    oid_slot   = (int)(indexoid % 64);
-    stored_oid = pg_atomic_read_u32(&sh->slot_oid[oid_slot]);
+    memset(&key, 0, sizeof(key));
+    key.dboid    = MyDatabaseId;
+    key.indexoid = indexoid;
 
-    /* Collision: another OID owns this slot */
-    if (stored_oid != (uint32) indexoid)
-        return BISCUIT_PRELOAD_NONE;
+    LWLockAcquire(BiscuitPreloadLock(), LW_SHARED);
+    entry = (BiscuitPreloadEntry *) hash_search(biscuit_preload_htab, &key, HASH_FIND, NULL);
+    if (entry)
+        state = entry->state;
+    LWLockRelease(BiscuitPreloadLock());
 
-    return pg_atomic_read_u32(&sh->slot_state[oid_slot]);
+    return state;
+}
+
+/* ================================================================
+ * biscuit_preload_adopt
+ * Replace a skeleton with the index the worker published.
+ * ================================================================ */
+
+BiscuitIndex *
+biscuit_preload_adopt(Relation index, BiscuitIndex *skeleton)
+{
+    Oid           indexoid = RelationGetRelid(index);
+    BiscuitIndex *idx;
+    MemoryContext oldcontext;
+
+    Assert(skeleton->preload_state < BISCUIT_PRELOAD_DONE);
+
+    /*
+     * A skeleton is never modified (aminsert completes it first), so it
+     * can be dropped in favour of the snapshot, which is at least as
+     * recent.  Like other replaced cache entries it is freed at
+     * transaction end.
+     */
+    idx = biscuit_storage_load(index);
+    if (idx)
+    {
+        biscuit_cache_insert(indexoid, idx);
+        elog(DEBUG1, "Biscuit: adopted preloaded snapshot for index %u", indexoid);
+        return idx;
+    }
+
+    /* Snapshot already stale again (or the worker failed): build here */
+    oldcontext = MemoryContextSwitchTo(BiscuitIndexMemoryContext(skeleton));
+    biscuit_complete_preload_local(skeleton, indexoid);
+    MemoryContextSwitchTo(oldcontext);
+
+    biscuit_cache_insert(indexoid, skeleton);
+    return skeleton;
 }
 
 /* ================================================================
@@ -256,6 +653,7 @@ biscuit_load_skeleton(Relation index)
     TupleTableSlot   *slot_tbl;
     TableScanDesc     scan;
     MemoryContext     oldcontext;
+    MemoryContext     copy_context;
     int               natts, col, ch;
     EState           *estate;
     ExprContext      *econtext;
@@ -299,24 +697,36 @@ biscuit_load_skeleton(Relation index)
     econtext = GetPerTupleExprContext(estate);
 
     /*
-     * All skeleton data must live in CacheMemoryContext.  rd_indexcxt is
+     * All skeleton data must live under CacheMemoryContext.  rd_indexcxt is
      * owned by PostgreSQL and deleted by RelationClearRelation on any
      * relcache invalidation, which would free our data while biscuit_cache
-     * still holds the pointer.  CacheMemoryContext is never reset by PG.
+     * still holds the pointer.  CacheMemoryContext is never reset by PG;
+     * the skeleton gets its own context there, see biscuit_cache.c.
      */
-    oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
+    copy_context = biscuit_cache_new_context();
+    oldcontext   = MemoryContextSwitchTo(copy_context);
 
     heap      = table_open(index->rd_index->indrelid, AccessShareLock);
     indexInfo = BuildIndexInfo(index);
     natts     = index->rd_index->indnatts;
 
     idx              = (BiscuitIndex *) palloc0(sizeof(BiscuitIndex));
+    idx->memory_context = copy_context;
     idx->capacity    = 1024;
     idx->num_records = 0;
     idx->num_columns = natts;
     idx->max_len     = 0;
+    biscuit_index_options(index, &idx->options);
     idx->tids        = (ItemPointerData *) palloc(idx->capacity * sizeof(ItemPointerData));
 
+    /* Replayed once the skeleton is complete: entries logged during the scan */
+    {
+        uint64 log_base;
+        uint64 log_version = biscuit_changelog_current(index, &log_base);
+
+        biscuit_changelog_attach(index, idx, log_version, log_base);
+    }
+
     /* ---- Allocate data caches; leave ALL bitmap fields NULL ---- */
     if (natts == 1)
     {
@@ -425,32 +835,7 @@ biscuit_load_skeleton(Relation index)
         econtext->ecxt_scantuple = slot_tbl;
         FormIndexDatum(indexInfo, slot_tbl, estate, index_values, index_isnull);
 
-        if (idx->num_records >= idx->capacity)
-        {
-            idx->capacity *= 2;
-            idx->tids = (ItemPointerData *) repalloc(
-                idx->tids, idx->capacity * sizeof(ItemPointerData));
-
-            if (natts == 1)
-            {
-                idx->data_cache = (char **) repalloc(
-                    idx->data_cache, idx->capacity * sizeof(char *));
-                idx->data_cache_lower = (char **) repalloc(
-                    idx->data_cache_lower, idx->capacity * sizeof(char *));
-            }
-            else
-            {
-                for (col = 0; col < natts; col++)
-                {
-                    idx->column_data_cache[col] = (char **) repalloc(
-                        idx->column_data_cache[col],
-                        idx->capacity * sizeof(char *));
-                    idx->column_data_cache_lower[col] = (char **) repalloc(
-                        idx->column_data_cache_lower[col],
-                        idx->capacity * sizeof(char *));
-                }
-            }
-        }
+        biscuit_reserve_records(idx, 1);
 
         ItemPointerCopy(&slot_tbl->tts_tid, &idx->tids[idx->num_records]);
 
@@ -459,13 +844,15 @@ biscuit_load_skeleton(Relation index)
             if (!index_isnull[0])
             {
                 int   out_len;
-                char *str = biscuit_datum_to_text(index_values[0], single_coltypid,
-                                                   &single_output_func, &out_len);
+                char *value = biscuit_datum_to_text(index_values[0], single_coltypid,
+                                                     &single_output_func, &out_len);
+                char *str = biscuit_arena_store(&idx->strings_legacy, value, out_len);
                 int   char_count = biscuit_utf8_char_count(str, out_len);
 
+                pfree(value);
                 idx->data_cache[idx->num_records]       = str;
                 idx->data_cache_lower[idx->num_records] =
-                    biscuit_str_tolower(str, out_len);
+                    biscuit_arena_store_lower(&idx->strings_legacy, str);
 
                 if (char_count > idx->max_len)
                     idx->max_len = char_count;
@@ -480,14 +867,20 @@ biscuit_load_skeleton(Relation index)
         {
             for (col = 0; col < natts; col++)
             {
+                BiscuitStringArena *arena = &idx->column_indices[col].strings;
                 int   out_len;
 
                 if (!index_isnull[col])
+                {
+                    char *value = biscuit_datum_to_text(index_values[col],
+                                                        idx->column_types[col],
+                                                        &idx->output_funcs[col],
+                                                        &out_len);
+
                     idx->column_data_cache[col][idx->num_records] =
-                        biscuit_datum_to_text(index_values[col],
-                                              idx->column_types[col],
-                                              &idx->output_funcs[col],
-                                              &out_len);
+                        biscuit_arena_store(arena, value, out_len);
+                    pfree(value);
+                }
                 else
                     idx->column_data_cache[col][idx->num_records] = NULL;
 
@@ -499,9 +892,8 @@ biscuit_load_skeleton(Relation index)
                  */
                 if (idx->column_data_cache[col][idx->num_records])
                     idx->column_data_cache_lower[col][idx->num_records] =
-                        biscuit_str_tolower(
-                            idx->column_data_cache[col][idx->num_records],
-                            strlen(idx->column_data_cache[col][idx->num_records]));
+                        biscuit_arena_store_lower(arena,
+                                                  idx->column_data_cache[col][idx->num_records]);
                 else
                     idx->column_data_cache_lower[col][idx->num_records] = NULL;
             }
@@ -517,6 +909,7 @@ biscuit_load_skeleton(Relation index)
 
     /* Mark as skeleton only — bitmaps not yet built */
     idx->preload_state = BISCUIT_PRELOAD_SKELETON;
+    idx->heap_ordered  = biscuit_tids_in_heap_order(idx->tids, idx->num_records);
     
     /* If the worker already signalled DONE, build bitmaps now
      * so the returned index is immediately warm and consistent with shmem. */
@@ -538,144 +931,42 @@ biscuit_load_skeleton(Relation index)
  * already-populated data_cache and updates the session cache entry.
  * ================================================================ */
 
-/*
- * Internal: index a single string into pos/neg/char/length bitmaps
- * for the single-column (legacy) layout.  Mirrors biscuit_index_single_record
- * in biscuit_index.c.
- */
-static void
-preload_index_single_record(BiscuitIndex *idx,
-                             const char   *str,
-                             int           byte_len,
-                             int           rec_idx)
+void
+biscuit_complete_preload(Oid indexoid)
 {
-    int byte_pos = 0;
-    int char_pos = 0;
-    int char_count = biscuit_utf8_char_count(str, byte_len);
-
-    /* Case-sensitive */
-    while (byte_pos < byte_len)
-    {
-        unsigned char first_byte = (unsigned char) str[byte_pos];
-        int           char_len   = biscuit_utf8_char_length(first_byte);
-        int           b;
+    Relation index;
+    bool     built = false;
 
-        if (byte_pos + char_len > byte_len)
-            char_len = byte_len - byte_pos;
-
-        for (b = 0; b < char_len; b++)
-        {
-            unsigned char uch = (unsigned char) str[byte_pos + b];
-            RoaringBitmap *bm;
-            int remaining_chars;
-            int neg_offset;
-
-            bm = biscuit_get_pos_bitmap(idx, uch, char_pos);
-            if (!bm) { bm = biscuit_roaring_create(); biscuit_set_pos_bitmap(idx, uch, char_pos, bm); }
-            biscuit_roaring_add(bm, rec_idx);
-
-            remaining_chars = biscuit_utf8_char_count(str + byte_pos, byte_len - byte_pos);
-            neg_offset = -remaining_chars;
-            bm = biscuit_get_neg_bitmap(idx, uch, neg_offset);
-            if (!bm) { bm = biscuit_roaring_create(); biscuit_set_neg_bitmap(idx, uch, neg_offset, bm); }
-            biscuit_roaring_add(bm, rec_idx);
-
-            if (!idx->char_cache_legacy[uch])
-                idx->char_cache_legacy[uch] = biscuit_roaring_create();
-            biscuit_roaring_add(idx->char_cache_legacy[uch], rec_idx);
-        }
-        byte_pos += char_len;
-        char_pos++;
-    }
+    /*
+     * The worker lives in its own process, so an in-memory copy built here
+     * is useless to the sessions waiting on it.  What it can hand over is
+     * the on-disk snapshot: build the index from the heap, write it out,
+     * and let each session load that instead of rebuilding the bitmaps
+     * from its skeleton.  Nothing is built if a VALID snapshot already
+     * exists (e.g. VACUUM wrote one in the meantime).
+     */
+    index = index_open(indexoid, AccessShareLock);
 
-    /* Case-insensitive — data_cache_lower already populated by skeleton */
-    if (idx->data_cache_lower[rec_idx])
+    if (!biscuit_storage_is_valid(index))
     {
-        const char *sl      = idx->data_cache_lower[rec_idx];
-        int         sll     = strlen(sl);
-        int         lcc     = biscuit_utf8_char_count(sl, sll);
-        int         lbp     = 0;
-        int         lcp     = 0;
-
-        if (lcc > idx->max_length_lower)
-            idx->max_length_lower = lcc;
-
-        while (lbp < sll)
-        {
-            unsigned char fb  = (unsigned char) sl[lbp];
-            int           cl2 = biscuit_utf8_char_length(fb);
-            int           b;
-
-            if (lbp + cl2 > sll) cl2 = sll - lbp;
-
-            for (b = 0; b < cl2; b++)
-            {
-                unsigned char uch = (unsigned char) sl[lbp + b];
-                RoaringBitmap *bm;
-                int rc, no;
-
-                bm = biscuit_get_pos_bitmap_lower(idx, uch, lcp);
-                if (!bm) { bm = biscuit_roaring_create(); biscuit_set_pos_bitmap_lower(idx, uch, lcp, bm); }
-                biscuit_roaring_add(bm, rec_idx);
-
-                rc = biscuit_utf8_char_count(sl + lbp, sll - lbp);
-                no = -rc;
-                bm = biscuit_get_neg_bitmap_lower(idx, uch, no);
-                if (!bm) { bm = biscuit_roaring_create(); biscuit_set_neg_bitmap_lower(idx, uch, no, bm); }
-                biscuit_roaring_add(bm, rec_idx);
-
-                if (!idx->char_cache_lower[uch])
-                    idx->char_cache_lower[uch] = biscuit_roaring_create();
-                biscuit_roaring_add(idx->char_cache_lower[uch], rec_idx);
-            }
-            lbp += cl2;
-            lcp++;
-        }
+        built = biscuit_build_snapshot(index);
+        if (!built)
+            elog(LOG, "Biscuit preload: index %u changed while building, "
+                      "sessions will build locally", indexoid);
     }
 
-    if (char_count > idx->max_len)
-        idx->max_len = char_count;
-}
-
-void 
-biscuit_complete_preload(Oid indexoid)
-{
-    int                  oid_slot = (int)(indexoid % 64);
-    BiscuitPreloadShmem *sh       = biscuit_preload_shmem;
-
     /*
-     * The worker's only job is to signal DONE in the shmem slot.
-     *
-     * Each foreground session has already called biscuit_load_skeleton()
-     * during its first beginscan, so it holds TIDs and raw string data in
-     * its own CacheMemoryContext.  When rescan() next checks shmem and
-     * finds DONE it calls biscuit_complete_preload_local() on that
-     * existing skeleton — pure CPU work, zero extra I/O.
-     *
-     * A previous implementation did a full heap scan here (biscuit_load_skeleton
-     * + biscuit_complete_preload_local) and then discarded the result.  That
-     * wasted one extra heap scan per index per server start while providing
-     * no benefit: the worker's address space is separate from every session,
-     * so nothing built here is reachable by foreground backends.
-     *
-     * Verifying the index is still valid (index_open) before signalling DONE
-     * is a worthwhile safety check and is cheap — no heap scan, just a
-     * syscache lookup.
+     * With biscuit.shared_index on, publish the snapshot to the shared
+     * image area too, so the first foreground load attaches to it instead
+     * of decoding the pages itself.
      */
-    Relation index = index_open(indexoid, AccessShareLock);
-    if (!index)
-    {
-        elog(WARNING, "Biscuit preload: could not open index %u, skipping",
-             indexoid);
-        return;
-    }
-    index_close(index, AccessShareLock);
+    if (biscuit_shared_enabled() && biscuit_storage_prewarm_shared(index))
+        elog(DEBUG1, "Biscuit preload: published shared image for index %u", indexoid);
 
-    if (sh && oid_slot >= 0)
-        pg_atomic_write_u32(&sh->slot_state[oid_slot], BISCUIT_PRELOAD_DONE);
+    index_close(index, AccessShareLock);
 
-    elog(LOG, "Biscuit preload: signalled DONE for index %u "
-              "(bitmaps built on demand per session)", indexoid);
+    elog(LOG, "Biscuit preload: index %u ready%s", indexoid,
+         built ? " (snapshot written)" : "");
 }
 
 /* ================================================================
@@ -689,296 +980,144 @@ biscuit_complete_preload(Oid indexoid)
  * This is the foreground-side alternative to calling biscuit_load_index()
  * (which would do a full heap scan + bitmap build from scratch).  Because
  * the skeleton is already in memory the only cost here is the bitmap
- * construction itself — identical to what biscuit_complete_preload() does
- * in the background worker, but without the second heap scan.
+ * construction itself.  Used when the worker's snapshot cannot be
+ * adopted (see biscuit_preload_adopt) or no worker is available.
  *
- * On success:
- *   • idx->preload_state is set to BISCUIT_PRELOAD_DONE
- *   • The shmem slot_state for indexoid is written to DONE so that
- *     other sessions see the index as warm.
+ * On success idx->preload_state is set to BISCUIT_PRELOAD_DONE.  The
+ * shared state is left alone: DONE there means the worker's snapshot is
+ * available, which a local build does not provide.
  * ================================================================ */
-void
-biscuit_complete_preload_local(BiscuitIndex *idx, Oid indexoid)
+/*
+ * Drop the strings a skeleton loaded for the fallback scan but the index
+ * options do not keep: every value without store_strings, otherwise the
+ * lowercased copies without ilike.
+ */
+static void
+biscuit_preload_trim_strings(BiscuitIndex *idx)
 {
-    int rec_idx, i, ch;
+    int col;
 
-    Assert(idx != NULL);
-    Assert(idx->preload_state < BISCUIT_PRELOAD_DONE);
-
-    idx->preload_state = BISCUIT_PRELOAD_RUNNING;
+    if (idx->options.store_strings && idx->options.ilike)
+        return;
 
-    if (idx->num_columns == 1)
+    for (col = 0; col < idx->num_columns; col++)
     {
-        for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
+        BiscuitStringArena *arena;
+        char              **strs;
+        char              **lower;
+        int                 rec;
+
+        if (idx->num_columns == 1)
         {
-            if (idx->data_cache[rec_idx])
-                preload_index_single_record(idx,
-                                            idx->data_cache[rec_idx],
-                                            strlen(idx->data_cache[rec_idx]),
-                                            rec_idx);
-            CHECK_FOR_INTERRUPTS();
+            arena = &idx->strings_legacy;
+            strs  = idx->data_cache;
+            lower = idx->data_cache_lower;
+        }
+        else
+        {
+            arena = &idx->column_indices[col].strings;
+            strs  = idx->column_data_cache[col];
+            lower = idx->column_data_cache_lower[col];
         }
 
-        /* Length bitmaps */
-        idx->max_length_legacy = idx->max_len + 1;
-        idx->max_length_lower += 1;
-
-        idx->length_bitmaps_legacy    = (RoaringBitmap **) palloc0(idx->max_length_legacy * sizeof(RoaringBitmap *));
-        idx->length_ge_bitmaps_legacy = (RoaringBitmap **) palloc0(idx->max_length_legacy * sizeof(RoaringBitmap *));
-        idx->length_bitmaps_lower     = (RoaringBitmap **) palloc0(idx->max_length_lower   * sizeof(RoaringBitmap *));
-        idx->length_ge_bitmaps_lower  = (RoaringBitmap **) palloc0(idx->max_length_lower   * sizeof(RoaringBitmap *));
-
-        for (ch = 0; ch < idx->max_length_legacy; ch++)
-            idx->length_ge_bitmaps_legacy[ch] = biscuit_roaring_create();
-        for (ch = 0; ch < idx->max_length_lower; ch++)
-            idx->length_ge_bitmaps_lower[ch] = biscuit_roaring_create();
-
-        for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
+        if (!idx->options.store_strings)
         {
-            int bl, cl;
+            memset(strs, 0, idx->num_records * sizeof(char *));
+            memset(lower, 0, idx->num_records * sizeof(char *));
+            biscuit_arena_free(arena);
+            continue;
+        }
 
-            if (!idx->data_cache[rec_idx]) continue;
+        for (rec = 0; rec < idx->num_records; rec++)
+        {
+            if (lower[rec] != strs[rec])
+                biscuit_arena_release(arena, NULL, lower[rec]);
+            lower[rec] = NULL;
+        }
+        biscuit_arena_compact(arena, strs, lower, idx->num_records);
+    }
+}
 
-            bl = strlen(idx->data_cache[rec_idx]);
-            cl = biscuit_utf8_char_count(idx->data_cache[rec_idx], bl);
+void
+biscuit_complete_preload_local(BiscuitIndex *idx, Oid indexoid)
+{
+    BiscuitBulkLoader *bulk;
+    int                rec_idx, col;
 
-            if (cl < idx->max_length_legacy)
-            {
-                if (!idx->length_bitmaps_legacy[cl])
-                    idx->length_bitmaps_legacy[cl] = biscuit_roaring_create();
-                biscuit_roaring_add(idx->length_bitmaps_legacy[cl], rec_idx);
-            }
-            for (i = 0; i <= cl && i < idx->max_length_legacy; i++)
-                biscuit_roaring_add(idx->length_ge_bitmaps_legacy[i], rec_idx);
+    Assert(idx != NULL);
+    Assert(idx->preload_state < BISCUIT_PRELOAD_DONE);
 
-            if (idx->data_cache_lower[rec_idx])
-            {
-                int lbl = strlen(idx->data_cache_lower[rec_idx]);
-                int lcl = biscuit_utf8_char_count(idx->data_cache_lower[rec_idx], lbl);
+    idx->preload_state = BISCUIT_PRELOAD_RUNNING;
 
-                if (lcl < idx->max_length_lower)
-                {
-                    if (!idx->length_bitmaps_lower[lcl])
-                        idx->length_bitmaps_lower[lcl] = biscuit_roaring_create();
-                    biscuit_roaring_add(idx->length_bitmaps_lower[lcl], rec_idx);
-                }
-                for (i = 0; i <= lcl && i < idx->max_length_lower; i++)
-                    biscuit_roaring_add(idx->length_ge_bitmaps_lower[i], rec_idx);
-            }
-        }
+    if (idx->num_columns == 1)
+    {
+        if (idx->options.trigrams && !idx->trigrams_legacy)
+            idx->trigrams_legacy = biscuit_trigram_create();
     }
     else
     {
-        int col;
-
         for (col = 0; col < idx->num_columns; col++)
-        {
-            ColumnIndex *cidx        = &idx->column_indices[col];
-            int          max_cl      = 0;
-            int          max_cl_lower = 0;
-
-            for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
-            {
-                const char *str;
-                int         bl, cl, byte_pos, char_pos;
-
-                if (!idx->column_data_cache[col][rec_idx]) continue;
-
-                str = idx->column_data_cache[col][rec_idx];
-                bl  = strlen(str);
-                cl  = biscuit_utf8_char_count(str, bl);
-
-                if (cl > max_cl) max_cl = cl;
-
-                /* ---- Case-sensitive pass ----
-                 *
-                 * FIX 1: Use biscuit_get_col_pos_bitmap /
-                 * biscuit_set_col_pos_bitmap instead of direct array
-                 * indexing.  The set_* functions do a binary-search
-                 * insert with repalloc on capacity overflow; the old
-                 * code did entries[count++] with no bounds check,
-                 * overflowing the 8-slot skeleton allocation after the
-                 * 9th distinct (char, position) pair.
-                 */
-                byte_pos = char_pos = 0;
-                while (byte_pos < bl)
-                {
-                    unsigned char fb  = (unsigned char) str[byte_pos];
-                    int           chl = biscuit_utf8_char_length(fb);
-                    int           b;
+            if (idx->options.trigrams && !idx->column_indices[col].trigrams)
+                idx->column_indices[col].trigrams = biscuit_trigram_create();
+    }
 
-                    if (byte_pos + chl > bl) chl = bl - byte_pos;
+    /*
+     * Same pipeline as a build from the heap (biscuit_bulk.c).  The
+     * skeleton already holds the lowercased copies; a multi-column one
+     * may lack a copy whose value was NULL at load time, so it is
+     * recomputed when missing.
+     */
+    bulk = biscuit_bulk_begin(idx);
 
-                    for (b = 0; b < chl; b++)
-                    {
-                        unsigned char  uch = (unsigned char) str[byte_pos + b];
-                        RoaringBitmap *bm;
-                        int            rch, no;
-
-                        /* positive-position bitmap */
-                        bm = biscuit_get_col_pos_bitmap(cidx, uch, char_pos);
-                        if (!bm)
-                        {
-                            bm = biscuit_roaring_create();
-                            biscuit_set_col_pos_bitmap(cidx, uch, char_pos, bm);
-                        }
-                        biscuit_roaring_add(bm, rec_idx);
-
-                        /* negative-position bitmap */
-                        rch = biscuit_utf8_char_count(str + byte_pos, bl - byte_pos);
-                        no  = -rch;
-                        bm  = biscuit_get_col_neg_bitmap(cidx, uch, no);
-                        if (!bm)
-                        {
-                            bm = biscuit_roaring_create();
-                            biscuit_set_col_neg_bitmap(cidx, uch, no, bm);
-                        }
-                        biscuit_roaring_add(bm, rec_idx);
-
-                        /* character-presence cache */
-                        if (!cidx->char_cache[uch])
-                            cidx->char_cache[uch] = biscuit_roaring_create();
-                        biscuit_roaring_add(cidx->char_cache[uch], rec_idx);
-                    }
-                    byte_pos += chl;
-                    char_pos++;
-                }
+    for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
+    {
+        if (idx->num_columns == 1)
+        {
+            const char *str = idx->data_cache[rec_idx];
+            const char *sl  = idx->data_cache_lower[rec_idx];
 
-                /* ---- Case-insensitive pass ----
-                 *
-                 * FIX 2: This entire block was missing.  The old code
-                 * never populated pos_idx_lower, neg_idx_lower, or
-                 * char_cache_lower for multi-column indexes, so any
-                 * ILIKE query after a preload would dereference NULL or
-                 * stale pointers and segfault.
-                 */
+            if (str)
+                biscuit_bulk_add(bulk, 0, str, biscuit_cache_strlen(str),
+                                 sl, sl ? biscuit_cache_strlen(sl) : 0, rec_idx);
+        }
+        else
+        {
+            for (col = 0; col < idx->num_columns; col++)
+            {
+                const char *str = idx->column_data_cache[col][rec_idx];
+                char       *sl;
+                int         bl;
+
+                if (!str)
+                    continue;
+
+                bl = biscuit_cache_strlen(str);
+                sl = idx->column_data_cache_lower[col][rec_idx];
+                if (sl || !idx->options.ilike)
+                    biscuit_bulk_add(bulk, col, str, bl, sl, sl ? biscuit_cache_strlen(sl) : 0,
+                                     rec_idx);
+                else
                 {
-                    char *sl  = biscuit_str_tolower(str, bl);
-                    int   sll = (int) strlen(sl);
-                    int   lcc = biscuit_utf8_char_count(sl, sll);
-                    int   lbp = 0;
-                    int   lcp = 0;
-
-                    if (lcc > max_cl_lower) max_cl_lower = lcc;
+                    int sll;
 
-                    while (lbp < sll)
+                    sl = biscuit_str_fold(str, bl, &sll);
+                    if (sl)
                     {
-                        unsigned char fb2 = (unsigned char) sl[lbp];
-                        int           chl2 = biscuit_utf8_char_length(fb2);
-                        int           b;
-
-                        if (lbp + chl2 > sll) chl2 = sll - lbp;
-
-                        for (b = 0; b < chl2; b++)
-                        {
-                            unsigned char  uch = (unsigned char) sl[lbp + b];
-                            RoaringBitmap *bm;
-                            int            rc, no;
-
-                            bm = biscuit_get_col_pos_bitmap_lower(cidx, uch, lcp);
-                            if (!bm)
-                            {
-                                bm = biscuit_roaring_create();
-                                biscuit_set_col_pos_bitmap_lower(cidx, uch, lcp, bm);
-                            }
-                            biscuit_roaring_add(bm, rec_idx);
-
-                            rc = biscuit_utf8_char_count(sl + lbp, sll - lbp);
-                            no = -rc;
-                            bm = biscuit_get_col_neg_bitmap_lower(cidx, uch, no);
-                            if (!bm)
-                            {
-                                bm = biscuit_roaring_create();
-                                biscuit_set_col_neg_bitmap_lower(cidx, uch, no, bm);
-                            }
-                            biscuit_roaring_add(bm, rec_idx);
-
-                            if (!cidx->char_cache_lower[uch])
-                                cidx->char_cache_lower[uch] = biscuit_roaring_create();
-                            biscuit_roaring_add(cidx->char_cache_lower[uch], rec_idx);
-                        }
-                        lbp += chl2;
-                        lcp++;
+                        biscuit_bulk_add(bulk, col, str, bl, sl, sll, rec_idx);
+                        pfree(sl);
                     }
-
-                    pfree(sl);
+                    else
+                        biscuit_bulk_add(bulk, col, str, bl, str, bl, rec_idx);
                 }
-
-                CHECK_FOR_INTERRUPTS();
-            }
-
-            /* ---- Case-sensitive length bitmaps ---- */
-            cidx->max_length = max_cl + 1;
-            cidx->length_bitmaps    = (RoaringBitmap **) palloc0(cidx->max_length * sizeof(RoaringBitmap *));
-            cidx->length_ge_bitmaps = (RoaringBitmap **) palloc0(cidx->max_length * sizeof(RoaringBitmap *));
-            for (i = 0; i < cidx->max_length; i++)
-                cidx->length_ge_bitmaps[i] = biscuit_roaring_create();
-
-            for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
-            {
-                int bl2, cl2;
-
-                if (!idx->column_data_cache[col][rec_idx]) continue;
-                bl2 = strlen(idx->column_data_cache[col][rec_idx]);
-                cl2 = biscuit_utf8_char_count(idx->column_data_cache[col][rec_idx], bl2);
-                if (cl2 < cidx->max_length)
-                {
-                    if (!cidx->length_bitmaps[cl2])
-                        cidx->length_bitmaps[cl2] = biscuit_roaring_create();
-                    biscuit_roaring_add(cidx->length_bitmaps[cl2], rec_idx);
-                }
-                for (i = 0; i <= cl2 && i < cidx->max_length; i++)
-                    biscuit_roaring_add(cidx->length_ge_bitmaps[i], rec_idx);
-            }
-
-            /* ---- Case-insensitive length bitmaps ----
-             *
-             * FIX 2 (cont): Previously max_length_lower was simply
-             * copied from max_length (wrong: lowercasing can change
-             * character count, e.g. German ß→ss), and the bitmaps were
-             * allocated but never filled.  Now we use the independently
-             * tracked max_cl_lower and populate correctly.
-             */
-            cidx->max_length_lower = max_cl_lower + 1;
-            cidx->length_bitmaps_lower    = (RoaringBitmap **) palloc0(cidx->max_length_lower * sizeof(RoaringBitmap *));
-            cidx->length_ge_bitmaps_lower = (RoaringBitmap **) palloc0(cidx->max_length_lower * sizeof(RoaringBitmap *));
-            for (i = 0; i < cidx->max_length_lower; i++)
-                cidx->length_ge_bitmaps_lower[i] = biscuit_roaring_create();
-
-            for (rec_idx = 0; rec_idx < idx->num_records; rec_idx++)
-            {
-                int   bl2, lcl;
-                char *sl;
-
-                if (!idx->column_data_cache[col][rec_idx]) continue;
-                bl2 = strlen(idx->column_data_cache[col][rec_idx]);
-                sl  = biscuit_str_tolower(idx->column_data_cache[col][rec_idx], bl2);
-                lcl = biscuit_utf8_char_count(sl, strlen(sl));
-                pfree(sl);
-
-                if (lcl < cidx->max_length_lower)
-                {
-                    if (!cidx->length_bitmaps_lower[lcl])
-                        cidx->length_bitmaps_lower[lcl] = biscuit_roaring_create();
-                    biscuit_roaring_add(cidx->length_bitmaps_lower[lcl], rec_idx);
-                }
-                for (i = 0; i <= lcl && i < cidx->max_length_lower; i++)
-                    biscuit_roaring_add(cidx->length_ge_bitmaps_lower[i], rec_idx);
             }
         }
+        CHECK_FOR_INTERRUPTS();
     }
 
-    idx->preload_state = BISCUIT_PRELOAD_DONE;
+    biscuit_bulk_finish(bulk);
+    biscuit_preload_trim_strings(idx);
 
-    /* Signal other sessions via shmem */
-    {
-        BiscuitPreloadShmem *_sh = biscuit_preload_shmem;
-        if (_sh)
-        {
-            int _oid_slot = (int)(indexoid % 64);
-            pg_atomic_write_u32(&_sh->slot_state[_oid_slot], BISCUIT_PRELOAD_DONE);
-        }
-    }
+    idx->preload_state = BISCUIT_PRELOAD_DONE;
 
     elog(DEBUG1,
          "Biscuit: local bitmap build complete for index %u (%d records)",
@@ -990,82 +1129,6 @@ biscuit_complete_preload_local(BiscuitIndex *idx, Oid indexoid)
  * Sequential string scan used while bitmaps are not yet ready.
  * ================================================================ */
 
-/*
- * biscuit_like_match
- * -------------------
- * Correct, UTF-8-aware backtracking LIKE/ILIKE matcher.  Honors the same
- * escape convention as the rest of this extension (backslash escapes the
- * following character, so '\%' / '\_' / '\\' are literals, not wildcards).
- *
- * '%' matches zero or more characters; '_' matches exactly one UTF-8
- * character.  Backtracks on '%' the standard way: remember the last '%'
- * position and the haystack position right after it, and on a mismatch
- * retry by having that '%' consume one more character.
- *
- * hay/hay_len and pat/pat_len are byte buffers; ilike compares using
- * lower-cased single bytes (callers pass already-lower-cased hay+pattern
- * for ILIKE, matching the convention used elsewhere in this file).
- */
-static bool
-biscuit_like_match(const char *hay, int hay_len, const char *pat, int pat_len)
-{
-    int hi = 0, pi = 0;
-    int star_pi = -1, star_hi = -1;
-
-    while (hi < hay_len)
-    {
-        if (pi < pat_len && pat[pi] == '\\' && pi + 1 < pat_len)
-        {
-            /* literal escaped char must match exactly (1 byte) */
-            if (hay[hi] == pat[pi + 1])
-            {
-                hi++;
-                pi += 2;
-                continue;
-            }
-        }
-        else if (pi < pat_len && pat[pi] == '_')
-        {
-            int cl = biscuit_utf8_char_length((unsigned char) hay[hi]);
-            if (hi + cl > hay_len)
-                cl = hay_len - hi;
-            hi += cl;
-            pi += 1;
-            continue;
-        }
-        else if (pi < pat_len && pat[pi] == '%')
-        {
-            star_pi = pi++;
-            star_hi = hi;
-            continue;
-        }
-        else if (pi < pat_len && hay[hi] == pat[pi])
-        {
-            hi++;
-            pi++;
-            continue;
-        }
-
-        /* mismatch: backtrack to the most recent '%' if any */
-        if (star_pi >= 0)
-        {
-            pi = star_pi + 1;
-            star_hi += biscuit_utf8_char_length((unsigned char) hay[star_hi]);
-            if (star_hi > hay_len)
-                return false;
-            hi = star_hi;
-            continue;
-        }
-        return false;
-    }
-
-    /* consume any trailing '%' (and reject any other trailing pattern) */
-    while (pi < pat_len && pat[pi] == '%')
-        pi++;
-
-    return pi == pat_len;
-}
-
 void
 biscuit_fallback_scan(BiscuitIndex *idx,
                       const char   *pattern,
@@ -1078,63 +1141,44 @@ biscuit_fallback_scan(BiscuitIndex *idx,
     int              capacity = 256;
     int              count    = 0;
     ItemPointerData *tids     = (ItemPointerData *) palloc(capacity * sizeof(ItemPointerData));
-    const char      *match_pattern = pattern;
     char            *pattern_lower = NULL;
-    int              pat_len;
+    BiscuitLikePlan *plan;
 
     if (ilike)
     {
         pattern_lower = biscuit_str_tolower(pattern, strlen(pattern));
-        match_pattern = pattern_lower;
+        plan = biscuit_like_compile(pattern_lower, strlen(pattern_lower));
     }
-    pat_len = strlen(match_pattern);
+    else
+        plan = biscuit_like_compile(pattern, strlen(pattern));
 
     for (i = 0; i < idx->num_records; i++)
     {
         const char *str;
+        char       *to_free;
+        int         len;
+        bool        matched;
 
         /* skip tombstoned */
-#ifdef HAVE_ROARING
-        if (roaring_bitmap_contains(idx->tombstones, (uint32_t) i))
+        if (biscuit_roaring_contains(idx->tombstones, (uint32_t) i))
             continue;
-#else
-        { uint32_t bl = i >> 6, bt = i & 63;
-          if ((int) bl < idx->tombstones->num_blocks &&
-              (idx->tombstones->blocks[bl] & (1ULL << bt)))
-              continue; }
-#endif
 
-        if (idx->num_columns == 1)
-        {
-            str = ilike ? idx->data_cache_lower[i] : idx->data_cache[i];
-        }
-        else
-        {
-            if (col_idx < 0 || col_idx >= idx->num_columns) continue;
-            if (ilike)
-            {
-                /*
-                 * Use the pre-lowercased cache populated at build / skeleton
-                 * load time.  This avoids a palloc + memcpy + pfree on every
-                 * record for every ILIKE fallback scan.
-                 *
-                 * column_data_cache_lower is guaranteed non-NULL here: it is
-                 * allocated alongside column_data_cache in both biscuit_build
-                 * (biscuit_index.c) and biscuit_load_skeleton (this file).
-                 * Per-slot entries are NULL iff the source value was NULL,
-                 * which is caught by the "if (!str) continue" below.
-                 */
-                str = idx->column_data_cache_lower[col_idx][i];
-            }
-            else
-            {
-                str = idx->column_data_cache[col_idx][i];
-            }
-        }
+        if (idx->num_columns > 1 && (col_idx < 0 || col_idx >= idx->num_columns))
+            continue;
 
+        /*
+         * The skeleton holds the lowercased copies made at load time, so
+         * ILIKE needs no per-record palloc here.  NULL values have no
+         * string and are skipped.
+         */
+        str = biscuit_record_string(idx, col_idx, ilike, (uint32_t) i, &len, &to_free);
         if (!str) continue;
 
-        if (biscuit_like_match(str, strlen(str), match_pattern, pat_len))
+        matched = biscuit_like_exec(plan, str, len);
+        if (to_free)
+            pfree(to_free);
+
+        if (matched)
         {
             if (count >= capacity)
             {
@@ -1146,6 +1190,7 @@ biscuit_fallback_scan(BiscuitIndex *idx,
         }
     }
 
+    biscuit_like_free(plan);
     if (pattern_lower) pfree(pattern_lower);
 
     *out_tids  = tids;
@@ -1156,12 +1201,143 @@ biscuit_fallback_scan(BiscuitIndex *idx,
  * Background worker main loop
  * ================================================================ */
 
+static int               biscuit_worker_slot = -1;
+static BiscuitPreloadKey biscuit_worker_current;    /* index being built */
+static bool              biscuit_worker_working = false;
+
+/*
+ * Record the outcome for the index this worker was building;
+ * BISCUIT_PRELOAD_NONE forgets it (a prewarm entry for a dropped index).
+ */
+static void
+biscuit_preload_finish_current(uint32 state)
+{
+    BiscuitPreloadEntry *entry;
+
+    if (!biscuit_worker_working)
+        return;
+
+    LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
+    entry = (BiscuitPreloadEntry *)
+        hash_search(biscuit_preload_htab, &biscuit_worker_current, HASH_FIND, NULL);
+    if (entry && entry->state == BISCUIT_PRELOAD_RUNNING)
+    {
+        if (state == BISCUIT_PRELOAD_NONE)
+            hash_search(biscuit_preload_htab, &biscuit_worker_current, HASH_REMOVE, NULL);
+        else
+            entry->state = state;
+    }
+    if (biscuit_worker_slot >= 0)
+        biscuit_preload_shmem->workers[biscuit_worker_slot].busy = false;
+    LWLockRelease(BiscuitPreloadLock());
+
+    memset(&biscuit_worker_current, 0, sizeof(biscuit_worker_current));
+    biscuit_worker_working = false;
+}
+
+/* Entries of the startup prewarm come from a list or an earlier run */
+bool
+biscuit_preload_is_biscuit(Oid relid)
+{
+    HeapTuple    tup;
+    Form_pg_class form;
+    bool         result;
+
+    tup = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+    if (!HeapTupleIsValid(tup))
+        return false;
+    form   = (Form_pg_class) GETSTRUCT(tup);
+    result = form->relkind == RELKIND_INDEX &&
+             form->relam == get_index_am_oid("biscuit", true);
+    ReleaseSysCache(tup);
+
+    return result;
+}
+
+/*
+ * Read every block of the index into shared buffers, so the sessions that
+ * load its snapshot after a prewarm find it there.  A shared image needs
+ * no such help.
+ */
+static void
+biscuit_preload_read_buffers(Oid indexoid)
+{
+    Relation    index = index_open(indexoid, AccessShareLock);
+    BlockNumber nblocks = RelationGetNumberOfBlocks(index);
+    BlockNumber blkno;
+
+    for (blkno = 0; blkno < nblocks; blkno++)
+    {
+        CHECK_FOR_INTERRUPTS();
+        ReleaseBuffer(ReadBufferExtended(index, MAIN_FORKNUM, blkno, RBM_NORMAL, NULL));
+    }
+
+    index_close(index, AccessShareLock);
+}
+
+/*
+ * Fail the prewarm entries still queued for dboid once its last worker is
+ * gone, so biscuit_prewarm_ready() does not wait on them forever (the
+ * worker could not connect, or died).  Caller holds BiscuitPreloadLock.
+ */
+static void
+biscuit_preload_drop_prewarm(Oid dboid)
+{
+    BiscuitPreloadShmem *sh = biscuit_preload_shmem;
+    dlist_mutable_iter   iter;
+    int                  i;
+
+    for (i = 0; i < BISCUIT_PRELOAD_MAX_WORKERS; i++)
+        if (sh->workers[i].dboid == dboid)
+            return;
+
+    dlist_foreach_modify(iter, &sh->queue)
+    {
+        BiscuitPreloadEntry *entry = dlist_container(BiscuitPreloadEntry, node, iter.cur);
+
+        if (entry->key.dboid != dboid || !entry->prewarm)
+            continue;
+
+        dlist_delete(iter.cur);
+        sh->queue_size--;
+        entry->state = BISCUIT_PRELOAD_FAILED;
+    }
+}
+
+/* However the worker exits: fail the index in progress and free the slot */
+static void
+biscuit_preload_worker_exit(int code, Datum arg)
+{
+    BiscuitPreloadShmem *sh = biscuit_preload_shmem;
+    Oid                  dboid;
+
+    (void) code;
+    (void) arg;
+
+    if (!sh || biscuit_worker_slot < 0)
+        return;
+
+    biscuit_preload_finish_current(BISCUIT_PRELOAD_FAILED);
+
+    LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
+    dboid = sh->workers[biscuit_worker_slot].dboid;
+    sh->workers[biscuit_worker_slot].dboid = InvalidOid;
+    sh->workers[biscuit_worker_slot].pid   = 0;
+    sh->workers[biscuit_worker_slot].latch = NULL;
+    sh->workers[biscuit_worker_slot].busy  = false;
+    biscuit_preload_drop_prewarm(dboid);
+    LWLockRelease(BiscuitPreloadLock());
+
+    biscuit_worker_slot = -1;
+}
+
 void
 biscuit_preload_worker_main(Datum main_arg)
 {
-    BiscuitPreloadShmem *sh;
-
-    (void) main_arg;   /* suppress unused-parameter warning */
+    BiscuitPreloadShmem *sh     = biscuit_preload_shmem;
+    int                  slotno = DatumGetInt32(main_arg);
+    Oid                  dboid;
+    long                 idle_ms = 0;
 
     /* Allow signals */
     pqsignal(SIGTERM, die);
@@ -1172,66 +1348,107 @@ biscuit_preload_worker_main(Datum main_arg)
 #endif
     BackgroundWorkerUnblockSignals();
 
-    /* Connect to the default database (template1 or first DB in list) */
-    BackgroundWorkerInitializeConnection(NULL, NULL, 0);
+    if (!sh || slotno < 0 || slotno >= BISCUIT_PRELOAD_MAX_WORKERS)
+        proc_exit(0);
 
     /* Register our latch so requesters can wake us */
-    sh = biscuit_preload_shmem;
-    if (sh)
-        sh->worker_latch = MyLatch;
+    LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
+    dboid = sh->workers[slotno].dboid;
+    sh->workers[slotno].pid   = MyProcPid;
+    sh->workers[slotno].latch = MyLatch;
+    LWLockRelease(BiscuitPreloadLock());
+
+    biscuit_worker_slot = slotno;
+    on_shmem_exit(biscuit_preload_worker_exit, (Datum) 0);
+
+    if (!OidIsValid(dboid))
+        proc_exit(0);
 
-    elog(LOG, "Biscuit preload worker started");
+    /* Indexes can only be opened from a session in their own database */
+    BackgroundWorkerInitializeConnectionByOid(dboid, InvalidOid, 0);
+
+    elog(LOG, "Biscuit preload worker started for database %u", dboid);
 
     for (;;)
     {
-        Oid  indexoid = InvalidOid;
-        int  oid_slot = -1;
+        dlist_iter           iter;
+        BiscuitPreloadEntry *next = NULL;
+        bool                 prewarm = false;
 
         CHECK_FOR_INTERRUPTS();
 
-        /* Dequeue one OID */
-        if (sh)
+        if (ConfigReloadPending)
         {
-            LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
-            if (sh->queue_size > 0)
-            {
-                indexoid = sh->queue[sh->queue_head];
-                sh->queue_head = (sh->queue_head + 1) % 64;
-                sh->queue_size--;
-                oid_slot = (int)(indexoid % 64);
-                pg_atomic_write_u32(&sh->slot_state[oid_slot],
-                                    BISCUIT_PRELOAD_RUNNING);
-            }
+            ConfigReloadPending = false;
+            ProcessConfigFile(PGC_SIGHUP);
+        }
+
+        /* Dequeue the request of highest priority (then the oldest) for our database */
+        LWLockAcquire(BiscuitPreloadLock(), LW_EXCLUSIVE);
+        dlist_foreach(iter, &sh->queue)
+        {
+            BiscuitPreloadEntry *entry = dlist_container(BiscuitPreloadEntry, node, iter.cur);
+
+            if (entry->key.dboid == dboid && (!next || entry->priority > next->priority))
+                next = entry;
+        }
+
+        if (next)
+        {
+            dlist_delete(&next->node);
+            sh->queue_size--;
+            next->state              = BISCUIT_PRELOAD_RUNNING;
+            biscuit_worker_current   = next->key;
+            biscuit_worker_working   = true;
+            prewarm                  = next->prewarm;
+            sh->workers[slotno].busy = true;
+        }
+        else if (idle_ms >= BISCUIT_PRELOAD_IDLE_TIMEOUT_MS)
+        {
+            /*
+             * Give the slot up while still holding the lock, so a request
+             * arriving after this point starts a fresh worker.
+             */
+            sh->workers[slotno].dboid = InvalidOid;
+            sh->workers[slotno].pid   = 0;
+            sh->workers[slotno].latch = NULL;
+            biscuit_worker_slot       = -1;
             LWLockRelease(BiscuitPreloadLock());
+
+            elog(DEBUG1, "Biscuit preload worker for database %u exiting after idle period", dboid);
+            proc_exit(0);
         }
+        LWLockRelease(BiscuitPreloadLock());
 
-        if (OidIsValid(indexoid))
+        if (next)
         {
+            Oid             indexoid = biscuit_worker_current.indexoid;
+            volatile uint32 result   = BISCUIT_PRELOAD_DONE;
+
+            idle_ms = 0;
+
             PG_TRY();
             {
                 StartTransactionCommand();
                 PushActiveSnapshot(GetTransactionSnapshot());
 
-                biscuit_complete_preload(indexoid);
+                if (!OidIsValid(indexoid))
+                    biscuit_prewarm_resolve();  /* queues biscuit.prewarm_indexes */
+                else if (!prewarm || biscuit_preload_is_biscuit(indexoid))
+                {
+                    biscuit_complete_preload(indexoid);
+                    if (prewarm && !biscuit_shared_enabled())
+                        biscuit_preload_read_buffers(indexoid);
+                }
+                else
+                    result = BISCUIT_PRELOAD_NONE;
 
                 PopActiveSnapshot();
                 CommitTransactionCommand();
-
-                /*
-                 * biscuit_complete_preload already writes DONE into the
-                 * shmem slot via its internal logic.  The write here is
-                 * a belt-and-suspenders guarantee in case the function
-                 * returns without doing so (e.g. "already DONE" early-exit).
-                 */
-                if (sh && oid_slot >= 0)
-                    pg_atomic_write_u32(&sh->slot_state[oid_slot],
-                                        BISCUIT_PRELOAD_DONE);
             }
             PG_CATCH();
             {
-                if (sh && oid_slot >= 0)
-                    pg_atomic_write_u32(&sh->slot_state[oid_slot],
-                                        BISCUIT_PRELOAD_FAILED);
+                result = BISCUIT_PRELOAD_FAILED;
 
                 HOLD_INTERRUPTS();
                 EmitErrorReport();
@@ -1240,15 +1457,24 @@ biscuit_preload_worker_main(Datum main_arg)
                 RESUME_INTERRUPTS();
             }
             PG_END_TRY();
+
+            biscuit_preload_finish_current(result);
+
+            /* The names just resolved may want more of this database's workers */
+            if (!OidIsValid(indexoid))
+                (void) biscuit_preload_dispatch();
         }
         else
         {
             /* Nothing to do — wait for a signal (up to 5 seconds) */
-            (void) WaitLatch(MyLatch,
-                             WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
-                             5000L,
-                             WAIT_EVENT_BGWORKER_MAIN);
+            int rc = WaitLatch(MyLatch,
+                               WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+                               5000L,
+                               WAIT_EVENT_BGWORKER_MAIN);
             ResetLatch(MyLatch);
+
+            if (rc & WL_TIMEOUT)
+                idle_ms += 5000L;
         }
     }
 }
@@ -5,8 +5,8 @@
  * On the first query after a restart, biscuit_beginscan returns a
  * skeleton index immediately (TIDs + data cache loaded, bitmaps empty)
  * so the caller is unblocked.  Simultaneously, a background worker
- * (BiscuitPreloadWorker) is launched to rebuild all bitmaps into
- * CacheMemoryContext.  Subsequent queries find the index fully warm.
+ * (BiscuitPreloadWorker) is asked to build the full index.  Subsequent
+ * queries pick up the worker's result and find the index fully warm.
  *
  * Thread-safety contract
  * ----------------------
@@ -16,12 +16,21 @@
  * but correct).  Once the worker sets the flag the fast bitmap path is
  * used automatically.
  *
- * The worker and the foreground process live in *separate OS processes*
- * (PostgreSQL background worker model), so there is no shared memory
- * race: the worker writes into its own backend's CacheMemoryContext
- * copy of the index and then signals the owning session via a named
- * latch.  The owning session re-caches the fully-loaded index on next
- * access.
+ * What the worker delivers
+ * ------------------------
+ * The worker lives in a separate process, so it cannot hand over its
+ * in-memory copy.  Instead it writes the finished index to the on-disk
+ * snapshot (biscuit_storage.c) and, with biscuit.shared_index on, maps
+ * it into the shared image area (biscuit_shared.c).  When a backend
+ * holding a skeleton sees DONE it calls biscuit_preload_adopt(), which
+ * loads that snapshot (a sequential read, or attaching to the shared
+ * image) instead of rebuilding every bitmap itself.
+ *
+ * Workers are started on demand, up to biscuit.preload_workers per
+ * database (a worker must be connected to the database that owns the
+ * index), each building a different index, and exit when idle.  They
+ * take the queued index of highest priority first: one a session is
+ * waiting on, then the indexes biscuit_prewarm.c queues at startup.
  */
 
 #ifndef BISCUIT_PRELOAD_H
@@ -37,72 +46,101 @@
 #define BISCUIT_PRELOAD_SKELETON   1   /* skeleton loaded, worker pending */
 #define BISCUIT_PRELOAD_RUNNING    2   /* worker is building bitmaps  */
 #define BISCUIT_PRELOAD_DONE       3   /* fully warm, use bitmap path */
-#define BISCUIT_PRELOAD_FAILED     4   /* worker crashed; use seq scan */
+#define BISCUIT_PRELOAD_FAILED     4   /* worker failed; build locally */
 
-/* ================================================================
- * Shared-memory control block
- * Allocated once in _PG_init via ShmemInitStruct.
- * ================================================================ */
-typedef struct BiscuitPreloadShmem
+/* At most this many preload workers run at once, over all databases */
+#define BISCUIT_PRELOAD_MAX_WORKERS 16
+
+/* Queue priorities: a session waits on it, or biscuit.prewarm_indexes has it */
+#define BISCUIT_PRELOAD_PRIORITY_WAITING PG_INT64_MAX
+#define BISCUIT_PRELOAD_PRIORITY_LISTED  (PG_INT64_MAX - 1)
+
+/* GUC: size of the per-index state table (biscuit.preload_max_indexes) */
+extern int biscuit_preload_max_indexes;
+
+/* GUC: preload workers one database may run at once (biscuit.preload_workers) */
+extern int biscuit_preload_workers;
+
+/* One entry of the shared state table, as biscuit_preload_status() shows it */
+typedef struct BiscuitPreloadInfo
 {
-    /* Queue of index OIDs waiting to be preloaded (ring buffer). */
-    Oid     queue[64];
-    int     queue_head;         /* next slot to dequeue             */
-    int     queue_tail;         /* next slot to enqueue             */
-    int     queue_size;         /* current item count               */
-
-    /* Latch owned by the preload worker process. */
-    Latch  *worker_latch;
-
-    /*
-     * Per-OID state tracking, indexed by (OID % 64).
-     *
-     * slot_state[] is keyed by OID modulo 64 — NOT by ring-buffer position.
-     * This means the state remains readable even after the worker dequeues
-     * the OID (advancing queue_head past it).  biscuit_preload_state() reads
-     * slot_state[indexoid % 64] directly, with no ring-buffer scan.
-     *
-     * Collision risk: two distinct OIDs that share the same slot (OID % 64).
-     * We track the OID stored in each slot so callers can detect this and
-     * fall back to BISCUIT_PRELOAD_NONE safely.
-     */
-    pg_atomic_uint32 slot_state[64];  /* BISCUIT_PRELOAD_* for OID % 64  */
-    pg_atomic_uint32 slot_oid[64];    /* OID currently owning the slot    */
-} BiscuitPreloadShmem;
+    Oid         dboid;
+    Oid         indexoid;
+    uint32      state;          /* BISCUIT_PRELOAD_* */
+    int64       priority;
+    bool        prewarm;        /* queued by the startup prewarm */
+} BiscuitPreloadInfo;
 
 /* ================================================================
  * API
  * ================================================================ */
 
 /*
- * Size of the shared-memory segment used by the preloader.
+ * Size of the shared-memory segment used by the preloader (control
+ * block plus the per-index state table).
  * Must be called from the shmem_request_hook.
  */
 extern Size biscuit_preload_shmem_size(void);
 
 /*
- * Called from _PG_init to register the background worker and allocate
- * shared memory.  Safe to call multiple times (idempotent).
+ * Called from _PG_init to define the preload GUC and hook shared-memory
+ * allocation.  Workers are started on demand by biscuit_preload_request.
  */
 extern void biscuit_preload_init(void);
 
 /*
- * Request background preloading for the given index OID.
- * Returns immediately; the worker does the heavy lifting.
- * If the worker is not available (e.g. max_worker_processes reached),
- * this is a no-op — the skeleton will remain and the fallback seq-scan
- * path handles queries until a full load happens lazily.
+ * Request background preloading for the given index OID (in the current
+ * database).  Returns immediately; the worker does the heavy lifting.
+ * Returns false when no worker can take the request (library not
+ * preloaded, state table full, no free worker slot, or recovery); the
+ * caller should then build the bitmaps itself.
+ */
+extern bool biscuit_preload_request(Oid indexoid);
+
+/*
+ * Queue indexoid of database dboid at the given priority without starting
+ * a worker (biscuit_preload_dispatch does that).  An InvalidOid index
+ * queues resolving biscuit.prewarm_indexes in that database.  False when
+ * the state table is full.
+ */
+extern bool biscuit_preload_enqueue(Oid dboid, Oid indexoid, int64 priority, bool prewarm);
+
+/*
+ * Start workers, within their limits, for every database with queued
+ * indexes.  Returns the number of indexes still queued.
  */
-extern void biscuit_preload_request(Oid indexoid);
+extern int  biscuit_preload_dispatch(void);
+
+/* The startup prewarm has queued everything it was going to */
+extern void biscuit_preload_prewarm_queued(void);
+
+/*
+ * True once the startup prewarm has queued its indexes and every one of
+ * them is built or has failed.  Also true without shared memory and
+ * during recovery, when nothing is warmed in the background.
+ */
+extern bool biscuit_preload_prewarm_ready(void);
+
+/* Whether relid is (still) a Biscuit index; needs a transaction */
+extern bool biscuit_preload_is_biscuit(Oid relid);
+
+/* Every tracked index (all databases), palloc'd; *count entries */
+extern BiscuitPreloadInfo *biscuit_preload_collect(int *count);
 
 /*
  * Return the current BISCUIT_PRELOAD_* state for the given index OID
- * as recorded in the shared-memory ring buffer.
- * Returns BISCUIT_PRELOAD_NONE when the OID is not in the queue.
- * Cheap: reads an atomic uint32, no lock.
+ * as recorded in the shared state table.
+ * Returns BISCUIT_PRELOAD_NONE when the OID was never requested.
  */
 extern uint32 biscuit_preload_state(Oid indexoid);
 
+/*
+ * Replace a skeleton once the worker reports DONE: loads the snapshot
+ * the worker published, or completes the skeleton locally if that
+ * snapshot is no longer valid.  Caches and returns the index to use.
+ */
+extern BiscuitIndex *biscuit_preload_adopt(Relation index, BiscuitIndex *skeleton);
+
 /*
  * Build just the skeleton: TIDs and data_cache populated, all bitmap
  * fields zeroed/NULL.  preload_state is set to BISCUIT_PRELOAD_SKELETON.
@@ -111,9 +149,9 @@ extern uint32 biscuit_preload_state(Oid indexoid);
 extern BiscuitIndex *biscuit_load_skeleton(Relation index);
 
 /*
- * Complete the bitmap population for an already-skeleton index.
- * Called from the background worker.  When done, sets preload_state to
- * BISCUIT_PRELOAD_DONE.
+ * Worker side: make sure the index has a VALID on-disk snapshot
+ * (building it from the heap if needed) and publish it to the shared
+ * image area when that is enabled.
  */
 extern void biscuit_complete_preload(Oid indexoid);
 
@@ -123,20 +161,19 @@ extern void biscuit_complete_preload(Oid indexoid);
  * populated, all bitmap fields NULL).  Does NOT open the relation or do
  * a heap scan — it indexes only from the in-memory string cache.
  *
- * On success sets idx->preload_state = BISCUIT_PRELOAD_DONE and writes
- * DONE into the shared-memory slot so other backends see it.
+ * On success sets idx->preload_state = BISCUIT_PRELOAD_DONE.
  *
- * Used by the foreground rescan path when it detects that the worker has
- * finished: instead of calling biscuit_load_index() (full heap scan +
- * bitmap build), it calls this on the skeleton it already has in memory,
+ * Used when the worker's snapshot cannot be used (or no worker is
+ * available): instead of calling biscuit_load_index() (full heap scan +
+ * bitmap build), it indexes the skeleton it already has in memory,
  * building bitmaps in O(total-string-bytes) time with no extra I/O.
  */
 extern void biscuit_complete_preload_local(BiscuitIndex *idx, Oid indexoid);
 
 /*
  * Fallback scan used while preload_state < BISCUIT_PRELOAD_DONE.
- * Walks data_cache / column_data_cache and matches pattern using
- * pg_pattern_fixed_prefix / plain strstr — no bitmaps.
+ * Walks data_cache / column_data_cache and matches each string against
+ * the pattern compiled once with biscuit_like_compile() — no bitmaps.
  * Writes matching TIDs into *out_tids / *out_count (palloc'd).
  */
 extern void biscuit_fallback_scan(BiscuitIndex *idx,
@@ -148,7 +185,7 @@ extern void biscuit_fallback_scan(BiscuitIndex *idx,
 
 /*
  * Background worker main entry point (registered with
- * RegisterBackgroundWorker).
+ * RegisterDynamicBackgroundWorker; main_arg is the worker slot).
  */
 extern void biscuit_preload_worker_main(Datum main_arg);
 
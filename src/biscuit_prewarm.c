@@ -0,0 +1,487 @@
+/*
+ * biscuit_prewarm.c
+ * Startup prewarm of Biscuit indexes.
+ *
+ * Without it an index is warmed lazily: its first scan after a restart
+ * loads a skeleton and queues it for a preload worker, and every query
+ * until the worker is done walks the string caches.  With biscuit.prewarm
+ * on (the default; needs shared_preload_libraries), a launcher started
+ * once recovery has finished queues, before any query asks:
+ *
+ *   1. the indexes of biscuit.prewarm_indexes, a list of
+ *      "database:[schema.]index" names.  The launcher is not connected
+ *      to any database, so it queues one lookup per database named there,
+ *      and the first preload worker of that database resolves the names
+ *      and queues the indexes (biscuit_prewarm_resolve).
+ *
+ *   2. every index of the usage file, a Biscuit index scanned since the
+ *      last start, with its scan count (biscuit_stat_indexes) as its
+ *      priority.  The launcher rewrites the file every
+ *      biscuit.prewarm_interval seconds and at shutdown, counting the
+ *      scans before the last start at half weight, so indexes that fall
+ *      out of use fade from it.
+ *
+ * The preload workers (biscuit_preload.c) then build them, up to
+ * biscuit.preload_workers per database at once, in priority order: an
+ * index a session is waiting on, then the listed ones, then the rest by
+ * recorded usage.  While workers are short of slots the launcher keeps
+ * dispatching the queue.
+ *
+ * biscuit_prewarm_ready() is true once everything queued here is built
+ * (or failed), so a load balancer can hold traffic until then.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_instrument.h"
+#include "biscuit_preload.h"
+#include "biscuit_prewarm.h"
+
+#include "catalog/namespace.h"
+#include "commands/dbcommands.h"
+#include "nodes/miscnodes.h"
+#include "storage/fd.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/syscache.h"
+#include "utils/varlena.h"
+#include "utils/wait_event.h"
+
+#include <unistd.h>
+
+/* In the data directory, like pg_prewarm's autoprewarm.blocks */
+#define BISCUIT_PREWARM_FILE "biscuit_prewarm.dat"
+
+/* How often the launcher looks at the queue while indexes wait for a worker */
+#define BISCUIT_PREWARM_DISPATCH_MS 1000L
+
+bool  biscuit_prewarm_enabled  = true;
+char *biscuit_prewarm_indexes  = NULL;
+int   biscuit_prewarm_interval = 300;
+
+/* ================================================================
+ * SECTION 1 – Usage file
+ * ================================================================ */
+
+typedef struct BiscuitPrewarmKey
+{
+    Oid         dboid;
+    Oid         indexoid;
+} BiscuitPrewarmKey;
+
+typedef struct BiscuitPrewarmRecord
+{
+    BiscuitPrewarmKey key;
+    int64             scans;
+} BiscuitPrewarmRecord;
+
+static int
+biscuit_prewarm_record_cmp(const void *a, const void *b)
+{
+    int64 sa = ((const BiscuitPrewarmRecord *) a)->scans;
+    int64 sb = ((const BiscuitPrewarmRecord *) b)->scans;
+
+    return (sa < sb) - (sa > sb);   /* most scanned first */
+}
+
+/* The records of the usage file, most scanned first; NULL when there is none */
+static BiscuitPrewarmRecord *
+biscuit_prewarm_read(int *count)
+{
+    BiscuitPrewarmRecord *records  = NULL;
+    int                   capacity = 0;
+    int                   n        = 0;
+    FILE                 *file;
+    char                  line[128];
+
+    *count = 0;
+
+    file = AllocateFile(BISCUIT_PREWARM_FILE, "r");
+    if (!file)
+    {
+        if (errno != ENOENT)
+            ereport(LOG,
+                    (errcode_for_file_access(),
+                     errmsg("could not open file \"%s\": %m", BISCUIT_PREWARM_FILE)));
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned int dboid;
+        unsigned int indexoid;
+        long long    scans;
+
+        if (line[0] == '#' ||
+            sscanf(line, "%u %u %lld", &dboid, &indexoid, &scans) != 3)
+            continue;
+
+        if (n == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            records  = records
+                ? (BiscuitPrewarmRecord *) repalloc(records, capacity * sizeof(BiscuitPrewarmRecord))
+                : (BiscuitPrewarmRecord *) palloc(capacity * sizeof(BiscuitPrewarmRecord));
+        }
+        records[n].key.dboid    = (Oid) dboid;
+        records[n].key.indexoid = (Oid) indexoid;
+        records[n].scans        = (int64) scans;
+        n++;
+    }
+    FreeFile(file);
+
+    if (n > 1)
+        qsort(records, n, sizeof(BiscuitPrewarmRecord), biscuit_prewarm_record_cmp);
+
+    *count = n;
+    return records;
+}
+
+/*
+ * Write the usage file: the scans since this start, plus half of those
+ * read at startup (loaded).  Written to a temporary file and renamed,
+ * so a crash leaves the previous one.
+ */
+static void
+biscuit_prewarm_dump(const BiscuitPrewarmRecord *loaded, int nloaded)
+{
+    BiscuitStatUsage     *usage;
+    HTAB                 *merged;
+    HASHCTL               info;
+    HASH_SEQ_STATUS       status;
+    BiscuitPrewarmRecord *rec;
+    FILE                 *file;
+    const char           *tmpfile = BISCUIT_PREWARM_FILE ".tmp";
+    int                   nusage;
+    int                   i;
+
+    memset(&info, 0, sizeof(info));
+    info.keysize   = sizeof(BiscuitPrewarmKey);
+    info.entrysize = sizeof(BiscuitPrewarmRecord);
+    info.hcxt      = CurrentMemoryContext;
+    merged = hash_create("biscuit prewarm usage", Max(nloaded, 64), &info,
+                         HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+    for (i = 0; i < nloaded; i++)
+    {
+        bool found;
+
+        rec = (BiscuitPrewarmRecord *) hash_search(merged, &loaded[i].key, HASH_ENTER, &found);
+        rec->scans = (found ? rec->scans : 0) + loaded[i].scans / 2;
+    }
+
+    usage = biscuit_instrument_usage(&nusage);
+    for (i = 0; i < nusage; i++)
+    {
+        BiscuitPrewarmKey key;
+        bool              found;
+
+        memset(&key, 0, sizeof(key));
+        key.dboid    = usage[i].dboid;
+        key.indexoid = usage[i].indexoid;
+        rec = (BiscuitPrewarmRecord *) hash_search(merged, &key, HASH_ENTER, &found);
+        rec->scans = (found ? rec->scans : 0) + usage[i].scans;
+    }
+
+    file = AllocateFile(tmpfile, "w");
+    if (!file)
+    {
+        ereport(LOG,
+                (errcode_for_file_access(),
+                 errmsg("could not open file \"%s\": %m", tmpfile)));
+        return;
+    }
+
+    fprintf(file, "# biscuit prewarm: database index scans\n");
+    hash_seq_init(&status, merged);
+    while ((rec = (BiscuitPrewarmRecord *) hash_seq_search(&status)) != NULL)
+    {
+        if (rec->scans > 0)
+            fprintf(file, "%u %u %lld\n",
+                    rec->key.dboid, rec->key.indexoid, (long long) rec->scans);
+    }
+
+    if (FreeFile(file) != 0)
+    {
+        ereport(LOG,
+                (errcode_for_file_access(),
+                 errmsg("could not write file \"%s\": %m", tmpfile)));
+        unlink(tmpfile);
+        return;
+    }
+
+    (void) durable_rename(tmpfile, BISCUIT_PREWARM_FILE, LOG);
+}
+
+/* ================================================================
+ * SECTION 2 – Queueing
+ * ================================================================ */
+
+/*
+ * The "database:index" items of biscuit.prewarm_indexes, split in place
+ * from a copy of the setting; NIL (with a warning) when it does not parse.
+ */
+static List *
+biscuit_prewarm_items(void)
+{
+    char *raw;
+    List *items;
+
+    if (!biscuit_prewarm_indexes || biscuit_prewarm_indexes[0] == '\0')
+        return NIL;
+
+    raw = pstrdup(biscuit_prewarm_indexes);
+    if (!SplitGUCList(raw, ',', &items))
+    {
+        ereport(WARNING,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("invalid list syntax in parameter \"biscuit.prewarm_indexes\"")));
+        return NIL;
+    }
+    return items;
+}
+
+/*
+ * Launcher, at startup: queue a name lookup for every database of
+ * biscuit.prewarm_indexes and every recorded index of a database that
+ * still exists.  Dropped indexes are skipped by the worker.
+ */
+static void
+biscuit_prewarm_queue(const BiscuitPrewarmRecord *records, int nrecords)
+{
+    List     *items;
+    List     *dboids = NIL;
+    ListCell *lc;
+    int       queued = 0;
+    int       i;
+
+    StartTransactionCommand();
+
+    items = biscuit_prewarm_items();
+    foreach(lc, items)
+    {
+        char *item  = (char *) lfirst(lc);
+        char *colon = strchr(item, ':');
+        Oid   dboid;
+
+        if (!colon)
+        {
+            ereport(WARNING,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("biscuit.prewarm_indexes entry \"%s\" has no database", item),
+                     errhint("Entries are written as database:index or database:schema.index.")));
+            continue;
+        }
+
+        *colon = '\0';
+        dboid  = get_database_oid(item, true);
+        if (!OidIsValid(dboid))
+        {
+            ereport(WARNING,
+                    (errcode(ERRCODE_UNDEFINED_DATABASE),
+                     errmsg("biscuit.prewarm_indexes: database \"%s\" does not exist", item)));
+            continue;
+        }
+        if (list_member_oid(dboids, dboid))
+            continue;
+
+        dboids = lappend_oid(dboids, dboid);
+        if (biscuit_preload_enqueue(dboid, InvalidOid, BISCUIT_PRELOAD_PRIORITY_LISTED, true))
+            queued++;
+    }
+
+    for (i = 0; i < nrecords; i++)
+    {
+        const BiscuitPrewarmRecord *rec = &records[i];
+
+        if (!SearchSysCacheExists1(DATABASEOID, ObjectIdGetDatum(rec->key.dboid)))
+            continue;
+        if (!biscuit_preload_enqueue(rec->key.dboid, rec->key.indexoid,
+                                     Min(rec->scans, BISCUIT_PRELOAD_PRIORITY_LISTED - 1),
+                                     true))
+            break;              /* state table full */
+        queued++;
+    }
+
+    CommitTransactionCommand();
+
+    biscuit_preload_prewarm_queued();
+
+    elog(LOG, "Biscuit prewarm: queued %d %s (%d recorded)", queued,
+         queued == 1 ? "entry" : "entries", nrecords);
+}
+
+void
+biscuit_prewarm_resolve(void)
+{
+    char     *dbname = get_database_name(MyDatabaseId);
+    size_t    dblen;
+    List     *items;
+    ListCell *lc;
+
+    if (!dbname)
+        return;
+    dblen = strlen(dbname);
+
+    items = biscuit_prewarm_items();
+    foreach(lc, items)
+    {
+        char             *item  = (char *) lfirst(lc);
+        char             *colon = strchr(item, ':');
+        ErrorSaveContext  escontext = {T_ErrorSaveContext};
+        List             *names;
+        Oid               relid = InvalidOid;
+
+        if (!colon || (size_t) (colon - item) != dblen || strncmp(item, dbname, dblen) != 0)
+            continue;
+
+        names = stringToQualifiedNameList(colon + 1, (Node *) &escontext);
+        if (names)
+            relid = RangeVarGetRelid(makeRangeVarFromNameList(names), NoLock, true);
+
+        if (!OidIsValid(relid) || !biscuit_preload_is_biscuit(relid))
+        {
+            ereport(WARNING,
+                    (errcode(ERRCODE_UNDEFINED_OBJECT),
+                     errmsg("biscuit.prewarm_indexes: \"%s\" is not a Biscuit index in database \"%s\"",
+                            colon + 1, dbname)));
+            continue;
+        }
+
+        if (!biscuit_preload_enqueue(MyDatabaseId, relid, BISCUIT_PRELOAD_PRIORITY_LISTED, true))
+            ereport(WARNING,
+                    (errmsg("biscuit.prewarm_indexes: no room to queue \"%s\"", colon + 1),
+                     errhint("Increase biscuit.preload_max_indexes.")));
+    }
+}
+
+/* ================================================================
+ * SECTION 3 – Launcher
+ * ================================================================ */
+
+/* However the launcher exits, biscuit_prewarm_ready() must not wait on it */
+static void
+biscuit_prewarm_exit(int code, Datum arg)
+{
+    (void) code;
+    (void) arg;
+
+    biscuit_preload_prewarm_queued();
+}
+
+void
+biscuit_prewarm_main(Datum main_arg)
+{
+    BiscuitPrewarmRecord *records;
+    int                   nrecords;
+    MemoryContext         dump_context;
+    TimestampTz           last_dump;
+
+    (void) main_arg;
+
+    pqsignal(SIGTERM, SignalHandlerForShutdownRequest);
+    pqsignal(SIGHUP,  SignalHandlerForConfigReload);
+    BackgroundWorkerUnblockSignals();
+
+    on_shmem_exit(biscuit_prewarm_exit, (Datum) 0);
+
+    /* Only shared catalogs: enough to look up databases */
+    BackgroundWorkerInitializeConnection(NULL, NULL, 0);
+
+    records = biscuit_prewarm_read(&nrecords);
+    biscuit_prewarm_queue(records, nrecords);
+
+    dump_context = AllocSetContextCreate(TopMemoryContext, "biscuit prewarm dump",
+                                         ALLOCSET_DEFAULT_SIZES);
+    last_dump    = GetCurrentTimestamp();
+
+    while (!ShutdownRequestPending)
+    {
+        int queued;
+
+        CHECK_FOR_INTERRUPTS();
+
+        if (ConfigReloadPending)
+        {
+            ConfigReloadPending = false;
+            ProcessConfigFile(PGC_SIGHUP);
+        }
+
+        queued = biscuit_preload_dispatch();
+
+        if (biscuit_prewarm_interval > 0 &&
+            TimestampDifferenceExceeds(last_dump, GetCurrentTimestamp(),
+                                       biscuit_prewarm_interval * 1000))
+        {
+            MemoryContext oldcontext = MemoryContextSwitchTo(dump_context);
+
+            biscuit_prewarm_dump(records, nrecords);
+            MemoryContextSwitchTo(oldcontext);
+            MemoryContextReset(dump_context);
+            last_dump = GetCurrentTimestamp();
+        }
+
+        (void) WaitLatch(MyLatch,
+                         WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+                         queued > 0 ? BISCUIT_PREWARM_DISPATCH_MS : 10000L,
+                         PG_WAIT_EXTENSION);
+        ResetLatch(MyLatch);
+    }
+
+    /* Shutdown: record this run's usage for the next start */
+    MemoryContextSwitchTo(dump_context);
+    biscuit_prewarm_dump(records, nrecords);
+
+    proc_exit(0);
+}
+
+/* ================================================================
+ * SECTION 4 – Initialisation
+ * ================================================================ */
+
+void
+biscuit_prewarm_init(void)
+{
+    BackgroundWorker worker;
+
+    DefineCustomBoolVariable("biscuit.prewarm",
+                             "Warm Biscuit indexes at server start.",
+                             "Warms biscuit.prewarm_indexes and the indexes scanned "
+                             "before the restart, most used first.",
+                             &biscuit_prewarm_enabled,
+                             true,
+                             PGC_POSTMASTER,
+                             0,
+                             NULL, NULL, NULL);
+
+    DefineCustomStringVariable("biscuit.prewarm_indexes",
+                               "Biscuit indexes warmed first at server start.",
+                               "Comma-separated database:index or database:schema.index names.",
+                               &biscuit_prewarm_indexes,
+                               "",
+                               PGC_POSTMASTER,
+                               0,
+                               NULL, NULL, NULL);
+
+    DefineCustomIntVariable("biscuit.prewarm_interval",
+                            "Interval between writes of the Biscuit index usage file.",
+                            "0 writes it only at shutdown.",
+                            &biscuit_prewarm_interval,
+                            300, 0, INT_MAX / 1000,
+                            PGC_SIGHUP,
+                            GUC_UNIT_S,
+                            NULL, NULL, NULL);
+
+    if (!process_shared_preload_libraries_in_progress || !biscuit_prewarm_enabled)
+        return;
+
+    memset(&worker, 0, sizeof(worker));
+    worker.bgw_flags        = BGWORKER_SHMEM_ACCESS |
+                              BGWORKER_BACKEND_DATABASE_CONNECTION;
+    worker.bgw_start_time   = BgWorkerStart_RecoveryFinished;
+    worker.bgw_restart_time = BGW_NEVER_RESTART;
+    snprintf(worker.bgw_library_name, BGW_MAXLEN, "biscuit");
+    snprintf(worker.bgw_function_name, BGW_MAXLEN, "biscuit_prewarm_main");
+    snprintf(worker.bgw_name, BGW_MAXLEN, "biscuit prewarm launcher");
+    snprintf(worker.bgw_type, BGW_MAXLEN, "biscuit prewarm");
+    RegisterBackgroundWorker(&worker);
+}
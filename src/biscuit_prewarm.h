@@ -0,0 +1,34 @@
+/*
+ * biscuit_prewarm.h
+ * Startup prewarm: warm the listed and the most used Biscuit indexes as
+ * soon as the server accepts connections, instead of on their first
+ * query.
+ */
+
+#ifndef BISCUIT_PREWARM_H
+#define BISCUIT_PREWARM_H
+
+#include "biscuit_common.h"
+
+/* biscuit.prewarm: run the prewarm launcher (needs shared_preload_libraries) */
+extern bool  biscuit_prewarm_enabled;
+
+/* biscuit.prewarm_indexes: "database:index" list warmed first */
+extern char *biscuit_prewarm_indexes;
+
+/* biscuit.prewarm_interval: seconds between writes of the usage file */
+extern int   biscuit_prewarm_interval;
+
+/* Register the GUCs and, at postmaster start, the launcher */
+extern void biscuit_prewarm_init(void);
+
+/*
+ * Preload worker side, in a transaction: queue the indexes of
+ * biscuit.prewarm_indexes that belong to the current database.
+ */
+extern void biscuit_prewarm_resolve(void);
+
+/* Launcher entry point (a static background worker) */
+extern void biscuit_prewarm_main(Datum main_arg);
+
+#endif /* BISCUIT_PREWARM_H */
@@ -0,0 +1,506 @@
+/*
+ * biscuit_regex.c
+ * Regular-expression keys through a LIKE prefilter.
+ *
+ * The opclass carries ~ and ~* (strategies 5 and 6); SIMILAR TO reaches
+ * the index as ~ on similar_to_escape() of its pattern, folded to a
+ * constant by the planner.  The bitmaps cannot evaluate a regex, but they
+ * evaluate LIKE, so each regex key is replaced at rescan by a LIKE (~*:
+ * ILIKE) key on a pattern that every match of the regex also matches
+ * (biscuit_keys_rewrite()):
+ *
+ *   '^error: .*timeout'     ->  'error: %timeout%'
+ *   'user_[0-9]+@corp\.com' ->  '%user\__%@corp.com%'
+ *   '(foo|bar)baz$'         ->  '%baz'
+ *   '\d{3}-\d{4}'           ->  '%_%-_%'
+ *
+ * The walk over the ARE keeps ordinary characters as literals, turns '.',
+ * bracket expressions and class escapes into '_', and anything optional
+ * or repeated into a '%' gap (a repeated atom stays once, followed by the
+ * gap).  Groups are inlined unless they hold an alternation; constraints
+ * (anchors inside the pattern, \y, lookaround) are dropped, as they match
+ * no characters.  A top-level alternation, back-reference or embedded
+ * option leaves only '%'.  The candidates are therefore a superset of the
+ * answer and the scan sets xs_recheck, so the executor runs the regex on
+ * them.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_regex.h"
+#include "biscuit_utf8.h"
+
+#include "lib/stringinfo.h"
+
+typedef struct BiscuitRegexParser
+{
+    const char *p;
+    const char *end;
+    bool        failed;         /* nothing can be required of a match */
+    bool        anchored_end;   /* a final top-level '$' */
+} BiscuitRegexParser;
+
+/* ================================================================
+ * SECTION 1 – LIKE output
+ * ================================================================ */
+
+/* Whether the last byte of out is an unescaped '%' */
+static bool
+biscuit_regex_ends_in_gap(const StringInfo out)
+{
+    int n = 0;
+
+    if (out->len == 0 || out->data[out->len - 1] != '%')
+        return false;
+    while (n < out->len - 1 && out->data[out->len - 2 - n] == '\\')
+        n++;
+    return (n % 2) == 0;
+}
+
+static void
+biscuit_regex_append_gap(StringInfo out)
+{
+    if (!biscuit_regex_ends_in_gap(out))
+        appendStringInfoChar(out, '%');
+}
+
+static void
+biscuit_regex_append_literal(StringInfo out, const char *ch, int len)
+{
+    if (len == 1 && (*ch == '%' || *ch == '_' || *ch == '\\'))
+        appendStringInfoChar(out, '\\');
+    appendBinaryStringInfo(out, ch, len);
+}
+
+/* Append a LIKE fragment, merging its leading gap with a trailing one */
+static void
+biscuit_regex_append(StringInfo out, const StringInfo frag)
+{
+    int i = 0;
+
+    if (frag->len > 0 && frag->data[0] == '%')
+    {
+        biscuit_regex_append_gap(out);
+        i = 1;
+    }
+    appendBinaryStringInfo(out, frag->data + i, frag->len - i);
+}
+
+/* ================================================================
+ * SECTION 2 – ARE walk
+ * ================================================================ */
+
+static int
+biscuit_regex_char_len(const BiscuitRegexParser *rp)
+{
+    int len = biscuit_utf8_char_length((unsigned char) *rp->p);
+
+    return Min(len, (int) (rp->end - rp->p));
+}
+
+/* Skip n hexadecimal digits (all of them when n < 0) */
+static void
+biscuit_regex_skip_hex(BiscuitRegexParser *rp, int n)
+{
+    while ((n < 0 || n-- > 0) && rp->p < rp->end && isxdigit((unsigned char) *rp->p))
+        rp->p++;
+}
+
+/* A bracket expression, rp->p just past '['; it matches one character */
+static void
+biscuit_regex_bracket(BiscuitRegexParser *rp)
+{
+    if (rp->p < rp->end && *rp->p == '^')
+        rp->p++;
+    if (rp->p < rp->end && *rp->p == ']')
+        rp->p++;
+
+    while (rp->p < rp->end && *rp->p != ']')
+    {
+        if (*rp->p == '[' && rp->p + 1 < rp->end &&
+            (rp->p[1] == ':' || rp->p[1] == '.' || rp->p[1] == '='))
+        {
+            char        delim = rp->p[1];
+            const char *q     = rp->p + 2;
+
+            while (q + 1 < rp->end && !(q[0] == delim && q[1] == ']'))
+                q++;
+            if (q + 1 >= rp->end)
+            {
+                rp->failed = true;
+                return;
+            }
+            rp->p = q + 2;
+        }
+        else if (*rp->p == '\\')
+            rp->p = Min(rp->p + 2, rp->end);
+        else
+            rp->p += biscuit_regex_char_len(rp);
+    }
+
+    if (rp->p >= rp->end)
+        rp->failed = true;
+    else
+        rp->p++;
+}
+
+/*
+ * An escape, rp->p just past '\': a literal, '_' for one character of a
+ * class or a character entry, or nothing for a constraint.
+ */
+static void
+biscuit_regex_escape(BiscuitRegexParser *rp, StringInfo atom)
+{
+    char c;
+
+    if (rp->p >= rp->end)
+    {
+        rp->failed = true;
+        return;
+    }
+
+    c = *rp->p;
+    if (!isalnum((unsigned char) c))
+    {
+        int len = biscuit_regex_char_len(rp);
+
+        biscuit_regex_append_literal(atom, rp->p, len);
+        rp->p += len;
+        return;
+    }
+
+    rp->p++;
+    switch (c)
+    {
+        case 'd': case 'D': case 's': case 'S': case 'w': case 'W':
+        case 'a': case 'b': case 'B': case 'e': case 'f': case 'n':
+        case 'r': case 't': case 'v':
+            appendStringInfoChar(atom, '_');
+            break;
+        case 'c':
+            if (rp->p >= rp->end)
+                rp->failed = true;
+            else
+                rp->p += biscuit_regex_char_len(rp);
+            appendStringInfoChar(atom, '_');
+            break;
+        case 'x':
+            biscuit_regex_skip_hex(rp, -1);
+            appendStringInfoChar(atom, '_');
+            break;
+        case 'u':
+            biscuit_regex_skip_hex(rp, 4);
+            appendStringInfoChar(atom, '_');
+            break;
+        case 'U':
+            biscuit_regex_skip_hex(rp, 8);
+            appendStringInfoChar(atom, '_');
+            break;
+        case 'A': case 'Z': case 'm': case 'M': case 'y': case 'Y':
+            break;
+        default:
+            /* Back-references, octal entries and unknown escapes */
+            rp->failed = true;
+            break;
+    }
+}
+
+/* The repetition count at rp->p, consumed (capped: only 0 and 1 matter) */
+static int
+biscuit_regex_bound(BiscuitRegexParser *rp)
+{
+    int n = 0;
+
+    while (rp->p < rp->end && isdigit((unsigned char) *rp->p))
+    {
+        n = n * 10 + (*rp->p - '0');
+        n = Min(n, 1000);
+        rp->p++;
+    }
+    return n;
+}
+
+/*
+ * The bounds of a quantifier at rp->p, consumed; max is -1 when there is
+ * none.  Returns false (consuming nothing) when no quantifier follows.
+ */
+static bool
+biscuit_regex_quantifier(BiscuitRegexParser *rp, int *min, int *max)
+{
+    if (rp->p >= rp->end)
+        return false;
+
+    switch (*rp->p)
+    {
+        case '*': *min = 0; *max = -1; rp->p++; break;
+        case '+': *min = 1; *max = -1; rp->p++; break;
+        case '?': *min = 0; *max = 1;  rp->p++; break;
+        case '{':
+            if (rp->p + 1 >= rp->end || !isdigit((unsigned char) rp->p[1]))
+                return false;
+            rp->p++;
+            *min = biscuit_regex_bound(rp);
+            *max = *min;
+            if (rp->p < rp->end && *rp->p == ',')
+            {
+                rp->p++;
+                *max = -1;
+                if (rp->p < rp->end && isdigit((unsigned char) *rp->p))
+                    *max = biscuit_regex_bound(rp);
+            }
+            if (rp->p >= rp->end || *rp->p != '}')
+            {
+                rp->failed = true;
+                return false;
+            }
+            rp->p++;
+            break;
+        default:
+            return false;
+    }
+
+    /* Non-greedy forms match the same strings */
+    if (rp->p < rp->end && *rp->p == '?')
+        rp->p++;
+    return true;
+}
+
+static void biscuit_regex_sequence(BiscuitRegexParser *rp, StringInfo out,
+                                   int depth, bool *alternation);
+
+/*
+ * One atom into atom.  *zero_width is set for constraints, which match
+ * no characters and are dropped.
+ */
+static void
+biscuit_regex_atom(BiscuitRegexParser *rp, StringInfo atom, int depth,
+                   bool *zero_width)
+{
+    char c = *rp->p;
+
+    *zero_width = false;
+
+    switch (c)
+    {
+        case '(':
+        {
+            bool alternation = false;
+
+            rp->p++;
+            if (rp->end - rp->p >= 2 && rp->p[0] == '?')
+            {
+                if (rp->p[1] == ':')
+                    rp->p += 2;
+                else if (rp->p[1] == '=' || rp->p[1] == '!')
+                {
+                    rp->p += 2;
+                    *zero_width = true;
+                }
+                else if (rp->end - rp->p >= 3 && rp->p[1] == '<' &&
+                         (rp->p[2] == '=' || rp->p[2] == '!'))
+                {
+                    rp->p += 3;
+                    *zero_width = true;
+                }
+                else
+                {
+                    rp->failed = true;
+                    return;
+                }
+            }
+
+            biscuit_regex_sequence(rp, atom, depth + 1, &alternation);
+            if (rp->failed)
+                return;
+            if (rp->p >= rp->end || *rp->p != ')')
+            {
+                rp->failed = true;
+                return;
+            }
+            rp->p++;
+
+            /* Lookaround only constrains; an alternation requires nothing */
+            if (*zero_width || alternation)
+            {
+                resetStringInfo(atom);
+                if (!*zero_width)
+                    appendStringInfoChar(atom, '%');
+            }
+            return;
+        }
+        case ')':
+            rp->failed = true;      /* unbalanced */
+            return;
+        case '*': case '+': case '?':
+            rp->failed = true;      /* quantifier without an atom */
+            return;
+        case '^': case '$':
+            if (c == '$' && depth == 0 && rp->p + 1 == rp->end)
+                rp->anchored_end = true;
+            rp->p++;
+            *zero_width = true;
+            return;
+        case '.':
+            rp->p++;
+            appendStringInfoChar(atom, '_');
+            return;
+        case '[':
+            rp->p++;
+            biscuit_regex_bracket(rp);
+            appendStringInfoChar(atom, '_');
+            return;
+        case '\\':
+        {
+            int before = atom->len;
+
+            rp->p++;
+            biscuit_regex_escape(rp, atom);
+            *zero_width = (atom->len == before);
+            return;
+        }
+        case '{':
+            if (rp->p + 1 < rp->end && isdigit((unsigned char) rp->p[1]))
+            {
+                rp->failed = true;  /* bound without an atom */
+                return;
+            }
+            /* FALLTHROUGH */
+        default:
+        {
+            int len = biscuit_regex_char_len(rp);
+
+            biscuit_regex_append_literal(atom, rp->p, len);
+            rp->p += len;
+            return;
+        }
+    }
+}
+
+/*
+ * A sequence of quantified atoms up to the ')' closing this depth (left
+ * in place) or the end.  *alternation is set when a '|' splits it.
+ */
+static void
+biscuit_regex_sequence(BiscuitRegexParser *rp, StringInfo out, int depth,
+                       bool *alternation)
+{
+    StringInfoData atom;
+
+    initStringInfo(&atom);
+
+    while (rp->p < rp->end && !rp->failed)
+    {
+        bool zero_width;
+        int  min, max;
+
+        if (*rp->p == ')' && depth > 0)
+            break;
+        if (*rp->p == '|')
+        {
+            *alternation = true;
+            rp->p++;
+            continue;
+        }
+
+        resetStringInfo(&atom);
+        biscuit_regex_atom(rp, &atom, depth, &zero_width);
+        if (rp->failed)
+            break;
+
+        if (!biscuit_regex_quantifier(rp, &min, &max))
+        {
+            if (rp->failed)
+                break;
+            min = max = 1;
+        }
+        if (zero_width)
+            continue;
+
+        if (min == 0)
+            biscuit_regex_append_gap(out);
+        else
+        {
+            biscuit_regex_append(out, &atom);
+            if (max != 1)
+                biscuit_regex_append_gap(out);
+        }
+    }
+
+    pfree(atom.data);
+}
+
+/* ================================================================
+ * SECTION 3 – Public API
+ * ================================================================ */
+
+char *
+biscuit_regex_to_like(const char *regex)
+{
+    BiscuitRegexParser rp;
+    StringInfoData     body;
+    StringInfoData     like;
+    bool               anchored_start = false;
+    bool               alternation    = false;
+
+    rp.p            = regex;
+    rp.end          = regex + strlen(regex);
+    rp.failed       = false;
+    rp.anchored_end = false;
+
+    initStringInfo(&body);
+
+    /* Directors: ***= makes the rest a literal, ***: is the default */
+    if (strncmp(rp.p, "***=", 4) == 0)
+    {
+        rp.p += 4;
+        while (rp.p < rp.end)
+        {
+            int len = biscuit_regex_char_len(&rp);
+
+            biscuit_regex_append_literal(&body, rp.p, len);
+            rp.p += len;
+        }
+    }
+    else
+    {
+        if (strncmp(rp.p, "***:", 4) == 0)
+            rp.p += 4;
+
+        /* Embedded options change case, anchors or syntax; only c is harmless */
+        if (rp.end - rp.p >= 3 && rp.p[0] == '(' && rp.p[1] == '?' &&
+            isalpha((unsigned char) rp.p[2]))
+        {
+            const char *q = rp.p + 2;
+
+            while (q < rp.end && *q == 'c')
+                q++;
+            if (q < rp.end && *q == ')')
+                rp.p = q + 1;
+            else
+                rp.failed = true;
+        }
+
+        if (!rp.failed && rp.p < rp.end && *rp.p == '^')
+        {
+            anchored_start = true;
+            rp.p++;
+        }
+
+        if (!rp.failed)
+            biscuit_regex_sequence(&rp, &body, 0, &alternation);
+    }
+
+    initStringInfo(&like);
+    if (rp.failed || alternation)
+        appendStringInfoChar(&like, '%');
+    else
+    {
+        if (!anchored_start)
+            appendStringInfoChar(&like, '%');
+        biscuit_regex_append(&like, &body);
+        if (!rp.anchored_end)
+            biscuit_regex_append_gap(&like);
+    }
+
+    pfree(body.data);
+    return like.data;
+}
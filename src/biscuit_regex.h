@@ -0,0 +1,19 @@
+/*
+ * biscuit_regex.h
+ * Regular-expression (~, ~*) and SIMILAR TO keys, answered through a LIKE
+ * pattern built from the literals every match must contain.
+ */
+
+#ifndef BISCUIT_REGEX_H
+#define BISCUIT_REGEX_H
+
+#include "biscuit_common.h"
+
+/*
+ * A LIKE pattern (backslash escapes) matched by every string the ARE
+ * regex matches: its anchored prefix and suffix and the required literal
+ * runs in between.  "%" when nothing is required.  palloc'd.
+ */
+extern char   *biscuit_regex_to_like(const char *regex);
+
+#endif /* BISCUIT_REGEX_H */
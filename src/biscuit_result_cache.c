@@ -0,0 +1,316 @@
+/*
+ * biscuit_result_cache.c
+ * Cross-query cache of pattern results.
+ *
+ * Dashboards tend to run the same few patterns over and over, and every
+ * scan used to evaluate them from scratch.  This cache remembers the
+ * record bitmap each (index, column, LIKE/ILIKE, pattern) produced, so a
+ * repeated pattern costs one bitmap copy.  It stores the positive result
+ * only: NOT LIKE / NOT ILIKE keys share the entry of their pattern and
+ * are inverted by the caller as before, and tombstones are filtered by
+ * the caller as well.
+ *
+ * Ownership and freshness
+ * -----------------------
+ * The cache is backend-local, like the BiscuitIndex copies it describes.
+ * Entries name their index by BiscuitIndex.result_cache_tag, a number
+ * handed out once per in-memory copy, so a rebuilt, reloaded or
+ * privatised copy of the same relation starts with no entries and stale
+ * entries simply age out.  Changes made through this backend's copy keep
+ * it exact:
+ *
+ *   aminsert      each entry of the index is patched for the new slot by
+ *                 matching the slot's value against the pattern directly
+ *                 (its compiled plan), so inserts do not cost hit rate;
+ *                 a lossy entry simply takes every slot with a value.
+ *   ambulkdelete  every entry of the index is dropped; VACUUM is rare
+ *                 and touches many slots at once.
+ *
+ * Entries live in their own memory context and on one LRU list across
+ * all indexes; biscuit.result_cache_size caps their summed bitmap sizes
+ * and the least recently used entries are evicted first.  A lookup is a
+ * linear walk comparing hashes, which is negligible next to evaluating
+ * even a cheap pattern at the sizes the cap allows.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_index.h"
+#include "biscuit_like.h"
+#include "biscuit_pattern.h"
+#include "biscuit_pending.h"
+#include "biscuit_result_cache.h"
+#include "biscuit_utf8.h"
+
+#include "common/hashfn.h"
+#include "utils/guc.h"
+
+int biscuit_result_cache_size = 4096;      /* kB */
+
+static MemoryContext biscuit_result_cache_context = NULL;
+static dlist_head    biscuit_result_cache_lru     = DLIST_STATIC_INIT(biscuit_result_cache_lru);
+static Size          biscuit_result_cache_bytes   = 0;
+static uint64        biscuit_result_cache_next_tag = 1;
+
+void
+biscuit_result_cache_init(void)
+{
+    DefineCustomIntVariable("biscuit.result_cache_size",
+                            "Memory for caching pattern results across queries, per backend.",
+                            "Repeated patterns are answered from the cache.  0 disables it.",
+                            &biscuit_result_cache_size,
+                            4096, 0, MAX_KILOBYTES,
+                            PGC_USERSET,
+                            GUC_UNIT_KB,
+                            NULL, NULL, NULL);
+}
+
+/* ================================================================
+ * SECTION 1 – Entries
+ * ================================================================ */
+
+static Size
+biscuit_result_cache_limit(void)
+{
+    return (Size) biscuit_result_cache_size * 1024;
+}
+
+static uint64
+biscuit_result_cache_tag(BiscuitIndex *idx)
+{
+    if (idx->result_cache_tag == 0)
+        idx->result_cache_tag = biscuit_result_cache_next_tag++;
+    return idx->result_cache_tag;
+}
+
+static void
+biscuit_result_cache_drop(PatternCacheEntry *entry)
+{
+    dlist_delete(&entry->node);
+    biscuit_result_cache_bytes -= entry->bytes;
+
+    biscuit_roaring_free(entry->result);
+    pfree(entry->pattern);
+    biscuit_like_free(entry->match_plan);
+    pfree(entry);
+}
+
+/* Evict least recently used entries until `incoming` more bytes fit */
+static void
+biscuit_result_cache_make_room(Size incoming)
+{
+    Size limit = biscuit_result_cache_limit();
+
+    while (!dlist_is_empty(&biscuit_result_cache_lru) &&
+           biscuit_result_cache_bytes + incoming > limit)
+    {
+        PatternCacheEntry *victim = dlist_tail_element(PatternCacheEntry, node,
+                                                       &biscuit_result_cache_lru);
+
+        biscuit_result_cache_drop(victim);
+    }
+}
+
+static PatternCacheEntry *
+biscuit_result_cache_find(uint64 tag, int column, bool ilike,
+                          const char *pattern, uint32 hash)
+{
+    dlist_iter iter;
+
+    dlist_foreach(iter, &biscuit_result_cache_lru)
+    {
+        PatternCacheEntry *entry = dlist_container(PatternCacheEntry, node, iter.cur);
+
+        if (entry->hash == hash &&
+            entry->index_tag == tag &&
+            entry->column == column &&
+            entry->ilike == ilike &&
+            strcmp(entry->pattern, pattern) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+/*
+ * Patterns the index was built to answer go to the bitmap queries; the
+ * rest are narrowed by biscuit_query_unindexed() and, without strings to
+ * verify them against, come back lossy.  Records on the pending list are
+ * in no bitmap and are matched against their strings.
+ */
+static RoaringBitmap *
+biscuit_result_cache_evaluate(BiscuitIndex *idx, int column, bool ilike,
+                              const char *pattern, bool *lossy)
+{
+    int            support = biscuit_pattern_support(&idx->options, ilike, pattern);
+    RoaringBitmap *result;
+
+    *lossy = (support == BISCUIT_SUPPORT_RECHECK);
+    if (support != BISCUIT_SUPPORT_BITMAP)
+        result = biscuit_query_unindexed(idx, column, ilike, pattern,
+                                         support == BISCUIT_SUPPORT_VERIFY);
+    else if (idx->num_columns > 1)
+        result = ilike ? biscuit_query_column_pattern_ilike(idx, column, pattern)
+                       : biscuit_query_column_pattern(idx, column, pattern);
+    else
+        result = ilike ? biscuit_query_pattern_ilike(idx, pattern)
+                       : biscuit_query_pattern(idx, pattern);
+
+    if (!result)
+        result = biscuit_roaring_create();
+    biscuit_pending_add_matches(idx, column, ilike, pattern, result);
+
+    return result;
+}
+
+/* ================================================================
+ * SECTION 2 – Public API
+ * ================================================================ */
+
+RoaringBitmap *
+biscuit_result_cache_query(BiscuitIndex *idx, int column, bool ilike,
+                           const char *pattern, bool *lossy)
+{
+    PatternCacheEntry *entry;
+    RoaringBitmap     *result;
+    MemoryContext      oldcontext;
+    uint32             hash;
+    uint64             tag;
+    Size               bytes;
+
+    if (biscuit_result_cache_size <= 0)
+        return biscuit_result_cache_evaluate(idx, column, ilike, pattern, lossy);
+
+    tag  = biscuit_result_cache_tag(idx);
+    hash = hash_bytes((const unsigned char *) pattern, (int) strlen(pattern));
+
+    entry = biscuit_result_cache_find(tag, column, ilike, pattern, hash);
+    if (entry)
+    {
+        idx->result_cache_hits++;
+        dlist_move_head(&biscuit_result_cache_lru, &entry->node);
+        *lossy = entry->lossy;
+        return biscuit_roaring_copy(entry->result);
+    }
+
+    idx->result_cache_misses++;
+    result = biscuit_result_cache_evaluate(idx, column, ilike, pattern, lossy);
+
+    /* Results larger than the whole cache are not worth evicting for */
+    bytes = sizeof(PatternCacheEntry) + strlen(pattern) + 1 +
+            biscuit_roaring_memory_usage(result);
+    if (bytes > biscuit_result_cache_limit())
+        return result;
+
+    biscuit_result_cache_make_room(bytes);
+
+    if (!biscuit_result_cache_context)
+        biscuit_result_cache_context = AllocSetContextCreate(TopMemoryContext,
+                                                             "Biscuit result cache",
+                                                             ALLOCSET_DEFAULT_SIZES);
+
+    oldcontext = MemoryContextSwitchTo(biscuit_result_cache_context);
+    entry = (PatternCacheEntry *) palloc0(sizeof(PatternCacheEntry));
+    entry->index_tag     = tag;
+    entry->column        = column;
+    entry->ilike         = ilike;
+    entry->hash          = hash;
+    entry->pattern       = pstrdup(pattern);
+    if (ilike)
+    {
+        char *lower = biscuit_str_tolower(pattern, strlen(pattern));
+
+        entry->match_plan = biscuit_like_compile(lower, strlen(lower));
+        pfree(lower);
+    }
+    else
+        entry->match_plan = biscuit_like_compile(pattern, strlen(pattern));
+    entry->result        = biscuit_roaring_copy(result);
+    entry->lossy         = *lossy;
+    entry->bytes         = bytes;
+    MemoryContextSwitchTo(oldcontext);
+
+    dlist_push_head(&biscuit_result_cache_lru, &entry->node);
+    biscuit_result_cache_bytes += bytes;
+
+    return result;
+}
+
+void
+biscuit_result_cache_note_insert(BiscuitIndex *idx, uint32 rec)
+{
+    dlist_iter    iter;
+    MemoryContext oldcontext;
+
+    if (idx->result_cache_tag == 0 || dlist_is_empty(&biscuit_result_cache_lru))
+        return;
+
+    oldcontext = MemoryContextSwitchTo(biscuit_result_cache_context);
+
+    dlist_foreach(iter, &biscuit_result_cache_lru)
+    {
+        PatternCacheEntry *entry = dlist_container(PatternCacheEntry, node, iter.cur);
+        const char        *str;
+        char              *to_free;
+        int                len;
+
+        if (entry->index_tag != idx->result_cache_tag)
+            continue;
+
+        /*
+         * A reused slot may still be set from the value it held before.
+         * The new value is cached even by an index without strings until
+         * this returns.
+         */
+        str = biscuit_record_string(idx, entry->column, entry->ilike, rec, &len, &to_free);
+        if (str && (entry->lossy ||
+                    biscuit_like_exec(entry->match_plan, str, len)))
+            biscuit_roaring_add(entry->result, rec);
+        else
+            biscuit_roaring_remove(entry->result, rec);
+
+        if (to_free)
+            pfree(to_free);
+    }
+
+    MemoryContextSwitchTo(oldcontext);
+}
+
+void
+biscuit_result_cache_invalidate(BiscuitIndex *idx)
+{
+    dlist_mutable_iter iter;
+
+    if (idx->result_cache_tag == 0)
+        return;
+
+    dlist_foreach_modify(iter, &biscuit_result_cache_lru)
+    {
+        PatternCacheEntry *entry = dlist_container(PatternCacheEntry, node, iter.cur);
+
+        if (entry->index_tag == idx->result_cache_tag)
+            biscuit_result_cache_drop(entry);
+    }
+}
+
+void
+biscuit_result_cache_usage(const BiscuitIndex *idx, int *entries, Size *bytes)
+{
+    dlist_iter iter;
+
+    *entries = 0;
+    *bytes   = 0;
+
+    if (idx->result_cache_tag == 0)
+        return;
+
+    dlist_foreach(iter, &biscuit_result_cache_lru)
+    {
+        PatternCacheEntry *entry = dlist_container(PatternCacheEntry, node, iter.cur);
+
+        if (entry->index_tag == idx->result_cache_tag)
+        {
+            (*entries)++;
+            *bytes += entry->bytes;
+        }
+    }
+}
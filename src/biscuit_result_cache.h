@@ -0,0 +1,42 @@
+/*
+ * biscuit_result_cache.h
+ * Backend-local LRU cache of pattern results (record bitmaps), shared by
+ * every index the backend scans and bounded by biscuit.result_cache_size.
+ */
+
+#ifndef BISCUIT_RESULT_CACHE_H
+#define BISCUIT_RESULT_CACHE_H
+
+#include "biscuit_common.h"
+
+/* biscuit.result_cache_size, in kB (0 disables the cache) */
+extern int            biscuit_result_cache_size;
+
+/* Register the GUC (called from _PG_init) */
+extern void           biscuit_result_cache_init(void);
+
+/*
+ * Records of column whose value matches pattern (LIKE, or ILIKE when
+ * ilike), before tombstone filtering: the result of biscuit_query_pattern
+ * and friends, served from the cache when possible.  *lossy is set when
+ * the index's options leave the pattern to the executor and the result
+ * is only a superset.  The caller owns the returned bitmap.
+ */
+extern RoaringBitmap *biscuit_result_cache_query(BiscuitIndex *idx, int column,
+                                                 bool ilike, const char *pattern,
+                                                 bool *lossy);
+
+/*
+ * Keep the cached results of idx exact after aminsert wrote slot rec.
+ * Must run after the slot's strings are in the data caches.
+ */
+extern void           biscuit_result_cache_note_insert(BiscuitIndex *idx, uint32 rec);
+
+/* Drop every cached result of idx */
+extern void           biscuit_result_cache_invalidate(BiscuitIndex *idx);
+
+/* Entries and bytes currently cached for idx */
+extern void           biscuit_result_cache_usage(const BiscuitIndex *idx,
+                                                 int *entries, Size *bytes);
+
+#endif /* BISCUIT_RESULT_CACHE_H */
@@ -15,21 +15,22 @@
  *
  * Fix
  * ---
- * Both the single-column and multi-column fast paths now call
- * biscuit_collect_sorted_tids_parallel() when scan->parallel_scan != NULL.
- * That function handles all coordination internally:
+ * biscuit_rescan() coordinates the participants before any of them
+ * evaluates the query:
  *
- *   • Each participant evaluates the bitmap locally (read-only, deterministic
- *     → identical result in every process, no DSM pointer sharing needed).
- *   • An atomic CAS on pdesc->next_chunk (UNINIT→INITING) elects exactly one
- *     initializer to write total_tids/total_chunks into the shared DSM
- *     descriptor.  Others spin-wait with CHECK_FOR_INTERRUPTS + 1µs sleep.
- *   • Every participant then claims a disjoint chunk range atomically and
- *     returns only those TIDs to Gather — assembling exactly one result copy.
+ *   • An atomic CAS on pdesc->initialized elects exactly one participant
+ *     to evaluate the query (biscuit_rescan → biscuit_parallel_claim).  It
+ *     publishes the bitmap itself in the parallel scan descriptor.
+ *   • The others wait for that without evaluating anything
+ *     (biscuit_rescan_shared).
+ *   • Every participant holding the bitmap claims chunks of its ranks
+ *     from an atomic counter in the descriptor and converts only those
+ *     to TIDs, so Gather assembles exactly one result copy however many
+ *     participants run.  When it could not be shared, its evaluator
+ *     returns all of it and the others nothing.
  *
- * No changes to BiscuitScanOpaque or biscuit_common.h are required.
- * No IsParallelWorker() distinction is needed — every participant runs
- * the same code path.
+ * Whoever wins shares its result: the descriptor lives in the query's DSM
+ * segment, which outlasts every participant's scan.
  *
  *
  * Lazy-load strategy
@@ -41,7 +42,12 @@
  *
  * The new path:
  *
- *  1. beginscan   – loads only a lightweight skeleton (TIDs + raw string
+ *  0. beginscan   – if the index carries a VALID on-disk snapshot
+ *                   (biscuit_storage.c), loads it directly: one
+ *                   sequential read of the index, no heap scan, and the
+ *                   fast bitmap path is available immediately.
+ *
+ *  1. beginscan   – otherwise loads only a lightweight skeleton (TIDs + raw string
  *                   data_cache, no bitmaps) via biscuit_load_skeleton(),
  *                   then immediately calls biscuit_preload_request() to
  *                   enqueue the index OID for the background worker.
@@ -55,24 +61,36 @@
  *                                  the warm-up window.
  *
  *  3. background worker – calls biscuit_complete_preload(), which
- *                          rebuilds all bitmaps from the already-cached
- *                          data and sets preload_state = DONE.  On the
- *                          next beginscan the session picks up the warm
- *                          index from the process cache and takes the
- *                          fast path from that point forward.
+ *                          builds the full index and writes it to the
+ *                          on-disk snapshot (and the shared image area),
+ *                          then sets DONE.  The session then swaps its
+ *                          skeleton for that snapshot via
+ *                          biscuit_preload_adopt() and takes the fast
+ *                          path from that point forward.  Without a
+ *                          worker the skeleton is completed locally.
  *
- * The fallback scan result set is exact (no false positives) so
- * xs_recheck stays false.
+ * The fallback scan result set is exact (no false positives), and so
+ * is the bitmap path for every pattern the index's options cover.  Only
+ * a key its options leave to the executor (biscuit_pattern_support)
+ * makes the scan lossy and sets xs_recheck.
  */
 
 #include "biscuit_common.h"
 #include "biscuit_bitmap.h"
 #include "biscuit_cache.h"
+#include "biscuit_changelog.h"
 #include "biscuit_pattern.h"
+#include "biscuit_pending.h"
 #include "biscuit_tid.h"
+#include "biscuit_utf8.h"
 #include "biscuit_index.h"
+#include "biscuit_instrument.h"
+#include "biscuit_keys.h"
+#include "biscuit_like.h"
 #include "biscuit_preload.h"   /* biscuit_load_skeleton, biscuit_preload_request,
                                    biscuit_preload_state, biscuit_fallback_scan */
+#include "biscuit_result_cache.h"
+#include "biscuit_storage.h"
 #include "biscuit_scan.h"
 
 /* ================================================================
@@ -100,11 +118,11 @@ biscuit_beginscan(Relation index, int nkeys, int norderbys)
      * PostgreSQL pfree()s rd_amcache on relcache invalidation, and since
      * biscuit_cache holds the same object, that pfree would free memory
      * the global cache still references — a use-after-free on the next
-     * lookup. biscuit_cache (with its relcache callback in
-     * biscuit_cache.c) is the single source of truth for this object's
-     * lifetime.
+     * lookup. biscuit_cache is the single source of truth for this
+     * object's lifetime; biscuit_changelog_lookup() first brings the copy
+     * up to date with other backends' changes, or drops it if it cannot.
      */
-    so->index = biscuit_cache_lookup(indexoid);
+    so->index = biscuit_changelog_lookup(index);
 
     elog(DEBUG1, "Entered beginscan()");
 
@@ -112,20 +130,23 @@ biscuit_beginscan(Relation index, int nkeys, int norderbys)
     {
         /*
          * We have a cached index — but it may still be a skeleton.
-         * Upgrade it synchronously if the worker has signalled DONE
-         * and we haven't built the bitmaps yet in this session.
+         * Swap it for the worker's result if the worker has signalled
+         * DONE (or build it here if the worker failed).
          */
-        if (so->index->preload_state < BISCUIT_PRELOAD_DONE)
-        {
-            uint32 shmem_state = biscuit_preload_state(indexoid);
-            if (shmem_state >= BISCUIT_PRELOAD_DONE)
-            {
-                MemoryContext _oldctx = MemoryContextSwitchTo(CacheMemoryContext);
-                biscuit_complete_preload_local(so->index, indexoid);
-                MemoryContextSwitchTo(_oldctx);
-            }
-            /* else: still warming, rescan() will use fallback */
-        }
+        if (so->index->preload_state < BISCUIT_PRELOAD_DONE &&
+            biscuit_preload_state(indexoid) >= BISCUIT_PRELOAD_DONE)
+            so->index = biscuit_preload_adopt(index, so->index);
+        /* else: still warming, rescan() will use fallback */
+    }
+    else if ((so->index = biscuit_storage_load(index)) != NULL)
+    {
+        /* Persisted snapshot: fully warm without touching the heap */
+        biscuit_register_callback();
+        biscuit_cache_insert(indexoid, so->index);
+
+        elog(DEBUG1,
+             "Biscuit: snapshot loaded for %u (%d records)",
+             indexoid, so->index->num_records);
     }
     else
     {
@@ -133,7 +154,15 @@ biscuit_beginscan(Relation index, int nkeys, int norderbys)
         so->index->preload_state = BISCUIT_PRELOAD_SKELETON;
         biscuit_register_callback();
         biscuit_cache_insert(indexoid, so->index);
-        biscuit_preload_request(indexoid);
+
+        /* No worker to wait for: build the bitmaps from the skeleton now */
+        if (!biscuit_preload_request(indexoid))
+        {
+            MemoryContext oldctx = MemoryContextSwitchTo(BiscuitIndexMemoryContext(so->index));
+
+            biscuit_complete_preload_local(so->index, indexoid);
+            MemoryContextSwitchTo(oldctx);
+        }
 
         elog(DEBUG1,
              "Biscuit: skeleton loaded for %u (%d records), bitmaps pending",
@@ -143,23 +172,392 @@ biscuit_beginscan(Relation index, int nkeys, int norderbys)
     so->results            = NULL;
     so->num_results        = 0;
     so->current            = 0;
+    so->stream             = NULL;
+    so->batch_size         = 0;
+    so->sort_batches       = false;
+    so->records            = NULL;
+    so->parallel_publish   = false;
     so->is_aggregate_only  = false;
     so->needs_sorted_access = true;
-    so->limit_remaining    = -1;
+    so->recheck            = false;
+    memset(&so->instr, 0, sizeof(so->instr));
+
+    /* Index-only scans get their tuples in the index's own descriptor */
+    scan->xs_itupdesc = RelationGetDescr(index);
 
     scan->opaque = so;
     return scan;
 }
 
+/* ================================================================
+ * SECTION 1b – Result delivery
+ *
+ * A serial scan streams TIDs out of the result bitmap in growing batches
+ * (biscuit_tid_stream_*), so a LIMIT stops the walk early and memory
+ * stays bounded by the batch size.  A plain index scan that wants TIDs in
+ * heap order gets each batch sorted by block instead of the whole result:
+ * heap access stays mostly sequential within a batch, and nothing past
+ * the batches the executor consumes is ever converted or sorted.
+ * Bitmap index scans always stream: getbitmap feeds the roaring result
+ * straight into the TIDBitmap, which orders TIDs by block itself, so
+ * the TID array and the radix sort are skipped entirely.
+ * Parallel scans stream too, over the rank chunks each participant
+ * claims (biscuit_tid_stream_begin_parallel).
+ *
+ * Index-only scans (xs_want_itup) also need the record of every TID to
+ * rebuild its values from the string caches, so they keep record order
+ * and collect so->records alongside so->results.
+ * ================================================================ */
+
+#define BISCUIT_SCAN_FIRST_BATCH    32
+#define BISCUIT_SCAN_MAX_BATCH      1024
+#define BISCUIT_BITMAP_BATCH        8192
+
+/*
+ * index_beginscan_bitmap() never sets heapRelation, so a scan without
+ * one will be driven through amgetbitmap rather than amgettuple.
+ */
+#define BiscuitScanIsBitmap(scan)   ((scan)->heapRelation == NULL)
+
+#define BiscuitScanParallelDesc(scan) \
+    ((BiscuitParallelScanDesc *) OffsetToPointer((scan)->parallel_scan, \
+                                                 BISCUIT_PARALLEL_AM_OFFSET((scan)->parallel_scan)))
+
+/*
+ * Start handing out stream, batch by batch (biscuit_scan_next_batch)
+ */
+static void
+biscuit_scan_stream(IndexScanDesc scan, BiscuitTidStream *stream, bool needs_sorting)
+{
+    BiscuitScanOpaque *so = (BiscuitScanOpaque *) scan->opaque;
+
+    /* The visibility map spares most heap fetches; record order will do */
+    if (scan->xs_want_itup)
+        needs_sorting = false;
+
+    /* Records numbered in heap order yield their TIDs already sorted */
+    if (so->index->heap_ordered)
+        needs_sorting = false;
+
+    so->stream       = stream;
+    so->batch_size   = BISCUIT_SCAN_FIRST_BATCH;
+    so->sort_batches = needs_sorting && !BiscuitScanIsBitmap(scan);
+    if (so->sort_batches)
+        so->instr.sorted_rescans++;
+}
+
+/*
+ * Hand the final result bitmap to the scan.  Takes ownership of result.
+ */
+static void
+biscuit_scan_deliver(IndexScanDesc scan, RoaringBitmap *result,
+                     bool needs_sorting)
+{
+    BiscuitScanOpaque       *so = (BiscuitScanOpaque *) scan->opaque;
+    BiscuitParallelScanDesc *pdesc;
+
+    biscuit_instrument_cardinality(&so->instr, result);
+
+    if (scan->parallel_scan == NULL)
+    {
+        biscuit_scan_stream(scan, biscuit_tid_stream_begin(result), needs_sorting);
+        return;
+    }
+
+    /* Only the participant that claimed the scan returns rows of its own */
+    if (!so->parallel_publish)
+    {
+        biscuit_roaring_free(result);
+        return;
+    }
+    so->parallel_publish = false;
+
+    /*
+     * We evaluated the query for every participant: share it, and take
+     * chunks of it like everyone else.  A result too large to share is
+     * returned here whole.
+     */
+    pdesc = BiscuitScanParallelDesc(scan);
+    if (biscuit_parallel_publish(pdesc, so->index, result, so->recheck))
+        biscuit_scan_stream(scan, biscuit_tid_stream_begin_parallel(result, false, pdesc),
+                            needs_sorting);
+    else
+        biscuit_scan_stream(scan, biscuit_tid_stream_begin(result), needs_sorting);
+}
+
+/*
+ * Refill so->results with the next batch from the stream.  Returns
+ * false (and ends the stream) once it is exhausted.
+ */
+static bool
+biscuit_scan_next_batch(IndexScanDesc scan)
+{
+    BiscuitScanOpaque *so = (BiscuitScanOpaque *) scan->opaque;
+    instr_time         start;
+    int                n;
+
+    if (!so->stream)
+        return false;
+
+    BISCUIT_INSTR_START(start);
+
+    /* Allocated on first use: bitmap scans never need it */
+    if (!so->results)
+        so->results = (ItemPointerData *)
+            palloc(BISCUIT_SCAN_MAX_BATCH * sizeof(ItemPointerData));
+    if (scan->xs_want_itup && !so->records)
+        so->records = (uint32_t *) palloc(BISCUIT_SCAN_MAX_BATCH * sizeof(uint32_t));
+
+    n = biscuit_tid_stream_next(so->stream, so->index,
+                                so->results, so->records, so->batch_size);
+    if (so->sort_batches && n > 1)
+        biscuit_sort_tids_by_block(so->results, n);
+    BISCUIT_INSTR_STOP(so->instr.collect_time, start);
+    if (n == 0)
+    {
+        biscuit_tid_stream_end(so->stream);
+        so->stream = NULL;
+        return false;
+    }
+
+    so->num_results = n;
+    so->current     = 0;
+    so->batch_size  = Min(so->batch_size * 2, BISCUIT_SCAN_MAX_BATCH);
+    return true;
+}
+
+/* ================================================================
+ * SECTION 1c – Per-key evaluation
+ *
+ * Keys arrive here rewritten by biscuit_keys_rewrite(): LIKE / ILIKE
+ * strategies only, with an array key holding several patterns whose
+ * matches are OR-ed.  NOT strategies are inverted by the callers.
+ * ================================================================ */
+
+static bool
+biscuit_scan_key_is_ilike(ScanKey key)
+{
+    switch (key->sk_strategy)
+    {
+        case BISCUIT_LIKE_STRATEGY:
+        case BISCUIT_NOT_LIKE_STRATEGY:
+            return false;
+        case BISCUIT_ILIKE_STRATEGY:
+        case BISCUIT_NOT_ILIKE_STRATEGY:
+            return true;
+        default:
+            elog(ERROR, "Biscuit: unsupported scan strategy %d", key->sk_strategy);
+            return false;       /* keep compiler quiet */
+    }
+}
+
+/*
+ * Bitmap of the records of column col matching key.  NULL when its only
+ * pattern has no usable result (the caller ends the scan).
+ */
+static RoaringBitmap *
+biscuit_scan_key_query(BiscuitIndex *idx, int col, ScanKey key, bool *lossy)
+{
+    bool           is_ilike = biscuit_scan_key_is_ilike(key);
+    RoaringBitmap *result   = NULL;
+    char         **patterns;
+    int            npatterns;
+    int            i;
+
+    *lossy   = false;
+    patterns = biscuit_key_patterns(key, &npatterns);
+
+    for (i = 0; i < npatterns; i++)
+    {
+        RoaringBitmap *r;
+        bool           r_lossy;
+
+        r = biscuit_result_cache_query(idx, col, is_ilike, patterns[i], &r_lossy);
+        if (!r)
+            continue;
+        *lossy |= r_lossy;
+
+        if (!result)
+            result = r;
+        else
+        {
+            biscuit_roaring_or_inplace(result, r);
+            biscuit_roaring_free(r);
+        }
+    }
+
+    /* An array of no (non-null) elements matches nothing */
+    if (!result && npatterns == 0)
+        result = biscuit_roaring_create();
+
+    biscuit_key_patterns_free(patterns, npatterns);
+    return result;
+}
+
+/*
+ * biscuit_fallback_scan() for every pattern of key.  The TID lists are
+ * appended; a TID may appear more than once.
+ */
+static void
+biscuit_scan_key_fallback(BiscuitIndex *idx, int col, ScanKey key,
+                          ItemPointerData **out_tids, int *out_count)
+{
+    bool             is_ilike = biscuit_scan_key_is_ilike(key);
+    ItemPointerData *tids     = NULL;
+    int              count    = 0;
+    char           **patterns;
+    int              npatterns;
+    int              i;
+
+    patterns = biscuit_key_patterns(key, &npatterns);
+
+    for (i = 0; i < npatterns; i++)
+    {
+        ItemPointerData *p_tids  = NULL;
+        int              p_count = 0;
+
+        biscuit_fallback_scan(idx, patterns[i], is_ilike, col, &p_tids, &p_count);
+
+        if (!tids)
+        {
+            tids  = p_tids;
+            count = p_count;
+            continue;
+        }
+        if (p_count > 0)
+        {
+            tids = (ItemPointerData *)
+                repalloc_huge(tids, ((Size) count + p_count) * sizeof(ItemPointerData));
+            memcpy(tids + count, p_tids, (Size) p_count * sizeof(ItemPointerData));
+            count += p_count;
+        }
+        if (p_tids)
+            pfree(p_tids);
+    }
+
+    biscuit_key_patterns_free(patterns, npatterns);
+    *out_tids  = tids;
+    *out_count = count;
+}
+
 /* ================================================================
  * SECTION 2 – Multi-column rescan helper  (bitmap path)
  *
  * Only reached when preload_state == BISCUIT_PRELOAD_DONE.
  * ================================================================ */
 
+/*
+ * Once the running intersection is this small, the remaining predicates
+ * are checked against the string cache instead of being evaluated as
+ * bitmaps over the whole index.
+ */
+#define BISCUIT_VERIFY_THRESHOLD    512
+
+/*
+ * Drop from candidates every record that fails one of predicates
+ * first..plan->count-1, matching the strings directly.  A predicate with
+ * several patterns (an array key) holds when any of them matches.  NULL
+ * values match neither LIKE nor NOT LIKE, as on the bitmap path.
+ */
+static void
+biscuit_verify_candidates(BiscuitIndex *idx, QueryPlan *plan, int first,
+                          RoaringBitmap *candidates, BiscuitScanInstrument *instr)
+{
+    uint64_t           n;
+    uint32_t          *recs  = biscuit_roaring_to_array(candidates, &n);
+    BiscuitLikePlan ***plans;
+    int               *nplans;
+    uint64_t           k;
+    int                i;
+    int                j;
+
+    if (!recs)
+        return;
+
+    plans  = (BiscuitLikePlan ***) palloc0(plan->count * sizeof(BiscuitLikePlan **));
+    nplans = (int *) palloc0(plan->count * sizeof(int));
+
+    for (i = first; i < plan->count; i++)
+    {
+        QueryPredicate *pred     = &plan->predicates[i];
+        int             strategy = pred->scan_key->sk_strategy;
+        char          **patterns = biscuit_key_patterns(pred->scan_key, &nplans[i]);
+
+        plans[i] = (BiscuitLikePlan **) palloc(Max(nplans[i], 1) * sizeof(BiscuitLikePlan *));
+        for (j = 0; j < nplans[i]; j++)
+        {
+            if (strategy == BISCUIT_ILIKE_STRATEGY || strategy == BISCUIT_NOT_ILIKE_STRATEGY)
+            {
+                char *lower = biscuit_str_tolower(patterns[j], strlen(patterns[j]));
+
+                plans[i][j] = biscuit_like_compile(lower, strlen(lower));
+                pfree(lower);
+            }
+            else
+                plans[i][j] = biscuit_like_compile(patterns[j], strlen(patterns[j]));
+        }
+        biscuit_key_patterns_free(patterns, nplans[i]);
+    }
+
+    for (k = 0; k < n; k++)
+    {
+        uint32_t rec  = recs[k];
+        bool     keep = true;
+
+        for (i = first; i < plan->count && keep; i++)
+        {
+            QueryPredicate *pred     = &plan->predicates[i];
+            int             strategy = pred->scan_key->sk_strategy;
+            bool            is_ilike = (strategy == BISCUIT_ILIKE_STRATEGY ||
+                                        strategy == BISCUIT_NOT_ILIKE_STRATEGY);
+            bool            is_not   = (strategy == BISCUIT_NOT_LIKE_STRATEGY ||
+                                        strategy == BISCUIT_NOT_ILIKE_STRATEGY);
+            bool            matched  = false;
+            const char     *str;
+            char           *to_free;
+            int             len;
+
+            if (pred->column_index < 0 || pred->column_index >= idx->num_columns)
+                continue;
+
+            str = biscuit_record_string(idx, pred->column_index, is_ilike, rec,
+                                        &len, &to_free);
+
+            if (str)
+                for (j = 0; j < nplans[i] && !matched; j++)
+                    matched = biscuit_like_exec(plans[i][j], str, len);
+
+            keep = str != NULL && matched != is_not;
+            if (to_free)
+                pfree(to_free);
+        }
+
+        if (!keep)
+            biscuit_roaring_remove(candidates, rec);
+        else
+            instr->verify_matched++;
+    }
+    instr->verify_checked += (int64) n;
+
+    for (i = first; i < plan->count; i++)
+    {
+        for (j = 0; j < nplans[i]; j++)
+            biscuit_like_free(plans[i][j]);
+        pfree(plans[i]);
+    }
+    pfree(plans);
+    pfree(nplans);
+    pfree(recs);
+}
+
 /*
  * biscuit_rescan_multicolumn
  *
+ * Predicates are applied in the order chosen by biscuit_build_query_plan()
+ * (smallest bitmap-cardinality bound first).  Evaluation stops as soon
+ * as the intersection is empty, and once it holds at most
+ * BISCUIT_VERIFY_THRESHOLD records the rest are verified directly.
+ *
  * scan is passed through so the function can dispatch to the parallel
  * or single-threaded TID-collection path exactly as the single-column
  * fast path in biscuit_rescan() does.  See that path for the full
@@ -174,6 +572,8 @@ biscuit_rescan_multicolumn(IndexScanDesc scan,
     RoaringBitmap     *candidates;
     QueryPlan         *plan;
     bool               needs_sorting;
+    bool               verified = false;
+    instr_time         start;
     int                i;
 
     (void) orderbys;
@@ -195,10 +595,14 @@ biscuit_rescan_multicolumn(IndexScanDesc scan,
         biscuit_roaring_andnot_inplace(candidates, so->index->tombstones);
 
     /* Build optimized query plan */
+    BISCUIT_INSTR_START(start);
     plan = biscuit_build_query_plan(so->index, keys, nkeys);
+    BISCUIT_INSTR_STOP(so->instr.plan_time, start);
     if (!plan)
         goto cleanup;
 
+    BISCUIT_INSTR_START(start);
+
     /* Apply each predicate in order of selectivity */
     for (i = 0; i < plan->count; i++)
     {
@@ -206,19 +610,19 @@ biscuit_rescan_multicolumn(IndexScanDesc scan,
         int             pred_strategy   = pred->scan_key->sk_strategy;
         bool            pred_is_not_like = (pred_strategy == BISCUIT_NOT_LIKE_STRATEGY ||
                                             pred_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
-        bool            pred_is_ilike   = (pred_strategy == BISCUIT_ILIKE_STRATEGY ||
-                                           pred_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
         RoaringBitmap  *col_result;
+        bool            lossy;
 
         if (pred->column_index < 0 || pred->column_index >= so->index->num_columns)
             continue;
 
-        col_result = pred_is_ilike
-            ? biscuit_query_column_pattern_ilike(so->index, pred->column_index, pred->pattern)
-            : biscuit_query_column_pattern(so->index, pred->column_index, pred->pattern);
+        col_result = biscuit_scan_key_query(so->index, pred->column_index,
+                                            pred->scan_key, &lossy);
+        so->recheck |= lossy;
 
         if (!col_result)
             col_result = biscuit_roaring_create();
+        biscuit_instrument_cardinality(&so->instr, col_result);
 
         if (pred_is_not_like)
         {
@@ -245,9 +649,12 @@ biscuit_rescan_multicolumn(IndexScanDesc scan,
                     biscuit_roaring_add(all, j);
 #endif
             }
+            biscuit_pending_add_valued(so->index, pred->column_index, all);
             if (so->index->tombstone_count > 0 && so->index->tombstones)
                 biscuit_roaring_andnot_inplace(all, so->index->tombstones);
-            biscuit_roaring_andnot_inplace(all, col_result);
+            /* The complement of a superset is no superset; recheck them all */
+            if (!lossy)
+                biscuit_roaring_andnot_inplace(all, col_result);
             biscuit_roaring_free(col_result);
             col_result = all;
         }
@@ -255,28 +662,26 @@ biscuit_rescan_multicolumn(IndexScanDesc scan,
         biscuit_roaring_and_inplace(candidates, col_result);
         biscuit_roaring_free(col_result);
 
-        if (biscuit_roaring_count(candidates) == 0)
+        if (biscuit_roaring_is_empty(candidates))
             break;
-    }
-
-    /* Parallel-aware TID collection — same as single-column fast path. */
-    {
-        BiscuitParallelScanDesc *pdesc = NULL;
 
-        if (scan->parallel_scan != NULL)
+        if (i + 1 < plan->count && so->index->options.store_strings &&
+            biscuit_roaring_count(candidates) <= BISCUIT_VERIFY_THRESHOLD)
         {
-            pdesc = (BiscuitParallelScanDesc *)
-                        OffsetToPointer(scan->parallel_scan,
-                                        BISCUIT_PARALLEL_AM_OFFSET(scan->parallel_scan));
-        }
+            BISCUIT_INSTR_STOP(so->instr.eval_time, start);
+            verified = true;
 
-        biscuit_collect_sorted_tids_parallel(
-            so->index, candidates, pdesc,
-            &so->results, &so->num_results,
-            needs_sorting);
+            BISCUIT_INSTR_START(start);
+            biscuit_verify_candidates(so->index, plan, i + 1, candidates, &so->instr);
+            BISCUIT_INSTR_STOP(so->instr.verify_time, start);
+            break;
+        }
     }
+    if (!verified)
+        BISCUIT_INSTR_STOP(so->instr.eval_time, start);
 
-    biscuit_roaring_free(candidates);
+    /* Parallel-aware TID collection — same as single-column fast path. */
+    biscuit_scan_deliver(scan, candidates, needs_sorting);
 
 cleanup:
     biscuit_free_query_plan(plan);
@@ -300,10 +705,14 @@ biscuit_rescan_multicolumn_fallback(IndexScanDesc scan,
     int                n             = so->index->num_records;
     uint32            *tid_map       = NULL;
     int                map_size      = 0;
+    instr_time         start;
 
     (void) orderbys;
     (void) norderbys;
 
+    so->instr.fallback_rescans++;
+    BISCUIT_INSTR_START(start);
+
     /*
      * Build a TID → record-index hash map once (O(n)) so the per-TID
      * reverse-lookup below is O(1) instead of O(num_records).
@@ -345,9 +754,6 @@ biscuit_rescan_multicolumn_fallback(IndexScanDesc scan,
         for (i = 0; i < nkeys; i++)
         {
             ScanKey          key = &keys[i];
-            text            *pattern_text;
-            char            *pattern;
-            bool             is_ilike;
             bool             is_not;
             int              col_idx;
             ItemPointerData *key_tids   = NULL;
@@ -365,25 +771,11 @@ biscuit_rescan_multicolumn_fallback(IndexScanDesc scan,
             if (col_idx < 0 || col_idx >= so->index->num_columns)
                 continue;
 
-            /*
-             * Derive is_ilike and is_not from THIS key's strategy before
-             * passing is_ilike to biscuit_fallback_scan.  Previously these
-             * assignments appeared after the call, leaving is_ilike
-             * uninitialised — an undefined-behaviour read that happened to
-             * produce the first key's value on every iteration, making all
-             * subsequent keys inherit the first key's case-sensitivity.
-             */
-            is_ilike = (key->sk_strategy == BISCUIT_ILIKE_STRATEGY ||
-                        key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
-            is_not   = (key->sk_strategy == BISCUIT_NOT_LIKE_STRATEGY ||
-                        key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
+            is_not = (key->sk_strategy == BISCUIT_NOT_LIKE_STRATEGY ||
+                      key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
 
-            pattern_text = DatumGetTextPP(key->sk_argument);
-            pattern      = text_to_cstring(pattern_text);
-
-            biscuit_fallback_scan(so->index, pattern, is_ilike, col_idx,
-                                  &key_tids, &key_count);
-            pfree(pattern);
+            biscuit_scan_key_fallback(so->index, col_idx, key,
+                                      &key_tids, &key_count);
 
             /* O(1) TID → record-index lookup via hash map */
             key_bitmap = biscuit_roaring_create();
@@ -441,6 +833,7 @@ biscuit_rescan_multicolumn_fallback(IndexScanDesc scan,
                 key_bitmap = all;
             }
 
+            biscuit_instrument_cardinality(&so->instr, key_bitmap);
             biscuit_roaring_and_inplace(candidates, key_bitmap);
             biscuit_roaring_free(key_bitmap);
 
@@ -453,33 +846,12 @@ biscuit_rescan_multicolumn_fallback(IndexScanDesc scan,
             biscuit_roaring_andnot_inplace(candidates, so->index->tombstones);
 
         /*
-         * Parallel-aware TID collection — mirrors the dispatch used in
-         * biscuit_rescan_multicolumn() and the single-column fallback path.
-         *
-         * Previously this called biscuit_collect_sorted_tids_single()
-         * unconditionally, so every Gather participant returned the full TID
-         * set and the Gather node assembled N× the expected rows.
-         *
-         * biscuit_collect_sorted_tids_parallel() handles both cases: when
-         * pdesc is NULL it delegates to the single-threaded path unchanged;
-         * when pdesc is non-NULL each participant claims a disjoint slice of
-         * the pre-partitioned TID array, so Gather assembles exactly one copy.
+         * Parallel scans: biscuit_scan_deliver() publishes the result for
+         * the other participants, which take chunks of it, so Gather
+         * assembles exactly one copy.
          */
-        {
-            BiscuitParallelScanDesc *pdesc = NULL;
-
-            if (scan->parallel_scan != NULL)
-                pdesc = (BiscuitParallelScanDesc *)
-                            OffsetToPointer(scan->parallel_scan,
-                                            BISCUIT_PARALLEL_AM_OFFSET(scan->parallel_scan));
-
-            biscuit_collect_sorted_tids_parallel(
-                so->index, candidates, pdesc,
-                &so->results, &so->num_results,
-                needs_sorting);
-        }
-
-        biscuit_roaring_free(candidates);
+        BISCUIT_INSTR_STOP(so->instr.eval_time, start);
+        biscuit_scan_deliver(scan, candidates, needs_sorting);
     }
 
     if (tid_map)
@@ -495,24 +867,16 @@ biscuit_rescan_multicolumn_fallback(IndexScanDesc scan,
  * automatically use the fast bitmap path.
  * ================================================================ */
 
-void
-biscuit_rescan(IndexScanDesc scan,
-               ScanKey keys, int nkeys,
-               ScanKey orderbys, int norderbys)
+static void
+biscuit_rescan_internal(IndexScanDesc scan,
+                        ScanKey keys, int nkeys,
+                        ScanKey orderbys, int norderbys)
 {
     BiscuitScanOpaque *so = (BiscuitScanOpaque *) scan->opaque;
     bool               is_aggregate;
     bool               needs_sorting;
     bool               bitmaps_ready;
 
-    if (so->results)
-    {
-        pfree(so->results);
-        so->results = NULL;
-    }
-    so->num_results = 0;
-    so->current     = 0;
-
     if (!so->index || nkeys == 0 || so->index->num_records == 0)
         return;
 
@@ -533,15 +897,14 @@ biscuit_rescan(IndexScanDesc scan,
 
     so->is_aggregate_only   = is_aggregate;
     so->needs_sorted_access = needs_sorting;
-    so->limit_remaining     = -1;
 
     /*
      * Check whether the background worker has finished building the bitmaps.
      *
      * We first consult the in-process preload_state field which is the
      * cheapest check (no IPC).  If that still shows an incomplete state we
-     * also probe the shared-memory ring buffer in case the worker finished
-     * after this session's last cache lookup.
+     * also probe the shared preload state table in case the worker finished
+     * (or failed) after this session's last cache lookup.
      */
     bitmaps_ready = (so->index->preload_state >= BISCUIT_PRELOAD_DONE);
 
@@ -552,42 +915,24 @@ biscuit_rescan(IndexScanDesc scan,
         if (shmem_state >= BISCUIT_PRELOAD_DONE)
         {
             /*
-             * The worker has finished building bitmaps.  Rather than calling
-             * biscuit_load_index() (which would do a full heap scan again),
-             * we build the bitmaps directly from the skeleton that this
-             * session already holds in so->index->data_cache.
-             *
-             * biscuit_complete_preload_local() is O(total-string-bytes) with
-             * zero extra I/O.  It sets idx->preload_state = DONE and updates
-             * the shmem slot so other sessions benefit too.
+             * The worker has finished: it left a VALID snapshot behind, so
+             * adopt that instead of rebuilding every bitmap from the
+             * skeleton this session holds.  biscuit_preload_adopt() falls
+             * back to biscuit_complete_preload_local() if the snapshot has
+             * been demoted since, and refreshes the global cache either way
+             * (rd_amcache is deliberately left untouched — see the note in
+             * biscuit_beginscan()).
              *
              * This path executes at most once per session (the first query
              * after the background worker signals DONE).
              */
-            {
-                MemoryContext _oldctx = MemoryContextSwitchTo(CacheMemoryContext);
-                biscuit_complete_preload_local(so->index,
-                                               RelationGetRelid(scan->indexRelation));
-                MemoryContextSwitchTo(_oldctx);
-            }
-
-            /* Refresh the global cache so subsequent beginscans hit this
-             * upgraded copy. rd_amcache is deliberately left untouched —
-             * see the note in biscuit_beginscan(). */
-            biscuit_cache_insert(RelationGetRelid(scan->indexRelation), so->index);
+            so->index = biscuit_preload_adopt(scan->indexRelation, so->index);
 
             bitmaps_ready = true;
 
             elog(DEBUG1,
-                 "Biscuit: local bitmap build done for %u after preload signal",
-                 RelationGetRelid(scan->indexRelation));
-        }
-        else if (shmem_state == BISCUIT_PRELOAD_FAILED)
-        {
-            elog(DEBUG1,
-                 "Biscuit: preload worker failed for index %u; "
-                 "using sequential fallback scan (may be slow)",
-                 RelationGetRelid(scan->indexRelation));
+                 "Biscuit: index %u warm after preload signal (state %u)",
+                 RelationGetRelid(scan->indexRelation), shmem_state);
         }
     }
 
@@ -605,53 +950,30 @@ biscuit_rescan(IndexScanDesc scan,
         {
             /* ---- Single-column: AND all key results ---- */
             RoaringBitmap *result = NULL;
+            instr_time     start;
             int            i;
 
+            BISCUIT_INSTR_START(start);
             for (i = 0; i < nkeys; i++)
             {
                 ScanKey        key = &keys[i];
-                text          *pattern_text;
-                char          *pattern;
                 RoaringBitmap *key_result;
                 bool           is_not;
+                bool           lossy;
 
                 if (key->sk_flags & SK_ISNULL)
                     continue;
 
-                
-
-                pattern_text = DatumGetTextPP(key->sk_argument);
-                pattern      = text_to_cstring(pattern_text);
-
-                switch (key->sk_strategy)
-                {
-                    case BISCUIT_LIKE_STRATEGY:
-                        key_result = biscuit_query_pattern(so->index, pattern);
-                        break;
-                    case BISCUIT_NOT_LIKE_STRATEGY:
-                        key_result = biscuit_query_pattern(so->index, pattern);
-                        break;
-                    case BISCUIT_ILIKE_STRATEGY:
-                        key_result = biscuit_query_pattern_ilike(so->index, pattern);
-                        break;
-                    case BISCUIT_NOT_ILIKE_STRATEGY:
-                        key_result = biscuit_query_pattern_ilike(so->index, pattern);
-                        break;
-
-                    default:
-                        elog(ERROR, "Biscuit: unsupported scan strategy %d",
-                             key->sk_strategy);
-                        pfree(pattern);
-                        continue;
-                }
-
-                pfree(pattern);
+                key_result = biscuit_scan_key_query(so->index, 0, key, &lossy);
+                so->recheck |= lossy;
 
                 if (!key_result)
                 {
                     if (result) biscuit_roaring_free(result);
+                    BISCUIT_INSTR_STOP(so->instr.eval_time, start);
                     return;
                 }
+                biscuit_instrument_cardinality(&so->instr, key_result);
                 
                 is_not = (key->sk_strategy == BISCUIT_NOT_LIKE_STRATEGY ||
                           key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
@@ -685,9 +1007,11 @@ biscuit_rescan(IndexScanDesc scan,
                                 biscuit_roaring_add(all, j);
                         }
                     }
+                    biscuit_pending_add_valued(so->index, 0, all);
                     if (so->index->tombstone_count > 0 && so->index->tombstones)
                         biscuit_roaring_andnot_inplace(all, so->index->tombstones);
-                    biscuit_roaring_andnot_inplace(all, key_result);
+                    if (!lossy)
+                        biscuit_roaring_andnot_inplace(all, key_result);
                     biscuit_roaring_free(key_result);
                     key_result = all;
                 }
@@ -701,11 +1025,13 @@ biscuit_rescan(IndexScanDesc scan,
                     if (biscuit_roaring_is_empty(result))
                     {
                         biscuit_roaring_free(result);
+                        BISCUIT_INSTR_STOP(so->instr.eval_time, start);
                         return;
                     }
                 }
             }
 
+            BISCUIT_INSTR_STOP(so->instr.eval_time, start);
             if (!result)
                 return;
 
@@ -717,41 +1043,17 @@ biscuit_rescan(IndexScanDesc scan,
              * Parallel-aware TID collection.
              *
              * When scan->parallel_scan is set, the Gather node has launched
-             * background workers that will each call biscuit_rescan()
-             * independently on their own private IndexScanDesc.  Without
-             * coordination every participant evaluates the full bitmap and
-             * returns the full TID set, causing N× row duplication.
-             *
-             * Fix: biscuit_collect_sorted_tids_parallel() handles this
-             * transparently.  Every participant (leader and workers alike)
-             * evaluates the bitmap locally — the result is identical for all
-             * because the bitmap and index data are read-only and deterministic.
-             * An atomic CAS on pdesc->next_chunk elects exactly one initializer
-             * which writes total_tids/total_chunks into the shared DSM
-             * descriptor; the others spin-wait.  Then each participant atomically
-             * claims a disjoint chunk range and returns only those TIDs to its
-             * local Gather feeder — so the Gather node assembles exactly one
-             * copy of the full result.
+             * background workers that each call biscuit_rescan() on their
+             * own IndexScanDesc.  Only the participant that won
+             * biscuit_parallel_claim() gets here: biscuit_scan_deliver()
+             * publishes its result in the shared descriptor, and every
+             * participant, this one included, claims chunks of ranks from
+             * it, so the Gather node assembles exactly one copy.
              *
-             * When scan->parallel_scan is NULL the function is identical to
-             * biscuit_collect_sorted_tids_single().
+             * When scan->parallel_scan is NULL the result is streamed.
              */
-             elog(DEBUG1, "Entering Checkpoint - 3: 700");
-            {
-                BiscuitParallelScanDesc *pdesc = NULL;
-                elog(DEBUG1, "Entering Checkpoint - 2: 702");
-                if (scan->parallel_scan != NULL)
-                    pdesc = (BiscuitParallelScanDesc *)
-                                OffsetToPointer(scan->parallel_scan,
-                                                BISCUIT_PARALLEL_AM_OFFSET(scan->parallel_scan));
-              
-                biscuit_collect_sorted_tids_parallel(
-                    so->index, result, pdesc,
-                    &so->results, &so->num_results,
-                    needs_sorting);
-            }
-
-            biscuit_roaring_free(result);
+            elog(DEBUG1, "Entering Checkpoint - 3: 700");
+            biscuit_scan_deliver(scan, result, needs_sorting);
         }
 
         return; /* fast path done */
@@ -807,6 +1109,10 @@ biscuit_rescan(IndexScanDesc scan,
             int            n          = so->index->num_records;
             uint32        *tid_map    = NULL; /* tid_map[bucket] = recidx+1, 0=empty */
             int            map_size   = 0;
+            instr_time     start;
+
+            so->instr.fallback_rescans++;
+            BISCUIT_INSTR_START(start);
 
             /* Smallest power-of-two >= 2*n (load factor ~0.5) */
             if (n > 0)
@@ -845,9 +1151,6 @@ biscuit_rescan(IndexScanDesc scan,
                 for (i = 0; i < nkeys; i++)
                 {
                     ScanKey          key = &keys[i];
-                    text            *pattern_text;
-                    char            *pattern;
-                    bool             is_ilike;
                     bool             is_not;
                     ItemPointerData *key_tids  = NULL;
                     int              key_count = 0;
@@ -857,18 +1160,12 @@ biscuit_rescan(IndexScanDesc scan,
                     if (key->sk_flags & SK_ISNULL)
                         continue;
 
-                    is_ilike = (key->sk_strategy == BISCUIT_ILIKE_STRATEGY ||
-                                key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
-                    is_not   = (key->sk_strategy == BISCUIT_NOT_LIKE_STRATEGY ||
-                                key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
-
-                    pattern_text = DatumGetTextPP(key->sk_argument);
-                    pattern      = text_to_cstring(pattern_text);
+                    is_not = (key->sk_strategy == BISCUIT_NOT_LIKE_STRATEGY ||
+                              key->sk_strategy == BISCUIT_NOT_ILIKE_STRATEGY);
 
                     /* col_idx = 0 for single-column */
-                    biscuit_fallback_scan(so->index, pattern, is_ilike, 0,
-                                          &key_tids, &key_count);
-                    pfree(pattern);
+                    biscuit_scan_key_fallback(so->index, 0, key,
+                                              &key_tids, &key_count);
 
                     /* Convert TID list to a record-index bitmap via hash map */
                     key_bitmap = biscuit_roaring_create();
@@ -916,6 +1213,7 @@ biscuit_rescan(IndexScanDesc scan,
                         key_bitmap = all;
                     }
 
+                    biscuit_instrument_cardinality(&so->instr, key_bitmap);
                     biscuit_roaring_and_inplace(candidates, key_bitmap);
                     biscuit_roaring_free(key_bitmap);
 
@@ -927,24 +1225,8 @@ biscuit_rescan(IndexScanDesc scan,
                 if (so->index->tombstone_count > 0 && so->index->tombstones)
                     biscuit_roaring_andnot_inplace(candidates, so->index->tombstones);
 
-                /*biscuit_collect_sorted_tids_single(so->index, candidates,
-                                                     &so->results, &so->num_results,
-                                                     needs_sorting);*/
-               
-                {
-                    BiscuitParallelScanDesc *pdesc = NULL;
-                    elog(DEBUG1, "Entering Checkpoint - 2: 702");
-                    if (scan->parallel_scan != NULL)
-                        pdesc = (BiscuitParallelScanDesc *)
-                                    OffsetToPointer(scan->parallel_scan,
-                                                    BISCUIT_PARALLEL_AM_OFFSET(scan->parallel_scan));
-                  
-                     biscuit_collect_sorted_tids_parallel(
-                        so->index, candidates, pdesc,
-                        &so->results, &so->num_results,
-                        needs_sorting);
-                }
-                biscuit_roaring_free(candidates);
+                BISCUIT_INSTR_STOP(so->instr.eval_time, start);
+                biscuit_scan_deliver(scan, candidates, needs_sorting);
             }
 
             if (tid_map)
@@ -952,10 +1234,152 @@ biscuit_rescan(IndexScanDesc scan,
         }
     }
 
+/*
+ * Parallel participants other than the one that evaluated the query: take
+ * chunks of the published result.  When it was not shared, or this copy
+ * of the index numbers records differently, the participant that
+ * evaluated it returns all of it and this one returns nothing.
+ */
+static void
+biscuit_rescan_shared(IndexScanDesc scan, BiscuitParallelScanDesc *pdesc)
+{
+    BiscuitScanOpaque *so = (BiscuitScanOpaque *) scan->opaque;
+    RoaringBitmap     *shared;
+
+    shared = biscuit_parallel_wait(pdesc, so->index, &so->recheck);
+    if (!shared)
+        return;
+
+    so->is_aggregate_only   = biscuit_is_aggregate_query(scan);
+    so->needs_sorted_access = !so->is_aggregate_only && !scan->xs_want_itup;
+
+    biscuit_instrument_cardinality(&so->instr, shared);
+    biscuit_scan_stream(scan, biscuit_tid_stream_begin_parallel(shared, true, pdesc),
+                        so->needs_sorted_access);
+}
+
+void
+biscuit_rescan(IndexScanDesc scan,
+               ScanKey keys, int nkeys,
+               ScanKey orderbys, int norderbys)
+{
+    BiscuitScanOpaque       *so = (BiscuitScanOpaque *) scan->opaque;
+    BiscuitParallelScanDesc *pdesc;
+    ScanKey                  like_keys;
+    bool                     lossy_keys;
+    uint64                   ops = biscuit_bitmap_ops;
+    instr_time               start;
+
+    so->instr.rescans++;
+
+    if (so->stream)
+    {
+        biscuit_tid_stream_end(so->stream);
+        so->stream = NULL;
+    }
+    if (so->results)
+    {
+        pfree(so->results);
+        so->results = NULL;
+    }
+    if (so->records)
+    {
+        pfree(so->records);
+        so->records = NULL;
+    }
+    so->num_results      = 0;
+    so->current          = 0;
+    so->recheck          = false;
+    so->parallel_publish = false;
+
+    /*
+     * Every strategy is evaluated as LIKE / ILIKE keys; the executor
+     * rechecks the rows of those that match a superset (regex, ...)
+     */
+    BISCUIT_INSTR_START(start);
+    like_keys = biscuit_keys_rewrite(keys, nkeys, &lossy_keys);
+    so->recheck = lossy_keys;
+    BISCUIT_INSTR_STOP(so->instr.plan_time, start);
+
+    if (scan->parallel_scan == NULL)
+    {
+        biscuit_rescan_internal(scan, like_keys, nkeys, orderbys, norderbys);
+        biscuit_keys_free(like_keys, keys, nkeys);
+        so->instr.bitmap_ops += biscuit_bitmap_ops - ops;
+        return;
+    }
+
+    /*
+     * Parallel scan: one participant evaluates the query and publishes it
+     * (biscuit_scan_deliver); the rest wait for it and never evaluate it.
+     * All of them then claim chunks of it until none are left.
+     */
+    pdesc = BiscuitScanParallelDesc(scan);
+    if (biscuit_parallel_claim(pdesc))
+    {
+        so->parallel_publish = true;
+        biscuit_rescan_internal(scan, like_keys, nkeys, orderbys, norderbys);
+
+        /* A scan that ended without a result still releases the others */
+        if (so->parallel_publish)
+        {
+            RoaringBitmap *empty = biscuit_roaring_create();
+
+            biscuit_parallel_publish(pdesc, so->index, empty, so->recheck);
+            biscuit_roaring_free(empty);
+            so->parallel_publish = false;
+        }
+        biscuit_keys_free(like_keys, keys, nkeys);
+        so->instr.bitmap_ops += biscuit_bitmap_ops - ops;
+        return;
+    }
+
+    biscuit_rescan_shared(scan, pdesc);
+    biscuit_keys_free(like_keys, keys, nkeys);
+    so->instr.bitmap_ops += biscuit_bitmap_ops - ops;
+}
+
 /* ================================================================
  * SECTION 4 – gettuple
  * ================================================================ */
 
+/*
+ * Index-only scans: the indexed values of record rec, rebuilt from the
+ * string caches as an index tuple.  biscuit_canreturn() allows this only
+ * for indexes that keep their strings, and every supported type is text
+ * underneath, so the cached bytes are the value.
+ */
+static void
+biscuit_scan_form_itup(IndexScanDesc scan, uint32_t rec)
+{
+    BiscuitScanOpaque *so   = (BiscuitScanOpaque *) scan->opaque;
+    TupleDesc          desc = scan->xs_itupdesc;
+    Datum              values[INDEX_MAX_KEYS];
+    bool               isnull[INDEX_MAX_KEYS];
+    int                col;
+
+    Assert(desc->natts == so->index->num_columns);
+
+    for (col = 0; col < desc->natts; col++)
+    {
+        const char *str;
+        char       *to_free;
+        int         len;
+
+        str = biscuit_record_string(so->index, col, false, rec, &len, &to_free);
+        isnull[col] = (str == NULL);
+        values[col] = str ? PointerGetDatum(cstring_to_text_with_len(str, len)) : (Datum) 0;
+    }
+
+    if (scan->xs_itup)
+        pfree(scan->xs_itup);
+    scan->xs_itup = index_form_tuple(desc, values, isnull);
+
+    for (col = 0; col < desc->natts; col++)
+        if (!isnull[col])
+            pfree(DatumGetPointer(values[col]));
+}
+
 bool
 biscuit_gettuple(IndexScanDesc scan, ScanDirection dir)
 {
@@ -963,15 +1387,15 @@ biscuit_gettuple(IndexScanDesc scan, ScanDirection dir)
 
     (void) dir;  /* Biscuit always returns results in build order */
 
-    if (so->current >= so->num_results)
+    if (so->current >= so->num_results && !biscuit_scan_next_batch(scan))
         return false;
 
     scan->xs_heaptid = so->results[so->current];
-    scan->xs_recheck = false;
+    scan->xs_recheck = so->recheck;
+    if (scan->xs_want_itup)
+        biscuit_scan_form_itup(scan, so->records[so->current]);
     so->current++;
-
-    if (so->limit_remaining > 0)
-        so->limit_remaining--;
+    so->instr.tids++;
 
     return true;
 }
@@ -990,7 +1414,7 @@ biscuit_getbitmap(IndexScanDesc scan, TIDBitmap *tbm)
 
     if (so->num_results > 0)
     {
-        bool recheck = false;
+        bool recheck = so->recheck;
 
         if (so->num_results > chunk_size)
         {
@@ -1009,6 +1433,33 @@ biscuit_getbitmap(IndexScanDesc scan, TIDBitmap *tbm)
         }
     }
 
+    /*
+     * Streaming: walk the rest of the roaring result in fixed batches
+     * straight into the TIDBitmap, without the intermediate TID array.
+     */
+    if (so->stream)
+    {
+        ItemPointerData *batch = (ItemPointerData *)
+            palloc(BISCUIT_BITMAP_BATCH * sizeof(ItemPointerData));
+        int              n;
+        instr_time       start;
+
+        BISCUIT_INSTR_START(start);
+        while ((n = biscuit_tid_stream_next(so->stream, so->index,
+                                            batch, NULL, BISCUIT_BITMAP_BATCH)) > 0)
+        {
+            tbm_add_tuples(tbm, batch, n, so->recheck);
+            ntids += n;
+            CHECK_FOR_INTERRUPTS();
+        }
+
+        biscuit_tid_stream_end(so->stream);
+        so->stream = NULL;
+        pfree(batch);
+        BISCUIT_INSTR_STOP(so->instr.collect_time, start);
+    }
+
+    so->instr.tids += ntids;
     return ntids;
 }
 
@@ -1023,8 +1474,13 @@ biscuit_endscan(IndexScanDesc scan)
 
     if (so)
     {
+        if (so->stream)
+            biscuit_tid_stream_end(so->stream);
         if (so->results)
             pfree(so->results);
+        if (so->records)
+            pfree(so->records);
+        biscuit_instrument_report(RelationGetRelid(scan->indexRelation), &so->instr);
         pfree(so);
     }
     
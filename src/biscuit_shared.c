@@ -0,0 +1,651 @@
+/*
+ * biscuit_shared.c
+ * Shared-memory (DSA) resident index images.
+ *
+ * Every backend normally builds its own BiscuitIndex in CacheMemoryContext;
+ * with many pooled connections that is one multi-GB copy per connection.
+ * When biscuit.shared_index is on, the persisted snapshot stream written
+ * by biscuit_storage.c is instead copied once into a DSA area, and each
+ * backend decodes it in place (biscuit_storage_decode with zero_copy):
+ * bitmaps become frozen, read-only views of the image, and TIDs and
+ * strings point straight into it.  Only small per-view bookkeeping
+ * (headers, position-entry arrays, record pointer arrays) is private.
+ *
+ * Registry
+ * --------
+ * A shared hash table keyed by (database, index OID) maps each index to
+ * its current image, tagged with the relfilenumber and snapshot version it
+ * was read from.  A backend only attaches to an image that matches the
+ * snapshot on the metapage it is looking at; anything else is retired.
+ * The data pages of a snapshot stay as they are until the next one is
+ * written, so a snapshot demoted by a write keeps its image: the change
+ * log holds the rest.
+ *
+ * Each image carries a reference count of attached views, protected by
+ * the registry lock.  A retired image is freed when its last view goes.
+ * Views are released at transaction end rather than immediately, because
+ * a relcache invalidation can drop the cache entry while a scan in this
+ * backend still uses the view.
+ *
+ * Writes
+ * ------
+ * The image is never modified.  A change made in this backend or
+ * replayed from the change log is taken by the view as a delta
+ * (biscuit_shared_open_delta): the view gets private copies of its TID
+ * array and tombstones, inserted records go to its pending list, which a
+ * view never merges, and deleted records are only tombstoned.  The
+ * bitmaps stay shared, so each backend pays for the changes since the
+ * snapshot, not for a copy of the index.  The next snapshot (written by
+ * VACUUM) truncates the log; views then reload and attach to its image.
+ *
+ * What a view cannot take (inserts into an index without a pending list,
+ * compaction, writing a snapshot) goes to biscuit_shared_make_private(),
+ * which decodes a private copy from the image and replays the change log
+ * on top, as a load of a stale snapshot does.
+ *
+ * Sharing needs biscuit in shared_preload_libraries.  Without it, or when
+ * the area is full (biscuit.shared_memory_limit), loads silently fall
+ * back to private copies.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_cache.h"
+#include "biscuit_changelog.h"
+#include "biscuit_shared.h"
+#include "biscuit_storage.h"
+
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+
+/* ================================================================
+ * SECTION 1 – Types and state
+ * ================================================================ */
+
+bool biscuit_shared_index        = false;
+int  biscuit_shared_memory_limit = 0;       /* MB, 0 = no limit */
+int  biscuit_shared_max_indexes  = 1024;
+
+typedef struct BiscuitSharedKey
+{
+    Oid         dboid;
+    Oid         indexoid;
+} BiscuitSharedKey;
+
+typedef struct BiscuitSharedEntry
+{
+    BiscuitSharedKey key;
+    RelFileNumber    relnumber;     /* storage the image was read from */
+    uint64           version;       /* metapage snapshot_version */
+    uint64           nbytes;        /* stream length */
+    dsa_pointer      image;         /* BiscuitSharedImage */
+} BiscuitSharedEntry;
+
+/* Header of an image in the DSA area; the stream follows at MAXALIGN */
+typedef struct BiscuitSharedImage
+{
+    uint32      refcount;           /* attached views, under the lock */
+    bool        retired;            /* free when refcount reaches 0 */
+    uint64      nbytes;
+    uint64      version;            /* change log version it reflects */
+} BiscuitSharedImage;
+
+#define BiscuitSharedImageData(image) \
+    ((char *) (image) + MAXALIGN(sizeof(BiscuitSharedImage)))
+
+typedef struct BiscuitSharedControl
+{
+    dsa_handle  area_handle;        /* DSA_HANDLE_INVALID until first use */
+} BiscuitSharedControl;
+
+static BiscuitSharedControl *biscuit_shared_ctl  = NULL;
+static HTAB                 *biscuit_shared_htab = NULL;
+static LWLock               *biscuit_shared_lock = NULL;
+static dsa_area             *biscuit_shared_area = NULL;
+
+/* Views owned by the session cache, and views waiting for transaction end */
+static List *biscuit_shared_views   = NIL;
+static List *biscuit_shared_pending = NIL;
+static bool  biscuit_shared_callbacks_registered = false;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* ================================================================
+ * SECTION 2 – Shared memory setup
+ * ================================================================ */
+
+static Size
+biscuit_shared_shmem_size(void)
+{
+    return MAXALIGN(sizeof(BiscuitSharedControl))
+         + hash_estimate_size(biscuit_shared_max_indexes, sizeof(BiscuitSharedEntry));
+}
+
+static void
+biscuit_shared_shmem_request(void)
+{
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+    RequestAddinShmemSpace(biscuit_shared_shmem_size());
+    RequestNamedLWLockTranche("biscuit_shared", 1);
+}
+
+static void
+biscuit_shared_shmem_startup(void)
+{
+    HASHCTL info;
+    bool    found;
+
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+    biscuit_shared_ctl = (BiscuitSharedControl *)
+        ShmemInitStruct("biscuit_shared", sizeof(BiscuitSharedControl), &found);
+    if (!found)
+        biscuit_shared_ctl->area_handle = DSA_HANDLE_INVALID;
+
+    memset(&info, 0, sizeof(info));
+    info.keysize   = sizeof(BiscuitSharedKey);
+    info.entrysize = sizeof(BiscuitSharedEntry);
+    biscuit_shared_htab = ShmemInitHash("biscuit shared images",
+                                        biscuit_shared_max_indexes,
+                                        biscuit_shared_max_indexes,
+                                        &info, HASH_ELEM | HASH_BLOBS);
+
+    biscuit_shared_lock = &(GetNamedLWLockTranche("biscuit_shared"))->lock;
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+void
+biscuit_shared_init(void)
+{
+    DefineCustomBoolVariable("biscuit.shared_index",
+                             "Keep one copy of each Biscuit index in shared memory for all backends.",
+                             "Requires biscuit in shared_preload_libraries and a persisted snapshot; "
+                             "otherwise each backend builds its own copy.",
+                             &biscuit_shared_index,
+                             false,
+                             PGC_SIGHUP,
+                             0,
+                             NULL, NULL, NULL);
+
+    DefineCustomIntVariable("biscuit.shared_memory_limit",
+                            "Upper bound on shared memory used for Biscuit index images.",
+                            "0 means no limit.  When the limit is reached, loads fall back to "
+                            "per-backend copies.",
+                            &biscuit_shared_memory_limit,
+                            0, 0, INT_MAX,
+                            PGC_POSTMASTER,
+                            GUC_UNIT_MB,
+                            NULL, NULL, NULL);
+
+    DefineCustomIntVariable("biscuit.shared_max_indexes",
+                            "Number of Biscuit indexes the shared image registry is sized for.",
+                            NULL,
+                            &biscuit_shared_max_indexes,
+                            1024, 16, 1000000,
+                            PGC_POSTMASTER,
+                            0,
+                            NULL, NULL, NULL);
+
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook      = biscuit_shared_shmem_request;
+
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook      = biscuit_shared_shmem_startup;
+}
+
+bool
+biscuit_shared_enabled(void)
+{
+    return biscuit_shared_index && biscuit_shared_htab != NULL;
+}
+
+/*
+ * Create or attach the DSA area.  The area is pinned, so it outlives the
+ * backend that created it; each backend pins its own mapping.
+ *
+ * The DSA tranche reuses the id of our named LWLock tranche, which works
+ * across every supported release without registering another tranche.
+ */
+static bool
+biscuit_shared_attach_area(void)
+{
+    MemoryContext oldcontext;
+
+    if (biscuit_shared_area)
+        return true;
+    if (!biscuit_shared_ctl)
+        return false;
+
+    oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+    LWLockAcquire(biscuit_shared_lock, LW_EXCLUSIVE);
+
+    if (biscuit_shared_ctl->area_handle == DSA_HANDLE_INVALID)
+    {
+        biscuit_shared_area = dsa_create(biscuit_shared_lock->tranche);
+        if (biscuit_shared_memory_limit > 0)
+            dsa_set_size_limit(biscuit_shared_area,
+                               (size_t) biscuit_shared_memory_limit * 1024 * 1024);
+        dsa_pin(biscuit_shared_area);
+        biscuit_shared_ctl->area_handle = dsa_get_handle(biscuit_shared_area);
+    }
+    else
+        biscuit_shared_area = dsa_attach(biscuit_shared_ctl->area_handle);
+
+    dsa_pin_mapping(biscuit_shared_area);
+
+    LWLockRelease(biscuit_shared_lock);
+    MemoryContextSwitchTo(oldcontext);
+
+    return true;
+}
+
+/* ================================================================
+ * SECTION 3 – Registry (caller holds biscuit_shared_lock exclusively)
+ * ================================================================ */
+
+static void
+biscuit_shared_make_key(Relation index, BiscuitSharedKey *key)
+{
+    memset(key, 0, sizeof(BiscuitSharedKey));
+    key->dboid    = MyDatabaseId;
+    key->indexoid = RelationGetRelid(index);
+}
+
+static bool
+biscuit_shared_entry_matches(const BiscuitSharedEntry *entry, Relation index,
+                             const BiscuitMetaPageData *meta)
+{
+    return entry->relnumber == index->rd_locator.relNumber &&
+           entry->version == meta->snapshot_version &&
+           entry->nbytes == meta->snapshot_bytes;
+}
+
+static void
+biscuit_shared_retire_image(dsa_pointer dp)
+{
+    BiscuitSharedImage *image = (BiscuitSharedImage *) dsa_get_address(biscuit_shared_area, dp);
+
+    image->retired = true;
+    if (image->refcount == 0)
+        dsa_free(biscuit_shared_area, dp);
+}
+
+static void
+biscuit_shared_retire_entry(BiscuitSharedEntry *entry)
+{
+    biscuit_shared_retire_image(entry->image);
+    hash_search(biscuit_shared_htab, &entry->key, HASH_REMOVE, NULL);
+}
+
+/* Free every image nobody is attached to (used when the area is full) */
+static void
+biscuit_shared_evict_idle(void)
+{
+    HASH_SEQ_STATUS     status;
+    BiscuitSharedEntry *entry;
+
+    hash_seq_init(&status, biscuit_shared_htab);
+    while ((entry = (BiscuitSharedEntry *) hash_seq_search(&status)) != NULL)
+    {
+        BiscuitSharedImage *image = (BiscuitSharedImage *)
+            dsa_get_address(biscuit_shared_area, entry->image);
+
+        if (image->refcount == 0)
+            biscuit_shared_retire_entry(entry);
+    }
+}
+
+static void
+biscuit_shared_unref(dsa_pointer dp)
+{
+    BiscuitSharedImage *image;
+
+    LWLockAcquire(biscuit_shared_lock, LW_EXCLUSIVE);
+    image = (BiscuitSharedImage *) dsa_get_address(biscuit_shared_area, dp);
+    Assert(image->refcount > 0);
+    if (--image->refcount == 0 && image->retired)
+        dsa_free(biscuit_shared_area, dp);
+    LWLockRelease(biscuit_shared_lock);
+}
+
+/* Find a matching published image and take a reference on it */
+static dsa_pointer
+biscuit_shared_find(Relation index, const BiscuitMetaPageData *meta)
+{
+    BiscuitSharedKey    key;
+    BiscuitSharedEntry *entry;
+    dsa_pointer         dp = InvalidDsaPointer;
+
+    biscuit_shared_make_key(index, &key);
+
+    LWLockAcquire(biscuit_shared_lock, LW_EXCLUSIVE);
+    entry = (BiscuitSharedEntry *) hash_search(biscuit_shared_htab, &key, HASH_FIND, NULL);
+    if (entry)
+    {
+        if (biscuit_shared_entry_matches(entry, index, meta))
+        {
+            BiscuitSharedImage *image = (BiscuitSharedImage *)
+                dsa_get_address(biscuit_shared_area, entry->image);
+
+            image->refcount++;
+            dp = entry->image;
+        }
+        else
+            biscuit_shared_retire_entry(entry);     /* superseded snapshot or REINDEX */
+    }
+    LWLockRelease(biscuit_shared_lock);
+
+    return dp;
+}
+
+/*
+ * Copy the on-disk stream into a new image and register it.  Returns the
+ * image with one reference held, or InvalidDsaPointer if it does not fit.
+ */
+static dsa_pointer
+biscuit_shared_publish(Relation index, const BiscuitMetaPageData *meta)
+{
+    BiscuitSharedKey    key;
+    BiscuitSharedEntry *entry;
+    BiscuitSharedImage *image;
+    dsa_pointer         dp;
+    Size                total = MAXALIGN(sizeof(BiscuitSharedImage)) + meta->snapshot_bytes;
+    bool                found;
+
+    dp = dsa_allocate_extended(biscuit_shared_area, total, DSA_ALLOC_HUGE | DSA_ALLOC_NO_OOM);
+    if (!DsaPointerIsValid(dp))
+    {
+        LWLockAcquire(biscuit_shared_lock, LW_EXCLUSIVE);
+        biscuit_shared_evict_idle();
+        LWLockRelease(biscuit_shared_lock);
+
+        dp = dsa_allocate_extended(biscuit_shared_area, total, DSA_ALLOC_HUGE | DSA_ALLOC_NO_OOM);
+    }
+    if (!DsaPointerIsValid(dp))
+    {
+        elog(DEBUG1, "Biscuit: no room in the shared area for index %u (" UINT64_FORMAT " bytes)",
+             RelationGetRelid(index), meta->snapshot_bytes);
+        return InvalidDsaPointer;
+    }
+
+    image           = (BiscuitSharedImage *) dsa_get_address(biscuit_shared_area, dp);
+    image->refcount = 1;
+    image->retired  = false;
+    image->nbytes   = meta->snapshot_bytes;
+    image->version  = meta->snapshot_version;
+
+    PG_TRY();
+    {
+        biscuit_storage_read_stream(index, meta, BiscuitSharedImageData(image));
+    }
+    PG_CATCH();
+    {
+        dsa_free(biscuit_shared_area, dp);
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+
+    biscuit_shared_make_key(index, &key);
+
+    LWLockAcquire(biscuit_shared_lock, LW_EXCLUSIVE);
+    entry = (BiscuitSharedEntry *) hash_search(biscuit_shared_htab, &key, HASH_ENTER_NULL, &found);
+    if (!entry)
+    {
+        /* Registry full: only this backend will use the image */
+        image->retired = true;
+    }
+    else if (found && biscuit_shared_entry_matches(entry, index, meta))
+    {
+        /* Another backend published the same snapshot meanwhile */
+        BiscuitSharedImage *winner = (BiscuitSharedImage *)
+            dsa_get_address(biscuit_shared_area, entry->image);
+
+        winner->refcount++;
+        dsa_free(biscuit_shared_area, dp);
+        dp = entry->image;
+    }
+    else
+    {
+        if (found)
+            biscuit_shared_retire_image(entry->image);
+
+        entry->relnumber = index->rd_locator.relNumber;
+        entry->version   = meta->snapshot_version;
+        entry->nbytes    = meta->snapshot_bytes;
+        entry->image     = dp;
+    }
+    LWLockRelease(biscuit_shared_lock);
+
+    elog(DEBUG1, "Biscuit: published shared image of index %u (" UINT64_FORMAT " bytes)",
+         RelationGetRelid(index), meta->snapshot_bytes);
+
+    return dp;
+}
+
+/* ================================================================
+ * SECTION 4 – View lifecycle
+ * ================================================================ */
+
+static void
+biscuit_shared_detach(BiscuitIndex *view)
+{
+    dsa_pointer dp = view->shared_image;
+
+    biscuit_storage_free_view(view);
+    biscuit_shared_unref(dp);
+}
+
+static void
+biscuit_shared_process_pending(void)
+{
+    while (biscuit_shared_pending != NIL)
+    {
+        BiscuitIndex *view = (BiscuitIndex *) linitial(biscuit_shared_pending);
+
+        biscuit_shared_pending = list_delete_first(biscuit_shared_pending);
+        biscuit_shared_detach(view);
+    }
+}
+
+static void
+biscuit_shared_xact_callback(XactEvent event, void *arg)
+{
+    (void) arg;
+
+    switch (event)
+    {
+        case XACT_EVENT_COMMIT:
+        case XACT_EVENT_ABORT:
+        case XACT_EVENT_PARALLEL_COMMIT:
+        case XACT_EVENT_PARALLEL_ABORT:
+            biscuit_shared_process_pending();
+            break;
+        default:
+            break;
+    }
+}
+
+/* Drop every reference this backend still holds before it detaches */
+static void
+biscuit_shared_shmem_exit(int code, Datum arg)
+{
+    (void) code;
+    (void) arg;
+
+    biscuit_shared_process_pending();
+    while (biscuit_shared_views != NIL)
+    {
+        BiscuitIndex *view = (BiscuitIndex *) linitial(biscuit_shared_views);
+
+        biscuit_shared_views = list_delete_first(biscuit_shared_views);
+        biscuit_shared_detach(view);
+    }
+}
+
+static void
+biscuit_shared_register_callbacks(void)
+{
+    if (biscuit_shared_callbacks_registered)
+        return;
+
+    RegisterXactCallback(biscuit_shared_xact_callback, NULL);
+    before_shmem_exit(biscuit_shared_shmem_exit, (Datum) 0);
+    biscuit_shared_callbacks_registered = true;
+}
+
+/* ================================================================
+ * SECTION 5 – Public API
+ * ================================================================ */
+
+BiscuitIndex *
+biscuit_shared_acquire(Relation index, const BiscuitMetaPageData *meta)
+{
+    BiscuitSharedImage *image;
+    BiscuitIndex       *view;
+    MemoryContext       view_context;
+    MemoryContext       oldcontext;
+    dsa_pointer         dp;
+
+    if (!biscuit_shared_attach_area())
+        return NULL;
+    biscuit_shared_register_callbacks();
+
+    dp = biscuit_shared_find(index, meta);
+    if (!DsaPointerIsValid(dp))
+        dp = biscuit_shared_publish(index, meta);
+    if (!DsaPointerIsValid(dp))
+        return NULL;
+
+    image        = (BiscuitSharedImage *) dsa_get_address(biscuit_shared_area, dp);
+    view_context = AllocSetContextCreate(CacheMemoryContext,
+                                         "Biscuit shared view",
+                                         ALLOCSET_DEFAULT_SIZES);
+
+    oldcontext = MemoryContextSwitchTo(view_context);
+    PG_TRY();
+    {
+        view = biscuit_storage_decode(index, BiscuitSharedImageData(image), image->nbytes, true);
+    }
+    PG_CATCH();
+    {
+        MemoryContextSwitchTo(oldcontext);
+        MemoryContextDelete(view_context);
+
+        /* A corrupt image must not be handed to anyone else */
+        LWLockAcquire(biscuit_shared_lock, LW_EXCLUSIVE);
+        image->retired = true;
+        LWLockRelease(biscuit_shared_lock);
+        biscuit_shared_unref(dp);
+
+        PG_RE_THROW();
+    }
+    PG_END_TRY();
+    MemoryContextSwitchTo(oldcontext);
+
+    view->shared_image   = dp;
+    view->memory_context = view_context;
+
+    /* Only a view of the VALID snapshot may own its epoch */
+    view->storage_epoch = (meta->snapshot_state == BISCUIT_SNAPSHOT_VALID)
+                          ? meta->snapshot_epoch : 0;
+
+    oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+    biscuit_shared_views = lappend(biscuit_shared_views, view);
+    MemoryContextSwitchTo(oldcontext);
+
+    return view;
+}
+
+void
+biscuit_shared_open_delta(BiscuitIndex *view)
+{
+    MemoryContext    oldcontext;
+    ItemPointerData *tids;
+    RoaringBitmap   *tombstones;
+
+    Assert(BiscuitIndexIsShared(view));
+    if (view->shared_delta)
+        return;
+
+    oldcontext = MemoryContextSwitchTo(view->memory_context);
+
+    /* Exactly sized: biscuit_reserve_records() grows it like a private one */
+    tids = (ItemPointerData *) biscuit_palloc_huge(Max(view->capacity, 1) *
+                                                   sizeof(ItemPointerData));
+    memcpy(tids, view->tids, (Size) view->num_records * sizeof(ItemPointerData));
+    view->tids = tids;
+
+    tombstones = biscuit_roaring_copy(view->tombstones);
+    biscuit_roaring_view_free(view->tombstones);
+    view->tombstones = tombstones;
+
+    view->shared_delta = true;
+    MemoryContextSwitchTo(oldcontext);
+}
+
+BiscuitIndex *
+biscuit_shared_make_private(Relation index, BiscuitIndex *view)
+{
+    BiscuitSharedImage  *image;
+    BiscuitMetaPageData  meta;
+    BiscuitIndex        *idx;
+    MemoryContext        oldcontext;
+    MemoryContext        copy_context;
+    bool                 ok;
+
+    Assert(BiscuitIndexIsShared(view));
+
+    image = (BiscuitSharedImage *) dsa_get_address(biscuit_shared_area, view->shared_image);
+
+    copy_context = biscuit_cache_new_context();
+    oldcontext   = MemoryContextSwitchTo(copy_context);
+    idx = biscuit_storage_decode(index, BiscuitSharedImageData(image), image->nbytes, false);
+    MemoryContextSwitchTo(oldcontext);
+    idx->memory_context = copy_context;
+
+    /* The view's delta is in the change log: replay it from the image on */
+    biscuit_changelog_attach_snapshot(index, idx, image->version, view->log_base);
+
+    LockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+    ok = biscuit_storage_describe(index, &meta) && biscuit_changelog_replay(index, idx, &meta);
+    UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+
+    if (!ok)
+    {
+        elog(DEBUG1, "Biscuit: the change log no longer covers the image of index %u",
+             RelationGetRelid(index));
+        MemoryContextDelete(copy_context);
+        return NULL;
+    }
+
+    /* Same content as the view, so it may keep ownership of its epoch */
+    idx->storage_epoch = view->storage_epoch;
+
+    /* Replacing the cache entry releases the view */
+    biscuit_cache_insert(RelationGetRelid(index), idx);
+
+    elog(DEBUG1, "Biscuit: index %u switched to a private copy for writing",
+         RelationGetRelid(index));
+
+    return idx;
+}
+
+void
+biscuit_shared_release(BiscuitIndex *idx)
+{
+    MemoryContext oldcontext;
+
+    if (!idx || !BiscuitIndexIsShared(idx) || !list_member_ptr(biscuit_shared_views, idx))
+        return;
+
+    oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+    biscuit_shared_views   = list_delete_ptr(biscuit_shared_views, idx);
+    biscuit_shared_pending = lappend(biscuit_shared_pending, idx);
+    MemoryContextSwitchTo(oldcontext);
+}
@@ -0,0 +1,67 @@
+/*
+ * biscuit_shared.h
+ * Shared-memory (DSA) resident index images.
+ *
+ * With biscuit.shared_index = on (and biscuit in shared_preload_libraries)
+ * an on-disk snapshot is copied once into a DSA area and every backend
+ * maps it as a read-only view instead of building a private copy, so
+ * memory scales with the number of indexes rather than the number of
+ * connections.  Changes since the snapshot are a small per-backend delta
+ * on top of the view.  See biscuit_shared.c.
+ */
+
+#ifndef BISCUIT_SHARED_H
+#define BISCUIT_SHARED_H
+
+#include "biscuit_common.h"
+
+/* True for a read-only view of a shared image */
+#define BiscuitIndexIsShared(idx)   DsaPointerIsValid((idx)->shared_image)
+
+/* GUCs */
+extern bool biscuit_shared_index;
+extern int  biscuit_shared_memory_limit;
+extern int  biscuit_shared_max_indexes;
+
+/*
+ * Called from _PG_init: defines the GUCs and hooks shared-memory
+ * allocation.  Safe when the library is not preloaded (sharing is then
+ * simply unavailable).
+ */
+extern void biscuit_shared_init(void);
+
+/* Is shared residency configured and available in this process? */
+extern bool biscuit_shared_enabled(void);
+
+/*
+ * Return a view of the shared image for the snapshot in *meta,
+ * publishing it first if needed.  The caller holds the metapage share
+ * lock.  Returns NULL if the image cannot be placed in the shared area.
+ */
+extern BiscuitIndex *biscuit_shared_acquire(Relation index,
+                                            const BiscuitMetaPageData *meta);
+
+/*
+ * Let a view take changes as a delta on top of its image: private copies
+ * of its TID array and tombstones, inserts on its pending list (never
+ * merged), deletes as tombstones only.  Idempotent.
+ */
+extern void biscuit_shared_open_delta(BiscuitIndex *view);
+
+/*
+ * Replace a view with a private, writable copy decoded from the same
+ * image and caught up through the change log, install it in the session
+ * cache and return it.  NULL when the log no longer reaches back to the
+ * image; the caller loads the index again.  The image stays published.
+ */
+extern BiscuitIndex *biscuit_shared_make_private(Relation index,
+                                                 BiscuitIndex *view);
+
+/*
+ * Drop this backend's reference to a view.  Scans may still hold the
+ * pointer, so the view is unmapped at the end of the transaction.
+ * No-op for private copies.
+ */
+extern void biscuit_shared_release(BiscuitIndex *idx);
+
+#endif /* BISCUIT_SHARED_H */
@@ -0,0 +1,366 @@
+/*
+ * biscuit_stats.c
+ * Planner statistics.
+ *
+ * biscuit_costestimate() used to report a fixed selectivity of 1% for
+ * every pattern, so LIKE '%' and LIKE 'exact-sku-123' looked alike to the
+ * planner.  The index already knows, per column, how many records contain
+ * each byte, start or end with it, and have at least n characters; those
+ * counts are the cardinalities of char_cache, the position-0 / -1 entries
+ * of pos_idx_lower / neg_idx_lower and length_ge_bitmaps.
+ *
+ * biscuit_stats_compute() folds them into a fixed-size BiscuitStatsData
+ * (about 2 kB per column), which biscuit_storage.c writes to the metapage
+ * together with each persisted snapshot.  They describe the index as of
+ * the last CREATE INDEX or VACUUM, which is the same freshness contract
+ * as pg_statistic after ANALYZE.
+ *
+ * Estimate
+ * --------
+ * Every concrete byte of the pattern contributes the fraction of records
+ * containing it (the first / last byte of an anchored pattern the
+ * fraction of records starting / ending with it instead), and the length
+ * bound contributes the fraction of records that are long enough.  The
+ * factors are far from independent (the bytes of one word, or of one
+ * UTF-8 character, travel together), so instead of a plain product they
+ * are combined with exponential backoff: sorted most selective first,
+ * s = f1 * f2^(1/2) * f3^(1/4) * f4^(1/8).
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_index.h"
+#include "biscuit_pattern.h"
+#include "biscuit_stats.h"
+#include "biscuit_utf8.h"
+
+#include <math.h>
+
+#include "utils/selfuncs.h"
+
+/* Literal-escape sentinel in parsed part strings (see biscuit_pattern.c) */
+#define BISCUIT_STATS_LITERAL_ESC   '\x01'
+
+/* Number of factors combined by exponential backoff */
+#define BISCUIT_STATS_BACKOFF       4
+
+/* ================================================================
+ * SECTION 1 – Computing the statistics
+ * ================================================================ */
+
+/* The bitmaps of one column, single- or multi-column layout alike */
+typedef struct BiscuitStatsSource
+{
+    RoaringBitmap **char_cache;
+    RoaringBitmap **char_cache_lower;
+    CharIndex      *pos_idx_lower;
+    CharIndex      *neg_idx_lower;
+    RoaringBitmap **length_ge;
+    int             max_length;
+} BiscuitStatsSource;
+
+static void
+biscuit_stats_source(BiscuitIndex *idx, int col, BiscuitStatsSource *src)
+{
+    if (idx->num_columns == 1)
+    {
+        src->char_cache       = idx->char_cache_legacy;
+        src->char_cache_lower = idx->char_cache_lower;
+        src->pos_idx_lower    = idx->pos_idx_lower;
+        src->neg_idx_lower    = idx->neg_idx_lower;
+        src->length_ge        = idx->length_ge_bitmaps_legacy;
+        src->max_length       = idx->max_length_legacy;
+    }
+    else
+    {
+        ColumnIndex *cidx = &idx->column_indices[col];
+
+        src->char_cache       = cidx->char_cache;
+        src->char_cache_lower = cidx->char_cache_lower;
+        src->pos_idx_lower    = cidx->pos_idx_lower;
+        src->neg_idx_lower    = cidx->neg_idx_lower;
+        src->length_ge        = cidx->length_ge_bitmaps;
+        src->max_length       = cidx->max_length;
+    }
+}
+
+static RoaringBitmap *
+biscuit_stats_entry(const CharIndex *cidx, int pos)
+{
+    int left = 0, right = cidx->count - 1;
+
+    while (left <= right)
+    {
+        int mid = (left + right) >> 1;
+
+        if (cidx->entries[mid].pos == pos)
+            return cidx->entries[mid].bitmap;
+        else if (cidx->entries[mid].pos < pos)
+            left = mid + 1;
+        else
+            right = mid - 1;
+    }
+    return NULL;
+}
+
+/* Cardinality of bm, not counting records deleted since the last cleanup */
+static uint64
+biscuit_stats_live_count(const BiscuitIndex *idx, const RoaringBitmap *bm)
+{
+    uint64 n;
+
+    if (!bm)
+        return 0;
+
+    n = biscuit_roaring_count(bm);
+    if (n > 0 && idx->tombstone_count > 0 && !biscuit_roaring_is_empty(idx->tombstones))
+    {
+        RoaringBitmap *dead = biscuit_roaring_copy(bm);
+
+        biscuit_roaring_and_inplace(dead, idx->tombstones);
+        n -= Min(n, biscuit_roaring_count(dead));
+        biscuit_roaring_free(dead);
+    }
+    return n;
+}
+
+static uint16
+biscuit_stats_fraction(uint64 count, uint64 total)
+{
+    uint64 f;
+
+    if (count == 0 || total == 0)
+        return 0;
+
+    f = (count * BISCUIT_STATS_SCALE + total - 1) / total;
+    return (uint16) Min(f, BISCUIT_STATS_SCALE);
+}
+
+/* Does record i hold a value (i.e. is it neither free nor NULL)? */
+static bool
+biscuit_stats_has_data(const BiscuitIndex *idx, int i)
+{
+    return biscuit_record_has_value(idx, (uint32_t) i);
+}
+
+void
+biscuit_stats_compute(BiscuitIndex *idx, BiscuitStatsData *stats)
+{
+    uint64           live;
+    uint64           pairs = 0, ascending = 0;
+    ItemPointerData *prev  = NULL;
+    int              col, ch, i;
+
+    memset(stats, 0, sizeof(BiscuitStatsData));
+    stats->magic    = BISCUIT_STATS_MAGIC;
+    stats->ncolumns = Min(idx->num_columns, BISCUIT_STATS_MAX_COLUMNS);
+
+    live = (idx->num_records > idx->free_count)
+           ? (uint64) (idx->num_records - idx->free_count) : 0;
+    stats->live_records = (uint32) Min(live, PG_UINT32_MAX);
+
+    for (col = 0; col < (int) stats->ncolumns; col++)
+    {
+        BiscuitColumnStats *cs = &stats->columns[col];
+        BiscuitStatsSource  src;
+
+        biscuit_stats_source(idx, col, &src);
+
+        for (ch = 0; ch < CHAR_RANGE; ch++)
+        {
+            cs->has_char[ch] = biscuit_stats_fraction(
+                biscuit_stats_live_count(idx, src.char_cache[ch]), live);
+            cs->has_char_lower[ch] = biscuit_stats_fraction(
+                biscuit_stats_live_count(idx, src.char_cache_lower[ch]), live);
+            cs->first_char[ch] = biscuit_stats_fraction(
+                biscuit_stats_live_count(idx, biscuit_stats_entry(&src.pos_idx_lower[ch], 0)), live);
+            cs->last_char[ch] = biscuit_stats_fraction(
+                biscuit_stats_live_count(idx, biscuit_stats_entry(&src.neg_idx_lower[ch], -1)), live);
+        }
+
+        for (i = 0; i < BISCUIT_STATS_LENGTHS && i < src.max_length; i++)
+            cs->length_ge[i] = biscuit_stats_fraction(
+                biscuit_stats_live_count(idx, src.length_ge ? src.length_ge[i] : NULL), live);
+    }
+
+    /*
+     * TIDs come back in record order; that matches the heap right after a
+     * build and drifts as inserts reuse free slots.
+     */
+    for (i = 0; i < idx->num_records; i++)
+    {
+        if (!biscuit_stats_has_data(idx, i))
+            continue;
+        if (prev)
+        {
+            pairs++;
+            if (ItemPointerCompare(prev, &idx->tids[i]) < 0)
+                ascending++;
+        }
+        prev = &idx->tids[i];
+    }
+    stats->correlation = pairs ? (float4) (2.0 * ascending / pairs - 1.0) : 1.0f;
+}
+
+/* ================================================================
+ * SECTION 2 – Selectivity estimate
+ * ================================================================ */
+
+static double
+biscuit_stats_value(uint16 scaled)
+{
+    return (double) scaled / BISCUIT_STATS_SCALE;
+}
+
+/* Fraction of records with at least len characters */
+static double
+biscuit_stats_length_ge(const BiscuitColumnStats *cs, int len)
+{
+    if (len <= 0)
+        return biscuit_stats_value(cs->length_ge[0]);
+    return biscuit_stats_value(cs->length_ge[Min(len, BISCUIT_STATS_LENGTHS - 1)]);
+}
+
+/*
+ * Concrete byte at the start (from_end = false) or end of a part string,
+ * or -1 if that character is a '_' wildcard.
+ */
+static int
+biscuit_stats_anchor_byte(const char *part, int byte_len, bool from_end)
+{
+    unsigned char c;
+
+    if (byte_len <= 0)
+        return -1;
+
+    if (!from_end)
+    {
+        c = (unsigned char) part[0];
+        if (c == (unsigned char) BISCUIT_STATS_LITERAL_ESC)
+            return (byte_len > 1) ? (unsigned char) part[1] : -1;
+        return (c == '_') ? -1 : c;
+    }
+
+    c = (unsigned char) part[byte_len - 1];
+    if (byte_len > 1 && part[byte_len - 2] == BISCUIT_STATS_LITERAL_ESC)
+        return c;
+    return (c == '_') ? -1 : c;
+}
+
+Selectivity
+biscuit_stats_selectivity(const BiscuitStatsData *stats, int column,
+                          const char *pattern, int strategy)
+{
+    const BiscuitColumnStats *cs;
+    bool           is_ilike = (strategy == BISCUIT_ILIKE_STRATEGY ||
+                               strategy == BISCUIT_NOT_ILIKE_STRATEGY);
+    bool           is_not   = (strategy == BISCUIT_NOT_LIKE_STRATEGY ||
+                               strategy == BISCUIT_NOT_ILIKE_STRATEGY);
+    char          *pat;
+    ParsedPattern *parsed;
+    double         byte_sel[CHAR_RANGE];
+    double         factors[CHAR_RANGE + 1];
+    int            nfactors = 0;
+    int            min_len  = 0;
+    double         len_sel;
+    double         sel;
+    double         floor_sel;
+    int            i, j;
+
+    if (column < 0 || column >= (int) stats->ncolumns || stats->live_records == 0)
+        return -1;
+
+    cs  = &stats->columns[column];
+    pat = is_ilike ? biscuit_str_tolower(pattern, strlen(pattern)) : pstrdup(pattern);
+    parsed = biscuit_parse_pattern(pat);
+
+    for (i = 0; i < CHAR_RANGE; i++)
+        byte_sel[i] = -1.0;
+
+    /* Every concrete byte must occur somewhere in the value */
+    for (i = 0; i < parsed->part_count; i++)
+    {
+        const char *part = parsed->parts[i];
+        int         blen = parsed->part_byte_lens[i];
+
+        min_len += parsed->part_lens[i];
+
+        for (j = 0; j < blen; j++)
+        {
+            unsigned char c = (unsigned char) part[j];
+
+            if (c == (unsigned char) BISCUIT_STATS_LITERAL_ESC && j + 1 < blen)
+                c = (unsigned char) part[++j];
+            else if (c == '_')
+                continue;
+
+            byte_sel[c] = biscuit_stats_value(is_ilike ? cs->has_char_lower[c]
+                                                       : cs->has_char[c]);
+        }
+    }
+
+    /*
+     * Anchors.  The positional stats are case-folded, so a LIKE anchor is
+     * folded before the lookup (ASCII only; other bytes keep the weaker
+     * has_char bound).
+     */
+    if (parsed->part_count > 0)
+    {
+        int first = parsed->starts_percent ? -1 :
+            biscuit_stats_anchor_byte(parsed->parts[0], parsed->part_byte_lens[0], false);
+        int last  = parsed->ends_percent ? -1 :
+            biscuit_stats_anchor_byte(parsed->parts[parsed->part_count - 1],
+                                      parsed->part_byte_lens[parsed->part_count - 1], true);
+
+        if (first >= 0 && (is_ilike || first < 0x80))
+        {
+            double f = biscuit_stats_value(cs->first_char[is_ilike ? first
+                                                          : pg_ascii_tolower((unsigned char) first)]);
+            byte_sel[first] = (byte_sel[first] < 0) ? f : Min(byte_sel[first], f);
+        }
+        if (last >= 0 && (is_ilike || last < 0x80))
+        {
+            double f = biscuit_stats_value(cs->last_char[is_ilike ? last
+                                                         : pg_ascii_tolower((unsigned char) last)]);
+            byte_sel[last] = (byte_sel[last] < 0) ? f : Min(byte_sel[last], f);
+        }
+    }
+
+    /* Length: at least min_len characters, exactly min_len without '%' */
+    len_sel = biscuit_stats_length_ge(cs, min_len);
+    if (!parsed->starts_percent && !parsed->ends_percent && parsed->part_count <= 1 &&
+        min_len + 1 < BISCUIT_STATS_LENGTHS)
+        len_sel -= biscuit_stats_length_ge(cs, min_len + 1);
+
+    biscuit_free_parsed_pattern(parsed);
+    pfree(pat);
+
+    factors[nfactors++] = Max(len_sel, 0.0);
+    for (i = 0; i < CHAR_RANGE; i++)
+        if (byte_sel[i] >= 0)
+            factors[nfactors++] = byte_sel[i];
+
+    /* Insertion sort, most selective first */
+    for (i = 1; i < nfactors; i++)
+    {
+        double v = factors[i];
+
+        for (j = i; j > 0 && factors[j - 1] > v; j--)
+            factors[j] = factors[j - 1];
+        factors[j] = v;
+    }
+
+    sel = 1.0;
+    for (i = 0; i < nfactors && i < BISCUIT_STATS_BACKOFF; i++)
+        sel *= pow(factors[i], 1.0 / (double) (1 << i));
+
+    /* Never claim fewer than one row: the stats may be slightly stale */
+    floor_sel = 1.0 / (double) stats->live_records;
+    sel = Max(sel, floor_sel);
+
+    if (is_not)
+        sel = Max(1.0 - sel, floor_sel);
+
+    CLAMP_PROBABILITY(sel);
+    return (Selectivity) sel;
+}
@@ -0,0 +1,30 @@
+/*
+ * biscuit_stats.h
+ * Planner statistics derived from the index bitmaps, and the pattern
+ * selectivity estimate biscuit_costestimate() builds on them.
+ *
+ * The statistics are computed whenever a snapshot is persisted and kept
+ * on the metapage (see biscuit_storage.c), so planning never needs the
+ * index itself.
+ */
+
+#ifndef BISCUIT_STATS_H
+#define BISCUIT_STATS_H
+
+#include "biscuit_common.h"
+
+/* Summarise idx into *stats (every field, including magic) */
+extern void        biscuit_stats_compute(BiscuitIndex *idx, BiscuitStatsData *stats);
+
+/*
+ * Estimated fraction of rows matching `column <op> pattern`, where op is
+ * one of the BISCUIT_*_STRATEGY operators.  Returns -1 when the column is
+ * not covered by stats, so the caller can fall back to the planner's own
+ * estimate.
+ */
+extern Selectivity biscuit_stats_selectivity(const BiscuitStatsData *stats,
+                                             int column,
+                                             const char *pattern,
+                                             int strategy);
+
+#endif /* BISCUIT_STATS_H */
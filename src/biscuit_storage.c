@@ -0,0 +1,1683 @@
+/*
+ * biscuit_storage.c
+ * Persisted index snapshot.
+ *
+ * Serializes the complete in-memory BiscuitIndex (TIDs, string caches,
+ * every position / character / length bitmap and the CRUD state) into
+ * the index relation, so a backend with a cold cache can load it with a
+ * sequential read of the index instead of re-scanning the heap and
+ * rebuilding every bitmap.
+ *
+ * Layout
+ * ------
+ *   block 0          metapage (BiscuitMetaPageData in the special space)
+ *   block 1 .. n     data pages; together they hold one contiguous byte
+ *                    stream, BISCUIT_PAGE_PAYLOAD bytes per page, with
+ *                    the used length kept in the page opaque area.
+ *   after block n    change log pages (biscuit_changelog.c), chained from
+ *                    the metapage.
+ *
+ * Every page is written through GenericXLog, so the snapshot is crash
+ * safe and reaches physical standbys with the rest of the WAL stream.
+ *
+ * Freshness protocol
+ * ------------------
+ * aminsert and ambulkdelete modify the backend-local copy and append
+ * the change to the log, which other backends replay; the snapshot is
+ * written back by ambuild and amvacuumcleanup.  The metapage therefore
+ * records whether the data pages can be trusted:
+ *
+ *   VALID     the data pages match the heap; cold loads read them.
+ *   BUILDING  the data pages are stale, but the backend whose copy has
+ *             storage_epoch == snapshot_epoch holds a complete copy: it
+ *             either built it from the heap after claiming the epoch, or
+ *             loaded the VALID snapshot and was the first to modify it.
+ *   INVALID   stale, and nobody is known to hold a complete copy.
+ *
+ * biscuit_storage_claim() moves to BUILDING with a fresh epoch *before*
+ * a heap scan starts, and biscuit_storage_mark_dirty() runs before every
+ * local modification: it keeps BUILDING only for the owner and drops
+ * every other writer to INVALID.  A tuple inserted concurrently with the
+ * scan is therefore either seen by the scan or demotes the snapshot from
+ * aminsert.  A backend writes the metapage at most once per epoch, so
+ * steady-state inserts only take a shared buffer lock on block 0.
+ *
+ * Readers hold a share heavyweight lock on the metapage block (as GIN
+ * does for its pending list) for the duration of a load; the writer
+ * takes it exclusively while it rewrites the data pages, so no reader
+ * ever sees a half-written stream.  Readers use ConditionalLockPage and
+ * fall back to the heap path rather than queue behind a VACUUM.
+ *
+ * Writing the snapshot truncates the log first (its pages are
+ * overwritten), and may be done by any copy that has replayed the whole
+ * log, not only the owner of the epoch.  A snapshot that is no longer
+ * VALID is still loaded, privately, when the log reaches back to the
+ * version it was written at (snapshot_version) and is replayed on top.
+ *
+ * Bitmaps are stored in the encoding of the build (CRoaring portable
+ * format, or the fallback bitset's raw words); the metapage flags record
+ * which, and a library built the other way ignores the snapshot.
+ *
+ * The stream is laid out so that it can also be used in place: TID and
+ * free-list arrays and bitmap payloads start 8-byte aligned relative to
+ * the stream start, and strings are NUL-terminated.  biscuit_shared.c
+ * copies the stream into a DSA area once and every backend decodes it
+ * there with zero_copy = true, pointing into the image instead of
+ * copying it.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_arena.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_cache.h"
+#include "biscuit_changelog.h"
+#include "biscuit_pending.h"
+#include "biscuit_preload.h"
+#include "biscuit_shared.h"
+#include "biscuit_stats.h"
+#include "biscuit_tid.h"
+#include "biscuit_trigram.h"
+#include "biscuit_storage.h"
+
+#include "access/xlog.h"
+
+/* ================================================================
+ * SECTION 1 – Page and stream format
+ * ================================================================ */
+
+#define BISCUIT_PAGE_ID             0xB15C
+#define BISCUIT_STREAM_MAGIC        0x424E5350  /* "BSNP" */
+#define BISCUIT_NULL_LENGTH         0xFFFFFFFF
+#define BISCUIT_SAME_LENGTH         0xFFFFFFFE  /* lowercased copy is the value */
+#define BISCUIT_STREAM_ALIGN        8
+
+#ifdef HAVE_ROARING
+#define BISCUIT_SNAPSHOT_LOCAL_FLAGS    (BISCUIT_SNAPSHOT_F_ROARING | BISCUIT_SNAPSHOT_F_TRIGRAMS | \
+                                         BISCUIT_SNAPSHOT_F_SHARED_LOWER | BISCUIT_SNAPSHOT_F_OPTIONS)
+#else
+#define BISCUIT_SNAPSHOT_LOCAL_FLAGS    (BISCUIT_SNAPSHOT_F_TRIGRAMS | BISCUIT_SNAPSHOT_F_SHARED_LOWER | \
+                                         BISCUIT_SNAPSHOT_F_OPTIONS)
+#endif
+
+/* BiscuitOptions booleans in the stream */
+#define BISCUIT_STREAM_OPT_LIKE             0x0001
+#define BISCUIT_STREAM_OPT_ILIKE            0x0002
+#define BISCUIT_STREAM_OPT_SUFFIX           0x0004
+#define BISCUIT_STREAM_OPT_STRINGS          0x0008
+#define BISCUIT_STREAM_OPT_TRIGRAMS         0x0010
+
+/* Opaque area of a snapshot data page */
+typedef struct BiscuitPageOpaqueData
+{
+    uint32      nbytes;         /* stream bytes stored on this page */
+    uint16      flags;          /* reserved, always 0 */
+    uint16      page_id;        /* BISCUIT_PAGE_ID */
+} BiscuitPageOpaqueData;
+
+#define BiscuitPageGetOpaque(page) \
+    ((BiscuitPageOpaqueData *) PageGetSpecialPointer(page))
+#define BiscuitPageGetData(page) \
+    ((char *) (page) + MAXALIGN(SizeOfPageHeaderData))
+#define BISCUIT_PAGE_PAYLOAD \
+    (BLCKSZ - MAXALIGN(SizeOfPageHeaderData) - MAXALIGN(sizeof(BiscuitPageOpaqueData)))
+
+/*
+ * Sequential writer over blocks 1..n, or appending to a temporary file
+ * (file != NULL) when a parallel build hands a partial index to the
+ * leader.
+ */
+typedef struct BiscuitStorageWriter
+{
+    Relation    index;
+    BufFile    *file;
+    BlockNumber next_blkno;     /* block the staged payload goes to */
+    BlockNumber rel_nblocks;    /* current relation length */
+    char       *stage;          /* BISCUIT_PAGE_PAYLOAD bytes */
+    uint32      used;
+    uint64      total_bytes;
+} BiscuitStorageWriter;
+
+/*
+ * Sequential reader, either over blocks root..root+nblocks-1, over an
+ * in-memory image of the whole stream (end_blkno == next_blkno, page
+ * pointing at the image) or over a temporary file (file != NULL, page
+ * holding the last chunk read).
+ */
+typedef struct BiscuitStorageReader
+{
+    Relation             index;
+    BufFile             *file;
+    BufferAccessStrategy strategy;
+    BlockNumber          next_blkno;
+    BlockNumber          end_blkno;
+    char                *page;      /* payload copy of the current page */
+    uint64               len;
+    uint64               off;
+    uint64               total_bytes;
+    bool                 zero_copy; /* point into page instead of copying */
+} BiscuitStorageReader;
+
+static void
+biscuit_storage_corrupt(Relation index, const char *detail)
+{
+    ereport(ERROR,
+            (errcode(ERRCODE_INDEX_CORRUPTED),
+             errmsg("biscuit index \"%s\" has a corrupted snapshot",
+                    RelationGetRelationName(index)),
+             errdetail_internal("%s", detail),
+             errhint("REINDEX the index to rebuild it.")));
+}
+
+/* ================================================================
+ * SECTION 2 – Metapage helpers
+ * ================================================================ */
+
+static void
+biscuit_meta_init(Relation index, BiscuitMetaPageData *meta)
+{
+    memset(meta, 0, sizeof(BiscuitMetaPageData));
+    meta->magic          = BISCUIT_MAGIC;
+    meta->version        = BISCUIT_VERSION;
+    meta->root           = InvalidBlockNumber;
+    meta->num_columns    = index->rd_index->indnatts;
+    meta->snapshot_state = BISCUIT_SNAPSHOT_INVALID;
+    meta->log_head       = InvalidBlockNumber;
+    meta->log_tail       = InvalidBlockNumber;
+    meta->log_next_free  = BISCUIT_METAPAGE_BLKNO + 1;
+}
+
+/*
+ * Copy a current-version metapage into *meta.  Returns false for a new
+ * page, a foreign page or an older metapage (which has no usable
+ * snapshot).
+ */
+static bool
+biscuit_meta_from_page(Page page, BiscuitMetaPageData *meta)
+{
+    BiscuitMetaPageData *pm;
+
+    if (PageIsNew(page) || PageGetSpecialSize(page) < sizeof(BiscuitMetaPageData))
+        return false;
+
+    pm = (BiscuitMetaPageData *) PageGetSpecialPointer(page);
+    if (pm->magic != BISCUIT_MAGIC || pm->version != BISCUIT_VERSION)
+        return false;
+
+    memcpy(meta, pm, sizeof(BiscuitMetaPageData));
+    return true;
+}
+
+static bool
+biscuit_meta_read(Relation index, BiscuitMetaPageData *meta)
+{
+    Buffer buf;
+    bool   ok;
+
+    if (RelationGetNumberOfBlocks(index) == 0)
+        return false;
+
+    buf = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
+    LockBuffer(buf, BUFFER_LOCK_SHARE);
+    ok = biscuit_meta_from_page(BufferGetPage(buf), meta);
+    UnlockReleaseBuffer(buf);
+
+    return ok;
+}
+
+/* Room for planner statistics in the content area of the metapage */
+#define BISCUIT_META_STATS_SPACE \
+    (BLCKSZ - MAXALIGN(SizeOfPageHeaderData) - MAXALIGN(sizeof(BiscuitMetaPageData)))
+
+/*
+ * Caller holds an exclusive lock on buf.  With stats == NULL the planner
+ * statistics already on the page are kept: they stay a usable estimate
+ * after the snapshot itself goes stale.
+ */
+static void
+biscuit_meta_write(Relation index, Buffer buf, const BiscuitMetaPageData *meta,
+                   const BiscuitStatsData *stats)
+{
+    GenericXLogState *state;
+    Page              page;
+
+    state = GenericXLogStart(index);
+    page  = GenericXLogRegisterBuffer(state, buf, GENERIC_XLOG_FULL_IMAGE);
+    if (PageIsNew(page) ||
+        PageGetSpecialSize(page) != MAXALIGN(sizeof(BiscuitMetaPageData)))
+        PageInit(page, BufferGetPageSize(buf), sizeof(BiscuitMetaPageData));
+    memcpy(PageGetSpecialPointer(page), meta, sizeof(BiscuitMetaPageData));
+
+    if (stats)
+    {
+        uint32 ncols  = stats->ncolumns;
+        Size   nbytes;
+
+        while (ncols > 0 && BiscuitStatsSize(ncols) > BISCUIT_META_STATS_SPACE)
+            ncols--;
+        nbytes = BiscuitStatsSize(ncols);
+
+        memcpy(BiscuitPageGetData(page), stats, nbytes);
+        ((BiscuitStatsData *) BiscuitPageGetData(page))->ncolumns = ncols;
+        ((PageHeader) page)->pd_lower = MAXALIGN(SizeOfPageHeaderData) + nbytes;
+    }
+    GenericXLogFinish(state);
+}
+
+/* Pin block 0, creating it if the relation is still empty */
+static Buffer
+biscuit_meta_buffer(Relation index)
+{
+    Buffer buf;
+
+    if (RelationGetNumberOfBlocks(index) == 0)
+    {
+        LockRelationForExtension(index, ExclusiveLock);
+        if (RelationGetNumberOfBlocks(index) == 0)
+        {
+            buf = ReadBufferExtended(index, MAIN_FORKNUM, P_NEW, RBM_NORMAL, NULL);
+            UnlockRelationForExtension(index, ExclusiveLock);
+            Assert(BufferGetBlockNumber(buf) == BISCUIT_METAPAGE_BLKNO);
+            return buf;
+        }
+        UnlockRelationForExtension(index, ExclusiveLock);
+    }
+    return ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
+}
+
+static uint32
+biscuit_next_epoch(uint32 epoch)
+{
+    epoch++;
+    return (epoch == 0) ? 1 : epoch;
+}
+
+/* Does modifying idx require a metapage update? */
+static bool
+biscuit_meta_needs_demote(const BiscuitMetaPageData *meta, const BiscuitIndex *idx)
+{
+    if (meta->snapshot_state == BISCUIT_SNAPSHOT_VALID)
+        return true;
+    if (meta->snapshot_state == BISCUIT_SNAPSHOT_BUILDING)
+        return meta->snapshot_epoch != idx->storage_epoch;
+    return false;
+}
+
+/* ================================================================
+ * SECTION 3 – Stream writer
+ * ================================================================ */
+
+static void
+biscuit_writer_flush(BiscuitStorageWriter *w)
+{
+    Buffer                 buf;
+    Page                   page;
+    GenericXLogState      *state;
+    BiscuitPageOpaqueData *opaque;
+
+    if (w->used == 0)
+        return;
+
+    if (w->file)
+    {
+        BufFileWrite(w->file, w->stage, w->used);
+        w->used = 0;
+        CHECK_FOR_INTERRUPTS();
+        return;
+    }
+
+    if (w->next_blkno < w->rel_nblocks)
+        buf = ReadBuffer(w->index, w->next_blkno);
+    else
+    {
+        LockRelationForExtension(w->index, ExclusiveLock);
+        buf = ReadBufferExtended(w->index, MAIN_FORKNUM, P_NEW, RBM_NORMAL, NULL);
+        UnlockRelationForExtension(w->index, ExclusiveLock);
+
+        if (BufferGetBlockNumber(buf) != w->next_blkno)
+            elog(ERROR, "Biscuit: unexpected block %u while extending \"%s\" (expected %u)",
+                 BufferGetBlockNumber(buf), RelationGetRelationName(w->index),
+                 w->next_blkno);
+        w->rel_nblocks = w->next_blkno + 1;
+    }
+
+    LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+
+    state = GenericXLogStart(w->index);
+    page  = GenericXLogRegisterBuffer(state, buf, GENERIC_XLOG_FULL_IMAGE);
+    PageInit(page, BufferGetPageSize(buf), sizeof(BiscuitPageOpaqueData));
+
+    memcpy(BiscuitPageGetData(page), w->stage, w->used);
+    ((PageHeader) page)->pd_lower = MAXALIGN(SizeOfPageHeaderData) + w->used;
+
+    opaque          = BiscuitPageGetOpaque(page);
+    opaque->nbytes  = w->used;
+    opaque->flags   = 0;
+    opaque->page_id = BISCUIT_PAGE_ID;
+
+    GenericXLogFinish(state);
+    UnlockReleaseBuffer(buf);
+
+    w->next_blkno++;
+    w->used = 0;
+
+    CHECK_FOR_INTERRUPTS();
+}
+
+static void
+biscuit_writer_put(BiscuitStorageWriter *w, const void *data, size_t len)
+{
+    const char *src = (const char *) data;
+
+    while (len > 0)
+    {
+        size_t n = Min((size_t) (BISCUIT_PAGE_PAYLOAD - w->used), len);
+
+        memcpy(w->stage + w->used, src, n);
+        w->used        += n;
+        w->total_bytes += n;
+        src += n;
+        len -= n;
+
+        if (w->used == BISCUIT_PAGE_PAYLOAD)
+            biscuit_writer_flush(w);
+    }
+}
+
+/* Pad with zeroes up to the next BISCUIT_STREAM_ALIGN stream offset */
+static void
+biscuit_writer_align(BiscuitStorageWriter *w)
+{
+    static const char zeroes[BISCUIT_STREAM_ALIGN] = {0};
+    size_t            pad = (BISCUIT_STREAM_ALIGN - w->total_bytes % BISCUIT_STREAM_ALIGN)
+                            % BISCUIT_STREAM_ALIGN;
+
+    biscuit_writer_put(w, zeroes, pad);
+}
+
+static void
+biscuit_writer_put_u32(BiscuitStorageWriter *w, uint32 v)
+{
+    biscuit_writer_put(w, &v, sizeof(v));
+}
+
+static void
+biscuit_writer_put_i64(BiscuitStorageWriter *w, int64 v)
+{
+    biscuit_writer_put(w, &v, sizeof(v));
+}
+
+/* A cached value, arena- or image-resident (biscuit_arena.h) */
+static void
+biscuit_writer_put_string(BiscuitStorageWriter *w, const char *s)
+{
+    size_t len;
+
+    if (!s)
+    {
+        biscuit_writer_put_u32(w, BISCUIT_NULL_LENGTH);
+        return;
+    }
+    len = biscuit_cache_strlen(s);
+    biscuit_writer_put_u32(w, (uint32) len);
+    biscuit_writer_put(w, s, len + 1);     /* keep the NUL */
+}
+
+/* The lowercased copy of s, which shares s when lowercasing left it alone */
+static void
+biscuit_writer_put_lower(BiscuitStorageWriter *w, const char *s, const char *lower)
+{
+    if (lower && lower == s)
+        biscuit_writer_put_u32(w, BISCUIT_SAME_LENGTH);
+    else
+        biscuit_writer_put_string(w, lower);
+}
+
+/* The options the index was built with, which decide what the stream holds */
+static void
+biscuit_writer_put_options(BiscuitStorageWriter *w, const BiscuitOptions *options)
+{
+    uint32 bits = 0;
+
+    if (options->like)
+        bits |= BISCUIT_STREAM_OPT_LIKE;
+    if (options->ilike)
+        bits |= BISCUIT_STREAM_OPT_ILIKE;
+    if (options->suffix_index)
+        bits |= BISCUIT_STREAM_OPT_SUFFIX;
+    if (options->store_strings)
+        bits |= BISCUIT_STREAM_OPT_STRINGS;
+    if (options->trigrams)
+        bits |= BISCUIT_STREAM_OPT_TRIGRAMS;
+
+    biscuit_writer_put_u32(w, bits);
+    biscuit_writer_put_u32(w, (uint32) options->max_indexed_chars);
+}
+
+static void
+biscuit_writer_put_bitmap(BiscuitStorageWriter *w, const RoaringBitmap *rb)
+{
+    size_t size;
+    char  *buf;
+
+    if (!rb)
+    {
+        biscuit_writer_put_u32(w, BISCUIT_NULL_LENGTH);
+        return;
+    }
+
+    size = biscuit_roaring_serialized_size(rb);
+    if (size >= BISCUIT_NULL_LENGTH)
+        elog(ERROR, "Biscuit: bitmap of %zu bytes is too large to persist", size);
+
+    buf = (char *) MemoryContextAllocHuge(CurrentMemoryContext, Max(size, 1));
+    biscuit_roaring_serialize(rb, buf);
+    biscuit_writer_put_u32(w, (uint32) size);
+    biscuit_writer_align(w);
+    biscuit_writer_put(w, buf, size);
+    pfree(buf);
+}
+
+static void
+biscuit_writer_put_charindex(BiscuitStorageWriter *w, const CharIndex *ci)
+{
+    int i;
+
+    biscuit_writer_put_u32(w, (uint32) ci->count);
+    for (i = 0; i < ci->count; i++)
+    {
+        biscuit_writer_put_u32(w, (uint32) ci->entries[i].pos);
+        biscuit_writer_put_bitmap(w, ci->entries[i].bitmap);
+    }
+}
+
+/*
+ * One "side" of the index: the case-sensitive or the case-insensitive
+ * set of position, character and length bitmaps.
+ */
+static void
+biscuit_writer_put_side(BiscuitStorageWriter *w,
+                        const CharIndex *pos_idx,
+                        const CharIndex *neg_idx,
+                        RoaringBitmap *const *char_cache,
+                        RoaringBitmap *const *length_bitmaps,
+                        RoaringBitmap *const *length_ge_bitmaps,
+                        int max_length)
+{
+    int ch;
+    int i;
+
+    for (ch = 0; ch < CHAR_RANGE; ch++)
+    {
+        biscuit_writer_put_charindex(w, &pos_idx[ch]);
+        biscuit_writer_put_charindex(w, &neg_idx[ch]);
+        biscuit_writer_put_bitmap(w, char_cache[ch]);
+    }
+
+    if (!length_bitmaps || !length_ge_bitmaps)
+        max_length = 0;
+
+    biscuit_writer_put_u32(w, (uint32) max_length);
+    for (i = 0; i < max_length; i++)
+    {
+        biscuit_writer_put_bitmap(w, length_bitmaps[i]);
+        biscuit_writer_put_bitmap(w, length_ge_bitmaps[i]);
+    }
+}
+
+/*
+ * Optional trigram table: a presence flag, then only the non-empty
+ * buckets as (bucket number, CharIndex) pairs.
+ */
+static void
+biscuit_writer_put_trigrams(BiscuitStorageWriter *w, const CharIndex *tri)
+{
+    uint32 nbuckets = 0;
+    int    b;
+
+    biscuit_writer_put_u32(w, tri ? 1 : 0);
+    if (!tri)
+        return;
+
+    for (b = 0; b < BISCUIT_TRIGRAM_BUCKETS; b++)
+        if (tri[b].count > 0)
+            nbuckets++;
+
+    biscuit_writer_put_u32(w, nbuckets);
+    for (b = 0; b < BISCUIT_TRIGRAM_BUCKETS; b++)
+    {
+        if (tri[b].count == 0)
+            continue;
+        biscuit_writer_put_u32(w, (uint32) b);
+        biscuit_writer_put_charindex(w, &tri[b]);
+    }
+}
+
+static void
+biscuit_storage_write_index(BiscuitStorageWriter *w, BiscuitIndex *idx)
+{
+    int rec;
+    int col;
+
+    biscuit_writer_put_u32(w, BISCUIT_STREAM_MAGIC);
+    biscuit_writer_put_u32(w, (uint32) idx->num_columns);
+    biscuit_writer_put_u32(w, (uint32) idx->num_records);
+    biscuit_writer_put_options(w, &idx->options);
+    biscuit_writer_align(w);
+    biscuit_writer_put(w, idx->tids, idx->num_records * sizeof(ItemPointerData));
+
+    /* CRUD state */
+    biscuit_writer_put_bitmap(w, idx->tombstones);
+    biscuit_writer_put_u32(w, (uint32) idx->tombstone_count);
+    biscuit_writer_put_u32(w, (uint32) idx->free_count);
+    biscuit_writer_align(w);
+    biscuit_writer_put(w, idx->free_list, idx->free_count * sizeof(uint32_t));
+    biscuit_writer_put_i64(w, idx->insert_count);
+    biscuit_writer_put_i64(w, idx->update_count);
+    biscuit_writer_put_i64(w, idx->delete_count);
+
+    if (idx->num_columns == 1)
+    {
+        for (rec = 0; rec < idx->num_records; rec++)
+        {
+            biscuit_writer_put_string(w, idx->data_cache[rec]);
+            biscuit_writer_put_lower(w, idx->data_cache[rec],
+                                     idx->data_cache_lower ? idx->data_cache_lower[rec] : NULL);
+        }
+
+        biscuit_writer_put_u32(w, (uint32) idx->max_len);
+        biscuit_writer_put_side(w, idx->pos_idx_legacy, idx->neg_idx_legacy,
+                                idx->char_cache_legacy,
+                                idx->length_bitmaps_legacy, idx->length_ge_bitmaps_legacy,
+                                idx->max_length_legacy);
+        biscuit_writer_put_side(w, idx->pos_idx_lower, idx->neg_idx_lower,
+                                idx->char_cache_lower,
+                                idx->length_bitmaps_lower, idx->length_ge_bitmaps_lower,
+                                idx->max_length_lower);
+        biscuit_writer_put_trigrams(w, idx->trigrams_legacy);
+    }
+    else
+    {
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            ColumnIndex *cidx = &idx->column_indices[col];
+
+            biscuit_writer_put_u32(w, idx->column_types[col]);
+            for (rec = 0; rec < idx->num_records; rec++)
+            {
+                biscuit_writer_put_string(w, idx->column_data_cache[col][rec]);
+                biscuit_writer_put_lower(w, idx->column_data_cache[col][rec],
+                                         idx->column_data_cache_lower[col][rec]);
+            }
+
+            biscuit_writer_put_side(w, cidx->pos_idx, cidx->neg_idx, cidx->char_cache,
+                                    cidx->length_bitmaps, cidx->length_ge_bitmaps,
+                                    cidx->max_length);
+            biscuit_writer_put_side(w, cidx->pos_idx_lower, cidx->neg_idx_lower,
+                                    cidx->char_cache_lower,
+                                    cidx->length_bitmaps_lower, cidx->length_ge_bitmaps_lower,
+                                    cidx->max_length_lower);
+            biscuit_writer_put_trigrams(w, cidx->trigrams);
+        }
+    }
+
+    biscuit_writer_put_u32(w, BISCUIT_STREAM_MAGIC);
+}
+
+/* ================================================================
+ * SECTION 4 – Stream reader
+ * ================================================================ */
+
+static void
+biscuit_reader_next_page(BiscuitStorageReader *r)
+{
+    Buffer                 buf;
+    Page                   page;
+    BiscuitPageOpaqueData *opaque;
+    bool                   ok;
+
+    if (r->file)
+    {
+        r->len = BufFileReadMaybeEOF(r->file, r->page, BISCUIT_PAGE_PAYLOAD, true);
+        r->off = 0;
+        if (r->len == 0)
+            biscuit_storage_corrupt(r->index, "snapshot stream ends before its last record");
+        CHECK_FOR_INTERRUPTS();
+        return;
+    }
+
+    if (r->next_blkno >= r->end_blkno)
+        biscuit_storage_corrupt(r->index, "snapshot stream ends before its last record");
+
+    buf = ReadBufferExtended(r->index, MAIN_FORKNUM, r->next_blkno, RBM_NORMAL, r->strategy);
+    LockBuffer(buf, BUFFER_LOCK_SHARE);
+    page   = BufferGetPage(buf);
+    opaque = BiscuitPageGetOpaque(page);
+
+    ok = !PageIsNew(page)
+        && PageGetSpecialSize(page) == MAXALIGN(sizeof(BiscuitPageOpaqueData))
+        && opaque->page_id == BISCUIT_PAGE_ID
+        && opaque->nbytes > 0
+        && opaque->nbytes <= BISCUIT_PAGE_PAYLOAD;
+
+    if (ok)
+    {
+        memcpy(r->page, BiscuitPageGetData(page), opaque->nbytes);
+        r->len = opaque->nbytes;
+        r->off = 0;
+    }
+    UnlockReleaseBuffer(buf);
+
+    if (!ok)
+        biscuit_storage_corrupt(r->index, "snapshot data page has an invalid header");
+
+    r->next_blkno++;
+
+    CHECK_FOR_INTERRUPTS();
+}
+
+static void
+biscuit_reader_get(BiscuitStorageReader *r, void *dst, size_t len)
+{
+    char *out = (char *) dst;
+
+    while (len > 0)
+    {
+        size_t n;
+
+        if (r->off == r->len)
+            biscuit_reader_next_page(r);
+
+        n = (size_t) Min(r->len - r->off, (uint64) len);
+        memcpy(out, r->page + r->off, n);
+        r->off         += n;
+        r->total_bytes += n;
+        out += n;
+        len -= n;
+    }
+}
+
+/*
+ * Return a pointer to the next len bytes of an in-memory image and skip
+ * them (zero_copy readers only).
+ */
+static const char *
+biscuit_reader_take(BiscuitStorageReader *r, uint64 len)
+{
+    const char *p;
+
+    Assert(r->zero_copy);
+    if (r->len - r->off < len)
+        biscuit_storage_corrupt(r->index, "snapshot stream ends before its last record");
+
+    p = r->page + r->off;
+    r->off         += len;
+    r->total_bytes += len;
+    return p;
+}
+
+/* Skip the writer's padding up to the next BISCUIT_STREAM_ALIGN offset */
+static void
+biscuit_reader_align(BiscuitStorageReader *r)
+{
+    char   pad[BISCUIT_STREAM_ALIGN];
+    size_t n = (BISCUIT_STREAM_ALIGN - r->total_bytes % BISCUIT_STREAM_ALIGN)
+               % BISCUIT_STREAM_ALIGN;
+
+    biscuit_reader_get(r, pad, n);
+}
+
+/*
+ * Fetch an array of len bytes: copied into a fresh palloc'd buffer of
+ * alloc_len bytes, or pointed at in place for zero_copy readers.
+ */
+static void *
+biscuit_reader_get_array(BiscuitStorageReader *r, size_t len, size_t alloc_len)
+{
+    void *dst;
+
+    biscuit_reader_align(r);
+    if (r->zero_copy)
+        return (void *) biscuit_reader_take(r, len);
+
+    dst = biscuit_palloc_huge(Max(alloc_len, 1));
+    biscuit_reader_get(r, dst, len);
+    return dst;
+}
+
+static uint32
+biscuit_reader_get_u32(BiscuitStorageReader *r)
+{
+    uint32 v;
+
+    biscuit_reader_get(r, &v, sizeof(v));
+    return v;
+}
+
+static int64
+biscuit_reader_get_i64(BiscuitStorageReader *r)
+{
+    int64 v;
+
+    biscuit_reader_get(r, &v, sizeof(v));
+    return v;
+}
+
+/* Read a non-negative count, rejecting values above limit */
+static int
+biscuit_reader_get_count(BiscuitStorageReader *r, uint32 limit, const char *what)
+{
+    uint32 v = biscuit_reader_get_u32(r);
+
+    if (v > limit)
+        biscuit_storage_corrupt(r->index, psprintf("%s %u is out of range", what, v));
+    return (int) v;
+}
+
+/*
+ * A cached value whose length word has been read.  Zero-copy readers
+ * point at the image, where the length word sits in front of the bytes
+ * just as in an arena; other readers copy the value into arena.
+ */
+static char *
+biscuit_reader_get_string_body(BiscuitStorageReader *r, BiscuitStringArena *arena,
+                               uint32 len)
+{
+    char *s;
+    char *result;
+
+    if (len >= MaxAllocSize)
+        biscuit_storage_corrupt(r->index, "string length is out of range");
+
+    if (r->zero_copy)
+    {
+        s = (char *) biscuit_reader_take(r, (uint64) len + 1);
+        if (s[len] != '\0')
+            biscuit_storage_corrupt(r->index, "string is not terminated");
+        return s;
+    }
+
+    s = (char *) palloc(len + 1);
+    biscuit_reader_get(r, s, len + 1);
+    if (s[len] != '\0')
+        biscuit_storage_corrupt(r->index, "string is not terminated");
+
+    result = biscuit_arena_store(arena, s, (int) len);
+    pfree(s);
+    return result;
+}
+
+static char *
+biscuit_reader_get_string(BiscuitStorageReader *r, BiscuitStringArena *arena)
+{
+    uint32 len = biscuit_reader_get_u32(r);
+
+    if (len == BISCUIT_NULL_LENGTH)
+        return NULL;
+    return biscuit_reader_get_string_body(r, arena, len);
+}
+
+/* Counterpart of biscuit_writer_put_lower() */
+static char *
+biscuit_reader_get_lower(BiscuitStorageReader *r, BiscuitStringArena *arena, char *s)
+{
+    uint32 len = biscuit_reader_get_u32(r);
+
+    if (len == BISCUIT_NULL_LENGTH)
+        return NULL;
+    if (len == BISCUIT_SAME_LENGTH)
+    {
+        if (!s)
+            biscuit_storage_corrupt(r->index, "lowercased copy of a NULL value");
+        return s;
+    }
+    return biscuit_reader_get_string_body(r, arena, len);
+}
+
+/* Counterpart of biscuit_writer_put_options() */
+static void
+biscuit_reader_get_options(BiscuitStorageReader *r, BiscuitOptions *options)
+{
+    uint32 bits = biscuit_reader_get_u32(r);
+
+    options->like              = (bits & BISCUIT_STREAM_OPT_LIKE) != 0;
+    options->ilike             = (bits & BISCUIT_STREAM_OPT_ILIKE) != 0;
+    options->suffix_index      = (bits & BISCUIT_STREAM_OPT_SUFFIX) != 0;
+    options->store_strings     = (bits & BISCUIT_STREAM_OPT_STRINGS) != 0;
+    options->trigrams          = (bits & BISCUIT_STREAM_OPT_TRIGRAMS) != 0;
+    options->max_indexed_chars = biscuit_reader_get_count(r, INT_MAX, "max_indexed_chars");
+    options->pending_list_limit = -1;     /* read from the relation */
+}
+
+static RoaringBitmap *
+biscuit_reader_get_bitmap(BiscuitStorageReader *r)
+{
+    uint32         size = biscuit_reader_get_u32(r);
+    RoaringBitmap *rb;
+
+    if (size == BISCUIT_NULL_LENGTH)
+        return NULL;
+
+    biscuit_reader_align(r);
+
+    if (r->zero_copy)
+        rb = biscuit_roaring_view(biscuit_reader_take(r, size), size);
+    else if (r->len - r->off >= size)
+    {
+        /* Common case: the whole bitmap sits on the current page */
+        rb = biscuit_roaring_deserialize(r->page + r->off, size);
+        r->off         += size;
+        r->total_bytes += size;
+    }
+    else
+    {
+        char *buf = (char *) MemoryContextAllocHuge(CurrentMemoryContext, Max(size, 1));
+
+        biscuit_reader_get(r, buf, size);
+        rb = biscuit_roaring_deserialize(buf, size);
+        pfree(buf);
+    }
+
+    if (!rb)
+        biscuit_storage_corrupt(r->index, "bitmap does not deserialize");
+    return rb;
+}
+
+static void
+biscuit_reader_get_charindex(BiscuitStorageReader *r, CharIndex *ci)
+{
+    int i;
+
+    ci->count    = biscuit_reader_get_count(r, MaxAllocSize / sizeof(PosEntry), "position count");
+    ci->capacity = r->zero_copy ? ci->count : Max(ci->count, 8);
+    ci->entries  = (PosEntry *) palloc(ci->capacity * sizeof(PosEntry));
+
+    for (i = 0; i < ci->count; i++)
+    {
+        ci->entries[i].pos    = (int) biscuit_reader_get_u32(r);
+        ci->entries[i].bitmap = biscuit_reader_get_bitmap(r);
+        if (!ci->entries[i].bitmap)
+            biscuit_storage_corrupt(r->index, "position entry without a bitmap");
+    }
+}
+
+static void
+biscuit_reader_get_side(BiscuitStorageReader *r,
+                        CharIndex *pos_idx,
+                        CharIndex *neg_idx,
+                        RoaringBitmap **char_cache,
+                        RoaringBitmap ***length_bitmaps,
+                        RoaringBitmap ***length_ge_bitmaps,
+                        int *max_length)
+{
+    int ch;
+    int i;
+
+    for (ch = 0; ch < CHAR_RANGE; ch++)
+    {
+        biscuit_reader_get_charindex(r, &pos_idx[ch]);
+        biscuit_reader_get_charindex(r, &neg_idx[ch]);
+        char_cache[ch] = biscuit_reader_get_bitmap(r);
+    }
+
+    *max_length = biscuit_reader_get_count(r, MaxAllocSize / sizeof(RoaringBitmap *), "length bound");
+    if (*max_length == 0)
+    {
+        *length_bitmaps    = NULL;
+        *length_ge_bitmaps = NULL;
+        return;
+    }
+
+    *length_bitmaps    = (RoaringBitmap **) palloc0(*max_length * sizeof(RoaringBitmap *));
+    *length_ge_bitmaps = (RoaringBitmap **) palloc0(*max_length * sizeof(RoaringBitmap *));
+    for (i = 0; i < *max_length; i++)
+    {
+        (*length_bitmaps)[i]    = biscuit_reader_get_bitmap(r);
+        (*length_ge_bitmaps)[i] = biscuit_reader_get_bitmap(r);
+    }
+}
+
+static CharIndex *
+biscuit_reader_get_trigrams(BiscuitStorageReader *r)
+{
+    CharIndex *tri;
+    int        nbuckets;
+    int        i;
+
+    if (biscuit_reader_get_u32(r) == 0)
+        return NULL;
+
+    tri      = biscuit_trigram_create();
+    nbuckets = biscuit_reader_get_count(r, BISCUIT_TRIGRAM_BUCKETS, "trigram bucket count");
+    for (i = 0; i < nbuckets; i++)
+    {
+        uint32 b = biscuit_reader_get_u32(r);
+
+        if (b >= BISCUIT_TRIGRAM_BUCKETS || tri[b].entries)
+            biscuit_storage_corrupt(r->index, "trigram bucket out of range");
+        biscuit_reader_get_charindex(r, &tri[b]);
+    }
+    return tri;
+}
+
+/*
+ * Rebuild a BiscuitIndex from the stream in CurrentMemoryContext.  For a
+ * private copy, capacities mirror what biscuit_build() would have
+ * allocated so later inserts grow the arrays the same way; a zero_copy
+ * view is read-only and sized exactly.
+ */
+static BiscuitIndex *
+biscuit_storage_read_index(BiscuitStorageReader *r, Relation index)
+{
+    BiscuitIndex *idx;
+    int           natts = index->rd_index->indnatts;
+    int           rec;
+    int           col;
+
+    if (biscuit_reader_get_u32(r) != BISCUIT_STREAM_MAGIC)
+        biscuit_storage_corrupt(index, "snapshot stream has a bad header");
+    if ((int) biscuit_reader_get_u32(r) != natts)
+        biscuit_storage_corrupt(index, "snapshot column count does not match the index");
+
+    idx               = (BiscuitIndex *) palloc0(sizeof(BiscuitIndex));
+    idx->num_columns  = natts;
+    idx->num_records  = biscuit_reader_get_count(r, BISCUIT_MAX_RECORDS, "record count");
+    biscuit_reader_get_options(r, &idx->options);
+    idx->capacity     = r->zero_copy ? idx->num_records : Max(1024, idx->num_records);
+    idx->tids         = (ItemPointerData *)
+        biscuit_reader_get_array(r, (Size) idx->num_records * sizeof(ItemPointerData),
+                                 (Size) idx->capacity * sizeof(ItemPointerData));
+
+    /* CRUD state */
+    idx->tombstones = biscuit_reader_get_bitmap(r);
+    if (!idx->tombstones)
+        idx->tombstones = biscuit_roaring_create();
+    idx->tombstone_count = biscuit_reader_get_count(r, idx->num_records, "tombstone count");
+    idx->free_count      = biscuit_reader_get_count(r, idx->num_records, "free slot count");
+    idx->free_capacity   = r->zero_copy ? idx->free_count : Max(64, idx->free_count);
+    idx->free_list       = (uint32_t *)
+        biscuit_reader_get_array(r, idx->free_count * sizeof(uint32_t),
+                                 idx->free_capacity * sizeof(uint32_t));
+    idx->insert_count = biscuit_reader_get_i64(r);
+    idx->update_count = biscuit_reader_get_i64(r);
+    idx->delete_count = biscuit_reader_get_i64(r);
+
+    if (natts == 1)
+    {
+        idx->data_cache       = (char **) biscuit_palloc0_huge((Size) idx->capacity * sizeof(char *));
+        idx->data_cache_lower = (char **) biscuit_palloc0_huge((Size) idx->capacity * sizeof(char *));
+        for (rec = 0; rec < idx->num_records; rec++)
+        {
+            idx->data_cache[rec]       = biscuit_reader_get_string(r, &idx->strings_legacy);
+            idx->data_cache_lower[rec] = biscuit_reader_get_lower(r, &idx->strings_legacy,
+                                                                  idx->data_cache[rec]);
+        }
+
+        idx->max_len = (int) biscuit_reader_get_u32(r);
+        biscuit_reader_get_side(r, idx->pos_idx_legacy, idx->neg_idx_legacy,
+                                idx->char_cache_legacy,
+                                &idx->length_bitmaps_legacy, &idx->length_ge_bitmaps_legacy,
+                                &idx->max_length_legacy);
+        biscuit_reader_get_side(r, idx->pos_idx_lower, idx->neg_idx_lower,
+                                idx->char_cache_lower,
+                                &idx->length_bitmaps_lower, &idx->length_ge_bitmaps_lower,
+                                &idx->max_length_lower);
+        idx->trigrams_legacy = biscuit_reader_get_trigrams(r);
+    }
+    else
+    {
+        idx->column_types            = (Oid *)        palloc(natts * sizeof(Oid));
+        idx->output_funcs            = (FmgrInfo *)   palloc(natts * sizeof(FmgrInfo));
+        idx->column_data_cache       = (char ***)     palloc(natts * sizeof(char **));
+        idx->column_data_cache_lower = (char ***)     palloc(natts * sizeof(char **));
+        idx->column_indices          = (ColumnIndex *) palloc0(natts * sizeof(ColumnIndex));
+
+        for (col = 0; col < natts; col++)
+        {
+            Form_pg_attribute col_attr = TupleDescAttr(RelationGetDescr(index), col);
+            ColumnIndex      *cidx = &idx->column_indices[col];
+            Oid               typoutput;
+            bool              typIsVarlena;
+
+            if (biscuit_reader_get_u32(r) != col_attr->atttypid)
+                biscuit_storage_corrupt(index, "snapshot column type does not match the index");
+
+            idx->column_types[col] = col_attr->atttypid;
+            getTypeOutputInfo(col_attr->atttypid, &typoutput, &typIsVarlena);
+            fmgr_info(typoutput, &idx->output_funcs[col]);
+
+            idx->column_data_cache[col]       = (char **) biscuit_palloc0_huge((Size) idx->capacity * sizeof(char *));
+            idx->column_data_cache_lower[col] = (char **) biscuit_palloc0_huge((Size) idx->capacity * sizeof(char *));
+            for (rec = 0; rec < idx->num_records; rec++)
+            {
+                idx->column_data_cache[col][rec]       = biscuit_reader_get_string(r, &cidx->strings);
+                idx->column_data_cache_lower[col][rec] =
+                    biscuit_reader_get_lower(r, &cidx->strings, idx->column_data_cache[col][rec]);
+            }
+
+            biscuit_reader_get_side(r, cidx->pos_idx, cidx->neg_idx, cidx->char_cache,
+                                    &cidx->length_bitmaps, &cidx->length_ge_bitmaps,
+                                    &cidx->max_length);
+            biscuit_reader_get_side(r, cidx->pos_idx_lower, cidx->neg_idx_lower,
+                                    cidx->char_cache_lower,
+                                    &cidx->length_bitmaps_lower, &cidx->length_ge_bitmaps_lower,
+                                    &cidx->max_length_lower);
+            cidx->trigrams = biscuit_reader_get_trigrams(r);
+        }
+    }
+
+    if (biscuit_reader_get_u32(r) != BISCUIT_STREAM_MAGIC)
+        biscuit_storage_corrupt(index, "snapshot stream has a bad trailer");
+
+    idx->heap_ordered  = biscuit_tids_in_heap_order(idx->tids, idx->num_records);
+    idx->preload_state = BISCUIT_PRELOAD_DONE;
+    return idx;
+}
+
+/* ================================================================
+ * SECTION 5 – Public API
+ * ================================================================ */
+
+uint32
+biscuit_storage_claim(Relation index)
+{
+    BiscuitMetaPageData meta;
+    Buffer              buf;
+
+    if (RecoveryInProgress())
+        return 0;
+
+    buf = biscuit_meta_buffer(index);
+    LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+
+    if (!biscuit_meta_from_page(BufferGetPage(buf), &meta))
+        biscuit_meta_init(index, &meta);
+
+    meta.snapshot_epoch = biscuit_next_epoch(meta.snapshot_epoch);
+    meta.snapshot_state = BISCUIT_SNAPSHOT_BUILDING;
+    biscuit_meta_write(index, buf, &meta, NULL);
+
+    UnlockReleaseBuffer(buf);
+
+    return meta.snapshot_epoch;
+}
+
+void
+biscuit_storage_mark_dirty(Relation index, BiscuitIndex *idx)
+{
+    BiscuitMetaPageData meta;
+    Buffer              buf;
+    Page                page;
+
+    if (RecoveryInProgress() || RelationGetNumberOfBlocks(index) == 0)
+        return;
+
+    buf  = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
+    page = BufferGetPage(buf);
+
+    /* Fast path: already demoted, or we own the BUILDING epoch */
+    LockBuffer(buf, BUFFER_LOCK_SHARE);
+    if (!biscuit_meta_from_page(page, &meta) || !biscuit_meta_needs_demote(&meta, idx))
+    {
+        UnlockReleaseBuffer(buf);
+        return;
+    }
+    LockBuffer(buf, BUFFER_LOCK_UNLOCK);
+
+    LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+    if (biscuit_meta_from_page(page, &meta) && biscuit_meta_needs_demote(&meta, idx))
+    {
+        if (meta.snapshot_state == BISCUIT_SNAPSHOT_VALID &&
+            meta.snapshot_epoch == idx->storage_epoch)
+        {
+            /* Our copy is the snapshot: keep ownership under a new epoch */
+            meta.snapshot_epoch = biscuit_next_epoch(meta.snapshot_epoch);
+            meta.snapshot_state = BISCUIT_SNAPSHOT_BUILDING;
+            idx->storage_epoch  = meta.snapshot_epoch;
+        }
+        else
+            meta.snapshot_state = BISCUIT_SNAPSHOT_INVALID;
+
+        biscuit_meta_write(index, buf, &meta, NULL);
+    }
+    UnlockReleaseBuffer(buf);
+}
+
+/*
+ * Whether idx has every change the metapage records: it was loaded or
+ * built from this relfilenode and has replayed the change log up to its
+ * newest entry.  Such a copy is as complete as the owner of an epoch.
+ */
+static bool
+biscuit_storage_is_synced(Relation index, const BiscuitIndex *idx,
+                          const BiscuitMetaPageData *meta)
+{
+    return idx->log_relnumber == index->rd_locator.relNumber &&
+           idx->log_version == meta->log_version &&
+           idx->log_version >= meta->log_base;
+}
+
+bool
+biscuit_storage_persist(Relation index, BiscuitIndex *idx)
+{
+    BiscuitMetaPageData  meta;
+    BiscuitStorageWriter w;
+    BiscuitStatsData    *stats;
+    Buffer               buf;
+    bool                 published = false;
+
+    /* A shared view cannot merge its pending list into the image */
+    if (RecoveryInProgress() || !idx || idx->preload_state < BISCUIT_PRELOAD_DONE ||
+        BiscuitIndexIsShared(idx))
+        return false;
+
+    LockPage(index, BISCUIT_METAPAGE_BLKNO, ExclusiveLock);
+
+    if (RelationGetNumberOfBlocks(index) == 0)
+    {
+        UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ExclusiveLock);
+        return false;
+    }
+
+    buf = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
+    LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+
+    /*
+     * An index built by an earlier release has an older metapage: start a
+     * current one, at log version 0, which a copy attached to it matches.
+     */
+    (void) biscuit_storage_meta_upgrade(index, BufferGetPage(buf), &meta);
+
+    if ((meta.snapshot_state != BISCUIT_SNAPSHOT_BUILDING ||
+         idx->storage_epoch == 0 ||
+         meta.snapshot_epoch != idx->storage_epoch) &&
+        !biscuit_storage_is_synced(index, idx, &meta))
+    {
+        UnlockReleaseBuffer(buf);
+        UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ExclusiveLock);
+        return false;
+    }
+
+    /* A synced copy takes over a new epoch, as the build of an owner would */
+    if (meta.snapshot_state != BISCUIT_SNAPSHOT_BUILDING ||
+        meta.snapshot_epoch != idx->storage_epoch)
+    {
+        meta.snapshot_epoch = biscuit_next_epoch(meta.snapshot_epoch);
+        meta.snapshot_state = BISCUIT_SNAPSHOT_BUILDING;
+        idx->storage_epoch  = meta.snapshot_epoch;
+    }
+
+    /*
+     * The data pages are rewritten from block 1, over the old snapshot and
+     * the log pages after it.  Truncate the log (every entry is in idx)
+     * and stop trusting the old data pages before the first one goes.
+     */
+    meta.log_version++;
+    meta.log_base         = meta.log_version;
+    meta.log_head         = InvalidBlockNumber;
+    meta.log_tail         = InvalidBlockNumber;
+    meta.snapshot_nblocks = 0;
+    biscuit_meta_write(index, buf, &meta, NULL);
+    UnlockReleaseBuffer(buf);
+
+    idx->log_version = meta.log_version;
+    idx->log_base    = meta.log_base;
+    idx->log_blkno   = InvalidBlockNumber;
+
+    /* The snapshot holds bitmaps only: merge the pending list into them */
+    biscuit_pending_flush(idx);
+
+    memset(&w, 0, sizeof(w));
+    w.index       = index;
+    w.next_blkno  = BISCUIT_METAPAGE_BLKNO + 1;
+    w.rel_nblocks = RelationGetNumberOfBlocks(index);
+    w.stage       = (char *) palloc(BISCUIT_PAGE_PAYLOAD);
+
+    biscuit_storage_write_index(&w, idx);
+    biscuit_writer_flush(&w);
+    pfree(w.stage);
+
+    stats = (BiscuitStatsData *) palloc(sizeof(BiscuitStatsData));
+    biscuit_stats_compute(idx, stats);
+
+    /*
+     * Publish, unless a concurrent insert demoted the epoch meanwhile.
+     * Either way new log pages go after the stream just written.
+     */
+    buf = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
+    LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+    if (biscuit_meta_from_page(BufferGetPage(buf), &meta))
+    {
+        meta.log_next_free = w.next_blkno;
+
+        if (meta.snapshot_state == BISCUIT_SNAPSHOT_BUILDING &&
+            meta.snapshot_epoch == idx->storage_epoch)
+        {
+            meta.root             = BISCUIT_METAPAGE_BLKNO + 1;
+            meta.num_records      = idx->num_records;
+            meta.num_columns      = idx->num_columns;
+            meta.snapshot_state   = BISCUIT_SNAPSHOT_VALID;
+            meta.snapshot_flags   = BISCUIT_SNAPSHOT_LOCAL_FLAGS;
+            meta.snapshot_nblocks = w.next_blkno - meta.root;
+            meta.snapshot_bytes   = w.total_bytes;
+            meta.snapshot_version = idx->log_version;
+            biscuit_meta_write(index, buf, &meta, stats);
+            published = true;
+        }
+        else
+            biscuit_meta_write(index, buf, &meta, NULL);
+    }
+    UnlockReleaseBuffer(buf);
+    pfree(stats);
+
+    UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ExclusiveLock);
+
+    elog(DEBUG1, "Biscuit: %s snapshot of index %u (%u blocks, " UINT64_FORMAT " bytes)",
+         published ? "persisted" : "abandoned",
+         RelationGetRelid(index), w.next_blkno - (BISCUIT_METAPAGE_BLKNO + 1),
+         w.total_bytes);
+
+    return published;
+}
+
+/*
+ * Shared body of biscuit_storage_load() and biscuit_storage_prewarm_shared().
+ * With shared_only, never builds a private copy.
+ */
+static BiscuitIndex *
+biscuit_storage_load_internal(Relation index, bool shared_only)
+{
+    BiscuitMetaPageData  meta;
+    BiscuitStorageReader r;
+    BiscuitIndex        *idx;
+    MemoryContext        oldcontext;
+    MemoryContext        copy_context;
+    bool                 stale;
+
+    if (RelationGetNumberOfBlocks(index) <= BISCUIT_METAPAGE_BLKNO + 1)
+        return NULL;
+    if (shared_only && !biscuit_shared_enabled())
+        return NULL;
+
+    /* A writer is rewriting the snapshot: use the heap path instead */
+    if (!ConditionalLockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock))
+        return NULL;
+
+    if (!biscuit_meta_read(index, &meta) ||
+        meta.snapshot_flags != BISCUIT_SNAPSHOT_LOCAL_FLAGS ||
+        meta.num_columns != (uint32) index->rd_index->indnatts ||
+        meta.root == InvalidBlockNumber ||
+        meta.snapshot_nblocks == 0)
+    {
+        UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+        return NULL;
+    }
+
+    /*
+     * A stale snapshot is still a starting point while the change log
+     * holds every entry since it was written: load it, or map its shared
+     * image as a delta view, and replay the log on top.
+     */
+    stale = (meta.snapshot_state != BISCUIT_SNAPSHOT_VALID);
+    if (stale && (shared_only || meta.snapshot_version < meta.log_base))
+    {
+        UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+        return NULL;
+    }
+
+    /* Map the shared image instead of building a private copy */
+    if (biscuit_shared_enabled())
+    {
+        idx = biscuit_shared_acquire(index, &meta);
+
+        /* Replayed inserts must go to the view's pending list */
+        if (idx && stale && !biscuit_pending_accepts(index, idx))
+        {
+            biscuit_shared_release(idx);
+            idx = NULL;
+        }
+        if (idx)
+        {
+            biscuit_changelog_attach_snapshot(index, idx, meta.snapshot_version, meta.log_base);
+            if (stale)
+                biscuit_shared_open_delta(idx);
+            if (stale && !biscuit_changelog_replay(index, idx, &meta))
+            {
+                /* A private load would not get further */
+                biscuit_shared_release(idx);
+                UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+                return NULL;
+            }
+        }
+        if (idx || shared_only)
+        {
+            UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+            return idx;
+        }
+    }
+
+    memset(&r, 0, sizeof(r));
+    r.index      = index;
+    r.strategy   = GetAccessStrategy(BAS_BULKREAD);
+    r.next_blkno = meta.root;
+    r.end_blkno  = meta.root + meta.snapshot_nblocks;
+    r.page       = (char *) palloc(BISCUIT_PAGE_PAYLOAD);
+
+    copy_context = biscuit_cache_new_context();
+    oldcontext   = MemoryContextSwitchTo(copy_context);
+    idx = biscuit_storage_read_index(&r, index);
+    MemoryContextSwitchTo(oldcontext);
+    idx->memory_context = copy_context;
+
+    if (r.total_bytes != meta.snapshot_bytes ||
+        r.next_blkno != r.end_blkno ||
+        r.off != r.len ||
+        (uint32) idx->num_records != meta.num_records)
+        biscuit_storage_corrupt(index, "snapshot length does not match the metapage");
+
+    FreeAccessStrategy(r.strategy);
+    pfree(r.page);
+
+    /* Only a copy of the VALID snapshot may own its epoch */
+    idx->storage_epoch = stale ? 0 : meta.snapshot_epoch;
+    biscuit_changelog_attach_snapshot(index, idx, meta.snapshot_version, meta.log_base);
+
+    if (stale && !biscuit_changelog_replay(index, idx, &meta))
+    {
+        UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+        biscuit_storage_free_view(idx);
+        return NULL;
+    }
+    UnlockPage(index, BISCUIT_METAPAGE_BLKNO, ShareLock);
+
+    elog(DEBUG1, "Biscuit: loaded %ssnapshot of index %u (%d records, %u blocks)",
+         stale ? "stale " : "", RelationGetRelid(index), idx->num_records,
+         meta.snapshot_nblocks);
+
+    return idx;
+}
+
+BiscuitIndex *
+biscuit_storage_load(Relation index)
+{
+    return biscuit_storage_load_internal(index, false);
+}
+
+bool
+biscuit_storage_prewarm_shared(Relation index)
+{
+    BiscuitIndex *idx = biscuit_storage_load_internal(index, true);
+
+    if (!idx)
+        return false;
+
+    /* The image stays published; this process does not need the view */
+    biscuit_shared_release(idx);
+    return true;
+}
+
+/*
+ * Copy the raw snapshot stream described by *meta into dst, which must
+ * hold meta->snapshot_bytes bytes.  The caller holds the metapage share
+ * lock taken by biscuit_storage_load().
+ */
+void
+biscuit_storage_read_stream(Relation index, const BiscuitMetaPageData *meta, char *dst)
+{
+    BiscuitStorageReader r;
+
+    memset(&r, 0, sizeof(r));
+    r.index      = index;
+    r.strategy   = GetAccessStrategy(BAS_BULKREAD);
+    r.next_blkno = meta->root;
+    r.end_blkno  = meta->root + meta->snapshot_nblocks;
+    r.page       = (char *) palloc(BISCUIT_PAGE_PAYLOAD);
+
+    biscuit_reader_get(&r, dst, meta->snapshot_bytes);
+
+    if (r.next_blkno != r.end_blkno || r.off != r.len)
+        biscuit_storage_corrupt(index, "snapshot length does not match the metapage");
+
+    FreeAccessStrategy(r.strategy);
+    pfree(r.page);
+}
+
+BiscuitIndex *
+biscuit_storage_decode(Relation index, const char *image, uint64 nbytes, bool zero_copy)
+{
+    BiscuitStorageReader r;
+    BiscuitIndex        *idx;
+
+    if (zero_copy && ((uintptr_t) image % BISCUIT_STREAM_ALIGN) != 0)
+        elog(ERROR, "Biscuit: shared image is not aligned");
+
+    memset(&r, 0, sizeof(r));
+    r.index      = index;
+    r.page       = (char *) image;
+    r.len        = nbytes;
+    r.zero_copy  = zero_copy;
+
+    idx = biscuit_storage_read_index(&r, index);
+
+    if (r.total_bytes != nbytes)
+        biscuit_storage_corrupt(index, "snapshot image has trailing bytes");
+
+    return idx;
+}
+
+/*
+ * Write idx to a temporary file in the snapshot stream format.  Used by
+ * parallel build workers, whose partial index is read back by the leader
+ * with biscuit_storage_read_file().
+ */
+void
+biscuit_storage_write_file(BiscuitIndex *idx, BufFile *file)
+{
+    BiscuitStorageWriter w;
+
+    memset(&w, 0, sizeof(w));
+    w.file  = file;
+    w.stage = (char *) palloc(BISCUIT_PAGE_PAYLOAD);
+
+    biscuit_storage_write_index(&w, idx);
+    biscuit_writer_flush(&w);
+
+    pfree(w.stage);
+}
+
+BiscuitIndex *
+biscuit_storage_read_file(Relation index, BufFile *file)
+{
+    BiscuitStorageReader r;
+    BiscuitIndex        *idx;
+
+    memset(&r, 0, sizeof(r));
+    r.index = index;
+    r.file  = file;
+    r.page  = (char *) palloc(BISCUIT_PAGE_PAYLOAD);
+
+    idx = biscuit_storage_read_index(&r, index);
+
+    if (r.off != r.len ||
+        BufFileReadMaybeEOF(file, r.page, 1, true) != 0)
+        biscuit_storage_corrupt(index, "partial index file has trailing bytes");
+
+    pfree(r.page);
+    return idx;
+}
+
+static void
+biscuit_charindex_free_views(CharIndex *ci)
+{
+    int i;
+
+    for (i = 0; i < ci->count; i++)
+        biscuit_roaring_view_free(ci->entries[i].bitmap);
+}
+
+static void
+biscuit_side_free_views(CharIndex *pos_idx, CharIndex *neg_idx,
+                        RoaringBitmap **char_cache,
+                        RoaringBitmap **length_bitmaps,
+                        RoaringBitmap **length_ge_bitmaps,
+                        int max_length)
+{
+    int ch;
+    int i;
+
+    for (ch = 0; ch < CHAR_RANGE; ch++)
+    {
+        biscuit_charindex_free_views(&pos_idx[ch]);
+        biscuit_charindex_free_views(&neg_idx[ch]);
+        if (char_cache[ch])
+            biscuit_roaring_view_free(char_cache[ch]);
+    }
+    for (i = 0; i < max_length; i++)
+    {
+        if (length_bitmaps[i])
+            biscuit_roaring_view_free(length_bitmaps[i]);
+        if (length_ge_bitmaps[i])
+            biscuit_roaring_view_free(length_ge_bitmaps[i]);
+    }
+}
+
+static void
+biscuit_trigram_free_views(CharIndex *tri)
+{
+    int b;
+
+    if (!tri)
+        return;
+    for (b = 0; b < BISCUIT_TRIGRAM_BUCKETS; b++)
+        biscuit_charindex_free_views(&tri[b]);
+}
+
+void
+biscuit_storage_free_view(BiscuitIndex *idx)
+{
+#ifdef HAVE_ROARING
+    int col;
+
+    /* CRoaring view headers are malloc'd; everything else is in memory_context */
+    if (idx->tombstones)
+        biscuit_roaring_view_free(idx->tombstones);
+    if (idx->pending)
+        biscuit_roaring_view_free(idx->pending);
+
+    if (idx->num_columns == 1)
+    {
+        biscuit_side_free_views(idx->pos_idx_legacy, idx->neg_idx_legacy,
+                                idx->char_cache_legacy,
+                                idx->length_bitmaps_legacy, idx->length_ge_bitmaps_legacy,
+                                idx->max_length_legacy);
+        biscuit_side_free_views(idx->pos_idx_lower, idx->neg_idx_lower,
+                                idx->char_cache_lower,
+                                idx->length_bitmaps_lower, idx->length_ge_bitmaps_lower,
+                                idx->max_length_lower);
+        biscuit_trigram_free_views(idx->trigrams_legacy);
+    }
+    else
+    {
+        for (col = 0; col < idx->num_columns; col++)
+        {
+            ColumnIndex *cidx = &idx->column_indices[col];
+
+            biscuit_side_free_views(cidx->pos_idx, cidx->neg_idx, cidx->char_cache,
+                                    cidx->length_bitmaps, cidx->length_ge_bitmaps,
+                                    cidx->max_length);
+            biscuit_side_free_views(cidx->pos_idx_lower, cidx->neg_idx_lower,
+                                    cidx->char_cache_lower,
+                                    cidx->length_bitmaps_lower, cidx->length_ge_bitmaps_lower,
+                                    cidx->max_length_lower);
+            biscuit_trigram_free_views(cidx->trigrams);
+        }
+    }
+#endif
+
+    MemoryContextDelete(idx->memory_context);
+}
+
+bool
+biscuit_storage_is_valid(Relation index)
+{
+    BiscuitMetaPageData meta;
+
+    return biscuit_meta_read(index, &meta) &&
+           meta.snapshot_state == BISCUIT_SNAPSHOT_VALID;
+}
+
+bool
+biscuit_storage_describe(Relation index, BiscuitMetaPageData *meta)
+{
+    return biscuit_meta_read(index, meta);
+}
+
+bool
+biscuit_storage_meta_from_page(Page page, BiscuitMetaPageData *meta)
+{
+    return biscuit_meta_from_page(page, meta);
+}
+
+bool
+biscuit_storage_meta_upgrade(Relation index, Page page, BiscuitMetaPageData *meta)
+{
+    if (biscuit_meta_from_page(page, meta))
+        return false;
+    biscuit_meta_init(index, meta);
+    return true;
+}
+
+void
+biscuit_storage_upgrade(Relation index)
+{
+    BiscuitMetaPageData meta;
+    Buffer              buf;
+
+    if (RecoveryInProgress() || RelationGetNumberOfBlocks(index) == 0)
+        return;
+
+    buf = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
+    LockBuffer(buf, BUFFER_LOCK_EXCLUSIVE);
+    if (biscuit_storage_meta_upgrade(index, BufferGetPage(buf), &meta))
+    {
+        biscuit_meta_write(index, buf, &meta, NULL);
+        elog(DEBUG1, "Biscuit: upgraded the metapage of index %u", RelationGetRelid(index));
+    }
+    UnlockReleaseBuffer(buf);
+}
+
+bool
+biscuit_storage_read_stats(Relation index, BiscuitStatsData *stats)
+{
+    Buffer               buf;
+    Page                 page;
+    BiscuitMetaPageData  meta;
+    BiscuitStatsData    *ps;
+    Size                 avail;
+    bool                 ok = false;
+
+    if (RelationGetNumberOfBlocks(index) == 0)
+        return false;
+
+    buf  = ReadBuffer(index, BISCUIT_METAPAGE_BLKNO);
+    LockBuffer(buf, BUFFER_LOCK_SHARE);
+    page = BufferGetPage(buf);
+
+    if (biscuit_meta_from_page(page, &meta) &&
+        ((PageHeader) page)->pd_lower >= MAXALIGN(SizeOfPageHeaderData))
+    {
+        avail = ((PageHeader) page)->pd_lower - MAXALIGN(SizeOfPageHeaderData);
+        ps    = (BiscuitStatsData *) BiscuitPageGetData(page);
+
+        if (avail >= BiscuitStatsSize(0) &&
+            ps->magic == BISCUIT_STATS_MAGIC &&
+            ps->ncolumns <= BISCUIT_STATS_MAX_COLUMNS &&
+            BiscuitStatsSize(ps->ncolumns) <= avail)
+        {
+            memcpy(stats, ps, BiscuitStatsSize(ps->ncolumns));
+            ok = true;
+        }
+    }
+    UnlockReleaseBuffer(buf);
+
+    return ok;
+}
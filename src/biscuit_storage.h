@@ -0,0 +1,113 @@
+/*
+ * biscuit_storage.h
+ * Persisted index snapshot: writes the complete in-memory BiscuitIndex
+ * to the index relation and loads it back without touching the heap.
+ *
+ * The metapage carries a small state machine (INVALID / VALID /
+ * BUILDING, plus an epoch) describing whether the data pages may be
+ * trusted.  See biscuit_storage.c for the protocol.
+ */
+
+#ifndef BISCUIT_STORAGE_H
+#define BISCUIT_STORAGE_H
+
+#include "biscuit_common.h"
+
+#include "storage/buffile.h"
+
+/*
+ * Claim a fresh snapshot epoch before building the index from the heap.
+ * Returns the epoch to store in idx->storage_epoch (0 during recovery).
+ */
+extern uint32        biscuit_storage_claim(Relation index);
+
+/*
+ * Must be called before idx is modified by aminsert / ambulkdelete.
+ * Demotes a VALID snapshot so cold loads do not miss the change.
+ */
+extern void          biscuit_storage_mark_dirty(Relation index, BiscuitIndex *idx);
+
+/*
+ * Write idx to the data pages and publish it as VALID, truncating the
+ * change log.  Only succeeds for the copy that owns the current BUILDING
+ * epoch or has replayed the whole log; returns false (leaving the
+ * metapage alone) otherwise.
+ */
+extern bool          biscuit_storage_persist(Relation index, BiscuitIndex *idx);
+
+/*
+ * Load a VALID snapshot: a read-only view of the shared image when
+ * biscuit.shared_index is on, otherwise a private copy in
+ * CacheMemoryContext.  A stale snapshot the change log still covers is
+ * loaded privately and caught up from the log.  Returns NULL when no
+ * usable snapshot exists, so the caller can fall back to the heap.
+ */
+extern BiscuitIndex *biscuit_storage_load(Relation index);
+
+extern bool          biscuit_storage_is_valid(Relation index);
+
+/*
+ * Publish a VALID snapshot to the shared image area without keeping a
+ * copy in this backend (used by the preload worker).
+ */
+extern bool          biscuit_storage_prewarm_shared(Relation index);
+
+/* ---- Building blocks for biscuit_shared.c ---- */
+
+/* Copy the raw stream (meta->snapshot_bytes bytes) into dst */
+extern void          biscuit_storage_read_stream(Relation index,
+                                                 const BiscuitMetaPageData *meta,
+                                                 char *dst);
+
+/*
+ * Decode an in-memory stream in CurrentMemoryContext.  With zero_copy the
+ * result points into image (which must be 8-byte aligned and stay mapped)
+ * and is read-only; otherwise it is an ordinary private copy.
+ */
+extern BiscuitIndex *biscuit_storage_decode(Relation index, const char *image,
+                                            uint64 nbytes, bool zero_copy);
+
+/*
+ * Write idx to / read it back from a temporary file in the stream format
+ * (parallel build hand-off, see biscuit_parallel_build.c).  The result of
+ * biscuit_storage_read_file() is a private copy in CurrentMemoryContext.
+ */
+extern void          biscuit_storage_write_file(BiscuitIndex *idx, BufFile *file);
+extern BiscuitIndex *biscuit_storage_read_file(Relation index, BufFile *file);
+
+/*
+ * Free an index whose memory all lives in idx->memory_context (a zero_copy
+ * view, a throwaway build or a cached copy), including idx itself.
+ */
+extern void          biscuit_storage_free_view(BiscuitIndex *idx);
+
+/* ---- Building blocks for biscuit_changelog.c ---- */
+
+/* Copy a current-version metapage into *meta (false for any other page) */
+extern bool          biscuit_storage_meta_from_page(Page page,
+                                                    BiscuitMetaPageData *meta);
+
+/*
+ * Like biscuit_storage_meta_from_page(), but a new page or an older
+ * metapage (an index built by an earlier release) yields a fresh
+ * current-version metapage in *meta.  Returns true in that case: the
+ * caller must write the whole page.
+ */
+extern bool          biscuit_storage_meta_upgrade(Relation index, Page page,
+                                                  BiscuitMetaPageData *meta);
+
+/* Write a current metapage over an older one (not during recovery) */
+extern void          biscuit_storage_upgrade(Relation index);
+
+/* Metapage snapshot summary for biscuit_index_stats() */
+extern bool          biscuit_storage_describe(Relation index,
+                                              BiscuitMetaPageData *meta);
+
+/*
+ * Planner statistics stored with the last persisted snapshot (see
+ * biscuit_stats.c).  Returns false if the metapage carries none.
+ */
+extern bool          biscuit_storage_read_stats(Relation index,
+                                                BiscuitStatsData *stats);
+
+#endif /* BISCUIT_STORAGE_H */
@@ -2,6 +2,10 @@
  * biscuit_tid.c
  * TID sorting (radix + qsort) and TID collection (single-threaded and parallel).
  *
+ * Copies whose records are numbered in heap order (BiscuitIndex.heap_ordered,
+ * the normal case after a build or a VACUUM) produce TIDs in heap order
+ * straight from the result bitmap, and the sort is skipped.
+ *
  * Parallel design
  * ───────────────
  * The AM parallel callbacks (aminitparallelscan / amparallelrescan /
@@ -14,31 +18,10 @@
  * the expected row count. That is exactly the duplicate-result / slowdown
  * bug observed in the EXPLAIN ANALYZE output.
  *
- * Fix: range-partition the pre-sorted TID array across workers using the
- * atomic chunk counter already present in BiscuitParallelScanDesc.
- *
- *   Leader path  (biscuit_collect_sorted_tids_parallel)
- *   ────────────────────────────────────────────────────
- *   1. Collect the full result set into a palloc'd array exactly once
- *      (same as the single-threaded path).
- *   2. Populate pdesc->total_tids, total_chunks, chunk_size.
- *   3. Claim chunk 0 for the leader itself via biscuit_claim_next_chunk(),
- *      then copy only that slice into a fresh palloc'd *out_tids / *out_count.
- *      (Independent copy so the caller can pfree it without corrupting all_tids.)
- *   4. Store the full sorted array pointer in pdesc->pad[] (the cache-line
- *      padding field inside BiscuitParallelScanDesc) via memcpy so background
- *      workers can retrieve it with a matching memcpy + pg_memory_barrier().
- *      The array lives in the leader's palloc context (so->all_tids in
- *      BiscuitScanOpaque) for the duration of the scan.
- *
- *   Worker path  (biscuit_parallel_collect_chunk)
- *   ──────────────────────────────────────────────
- *   Each background worker detects IsParallelWorker() in biscuit_rescan(),
- *   reads the all_tids pointer from pdesc->pad[], then calls
- *   biscuit_parallel_collect_chunk() which atomically claims a disjoint
- *   [chunk_start, chunk_end) range and copies only those TIDs into a
- *   process-private buffer.  Workers never write shared state except through
- *   the atomic counter.
+ * Fix: one participant evaluates the query and publishes the result
+ * bitmap (in a DSM segment when it is the leader); every participant
+ * then converts only its own rank range of it to TIDs.  See PARALLEL
+ * COLLECTION below.
  *
  * Other changes from previous revision
  * ──────────────────────────────────────
@@ -52,6 +35,8 @@
 #include "biscuit_common.h"
 #include "biscuit_bitmap.h"
 #include "biscuit_tid.h"
+#include "biscuit_cache.h"
+#include "biscuit_storage.h"
 
 /* Number of slots to prefetch ahead in the TID-copy hot loop. */
 #define PREFETCH_DISTANCE 16
@@ -59,6 +44,7 @@
 /* ==================== COMPARISON ==================== */
 
 static int biscuit_planned_nworkers = 0;
+static Size biscuit_planned_result_space = 0;
 
 static inline int
 biscuit_compare_tids(const void *a, const void *b)
@@ -85,7 +71,7 @@ biscuit_radix_sort_tids(ItemPointerData *tids, int count)
 
     PG_TRY();
     {
-        temp = (ItemPointerData *) palloc(count * sizeof(ItemPointerData));
+        temp = (ItemPointerData *) biscuit_palloc_huge((Size) count * sizeof(ItemPointerData));
 
         /* Phase 1: sort all 32 bits of BlockNumber in 4 × 8-bit passes */
         src = tids;
@@ -209,6 +195,17 @@ biscuit_sort_tids_by_block(ItemPointerData *tids, int count)
         biscuit_radix_sort_tids(tids, count);
 }
 
+bool
+biscuit_tids_in_heap_order(const ItemPointerData *tids, int count)
+{
+    int i;
+
+    for (i = 1; i < count; i++)
+        if (ItemPointerCompare((ItemPointer) &tids[i - 1], (ItemPointer) &tids[i]) > 0)
+            return false;
+    return true;
+}
+
 /* ==================== SINGLE-THREADED COLLECTION ==================== */
 
 void
@@ -216,14 +213,21 @@ biscuit_collect_sorted_tids_single(BiscuitIndex *idx,
                                    RoaringBitmap *result,
                                    ItemPointerData **out_tids,
                                    int *out_count,
-                                   bool needs_sorting)
+                                   bool needs_sorting,
+                                   uint32_t **out_recs)
 {
     uint64_t         count;
     ItemPointerData *tids;
+    uint32_t        *recs = NULL;
     int              idx_out = 0;
 
+    Assert(!(needs_sorting && out_recs));
+
     count = biscuit_roaring_count(result);
 
+    if (out_recs)
+        *out_recs = NULL;
+
     if (count == 0)
     {
         *out_tids  = NULL;
@@ -231,9 +235,11 @@ biscuit_collect_sorted_tids_single(BiscuitIndex *idx,
         return;
     }
 
-    Assert(count <= (uint64_t) INT_MAX);
+    Assert(count <= (uint64_t) BISCUIT_MAX_RECORDS);
 
-    tids = (ItemPointerData *) palloc(count * sizeof(ItemPointerData));
+    tids = (ItemPointerData *) biscuit_palloc_huge(count * sizeof(ItemPointerData));
+    if (out_recs)
+        recs = (uint32_t *) biscuit_palloc_huge(count * sizeof(uint32_t));
 
 #ifdef HAVE_ROARING
     {
@@ -261,6 +267,8 @@ biscuit_collect_sorted_tids_single(BiscuitIndex *idx,
             if (rec_idx < (uint32_t) idx->num_records)
             {
                 ItemPointerCopy(&idx->tids[rec_idx], &tids[idx_out]);
+                if (recs)
+                    recs[idx_out] = rec_idx;
                 idx_out++;
             }
             roaring_uint32_iterator_advance(iter);
@@ -279,6 +287,8 @@ biscuit_collect_sorted_tids_single(BiscuitIndex *idx,
                 if (indices[i] < (uint32_t) idx->num_records)
                 {
                     ItemPointerCopy(&idx->tids[indices[i]], &tids[idx_out]);
+                    if (recs)
+                        recs[idx_out] = indices[i];
                     idx_out++;
                 }
             }
@@ -293,226 +303,328 @@ biscuit_collect_sorted_tids_single(BiscuitIndex *idx,
         biscuit_sort_tids_by_block(tids, idx_out);
 
     *out_tids = tids;
+    if (out_recs)
+        *out_recs = recs;
 }
 
-/* ==================== PARALLEL COLLECTION ==================== */
+/* ==================== STREAMING COLLECTION ==================== */
 
 /*
- * biscuit_collect_sorted_tids_parallel
- *
- * Called by every participant (leader and background workers) from
- * biscuit_rescan() when scan->parallel_scan != NULL.
- *
- * Design: pre-partition, self-identify, local evaluate
- * -----------------------------------------------------
- * The first participant to arrive (CAS initialized 0→1) evaluates the bitmap,
- * computes the total TID count, divides it into num_participants slices, writes
- * [start,end) into pdesc->slots[], then sets initialized=2.  All others spin.
- *
- * Then every participant reads MyParallelWorkerNumber to find its slot:
- *   leader (-1) → slot 0
- *   worker  N   → slot N+1
- *
- * Each participant evaluates the bitmap locally (identical result — same index,
- * same query, read-only), keeps only tids[start..end), frees the rest.
+ * Cursor over a result bitmap that yields TIDs on demand, so a scan that
+ * stops early (LIMIT, EXISTS, a failed join probe) never converts or
+ * stores the rest of the matches.  Record indices come out in ascending
+ * order, which is heap order while idx->heap_ordered holds.
  *
- * No per-TID atomics.  No chunk claiming races.  The Gather node assembles
- * exactly one copy of the full result from the disjoint per-process slices.
+ * A parallel stream (pdesc set) walks the same bitmap as every other
+ * participant's, but only the chunks of BISCUIT_PARALLEL_CHUNK ranks it
+ * claims from pdesc->next_rank.  Claims only grow, so the cursor only
+ * moves forward.
  */
-void
-biscuit_collect_sorted_tids_parallel(BiscuitIndex            *idx,
-                                      RoaringBitmap           *result,
-                                      BiscuitParallelScanDesc *pdesc,
-                                      ItemPointerData        **out_tids,
-                                      int                     *out_count,
-                                      bool                     needs_sorting)
+struct BiscuitTidStream
 {
-    *out_tids  = NULL;
-    *out_count = 0;
-    /* Non-parallel fallback. */
-    if (pdesc == NULL)
+    RoaringBitmap             *result;      /* owned, unless result_is_view */
+    bool                       result_is_view;
+    BiscuitParallelScanDesc   *pdesc;       /* rank chunks come from here   */
+    uint64_t                   rank;        /* rank of the next record      */
+    uint64_t                   chunk_end;   /* one past the claimed chunk   */
+    uint32_t                  *recbuf;      /* record indices for one batch */
+    int                        recbuf_len;
+#ifdef HAVE_ROARING
+    roaring_uint32_iterator_t *iter;
+#else
+    int                        next_value;  /* next of result->values, while sparse */
+    int                        next_block;  /* next word of result->blocks */
+    uint64_t                   word;        /* unconsumed bits of the current word */
+#endif
+};
+
+BiscuitTidStream *
+biscuit_tid_stream_begin(RoaringBitmap *result)
+{
+    BiscuitTidStream *stream = (BiscuitTidStream *) palloc0(sizeof(BiscuitTidStream));
+
+    stream->result = result;
+#ifdef HAVE_ROARING
+    stream->iter = roaring_iterator_create(result);
+#endif
+    return stream;
+}
+
+BiscuitTidStream *
+biscuit_tid_stream_begin_parallel(RoaringBitmap *result, bool view,
+                                  BiscuitParallelScanDesc *pdesc)
+{
+    BiscuitTidStream *stream = biscuit_tid_stream_begin(result);
+
+    stream->result_is_view = view;
+    stream->pdesc          = pdesc;
+    return stream;
+}
+
+/* The next up to max record indices, in order */
+static uint32_t
+biscuit_tid_stream_read(BiscuitTidStream *stream, uint32_t *buf, uint32_t max)
+{
+    uint32_t got = 0;
+
+#ifdef HAVE_ROARING
+    got = roaring_uint32_iterator_read(stream->iter, buf, max);
+#else
+    if (!stream->result->blocks)
     {
-        biscuit_collect_sorted_tids_single(idx, result, out_tids, out_count,
-                                           needs_sorting);
-        return;
+        while (got < max && stream->next_value < stream->result->num_values)
+            buf[got++] = stream->result->values[stream->next_value++];
     }
-    elog(DEBUG1,
-         "biscuit parallel: pid=%d ParallelWorkerNumber=%d "
-         "num_participants=%d initialized=%u",
-         (int) MyProcPid,
-         ParallelWorkerNumber,
-         pdesc->num_participants,
-         pg_atomic_read_u32(&pdesc->initialized));
-    /* ---------------------------------------------------------------
-     * Phase 1: elect one initializer to build the partition table.
-     *
-     * initialized states:
-     *   0 – nobody has started   (set by initparallelscan / parallelrescan)
-     *   1 – one process is computing (holds the "lock")
-     *   2 – partition table is ready; everyone may proceed
-     * --------------------------------------------------------------- */
+    else
     {
-        uint32 zero = 0;
-        bool   won  = pg_atomic_compare_exchange_u32(&pdesc->initialized,
-                                                      &zero, 1);
-        if (won)
+        while (got < max)
         {
-            /*
-             * We are the initializer.  Evaluate the bitmap to get total_tids,
-             * then divide into num_participants slices.
-             */
-            ItemPointerData *all_tids  = NULL;
-            int              all_count = 0;
-            int              np        = pdesc->num_participants;
-            int              i;
+            int bit;
 
-            biscuit_collect_sorted_tids_single(idx, result,
-                                               &all_tids, &all_count,
-                                               needs_sorting);
+            while (stream->word == 0 && stream->next_block < stream->result->num_blocks)
+                stream->word = stream->result->blocks[stream->next_block++];
+            if (stream->word == 0)
+                break;
 
-            pdesc->total_tids = (uint64_t) all_count;
+            bit = __builtin_ctzll(stream->word);
+            stream->word &= stream->word - 1;
+            buf[got++] = ((uint32_t) (stream->next_block - 1) << 6) | (uint32_t) bit;
+        }
+    }
+#endif
 
-            if (all_count > 0 && np > 0)
-            {
-                /*
-                 * Divide total_tids into np roughly-equal slices.
-                 * base_size = floor(all_count / np)
-                 * remainder = all_count % np   (distributed to last slot)
-                 *
-                 * We give the last slot whatever is left so uneven divisions
-                 * never lose or duplicate TIDs.
-                 */
-                uint64_t base_size = (uint64_t) all_count / (uint64_t) np;
-                uint64_t cursor    = 0;
-
-                for (i = 0; i < np; i++)
-                {
-                    pdesc->slots[i].start = cursor;
-                    if (i < np - 1)
-                        cursor += base_size;
-                    else
-                        cursor  = (uint64_t) all_count; /* last gets remainder */
-                    pdesc->slots[i].end = cursor;
-                }
-            }
-            else
+    stream->rank += got;
+    return got;
+}
+
+/* Move the cursor forward to the record of rank target */
+static void
+biscuit_tid_stream_seek(BiscuitTidStream *stream, uint64_t target)
+{
+#ifdef HAVE_ROARING
+    uint32_t first;
+
+    if (roaring_bitmap_select(stream->result, (uint32_t) target, &first))
+        roaring_uint32_iterator_move_equalorlarger(stream->iter, first);
+    else
+        while (stream->iter->has_value)
+            roaring_uint32_iterator_advance(stream->iter);
+    stream->rank = target;
+#else
+    uint64_t skip = target - stream->rank;
+
+    Assert(target >= stream->rank);
+
+    if (!stream->result->blocks)
+    {
+        stream->next_value = (int) Min(target, (uint64_t) stream->result->num_values);
+        stream->rank = target;
+        return;
+    }
+
+    /* Whole words go by popcount, then the bits below rank target */
+    for (;;)
+    {
+        uint64_t bits = (uint64_t) __builtin_popcountll(stream->word);
+
+        if (bits > skip)
+            break;
+        skip -= bits;
+        stream->word = 0;
+        if (stream->next_block >= stream->result->num_blocks)
+            break;
+        stream->word = stream->result->blocks[stream->next_block++];
+    }
+    while (skip-- > 0 && stream->word)
+        stream->word &= stream->word - 1;
+    stream->rank = target;
+#endif
+}
+
+int
+biscuit_tid_stream_next(BiscuitTidStream *stream, BiscuitIndex *idx,
+                        ItemPointerData *out, uint32_t *out_recs, int max)
+{
+    int n = 0;
+
+    if (stream->recbuf_len < max)
+    {
+        if (stream->recbuf)
+            pfree(stream->recbuf);
+        stream->recbuf     = (uint32_t *) palloc(max * sizeof(uint32_t));
+        stream->recbuf_len = max;
+    }
+
+    /* Loop only to skip record indices past num_records */
+    while (n == 0)
+    {
+        uint32_t want = (uint32_t) max;
+        uint32_t got;
+        uint32_t i;
+
+        if (stream->pdesc)
+        {
+            if (stream->rank >= stream->chunk_end)
             {
-                /* Empty result or no participants: zero all slots. */
-                for (i = 0; i < BISCUIT_MAX_PARALLEL_WORKERS + 1; i++)
-                    pdesc->slots[i].start = pdesc->slots[i].end = 0;
+                uint64_t start = pg_atomic_fetch_add_u64(&stream->pdesc->next_rank,
+                                                         BISCUIT_PARALLEL_CHUNK);
+
+                if (start >= stream->pdesc->total_tids)
+                    break;
+                biscuit_tid_stream_seek(stream, start);
+                stream->chunk_end = Min(start + BISCUIT_PARALLEL_CHUNK,
+                                        stream->pdesc->total_tids);
             }
+            want = (uint32_t) Min((uint64_t) want, stream->chunk_end - stream->rank);
+        }
 
-            /*
-             * Full barrier: slot writes must be visible to all processes
-             * before initialized is set to 2.
-             */
-            pg_memory_barrier();
-            pg_atomic_write_u32(&pdesc->initialized, 2);
+        got = biscuit_tid_stream_read(stream, stream->recbuf, want);
+        if (got == 0)
+            break;
 
-            /* Free the full array — we'll re-evaluate per-process below. */
-            if (all_tids)
-                pfree(all_tids);
-        }
-        else
+        for (i = 0; i < got; i++)
         {
-            /*
-             * Loser: spin until the initializer sets initialized = 2.
-             * Use a 1 µs sleep to avoid burning a core; CHECK_FOR_INTERRUPTS
-             * so the backend remains cancellable during the wait.
-             */
-            while (pg_atomic_read_u32(&pdesc->initialized) != 2)
+            uint32_t rec_idx = stream->recbuf[i];
+
+            if (i + PREFETCH_DISTANCE < got &&
+                stream->recbuf[i + PREFETCH_DISTANCE] < (uint32_t) idx->num_records)
+                __builtin_prefetch(&idx->tids[stream->recbuf[i + PREFETCH_DISTANCE]], 0, 1);
+
+            if (rec_idx < (uint32_t) idx->num_records)
             {
-                CHECK_FOR_INTERRUPTS();
-                pg_usleep(1);
+                if (out_recs)
+                    out_recs[n] = rec_idx;
+                ItemPointerCopy(&idx->tids[rec_idx], &out[n++]);
             }
-            pg_memory_barrier();    /* ensure slot reads see the initializer's writes */
         }
     }
 
-    /* ---------------------------------------------------------------
-     * Phase 2: every participant reads its own pre-computed slot.
-     *
-     * MyParallelWorkerNumber:
-     *   -1 → leader  → slot 0
-     *    N → worker N → slot N+1
-     * --------------------------------------------------------------- */
-    {
-        int      slot_idx;
-        uint64_t my_start;
-        uint64_t my_end;
-        int      my_count;
+    return n;
+}
 
-        slot_idx = ParallelWorkerNumber + 1;   /* leader: -1+1=0, worker N: N+1 */
+void
+biscuit_tid_stream_end(BiscuitTidStream *stream)
+{
+    if (!stream)
+        return;
+#ifdef HAVE_ROARING
+    roaring_uint32_iterator_free(stream->iter);
+#endif
+    if (stream->recbuf)
+        pfree(stream->recbuf);
+    if (stream->result_is_view)
+        biscuit_roaring_view_free(stream->result);
+    else
+        biscuit_roaring_free(stream->result);
+    pfree(stream);
+}
 
-        /* Clamp defensively — should never fire under normal operation. */
-        if (slot_idx < 0 || slot_idx >= pdesc->num_participants)
-        {
-            elog(WARNING,
-                 "biscuit: parallel slot index %d out of range [0,%d); "
-                 "returning empty result",
-                 slot_idx, pdesc->num_participants);
-            return;
-        }
+/* ==================== PARALLEL COLLECTION ==================== */
 
-        my_start = pdesc->slots[slot_idx].start;
-        my_end   = pdesc->slots[slot_idx].end;
-        my_count = (int) (my_end - my_start);
+/*
+ * Evaluate once, publish, hand out chunks
+ * ---------------------------------------
+ * Every participant used to evaluate the whole query, collect and sort
+ * every TID, and keep only its own slice: N participants paid N times
+ * the query for one result.  Now only the first participant to arrive
+ * evaluates it:
+ *
+ *   biscuit_parallel_claim()    CAS initialized 0 → 1; the winner runs
+ *                               the query, everyone else waits.
+ *   biscuit_parallel_publish()  the winner serializes the bitmap into
+ *                               the space behind the descriptor, then
+ *                               sets initialized = 2.
+ *   biscuit_parallel_wait()     the others view that bitmap in place.
+ *   parallel streams            every participant claims chunks of
+ *                               BISCUIT_PARALLEL_CHUNK ranks from the
+ *                               next_rank counter until the result runs
+ *                               out, and converts only those records.
+ *
+ * A participant that is slow to start, or never starts (fewer workers
+ * launched than planned, parallel_leader_participation = off), simply
+ * claims fewer chunks: nothing is assigned to anyone in advance.
+ *
+ * The result lives in the query's DSM segment, which the leader keeps
+ * until the executor shuts the whole parallel context down, so whichever
+ * participant won, leader or worker, can share it.  The space is sized
+ * when the leader estimates the descriptor (biscuit_parallel_result_space).
+ * A shared bitmap names records, so it is only used by a participant
+ * whose copy of the index has the same record_epoch and record count.
+ * When the result did not fit, the winner returns all of it and the
+ * others return nothing.
+ */
 
-        if (my_count <= 0 || pdesc->total_tids == 0)
-            return;   /* empty result or nothing assigned to this participant */
+bool
+biscuit_parallel_claim(BiscuitParallelScanDesc *pdesc)
+{
+    uint32 zero = 0;
 
-        /* ---------------------------------------------------------------
-         * Phase 3: evaluate the bitmap locally and return only our slice.
-         *
-         * Every process produces an identical sorted TID array (same index,
-         * same query, fully read-only).  We keep only [my_start, my_end)
-         * and immediately free the rest to avoid peak memory N× total_tids.
-         * --------------------------------------------------------------- */
-        {
-            ItemPointerData *all_tids  = NULL;
-            int              all_count = 0;
-            ItemPointerData *slice;
+    return pg_atomic_compare_exchange_u32(&pdesc->initialized, &zero, 1);
+}
 
-            biscuit_collect_sorted_tids_single(idx, result,
-                                               &all_tids, &all_count,
-                                               needs_sorting);
+bool
+biscuit_parallel_publish(BiscuitParallelScanDesc *pdesc, const BiscuitIndex *idx,
+                         const RoaringBitmap *result, bool recheck)
+{
+    uint64_t total = biscuit_roaring_count(result);
 
-            if (all_count == 0 || all_tids == NULL)
-                return;
+    pdesc->total_tids   = total;
+    pdesc->result_bytes = 0;
+    pg_atomic_write_u64(&pdesc->next_rank, 0);
 
-            /*
-             * Sanity: if the bitmap count differs from what the initializer
-             * saw, something changed between evaluations.  Clamp to avoid
-             * an out-of-bounds read; log a warning so the operator knows.
-             */
-            if ((uint64_t) all_count != pdesc->total_tids)
-            {
-                elog(WARNING,
-                     "biscuit: parallel TID count mismatch: expected %llu, "
-                     "got %d; clamping slice",
-                     (unsigned long long) pdesc->total_tids, all_count);
-                if (my_end > (uint64_t) all_count)
-                    my_end = (uint64_t) all_count;
-                if (my_start >= my_end)
-                {
-                    pfree(all_tids);
-                    return;
-                }
-                my_count = (int) (my_end - my_start);
-            }
+    if (total > 0 && idx && idx->record_epoch != 0)
+    {
+        size_t bytes = biscuit_roaring_serialized_size(result);
+
+        if (bytes <= pdesc->result_space)
+        {
+            biscuit_roaring_serialize(result, BiscuitParallelResult(pdesc));
+            pdesc->result_bytes   = bytes;
+            pdesc->result_epoch   = idx->record_epoch;
+            pdesc->result_records = idx->num_records;
+            pdesc->result_recheck = recheck;
+        }
+        else
+            elog(DEBUG1, "biscuit parallel: result of %zu bytes exceeds the %llu reserved",
+                 bytes, (unsigned long long) pdesc->result_space);
+    }
 
-            /* Copy the assigned slice into a fresh palloc buffer. */
-            slice = (ItemPointerData *)
-                        palloc(my_count * sizeof(ItemPointerData));
-            memcpy(slice, &all_tids[my_start],
-                   my_count * sizeof(ItemPointerData));
+    elog(DEBUG1, "biscuit parallel: published %llu records%s",
+         (unsigned long long) total, pdesc->result_bytes > 0 ? " (shared)" : "");
 
-            pfree(all_tids);    /* free the full local array immediately */
+    /* Result writes must be visible before initialized = 2 */
+    pg_memory_barrier();
+    pg_atomic_write_u32(&pdesc->initialized, 2);
 
-            *out_tids  = slice;
-            *out_count = my_count;
-        }
+    return pdesc->result_bytes > 0;
+}
+
+RoaringBitmap *
+biscuit_parallel_wait(BiscuitParallelScanDesc *pdesc, const BiscuitIndex *idx,
+                      bool *recheck)
+{
+    RoaringBitmap *view;
+
+    /* 1 µs sleeps so we do not burn a core; still cancellable */
+    while (pg_atomic_read_u32(&pdesc->initialized) != 2)
+    {
+        CHECK_FOR_INTERRUPTS();
+        pg_usleep(1);
     }
+    pg_memory_barrier();
+
+    if (pdesc->result_bytes == 0 || !idx ||
+        idx->record_epoch == 0 ||
+        pdesc->result_epoch != idx->record_epoch ||
+        pdesc->result_records != idx->num_records)
+        return NULL;
+
+    view = biscuit_roaring_view(BiscuitParallelResult(pdesc), pdesc->result_bytes);
+    if (!view)
+        return NULL;
+
+    *recheck = pdesc->result_recheck;
+    return view;
 }
 
 /* ==================== PARALLEL WORKER ENTRY POINT ==================== */
@@ -564,11 +676,59 @@ biscuit_is_aggregate_query(IndexScanDesc scan)
 
 /* ==================== PARALLEL AM CALLBACKS ==================== */
 
+/*
+ * Room for the result bitmap behind the descriptor.  The result can only
+ * name records the participants' copies hold, so it is bounded by the
+ * largest record count in sight now (the cached copy, the snapshot on the
+ * metapage, the planner's tuple count), with headroom for rows inserted
+ * before the participants load theirs.  A result that still does not fit
+ * is returned by the winner alone (biscuit_parallel_publish).
+ */
+static Size
+biscuit_parallel_result_space(Relation index)
+{
+    BiscuitIndex        *idx = biscuit_cache_lookup(RelationGetRelid(index));
+    BiscuitMetaPageData  meta;
+    uint64               records = 0;
+    size_t               bound;
+
+    if (idx)
+        records = (uint64) idx->num_records;
+    if (biscuit_storage_describe(index, &meta))
+        records = Max(records, (uint64) meta.num_records);
+    if (index->rd_rel->reltuples > 0)
+        records = Max(records, (uint64) index->rd_rel->reltuples);
+    if (records == 0)
+        return 0;
+
+    records += records / 8 + 1024;
+    bound    = biscuit_roaring_serialized_bound(records);
+    return MAXALIGN(Min(bound, BISCUIT_PARALLEL_RESULT_MAX));
+}
+
+/*
+ * Before PG18 the estimate callback is not told which index it is for,
+ * so the space is sized when a parallel path over the index is costed,
+ * which the same backend does before it estimates the descriptor.  Only
+ * the largest size seen is kept: whatever index the estimate turns out
+ * to be for, the reservation is never smaller than its own.
+ */
+void
+biscuit_parallel_note_path(Relation index)
+{
+#if PG_VERSION_NUM < 180000
+    biscuit_planned_result_space = Max(biscuit_planned_result_space,
+                                       biscuit_parallel_result_space(index));
+#else
+    (void) index;
+#endif
+}
+
 /*
  * biscuit_estimateparallelscan
  *
- * Returns sizeof(BiscuitParallelScanDesc) so the executor reserves exactly
- * the right amount of DSM space.
+ * Returns the size of BiscuitParallelScanDesc and the result space behind
+ * it, which initparallelscan (called next, in the same process) records.
  *
  * The amestimateparallelscan_function typedef has changed signature across
  * major PostgreSQL versions:
@@ -577,23 +737,19 @@ biscuit_is_aggregate_query(IndexScanDesc scan)
  *   PG17              : Size (*)(int nkeys, int norderbys)
  *   PG18  and later   : Size (*)(Relation indexRelation, int nworkers, int nchunks)
  *
- * On PG17 the parameters carry operator-class metadata (not a worker count),
- * so biscuit_planned_nworkers is left at 0 on that version.
- * On PG16 and earlier there are no parameters at all; same treatment.
- * On PG18+ nworkers is available and is stashed for initparallelscan.
- *
- * In all cases where nworkers is unavailable, biscuit_initparallelscan sets
- * num_participants = 1 (leader only), and the scan degrades gracefully to
- * the single-process path.
+ * On PG18+ the index is at hand and the space is sized for it exactly;
+ * before that the size noted by biscuit_parallel_note_path() is used.
+ * nworkers is only known on PG18+ and is kept for logging: participants
+ * claim their work dynamically and need no count.
  */
 #if PG_VERSION_NUM >= 180000
 Size
 biscuit_estimateparallelscan(Relation indexRelation, int nworkers, int nchunks)
 {
-    (void) indexRelation;
     (void) nchunks;
-    biscuit_planned_nworkers = nworkers;
-    return sizeof(BiscuitParallelScanDesc);
+    biscuit_planned_nworkers     = nworkers;
+    biscuit_planned_result_space = biscuit_parallel_result_space(indexRelation);
+    return add_size(BISCUIT_PARALLEL_DESC_SIZE, biscuit_planned_result_space);
 }
 #elif PG_VERSION_NUM >= 170000
 Size
@@ -602,68 +758,51 @@ biscuit_estimateparallelscan(int nkeys, int norderbys)
     (void) nkeys;
     (void) norderbys;
     biscuit_planned_nworkers = 0;
-    return sizeof(BiscuitParallelScanDesc);
+    return add_size(BISCUIT_PARALLEL_DESC_SIZE, biscuit_planned_result_space);
 }
 #else
 Size
 biscuit_estimateparallelscan(void)
 {
     biscuit_planned_nworkers = 0;
-    return sizeof(BiscuitParallelScanDesc);
+    return add_size(BISCUIT_PARALLEL_DESC_SIZE, biscuit_planned_result_space);
 }
 #endif
 
 /*
  * biscuit_initparallelscan
  *
- * Called once by the leader after the DSM segment is allocated.
- * Zeroes the descriptor, records num_participants, and sets initialized = 0
- * so the first rescan triggers partition computation.
- *
- * num_participants is inferred as the number of active workers + 1 (leader).
- * PostgreSQL does not pass nworkers here, so we derive it from
- * ParallelWorkerNumber which the leader can read as 0 workers launched
- * at this point (still during init).  Instead we store 0 and let
- * biscuit_collect_sorted_tids_parallel() populate it from
- * pdesc->num_participants.
- *
- * NOTE: nworkers is NOT available in this callback.  We therefore set
- * num_participants to 0 here and resolve it lazily at the first
- * biscuit_collect_sorted_tids_parallel() call using
- * scan->parallel_scan->ps_nworkers + 1.  biscuit_rescan() passes this
- * through the pdesc pointer which it derives from scan->parallel_scan.
- * The caller in biscuit_scan.c sets pdesc->num_participants after this
- * function returns.
+ * Called once by the leader after the DSM segment is allocated, right
+ * after biscuit_estimateparallelscan() in the same process.  Zeroes the
+ * descriptor, records the result space reserved behind it, and sets
+ * initialized = 0 so the first rescan elects the participant that
+ * evaluates the query.
  */
 void
 biscuit_initparallelscan(void *target)
 {
     BiscuitParallelScanDesc *pdesc = (BiscuitParallelScanDesc *) target;
+
     memset(pdesc, 0, sizeof(BiscuitParallelScanDesc));
     pg_atomic_init_u32(&pdesc->initialized, 0);
+    pg_atomic_init_u64(&pdesc->next_rank, 0);
 
-    /*
-     * nworkers is unavailable here directly, but estimateparallelscan
-     * was called in the same process immediately before this.
-     * +1 for the leader.
-     */
-    elog(DEBUG1, "Default pdesc->num_participants value: %d", pdesc->num_participants);
     pdesc->num_participants = biscuit_planned_nworkers + 1;
-    // biscuit_planned_nworkers = 0;   /* reset defensively */
-    elog(DEBUG1, "Initiated parallel scan. Parallel workers: %d",pdesc->num_participants);
+    pdesc->result_space     = biscuit_planned_result_space;
+    elog(DEBUG1, "biscuit parallel: descriptor with %llu bytes of result space, %d planned participants",
+         (unsigned long long) pdesc->result_space, pdesc->num_participants);
 }
 
 /*
  * biscuit_parallelrescan
  *
- * Resets the descriptor for a fresh scan (e.g. Materialize node rewind).
- * Clears initialized and all slots so the next rescan re-partitions.
+ * Resets the descriptor for a fresh scan (e.g. Materialize node rewind),
+ * so the next rescan evaluates and hands out the result again.
  */
 void
 biscuit_parallelrescan(IndexScanDesc scan)
 {
     BiscuitParallelScanDesc *pdesc;
-    int                      i;
 
     if (scan->parallel_scan == NULL)
         return;
@@ -672,10 +811,9 @@ biscuit_parallelrescan(IndexScanDesc scan)
                 OffsetToPointer(scan->parallel_scan,
                                 BISCUIT_PARALLEL_AM_OFFSET(scan->parallel_scan));
 
-    /* Clear all slots and reset the initialized flag to 0. */
-    pdesc->total_tids = 0;
-    for (i = 0; i < BISCUIT_MAX_PARALLEL_WORKERS + 1; i++)
-        pdesc->slots[i].start = pdesc->slots[i].end = 0;
+    pdesc->total_tids   = 0;
+    pdesc->result_bytes = 0;
+    pg_atomic_write_u64(&pdesc->next_rank, 0);
 
     pg_memory_barrier();
     pg_atomic_write_u32(&pdesc->initialized, 0);
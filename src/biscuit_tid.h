@@ -10,11 +10,10 @@
  *   BiscuitParallelScanDesc  – shared-memory descriptor placed in the
  *                              parallel query DSM segment by aminitparallelscan.
  *   biscuit_estimateparallelscan() – reports its size to the executor.
- *   biscuit_initparallelscan()     – initialises the atomic chunk counter.
- *   biscuit_parallelrescan()       – resets the counter for a new scan.
- *   biscuit_claim_next_chunk()     – atomically claims the next chunk slot.
- *   biscuit_parallel_collect_chunk() – worker loop; writes only into a
- *                                      worker-local palloc'd buffer.
+ *   biscuit_initparallelscan()     – initialises the claim and the rank counter.
+ *   biscuit_parallelrescan()       – resets them for a new scan.
+ *   biscuit_tid_stream_begin_parallel() – a stream over the rank chunks
+ *                                         this participant claims.
  */
 
 #ifndef BISCUIT_TID_H
@@ -28,141 +27,147 @@
 /*
  * BiscuitParallelScanDesc
  *
- * Lives in the parallel query DSM segment.  Carries the pre-computed
- * per-participant TID partition table so each worker can self-identify and
- * read its own disjoint [start, end) range without any runtime coordination.
+ * Lives in the parallel query DSM segment.  Carries the counter the
+ * participants claim rank chunks from and, right behind it, room for the
+ * result bitmap itself (result_space bytes, sized by
+ * biscuit_estimateparallelscan).
  *
- * Parallel design — pre-partition, self-identify, local evaluate
- * --------------------------------------------------------------
+ * Parallel design — evaluate once, publish, hand out chunks
+ * ---------------------------------------------------------
  * PostgreSQL parallel workers are separate OS processes with disjoint virtual
- * address spaces.  Only memory inside this DSM struct is shared.
- *
- * Key observations that drive the design:
- *
- *   A. The bitmap is read-only and deterministic: every process that evaluates
- *      it against the same index with the same query produces an identical
- *      sorted TID array.  So every participant can evaluate locally — no need
- *      to ship the TID array across process boundaries.
- *
- *   B. MyParallelWorkerNumber is a process-local int set by PostgreSQL before
- *      the first AM callback fires.  The leader has value -1; workers have
- *      0, 1, 2, … in launch order.  This gives each participant a stable,
- *      unique identity.
- *
- *   C. The executor tells us the worker count at estimateparallelscan /
- *      initparallelscan time, before any bitmap evaluation.
- *
- * Putting it together:
- *
- *   Init (biscuit_initparallelscan):
- *     • Record num_participants = 1 (leader) + nworkers.
- *     • Set initialized = 0.  All slot [start,end) pairs remain 0.
+ * address spaces.  Only memory inside the query's DSM segment is shared,
+ * so the result is serialized into the space reserved for it there.  That
+ * segment outlives every participant's scan, so it does not matter which
+ * one wrote it.
  *
  *   First rescan (any participant — whoever calls biscuit_rescan first):
- *     • CAS initialized: 0 → 1.  Winner evaluates the bitmap, computes the
- *       full sorted TID count, and fills slots[0..num_participants-1] with
- *       pre-computed [start, end) ranges.  The last slot absorbs any remainder
- *       so uneven divisions are handled correctly.  Then sets initialized = 2.
- *     • All other participants spin on initialized until it reaches 2.
- *       No per-TID coordination ever happens.
- *
- *   Each rescan:
- *     • Participant reads MyParallelWorkerNumber → slot index
- *         leader  (-1) → slot 0
- *         worker N     → slot N+1
- *     • Evaluates bitmap locally, returns only tids[slots[i].start .. slots[i].end).
+ *     • CAS initialized: 0 → 1 (biscuit_parallel_claim).  Only the winner
+ *       evaluates the query.  It serializes the bitmap behind the
+ *       descriptor when it fits, then sets initialized = 2
+ *       (biscuit_parallel_publish).
+ *     • All other participants spin on initialized until it reaches 2, then
+ *       view the published bitmap in place (biscuit_parallel_wait).
+ *
+ *   Every participant holding the bitmap then claims chunks of
+ *   BISCUIT_PARALLEL_CHUNK ranks (records in ascending order) from
+ *   next_rank and converts only those to TIDs, until total_tids is
+ *   reached.  How many participants actually run does not matter.
+ *
+ *   When the bitmap was not shared (too large), or a participant's copy
+ *   of the index numbers records differently, the winner returns the
+ *   whole result and the others return nothing.
  *
  *   Rescan (biscuit_parallelrescan):
- *     • Reset initialized = 0 and clear all slots so the next scan re-partitions.
- *
- * No atomic chunk counter.  No spin on chunk claims.  No false-sharing.
- * The only shared writes are the one-time partition computation.
+ *     • Reset initialized = 0 and next_rank so the next scan starts over.
  */
 
 /* Maximum participants (1 leader + up to this many workers). */
 #define BISCUIT_MAX_PARALLEL_WORKERS  64
 
-/*
- * BiscuitWorkerSlot — the TID index range assigned to one participant.
- * start is inclusive, end is exclusive.  Both are indices into the local
- * sorted TID array (identical across all processes for a given scan).
- */
-typedef struct BiscuitWorkerSlot
-{
-    uint64_t    start;      /* first TID index for this participant */
-    uint64_t    end;        /* one past the last TID index          */
-} BiscuitWorkerSlot;
+/* Ranks claimed from next_rank at a time */
+#define BISCUIT_PARALLEL_CHUNK        8192
 
 /*
  * initialized state values
- *   0 – partition table not yet computed.
- *   1 – computation in progress (one participant holds the lock).
- *   2 – partition table ready; all participants may proceed.
+ *   0 – result not yet evaluated.
+ *   1 – evaluation in progress (one participant holds the claim).
+ *   2 – result published; all participants may proceed.
  */
 typedef struct BiscuitParallelScanDesc
 {
     pg_atomic_uint32  initialized;      /* 0=uninit, 1=computing, 2=ready    */
-    int32             num_participants; /* leader + workers                  */
+    int32             num_participants; /* leader + planned workers (PG18+)  */
     uint64_t          total_tids;       /* filled in by the initializer      */
+    pg_atomic_uint64  next_rank;        /* first rank not yet claimed        */
 
     /*
-     * Per-participant TID ranges.  Slot 0 is always the leader; slot i+1
-     * belongs to background worker i (MyParallelWorkerNumber == i).
-     * The last slot's end is clamped to total_tids to absorb any remainder.
+     * The result bitmap, serialized by the winner at BiscuitParallelResult()
+     * (result_bytes is 0 when it was not shared), and the copy of the index
+     * it was evaluated on.
      */
-    BiscuitWorkerSlot slots[BISCUIT_MAX_PARALLEL_WORKERS + 1];
+    uint64_t          result_space;     /* bytes reserved behind the struct  */
+    uint64_t          result_bytes;
+    uint64            result_epoch;     /* record_epoch of that copy         */
+    int32             result_records;   /* and its num_records               */
+    bool              result_recheck;
 } BiscuitParallelScanDesc;
 
+/* The descriptor is followed by result_space bytes for the result bitmap */
+#define BISCUIT_PARALLEL_DESC_SIZE  MAXALIGN(sizeof(BiscuitParallelScanDesc))
+#define BiscuitParallelResult(pdesc) \
+    ((char *) (pdesc) + BISCUIT_PARALLEL_DESC_SIZE)
+
+/*
+ * Most of the query DSM segment reserved for one result; larger results
+ * are evaluated by every participant.
+ */
+#define BISCUIT_PARALLEL_RESULT_MAX ((Size) 64 * 1024 * 1024)
+
 /* Sort an array of TIDs for sequential heap access. */
 extern void biscuit_sort_tids_by_block(ItemPointerData *tids, int count);
 
-/* Single-threaded TID collection from a result bitmap. */
+/* Whether tids[0 .. count) ascend (ties allowed), see BiscuitIndex.heap_ordered */
+extern bool biscuit_tids_in_heap_order(const ItemPointerData *tids, int count);
+
+/*
+ * Single-threaded TID collection from a result bitmap.  When out_recs is
+ * not NULL it also receives the record of each TID (index-only scans);
+ * the TIDs are then left in record order, so needs_sorting must be false.
+ */
 extern void biscuit_collect_sorted_tids_single(BiscuitIndex *idx,
                                                RoaringBitmap *result,
                                                ItemPointerData **out_tids,
                                                int *out_count,
-                                               bool needs_sorting);
+                                               bool needs_sorting,
+                                               uint32_t **out_recs);
 
+/*
+ * Streaming collection: a cursor over a result bitmap (whose ownership
+ * passes to the stream) that yields up to max TIDs per call, in record
+ * order, and returns 0 once exhausted.  Used by every plain and
+ * index-only scan so time-to-first-row and memory do not depend on the
+ * number of matches.
+ * out_recs, when not NULL, receives the record of each TID.
+ */
+typedef struct BiscuitTidStream BiscuitTidStream;
+
+extern BiscuitTidStream *biscuit_tid_stream_begin(RoaringBitmap *result);
 
 /*
- * biscuit_collect_sorted_tids_parallel
- *
- * Parallel-aware TID collection.  Called by EVERY participant (leader and
- * background workers) from biscuit_rescan() whenever scan->parallel_scan
- * is non-NULL.
- *
- * Algorithm
- * ---------
- * 1. The first participant to arrive CASes pdesc->initialized from 0 → 1,
- *    evaluates the bitmap, computes the full sorted TID count, divides it
- *    evenly into pdesc->num_participants slices, writes each [start, end)
- *    into pdesc->slots[], then sets initialized = 2.  The last slot absorbs
- *    any remainder so uneven divisions are always correct.
- *
- * 2. All other participants spin on initialized until it reaches 2 (with
- *    CHECK_FOR_INTERRUPTS and a 1 µs sleep to avoid burning a core).
- *
- * 3. Every participant reads its own slot using its stable worker identity:
- *       leader  (MyParallelWorkerNumber == -1) → slot 0
- *       worker N (MyParallelWorkerNumber ==  N) → slot N+1
- *
- * 4. Each participant evaluates the bitmap locally (identical result for all
- *    — deterministic read-only operation) and returns only the TIDs in its
- *    assigned [start, end) range.
- *
- * No per-TID atomic operations.  No chunk claiming races.  The Gather node
- * assembles exactly one copy of the full result from the disjoint per-process
- * slices.
- *
- * When pdesc is NULL the function is identical to
- * biscuit_collect_sorted_tids_single() (non-parallel path).
+ * A stream over the chunks of result this participant claims from
+ * pdesc->next_rank.  With view set, result is the shared bitmap viewed by
+ * biscuit_parallel_wait() and is released with biscuit_roaring_view_free.
+ */
+extern BiscuitTidStream *biscuit_tid_stream_begin_parallel(RoaringBitmap *result,
+                                                           bool view,
+                                                           BiscuitParallelScanDesc *pdesc);
+extern int               biscuit_tid_stream_next(BiscuitTidStream *stream,
+                                                 BiscuitIndex *idx,
+                                                 ItemPointerData *out,
+                                                 uint32_t *out_recs,
+                                                 int max);
+extern void              biscuit_tid_stream_end(BiscuitTidStream *stream);
+
+/*
+ * Evaluate-once coordination (biscuit_tid.c, PARALLEL COLLECTION).
+ *
+ * biscuit_parallel_claim    true for the one participant that must
+ *                           evaluate the query and then publish it.
+ * biscuit_parallel_publish  share result in the descriptor when it fits
+ *                           and reset the rank counter; true when shared.
+ * biscuit_parallel_wait     wait for the publication; the shared result
+ *                           as a read-only view (release with
+ *                           biscuit_roaring_view_free), or NULL when this
+ *                           participant has nothing to return.
  */
-extern void biscuit_collect_sorted_tids_parallel(BiscuitIndex *idx,
-                                                  RoaringBitmap *result,
-                                                  BiscuitParallelScanDesc *pdesc,
-                                                  ItemPointerData **out_tids,
-                                                  int *out_count,
-                                                  bool needs_sorting);
+extern bool           biscuit_parallel_claim(BiscuitParallelScanDesc *pdesc);
+extern bool           biscuit_parallel_publish(BiscuitParallelScanDesc *pdesc,
+                                               const BiscuitIndex *idx,
+                                               const RoaringBitmap *result,
+                                               bool recheck);
+extern RoaringBitmap *biscuit_parallel_wait(BiscuitParallelScanDesc *pdesc,
+                                            const BiscuitIndex *idx,
+                                            bool *recheck);
 
 /*
  * Parallel worker entry point — registered via RegisterParallelWorkerMain()
@@ -180,8 +185,9 @@ extern bool biscuit_is_aggregate_query(IndexScanDesc scan);
 /*
  * biscuit_estimateparallelscan
  *
- * AM callback: returns sizeof(BiscuitParallelScanDesc) so the executor
- * reserves exactly the right amount of DSM space.
+ * AM callback: returns the size of BiscuitParallelScanDesc plus the room
+ * for a result bitmap over the index's records, so the executor reserves
+ * it in the query's DSM segment.
  *
  * The amestimateparallelscan_function typedef has changed signature across
  * major PostgreSQL versions:
@@ -198,20 +204,26 @@ extern Size biscuit_estimateparallelscan(int nkeys, int norderbys);
 extern Size biscuit_estimateparallelscan(void);
 #endif
 
+/*
+ * Sizes the result space for a parallel path over index on versions
+ * whose estimate callback does not receive the index (before PG18).
+ */
+extern void biscuit_parallel_note_path(Relation index);
+
 /*
  * biscuit_initparallelscan
  *
- * AM callback: zeroes the descriptor and records num_participants so the
- * partition table can be sized correctly at first rescan.  Sets
- * initialized = 0 (not yet computed).
+ * AM callback: zeroes the descriptor and records the result space behind
+ * it.  Sets initialized = 0 (not yet evaluated).
  */
 extern void biscuit_initparallelscan(void *target);
 
 /*
  * biscuit_parallelrescan
  *
- * AM callback: resets initialized = 0 and clears all slots so the next
- * rescan re-partitions from scratch (handles Materialize node rewinds).
+ * AM callback: resets initialized and next_rank so the next rescan
+ * evaluates and hands out the result from scratch (handles Materialize
+ * node rewinds).
  */
 extern void biscuit_parallelrescan(IndexScanDesc scan);
 
@@ -0,0 +1,280 @@
+/*
+ * biscuit_trigram.c
+ * Trigram posting bitmaps for '%substring%' patterns.
+ *
+ * A substring pattern seeds its candidates from the char_cache bitmap of
+ * one byte of the needle and verifies every candidate against the stored
+ * string.  For a common byte that is most of the table.  With the
+ * trigrams index option on, the index also keeps one bitmap per distinct
+ * three-byte sequence, and the candidates are intersected with the
+ * posting of every trigram of the needle before verification; a trigram
+ * that occurs nowhere empties the set without reading a single string.
+ *
+ * Keys
+ * ----
+ * A record is posted under the trigrams of its value with ASCII letters
+ * folded, and under those of its lowercased copy (data_cache_lower).
+ * Needles are ASCII-folded the same way, so a LIKE needle (taken as-is)
+ * and an ILIKE needle (lowercased by the caller) both look up keys that
+ * every matching record carries.  Postings are supersets and the filter
+ * never drops a match; verification still decides.  Only runs of three
+ * concrete bytes form a trigram: '_' breaks a run, and escaped literals
+ * (BISCUIT_LITERAL_ESC pairs) count as their byte.
+ *
+ * Layout
+ * ------
+ * BISCUIT_TRIGRAM_BUCKETS CharIndex buckets addressed by the first two
+ * bytes, each sorted by the third (PosEntry.pos), so inserting a new key
+ * shifts at most 255 entries.
+ *
+ * Deleted records are not removed from the postings.  A stale bit costs
+ * one verification at most and a reused slot adds its new trigrams on
+ * top, so postings remain supersets.
+ */
+
+#include "biscuit_common.h"
+#include "biscuit_bitmap.h"
+#include "biscuit_trigram.h"
+
+/* Literal-escape sentinel in parsed part strings (see biscuit_pattern.c) */
+#define BISCUIT_TRIGRAM_LITERAL_ESC '\x01'
+
+/*
+ * Postings intersected per part.  The smallest ones are kept; past a few
+ * dozen the candidates rarely shrink further.
+ */
+#define BISCUIT_TRIGRAM_MAX_PROBES  32
+
+#define BiscuitTrigramKey(a, b, c) \
+    (((uint32) (a) << 16) | ((uint32) (b) << 8) | (uint32) (c))
+
+/* ================================================================
+ * SECTION 1 – Table maintenance
+ * ================================================================ */
+
+CharIndex *
+biscuit_trigram_create(void)
+{
+    return (CharIndex *) palloc0(BISCUIT_TRIGRAM_BUCKETS * sizeof(CharIndex));
+}
+
+static RoaringBitmap *
+biscuit_trigram_lookup(const CharIndex *tri, uint32 key)
+{
+    const CharIndex *bucket = &tri[key >> 8];
+    int              third  = (int) (key & 0xFF);
+    int              left   = 0, right = bucket->count - 1;
+
+    while (left <= right)
+    {
+        int mid = (left + right) >> 1;
+
+        if (bucket->entries[mid].pos == third)
+            return bucket->entries[mid].bitmap;
+        else if (bucket->entries[mid].pos < third)
+            left = mid + 1;
+        else
+            right = mid - 1;
+    }
+    return NULL;
+}
+
+/* Posting for key, created empty if the key is new */
+static RoaringBitmap *
+biscuit_trigram_posting(CharIndex *tri, uint32 key)
+{
+    CharIndex *bucket     = &tri[key >> 8];
+    int        third      = (int) (key & 0xFF);
+    int        left       = 0, right = bucket->count - 1;
+    int        insert_pos = bucket->count;
+    int        i;
+
+    while (left <= right)
+    {
+        int mid = (left + right) >> 1;
+
+        if (bucket->entries[mid].pos == third)
+            return bucket->entries[mid].bitmap;
+        else if (bucket->entries[mid].pos < third)
+            left = mid + 1;
+        else
+        {
+            insert_pos = mid;
+            right      = mid - 1;
+        }
+    }
+
+    if (bucket->count >= bucket->capacity)
+    {
+        int new_cap = bucket->capacity > 0 ? bucket->capacity * 2 : 4;
+
+        if (bucket->entries)
+            bucket->entries = (PosEntry *) repalloc(bucket->entries, new_cap * sizeof(PosEntry));
+        else
+            bucket->entries = (PosEntry *) palloc(new_cap * sizeof(PosEntry));
+        bucket->capacity = new_cap;
+    }
+
+    for (i = bucket->count; i > insert_pos; i--)
+        bucket->entries[i] = bucket->entries[i - 1];
+
+    bucket->entries[insert_pos].pos    = third;
+    bucket->entries[insert_pos].bitmap = biscuit_roaring_create();
+    bucket->count++;
+
+    return bucket->entries[insert_pos].bitmap;
+}
+
+static void
+biscuit_trigram_add_string(CharIndex *tri, const char *str, int byte_len, uint32 rec)
+{
+    int i;
+
+    for (i = 0; i + 2 < byte_len; i++)
+    {
+        uint32 key = BiscuitTrigramKey(pg_ascii_tolower((unsigned char) str[i]),
+                                       pg_ascii_tolower((unsigned char) str[i + 1]),
+                                       pg_ascii_tolower((unsigned char) str[i + 2]));
+
+        biscuit_roaring_add(biscuit_trigram_posting(tri, key), rec);
+    }
+}
+
+void
+biscuit_trigram_add(CharIndex *tri,
+                    const char *str, int byte_len,
+                    const char *str_lower, int lower_len,
+                    uint32 rec)
+{
+    int i;
+
+    if (!tri || !str)
+        return;
+
+    biscuit_trigram_add_string(tri, str, byte_len, rec);
+
+    if (!str_lower)
+        return;
+
+    /* For ASCII values the lowercased copy adds nothing */
+    if (lower_len == byte_len)
+    {
+        for (i = 0; i < byte_len; i++)
+            if (pg_ascii_tolower((unsigned char) str[i]) != (unsigned char) str_lower[i])
+                break;
+        if (i == byte_len)
+            return;
+    }
+
+    biscuit_trigram_add_string(tri, str_lower, lower_len, rec);
+}
+
+/* ================================================================
+ * SECTION 2 – Candidate filter
+ * ================================================================ */
+
+void
+biscuit_trigram_filter(const CharIndex *tri, const char *part, int byte_len,
+                       RoaringBitmap *candidates)
+{
+    RoaringBitmap *postings[BISCUIT_TRIGRAM_MAX_PROBES];
+    uint64_t       cards[BISCUIT_TRIGRAM_MAX_PROBES];
+    int            nprobes = 0;
+    int            run     = 0;
+    unsigned char  back2   = 0;
+    unsigned char  back1   = 0;
+    int            i, j;
+
+    if (!tri || !candidates || !part)
+        return;
+
+    for (i = 0; i < byte_len; i++)
+    {
+        unsigned char  c = (unsigned char) part[i];
+        RoaringBitmap *bm;
+        uint64_t       card;
+
+        if (c == BISCUIT_TRIGRAM_LITERAL_ESC && i + 1 < byte_len)
+            c = (unsigned char) part[++i];
+        else if (c == '_')
+        {
+            run = 0;
+            continue;
+        }
+
+        c = pg_ascii_tolower(c);
+        if (++run >= 3)
+        {
+            bm = biscuit_trigram_lookup(tri, BiscuitTrigramKey(back2, back1, c));
+            if (!bm)
+            {
+                /* No record contains this trigram */
+                RoaringBitmap *empty = biscuit_roaring_create();
+
+                biscuit_roaring_and_inplace(candidates, empty);
+                biscuit_roaring_free(empty);
+                return;
+            }
+
+            /* Keep the smallest postings, sorted by cardinality */
+            for (j = 0; j < nprobes && postings[j] != bm; j++)
+                ;
+            if (j == nprobes)
+            {
+                card = biscuit_roaring_count(bm);
+                if (nprobes < BISCUIT_TRIGRAM_MAX_PROBES || card < cards[nprobes - 1])
+                {
+                    if (nprobes == BISCUIT_TRIGRAM_MAX_PROBES)
+                        nprobes--;
+                    for (j = nprobes; j > 0 && cards[j - 1] > card; j--)
+                    {
+                        postings[j] = postings[j - 1];
+                        cards[j]    = cards[j - 1];
+                    }
+                    postings[j] = bm;
+                    cards[j]    = card;
+                    nprobes++;
+                }
+            }
+        }
+        back2 = back1;
+        back1 = c;
+    }
+
+    for (j = 0; j < nprobes && !biscuit_roaring_is_empty(candidates); j++)
+        biscuit_roaring_and_inplace(candidates, postings[j]);
+}
+
+/* ================================================================
+ * SECTION 3 – Introspection
+ * ================================================================ */
+
+int
+biscuit_trigram_count(const CharIndex *tri)
+{
+    int total = 0;
+    int b;
+
+    if (!tri)
+        return 0;
+
+    for (b = 0; b < BISCUIT_TRIGRAM_BUCKETS; b++)
+        total += tri[b].count;
+    return total;
+}
+
+size_t
+biscuit_trigram_memory_usage(const CharIndex *tri)
+{
+    size_t total;
+    int    b;
+
+    if (!tri)
+        return 0;
+
+    total = BISCUIT_TRIGRAM_BUCKETS * sizeof(CharIndex);
+    for (b = 0; b < BISCUIT_TRIGRAM_BUCKETS; b++)
+        if (tri[b].count > 0)
+            total += biscuit_charindex_memory_usage(&tri[b]);
+    return total;
+}
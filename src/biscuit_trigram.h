@@ -0,0 +1,41 @@
+/*
+ * biscuit_trigram.h
+ * Optional trigram posting bitmaps used to prune the candidates of
+ * '%substring%' patterns before verification.
+ *
+ * A trigram table is an array of BISCUIT_TRIGRAM_BUCKETS CharIndex
+ * buckets (see biscuit_common.h); a NULL table means the index was built
+ * without postings and every function below is a no-op.
+ */
+
+#ifndef BISCUIT_TRIGRAM_H
+#define BISCUIT_TRIGRAM_H
+
+#include "biscuit_common.h"
+
+/* An empty table in CurrentMemoryContext */
+extern CharIndex *biscuit_trigram_create(void);
+
+/*
+ * Add record rec under the trigrams of str (ASCII-folded) and of its
+ * lowercased copy str_lower, which may be NULL.
+ */
+extern void       biscuit_trigram_add(CharIndex *tri,
+                                      const char *str, int byte_len,
+                                      const char *str_lower, int lower_len,
+                                      uint32 rec);
+
+/*
+ * Intersect candidates with the postings of every trigram in the parsed
+ * part string.  Never removes a record whose value contains the part
+ * (case-sensitively, or case-folded for a lowercased ILIKE part).
+ */
+extern void       biscuit_trigram_filter(const CharIndex *tri,
+                                         const char *part, int byte_len,
+                                         RoaringBitmap *candidates);
+
+/* Number of distinct trigrams, and bytes held by the table */
+extern int        biscuit_trigram_count(const CharIndex *tri);
+extern size_t     biscuit_trigram_memory_usage(const CharIndex *tri);
+
+#endif /* BISCUIT_TRIGRAM_H */
@@ -6,6 +6,11 @@
 #include "biscuit_common.h"
 #include "biscuit_utf8.h"
 
+#include "catalog/pg_collation.h"
+#include "catalog/pg_database.h"
+#include "utils/hsearch.h"
+#include "utils/syscache.h"
+
 /* ==================== UTF-8 BYTE-LENGTH LOOKUP ==================== */
 
 /*
@@ -112,23 +117,58 @@ biscuit_utf8_char_to_byte_offset(const char *str, int byte_len, int char_pos)
 /* ==================== LOWERCASE CONVERSION ==================== */
 
 /*
- * Convert str (length len bytes) to lowercase using PostgreSQL's
- * locale-aware lower() built-in.  The result is palloc'd.
+ * Case folding for the ILIKE side of the index, the same as lower() under
+ * the database's default collation.  Nearly every string SKUs, emails and
+ * URLs hold is plain ASCII, so that is folded eight bytes at a time in a
+ * 64-bit word, with no call into the locale:
+ *
+ *   • an all-ASCII string is checked first; one without upper case
+ *     letters folds to itself, and biscuit_str_fold() returns NULL without
+ *     allocating anything;
+ *   • otherwise 'A'..'Z' get 0x20 added, word by word.
+ *
+ * Non-ASCII characters fold through lower().  With a libc locale lower()
+ * maps each character on its own, so a character's folding is cached per
+ * backend (biscuit_fold_chars) and a string with a few accented letters
+ * costs a hash probe for each of them.  Other providers (ICU) may fold a
+ * character by its context (final sigma), so there a string with any
+ * non-ASCII byte goes through lower() whole.
+ *
+ * The ASCII fast path is only used once lower() has been checked to fold
+ * ASCII as 'A'..'Z' -> 'a'..'z' and leave the rest alone; a Turkish
+ * locale, where 'I' folds to a dotless i, keeps everything on lower().
  */
-char *
-biscuit_str_tolower(const char *str, int len)
+
+#define BISCUIT_FOLD_CACHE_MAX  65536   /* non-ASCII characters cached */
+
+#define BISCUIT_HIGH_BITS       UINT64CONST(0x8080808080808080)
+#define BISCUIT_BYTES(c)        (UINT64CONST(0x0101010101010101) * (c))
+
+/* A non-ASCII character (its bytes packed in key) and its lowercase */
+typedef struct BiscuitFoldEntry
+{
+    uint32      key;
+    uint8       len;
+    char        lower[7];
+} BiscuitFoldEntry;
+
+static bool  biscuit_fold_ready = false;
+static bool  biscuit_fold_ascii = false;    /* ASCII fast path usable */
+static HTAB *biscuit_fold_chars = NULL;     /* NULL: fold non-ASCII whole */
+
+/* lower() under the default collation, palloc'd, length in *out_len */
+static char *
+biscuit_fold_locale(const char *str, int len, int *out_len)
 {
     text *input;
     text *result_text;
     Oid   collation;
-
-    if (len == 0)
-        return pstrdup("");
+    char *result;
 
     input     = cstring_to_text_with_len(str, len);
     collation = get_typcollation(TEXTOID);
 
-    result_text = DatumGetTextP(
+    result_text = DatumGetTextPP(
         DirectFunctionCall2Coll(
             lower,
             collation,
@@ -136,7 +176,257 @@ biscuit_str_tolower(const char *str, int len)
             collation
         )
     );
-    return text_to_cstring(result_text);
+    *out_len = VARSIZE_ANY_EXHDR(result_text);
+    result   = pnstrdup(VARDATA_ANY(result_text), *out_len);
+
+    pfree(input);
+    pfree(result_text);
+    return result;
+}
+
+/* Decide, once per backend, what lower() can be replaced with */
+static void
+biscuit_fold_setup(void)
+{
+    char      ascii[128];
+    char     *folded;
+    int       folded_len;
+    bool      same;
+    HeapTuple tup;
+    char      provider = 0;
+    int       i;
+
+    for (i = 1; i < 128; i++)
+        ascii[i - 1] = (char) i;
+    folded = biscuit_fold_locale(ascii, 127, &folded_len);
+    same   = (folded_len == 127);
+    for (i = 1; i < 128 && same; i++)
+        same = (unsigned char) folded[i - 1] == pg_ascii_tolower((unsigned char) i);
+    pfree(folded);
+
+    tup = SearchSysCache1(DATABASEOID, ObjectIdGetDatum(MyDatabaseId));
+    if (HeapTupleIsValid(tup))
+    {
+        provider = ((Form_pg_database) GETSTRUCT(tup))->datlocprovider;
+        ReleaseSysCache(tup);
+    }
+
+    biscuit_fold_ascii = same;
+    if (same && provider == COLLPROVIDER_LIBC && GetDatabaseEncoding() == PG_UTF8)
+    {
+        HASHCTL ctl;
+
+        ctl.keysize   = sizeof(uint32);
+        ctl.entrysize = sizeof(BiscuitFoldEntry);
+        ctl.hcxt      = TopMemoryContext;
+        biscuit_fold_chars = hash_create("Biscuit case folding", 1024, &ctl,
+                                         HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+    }
+    biscuit_fold_ready = true;
+
+    elog(DEBUG1, "Biscuit: case folding: ASCII fast path %s, per-character cache %s",
+         biscuit_fold_ascii ? "on" : "off", biscuit_fold_chars ? "on" : "off");
+}
+
+/*
+ * Length of the ASCII prefix of str; *upper is set when it holds an upper
+ * case letter.
+ */
+static int
+biscuit_ascii_prefix(const char *str, int len, bool *upper)
+{
+    uint64 found = 0;
+    int    i     = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64 w;
+
+        memcpy(&w, str + i, sizeof(w));
+        if (w & BISCUIT_HIGH_BITS)
+            break;
+        /* high bit of a byte: >= 'A', and not > 'Z' */
+        found |= ((w + BISCUIT_BYTES(0x80 - 'A')) ^ (w + BISCUIT_BYTES(0x80 - 'Z' - 1)));
+    }
+    found &= BISCUIT_HIGH_BITS;
+
+    for (; i < len; i++)
+    {
+        unsigned char c = (unsigned char) str[i];
+
+        if (c & 0x80)
+            break;
+        if (c >= 'A' && c <= 'Z')
+            found = 1;
+    }
+
+    *upper = (found != 0);
+    return i;
+}
+
+/* Fold len ASCII bytes of str into out */
+static void
+biscuit_ascii_fold(const char *str, int len, char *out)
+{
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64 w;
+        uint64 upper;
+
+        memcpy(&w, str + i, sizeof(w));
+        upper = ((w + BISCUIT_BYTES(0x80 - 'A')) ^ (w + BISCUIT_BYTES(0x80 - 'Z' - 1))) &
+                BISCUIT_HIGH_BITS;
+        w |= upper >> 2;        /* 0x80 >> 2 == 'a' - 'A' */
+        memcpy(out + i, &w, sizeof(w));
+    }
+    for (; i < len; i++)
+        out[i] = (char) pg_ascii_tolower((unsigned char) str[i]);
+}
+
+/* Append the lowercase of the non-ASCII character str[0..len) to buf */
+static void
+biscuit_fold_char(const char *str, int len, StringInfo buf)
+{
+    BiscuitFoldEntry *entry;
+    uint32            key = 0;
+    bool              found;
+    char             *folded;
+    int               folded_len;
+
+    memcpy(&key, str, len);
+    entry = (BiscuitFoldEntry *) hash_search(biscuit_fold_chars, &key, HASH_FIND, NULL);
+    if (entry)
+    {
+        appendBinaryStringInfo(buf, entry->lower, entry->len);
+        return;
+    }
+
+    folded = biscuit_fold_locale(str, len, &folded_len);
+    appendBinaryStringInfo(buf, folded, folded_len);
+
+    if (folded_len <= (int) sizeof(entry->lower) &&
+        hash_get_num_entries(biscuit_fold_chars) < BISCUIT_FOLD_CACHE_MAX)
+    {
+        entry = (BiscuitFoldEntry *) hash_search(biscuit_fold_chars, &key, HASH_ENTER, &found);
+        entry->len = (uint8) folded_len;
+        memcpy(entry->lower, folded, folded_len);
+    }
+    pfree(folded);
+}
+
+/*
+ * Lowercase str (len bytes) as lower() does under the database's default
+ * collation.  Returns NULL when that leaves it unchanged, else a palloc'd
+ * copy of *out_len bytes.
+ */
+char *
+biscuit_str_fold(const char *str, int len, int *out_len)
+{
+    StringInfoData buf;
+    char          *folded;
+    bool           upper;
+    int            pos;
+
+    if (!biscuit_fold_ready)
+        biscuit_fold_setup();
+
+    pos = biscuit_fold_ascii ? biscuit_ascii_prefix(str, len, &upper) : 0;
+
+    if (pos == len && biscuit_fold_ascii)
+    {
+        if (!upper)
+            return NULL;
+        folded = (char *) palloc(len + 1);
+        biscuit_ascii_fold(str, len, folded);
+        folded[len] = '\0';
+        *out_len = len;
+        return folded;
+    }
+
+    if (!biscuit_fold_chars)
+    {
+        folded = biscuit_fold_locale(str, len, out_len);
+        if (*out_len == len && memcmp(folded, str, len) == 0)
+        {
+            pfree(folded);
+            return NULL;
+        }
+        return folded;
+    }
+
+    /* ASCII runs word by word, other characters through the cache */
+    initStringInfo(&buf);
+    enlargeStringInfo(&buf, len);
+    pos = 0;
+    while (pos < len)
+    {
+        int run = biscuit_ascii_prefix(str + pos, len - pos, &upper);
+
+        if (run > 0)
+        {
+            enlargeStringInfo(&buf, run);
+            biscuit_ascii_fold(str + pos, run, buf.data + buf.len);
+            buf.len           += run;
+            buf.data[buf.len]  = '\0';
+            pos               += run;
+        }
+        else
+        {
+            int char_len = biscuit_utf8_char_length((unsigned char) str[pos]);
+
+            if (pos + char_len > len)
+                char_len = len - pos;
+            biscuit_fold_char(str + pos, char_len, &buf);
+            pos += char_len;
+        }
+    }
+
+    if (buf.len == len && memcmp(buf.data, str, len) == 0)
+    {
+        pfree(buf.data);
+        return NULL;
+    }
+    *out_len = buf.len;
+    return buf.data;
+}
+
+/*
+ * Convert str (length len bytes) to lowercase as PostgreSQL's
+ * locale-aware lower() does.  The result is always palloc'd.
+ */
+char *
+biscuit_str_tolower(const char *str, int len)
+{
+    char *folded;
+    int   folded_len;
+
+    if (len == 0)
+        return pstrdup("");
+
+    folded = biscuit_str_fold(str, len, &folded_len);
+    return folded ? folded : pnstrdup(str, len);
+}
+
+/* True if the len bytes of str are all ASCII */
+bool
+biscuit_str_is_ascii(const char *str, int len)
+{
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64 w;
+
+        memcpy(&w, str + i, sizeof(w));
+        if (w & BISCUIT_HIGH_BITS)
+            return false;
+    }
+    for (; i < len; i++)
+        if ((unsigned char) str[i] & 0x80)
+            return false;
+    return true;
 }
 
 /* ==================== DATUM → C STRING ==================== */
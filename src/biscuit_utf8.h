@@ -23,9 +23,18 @@ extern bool biscuit_utf8_validate_char(const char *str, int byte_pos, int byte_l
 /* Byte offset of the character at char_pos (returns -1 on out-of-range) */
 extern int  biscuit_utf8_char_to_byte_offset(const char *str, int byte_len, int char_pos);
 
-/* Convert str to lowercase using PostgreSQL's locale-aware lower() */
+/* Convert str to lowercase as PostgreSQL's locale-aware lower() does */
 extern char *biscuit_str_tolower(const char *str, int len);
 
+/*
+ * The same, but NULL when the lowercase equals str, without allocating
+ * for a string of ASCII with no upper case; else *out_len bytes, palloc'd.
+ */
+extern char *biscuit_str_fold(const char *str, int len, int *out_len);
+
+/* True if the len bytes of str are all ASCII */
+extern bool  biscuit_str_is_ascii(const char *str, int len);
+
 /* Convert a Datum of a text-family type to a C string */
 extern char *biscuit_datum_to_text(Datum value, Oid typoid, FmgrInfo *outfunc, int *out_len);
 
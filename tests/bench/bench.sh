@@ -0,0 +1,200 @@
+#!/bin/bash
+
+################################################################################
+# Biscuit reproducible benchmark suite  (make bench)
+#
+# For every dataset kind (ascii, utf8) and scale it:
+#   1. generates bench_data deterministically (generate.sql)
+#   2. times CREATE INDEX ... USING biscuit (val) and records
+#      biscuit_index_memory_size() and the on-disk size
+#   3. runs one pgbench script per pattern class (queries/*.sql)
+#   4. rebuilds the index over (val, cat) and runs the multi-column script
+#   5. measures insert throughput through the index, then deletes a tenth
+#      of the rows and times VACUUM
+#
+# Results go to $BENCH_OUT/results.csv, one metric per line:
+#
+#   kind,rows,metric,value,unit
+#
+# sorted, so two runs diff cleanly; compare.sh flags regressions between
+# them.  The server and its settings are whatever PGHOST / PGPORT / PGUSER
+# point at; benchmark_env.md lists what the published numbers used.
+#
+# Settings (environment):
+#   BENCH_SCALES    row counts                     (default "10000 100000")
+#   BENCH_KINDS     dataset kinds                  (default "ascii utf8")
+#   BENCH_DURATION  seconds per pgbench run        (default 10)
+#   BENCH_CLIENTS   pgbench clients                (default 1)
+#   BENCH_DB        scratch database, recreated    (default biscuit_bench)
+#   BENCH_OUT       output directory       (default bench_results/<timestamp>)
+################################################################################
+
+set -euo pipefail
+
+BENCH_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+
+BENCH_SCALES="${BENCH_SCALES:-10000 100000}"
+BENCH_KINDS="${BENCH_KINDS:-ascii utf8}"
+BENCH_DURATION="${BENCH_DURATION:-10}"
+BENCH_CLIENTS="${BENCH_CLIENTS:-1}"
+BENCH_DB="${BENCH_DB:-biscuit_bench}"
+BENCH_OUT="${BENCH_OUT:-bench_results/$(date +%Y%m%d_%H%M%S)}"
+
+SELECT_CLASSES="exact prefix suffix substring multipart underscore ilike not_like"
+
+RESULTS="${BENCH_OUT}/results.csv"
+RAW="${BENCH_OUT}/raw.csv"
+
+################################################################################
+# Utility Functions
+################################################################################
+
+log_info() {
+    echo "[bench] $1" >&2
+}
+
+die() {
+    echo "[bench] ERROR: $1" >&2
+    exit 1
+}
+
+# Run SQL (from the argument) in the benchmark database, unaligned output
+sql() {
+    psql -X -q -v ON_ERROR_STOP=1 -At -d "$BENCH_DB" -c "$1"
+}
+
+# Milliseconds a SQL statement takes, measured around psql
+timed_sql() {
+    local start end
+    start=$(date +%s%N)
+    sql "$1" > /dev/null
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+# record kind rows metric value unit
+record() {
+    echo "$1,$2,$3,$4,$5" >> "$RAW"
+}
+
+kind_number() {
+    case "$1" in
+        ascii) echo 1 ;;
+        utf8)  echo 2 ;;
+        *)     die "unknown dataset kind '$1' (ascii, utf8)" ;;
+    esac
+}
+
+# pgbench_run kind rows script -> records <class>_tps and <class>_latency
+pgbench_run() {
+    local kind="$1" rows="$2" class="$3" out tps lat
+
+    out=$(pgbench -n -M simple -T "$BENCH_DURATION" -c "$BENCH_CLIENTS" \
+                  -D kind="$(kind_number "$kind")" -D rows="$rows" \
+                  -f "${BENCH_DIR}/queries/${class}.sql" "$BENCH_DB" 2>&1) ||
+        { echo "$out" >&2; die "pgbench failed for ${class}"; }
+
+    tps=$(echo "$out" | awk '/^tps = / { print $3; exit }')
+    lat=$(echo "$out" | awk '/^latency average = / { print $4; exit }')
+    [ -n "$tps" ] || { echo "$out" >&2; die "no tps in pgbench output for ${class}"; }
+
+    record "$kind" "$rows" "${class}_tps" "$tps" "tps"
+    record "$kind" "$rows" "${class}_latency" "${lat:-0}" "ms"
+    log_info "  ${class}: ${tps} tps, ${lat:-?} ms"
+}
+
+# build_index kind rows name columns -> records <name>_build, _memory, _disk
+build_index() {
+    local kind="$1" rows="$2" name="$3" columns="$4" ms
+
+    sql "DROP INDEX IF EXISTS bench_idx" > /dev/null
+    ms=$(timed_sql "CREATE INDEX bench_idx ON bench_data USING biscuit (${columns})")
+    record "$kind" "$rows" "${name}_build" "$ms" "ms"
+    record "$kind" "$rows" "${name}_memory" \
+        "$(sql "SELECT biscuit_index_memory_size('bench_idx'::regclass::oid)")" "bytes"
+    record "$kind" "$rows" "${name}_disk" \
+        "$(sql "SELECT pg_relation_size('bench_idx')")" "bytes"
+    log_info "  ${name} index built in ${ms} ms"
+}
+
+################################################################################
+# Benchmark
+################################################################################
+
+bench_dataset() {
+    local kind="$1" rows="$2" class ms deleted
+
+    log_info "${kind}, ${rows} rows"
+
+    ms=$(timed_sql "SELECT bench_generate($(kind_number "$kind"), ${rows})")
+    record "$kind" "$rows" "generate" "$ms" "ms"
+
+    build_index "$kind" "$rows" "single" "val"
+    for class in $SELECT_CLASSES; do
+        pgbench_run "$kind" "$rows" "$class"
+    done
+
+    build_index "$kind" "$rows" "multi" "val, cat"
+    pgbench_run "$kind" "$rows" "multicolumn"
+
+    # Writes go through the single-column index again
+    build_index "$kind" "$rows" "write" "val"
+    pgbench_run "$kind" "$rows" "insert"
+
+    deleted=$(sql "WITH d AS (DELETE FROM bench_data WHERE id % 10 = 0 RETURNING 1)
+                   SELECT count(*) FROM d")
+    ms=$(timed_sql "VACUUM bench_data")
+    record "$kind" "$rows" "vacuum" "$ms" "ms"
+    record "$kind" "$rows" "vacuum_rate" \
+        "$(awk -v n="$deleted" -v ms="$ms" 'BEGIN { printf "%.1f", n * 1000 / (ms > 0 ? ms : 1) }')" \
+        "rows/s"
+    log_info "  vacuum of ${deleted} dead rows in ${ms} ms"
+}
+
+main() {
+    local kind rows
+
+    command -v psql    > /dev/null || die "psql not found"
+    command -v pgbench > /dev/null || die "pgbench not found"
+    for kind in $BENCH_KINDS; do
+        kind_number "$kind" > /dev/null
+    done
+
+    mkdir -p "$BENCH_OUT"
+    : > "$RAW"
+
+    psql -X -q -v ON_ERROR_STOP=1 -d postgres \
+         -c "DROP DATABASE IF EXISTS ${BENCH_DB}" \
+         -c "CREATE DATABASE ${BENCH_DB}" > /dev/null
+    sql "CREATE EXTENSION biscuit" > /dev/null
+    psql -X -q -v ON_ERROR_STOP=1 -d "$BENCH_DB" -f "${BENCH_DIR}/generate.sql" > /dev/null
+
+    # Measure the index, not the planner's choice between it and a seq scan
+    sql "ALTER DATABASE ${BENCH_DB} SET enable_seqscan = off" > /dev/null
+
+    {
+        echo "biscuit_version=$(sql "SELECT biscuit_version()")"
+        echo "roaring=$(sql "SELECT biscuit_has_roaring()")"
+        echo "server=$(sql "SELECT version()")"
+        echo "git=$(git -C "$BENCH_DIR" describe --always --dirty 2>/dev/null || echo unknown)"
+        echo "duration=${BENCH_DURATION}"
+        echo "clients=${BENCH_CLIENTS}"
+    } > "${BENCH_OUT}/meta.txt"
+
+    for kind in $BENCH_KINDS; do
+        for rows in $BENCH_SCALES; do
+            bench_dataset "$kind" "$rows"
+        done
+    done
+
+    {
+        echo "kind,rows,metric,value,unit"
+        LC_ALL=C sort -t, -k1,1 -k2,2n -k3,3 "$RAW"
+    } > "$RESULTS"
+    rm -f "$RAW"
+
+    psql -X -q -d postgres -c "DROP DATABASE IF EXISTS ${BENCH_DB}" > /dev/null
+    log_info "results in ${RESULTS}"
+}
+
+main "$@"
@@ -0,0 +1,56 @@
+#!/bin/bash
+
+################################################################################
+# Compare two Biscuit benchmark runs  (make bench-compare BASE=... NEW=...)
+#
+#   compare.sh base/results.csv new/results.csv [threshold-percent]
+#
+# Prints every metric both runs have with its change, and marks those that
+# got worse by more than the threshold (default 10%): lower tps or rows/s,
+# higher ms or bytes.  Exits 1 if any did, so it can gate a release.
+################################################################################
+
+set -euo pipefail
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 base.csv new.csv [threshold-percent]" >&2
+    exit 2
+fi
+
+BASE="$1"
+NEW="$2"
+THRESHOLD="${3:-10}"
+
+[ -f "$BASE" ] || { echo "$BASE: not found" >&2; exit 2; }
+[ -f "$NEW" ]  || { echo "$NEW: not found" >&2; exit 2; }
+
+awk -F, -v threshold="$THRESHOLD" '
+    FNR == 1 { next }                       # header
+    NR == FNR { base[$1 "," $2 "," $3] = $4; next }
+    {
+        key = $1 "," $2 "," $3
+        if (!(key in base))
+            next
+        old = base[key] + 0
+        new = $4 + 0
+        change = (old != 0) ? (new - old) * 100 / old : 0
+
+        # Throughput regresses downwards, everything else upwards
+        worse = ($5 == "tps" || $5 == "rows/s") ? -change : change
+        mark = ""
+        if (worse > threshold)
+        {
+            mark = "  REGRESSION"
+            regressions++
+        }
+        printf "%-6s %9s  %-22s %14s -> %14s %-7s %+7.1f%%%s\n",
+               $1, $2, $3, base[key], $4, $5, change, mark
+    }
+    END {
+        if (regressions > 0)
+        {
+            printf "\n%d metric(s) regressed by more than %s%%\n", regressions, threshold
+            exit 1
+        }
+    }
+' "$BASE" "$NEW"
@@ -0,0 +1,64 @@
+-- ============================================================================
+-- Biscuit benchmark dataset generator
+--
+-- Every value is a pure function of (kind, id), so a dataset can be rebuilt
+-- byte for byte at any scale and the pgbench scripts in queries/ can derive
+-- a pattern that matches a known row without reading the table first.
+--
+--   kind 1  ascii  hex fragments around a small vocabulary, 10–40 bytes
+--   kind 2  utf8   the same shape with 2–4 byte characters in every value
+--                  (accents, Cyrillic, Greek, CJK, emoji)
+--
+-- Values never contain '%', '_' or '\', so any substring of one is a LIKE
+-- pattern that matches it literally.
+--
+-- Loaded by bench.sh; usage:  SELECT bench_generate(1, 100000);
+-- ============================================================================
+
+CREATE OR REPLACE FUNCTION bench_value(kind int, id bigint)
+RETURNS text
+LANGUAGE sql IMMUTABLE STRICT PARALLEL SAFE AS $$
+    SELECT CASE kind
+        WHEN 1 THEN
+            substr(md5(id::text), 1, 6)
+            || '-' || (ARRAY['alpha','beta','gamma','delta','omega',
+                             'sigma','kappa','lambda'])[1 + (id % 8)::int]
+            || '-' || substr(md5((id * 7)::text), 1, 4 + (id % 16)::int)
+        ELSE
+            (ARRAY['café','naïve','Straße','日本語','Ελληνικά',
+                   'русский','中文字符','emoji😀'])[1 + (id % 8)::int]
+            || '-' || substr(md5(id::text), 1, 6)
+            || (ARRAY['ß','é','ø','ü','ç','ñ','å','ł'])[1 + ((id / 8) % 8)::int]
+            || '-' || substr(md5((id * 7)::text), 1, 2 + (id % 10)::int)
+    END
+$$;
+
+-- Second column of the multi-column benchmark: a low-cardinality category
+CREATE OR REPLACE FUNCTION bench_category(kind int, id bigint)
+RETURNS text
+LANGUAGE sql IMMUTABLE STRICT PARALLEL SAFE AS $$
+    SELECT CASE kind
+        WHEN 1 THEN (ARRAY['books','music','garden','tools','games',
+                           'sports','toys','kitchen'])[1 + ((id / 3) % 8)::int]
+        ELSE (ARRAY['livres','musique','jardín','инструменты','παιχνίδια',
+                    '体育','おもちゃ','küche'])[1 + ((id / 3) % 8)::int]
+    END
+$$;
+
+-- (Re)create bench_data with rows 1..nrows of the given kind
+CREATE OR REPLACE FUNCTION bench_generate(kind int, nrows bigint)
+RETURNS void
+LANGUAGE plpgsql AS $$
+BEGIN
+    DROP TABLE IF EXISTS bench_data;
+    CREATE TABLE bench_data (
+        id  bigint PRIMARY KEY,
+        val text NOT NULL,
+        cat text NOT NULL
+    );
+    INSERT INTO bench_data
+    SELECT g, bench_value(kind, g), bench_category(kind, g)
+    FROM generate_series(1, nrows) g;
+    ANALYZE bench_data;
+END;
+$$;
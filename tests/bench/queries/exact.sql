@@ -0,0 +1,3 @@
+-- Exact match: a whole value as a pattern without wildcards
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data WHERE val LIKE bench_value(:kind, :id);
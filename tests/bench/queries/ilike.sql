@@ -0,0 +1,3 @@
+-- ILIKE: an upper-cased prefix of a value, case-insensitive
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data WHERE val ILIKE upper(left(bench_value(:kind, :id), 4)) || '%';
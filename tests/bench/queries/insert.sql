@@ -0,0 +1,4 @@
+-- Insert throughput: new rows past the generated range
+\set id random(:rows + 1, :rows * 100)
+INSERT INTO bench_data VALUES (:id, bench_value(:kind, :id), bench_category(:kind, :id))
+ON CONFLICT (id) DO NOTHING;
@@ -0,0 +1,5 @@
+-- Multi-column: a prefix of val and a substring of cat, on an index over (val, cat)
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data
+WHERE val LIKE left(bench_value(:kind, :id), 3) || '%'
+  AND cat LIKE '%' || substr(bench_category(:kind, :id), 2, 3) || '%';
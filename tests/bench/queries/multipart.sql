@@ -0,0 +1,4 @@
+-- Multi-part: an anchored part and a floating part of the same value
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data
+WHERE val LIKE left(bench_value(:kind, :id), 3) || '%' || substr(bench_value(:kind, :id), 9, 3) || '%';
@@ -0,0 +1,3 @@
+-- NOT LIKE: everything but the values holding a substring
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data WHERE val NOT LIKE '%' || substr(bench_value(:kind, :id), 2, 3) || '%';
@@ -0,0 +1,3 @@
+-- Prefix: the first four characters of a value
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data WHERE val LIKE left(bench_value(:kind, :id), 4) || '%';
@@ -0,0 +1,3 @@
+-- Substring: four characters from inside a value
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data WHERE val LIKE '%' || substr(bench_value(:kind, :id), 3, 4) || '%';
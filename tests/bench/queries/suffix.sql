@@ -0,0 +1,3 @@
+-- Suffix: the last four characters of a value
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data WHERE val LIKE '%' || right(bench_value(:kind, :id), 4);
@@ -0,0 +1,4 @@
+-- Underscore-heavy: fixed characters at known positions, the rest single wildcards
+\set id random(1, :rows)
+SELECT count(*) FROM bench_data
+WHERE val LIKE left(bench_value(:kind, :id), 1) || '___' || substr(bench_value(:kind, :id), 5, 1) || '__%';
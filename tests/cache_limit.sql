@@ -0,0 +1,318 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - INDEX CACHE MEMORY LIMIT REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit
+-- =============================================================================
+-- With biscuit.cache_memory_limit set, a session keeps its copies of
+-- Biscuit indexes under that budget by evicting the least recently used
+-- ones, and loads an evicted index again on its next use.  These checks
+-- size the budget to hold about one of three indexes, query them in
+-- turn, and read the eviction and reload counters of biscuit_index_stats().
+-- Every query compares the rows of a forced Biscuit scan with a
+-- sequential scan; any difference raises an exception.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Data & Indexes
+--   §3  No Limit
+--   §4  A Budget For About One Index
+--   §5  Writes To Evicted Indexes
+--   §6  A Budget Smaller Than Any Index
+--   §7  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_lru_data    CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+-- A counter from biscuit_index_stats(), e.g. 'Evictions' or 'This index'.
+CREATE OR REPLACE FUNCTION biscuit_lru_stat(p_index TEXT, p_field TEXT)
+RETURNS BIGINT
+LANGUAGE sql
+AS $$
+    SELECT substring(biscuit_index_stats(p_index::regclass::oid)
+                     FROM '\n *' || p_field || ': ([0-9]+)')::BIGINT
+$$;
+
+-- The queries for one index; each call is one statement, so one transaction.
+CREATE OR REPLACE FUNCTION biscuit_lru_checks(p_step TEXT, p_column TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_index TEXT := 'biscuit_lru_' || p_column || '_idx';
+BEGIN
+    PERFORM biscuit_ops_check(format('%s: %s prefix', p_step, p_column),
+        format($q$SELECT id::TEXT FROM biscuit_lru_data WHERE %I LIKE 'k1%%'$q$, p_column),
+        v_index);
+    PERFORM biscuit_ops_check(format('%s: %s infix', p_step, p_column),
+        format($q$SELECT id::TEXT FROM biscuit_lru_data WHERE %I LIKE '%%-3_7%%'$q$, p_column),
+        v_index);
+    PERFORM biscuit_ops_check(format('%s: %s ILIKE', p_step, p_column),
+        format($q$SELECT %I FROM biscuit_lru_data WHERE %I ILIKE '%%NEW%%'$q$, p_column, p_column),
+        v_index);
+END;
+$$;
+
+
+-- =============================================================================
+-- §2  DATA & INDEXES
+-- =============================================================================
+
+CREATE TABLE biscuit_lru_data (
+    id  INT PRIMARY KEY,
+    a   TEXT,
+    b   TEXT,
+    c   TEXT
+);
+
+INSERT INTO biscuit_lru_data
+SELECT g, 'k' || (g % 97) || '-a-' || g, 'k' || (g % 89) || '-b-' || g || '-' || (g % 7),
+       'k' || (g % 83) || '-c-' || (g * 7) % 10007
+FROM generate_series(1, 20000) g;
+
+CREATE INDEX biscuit_lru_a_idx ON biscuit_lru_data USING biscuit (a);
+CREATE INDEX biscuit_lru_b_idx ON biscuit_lru_data USING biscuit (b);
+CREATE INDEX biscuit_lru_c_idx ON biscuit_lru_data USING biscuit (c);
+VACUUM ANALYZE biscuit_lru_data;
+
+
+-- =============================================================================
+-- §3  NO LIMIT
+-- =============================================================================
+
+SET biscuit.cache_memory_limit = 0;
+
+SELECT biscuit_lru_checks('no limit', 'a');
+SELECT biscuit_lru_checks('no limit', 'b');
+SELECT biscuit_lru_checks('no limit', 'c');
+
+DO $$
+DECLARE
+    v_column TEXT;
+BEGIN
+    FOREACH v_column IN ARRAY ARRAY['a', 'b', 'c'] LOOP
+        IF biscuit_lru_stat('biscuit_lru_' || v_column || '_idx', 'Evictions') <> 0 OR
+           biscuit_lru_stat('biscuit_lru_' || v_column || '_idx', 'This index') = 0 THEN
+            RAISE EXCEPTION '[no limit] expected a cached copy and no eviction:%',
+                E'\n' || biscuit_index_stats(('biscuit_lru_' || v_column || '_idx')::regclass::oid);
+        END IF;
+    END LOOP;
+END $$;
+
+
+-- =============================================================================
+-- §4  A BUDGET FOR ABOUT ONE INDEX
+-- =============================================================================
+-- One and a half times the largest copy: any two copies exceed it, so
+-- querying the indexes in turn evicts the one used longest ago.  The
+-- limit is enforced when a copy enters the cache, not on every lookup:
+-- REINDEX makes the copies cached above obsolete, so each is loaded
+-- again under the budget.
+
+SELECT set_config('biscuit.cache_memory_limit',
+    (greatest(biscuit_lru_stat('biscuit_lru_a_idx', 'This index'),
+              biscuit_lru_stat('biscuit_lru_b_idx', 'This index'),
+              biscuit_lru_stat('biscuit_lru_c_idx', 'This index')) * 3 / 2 / 1024 + 1)::TEXT,
+    false);
+REINDEX TABLE biscuit_lru_data;
+
+SELECT biscuit_lru_checks('budget', 'a');
+SELECT biscuit_lru_checks('budget', 'b');
+SELECT biscuit_lru_checks('budget', 'c');
+SELECT biscuit_lru_checks('budget, second round', 'a');
+SELECT biscuit_lru_checks('budget, second round', 'b');
+SELECT biscuit_lru_checks('budget, second round', 'c');
+
+DO $$
+DECLARE
+    v_column TEXT;
+    v_index  TEXT;
+    v_cached TEXT[];
+BEGIN
+    FOREACH v_column IN ARRAY ARRAY['a', 'b', 'c'] LOOP
+        v_index := 'biscuit_lru_' || v_column || '_idx';
+        IF biscuit_lru_stat(v_index, 'Evictions') = 0 OR
+           biscuit_lru_stat(v_index, 'Reloads') = 0 THEN
+            RAISE EXCEPTION '[budget] expected % to be evicted and loaded again:%', v_index,
+                E'\n' || biscuit_index_stats(v_index::regclass::oid);
+        END IF;
+
+        -- biscuit_index_stats() loaded it last: the copy it reports fits
+        v_cached := regexp_match(biscuit_index_stats(v_index::regclass::oid),
+                                 'All indexes: ([0-9]+) of ([0-9]+) kB');
+        IF v_cached IS NULL OR v_cached[1]::BIGINT > v_cached[2]::BIGINT * 1024 THEN
+            RAISE EXCEPTION '[budget] the cache is over its limit:%',
+                E'\n' || biscuit_index_stats(v_index::regclass::oid);
+        END IF;
+    END LOOP;
+END $$;
+
+
+-- =============================================================================
+-- §5  WRITES TO EVICTED INDEXES
+-- =============================================================================
+-- Each statement maintains all three indexes while the budget holds
+-- about one; the copies evicted meanwhile must come back with the rows.
+
+INSERT INTO biscuit_lru_data
+SELECT g, 'k1-new-a-' || g, 'k1-new-b-' || g, 'k1-new-c-' || g
+FROM generate_series(30001, 30500) g;
+UPDATE biscuit_lru_data SET b = 'k3-new-b-' || id WHERE id % 11 = 0;
+DELETE FROM biscuit_lru_data WHERE id % 13 = 0;
+
+SELECT biscuit_lru_checks('after DML', 'a');
+SELECT biscuit_lru_checks('after DML', 'b');
+SELECT biscuit_lru_checks('after DML', 'c');
+
+VACUUM biscuit_lru_data;
+SELECT biscuit_lru_checks('after VACUUM', 'c');
+SELECT biscuit_lru_checks('after VACUUM', 'b');
+SELECT biscuit_lru_checks('after VACUUM', 'a');
+
+
+-- =============================================================================
+-- §6  A BUDGET SMALLER THAN ANY INDEX
+-- =============================================================================
+-- The copy in use is never evicted, so every scan still has one.
+
+SET biscuit.cache_memory_limit = 1;
+
+SELECT biscuit_lru_checks('tiny budget', 'a');
+SELECT biscuit_lru_checks('tiny budget', 'b');
+SELECT biscuit_lru_checks('tiny budget', 'a');
+
+RESET biscuit.cache_memory_limit;
+SELECT biscuit_lru_checks('limit reset', 'c');
+
+
+-- =============================================================================
+-- §7  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit index cache memory limit regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;
@@ -0,0 +1,337 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - VACUUM COMPACTION REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit, dblink (§6 reads the compacted snapshot)
+-- =============================================================================
+-- VACUUM removes dead records from every bitmap at once, and when they
+-- leave more than a tenth of the slots free it renumbers the live records
+-- in heap order.  These checks delete and update rows in patterns that
+-- leave holes all over the record space, vacuum, and compare the rows of
+-- forced Biscuit scans with a sequential scan before and after.  Any
+-- difference raises an exception; so does a VACUUM that should have
+-- compacted the index and left free slots.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Data & Indexes
+--   §3  Deletes Below The Threshold
+--   §4  Deletes Past The Threshold
+--   §5  Updates, Inserts And A Second Compaction
+--   §6  A New Session Loads The Compacted Snapshot
+--   §7  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_cmp_data    CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+CREATE EXTENSION IF NOT EXISTS dblink;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+-- A counter from biscuit_index_stats(), e.g. 'Free slots' or 'Total slots'.
+CREATE OR REPLACE FUNCTION biscuit_cmp_stat(p_index TEXT, p_field TEXT)
+RETURNS BIGINT
+LANGUAGE sql
+AS $$
+    SELECT substring(biscuit_index_stats(p_index::regclass::oid)
+                     FROM '\n *' || p_field || ': ([0-9]+)')::BIGINT
+$$;
+
+-- Raise unless VACUUM left both indexes without holes, in heap order.
+CREATE OR REPLACE FUNCTION biscuit_cmp_expect_compacted(p_step TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_index TEXT;
+BEGIN
+    FOREACH v_index IN ARRAY ARRAY['biscuit_cmp_name_idx', 'biscuit_cmp_multi_idx'] LOOP
+        IF biscuit_cmp_stat(v_index, 'Free slots') <> 0 OR
+           biscuit_cmp_stat(v_index, 'Tombstones') <> 0 OR
+           biscuit_cmp_stat(v_index, 'Total slots') <> (SELECT count(*) FROM biscuit_cmp_data) OR
+           biscuit_index_stats(v_index::regclass::oid) !~ '\nHeap ordered: yes' THEN
+            RAISE EXCEPTION '[%] % was not compacted:%', p_step, v_index,
+                E'\n' || biscuit_index_stats(v_index::regclass::oid);
+        END IF;
+    END LOOP;
+END;
+$$;
+
+-- The same queries at every step, on both indexes.
+CREATE OR REPLACE FUNCTION biscuit_cmp_checks(p_step TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_modes TEXT[] := ARRAY['index', 'bitmap', 'indexonly'];
+BEGIN
+    PERFORM biscuit_ops_check(p_step || ': every record',
+        $q$SELECT id::TEXT FROM biscuit_cmp_data WHERE name LIKE '%'$q$,
+        'biscuit_cmp_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': prefix',
+        $q$SELECT name FROM biscuit_cmp_data WHERE name LIKE 'plum-%'$q$,
+        'biscuit_cmp_name_idx', v_modes);
+    PERFORM biscuit_ops_check(p_step || ': infix',
+        $q$SELECT id::TEXT FROM biscuit_cmp_data WHERE name LIKE '%-2_1%'$q$,
+        'biscuit_cmp_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': suffix',
+        $q$SELECT id::TEXT FROM biscuit_cmp_data WHERE name LIKE '%9'$q$,
+        'biscuit_cmp_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': ILIKE',
+        $q$SELECT name FROM biscuit_cmp_data WHERE name ILIKE 'PEAR-%0'$q$,
+        'biscuit_cmp_name_idx', v_modes);
+    PERFORM biscuit_ops_check(p_step || ': NOT LIKE',
+        $q$SELECT id::TEXT FROM biscuit_cmp_data WHERE name NOT LIKE '%e%'$q$,
+        'biscuit_cmp_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': length',
+        $q$SELECT id::TEXT FROM biscuit_cmp_data WHERE name LIKE '____-__'$q$,
+        'biscuit_cmp_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': second column',
+        $q$SELECT tag || '/' || name FROM biscuit_cmp_data WHERE tag LIKE 'T1%'$q$,
+        'biscuit_cmp_multi_idx', v_modes);
+    PERFORM biscuit_ops_check(p_step || ': both columns',
+        $q$SELECT id::TEXT FROM biscuit_cmp_data WHERE name LIKE 'fig%' AND tag LIKE '%7'$q$,
+        'biscuit_cmp_multi_idx');
+    PERFORM biscuit_ops_check(p_step || ': count(*)',
+        $q$SELECT count(*)::TEXT FROM biscuit_cmp_data WHERE name LIKE '%-1%'$q$,
+        'biscuit_cmp_name_idx', v_modes);
+END;
+$$;
+
+
+-- =============================================================================
+-- §2  DATA & INDEXES
+-- =============================================================================
+
+CREATE TABLE biscuit_cmp_data (
+    id    INT PRIMARY KEY,
+    name  TEXT,
+    tag   TEXT
+);
+
+INSERT INTO biscuit_cmp_data
+SELECT g, (ARRAY['plum', 'pear', 'Pear', 'fig'])[1 + g % 4] || '-' || g,
+       'T' || (g % 53)::TEXT
+FROM generate_series(1, 12000) g;
+
+CREATE INDEX biscuit_cmp_name_idx  ON biscuit_cmp_data USING biscuit (name);
+CREATE INDEX biscuit_cmp_multi_idx ON biscuit_cmp_data USING biscuit (name, tag);
+VACUUM ANALYZE biscuit_cmp_data;
+
+SELECT biscuit_cmp_checks('before deletes');
+
+
+-- =============================================================================
+-- §3  DELETES BELOW THE THRESHOLD
+-- =============================================================================
+-- One row in fifty: VACUUM removes the records but keeps their slots
+-- for later inserts instead of renumbering.
+
+DELETE FROM biscuit_cmp_data WHERE id % 50 = 0;
+VACUUM biscuit_cmp_data;
+
+DO $$
+BEGIN
+    IF biscuit_cmp_stat('biscuit_cmp_name_idx', 'Total slots') <=
+       (SELECT count(*) FROM biscuit_cmp_data) THEN
+        RAISE EXCEPTION '[few deletes] compacted below the threshold:%',
+            E'\n' || biscuit_index_stats('biscuit_cmp_name_idx'::regclass::oid);
+    END IF;
+END $$;
+
+SELECT biscuit_cmp_checks('few deletes');
+
+
+-- =============================================================================
+-- §4  DELETES PAST THE THRESHOLD
+-- =============================================================================
+-- A third of the rows, scattered and in one range: VACUUM renumbers.
+
+DELETE FROM biscuit_cmp_data WHERE id % 3 = 1;
+DELETE FROM biscuit_cmp_data WHERE id BETWEEN 5000 AND 5999;
+SELECT biscuit_cmp_checks('many deletes, before VACUUM');
+
+VACUUM ANALYZE biscuit_cmp_data;
+SELECT biscuit_cmp_expect_compacted('many deletes');
+SELECT biscuit_cmp_checks('many deletes');
+
+
+-- =============================================================================
+-- §5  UPDATES, INSERTS AND A SECOND COMPACTION
+-- =============================================================================
+-- Inserts go into the renumbered space; updating most rows leaves their
+-- old versions dead, so the next VACUUM compacts again.
+
+INSERT INTO biscuit_cmp_data
+SELECT g, 'plum-new-' || g, 'T1-new'
+FROM generate_series(20001, 20500) g;
+SELECT biscuit_cmp_checks('inserts after compaction');
+
+UPDATE biscuit_cmp_data SET name = 'fig-upd-' || id WHERE id % 2 = 0;
+UPDATE biscuit_cmp_data SET tag = 'T17' WHERE id % 7 = 0;
+SELECT biscuit_cmp_checks('updates, before VACUUM');
+
+VACUUM ANALYZE biscuit_cmp_data;
+SELECT biscuit_cmp_expect_compacted('updates');
+SELECT biscuit_cmp_checks('updates');
+
+
+-- =============================================================================
+-- §6  A NEW SESSION LOADS THE COMPACTED SNAPSHOT
+-- =============================================================================
+
+SELECT dblink_connect('biscuit_cmp_peer', 'dbname=' || current_database());
+
+DO $$
+DECLARE
+    v_query    TEXT;
+    v_peer     BIGINT;
+    v_expected BIGINT;
+BEGIN
+    FOREACH v_query IN ARRAY ARRAY[
+        $q$SELECT count(*) FROM biscuit_cmp_data WHERE name LIKE 'plum-%'$q$,
+        $q$SELECT count(*) FROM biscuit_cmp_data WHERE name LIKE '%-2_1%'$q$,
+        $q$SELECT count(*) FROM biscuit_cmp_data WHERE name LIKE 'fig%' AND tag LIKE '%7'$q$
+    ] LOOP
+        EXECUTE v_query INTO v_expected;
+        SELECT n INTO v_peer
+        FROM dblink('biscuit_cmp_peer', 'SET enable_seqscan = off; ' || v_query) AS t(n BIGINT);
+        IF v_peer IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[new session] % returned %, expected %', v_query, v_peer, v_expected;
+        END IF;
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES ('new session: ' || v_query, 'peer', v_peer, v_expected);
+    END LOOP;
+END $$;
+
+SELECT dblink_disconnect('biscuit_cmp_peer');
+
+
+-- =============================================================================
+-- §7  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit VACUUM compaction regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;
@@ -0,0 +1,345 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - INDEX-ONLY SCAN REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit
+-- =============================================================================
+-- Index-only scans rebuild the indexed values from the string caches.
+-- Every check forces an Index Only Scan on a vacuumed table, checks the
+-- plan with EXPLAIN (COSTS OFF), and compares the values returned with a
+-- sequential scan, NULLs included.  Any difference raises an exception.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Data
+--   §3  Single-Column Index
+--   §4  Multi-Column Index & NULLs
+--   §5  No Heap Fetches After VACUUM
+--   §6  Rows Changed Since VACUUM
+--   §7  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_ios_data    CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+-- The Heap Fetches an index-only scan of p_query reports.
+CREATE OR REPLACE FUNCTION biscuit_ios_heap_fetches(p_query TEXT)
+RETURNS INT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line    TEXT;
+    v_fetches INT;
+BEGIN
+    PERFORM biscuit_ops_mode('indexonly');
+    FOR v_line IN EXECUTE 'EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF) ' || p_query LOOP
+        IF v_line ~ 'Heap Fetches: ' THEN
+            v_fetches := substring(v_line FROM 'Heap Fetches: ([0-9]+)')::INT;
+        END IF;
+    END LOOP;
+    PERFORM set_config('enable_seqscan',    'on', true);
+    PERFORM set_config('enable_indexscan',  'on', true);
+    PERFORM set_config('enable_bitmapscan', 'on', true);
+    RETURN v_fetches;
+END;
+$$;
+
+
+-- =============================================================================
+-- §2  DATA
+-- =============================================================================
+
+CREATE TABLE biscuit_ios_data (
+    id     INT PRIMARY KEY,
+    sku    TEXT,
+    label  VARCHAR(64),
+    note   TEXT
+);
+
+-- Every third note and every eleventh label is NULL; then empty strings,
+-- multibyte values and rows NULL in one column of the pair only.
+INSERT INTO biscuit_ios_data (id, sku, label, note)
+SELECT g,
+       (ARRAY['AB', 'AC', 'BX', 'ZZ'])[1 + g % 4] || '-' || lpad(g::TEXT, 5, '0'),
+       CASE WHEN g % 11 = 0 THEN NULL ELSE 'L' || (g % 40)::TEXT || '-' || (ARRAY['x', 'y', 'xy'])[1 + g % 3] END,
+       CASE WHEN g % 3 = 0 THEN NULL ELSE 'note ' || (g % 17)::TEXT END
+FROM generate_series(1, 6000) g;
+
+INSERT INTO biscuit_ios_data (id, sku, label, note) VALUES
+    (10001, '',           '',         ''),
+    (10002, NULL,         'L1-x',     'null sku'),
+    (10003, 'AB-été',     NULL,       'null label'),
+    (10004, 'AB-ÉTÉ',     'L1-x',     NULL),
+    (10005, 'Straße',     'Straße',   'Straße'),
+    (10006, 'naïve café', 'L1-xy',    ''),
+    (10007, NULL,         NULL,       NULL),
+    (10008, 'AB_%',       'L1-x',     'literal wildcards');
+
+CREATE INDEX biscuit_ios_sku_idx   ON biscuit_ios_data USING biscuit (sku);
+CREATE INDEX biscuit_ios_multi_idx ON biscuit_ios_data USING biscuit (label, note);
+
+-- Index-only scans need the visibility map set
+VACUUM ANALYZE biscuit_ios_data;
+
+
+-- =============================================================================
+-- §3  SINGLE-COLUMN INDEX
+-- =============================================================================
+
+SELECT biscuit_ops_check('sku prefix',
+    $q$SELECT sku FROM biscuit_ios_data WHERE sku LIKE 'AB-%'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('sku ILIKE multibyte',
+    $q$SELECT sku FROM biscuit_ios_data WHERE sku ILIKE '%été%'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('sku empty string',
+    $q$SELECT sku FROM biscuit_ios_data WHERE sku = ''$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('sku literal wildcards',
+    $q$SELECT sku FROM biscuit_ios_data WHERE sku LIKE 'AB\_\%'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('sku NOT LIKE skips NULLs',
+    $q$SELECT sku FROM biscuit_ios_data WHERE sku NOT LIKE '%0%'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('sku regex',
+    $q$SELECT sku FROM biscuit_ios_data WHERE sku ~ '^(BX|ZZ)-0012'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('sku expression over the value',
+    $q$SELECT upper(sku) || ':' || length(sku) FROM biscuit_ios_data WHERE sku LIKE '%9_'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('count(*)',
+    $q$SELECT count(*)::TEXT FROM biscuit_ios_data WHERE sku LIKE '%7'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+
+
+-- =============================================================================
+-- §4  MULTI-COLUMN INDEX & NULLS
+-- =============================================================================
+-- A key on one column returns the other as stored, NULL or not.  The
+-- first checks return the raw values, NULLs as array elements; the
+-- others render both columns into one string.
+
+SELECT biscuit_ops_check('note where label matches (NULL notes)',
+    $q$SELECT note FROM biscuit_ios_data WHERE label LIKE 'L1-%'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('label where note matches (NULL labels)',
+    $q$SELECT label::TEXT FROM biscuit_ios_data WHERE note LIKE 'null%'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('both columns',
+    $q$SELECT coalesce(label, '<null>') || '/' || coalesce(note, '<null>')
+       FROM biscuit_ios_data WHERE label ILIKE '%-XY'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('both columns, key on each',
+    $q$SELECT coalesce(label, '<null>') || '/' || coalesce(note, '<null>')
+       FROM biscuit_ios_data WHERE label LIKE 'L2%' AND note LIKE '%1_'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('empty strings are not NULL',
+    $q$SELECT coalesce(label, '<null>') || '/' || coalesce(note, '<null>')
+       FROM biscuit_ios_data WHERE note = ''$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('match-all pattern skips NULLs',
+    $q$SELECT coalesce(label, '<null>') || '/' || coalesce(note, '<null>')
+       FROM biscuit_ios_data WHERE note LIKE '%'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('multibyte in both columns',
+    $q$SELECT label || '/' || note FROM biscuit_ios_data WHERE label ILIKE 'STRAßE'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+
+DO $$
+BEGIN
+    IF (SELECT count(*) FROM biscuit_ios_data WHERE label LIKE 'L1-%' AND note IS NULL) = 0 THEN
+        RAISE EXCEPTION '[NULL coverage] no NULL note among the label matches';
+    END IF;
+END $$;
+
+
+-- =============================================================================
+-- §5  NO HEAP FETCHES AFTER VACUUM
+-- =============================================================================
+
+DO $$
+DECLARE
+    v_fetches INT;
+BEGIN
+    v_fetches := biscuit_ios_heap_fetches(
+        $q$SELECT sku FROM biscuit_ios_data WHERE sku LIKE 'AB-%'$q$);
+    IF v_fetches IS DISTINCT FROM 0 THEN
+        RAISE EXCEPTION '[heap fetches, single column] % after VACUUM', v_fetches;
+    END IF;
+
+    v_fetches := biscuit_ios_heap_fetches(
+        $q$SELECT note FROM biscuit_ios_data WHERE label LIKE 'L1-%'$q$);
+    IF v_fetches IS DISTINCT FROM 0 THEN
+        RAISE EXCEPTION '[heap fetches, multi-column] % after VACUUM', v_fetches;
+    END IF;
+
+    INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+    VALUES ('heap fetches, single column', 'plan', 0, 0),
+           ('heap fetches, multi-column', 'plan', 0, 0);
+END $$;
+
+
+-- =============================================================================
+-- §6  ROWS CHANGED SINCE VACUUM
+-- =============================================================================
+-- Updated and inserted rows are on pages no longer all-visible; their
+-- values still come from the index and must be the new ones.
+
+UPDATE biscuit_ios_data SET sku = 'AB-upd-' || id, note = NULL WHERE id % 97 = 0;
+UPDATE biscuit_ios_data SET label = NULL WHERE id % 89 = 0;
+INSERT INTO biscuit_ios_data (id, sku, label, note)
+SELECT 20000 + g, 'AB-new-' || g, CASE WHEN g % 2 = 0 THEN 'L1-new' END, 'new ' || g
+FROM generate_series(1, 200) g;
+DELETE FROM biscuit_ios_data WHERE id % 101 = 0;
+
+SELECT biscuit_ops_check('after DML: sku prefix',
+    $q$SELECT sku FROM biscuit_ios_data WHERE sku LIKE 'AB-%'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('after DML: note where label matches',
+    $q$SELECT note FROM biscuit_ios_data WHERE label LIKE 'L1-%'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('after DML: both columns',
+    $q$SELECT coalesce(label, '<null>') || '/' || coalesce(note, '<null>')
+       FROM biscuit_ios_data WHERE note LIKE 'new 1%'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+
+VACUUM ANALYZE biscuit_ios_data;
+SELECT biscuit_ops_check('after VACUUM: sku prefix',
+    $q$SELECT sku FROM biscuit_ios_data WHERE sku LIKE 'AB-%'$q$,
+    'biscuit_ios_sku_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('after VACUUM: both columns',
+    $q$SELECT coalesce(label, '<null>') || '/' || coalesce(note, '<null>')
+       FROM biscuit_ios_data WHERE label LIKE 'L1-%'$q$,
+    'biscuit_ios_multi_idx', ARRAY['indexonly']);
+
+
+-- =============================================================================
+-- §7  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit index-only scan regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;
@@ -0,0 +1,488 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - OPERATOR AND FRESHNESS REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit, dblink (§8 changes the table from a second session)
+-- =============================================================================
+-- Every check runs one query with the Biscuit index forced (plain index
+-- scan, bitmap scan, and index-only scan where asked), checks that the
+-- plan really uses the index, and compares the rows with a sequential
+-- scan of the same query.  Any difference raises an exception.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Data
+--   §3  Regular Expressions & SIMILAR TO
+--   §4  Equality, Prefix (^@) & = ANY
+--   §5  ILIKE Case Folding
+--   §6  Index-Only Scans
+--   §7  Pending List Merge
+--   §8  Change Log Replay After DML From Another Session
+--   §9  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_ops_pending CASCADE;
+DROP TABLE IF EXISTS biscuit_ops_data    CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+CREATE EXTENSION IF NOT EXISTS dblink;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+
+-- =============================================================================
+-- §2  DATA
+-- =============================================================================
+
+CREATE TABLE biscuit_ops_data (
+    id    INT PRIMARY KEY,
+    name  TEXT,
+    code  TEXT
+);
+
+-- Generated words, then hand-picked edge cases: empty strings, NULLs,
+-- LIKE and regex metacharacters, and letters whose case folding is not
+-- ASCII.
+INSERT INTO biscuit_ops_data (id, name, code)
+SELECT g,
+       (ARRAY['apple', 'apricot', 'banana', 'cabbage', 'abacus', 'abcd', 'xabcx',
+              'foobaz', 'barbaz', 'bazooka'])[1 + g % 10] || '-' || (g % 97)::TEXT,
+       'C' || lpad((g % 250)::TEXT, 3, '0') || (ARRAY['-red', '-green', '-blue'])[1 + g % 3]
+FROM generate_series(1, 5000) g;
+
+INSERT INTO biscuit_ops_data (id, name, code) VALUES
+    (10001, '',                  'EMPTY'),
+    (10002, NULL,                'NULL-NAME'),
+    (10003, 'abc',               NULL),
+    (10004, 'ABC',               'upper'),
+    (10005, 'AbC',               'mixed'),
+    (10006, '50% off',           'percent'),
+    (10007, 'under_score',       'underscore'),
+    (10008, 'dot.ted',           'dot'),
+    (10009, 'back\slash',        'backslash'),
+    (10010, 'Été',               'accent-upper'),
+    (10011, 'été',               'accent-lower'),
+    (10012, 'ÉTÉ',               'accent-all-upper'),
+    (10013, 'Straße',            'sharp-s'),
+    (10014, 'STRASSE',           'ss'),
+    (10015, 'ǅemal',             'titlecase'),
+    (10016, 'ǆemal',             'lowercase-digraph'),
+    (10017, 'ΣΊΣΥΦΟΣ',           'greek-upper'),
+    (10018, 'σίσυφος',           'greek-lower'),
+    (10019, 'İstanbul',          'dotted-i'),
+    (10020, 'istanbul',          'plain-i'),
+    (10021, 'naïve café',        'diaeresis'),
+    (10022, 'NAÏVE CAFÉ',        'diaeresis-upper'),
+    (10023, 'abcabcabc',         'repeat'),
+    (10024, 'a',                 'single');
+
+CREATE INDEX biscuit_ops_name_idx ON biscuit_ops_data USING biscuit (name);
+CREATE INDEX biscuit_ops_multi_idx ON biscuit_ops_data USING biscuit (code, name);
+
+-- Index-only scans need the visibility map set
+VACUUM ANALYZE biscuit_ops_data;
+
+
+-- =============================================================================
+-- §3  REGULAR EXPRESSIONS & SIMILAR TO
+-- =============================================================================
+
+SELECT biscuit_ops_check('regex anchored',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~ '^ab.*-1$'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('regex class',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~ 'a[bp]r?i'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('regex alternation',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~ '(foo|bar)baz-[0-9]$'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('regex escaped metacharacter',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~ 'dot\.t'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('regex quantifier',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~ '^(abc){2,}'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('regex matches everything',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~ '.*'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('regex case-insensitive',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~* '^(été|abc)$'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('regex case-insensitive greek',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~* 'σίσυφ'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('SIMILAR TO prefix',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name SIMILAR TO 'ap%'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('SIMILAR TO alternation',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name SIMILAR TO '%(foo|bazoo)_%-1_'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('SIMILAR TO escaped percent',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name SIMILAR TO '50\% %'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('regex on second column',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE code ~ '^C0[0-4]9-(red|blue)$'$q$,
+    'biscuit_ops_multi_idx');
+
+
+-- =============================================================================
+-- §4  EQUALITY, PREFIX (^@) & = ANY
+-- =============================================================================
+
+SELECT biscuit_ops_check('= match',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name = 'abc'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('= no match',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name = 'ab'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('= empty string',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name = ''$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('= metacharacters are literal',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name = 'under_score'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('= multibyte',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name = 'Straße'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('^@ prefix',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ^@ 'apri'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('^@ whole value',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ^@ 'abc'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('^@ empty prefix',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ^@ ''$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('^@ wildcard is literal',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ^@ '50%'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('= ANY',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name = ANY (ARRAY['abc', 'ABC', 'banana-7', 'missing'])$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('= ANY with NULL element',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name = ANY (ARRAY['a', NULL, ''])$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('IN list',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name IN ('été', 'Été', 'apple-1')$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('= on second column',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE code = 'C042-green'$q$,
+    'biscuit_ops_multi_idx');
+SELECT biscuit_ops_check('= ANY and LIKE on two columns',
+    $q$SELECT id::TEXT FROM biscuit_ops_data
+       WHERE code = ANY (ARRAY['C001-green', 'C002-blue']) AND name LIKE '%a%'$q$,
+    'biscuit_ops_multi_idx');
+
+
+-- =============================================================================
+-- §5  ILIKE CASE FOLDING
+-- =============================================================================
+
+SELECT biscuit_ops_check('ILIKE ASCII',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE 'abc'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('ILIKE accented',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE 'été'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('ILIKE accented infix',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE '%CAFÉ%'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('ILIKE sharp s',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE 'STRA%E'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('ILIKE titlecase digraph',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE 'ǄEMAL'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('ILIKE greek final sigma',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE 'σίσυφος'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('ILIKE dotted capital I',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE '%stanbul'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('ILIKE underscore over multibyte',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE '_T_'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('NOT ILIKE',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name NOT ILIKE '%a%'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('ILIKE on second column',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE code ILIKE '%-RED'$q$,
+    'biscuit_ops_multi_idx');
+
+
+-- =============================================================================
+-- §6  INDEX-ONLY SCANS
+-- =============================================================================
+-- The values come back from the string caches (store_strings = on), so
+-- they must be byte-for-byte the heap values.
+
+SELECT biscuit_ops_check('index-only LIKE',
+    $q$SELECT name FROM biscuit_ops_data WHERE name LIKE '%ba%'$q$,
+    'biscuit_ops_name_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('index-only ILIKE multibyte',
+    $q$SELECT name FROM biscuit_ops_data WHERE name ILIKE '%É%'$q$,
+    'biscuit_ops_name_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('index-only empty string',
+    $q$SELECT name FROM biscuit_ops_data WHERE name = ''$q$,
+    'biscuit_ops_name_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('index-only regex',
+    $q$SELECT name FROM biscuit_ops_data WHERE name ~ 'slash|score'$q$,
+    'biscuit_ops_name_idx', ARRAY['indexonly']);
+SELECT biscuit_ops_check('index-only both columns',
+    $q$SELECT code || '/' || name FROM biscuit_ops_data WHERE code LIKE 'C1%-blue'$q$,
+    'biscuit_ops_multi_idx', ARRAY['indexonly']);
+
+
+-- =============================================================================
+-- §7  PENDING LIST MERGE
+-- =============================================================================
+-- A 64 kB pending list: the first batch stays pending, the next ones
+-- overflow it and are merged into the bitmaps, and VACUUM merges the
+-- rest.  Rows are checked after each step, with updates and deletes of
+-- pending and merged records in between.
+
+CREATE TABLE biscuit_ops_pending (
+    id    INT PRIMARY KEY,
+    name  TEXT
+);
+CREATE INDEX biscuit_ops_pending_idx ON biscuit_ops_pending USING biscuit (name)
+    WITH (pending_list_limit = 64);
+
+CREATE OR REPLACE FUNCTION biscuit_ops_pending_checks(p_step TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM biscuit_ops_check(p_step || ': LIKE infix',
+        $q$SELECT id::TEXT FROM biscuit_ops_pending WHERE name LIKE '%ear%'$q$,
+        'biscuit_ops_pending_idx');
+    PERFORM biscuit_ops_check(p_step || ': NOT LIKE',
+        $q$SELECT id::TEXT FROM biscuit_ops_pending WHERE name NOT LIKE 'p%'$q$,
+        'biscuit_ops_pending_idx');
+    PERFORM biscuit_ops_check(p_step || ': ILIKE',
+        $q$SELECT id::TEXT FROM biscuit_ops_pending WHERE name ILIKE 'PEAR-1%'$q$,
+        'biscuit_ops_pending_idx');
+    PERFORM biscuit_ops_check(p_step || ': =',
+        $q$SELECT id::TEXT FROM biscuit_ops_pending WHERE name = 'plum-7'$q$,
+        'biscuit_ops_pending_idx');
+    PERFORM biscuit_ops_check(p_step || ': regex',
+        $q$SELECT id::TEXT FROM biscuit_ops_pending WHERE name ~ '^(pear|fig)-[0-9]+5$'$q$,
+        'biscuit_ops_pending_idx');
+END;
+$$;
+
+-- Small enough to stay on the pending list
+INSERT INTO biscuit_ops_pending
+SELECT g, (ARRAY['pear', 'plum', 'fig', 'Pear'])[1 + g % 4] || '-' || g
+FROM generate_series(1, 200) g;
+SELECT biscuit_ops_pending_checks('pending');
+
+-- Overflows the pending list several times
+INSERT INTO biscuit_ops_pending
+SELECT g, (ARRAY['pear', 'plum', 'fig', 'Pear'])[1 + g % 4] || '-' || g
+FROM generate_series(201, 20000) g;
+SELECT biscuit_ops_pending_checks('merged');
+
+-- Updates and deletes of merged and pending records
+UPDATE biscuit_ops_pending SET name = 'fig-' || id WHERE id % 7 = 0;
+DELETE FROM biscuit_ops_pending WHERE id % 11 = 0;
+INSERT INTO biscuit_ops_pending
+SELECT g, 'pearl-' || g FROM generate_series(20001, 20100) g;
+SELECT biscuit_ops_pending_checks('after DML');
+
+VACUUM ANALYZE biscuit_ops_pending;
+SELECT biscuit_ops_pending_checks('after VACUUM');
+
+
+-- =============================================================================
+-- §8  CHANGE LOG REPLAY AFTER DML FROM ANOTHER SESSION
+-- =============================================================================
+-- This session holds warm copies of both indexes (the checks above
+-- loaded them).  A second session changes the table through dblink; the
+-- copies here must replay its change log entries before the next scan.
+
+SELECT dblink_connect('biscuit_ops_peer', 'dbname=' || current_database());
+
+SELECT dblink_exec('biscuit_ops_peer', $q$
+    INSERT INTO biscuit_ops_data (id, name, code)
+    SELECT 20000 + g, 'peer-' || g || '-abc', 'P' || lpad(g::TEXT, 3, '0')
+    FROM generate_series(1, 300) g
+$q$);
+SELECT biscuit_ops_check('peer insert',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name LIKE 'peer-%abc'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('peer insert, second column',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE code ^@ 'P1'$q$,
+    'biscuit_ops_multi_idx');
+
+SELECT dblink_exec('biscuit_ops_peer', $q$
+    UPDATE biscuit_ops_data SET name = 'peer-moved-' || id WHERE id BETWEEN 20001 AND 20050
+$q$);
+SELECT biscuit_ops_check('peer update, old values gone',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ~ '^peer-[0-9]+-abc$'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('peer update, new values found',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name ILIKE 'PEER-MOVED-%'$q$,
+    'biscuit_ops_name_idx');
+
+-- VACUUM logs the removed TIDs for the copies to replay
+SELECT dblink_exec('biscuit_ops_peer', $q$
+    DELETE FROM biscuit_ops_data WHERE id % 3 = 0
+$q$);
+SELECT dblink_exec('biscuit_ops_peer', 'VACUUM biscuit_ops_data');
+SELECT biscuit_ops_check('peer delete and vacuum',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name LIKE '%a%'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('peer delete and vacuum, NOT LIKE',
+    $q$SELECT id::TEXT FROM biscuit_ops_data WHERE name NOT LIKE '%a%'$q$,
+    'biscuit_ops_name_idx');
+SELECT biscuit_ops_check('peer delete and vacuum, index-only',
+    $q$SELECT name FROM biscuit_ops_data WHERE name LIKE 'peer%'$q$,
+    'biscuit_ops_name_idx', ARRAY['indexonly']);
+
+-- Changes made here must reach the peer's copy the same way
+INSERT INTO biscuit_ops_data (id, name, code) VALUES (30001, 'local-xyz', 'LOCAL');
+DO $$
+DECLARE
+    v_peer INT;
+BEGIN
+    SELECT n INTO v_peer
+    FROM dblink('biscuit_ops_peer', $q$
+        SET enable_seqscan = off;
+        SELECT count(*)::INT FROM biscuit_ops_data WHERE name LIKE '%xyz'
+    $q$) AS t(n INT);
+    IF v_peer IS DISTINCT FROM 1 THEN
+        RAISE EXCEPTION '[local insert] peer session found % rows, expected 1', v_peer;
+    END IF;
+END $$;
+
+SELECT dblink_disconnect('biscuit_ops_peer');
+
+
+-- =============================================================================
+-- §9  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit operator regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;
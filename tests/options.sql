@@ -0,0 +1,430 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - INDEX OPTION REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit
+-- =============================================================================
+-- Every indexed column holds the same values and carries one Biscuit index
+-- built with different storage parameters.  Each check forces the index
+-- (plain and bitmap scans, index-only where the option allows it) and
+-- compares the rows with a sequential scan: patterns the built structures
+-- cannot answer must still come back exact, verified against the strings
+-- or rechecked by the executor.  Any difference raises an exception.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Data & Indexes
+--   §3  Patterns Under Every Option
+--   §4  Index-Only Scans
+--   §5  Fallback To Recheck Or Sequential Scan
+--   §6  Option Validation
+--   §7  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_opts_data   CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+-- The EXPLAIN ANALYZE output of p_query as one string, without timings.
+CREATE OR REPLACE FUNCTION biscuit_opts_analyze(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+-- Raise unless p_sql fails with invalid_parameter_value mentioning p_message.
+CREATE OR REPLACE FUNCTION biscuit_opts_rejects(p_label TEXT, p_sql TEXT, p_message TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    BEGIN
+        EXECUTE p_sql;
+    EXCEPTION WHEN invalid_parameter_value THEN
+        IF position(p_message IN SQLERRM) = 0 THEN
+            RAISE EXCEPTION '[%] failed with "%", expected "%"', p_label, SQLERRM, p_message;
+        END IF;
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, 'validation', 0, 0);
+        RETURN;
+    END;
+    RAISE EXCEPTION '[%] was accepted: %', p_label, p_sql;
+END;
+$$;
+
+
+-- =============================================================================
+-- §2  DATA & INDEXES
+-- =============================================================================
+
+CREATE TABLE biscuit_opts_data (
+    id           INT PRIMARY KEY,
+    v_default    TEXT,
+    v_nolike     TEXT,
+    v_noilike    TEXT,
+    v_nosuffix   TEXT,
+    v_nostrings  TEXT,
+    v_short      TEXT,
+    v_bare       TEXT,
+    v_trigrams   TEXT
+);
+
+-- Generated words, then empty strings, NULLs, wildcards and letters whose
+-- case folding is not ASCII.  Every column gets the same value.
+WITH v(id, val) AS (
+    SELECT g,
+           (ARRAY['apple', 'apricot', 'banana', 'cabbage', 'abacus', 'abcd', 'xabcx',
+                  'foobaz', 'barbaz', 'bazooka'])[1 + g % 10] || '-' || (g % 97)::TEXT
+    FROM generate_series(1, 4000) g
+    UNION ALL
+    VALUES (10001, ''),
+           (10002, NULL),
+           (10003, 'abc'),
+           (10004, 'ABC'),
+           (10005, '50% off'),
+           (10006, 'under_score'),
+           (10007, 'Été'),
+           (10008, 'été'),
+           (10009, 'Straße'),
+           (10010, 'naïve café'),
+           (10011, 'NAÏVE CAFÉ'),
+           (10012, 'abcabcabc'),
+           (10013, 'a'),
+           (10014, 'a much longer value that runs past every position limit')
+)
+INSERT INTO biscuit_opts_data
+SELECT id, val, val, val, val, val, val, val, val FROM v;
+
+CREATE INDEX biscuit_opts_default_idx  ON biscuit_opts_data USING biscuit (v_default);
+CREATE INDEX biscuit_opts_nolike_idx   ON biscuit_opts_data USING biscuit (v_nolike)
+    WITH (like = off);
+CREATE INDEX biscuit_opts_noilike_idx  ON biscuit_opts_data USING biscuit (v_noilike)
+    WITH (ilike = off);
+CREATE INDEX biscuit_opts_nosuffix_idx ON biscuit_opts_data USING biscuit (v_nosuffix)
+    WITH (suffix_index = off);
+CREATE INDEX biscuit_opts_nostrings_idx ON biscuit_opts_data USING biscuit (v_nostrings)
+    WITH (store_strings = off);
+CREATE INDEX biscuit_opts_short_idx    ON biscuit_opts_data USING biscuit (v_short)
+    WITH (max_indexed_chars = 3);
+CREATE INDEX biscuit_opts_bare_idx     ON biscuit_opts_data USING biscuit (v_bare)
+    WITH (like = off, ilike = off, suffix_index = off, store_strings = off);
+CREATE INDEX biscuit_opts_trigrams_idx ON biscuit_opts_data USING biscuit (v_trigrams)
+    WITH (trigrams = on);
+
+-- Statistics for the costing checks, and the visibility map for §4
+VACUUM ANALYZE biscuit_opts_data;
+
+-- The options are stored with the index
+DO $$
+DECLARE
+    v_opts TEXT[];
+BEGIN
+    SELECT reloptions INTO v_opts FROM pg_class WHERE relname = 'biscuit_opts_bare_idx';
+    IF v_opts IS DISTINCT FROM
+       ARRAY['like=off', 'ilike=off', 'suffix_index=off', 'store_strings=off'] THEN
+        RAISE EXCEPTION '[reloptions] biscuit_opts_bare_idx has %', v_opts;
+    END IF;
+END $$;
+
+
+-- =============================================================================
+-- §3  PATTERNS UNDER EVERY OPTION
+-- =============================================================================
+-- Prefixes and suffixes longer and shorter than max_indexed_chars,
+-- infixes, multi-part and '_' patterns, and the patterns the length
+-- bitmaps answer alone, under LIKE, ILIKE and their negations.
+
+DO $$
+DECLARE
+    v_column  TEXT;
+    v_pattern TEXT;
+    v_op      TEXT;
+BEGIN
+    FOREACH v_column IN ARRAY ARRAY['default', 'nolike', 'noilike', 'nosuffix',
+                                    'nostrings', 'short', 'bare', 'trigrams'] LOOP
+        FOREACH v_pattern IN ARRAY ARRAY['ab%', 'apricot-4%', '%baz', '%zooka-12',
+                                         '%bc%', '%ap%co%-1%', 'a_c%', '%a_c',
+                                         'ba%az-_', '', '%', '___', 'abc', 'ABC',
+                                         '%É%', 'stra%e', '50\% %', '%position limit'] LOOP
+            FOREACH v_op IN ARRAY ARRAY['LIKE', 'ILIKE', 'NOT LIKE', 'NOT ILIKE'] LOOP
+                PERFORM biscuit_ops_check(
+                    format('%s: %s %L', v_column, v_op, v_pattern),
+                    format('SELECT id::TEXT FROM biscuit_opts_data WHERE v_%s %s %L',
+                           v_column, v_op, v_pattern),
+                    format('biscuit_opts_%s_idx', v_column));
+            END LOOP;
+        END LOOP;
+    END LOOP;
+END $$;
+
+-- Two keys on one column, one indexed and one not
+SELECT biscuit_ops_check('short: long prefix AND infix',
+    $q$SELECT id::TEXT FROM biscuit_opts_data WHERE v_short LIKE 'apricot%' AND v_short LIKE '%-4%'$q$,
+    'biscuit_opts_short_idx');
+SELECT biscuit_ops_check('bare: LIKE AND ILIKE',
+    $q$SELECT id::TEXT FROM biscuit_opts_data WHERE v_bare LIKE '%a%' AND v_bare ILIKE '%BAZ%'$q$,
+    'biscuit_opts_bare_idx');
+
+
+-- =============================================================================
+-- §4  INDEX-ONLY SCANS
+-- =============================================================================
+-- Values are rebuilt from the string caches, so only store_strings = on
+-- allows an index-only scan.
+
+DO $$
+DECLARE
+    v_column TEXT;
+BEGIN
+    FOREACH v_column IN ARRAY ARRAY['default', 'nolike', 'noilike', 'nosuffix',
+                                    'short', 'trigrams'] LOOP
+        PERFORM biscuit_ops_check(
+            format('%s: index-only', v_column),
+            format('SELECT v_%s FROM biscuit_opts_data WHERE v_%s ILIKE %L',
+                   v_column, v_column, '%a%'),
+            format('biscuit_opts_%s_idx', v_column), ARRAY['indexonly']);
+    END LOOP;
+END $$;
+
+DO $$
+DECLARE
+    v_column TEXT;
+    v_plan   TEXT;
+BEGIN
+    FOREACH v_column IN ARRAY ARRAY['nostrings', 'bare'] LOOP
+        PERFORM biscuit_ops_mode('indexonly');
+        v_plan := biscuit_ops_plan(format('SELECT v_%s FROM biscuit_opts_data WHERE v_%s LIKE %L',
+                                          v_column, v_column, 'ab%'));
+        IF position('Index Only Scan' IN v_plan) > 0 THEN
+            RAISE EXCEPTION '[%: no index-only scan] plan:%', v_column, E'\n' || v_plan;
+        END IF;
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (v_column || ': no index-only scan', 'plan', 0, 0);
+    END LOOP;
+    PERFORM set_config('enable_seqscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan', 'on', true);
+END $$;
+
+
+-- =============================================================================
+-- §5  FALLBACK TO RECHECK OR SEQUENTIAL SCAN
+-- =============================================================================
+-- Without the bitmaps for a pattern and without strings to verify it
+-- against, the index returns a superset for the executor to recheck, and
+-- the planner, costing it as selecting every row, prefers a sequential
+-- scan.  With the strings kept, the same pattern is verified in the index
+-- and nothing is left to recheck.
+
+DO $$
+DECLARE
+    v_plan TEXT;
+BEGIN
+    PERFORM biscuit_ops_mode('bitmap');
+    v_plan := biscuit_opts_analyze(
+        $q$SELECT id FROM biscuit_opts_data WHERE v_bare LIKE '%bazoo%'$q$);
+    IF v_plan !~ 'Rows Removed by Index Recheck: [1-9]' THEN
+        RAISE EXCEPTION '[bare: recheck] plan shows no rechecked rows:%', E'\n' || v_plan;
+    END IF;
+
+    v_plan := biscuit_opts_analyze(
+        $q$SELECT id FROM biscuit_opts_data WHERE v_nolike LIKE '%bazoo%'$q$);
+    IF v_plan ~ 'Rows Removed by Index Recheck: [1-9]' THEN
+        RAISE EXCEPTION '[nolike: verified] plan rechecked rows:%', E'\n' || v_plan;
+    END IF;
+
+    PERFORM set_config('enable_seqscan',    'on', true);
+    PERFORM set_config('enable_indexscan',  'on', true);
+    PERFORM set_config('enable_bitmapscan', 'on', true);
+    v_plan := biscuit_ops_plan(
+        $q$SELECT id FROM biscuit_opts_data WHERE v_bare LIKE '%bazoo%'$q$);
+    IF position('biscuit_opts_bare_idx' IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[bare: seqscan] planner chose the index:%', E'\n' || v_plan;
+    END IF;
+
+    INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+    VALUES ('bare: recheck', 'plan', 0, 0),
+           ('nolike: verified', 'plan', 0, 0),
+           ('bare: seqscan', 'plan', 0, 0);
+END $$;
+
+-- Index options changed later apply at the next REINDEX
+ALTER INDEX biscuit_opts_bare_idx SET (store_strings = on);
+REINDEX INDEX biscuit_opts_bare_idx;
+SELECT biscuit_ops_check('bare after REINDEX with strings: LIKE infix',
+    $q$SELECT id::TEXT FROM biscuit_opts_data WHERE v_bare LIKE '%bazoo%'$q$,
+    'biscuit_opts_bare_idx', ARRAY['index', 'bitmap', 'indexonly']);
+
+
+-- =============================================================================
+-- §6  OPTION VALIDATION
+-- =============================================================================
+
+SELECT biscuit_opts_rejects('boolean option',
+    'CREATE INDEX biscuit_opts_bad_idx ON biscuit_opts_data USING biscuit (v_default) WITH (like = maybe)',
+    'invalid value for boolean option "like"');
+SELECT biscuit_opts_rejects('trigrams is boolean',
+    'CREATE INDEX biscuit_opts_bad_idx ON biscuit_opts_data USING biscuit (v_default) WITH (trigrams = 2)',
+    'invalid value for boolean option "trigrams"');
+SELECT biscuit_opts_rejects('negative max_indexed_chars',
+    'CREATE INDEX biscuit_opts_bad_idx ON biscuit_opts_data USING biscuit (v_default) WITH (max_indexed_chars = -1)',
+    'value -1 out of bounds for option "max_indexed_chars"');
+SELECT biscuit_opts_rejects('non-integer max_indexed_chars',
+    'CREATE INDEX biscuit_opts_bad_idx ON biscuit_opts_data USING biscuit (v_default) WITH (max_indexed_chars = ten)',
+    'invalid value for integer option "max_indexed_chars"');
+SELECT biscuit_opts_rejects('negative pending_list_limit',
+    'CREATE INDEX biscuit_opts_bad_idx ON biscuit_opts_data USING biscuit (v_default) WITH (pending_list_limit = -5)',
+    'out of bounds for option "pending_list_limit"');
+SELECT biscuit_opts_rejects('unknown option',
+    'CREATE INDEX biscuit_opts_bad_idx ON biscuit_opts_data USING biscuit (v_default) WITH (suffixes = off)',
+    'unrecognized parameter "suffixes"');
+SELECT biscuit_opts_rejects('ALTER INDEX SET',
+    'ALTER INDEX biscuit_opts_short_idx SET (max_indexed_chars = -3)',
+    'out of bounds for option "max_indexed_chars"');
+
+-- Rejected statements leave nothing behind
+DO $$
+BEGIN
+    IF to_regclass('biscuit_opts_bad_idx') IS NOT NULL THEN
+        RAISE EXCEPTION '[validation] biscuit_opts_bad_idx exists';
+    END IF;
+END $$;
+
+
+-- =============================================================================
+-- §7  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit index option regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;
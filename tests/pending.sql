@@ -0,0 +1,302 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - PENDING LIST REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit
+-- =============================================================================
+-- Inserts go to a pending list that is merged into the bitmaps once it
+-- passes pending_list_limit.  These checks drive an index across that
+-- threshold so it holds pending and merged records at once, then query,
+-- delete and vacuum it.  Every check compares the rows of a forced
+-- Biscuit scan with a sequential scan; the rows are compared as sorted
+-- arrays, so a record returned twice (from the pending list and from the
+-- bitmaps) or not at all raises an exception.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Pending Records Only
+--   §3  Past The Threshold: Pending And Merged Records
+--   §4  Updates And Deletes
+--   §5  VACUUM
+--   §6  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_pend_data   CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+-- A counter from biscuit_index_stats(), e.g. 'Pending' or 'Pending merges'.
+CREATE OR REPLACE FUNCTION biscuit_pend_stat(p_index TEXT, p_field TEXT)
+RETURNS BIGINT
+LANGUAGE sql
+AS $$
+    SELECT substring(biscuit_index_stats(p_index::regclass::oid)
+                     FROM '\n *' || p_field || ': ([0-9]+)')::BIGINT
+$$;
+
+-- The same queries at every step: pending and merged records match each.
+CREATE OR REPLACE FUNCTION biscuit_pend_checks(p_step TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_modes TEXT[] := ARRAY['index', 'bitmap', 'indexonly'];
+BEGIN
+    PERFORM biscuit_ops_check(p_step || ': every record',
+        $q$SELECT id::TEXT FROM biscuit_pend_data WHERE name LIKE '%'$q$,
+        'biscuit_pend_idx');
+    PERFORM biscuit_ops_check(p_step || ': prefix',
+        $q$SELECT name FROM biscuit_pend_data WHERE name LIKE 'kiwi-%'$q$,
+        'biscuit_pend_idx', v_modes);
+    PERFORM biscuit_ops_check(p_step || ': infix',
+        $q$SELECT id::TEXT FROM biscuit_pend_data WHERE name LIKE '%i-1%'$q$,
+        'biscuit_pend_idx');
+    PERFORM biscuit_ops_check(p_step || ': suffix',
+        $q$SELECT id::TEXT FROM biscuit_pend_data WHERE name LIKE '%7'$q$,
+        'biscuit_pend_idx');
+    PERFORM biscuit_ops_check(p_step || ': ILIKE',
+        $q$SELECT name FROM biscuit_pend_data WHERE name ILIKE 'LIME-%'$q$,
+        'biscuit_pend_idx', v_modes);
+    PERFORM biscuit_ops_check(p_step || ': NOT LIKE',
+        $q$SELECT id::TEXT FROM biscuit_pend_data WHERE name NOT LIKE 'kiwi%'$q$,
+        'biscuit_pend_idx');
+    PERFORM biscuit_ops_check(p_step || ': =',
+        $q$SELECT id::TEXT FROM biscuit_pend_data WHERE name = 'kiwi-5'$q$,
+        'biscuit_pend_idx');
+    PERFORM biscuit_ops_check(p_step || ': count(*)',
+        $q$SELECT count(*)::TEXT FROM biscuit_pend_data WHERE name LIKE '%e-%'$q$,
+        'biscuit_pend_idx', v_modes);
+END;
+$$;
+
+CREATE TABLE biscuit_pend_data (
+    id    INT PRIMARY KEY,
+    name  TEXT
+);
+
+-- 64 kB: a few hundred short values stay pending, a few thousand do not.
+-- VACUUM merges the list, so the table is not vacuumed before §5.
+CREATE INDEX biscuit_pend_idx ON biscuit_pend_data USING biscuit (name)
+    WITH (pending_list_limit = 64);
+
+
+-- =============================================================================
+-- §2  PENDING RECORDS ONLY
+-- =============================================================================
+
+INSERT INTO biscuit_pend_data
+SELECT g, (ARRAY['kiwi', 'lime', 'Lime', 'date'])[1 + g % 4] || '-' || g
+FROM generate_series(1, 150) g;
+
+DO $$
+BEGIN
+    IF biscuit_pend_stat('biscuit_pend_idx', 'Pending') = 0 OR
+       biscuit_pend_stat('biscuit_pend_idx', 'Pending merges') <> 0 THEN
+        RAISE EXCEPTION '[pending only] expected pending records and no merge:%',
+            E'\n' || biscuit_index_stats('biscuit_pend_idx'::regclass::oid);
+    END IF;
+END $$;
+
+SELECT biscuit_pend_checks('pending only');
+
+
+-- =============================================================================
+-- §3  PAST THE THRESHOLD: PENDING AND MERGED RECORDS
+-- =============================================================================
+-- The large batch overflows the list and is merged; the small one after
+-- it starts a new list on top of the merged records.
+
+INSERT INTO biscuit_pend_data
+SELECT g, (ARRAY['kiwi', 'lime', 'Lime', 'date'])[1 + g % 4] || '-' || g
+FROM generate_series(151, 12000) g;
+INSERT INTO biscuit_pend_data
+SELECT g, (ARRAY['kiwi', 'lime', 'Lime', 'date'])[1 + g % 4] || '-' || g
+FROM generate_series(12001, 12040) g;
+
+DO $$
+BEGIN
+    IF biscuit_pend_stat('biscuit_pend_idx', 'Pending') = 0 OR
+       biscuit_pend_stat('biscuit_pend_idx', 'Pending merges') = 0 THEN
+        RAISE EXCEPTION '[pending and merged] expected both:%',
+            E'\n' || biscuit_index_stats('biscuit_pend_idx'::regclass::oid);
+    END IF;
+END $$;
+
+SELECT biscuit_pend_checks('pending and merged');
+
+-- Both kinds of record match one pattern, each exactly once
+SELECT biscuit_ops_check('pending and merged: kiwi-1200x',
+    $q$SELECT id::TEXT FROM biscuit_pend_data WHERE name LIKE 'kiwi-1200_'$q$,
+    'biscuit_pend_idx', ARRAY['index', 'bitmap', 'indexonly']);
+
+
+-- =============================================================================
+-- §4  UPDATES AND DELETES
+-- =============================================================================
+-- Rows written by the first batches are merged, the last ones pending.
+-- New versions of both kinds go to the pending list; old versions and
+-- deleted rows must not come back.
+
+UPDATE biscuit_pend_data SET name = 'kiwi-moved-' || id WHERE id % 13 = 0;
+DELETE FROM biscuit_pend_data WHERE id % 7 = 0;
+DELETE FROM biscuit_pend_data WHERE id BETWEEN 12010 AND 12020;
+SELECT biscuit_pend_checks('after DML');
+
+-- Before VACUUM the dead versions are still in the index; after it they
+-- are gone, and the pending list is merged
+VACUUM ANALYZE biscuit_pend_data;
+
+
+-- =============================================================================
+-- §5  VACUUM
+-- =============================================================================
+
+DO $$
+BEGIN
+    IF biscuit_pend_stat('biscuit_pend_idx', 'Pending') <> 0 THEN
+        RAISE EXCEPTION '[after VACUUM] pending list not merged:%',
+            E'\n' || biscuit_index_stats('biscuit_pend_idx'::regclass::oid);
+    END IF;
+END $$;
+
+SELECT biscuit_pend_checks('after VACUUM');
+
+-- A fresh pending list over the vacuumed index, then a second VACUUM
+INSERT INTO biscuit_pend_data
+SELECT g, 'kiwi-new-' || g FROM generate_series(13001, 13050) g;
+DELETE FROM biscuit_pend_data WHERE id BETWEEN 13001 AND 13010;
+SELECT biscuit_pend_checks('pending after VACUUM');
+
+VACUUM biscuit_pend_data;
+SELECT biscuit_pend_checks('second VACUUM');
+
+
+-- =============================================================================
+-- §6  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit pending list regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;
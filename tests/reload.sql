@@ -0,0 +1,387 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - SNAPSHOT RELOAD REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit, dblink (new sessions load the index from disk)
+-- =============================================================================
+-- CREATE INDEX and VACUUM write the whole index to the index relation,
+-- and a session that has no copy yet loads it from there.  A new session
+-- opened through dblink stands in for a restarted server: it has nothing
+-- cached and must answer from the snapshot, valid or stale with the
+-- change log replayed on top.  This session's own copy must survive
+-- relcache invalidations, and be loaded again when an option it was
+-- built with changes.  Every check compares the rows of a forced Biscuit
+-- scan with a sequential scan in this session; any difference raises an
+-- exception.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Data & Index
+--   §3  A New Session Loads The Snapshot
+--   §4  Relcache Invalidation In This Session
+--   §5  A New Session Loads A Stale Snapshot
+--   §6  VACUUM Writes A Valid Snapshot Again
+--   §7  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_rel_data    CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+CREATE EXTENSION IF NOT EXISTS dblink;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+-- The on-disk snapshot state biscuit_index_stats() reports: valid or stale.
+CREATE OR REPLACE FUNCTION biscuit_rel_state(p_stats TEXT)
+RETURNS TEXT
+LANGUAGE sql
+AS $$
+    SELECT substring(p_stats FROM '\n *State: ([a-z]+)')
+$$;
+
+-- biscuit_index_stats() as the peer session sees it.
+CREATE OR REPLACE FUNCTION biscuit_rel_peer_stats(p_index TEXT)
+RETURNS TEXT
+LANGUAGE sql
+AS $$
+    SELECT s FROM dblink('biscuit_rel_peer',
+        format('SELECT biscuit_index_stats(%L::regclass::oid)', p_index)) AS t(s TEXT)
+$$;
+
+-- Open the peer session, which has no copy of any index yet.
+CREATE OR REPLACE FUNCTION biscuit_rel_peer_open()
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    IF 'biscuit_rel_peer' = ANY (coalesce(dblink_get_connections(), '{}')) THEN
+        PERFORM dblink_disconnect('biscuit_rel_peer');
+    END IF;
+    PERFORM dblink_connect('biscuit_rel_peer', 'dbname=' || current_database());
+    PERFORM dblink_exec('biscuit_rel_peer', 'SET enable_seqscan = off');
+    PERFORM dblink_exec('biscuit_rel_peer', 'SET enable_bitmapscan = off');
+    PERFORM dblink_exec('biscuit_rel_peer', 'SET enable_indexonlyscan = off');
+END;
+$$;
+
+/*
+ * Run p_query in the peer session with p_index forced, and raise if the
+ * plan does not use it or if the rows differ from a sequential scan here.
+ */
+CREATE OR REPLACE FUNCTION biscuit_rel_peer_check(p_label TEXT, p_query TEXT, p_index TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_plan     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_expected := biscuit_ops_rows(p_query);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+
+    SELECT string_agg(line, E'\n') INTO v_plan
+    FROM dblink('biscuit_rel_peer', 'EXPLAIN (COSTS OFF) ' || p_query) AS t(line TEXT);
+    IF position('Index Scan using ' || p_index IN v_plan) = 0 THEN
+        RAISE EXCEPTION '[%] peer plan does not use %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+
+    SELECT r INTO v_actual
+    FROM dblink('biscuit_rel_peer',
+        format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query))
+        AS t(r TEXT[]);
+    INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+    VALUES (p_label, 'peer', cardinality(v_actual), cardinality(v_expected));
+
+    IF v_actual IS DISTINCT FROM v_expected THEN
+        RAISE EXCEPTION '[%] peer scan returned % rows, sequential scan %: missing %, extra %',
+            p_label, cardinality(v_actual), cardinality(v_expected),
+            (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+            (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+    END IF;
+END;
+$$;
+
+-- The same queries at every step, here (p_peer false) or in the peer.
+CREATE OR REPLACE FUNCTION biscuit_rel_checks(p_step TEXT, p_peer BOOLEAN)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_queries TEXT[][] := ARRAY[
+        ARRAY['prefix',   $q$SELECT id::TEXT FROM biscuit_rel_data WHERE name LIKE 'amber-%'$q$],
+        ARRAY['infix',    $q$SELECT id::TEXT FROM biscuit_rel_data WHERE name LIKE '%r-1_3%'$q$],
+        ARRAY['suffix',   $q$SELECT id::TEXT FROM biscuit_rel_data WHERE name LIKE '%-x'$q$],
+        ARRAY['ILIKE',    $q$SELECT id::TEXT FROM biscuit_rel_data WHERE name ILIKE 'CORAL%Y'$q$],
+        ARRAY['NOT LIKE', $q$SELECT id::TEXT FROM biscuit_rel_data WHERE name NOT LIKE '%e%'$q$],
+        ARRAY['=',        $q$SELECT id::TEXT FROM biscuit_rel_data WHERE name = 'jade-42-y'$q$],
+        ARRAY['values',   $q$SELECT name FROM biscuit_rel_data WHERE name LIKE 'jade-1%'$q$]
+    ];
+    i INT;
+BEGIN
+    FOR i IN 1 .. array_length(v_queries, 1) LOOP
+        IF p_peer THEN
+            PERFORM biscuit_rel_peer_check(p_step || ': ' || v_queries[i][1],
+                                           v_queries[i][2], 'biscuit_rel_idx');
+        ELSE
+            PERFORM biscuit_ops_check(p_step || ': ' || v_queries[i][1],
+                                      v_queries[i][2], 'biscuit_rel_idx');
+        END IF;
+    END LOOP;
+END;
+$$;
+
+
+-- =============================================================================
+-- §2  DATA & INDEX
+-- =============================================================================
+
+CREATE TABLE biscuit_rel_data (
+    id    INT PRIMARY KEY,
+    name  TEXT
+);
+
+INSERT INTO biscuit_rel_data
+SELECT g, (ARRAY['amber', 'coral', 'jade', 'Coral'])[1 + g % 4] || '-' || g || '-' ||
+          (ARRAY['x', 'y', 'xy'])[1 + g % 3]
+FROM generate_series(1, 8000) g;
+INSERT INTO biscuit_rel_data VALUES (9001, ''), (9002, NULL), (9003, 'été-x');
+
+CREATE INDEX biscuit_rel_idx ON biscuit_rel_data USING biscuit (name);
+ANALYZE biscuit_rel_data;
+
+DO $$
+BEGIN
+    IF biscuit_rel_state(biscuit_index_stats('biscuit_rel_idx'::regclass::oid))
+       IS DISTINCT FROM 'valid' THEN
+        RAISE EXCEPTION '[after CREATE INDEX] expected a valid snapshot:%',
+            E'\n' || biscuit_index_stats('biscuit_rel_idx'::regclass::oid);
+    END IF;
+END $$;
+
+
+-- =============================================================================
+-- §3  A NEW SESSION LOADS THE SNAPSHOT
+-- =============================================================================
+
+SELECT biscuit_rel_peer_open();
+SELECT biscuit_rel_checks('new session', true);
+
+DO $$
+BEGIN
+    IF biscuit_rel_state(biscuit_rel_peer_stats('biscuit_rel_idx')) IS DISTINCT FROM 'valid' THEN
+        RAISE EXCEPTION '[new session] loading the index changed the snapshot:%',
+            E'\n' || biscuit_rel_peer_stats('biscuit_rel_idx');
+    END IF;
+END $$;
+
+
+-- =============================================================================
+-- §4  RELCACHE INVALIDATION IN THIS SESSION
+-- =============================================================================
+-- Renaming the index and changing pending_list_limit invalidate its
+-- relcache entry but not the copy, which must keep answering.  Changing
+-- trigrams does not match the copy any more: it is dropped and the index
+-- loaded again with trigram postings.
+
+SELECT biscuit_rel_checks('warm copy', false);
+
+ALTER INDEX biscuit_rel_idx RENAME TO biscuit_rel_idx_renamed;
+ALTER INDEX biscuit_rel_idx_renamed RENAME TO biscuit_rel_idx;
+SELECT biscuit_rel_checks('after rename', false);
+
+ALTER INDEX biscuit_rel_idx SET (pending_list_limit = 128);
+SELECT biscuit_rel_checks('after SET (pending_list_limit)', false);
+
+ALTER INDEX biscuit_rel_idx SET (trigrams = on);
+SELECT biscuit_rel_checks('after SET (trigrams)', false);
+
+DO $$
+BEGIN
+    IF biscuit_index_stats('biscuit_rel_idx'::regclass::oid) !~ '\nTrigrams: [0-9]+' THEN
+        RAISE EXCEPTION '[after SET (trigrams)] the copy was not loaded again:%',
+            E'\n' || biscuit_index_stats('biscuit_rel_idx'::regclass::oid);
+    END IF;
+END $$;
+
+ALTER INDEX biscuit_rel_idx RESET (trigrams, pending_list_limit);
+SELECT biscuit_rel_checks('after RESET', false);
+
+
+-- =============================================================================
+-- §5  A NEW SESSION LOADS A STALE SNAPSHOT
+-- =============================================================================
+-- DML marks the snapshot stale; a new session loads it anyway and
+-- replays the change log written since.
+
+INSERT INTO biscuit_rel_data
+SELECT g, 'amber-new-' || g || '-x' FROM generate_series(10001, 10400) g;
+UPDATE biscuit_rel_data SET name = 'jade-moved-' || id || '-y' WHERE id % 17 = 0;
+DELETE FROM biscuit_rel_data WHERE id % 5 = 0;
+
+DO $$
+BEGIN
+    IF biscuit_rel_state(biscuit_index_stats('biscuit_rel_idx'::regclass::oid))
+       IS DISTINCT FROM 'stale' THEN
+        RAISE EXCEPTION '[after DML] expected a stale snapshot:%',
+            E'\n' || biscuit_index_stats('biscuit_rel_idx'::regclass::oid);
+    END IF;
+END $$;
+
+SELECT biscuit_rel_checks('after DML', false);
+SELECT biscuit_rel_peer_open();
+SELECT biscuit_rel_checks('new session, stale snapshot', true);
+
+
+-- =============================================================================
+-- §6  VACUUM WRITES A VALID SNAPSHOT AGAIN
+-- =============================================================================
+
+VACUUM ANALYZE biscuit_rel_data;
+
+DO $$
+BEGIN
+    IF biscuit_rel_state(biscuit_index_stats('biscuit_rel_idx'::regclass::oid))
+       IS DISTINCT FROM 'valid' THEN
+        RAISE EXCEPTION '[after VACUUM] expected a valid snapshot:%',
+            E'\n' || biscuit_index_stats('biscuit_rel_idx'::regclass::oid);
+    END IF;
+END $$;
+
+SELECT biscuit_rel_checks('after VACUUM', false);
+SELECT biscuit_rel_peer_open();
+SELECT biscuit_rel_checks('new session after VACUUM', true);
+
+SELECT dblink_disconnect('biscuit_rel_peer');
+
+
+-- =============================================================================
+-- §7  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit snapshot reload regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;
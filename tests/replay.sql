@@ -0,0 +1,401 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - CHANGE LOG REPLAY REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit, dblink (a second session writes the table)
+-- =============================================================================
+-- Every insert and bulkdelete appends an entry to the change log in the
+-- index relation.  This session keeps a warm copy of each index while a
+-- second session, opened through dblink, changes the table; the copy
+-- must catch up by replaying the new entries, not by loading the index
+-- again, and answer like a sequential scan.  biscuit_index_stats() shows
+-- the copy's log version and how many entries it replayed.  A snapshot
+-- written by VACUUM truncates the log, and replay resumes from there.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Data & Indexes
+--   §3  Changes Made In This Session
+--   §4  Inserts And Updates From Another Session
+--   §5  Entries Spanning Log Pages
+--   §6  Deletes Logged By VACUUM In Another Session
+--   §7  Replay After The Log Was Truncated
+--   §8  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_log_data    CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+CREATE EXTENSION IF NOT EXISTS dblink;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+/*
+ * The change log line of biscuit_index_stats(): the metapage version,
+ * the truncation point, the version of this session's copy and the
+ * entries it has replayed, in that order.
+ */
+CREATE OR REPLACE FUNCTION biscuit_log_stat(p_index TEXT)
+RETURNS BIGINT[]
+LANGUAGE sql
+AS $$
+    SELECT regexp_match(biscuit_index_stats(p_index::regclass::oid),
+        'Change log: version ([0-9]+) \(truncated at ([0-9]+)\), this copy at ([0-9]+), ([0-9]+) entries replayed')::BIGINT[]
+$$;
+
+/*
+ * Raise unless this session's copy of p_index is at the newest version
+ * and has replayed at least p_min_replayed entries since p_before, an
+ * earlier biscuit_log_stat() (no lower bound when p_before is NULL).
+ */
+CREATE OR REPLACE FUNCTION biscuit_log_expect(p_step TEXT, p_index TEXT,
+                                              p_before BIGINT[], p_min_replayed BIGINT)
+RETURNS BIGINT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_now BIGINT[] := biscuit_log_stat(p_index);
+BEGIN
+    IF v_now IS NULL OR v_now[3] <> v_now[1] THEN
+        RAISE EXCEPTION '[%] % copy is not at the newest version:%', p_step, p_index,
+            E'\n' || biscuit_index_stats(p_index::regclass::oid);
+    END IF;
+    IF p_before IS NOT NULL AND v_now[4] - p_before[4] < p_min_replayed THEN
+        RAISE EXCEPTION '[%] % replayed % entries, expected at least %:%', p_step, p_index,
+            v_now[4] - p_before[4], p_min_replayed,
+            E'\n' || biscuit_index_stats(p_index::regclass::oid);
+    END IF;
+    RETURN v_now;
+END;
+$$;
+
+-- The same queries at every step, on both indexes.
+CREATE OR REPLACE FUNCTION biscuit_log_checks(p_step TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM biscuit_ops_check(p_step || ': prefix',
+        $q$SELECT id::TEXT FROM biscuit_log_data WHERE name LIKE 'peer-%'$q$,
+        'biscuit_log_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': infix',
+        $q$SELECT id::TEXT FROM biscuit_log_data WHERE name LIKE '%-1_4%'$q$,
+        'biscuit_log_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': ILIKE',
+        $q$SELECT id::TEXT FROM biscuit_log_data WHERE name ILIKE '%MOVED%'$q$,
+        'biscuit_log_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': NOT LIKE',
+        $q$SELECT id::TEXT FROM biscuit_log_data WHERE name NOT LIKE '%a%'$q$,
+        'biscuit_log_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': long values',
+        $q$SELECT id::TEXT FROM biscuit_log_data WHERE name LIKE 'long-%xyz%'$q$,
+        'biscuit_log_name_idx');
+    PERFORM biscuit_ops_check(p_step || ': values',
+        $q$SELECT name FROM biscuit_log_data WHERE name LIKE 'peer-%3'$q$,
+        'biscuit_log_name_idx', ARRAY['index', 'bitmap', 'indexonly']);
+    PERFORM biscuit_ops_check(p_step || ': second column',
+        $q$SELECT id::TEXT FROM biscuit_log_data WHERE code LIKE 'P%7'$q$,
+        'biscuit_log_multi_idx');
+    PERFORM biscuit_ops_check(p_step || ': NULLs in the second column',
+        $q$SELECT coalesce(code, '<null>') FROM biscuit_log_data WHERE name LIKE 'peer-%0'$q$,
+        'biscuit_log_multi_idx', ARRAY['indexonly']);
+END;
+$$;
+
+
+-- =============================================================================
+-- §2  DATA & INDEXES
+-- =============================================================================
+
+CREATE TABLE biscuit_log_data (
+    id    INT PRIMARY KEY,
+    name  TEXT,
+    code  TEXT
+);
+
+INSERT INTO biscuit_log_data
+SELECT g, (ARRAY['alpha', 'beta', 'gamma'])[1 + g % 3] || '-' || g,
+       'C' || lpad((g % 500)::TEXT, 3, '0')
+FROM generate_series(1, 5000) g;
+
+CREATE INDEX biscuit_log_name_idx  ON biscuit_log_data USING biscuit (name);
+CREATE INDEX biscuit_log_multi_idx ON biscuit_log_data USING biscuit (name, code);
+VACUUM ANALYZE biscuit_log_data;
+
+-- Load both copies here before the other session writes anything
+SELECT biscuit_log_checks('warm copies');
+
+SELECT dblink_connect('biscuit_log_peer', 'dbname=' || current_database());
+
+
+-- =============================================================================
+-- §3  CHANGES MADE IN THIS SESSION
+-- =============================================================================
+-- The copy here takes its own changes directly and follows the log
+-- without replaying them.
+
+CREATE TEMP TABLE biscuit_log_before AS
+SELECT biscuit_log_stat('biscuit_log_name_idx') AS s;
+
+INSERT INTO biscuit_log_data
+SELECT g, 'local-' || g || '-a', 'L' || g FROM generate_series(6001, 6100) g;
+SELECT biscuit_log_checks('local insert');
+
+DO $$
+DECLARE
+    v_before BIGINT[] := (SELECT s FROM biscuit_log_before);
+    v_now    BIGINT[];
+BEGIN
+    v_now := biscuit_log_expect('local insert', 'biscuit_log_name_idx', NULL, 0);
+    IF v_now[1] <= v_before[1] THEN
+        RAISE EXCEPTION '[local insert] the log version did not move: % -> %', v_before, v_now;
+    END IF;
+    IF v_now[4] <> v_before[4] THEN
+        RAISE EXCEPTION '[local insert] replayed % of its own entries', v_now[4] - v_before[4];
+    END IF;
+END $$;
+
+
+-- =============================================================================
+-- §4  INSERTS AND UPDATES FROM ANOTHER SESSION
+-- =============================================================================
+
+TRUNCATE biscuit_log_before;
+INSERT INTO biscuit_log_before SELECT biscuit_log_stat('biscuit_log_name_idx');
+
+SELECT dblink_exec('biscuit_log_peer', $q$
+    INSERT INTO biscuit_log_data
+    SELECT 10000 + g, 'peer-' || g || '-abc', CASE WHEN g % 4 = 0 THEN NULL ELSE 'P' || g END
+    FROM generate_series(1, 300) g
+$q$);
+SELECT biscuit_log_checks('peer insert');
+SELECT biscuit_log_expect('peer insert', 'biscuit_log_name_idx',
+                          (SELECT s FROM biscuit_log_before), 300);
+
+TRUNCATE biscuit_log_before;
+INSERT INTO biscuit_log_before SELECT biscuit_log_stat('biscuit_log_name_idx');
+
+SELECT dblink_exec('biscuit_log_peer', $q$
+    UPDATE biscuit_log_data SET name = 'peer-moved-' || id WHERE id BETWEEN 10001 AND 10050
+$q$);
+SELECT dblink_exec('biscuit_log_peer', $q$
+    UPDATE biscuit_log_data SET code = NULL WHERE id % 9 = 0
+$q$);
+SELECT biscuit_log_checks('peer update');
+SELECT biscuit_log_expect('peer update', 'biscuit_log_name_idx',
+                          (SELECT s FROM biscuit_log_before), 50);
+SELECT biscuit_log_expect('peer update', 'biscuit_log_multi_idx', NULL, 0);
+
+
+-- =============================================================================
+-- §5  ENTRIES SPANNING LOG PAGES
+-- =============================================================================
+-- Each value is longer than a page, so its entry continues on new ones.
+
+TRUNCATE biscuit_log_before;
+INSERT INTO biscuit_log_before SELECT biscuit_log_stat('biscuit_log_name_idx');
+
+SELECT dblink_exec('biscuit_log_peer', $q$
+    INSERT INTO biscuit_log_data
+    SELECT 20000 + g, 'long-' || g || '-' || repeat('abcdefgh', 1500) || 'xyz', 'LONG'
+    FROM generate_series(1, 5) g
+$q$);
+SELECT biscuit_log_checks('peer long values');
+SELECT biscuit_log_expect('peer long values', 'biscuit_log_name_idx',
+                          (SELECT s FROM biscuit_log_before), 5);
+
+
+-- =============================================================================
+-- §6  DELETES LOGGED BY VACUUM IN ANOTHER SESSION
+-- =============================================================================
+-- The rows vanish from the heap at once; the copy here drops their
+-- records when it replays the delete entries VACUUM appends.  VACUUM
+-- also writes a new snapshot and truncates the log, so the copy may be
+-- loaded again instead; either way it must end up at the newest version.
+
+SELECT dblink_exec('biscuit_log_peer', $q$
+    DELETE FROM biscuit_log_data WHERE id % 3 = 0
+$q$);
+SELECT biscuit_log_checks('peer delete');
+SELECT dblink_exec('biscuit_log_peer', 'VACUUM biscuit_log_data');
+SELECT biscuit_log_checks('peer VACUUM');
+SELECT biscuit_log_expect('peer VACUUM', 'biscuit_log_name_idx', NULL, 0);
+SELECT biscuit_log_expect('peer VACUUM', 'biscuit_log_multi_idx', NULL, 0);
+
+
+-- =============================================================================
+-- §7  REPLAY AFTER THE LOG WAS TRUNCATED
+-- =============================================================================
+
+TRUNCATE biscuit_log_before;
+INSERT INTO biscuit_log_before SELECT biscuit_log_stat('biscuit_log_name_idx');
+
+SELECT dblink_exec('biscuit_log_peer', $q$
+    INSERT INTO biscuit_log_data
+    SELECT 30000 + g, 'peer-after-' || g || '-abc', 'P' || g
+    FROM generate_series(1, 120) g
+$q$);
+SELECT biscuit_log_checks('peer insert after truncation');
+
+DO $$
+DECLARE
+    v_before BIGINT[] := (SELECT s FROM biscuit_log_before);
+    v_now    BIGINT[];
+BEGIN
+    v_now := biscuit_log_expect('peer insert after truncation', 'biscuit_log_name_idx',
+                                v_before, 120);
+    IF v_now[2] <> v_before[2] THEN
+        RAISE EXCEPTION '[peer insert after truncation] the log was truncated again: % -> %',
+            v_before, v_now;
+    END IF;
+END $$;
+
+-- And the other way round: the peer's copy replays what this session wrote
+INSERT INTO biscuit_log_data VALUES (40001, 'local-after-xyz', 'LOCAL');
+DO $$
+DECLARE
+    v_peer INT;
+BEGIN
+    SELECT n INTO v_peer
+    FROM dblink('biscuit_log_peer', $q$
+        SET enable_seqscan = off;
+        SELECT count(*)::INT FROM biscuit_log_data WHERE name LIKE 'local-after-%'
+    $q$) AS t(n INT);
+    IF v_peer IS DISTINCT FROM 1 THEN
+        RAISE EXCEPTION '[local insert] peer session found % rows, expected 1', v_peer;
+    END IF;
+    INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+    VALUES ('local insert seen by the peer', 'peer', v_peer, 1);
+END $$;
+
+SELECT dblink_disconnect('biscuit_log_peer');
+DROP TABLE biscuit_log_before;
+
+
+-- =============================================================================
+-- §8  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit change log replay regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;
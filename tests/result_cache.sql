@@ -0,0 +1,367 @@
+-- =============================================================================
+-- BISCUIT POSTGRESQL EXTENSION - PATTERN RESULT CACHE REGRESSION TESTS
+-- =============================================================================
+-- Language:     Pure SQL + PL/pgSQL only. No psql meta-commands.
+-- Deterministic: Yes - fixed data, no random()
+-- Requires:     biscuit, dblink (§7 changes the table from a second session)
+-- =============================================================================
+-- A backend remembers the records each pattern matched, and answers the
+-- same pattern again from that cache.  These checks repeat a handful of
+-- patterns until they hit, change the table in every way that must
+-- reach the cached results (inserts here and in another session,
+-- updates, deletes, VACUUM), and repeat them again.  Every query compares
+-- the rows of a forced Biscuit scan with a sequential scan, so a stale
+-- cached result raises an exception; the hit and entry counters of
+-- biscuit_index_stats() show the cache was really used.
+--
+-- SECTIONS
+--   §1  Schema Setup & Check Helper
+--   §2  Data & Index
+--   §3  Repeated Patterns Hit The Cache
+--   §4  Inserts Patch The Cached Results
+--   §5  Updates And Deletes
+--   §6  VACUUM Drops The Cached Results
+--   §7  Changes From Another Session
+--   §8  Cache Disabled
+--   §9  Summary
+-- =============================================================================
+
+
+-- =============================================================================
+-- §1  SCHEMA SETUP & CHECK HELPER
+-- =============================================================================
+
+DROP TABLE IF EXISTS biscuit_ops_results CASCADE;
+DROP TABLE IF EXISTS biscuit_rc_data     CASCADE;
+
+CREATE EXTENSION IF NOT EXISTS biscuit;
+CREATE EXTENSION IF NOT EXISTS dblink;
+
+CREATE TABLE biscuit_ops_results (
+    check_id    SERIAL PRIMARY KEY,
+    label       TEXT NOT NULL,
+    scan_mode   TEXT NOT NULL,
+    index_rows  INT  NOT NULL,
+    seq_rows    INT  NOT NULL
+);
+
+-- Set the planner switches for one scan mode, for the current transaction.
+CREATE OR REPLACE FUNCTION biscuit_ops_mode(p_mode TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM set_config('enable_seqscan',       (p_mode = 'seq')::TEXT,       true);
+    PERFORM set_config('enable_indexscan',     (p_mode IN ('index', 'indexonly'))::TEXT, true);
+    PERFORM set_config('enable_indexonlyscan', (p_mode = 'indexonly')::TEXT, true);
+    PERFORM set_config('enable_bitmapscan',    (p_mode = 'bitmap')::TEXT,    true);
+END;
+$$;
+
+-- The sorted rows of p_query, a query returning one text column.
+CREATE OR REPLACE FUNCTION biscuit_ops_rows(p_query TEXT)
+RETURNS TEXT[]
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_rows TEXT[];
+BEGIN
+    EXECUTE format('SELECT coalesce(array_agg(r ORDER BY r), ''{}'') FROM (%s) q(r)', p_query)
+        INTO v_rows;
+    RETURN v_rows;
+END;
+$$;
+
+-- The EXPLAIN output of p_query as one string.
+CREATE OR REPLACE FUNCTION biscuit_ops_plan(p_query TEXT)
+RETURNS TEXT
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_line TEXT;
+    v_plan TEXT := '';
+BEGIN
+    FOR v_line IN EXECUTE 'EXPLAIN (COSTS OFF) ' || p_query LOOP
+        v_plan := v_plan || v_line || E'\n';
+    END LOOP;
+    RETURN v_plan;
+END;
+$$;
+
+/*
+ * Run p_query under each of p_modes with p_index forced, and raise if the
+ * plan does not use p_index the way the mode asks or if the rows differ
+ * from a sequential scan.
+ */
+CREATE OR REPLACE FUNCTION biscuit_ops_check(p_label TEXT, p_query TEXT, p_index TEXT,
+                                             p_modes TEXT[] DEFAULT ARRAY['index', 'bitmap'])
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_mode     TEXT;
+    v_plan     TEXT;
+    v_node     TEXT;
+    v_expected TEXT[];
+    v_actual   TEXT[];
+BEGIN
+    PERFORM biscuit_ops_mode('seq');
+    v_plan := biscuit_ops_plan(p_query);
+    IF position(p_index IN v_plan) > 0 THEN
+        RAISE EXCEPTION '[%] baseline plan still uses %:%', p_label, p_index, E'\n' || v_plan;
+    END IF;
+    v_expected := biscuit_ops_rows(p_query);
+
+    FOREACH v_mode IN ARRAY p_modes LOOP
+        PERFORM biscuit_ops_mode(v_mode);
+
+        v_node := CASE v_mode
+                      WHEN 'index'     THEN 'Index Scan using ' || p_index
+                      WHEN 'indexonly' THEN 'Index Only Scan using ' || p_index
+                      ELSE 'Bitmap Index Scan on ' || p_index
+                  END;
+        v_plan := biscuit_ops_plan(p_query);
+        IF position(v_node IN v_plan) = 0 THEN
+            RAISE EXCEPTION '[%] % plan does not show "%":%', p_label, v_mode, v_node,
+                            E'\n' || v_plan;
+        END IF;
+
+        v_actual := biscuit_ops_rows(p_query);
+        INSERT INTO biscuit_ops_results (label, scan_mode, index_rows, seq_rows)
+        VALUES (p_label, v_mode, cardinality(v_actual), cardinality(v_expected));
+
+        IF v_actual IS DISTINCT FROM v_expected THEN
+            RAISE EXCEPTION '[%] % scan returned % rows, sequential scan %: missing %, extra %',
+                p_label, v_mode, cardinality(v_actual), cardinality(v_expected),
+                (SELECT array_agg(e) FROM unnest(v_expected) e WHERE e <> ALL (v_actual)),
+                (SELECT array_agg(a) FROM unnest(v_actual) a WHERE a <> ALL (v_expected));
+        END IF;
+    END LOOP;
+
+    PERFORM set_config('enable_seqscan',       'on', true);
+    PERFORM set_config('enable_indexscan',     'on', true);
+    PERFORM set_config('enable_indexonlyscan', 'on', true);
+    PERFORM set_config('enable_bitmapscan',    'on', true);
+END;
+$$;
+
+-- A counter from biscuit_index_stats(), e.g. 'Hits' or 'Entries'.
+CREATE OR REPLACE FUNCTION biscuit_rc_stat(p_field TEXT)
+RETURNS BIGINT
+LANGUAGE sql
+AS $$
+    SELECT substring(biscuit_index_stats('biscuit_rc_idx'::regclass::oid)
+                     FROM '\n *' || p_field || ': ([0-9]+)')::BIGINT
+$$;
+
+-- The same patterns at every step; NOT LIKE shares the entry of LIKE.
+CREATE OR REPLACE FUNCTION biscuit_rc_checks(p_step TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    PERFORM biscuit_ops_check(p_step || ': infix',
+        $q$SELECT id::TEXT FROM biscuit_rc_data WHERE msg LIKE '%error%'$q$,
+        'biscuit_rc_idx');
+    PERFORM biscuit_ops_check(p_step || ': ILIKE infix',
+        $q$SELECT id::TEXT FROM biscuit_rc_data WHERE msg ILIKE '%ERROR%'$q$,
+        'biscuit_rc_idx');
+    PERFORM biscuit_ops_check(p_step || ': prefix',
+        $q$SELECT msg FROM biscuit_rc_data WHERE msg LIKE 'ORD-2026%'$q$,
+        'biscuit_rc_idx');
+    PERFORM biscuit_ops_check(p_step || ': NOT LIKE',
+        $q$SELECT id::TEXT FROM biscuit_rc_data WHERE msg NOT LIKE '%error%'$q$,
+        'biscuit_rc_idx');
+    PERFORM biscuit_ops_check(p_step || ': multi-part',
+        $q$SELECT id::TEXT FROM biscuit_rc_data WHERE msg LIKE 'ORD-%-1_%warn%'$q$,
+        'biscuit_rc_idx');
+    PERFORM biscuit_ops_check(p_step || ': count(*)',
+        $q$SELECT count(*)::TEXT FROM biscuit_rc_data WHERE msg LIKE '%error%'$q$,
+        'biscuit_rc_idx', ARRAY['bitmap']);
+END;
+$$;
+
+/*
+ * Run the checks twice and raise unless the second round hit the cache
+ * for every one of its scans.
+ */
+CREATE OR REPLACE FUNCTION biscuit_rc_expect_hits(p_step TEXT)
+RETURNS VOID
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    v_hits   BIGINT;
+    v_misses BIGINT;
+BEGIN
+    PERFORM biscuit_rc_checks(p_step);
+    v_hits   := biscuit_rc_stat('Hits');
+    v_misses := biscuit_rc_stat('Misses');
+
+    PERFORM biscuit_rc_checks(p_step || ', repeated');
+    IF biscuit_rc_stat('Hits') <= v_hits OR biscuit_rc_stat('Misses') <> v_misses THEN
+        RAISE EXCEPTION '[%] repeated patterns missed the cache:%', p_step,
+            E'\n' || biscuit_index_stats('biscuit_rc_idx'::regclass::oid);
+    END IF;
+END;
+$$;
+
+
+-- =============================================================================
+-- §2  DATA & INDEX
+-- =============================================================================
+
+CREATE TABLE biscuit_rc_data (
+    id   INT PRIMARY KEY,
+    msg  TEXT
+);
+
+INSERT INTO biscuit_rc_data
+SELECT g, (ARRAY['ORD-2026', 'ORD-2025', 'INV-2026'])[1 + g % 3] || '-' || g || ' ' ||
+          (ARRAY['ok', 'error: timeout', 'warn: slow', 'ERROR: disk', 'info'])[1 + g % 5]
+FROM generate_series(1, 10000) g;
+
+CREATE INDEX biscuit_rc_idx ON biscuit_rc_data USING biscuit (msg);
+VACUUM ANALYZE biscuit_rc_data;
+
+SET biscuit.result_cache_size = '4MB';
+
+
+-- =============================================================================
+-- §3  REPEATED PATTERNS HIT THE CACHE
+-- =============================================================================
+
+SELECT biscuit_rc_expect_hits('repeated');
+
+DO $$
+BEGIN
+    IF biscuit_rc_stat('Entries') = 0 THEN
+        RAISE EXCEPTION '[repeated] no cached results:%',
+            E'\n' || biscuit_index_stats('biscuit_rc_idx'::regclass::oid);
+    END IF;
+END $$;
+
+
+-- =============================================================================
+-- §4  INSERTS PATCH THE CACHED RESULTS
+-- =============================================================================
+-- The entries stay, patched for the new records, so the first round
+-- after the insert hits the cache already and must see the new rows.
+
+CREATE TEMP TABLE biscuit_rc_before AS SELECT biscuit_rc_stat('Hits') AS hits;
+
+INSERT INTO biscuit_rc_data
+SELECT g, 'ORD-2026-' || g || ' error: new'
+FROM generate_series(20001, 20200) g;
+INSERT INTO biscuit_rc_data VALUES (20301, 'ORD-2026 ERROR'), (20302, 'error'), (20303, '');
+SELECT biscuit_rc_checks('after insert');
+
+DO $$
+BEGIN
+    IF biscuit_rc_stat('Hits') <= (SELECT hits FROM biscuit_rc_before) THEN
+        RAISE EXCEPTION '[after insert] the insert dropped the cached results:%',
+            E'\n' || biscuit_index_stats('biscuit_rc_idx'::regclass::oid);
+    END IF;
+END $$;
+
+DROP TABLE biscuit_rc_before;
+
+
+-- =============================================================================
+-- §5  UPDATES AND DELETES
+-- =============================================================================
+
+UPDATE biscuit_rc_data SET msg = 'ORD-2026-' || id || ' warn: moved' WHERE id % 17 = 0;
+UPDATE biscuit_rc_data SET msg = 'resolved' WHERE msg LIKE '%error: timeout' AND id % 2 = 0;
+DELETE FROM biscuit_rc_data WHERE id % 23 = 0;
+SELECT biscuit_rc_expect_hits('after update and delete');
+
+
+-- =============================================================================
+-- §6  VACUUM DROPS THE CACHED RESULTS
+-- =============================================================================
+
+VACUUM ANALYZE biscuit_rc_data;
+
+DO $$
+BEGIN
+    IF biscuit_rc_stat('Entries') <> 0 THEN
+        RAISE EXCEPTION '[after VACUUM] cached results survived VACUUM:%',
+            E'\n' || biscuit_index_stats('biscuit_rc_idx'::regclass::oid);
+    END IF;
+END $$;
+
+SELECT biscuit_rc_expect_hits('after VACUUM');
+
+
+-- =============================================================================
+-- §7  CHANGES FROM ANOTHER SESSION
+-- =============================================================================
+-- This session's copy replays the other session's inserts, which patch
+-- its cached results like its own inserts do.  The other session's
+-- VACUUM then drops them.
+
+SELECT biscuit_rc_checks('before peer changes');
+CREATE TEMP TABLE biscuit_rc_before AS SELECT biscuit_rc_stat('Hits') AS hits;
+
+SELECT dblink_connect('biscuit_rc_peer', 'dbname=' || current_database());
+SELECT dblink_exec('biscuit_rc_peer', $q$
+    INSERT INTO biscuit_rc_data
+    SELECT 30000 + g, 'ORD-2026-' || g || ' error: peer warn'
+    FROM generate_series(1, 150) g
+$q$);
+SELECT biscuit_rc_checks('after peer insert');
+
+DO $$
+BEGIN
+    IF biscuit_rc_stat('Hits') <= (SELECT hits FROM biscuit_rc_before) THEN
+        RAISE EXCEPTION '[after peer insert] replay dropped the cached results:%',
+            E'\n' || biscuit_index_stats('biscuit_rc_idx'::regclass::oid);
+    END IF;
+END $$;
+
+DROP TABLE biscuit_rc_before;
+
+SELECT dblink_exec('biscuit_rc_peer', $q$
+    DELETE FROM biscuit_rc_data WHERE id BETWEEN 30001 AND 30020
+$q$);
+SELECT dblink_exec('biscuit_rc_peer', 'VACUUM biscuit_rc_data');
+SELECT dblink_disconnect('biscuit_rc_peer');
+
+SELECT biscuit_rc_expect_hits('after peer VACUUM');
+
+
+-- =============================================================================
+-- §8  CACHE DISABLED
+-- =============================================================================
+
+SET biscuit.result_cache_size = 0;
+
+DO $$
+DECLARE
+    v_hits BIGINT := biscuit_rc_stat('Hits');
+BEGIN
+    PERFORM biscuit_rc_checks('cache disabled');
+    PERFORM biscuit_rc_checks('cache disabled, repeated');
+    IF biscuit_rc_stat('Hits') <> v_hits THEN
+        RAISE EXCEPTION '[cache disabled] scans still hit the cache:%',
+            E'\n' || biscuit_index_stats('biscuit_rc_idx'::regclass::oid);
+    END IF;
+END $$;
+
+RESET biscuit.result_cache_size;
+
+
+-- =============================================================================
+-- §9  SUMMARY
+-- =============================================================================
+
+SELECT scan_mode, count(*) AS checks, sum(index_rows) AS rows_compared
+FROM biscuit_ops_results
+GROUP BY scan_mode
+ORDER BY scan_mode;
+
+DO $$
+BEGIN
+    RAISE NOTICE 'Biscuit pattern result cache regression tests: % checks passed',
+        (SELECT count(*) FROM biscuit_ops_results);
+END $$;